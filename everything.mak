@@ -22,7 +22,7 @@ endif
 all: 
 	@$(MAKE) -f $(lastword $(MAKEFILE_LIST)) -j$(MAKE_JOBS) all-targets
 
-all-targets : mathlib raytrace serverplugin_empty tier1 vgui_controls 
+all-targets : mathlib raytrace serverplugin_empty tier1 tier1bench vgui_controls vmpitest vrad_dll vrad_launcher vvis_dll vvis_launcher 
 
 
 # Individual projects + dependencies
@@ -43,10 +43,34 @@ tier1 :
 	@echo "Building: tier1"
 	@+cd /home/luna/prog/lemon-project/sp/src/tier1 && $(MAKE) -f tier1_linux32.mak $(CLEANPARAM)
 
+tier1bench : mathlib tier1 
+	@echo "Building: tier1bench"
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/tier1bench && $(MAKE) -f tier1bench_linux32.mak $(CLEANPARAM)
+
 vgui_controls : 
 	@echo "Building: vgui_controls"
 	@+cd /home/luna/prog/lemon-project/sp/src/vgui2/vgui_controls && $(MAKE) -f vgui_controls_linux32.mak $(CLEANPARAM)
 
+vmpitest : mathlib tier1 
+	@echo "Building: vmpitest"
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/vmpitest && $(MAKE) -f vmpitest_linux32.mak $(CLEANPARAM)
+
+vrad_dll : mathlib raytrace tier1 
+	@echo "Building: vrad_dll"
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/vrad && $(MAKE) -f vrad_dll_linux32.mak $(CLEANPARAM)
+
+vrad_launcher : tier1 
+	@echo "Building: vrad_launcher"
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/vrad_launcher && $(MAKE) -f vrad_launcher_linux32.mak $(CLEANPARAM)
+
+vvis_dll : mathlib tier1 
+	@echo "Building: vvis_dll"
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/vvis && $(MAKE) -f vvis_dll_linux32.mak $(CLEANPARAM)
+
+vvis_launcher : tier1 
+	@echo "Building: vvis_launcher"
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/vvis_launcher && $(MAKE) -f vvis_launcher_linux32.mak $(CLEANPARAM)
+
 # this is a bit over-inclusive, but the alternative (actually adding each referenced c/cpp/h file to
 # the tags file) seems like more work than it's worth.  feel free to fix that up if it bugs you. 
 TAGS:
@@ -63,15 +87,33 @@ TAGS:
 	@find /home/luna/prog/lemon-project/sp/src/tier1 -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
 	@find /home/luna/prog/lemon-project/sp/src/tier1 -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
 	@find /home/luna/prog/lemon-project/sp/src/tier1 -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/tier1bench -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/tier1bench -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/tier1bench -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
 	@find /home/luna/prog/lemon-project/sp/src/vgui2/vgui_controls -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
 	@find /home/luna/prog/lemon-project/sp/src/vgui2/vgui_controls -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
 	@find /home/luna/prog/lemon-project/sp/src/vgui2/vgui_controls -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vmpitest -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vmpitest -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vmpitest -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vrad -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vrad -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vrad -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vrad_launcher -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vrad_launcher -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vrad_launcher -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vvis -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vvis -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vvis -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vvis_launcher -name '*.cpp' -print0 | xargs -0 etags --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vvis_launcher -name '*.h' -print0 | xargs -0 etags --language=c++ --declarations --ignore-indentation --append
+	@find /home/luna/prog/lemon-project/sp/src/utils/vvis_launcher -name '*.c' -print0 | xargs -0 etags --declarations --ignore-indentation --append
 
 
 
 # Mark all the projects as phony or else make will see the directories by the same name and think certain targets 
 
-.PHONY: TAGS showtargets regen showregen clean cleantargets cleanandremove relink mathlib raytrace serverplugin_empty tier1 vgui_controls 
+.PHONY: TAGS showtargets regen showregen check clean cleantargets cleanandremove relink mathlib raytrace serverplugin_empty tier1 tier1bench vgui_controls vmpitest vrad_dll vrad_launcher vvis_dll vvis_launcher 
 
 
 
@@ -96,6 +138,14 @@ cleanandremove:
 
 
 
+# Build and run the tier1 correctness checks and the local VMPI job.
+
+check: tier1bench vmpitest
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/tier1bench && $(MAKE) -f tier1bench_linux32.mak check
+	@+cd /home/luna/prog/lemon-project/sp/src/utils/vmpitest && $(MAKE) -f vmpitest_linux32.mak check
+
+
+
 #relink
 
 relink: cleantargets 
@@ -117,7 +167,13 @@ showtargets:
 	echo 'raytrace' && \
 	echo 'serverplugin_empty' && \
 	echo 'tier1' && \
-	echo 'vgui_controls'
+	echo 'tier1bench' && \
+	echo 'vgui_controls' && \
+	echo 'vmpitest' && \
+	echo 'vrad_dll' && \
+	echo 'vrad_launcher' && \
+	echo 'vvis_dll' && \
+	echo 'vvis_launcher'
 
 
 
@@ -33,6 +33,8 @@ static CUtlVector<IServerNetworkable*> g_DeleteList;
 CGlobalEntityList gEntList;
 CBaseEntityList *g_pEntityList = &gEntList;
 
+ConVar sv_findentity_index( "sv_findentity_index", "1", 0, "Find entities by targetname and classname through the name index instead of checking every entity." );
+
 class CAimTargetManager : public IEntityListener
 {
 public:
@@ -290,10 +292,129 @@ CBaseEntityClassList::~CBaseEntityClassList()
 {
 }
 
+
+//-----------------------------------------------------------------------------
+// CEntityNameIndex
+//-----------------------------------------------------------------------------
+CEntityNameIndex::CEntityNameIndex()
+{
+	Purge();
+}
+
+void CEntityNameIndex::Purge()
+{
+	m_Groups.Purge();
+	for ( int i = 0; i < NUM_ENT_ENTRIES; i++ )
+	{
+		m_Links[i].m_Name = NULL_STRING;
+		m_Links[i].m_Key = NULL_STRING;
+		m_Links[i].m_iPrev = m_Links[i].m_iNext = -1;
+	}
+	m_nCount = 0;
+}
+
+void CEntityNameIndex::FoldName( const char *pszName, char *pszFolded, int nFoldedSize )
+{
+	// NamesMatch()'s ascii case conversion doesn't check that characters are
+	// letters, so any two ascii characters 32 apart can match ('0' and 'P',
+	// '?' and '_'). Folding to the low five bits keeps all of those together.
+	int i;
+	for ( i = 0; i < nFoldedSize - 1 && pszName[i]; i++ )
+	{
+		unsigned char c = pszName[i];
+		pszFolded[i] = ( c < 128 ) ? ( ( c & 31 ) | '@' ) : c;
+	}
+	pszFolded[i] = 0;
+}
+
+void CEntityNameIndex::SetName( int iSlot, string_t name, const unsigned int *pSequence )
+{
+	Link_t &link = m_Links[iSlot];
+
+	// Take it out of its old group
+	if ( link.m_Key != NULL_STRING )
+	{
+		UtlHashHandle_t hGroup = m_Groups.Find( STRING( link.m_Key ) );
+		Assert( hGroup != m_Groups.InvalidHandle() );
+		Group_t &group = m_Groups[hGroup];
+
+		if ( link.m_iPrev >= 0 )
+			m_Links[link.m_iPrev].m_iNext = link.m_iNext;
+		else
+			group.m_iHead = link.m_iNext;
+
+		if ( link.m_iNext >= 0 )
+			m_Links[link.m_iNext].m_iPrev = link.m_iPrev;
+		else
+			group.m_iTail = link.m_iPrev;
+
+		if ( group.m_iHead < 0 )
+		{
+			m_Groups.Remove( STRING( link.m_Key ) );
+		}
+		m_nCount--;
+	}
+
+	link.m_Name = name;
+	link.m_Key = NULL_STRING;
+	link.m_iPrev = link.m_iNext = -1;
+
+	if ( name == NULL_STRING )
+		return;
+
+	char szFolded[MAX_FOLDED_NAME];
+	FoldName( STRING( name ), szFolded, sizeof( szFolded ) );
+	link.m_Key = AllocPooledString( szFolded );
+	if ( link.m_Key == NULL_STRING )
+		return;
+
+	Group_t emptyGroup = { -1, -1 };
+	Group_t &group = m_Groups[ m_Groups.Insert( STRING( link.m_Key ), emptyGroup ) ];
+
+	// Entities are mostly named as they're created, at the end of the list, so
+	// look for its place from the end of the group
+	int iPrev = group.m_iTail;
+	while ( iPrev >= 0 && pSequence[iPrev] > pSequence[iSlot] )
+	{
+		iPrev = m_Links[iPrev].m_iPrev;
+	}
+
+	link.m_iPrev = iPrev;
+	link.m_iNext = ( iPrev >= 0 ) ? m_Links[iPrev].m_iNext : group.m_iHead;
+
+	if ( link.m_iPrev >= 0 )
+		m_Links[link.m_iPrev].m_iNext = iSlot;
+	else
+		group.m_iHead = iSlot;
+
+	if ( link.m_iNext >= 0 )
+		m_Links[link.m_iNext].m_iPrev = iSlot;
+	else
+		group.m_iTail = iSlot;
+
+	m_nCount++;
+}
+
+int CEntityNameIndex::First( const char *pszName ) const
+{
+	char szFolded[MAX_FOLDED_NAME];
+	FoldName( pszName, szFolded, sizeof( szFolded ) );
+
+	// If the folded name was never pooled, no entity has been grouped by it
+	string_t key = FindPooledString( szFolded );
+	if ( key == NULL_STRING )
+		return -1;
+
+	UtlHashHandle_t hGroup = m_Groups.Find( STRING( key ) );
+	return ( hGroup != m_Groups.InvalidHandle() ) ? m_Groups[hGroup].m_iHead : -1;
+}
+
+
 CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
 	m_bClearingEntities = false;
+	m_nNextEntitySequence = 0;
 }
 
 
@@ -382,6 +503,12 @@ void CGlobalEntityList::Clear( void )
 	m_iHighestEnt = 0;
 	m_iNumEnts = 0;
 
+	// The groups are keyed by pooled strings, which go away with the level
+	Assert( !m_NameIndex.Count() && !m_ClassnameIndex.Count() );
+	m_NameIndex.Purge();
+	m_ClassnameIndex.Purge();
+	m_nNextEntitySequence = 0;
+
 	m_bClearingEntities = false;
 }
 
@@ -455,6 +582,71 @@ void CGlobalEntityList::ReportEntityFlagsChanged( CBaseEntity *pEntity, unsigned
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Regroups an entity whose targetname or classname changed.
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::ReportEntityNameChanged( CBaseEntity *pEntity )
+{
+	// Entities that aren't in the list yet are grouped when they're added
+	const CBaseHandle &hEnt = pEntity->GetRefEHandle();
+	if ( !hEnt.IsValid() )
+		return;
+
+	int iSlot = hEnt.GetEntryIndex();
+	if ( m_NameIndex.GetName( iSlot ) != pEntity->GetEntityName() )
+	{
+		m_NameIndex.SetName( iSlot, pEntity->GetEntityName(), m_EntitySequence );
+	}
+	if ( m_ClassnameIndex.GetName( iSlot ) != pEntity->m_iClassname )
+	{
+		m_ClassnameIndex.SetName( iSlot, pEntity->m_iClassname, m_EntitySequence );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Iterates the entities in the group for a name that match it.
+// Input  : pStartEntity - Last entity found, NULL to start a new iteration.
+//			szName - Name to search for, without wildcards.
+//			bClassname - Match szName as a classname rather than a targetname.
+//-----------------------------------------------------------------------------
+CBaseEntity *CGlobalEntityList::FindInNameIndex( const CEntityNameIndex &index, CBaseEntity *pStartEntity, const char *szName, bool bClassname, IEntityFindFilter *pFilter )
+{
+	int iSlot = index.First( szName );
+	if ( pStartEntity && iSlot >= 0 )
+	{
+		int iStartSlot = pStartEntity->GetRefEHandle().GetEntryIndex();
+		if ( index.IsSameGroup( iSlot, iStartSlot ) )
+		{
+			iSlot = index.Next( iStartSlot );
+		}
+		else
+		{
+			// The last entity found has been renamed since, carry on from where it is in the list
+			while ( iSlot >= 0 && m_EntitySequence[iSlot] <= m_EntitySequence[iStartSlot] )
+			{
+				iSlot = index.Next( iSlot );
+			}
+		}
+	}
+
+	for ( ; iSlot >= 0; iSlot = index.Next( iSlot ) )
+	{
+		CBaseEntity *pEntity = (CBaseEntity *)GetEntInfoPtrByIndex( iSlot )->m_pEntity;
+		Assert( pEntity );
+
+		// Groups hold every name that folds the same way, so they still have to be compared
+		if ( bClassname ? !pEntity->ClassMatches( szName ) : !pEntity->NameMatches( szName ) )
+			continue;
+
+		if ( pFilter && !pFilter->ShouldFindEntity( pEntity ) )
+			continue;
+
+		return pEntity;
+	}
+
+	return NULL;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Used to confirm a pointer is a pointer to an entity, useful for
 //			asserts.
@@ -481,6 +673,10 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 {
+	// Wildcards have to be checked against every entity
+	if ( szName && szName[0] && !strchr( szName, '*' ) && sv_findentity_index.GetBool() )
+		return FindInNameIndex( m_ClassnameIndex, pStartEntity, szName, true, NULL );
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -590,6 +786,10 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	// Wildcards have to be checked against every entity
+	if ( !strchr( szName, '*' ) && sv_findentity_index.GetBool() )
+		return FindInNameIndex( m_NameIndex, pStartEntity, szName, false, pFilter );
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -1095,6 +1295,13 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
+
+	// It goes at the end of the list
+	int iSlot = handle.GetEntryIndex();
+	m_EntitySequence[iSlot] = m_nNextEntitySequence++;
+	m_NameIndex.SetName( iSlot, pBaseEnt->GetEntityName(), m_EntitySequence );
+	m_ClassnameIndex.SetName( iSlot, pBaseEnt->m_iClassname, m_EntitySequence );
+
 	//DevMsg(2,"Created %s\n", pBaseEnt->GetClassname() );
 	for ( i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
@@ -1125,6 +1332,9 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts--;
 
+	m_NameIndex.Remove( handle.GetEntryIndex() );
+	m_ClassnameIndex.Remove( handle.GetEntryIndex() );
+
 	m_iNumEnts--;
 }
 
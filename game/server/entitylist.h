@@ -14,6 +14,7 @@
 #endif
 
 #include "baseentity.h"
+#include "utlhashtable.h"
 
 class IEntityListener;
 
@@ -66,6 +67,68 @@ public:
 	virtual CBaseEntity *GetFilterResult( void ) = 0;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Groups the entities in the global list by a name (targetname or
+//			classname), so a search for a name only has to look at the
+//			entities that may have it. Each group is kept in entity list
+//			order, so searches find entities in the same order a walk of the
+//			whole list would.
+//
+//			Names are grouped by CEntityNameIndex::FoldName, which puts
+//			together every pair of names CBaseEntity::NameMatches could treat
+//			as the same (and some it wouldn't), so a group holds candidates
+//			that still have to be checked with NameMatches/ClassMatches.
+//-----------------------------------------------------------------------------
+class CEntityNameIndex
+{
+public:
+	CEntityNameIndex();
+
+	// Moves the entity in slot iSlot to the group for name, or out of any group
+	// if name is NULL_STRING. pSequence is the order each slot was added in.
+	void SetName( int iSlot, string_t name, const unsigned int *pSequence );
+	void Remove( int iSlot ) { SetName( iSlot, NULL_STRING, NULL ); }
+	void Purge();
+
+	int Count() const { return m_nCount; }
+
+	// The name the entity in a slot was grouped by
+	string_t GetName( int iSlot ) const { return m_Links[iSlot].m_Name; }
+
+	// The first slot in the group that would hold pszName, or -1
+	int First( const char *pszName ) const;
+	int Next( int iSlot ) const { return m_Links[iSlot].m_iNext; }
+
+	// True if both slots are in the same group
+	bool IsSameGroup( int iSlot1, int iSlot2 ) const { return m_Links[iSlot1].m_Key != NULL_STRING && m_Links[iSlot1].m_Key == m_Links[iSlot2].m_Key; }
+
+	// Names longer than this are grouped by their start
+	enum { MAX_FOLDED_NAME = 128 };
+
+	// Folds every ascii character together with the ones NamesMatch() will
+	// match it to
+	static void FoldName( const char *pszName, char *pszFolded, int nFoldedSize );
+
+private:
+	struct Group_t
+	{
+		int m_iHead;
+		int m_iTail;
+	};
+
+	struct Link_t
+	{
+		string_t m_Name;	// the entity's name when it was grouped
+		string_t m_Key;		// the pooled, folded name it's grouped by
+		int m_iPrev;
+		int m_iNext;
+	};
+
+	CUtlHashtable< const void *, Group_t > m_Groups;
+	Link_t m_Links[NUM_ENT_ENTRIES];
+	int m_nCount;
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: a global list of all the entities in the game.  All iteration through
 //			entities is done through this object.
@@ -81,6 +144,16 @@ private:
 	bool m_bClearingEntities;
 	CUtlVector<IEntityListener *>	m_entityListeners;
 
+	// Targetname and classname groups for the Find functions
+	CEntityNameIndex m_NameIndex;
+	CEntityNameIndex m_ClassnameIndex;
+
+	// The order the entity in each slot was added in, which is its order in the list
+	unsigned int m_EntitySequence[NUM_ENT_ENTRIES];
+	unsigned int m_nNextEntitySequence;
+
+	CBaseEntity *FindInNameIndex( const CEntityNameIndex &index, CBaseEntity *pStartEntity, const char *szName, bool bClassname, IEntityFindFilter *pFilter );
+
 public:
 	IServerNetworkable* GetServerNetworkable( CBaseHandle hEnt ) const;
 	CBaseNetworkable* GetBaseNetworkable( CBaseHandle hEnt ) const;
@@ -108,6 +181,9 @@ public:
 
 	void ReportEntityFlagsChanged( CBaseEntity *pEntity, unsigned int flagsOld, unsigned int flagsNow );
 
+	// The entity's targetname or classname changed, regroup it for the Find functions
+	void ReportEntityNameChanged( CBaseEntity *pEntity );
+
 	// entity is about to be removed, notify the listeners
 	void NotifyCreateEntity( CBaseEntity *pEnt );
 	void NotifySpawn( CBaseEntity *pEnt );
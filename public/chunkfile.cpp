@@ -34,7 +34,11 @@
 
 #include <fcntl.h>
 #ifdef _WIN32
+#include <windows.h>
 #include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 #include <math.h>
 #include <sys/stat.h>
@@ -151,7 +155,7 @@ ChunkHandler_t CChunkHandlerMap::GetHandler(const char *pszChunkName, void **ppD
 		pNode = pNode->pNext;
 	}
 
-	return(false);
+	return(NULL);
 }
 
 
@@ -165,6 +169,12 @@ CChunkFile::CChunkFile(void)
 	m_szIndent[0] = '\0';
 	m_nHandlerStackDepth = 0;
 	m_DefaultChunkHandler = 0;
+	m_pMappedData = NULL;
+	m_nMappedSize = 0;
+#ifdef _WIN32
+	m_hMappedFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#endif
 }
 
 
@@ -177,6 +187,8 @@ CChunkFile::~CChunkFile(void)
 	{
 		fclose(m_hFile);
 	}
+
+	UnmapFile();
 }
 
 
@@ -236,6 +248,9 @@ ChunkFileResult_t CChunkFile::Close(void)
 		m_hFile = NULL;
 	}
 
+	m_TokenReader.Close();
+	UnmapFile();
+
 	return(ChunkFile_Ok);
 }
 
@@ -356,34 +371,10 @@ ChunkFileResult_t CChunkFile::HandleChunk(const char *szChunkName)
 			//
 			// No handler for this chunk. Skip to the matching close curly brace.
 			//
-			int nDepth = 1;
-			ChunkFileResult_t eResult;
-
-			do
+			if (SkipChunk() == ChunkFile_UnexpectedEOF)
 			{
-				ChunkType_t eChunkType;
-				char szKey[MAX_KEYVALUE_LEN];
-				char szValue[MAX_KEYVALUE_LEN];
-
-				while ((eResult = ReadNext(szKey, szValue, sizeof(szValue), eChunkType)) == ChunkFile_Ok)
-				{
-					if (eChunkType == ChunkType_Chunk)
-					{
-						nDepth++;
-					}
-				}
-
-				if (eResult == ChunkFile_EndOfChunk)
-				{
-					eResult = ChunkFile_Ok;
-					nDepth--;
-				}
-				else if (eResult == ChunkFile_EOF)
-				{
-					return(ChunkFile_UnexpectedEOF);
-				}
-
-			} while ((nDepth) && (eResult == ChunkFile_Ok));
+				return(ChunkFile_UnexpectedEOF);
+			}
 		}
 	}
 	
@@ -391,6 +382,58 @@ ChunkFileResult_t CChunkFile::HandleChunk(const char *szChunkName)
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Skips the rest of the chunk that was just entered, up to and
+//			including its close curly brace. When reading from memory this
+//			only looks for braces instead of reading the chunk's keys.
+// Output : ChunkFileResult_t
+//-----------------------------------------------------------------------------
+ChunkFileResult_t CChunkFile::SkipChunk(void)
+{
+	if (m_TokenReader.IsBuffer())
+	{
+		if (!m_TokenReader.SkipBlock())
+		{
+			return(ChunkFile_UnexpectedEOF);
+		}
+
+		m_nCurrentDepth--;
+		return(ChunkFile_Ok);
+	}
+
+	int nDepth = 1;
+	ChunkFileResult_t eResult;
+
+	do
+	{
+		ChunkType_t eChunkType;
+		char szKey[MAX_KEYVALUE_LEN];
+		char szValue[MAX_KEYVALUE_LEN];
+
+		while ((eResult = ReadNext(szKey, szValue, sizeof(szValue), eChunkType)) == ChunkFile_Ok)
+		{
+			if (eChunkType == ChunkType_Chunk)
+			{
+				nDepth++;
+			}
+		}
+
+		if (eResult == ChunkFile_EndOfChunk)
+		{
+			eResult = ChunkFile_Ok;
+			nDepth--;
+		}
+		else if (eResult == ChunkFile_EOF)
+		{
+			return(ChunkFile_UnexpectedEOF);
+		}
+
+	} while ((nDepth) && (eResult == ChunkFile_Ok));
+
+	return(eResult);
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Opens the chunk file for reading or writing.
 // Input  : pszFileName - Path of file to open.
@@ -403,7 +446,11 @@ ChunkFileResult_t CChunkFile::Open(const char *pszFileName, ChunkFileOpenMode_t
 	if (eMode == ChunkFile_Read)
 	{
 		// UNDONE: TokenReader encapsulates file - unify reading and writing to use the same file I/O.
-		// UNDONE: Support in-memory parsing.
+		if (MapFile(pszFileName))
+		{
+			return(OpenBuffer(pszFileName, m_pMappedData, m_nMappedSize));
+		}
+
 		if (m_TokenReader.Open(pszFileName))
 		{
 			m_nCurrentDepth = 0;
@@ -429,6 +476,146 @@ ChunkFileResult_t CChunkFile::Open(const char *pszFileName, ChunkFileOpenMode_t
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Reads chunks out of memory instead of a file.
+// Input  : pszFileName - Name to use in error messages.
+//			pBuffer - Text to read. It must stay valid until the file is closed.
+//			nBufferSize - Number of bytes in pBuffer.
+//			nFirstLine - Line the buffer starts on, for error messages.
+// Output : Returns ChunkFile_Ok on success, ChunkFile_Fail on failure.
+//-----------------------------------------------------------------------------
+ChunkFileResult_t CChunkFile::OpenBuffer(const char *pszFileName, const char *pBuffer, int nBufferSize, int nFirstLine)
+{
+	if (!m_TokenReader.OpenBuffer(pszFileName, pBuffer, nBufferSize, nFirstLine))
+	{
+		return(ChunkFile_Fail);
+	}
+
+	m_nCurrentDepth = 0;
+	return(ChunkFile_Ok);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps a file that is about to be read into memory.
+// Output : Returns false if it can't be mapped, in which case it is read as a stream.
+//-----------------------------------------------------------------------------
+bool CChunkFile::MapFile(const char *pszFileName)
+{
+	UnmapFile();
+
+#ifdef _WIN32
+	HANDLE hFile = ::CreateFile(pszFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		return(false);
+	}
+
+	m_hMappedFile = hFile;
+	m_nMappedSize = (int)::GetFileSize(hFile, NULL);
+	if (m_nMappedSize > 0)
+	{
+		m_hMapping = ::CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_hMapping)
+		{
+			m_pMappedData = (const char *)::MapViewOfFile((HANDLE)m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+#else
+	int fd = open(pszFileName, O_RDONLY);
+	if (fd == -1)
+	{
+		return(false);
+	}
+
+	struct stat st;
+	if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+	{
+		m_nMappedSize = (int)st.st_size;
+		void *pData = mmap(NULL, m_nMappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (pData != MAP_FAILED)
+		{
+			madvise(pData, m_nMappedSize, MADV_SEQUENTIAL);
+			m_pMappedData = (const char *)pData;
+		}
+	}
+	close(fd);
+#endif
+
+	if (m_pMappedData == NULL)
+	{
+		UnmapFile();
+		return(false);
+	}
+
+	return(true);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Releases the mapping made by MapFile.
+//-----------------------------------------------------------------------------
+void CChunkFile::UnmapFile(void)
+{
+#ifdef _WIN32
+	if (m_pMappedData != NULL)
+	{
+		::UnmapViewOfFile(m_pMappedData);
+	}
+	if (m_hMapping != NULL)
+	{
+		::CloseHandle((HANDLE)m_hMapping);
+	}
+	if (m_hMappedFile != INVALID_HANDLE_VALUE)
+	{
+		::CloseHandle((HANDLE)m_hMappedFile);
+	}
+	m_hMapping = NULL;
+	m_hMappedFile = INVALID_HANDLE_VALUE;
+#else
+	if (m_pMappedData != NULL)
+	{
+		munmap((void *)m_pMappedData, m_nMappedSize);
+	}
+#endif
+	m_pMappedData = NULL;
+	m_nMappedSize = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the text being read, or NULL if the file is being read as
+//			a stream.
+//-----------------------------------------------------------------------------
+const char *CChunkFile::GetBuffer(int *pnBufferSize)
+{
+	if (pnBufferSize)
+	{
+		*pnBufferSize = m_nMappedSize;
+	}
+
+	return(m_pMappedData);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the offset into GetBuffer of the next character to be read.
+//-----------------------------------------------------------------------------
+int CChunkFile::GetBufferOffset(void)
+{
+	return(m_TokenReader.GetBufferOffset());
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the line being read, for error messages.
+//-----------------------------------------------------------------------------
+int CChunkFile::GetLine(void)
+{
+	return(m_TokenReader.GetLine());
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Removes the topmost set of chunk handlers.
 //-----------------------------------------------------------------------------
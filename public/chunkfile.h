@@ -123,6 +123,7 @@ class CChunkFile
 		~CChunkFile(void);
 
 		ChunkFileResult_t Open(const char *pszFileName, ChunkFileOpenMode_t eMode);
+		ChunkFileResult_t OpenBuffer(const char *pszFileName, const char *pBuffer, int nBufferSize, int nFirstLine = 1);
 		ChunkFileResult_t Close(void);
 		const char *GetErrorText(ChunkFileResult_t eResult);
 
@@ -150,8 +151,15 @@ class CChunkFile
 		ChunkFileResult_t ReadChunk(KeyHandler_t pfnKeyHandler = NULL, void *pData = NULL);
 		ChunkFileResult_t ReadNext(char *szKey, char *szValue, int nValueSize, ChunkType_t &eChunkType);
 		ChunkFileResult_t HandleChunk(const char *szChunkName);
+		ChunkFileResult_t SkipChunk(void);
 		void HandleError(const char *szChunkName, ChunkFileResult_t eError);
 
+		// Files opened for reading are memory mapped when possible. GetBuffer returns
+		// the mapped file, or NULL if it isn't mapped.
+		const char *GetBuffer(int *pnBufferSize = NULL);
+		int GetBufferOffset(void);
+		int GetLine(void);
+
 		// These functions should more really be named Parsexxx and possibly moved elsewhere.
 		static bool ReadKeyValueBool(const char *pszValue, bool &bBool);
 		static bool ReadKeyValueColor(const char *pszValue, unsigned char &chRed, unsigned char &chGreen, unsigned char &chBlue);
@@ -177,9 +185,19 @@ class CChunkFile
 	protected:
 
 		void BuildIndentString(char *pszDest, int nDepth);
+		bool MapFile(const char *pszFileName);
+		void UnmapFile(void);
 
 		TokenReader m_TokenReader;
 
+		// The file being read, if it could be mapped.
+		const char *m_pMappedData;
+		int m_nMappedSize;
+#ifdef _WIN32
+		void *m_hMappedFile;
+		void *m_hMapping;
+#endif
+
 		FILE *m_hFile;
 		char m_szErrorToken[80];
 		char m_szIndent[MAX_INDENT_DEPTH];
@@ -41,6 +41,17 @@ public:
 
 };
 
+/// 8 rays traced together by Trace8Rays. These are kept as two FourRays so that they can be set
+/// up with the usual FourVectors code, and traced as two packets on cpus without AVX.
+class EightRays
+{
+public:
+	FourRays m_Rays[2];										// rays 0-3 and 4-7
+
+	// returns direction sign mask for all 8 rays, or -1 if they can not be traced as a bundle.
+	int CalculateDirectionSignMask(void) const;
+};
+
 /// The format a triangle is stored in for intersections. size of this structure is important.
 /// This structure can be in one of two forms. Before the ray tracing environment is set up, the
 /// ProjectedEdgeEquations hold the coordinates of the 3 vertices, for facilitating bounding box
@@ -193,6 +204,39 @@ protected:
 };
 
 
+#define BVHNODE_STATE_LEAF 3									// low 2 bits of m_nFlags are the split axis, or this
+
+struct CacheOptimizedBVHNode
+{
+	// 32 bytes, so two nodes (the children of a node are always stored next to each other) share
+	// a cache line.
+	float m_flMins[3];
+	int32 m_nChild;											// left child idx (right child is next)
+	                                                        // or first entry in TriangleIndexList
+	                                                        // for leaf nodes.
+	float m_flMaxs[3];
+	int32 m_nFlags;											// split axis or BVHNODE_STATE_LEAF in
+	                                                        // the low 2 bits, triangle count above.
+
+	inline bool IsLeaf(void) const
+	{
+		return ( m_nFlags & 3 ) == BVHNODE_STATE_LEAF;
+	}
+
+	inline int SplitAxis(void) const
+	{
+		assert(!IsLeaf());
+		return m_nFlags & 3;
+	}
+
+	inline int NumberOfTrianglesInLeaf(void) const
+	{
+		assert(IsLeaf());
+		return m_nFlags >> 2;
+	}
+};
+
+
 struct RayTracingSingleResult
 {
 	Vector surface_normal;									// surface normal at intersection
@@ -220,6 +264,7 @@ public:
 #define RTE_FLAGS_FAST_TREE_GENERATION 1
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_COLORS 2				// saves memory if not needed
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_MATERIALS 4
+#define RTE_FLAGS_USE_BVH 8									// binned-SAH bvh instead of the kd-tree
 
 enum RayTraceLightingMode_t {
 	DIRECT_LIGHTING,										// just dot product lighting
@@ -262,6 +307,7 @@ public:
 
 	FourVectors BackgroundColor;							//< color where no intersection
 	CUtlVector<CacheOptimizedKDNode> OptimizedKDTree;		//< the packed kdtree. root is 0
+	CUtlVector<CacheOptimizedBVHNode> OptimizedBVHTree;		//< the packed bvh, if RTE_FLAGS_USE_BVH. root is 0
 	CUtlBlockVector<CacheOptimizedTriangle> OptimizedTriangleList; //< the packed triangles
 	CUtlVector<int32> TriangleIndexList;					//< the list of triangle indices.
 	CUtlVector<LightDesc_t> LightList;						//< the list of lights
@@ -310,6 +356,25 @@ public:
 					RayTracingResult *rslt_out,
 					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
 
+	// fire 8 rays through the scene. When the cpu supports AVX and all 8 rays have the same
+	// direction signs they are traced together as one packet, otherwise this traces each half with
+	// Trace4Rays. TMin, TMax and rslt_out are per half. ppCallbacks, if set, holds a transparent
+	// triangle callback for each half.
+	void Trace8Rays(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],
+					RayTracingResult rslt_out[2],
+					int32 skip_id=-1, ITransparentTriangleCallback **ppCallbacks = NULL);
+
+	// returns true if Trace8Rays traces 8 rays at once on this cpu, so callers can decide
+	// whether to gather work into 8-wide packets at all.
+	static bool SupportsEightWideTracing(void);
+
+	// counts the rays passed to Trace4Rays, Trace8Rays and ray streams, for benchmarking.
+	// Counting is off by default so normal runs don't pay for the interlocked adds.
+	static void EnableRayCounting( bool bEnable );
+	static int64 GetRayCount(void);
+	static bool s_bCountRays;
+	static void AddRayCount( int nRays );
+
 	// compute virtual light sources to model inter-reflection
 	void ComputeVirtualLightSources(void);
 
@@ -356,6 +421,27 @@ public:
 	void CalculateTriangleListBounds(int32 const *tris,int ntris,
 									 Vector &minout, Vector &maxout);
 
+	// bvh alternative to the kd-tree, used when RTE_FLAGS_USE_BVH is set. The tree is built
+	// with binned SAH, with subtrees built in parallel using the tool threads.
+	void SetupBVH(void);
+
+	void TraceBVH4Rays(const FourRays &rays, fltx4 TMin, fltx4 TMax,int DirectionSignMask,
+					   RayTracingResult *rslt_out,
+					   int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
+
+	// 8-wide avx traversals used by Trace8Rays
+	void TraceKD8RaysAVX(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],
+						 int DirectionSignMask, RayTracingResult rslt_out[2],
+						 int32 skip_id, ITransparentTriangleCallback **ppCallbacks);
+	void TraceBVH8RaysAVX(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],
+						  int DirectionSignMask, RayTracingResult rslt_out[2],
+						  int32 skip_id, ITransparentTriangleCallback **ppCallbacks);
+
+	// builds both the kd-tree and the bvh from the triangles added so far, and prints the build
+	// times and traced rays per second for each. Call instead of SetupAccelerationStructure; the
+	// environment is left set up with whichever structure RTE_FLAGS_USE_BVH selects.
+	void BenchmarkAccelerationStructures(int nRays);
+
 	void AddInfinitePointLight(Vector position,				// light center
 							   Vector intensity);			// rgb amount
 
@@ -231,6 +231,46 @@ public:
 #endif
 	}
 
+	// Pushes nCount nodes already linked from pFirst to pLast through their Next
+	// pointers with a single exchange
+	void PushChain( TSLNodeBase_t *pFirst, TSLNodeBase_t *pLast, int nCount )
+	{
+#ifdef USE_NATIVE_SLIST
+		TSLNodeBase_t *pNode = pFirst;
+		for ( int i = 0; i < nCount; i++ )
+		{
+			TSLNodeBase_t *pNext = pNode->Next;
+			Push( pNode );
+			pNode = pNext;
+		}
+#else
+		TSLHead_t oldHead;
+		TSLHead_t newHead;
+
+		#if defined( PLATFORM_PS3 ) || defined( PLATFORM_X360 )
+		__lwsync(); // write-release barrier
+		#endif
+
+#ifdef PLATFORM_64BITS
+		newHead.value.Padding = 0;
+#endif
+		for (;;)
+		{
+			oldHead.value64x128 = m_Head.value64x128;
+			pLast->Next = oldHead.value.Next;
+			newHead.value.Next = pFirst;
+
+			newHead.value32.DepthAndSequence = oldHead.value32.DepthAndSequence + 0x10000 + nCount;
+
+			if ( ThreadInterlockedAssignIf64x128( &m_Head.value64x128, newHead.value64x128, oldHead.value64x128 ) )
+			{
+				break;
+			}
+			ThreadPause();
+		};
+#endif
+	}
+
 	TSLNodeBase_t *Pop()
 	{
 #ifdef USE_NATIVE_SLIST
@@ -78,6 +78,11 @@ public:
 	//	understand the implications before using this.
 	static void SetUseGrowableStringTable( bool bUseGrowableTable );
 
+	// When set, LoadFromFile reads text files through a compiled image cached
+	// beside them (see tier1/kvimage.h), compiling the image when it's missing or
+	// stale. Saves parsing the same scripts on every level load.
+	static void SetUseCompiledCache( bool bUseCache );
+
 	KeyValues( const char *setName );
 
 	//
@@ -256,6 +261,8 @@ public:
 	void RecursiveMergeKeyValues( KeyValues *baseKV );
 
 private:
+	friend class CKeyValuesImage;	// builds trees straight from compiled images
+
 	KeyValues( KeyValues& );	// prevent copy constructor being used
 
 	// prevent delete being called except through deleteThis()
@@ -0,0 +1,241 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compiled KeyValues images. A KeyValues tree flattened into one
+//			block of memory that can be mapped straight from disk and read
+//			in place, without tokenizing the text or allocating any nodes.
+//
+//			Keys are read through KeyValuesImageKey, which mirrors the read
+//			side of KeyValues. Code that needs to change a subtree (or pass it
+//			to something that takes KeyValues) turns just that subtree into
+//			real KeyValues with MakeKeyValues.
+//
+//			Images are cached next to the text they were compiled from
+//			("scripts/weapon_ar2.txt" -> "scripts/weapon_ar2.txt.kvb"). A cache
+//			is used while every file it was parsed from (the text plus its
+//			#include and #base files) has the same time stamp, or failing that
+//			the same CRC, as when it was compiled.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef KVIMAGE_H
+#define KVIMAGE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "KeyValues.h"
+#include "utlbuffer.h"
+#include "utlstring.h"
+#include "checksum_crc.h"
+
+class IBaseFileSystem;
+class CKeyValuesImage;
+
+
+#define KVIMAGE_ID				MAKEID( 'K', 'V', 'B', 'I' )
+#define KVIMAGE_VERSION			1
+#define KVIMAGE_CACHE_EXTENSION	".kvb"
+
+// How the text was parsed. A cached image is only used if these match the load.
+enum
+{
+	KVIMAGE_FLAG_ESCAPE_SEQUENCES	= 0x0001,	// KeyValues::UsesEscapeSequences( true )
+	KVIMAGE_FLAG_NO_CONDITIONALS	= 0x0002,	// KeyValues::UsesConditionals( false )
+
+	KVIMAGE_LOAD_FLAGS				= 0x00ff,
+
+	// The platform [$WIN32] etc. conditionals were evaluated for. Set when compiling.
+	KVIMAGE_PLATFORM_X360			= 0x0100,
+	KVIMAGE_PLATFORM_PC				= 0x0200,
+	KVIMAGE_PLATFORM_WINDOWS		= 0x0400,
+	KVIMAGE_PLATFORM_OSX			= 0x0800,
+	KVIMAGE_PLATFORM_LINUX			= 0x1000,
+	KVIMAGE_PLATFORM_POSIX			= 0x2000,
+};
+
+
+//-----------------------------------------------------------------------------
+// On disk layout. All offsets are from the start of the image, strings are
+// offsets into the string block, and nodes are indices into the node block.
+// Everything is in the byte order of the platform that wrote it.
+//-----------------------------------------------------------------------------
+struct KVImageHeader_t
+{
+	int			m_nId;
+	int			m_nVersion;
+	int			m_nSize;				// the whole image, including this header
+	int			m_nFlags;
+	int			m_nDependencyCount;		// the source file, then every file it included
+	int			m_nDependencyOffset;
+	int			m_nNodeCount;			// node 0 is the first top level key
+	int			m_nNodeOffset;
+	int			m_nStringBytes;
+	int			m_nStringOffset;
+};
+
+struct KVImageDependency_t
+{
+	int64		m_nFileTime;
+	int			m_nFileName;
+	int			m_nFileSize;
+	CRC32_t		m_nCRC;
+	int			m_nPad;
+};
+
+// A file an image is compiled from, see CKeyValuesImage::Compile
+struct KVImageSourceFile_t
+{
+	CUtlString	m_FileName;
+	int64		m_nFileTime;
+	int			m_nFileSize;
+	CRC32_t		m_nCRC;
+};
+
+struct KVImageNode_t
+{
+	int			m_nName;
+	unsigned	m_nNameHash;		// CKeyValuesImage::HashKeyName of the name
+	int			m_nNext;			// the next peer, or -1
+	int			m_nFirstChild;		// the first subkey, or -1
+	int			m_nString;			// leaves: the value as KeyValues::GetString gives it
+	unsigned char m_nType;			// KeyValues::types_t
+	unsigned char m_Pad[3];
+	union
+	{
+		int		m_iValue;
+		float	m_flValue;
+		unsigned char m_Color[4];
+		unsigned int m_Uint64[2];	// in memory order, read with memcpy
+	};
+};
+
+
+//-----------------------------------------------------------------------------
+// A key in an image. Cheap to copy; only valid as long as the image is.
+// The accessors behave like the KeyValues ones of the same name, except that
+// reading a number as a string doesn't change the key's type.
+//-----------------------------------------------------------------------------
+class KeyValuesImageKey
+{
+public:
+	KeyValuesImageKey() : m_pImage( NULL ), m_nNode( -1 ) {}
+
+	bool IsValid() const { return m_nNode >= 0; }
+	const char *GetName() const;
+
+	KeyValuesImageKey FindKey( const char *keyName ) const;
+
+	KeyValuesImageKey GetFirstSubKey() const;
+	KeyValuesImageKey GetNextKey() const;
+	KeyValuesImageKey GetFirstTrueSubKey() const;
+	KeyValuesImageKey GetNextTrueSubKey() const;
+	KeyValuesImageKey GetFirstValue() const;
+	KeyValuesImageKey GetNextValue() const;
+
+	int   GetInt( const char *keyName = NULL, int defaultValue = 0 ) const;
+	uint64 GetUint64( const char *keyName = NULL, uint64 defaultValue = 0 ) const;
+	float GetFloat( const char *keyName = NULL, float defaultValue = 0.0f ) const;
+	const char *GetString( const char *keyName = NULL, const char *defaultValue = "" ) const;
+	bool GetBool( const char *keyName = NULL, bool defaultValue = false ) const;
+	Color GetColor( const char *keyName = NULL ) const;
+	bool IsEmpty( const char *keyName = NULL ) const;
+	KeyValues::types_t GetDataType( const char *keyName = NULL ) const;
+
+	// Copies this key and everything under it (but not its peers) into new
+	// KeyValues. Free them with deleteThis.
+	KeyValues *MakeKeyValues() const;
+
+private:
+	friend class CKeyValuesImage;
+	KeyValuesImageKey( const CKeyValuesImage *pImage, int nNode ) : m_pImage( pImage ), m_nNode( nNode ) {}
+
+	const KVImageNode_t &Node() const;
+
+	const CKeyValuesImage *m_pImage;
+	int m_nNode;
+};
+
+#define FOR_EACH_IMAGE_SUBKEY( kvRoot, kvSubKey ) \
+	for ( KeyValuesImageKey kvSubKey = (kvRoot).GetFirstSubKey(); kvSubKey.IsValid(); kvSubKey = kvSubKey.GetNextKey() )
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Owns (or borrows) one compiled image
+//-----------------------------------------------------------------------------
+class CKeyValuesImage
+{
+public:
+	CKeyValuesImage();
+	~CKeyValuesImage();
+
+	// Uses an image already in memory, which must outlive this object.
+	// Returns false if it isn't a complete image for this platform.
+	bool Init( const void *pData, int nSize );
+
+	// Maps a compiled file from disk, or reads it if it can't be mapped
+	// (e.g. it's in a pack file).
+	bool LoadFromFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID = NULL );
+
+	// Loads the cached image of a text KeyValues file, compiling it (and
+	// writing the cache, if bUpdateCache) when the cache is missing or stale.
+	// nLoadFlags are KVIMAGE_FLAG_*.
+	bool LoadCached( IBaseFileSystem *pFileSystem, const char *pResourceName, const char *pPathID = NULL, int nLoadFlags = 0, bool bUpdateCache = true );
+
+	void Purge();
+
+	bool IsValid() const { return m_pHeader != NULL; }
+	const KVImageHeader_t *GetHeader() const { return m_pHeader; }
+
+	// The first top level key. Its peers are the other top level keys.
+	KeyValuesImageKey GetRoot() const;
+
+	// Copies the whole image into pDest and new peers of it, the way
+	// KeyValues::LoadFromFile fills the KeyValues it's called on.
+	bool MakeKeyValues( KeyValues *pDest ) const;
+
+	// Compiles a KeyValues tree (with its peers). pSources are the files it
+	// was parsed from, for cache checks, or NULL. Fails if the tree holds
+	// pointers, which can't be saved.
+	static bool Compile( KeyValues *pRoot, int nLoadFlags, const CUtlVector< KVImageSourceFile_t > *pSources, CUtlBuffer &buf );
+
+	// Parses a text KeyValues file the way KeyValues::LoadFromFile would and compiles it.
+	// An absolute pResourceName under pPathID is recorded relative to it.
+	static bool CompileFile( IBaseFileSystem *pFileSystem, const char *pResourceName, const char *pPathID, int nLoadFlags, CUtlBuffer &buf );
+
+	// True if every file the image was compiled from is unchanged
+	bool IsCurrent( IBaseFileSystem *pFileSystem, const char *pPathID = NULL ) const;
+
+	// The platform flags for conditionals evaluated on this platform
+	static int GetPlatformFlags();
+
+	// Case insensitive, like KeyValues key names
+	static unsigned HashKeyName( const char *pName );
+
+	static void GetCacheFileName( const char *pResourceName, char *pCacheName, int nCacheNameSize );
+
+private:
+	friend class KeyValuesImageKey;
+
+	CKeyValuesImage( const CKeyValuesImage & );
+	CKeyValuesImage &operator=( const CKeyValuesImage & );
+
+	const KVImageNode_t &Node( int nNode ) const { return m_pNodes[nNode]; }
+	const char *String( int nOffset ) const { return m_pStrings + nOffset; }
+
+	bool SetImage( const void *pData, int nSize );
+	void FillKey( KeyValues *pKey, int nNode ) const;
+	KeyValues *MakeKey( int nNode ) const;
+
+	const KVImageHeader_t *m_pHeader;
+	const KVImageNode_t *m_pNodes;
+	const char *m_pStrings;
+
+	CUtlBuffer m_Buffer;		// holds the image when it was read or compiled
+	void *m_pMappedView;		// or this, when it was mapped
+	int m_nMappedSize;
+};
+
+
+#endif // KVIMAGE_H
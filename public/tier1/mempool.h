@@ -106,24 +106,81 @@ protected:
 
 
 //-----------------------------------------------------------------------------
-// 
+// Thread safe pool. Freed blocks go on a lock free list, and in front of that
+// each thread has a small magazine of blocks so most allocs and frees don't
+// touch shared memory. Magazines are picked by hashing the thread id; a thread
+// that finds its magazine in use by another thread goes straight to the shared
+// list rather than waiting. Only carving new blocks out of a blob takes a lock.
 //-----------------------------------------------------------------------------
+struct MemoryPoolMTStats_t
+{
+	int64	m_nMagazineAllocs;	// Allocs served from a magazine
+	int64	m_nMagazineFrees;	// Frees kept in a magazine
+	int64	m_nRefills;			// Empty magazines refilled from the shared list
+	int64	m_nFlushes;			// Full magazines that returned a batch to the shared list
+	int64	m_nContended;		// Allocs and frees that found their magazine in use
+	int64	m_nGrows;			// Times the shared list was empty and blocks were carved under the lock
+};
+
 class CMemoryPoolMT : public CUtlMemoryPool
 {
 public:
-	CMemoryPoolMT(int blockSize, int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, const char *pszAllocOwner = NULL) : CUtlMemoryPool( blockSize, numElements, growMode, pszAllocOwner) {}
+	// Blocks are at least TSLIST_NODE_ALIGNMENT aligned so they can sit on the lock free list
+	CMemoryPoolMT(int blockSize, int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, const char *pszAllocOwner = NULL, int nAlignment = 0);
+	~CMemoryPoolMT();
 
+	void*		Alloc()	{ return Alloc( m_BlockSize ); }
+	void*		Alloc( size_t amount );
+	void*		AllocZero()	{ return AllocZero( m_BlockSize ); }
+	void*		AllocZero( size_t amount );
+	void		Free(void *pMem);
+
+	// Frees everything. Not safe while other threads are using the pool.
+	void		Clear();
 
-	void*		Alloc()	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Alloc(); }
-	void*		Alloc( size_t amount )	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Alloc( amount ); }
-	void*		AllocZero()	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::AllocZero(); }	
-	void*		AllocZero( size_t amount )	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::AllocZero( amount ); }
-	void		Free(void *pMem) { AUTO_LOCK( m_mutex ); CUtlMemoryPool::Free( pMem ); }
+	// Blocks handed out. Only exact while no other thread is using the pool.
+	int Count();
+	// Blocks ever carved out of the blobs, which includes blocks sitting free in
+	// magazines and the shared list, so it's an upper bound on the peak.
+	int PeakCount() { return m_BlocksAllocated; }
+
+	void GetStats( MemoryPoolMTStats_t &stats );
+	void ResetStats();
 
-	// Frees everything
-	void		Clear() { AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Clear(); }
 private:
-	CThreadFastMutex m_mutex; // @TODO: Rework to use tslist (toml 7/6/2007)
+	enum
+	{
+		NUM_MAGAZINES = 16,
+		MAGAZINE_SIZE = 32,
+		MAGAZINE_BATCH = MAGAZINE_SIZE / 2,	// Blocks moved to or from the shared list at once
+	};
+
+	// Each magazine sits on its own cache line(s)
+	struct Magazine_t
+	{
+		volatile long	m_nLock;
+		int				m_nBlocks;
+		int				m_nNetAllocs;		// Allocs minus frees through this magazine
+		void			*m_pBlocks[MAGAZINE_SIZE];
+		int64			m_nAllocs;
+		int64			m_nFrees;
+		int64			m_nRefills;
+		int64			m_nFlushes;
+	};
+
+	Magazine_t	*LockMagazine();
+	void		UnlockMagazine( Magazine_t *pMagazine );
+	void		RefillMagazine( Magazine_t *pMagazine );
+	void		FlushMagazine( Magazine_t *pMagazine );
+	int			CarveBlocks( void **ppBlocks, int nCount );
+
+	byte			*m_pMagazines;
+	int				m_nMagazineStride;
+	CTSListBase		*m_pFreeList;		// Allocated separately so it gets the alignment it needs
+	volatile long	m_nNetAllocsUnmagazined;	// Allocs minus frees that bypassed the magazines
+	volatile long	m_nContended;
+	int				m_nGrows;
+	CThreadFastMutex m_GrowMutex;		// Guards the CUtlMemoryPool blobs
 };
 
 
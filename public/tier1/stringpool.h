@@ -17,7 +17,8 @@
 
 //-----------------------------------------------------------------------------
 // Purpose: Allocates memory for strings, checking for duplicates first,
-//			reusing exising strings if duplicate found.
+//			reusing exising strings if duplicate found. Strings are compared
+//			case insensitively.
 //-----------------------------------------------------------------------------
 
 class CStringPool
@@ -34,10 +35,25 @@ public:
 	// searches for a string already in the pool
 	const char * Find( const char *pszValue );
 
+	// The same, for callers that hash a string once and look it up many times.
+	// nHash must come from HashString.
+	const char * Allocate( const char *pszValue, unsigned nHash );
+	const char * Find( const char *pszValue, unsigned nHash );
+
+	static unsigned HashString( const char *pszValue );
+
 protected:
-	typedef CUtlRBTree<const char *, unsigned short> CStrSet;
+	struct HashSlot_t
+	{
+		const char *m_pszValue;		// NULL if the slot is empty
+		unsigned m_nHash;
+	};
+
+	void GrowHashTable();
 
-	CStrSet m_Strings;
+	// Open addressed with linear probing, kept at most half full
+	CUtlVector<HashSlot_t> m_Slots;
+	unsigned int m_nStrings;
 };
 
 //-----------------------------------------------------------------------------
@@ -57,6 +57,7 @@ public:
 	TokenReader();
 
 	bool Open(const char *pszFilename);
+	bool OpenBuffer(const char *pszFilename, const char *pBuffer, int nBufferSize, int nFirstLine = 1);
 	trtoken_t NextToken(char *pszStore, int nSize);
 	trtoken_t NextTokenDynamic(char **ppszStore);
 	void Close();
@@ -67,7 +68,13 @@ public:
 	const char *Error(char *error, ...);
 	trtoken_t PeekTokenType(char* = NULL, int maxlen = 0);
 
+	// Only valid when reading from a buffer.
+	bool SkipBlock(void);
+	inline bool IsBuffer(void) const;
+	inline int GetBufferOffset(void) const;
+
 	inline int GetErrorCount(void);
+	inline int GetLine(void) const;
 
 private:
 	// compiler can't generate an assignment operator since descended from std::ifstream
@@ -77,6 +84,10 @@ private:
 	trtoken_t GetString(char *pszStore, int nSize);
 	bool SkipWhiteSpace(void);
 
+	trtoken_t NextTokenFromBuffer(char *pszStore, int nSize);
+	trtoken_t GetStringFromBuffer(char *pszStore, int nSize);
+	bool SkipWhiteSpaceInBuffer(void);
+
 	int m_nLine;
 	int m_nErrorCount;
 
@@ -84,6 +95,11 @@ private:
 	char m_szStuffed[128];
 	bool m_bStuffed;
 	trtoken_t m_eStuffed;
+
+	// Set by OpenBuffer. The buffer is owned by the caller and isn't NULL terminated.
+	const char *m_pBuffer;
+	int m_nBufferSize;
+	int m_nBufferPos;
 };
 
 
@@ -96,4 +112,31 @@ int TokenReader::GetErrorCount(void)
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the line the reader is on, for error messages.
+//-----------------------------------------------------------------------------
+int TokenReader::GetLine(void) const
+{
+	return(m_nLine);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if tokens are being read from a buffer instead of a file.
+//-----------------------------------------------------------------------------
+bool TokenReader::IsBuffer(void) const
+{
+	return(m_pBuffer != NULL);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the offset of the next character to be read from the buffer.
+//-----------------------------------------------------------------------------
+int TokenReader::GetBufferOffset(void) const
+{
+	return(m_nBufferPos);
+}
+
+
 #endif // TOKENREADER_H
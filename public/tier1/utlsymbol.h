@@ -27,8 +27,16 @@ class CUtlSymbolTableMT;
 
 //-----------------------------------------------------------------------------
 // This is a symbol, which is a easier way of dealing with strings.
+//
+// Symbols are 16 bits by default, which caps a table at 64k strings. Define
+// UTLSYMBOL_32BIT_IDS across the whole build to lift that; it changes the size of
+// CUtlSymbol, so everything sharing symbols (including prebuilt libs) must agree.
 //-----------------------------------------------------------------------------
+#ifdef UTLSYMBOL_32BIT_IDS
+typedef unsigned int UtlSymId_t;
+#else
 typedef unsigned short UtlSymId_t;
+#endif
 
 #define UTL_INVAL_SYMBOL  ((UtlSymId_t)~0)
 
@@ -85,6 +93,10 @@ protected:
 //    of strings to symbols and back. The symbol class itself contains
 //    a static version of this class for creating global strings, but this
 //    class can also be instanced to create local symbol tables.
+//
+//    Symbols are numbered in the order they're added, starting at 0. Lookups
+//    go through an open addressed hash index, so they cost one hash and
+//    (almost always) one string compare.
 //-----------------------------------------------------------------------------
 
 class CUtlSymbolTable
@@ -99,6 +111,17 @@ public:
 
 	// Finds the symbol for pString
 	CUtlSymbol Find( const char* pString ) const;
+
+	// The same, for callers that hash a string once and look it up many times.
+	// nHash must come from HashString on a table with the same case sensitivity.
+	CUtlSymbol AddString( const char* pString, unsigned nHash );
+	CUtlSymbol Find( const char* pString, unsigned nHash ) const;
+
+	unsigned HashString( const char* pString ) const
+	{
+		return HashString( pString, m_bInsensitive );
+	}
+	static unsigned HashString( const char* pString, bool caseInsensitive );
 	
 	// Look up the string associated with a particular symbol
 	const char* String( CUtlSymbol id ) const;
@@ -108,46 +131,39 @@ public:
 
 	int GetNumStrings( void ) const
 	{
-		return m_Lookup.Count();
+		return m_nSymbols;
 	}
 
 protected:
-	class CStringPoolIndex
+	struct SymbolEntry_t
 	{
-	public:
-		inline CStringPoolIndex()
-		{
-		}
-
-		inline CStringPoolIndex( unsigned short iPool, unsigned short iOffset )
-		{
-			m_iPool = iPool;
-			m_iOffset = iOffset;
-		}
-
-		inline bool operator==( const CStringPoolIndex &other )	const
-		{
-			return m_iPool == other.m_iPool && m_iOffset == other.m_iOffset;
-		}
+		const char *m_pString;
+		unsigned m_nHash;
+	};
 
-		unsigned short m_iPool;		// Index into m_StringPools.
-		unsigned short m_iOffset;	// Index into the string pool.
+	// Linear probing, kept at most half full. Slots are filled in place, and the
+	// table is replaced rather than resized when it grows, so lookups never see
+	// it move. Replaced tables are kept until RemoveAll for lookups still in them.
+	struct HashSlot_t
+	{
+		unsigned m_nHash;
+		UtlSymId_t m_Id;		// UTL_INVAL_SYMBOL if the slot is empty
 	};
 
-	class CLess
+	struct HashTable_t
 	{
-	public:
-		CLess( int ignored = 0 ) {} // permits default initialization to NULL in CUtlRBTree
-		bool operator!() const { return false; }
-		bool operator()( const CStringPoolIndex &left, const CStringPoolIndex &right ) const;
+		HashTable_t *m_pRetired;
+		unsigned m_nMask;
+		HashSlot_t m_Slots[1];
 	};
 
-	// Stores the symbol lookup
-	class CTree : public CUtlRBTree<CStringPoolIndex, unsigned short, CLess>
+	// Symbols are stored in fixed size chunks that never move. The directory of
+	// chunks is replaced the same way as the hash table when it fills up.
+	struct ChunkDirectory_t
 	{
-	public:
-		CTree(  int growSize, int initSize ) : CUtlRBTree<CStringPoolIndex, unsigned short, CLess>( growSize, initSize ) {}
-		friend class CUtlSymbolTable::CLess; // Needed to allow CLess to calculate pointer to symbol table
+		ChunkDirectory_t *m_pRetired;
+		int m_nChunks;
+		SymbolEntry_t *m_pChunks[1];
 	};
 
 	struct StringPool_t
@@ -157,18 +173,21 @@ protected:
 		char m_Data[1];
 	};
 
-	CTree m_Lookup;
+	HashTable_t * volatile m_pHashTable;
+	ChunkDirectory_t * volatile m_pDirectory;
+	int m_nSymbols;
+	int m_nInitialSlots;
 	bool m_bInsensitive;
-	mutable const char* m_pUserSearchString;
 
 	// stores the string data
 	CUtlVector<StringPool_t*> m_StringPools;
 
 private:
-	int FindPoolWithSpace( int len ) const;
-	const char* StringFromIndex( const CStringPoolIndex &index ) const;
-
-	friend class CLess;
+	UtlSymId_t FindId( const char *pString, unsigned nHash ) const;
+	const char* StringFromId( UtlSymId_t id ) const;
+	const char* CopyString( const char *pString );
+	void GrowHashTable();
+	void AddChunk();
 };
 
 class CUtlSymbolTableMT : private CUtlSymbolTable
@@ -181,34 +200,53 @@ public:
 
 	CUtlSymbol AddString( const char* pString )
 	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::AddString( pString );
-		m_lock.UnlockWrite();
+		if ( !pString )
+			return CUtlSymbol();
+		return AddString( pString, CUtlSymbolTable::HashString( pString ) );
+	}
+
+	CUtlSymbol AddString( const char* pString, unsigned nHash )
+	{
+		// Most adds are for strings that are already there, which don't need the lock
+		CUtlSymbol result = CUtlSymbolTable::Find( pString, nHash );
+		if ( result.IsValid() )
+			return result;
+
+		m_lock.Lock();
+		result = CUtlSymbolTable::AddString( pString, nHash );
+		m_lock.Unlock();
 		return result;
 	}
 
+	// Lookups don't lock. Symbols are never removed, and each one is published only
+	// once it's complete, so a lookup racing an add just doesn't see the new symbol.
 	CUtlSymbol Find( const char* pString ) const
 	{
-		m_lock.LockForRead();
-		CUtlSymbol result = CUtlSymbolTable::Find( pString );
-		m_lock.UnlockRead();
-		return result;
+		return CUtlSymbolTable::Find( pString );
+	}
+
+	CUtlSymbol Find( const char* pString, unsigned nHash ) const
+	{
+		return CUtlSymbolTable::Find( pString, nHash );
 	}
 
 	const char* String( CUtlSymbol id ) const
 	{
-		m_lock.LockForRead();
-		const char *pszResult = CUtlSymbolTable::String( id );
-		m_lock.UnlockRead();
-		return pszResult;
+		return CUtlSymbolTable::String( id );
+	}
+
+	unsigned HashString( const char* pString ) const
+	{
+		return CUtlSymbolTable::HashString( pString );
+	}
+
+	int GetNumStrings( void ) const
+	{
+		return CUtlSymbolTable::GetNumStrings();
 	}
 	
 private:
-#if defined(WIN32) || defined(_WIN32)
-	mutable CThreadSpinRWLock m_lock;
-#else
-	mutable CThreadRWLock m_lock;
-#endif
+	CThreadFastMutex m_lock;
 };
 
 
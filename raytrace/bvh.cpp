@@ -0,0 +1,508 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+// $Id$
+//
+// Bounding volume hierarchy alternative to the kd-tree in raytrace.cpp, selected with
+// RTE_FLAGS_USE_BVH. Nodes are split with a binned surface area heuristic, which is much cheaper
+// to evaluate than trying every triangle vertex as a split the way RefineNode does. The top of the
+// tree is built on the main thread until the remaining subtrees are small enough, and those are
+// then built in parallel using the tool threads.
+
+#include "raytrace.h"
+#include "raytrace_intersect.h"
+#include <cmdlib.h>
+#include "threads.h"
+#include "pacifier.h"
+#include "vstdlib/random.h"
+#include <stdio.h>
+
+
+#define BVH_NUM_BINS 16
+#define BVH_MAX_LEAF_TRIANGLES 8							// nodes with more are always split
+#define BVH_MIN_TASK_TRIANGLES 4096							// subtrees smaller than this are built
+															// on one thread
+
+// same relative costs as the kd-tree builder
+#define BVH_COST_OF_TRAVERSAL 75
+#define BVH_COST_OF_INTERSECTION 167
+
+
+static float BVHSurfaceArea( Vector const &boxmin, Vector const &boxmax )
+{
+	Vector boxdim = boxmax - boxmin;
+	return 2.0 * ( ( boxdim[0] * boxdim[2] ) + ( boxdim[0] * boxdim[1] ) + ( boxdim[1] * boxdim[2] ) );
+}
+
+static void ClearBounds( Vector &mins, Vector &maxs )
+{
+	mins.Init( 1.0e23, 1.0e23, 1.0e23 );
+	maxs.Init( -1.0e23, -1.0e23, -1.0e23 );
+}
+
+static void AddBoxToBounds( Vector const &boxmin, Vector const &boxmax, Vector &mins, Vector &maxs )
+{
+	VectorMin( boxmin, mins, mins );
+	VectorMax( boxmax, maxs, maxs );
+}
+
+
+//-----------------------------------------------------------------------------
+// Builder
+//-----------------------------------------------------------------------------
+struct BVHBuildTri_t
+{
+	Vector m_vecMins;
+	Vector m_vecMaxs;
+	Vector m_vecCenter;
+};
+
+struct BVHBuildTask_t
+{
+	int m_nNode;											// placeholder node in the main tree
+	int m_nFirstTri;
+	int m_nTris;
+	int m_nDepth;
+	CUtlVector<CacheOptimizedBVHNode> m_Nodes;				// the subtree. root is 0
+};
+
+class CBVHBuilder
+{
+public:
+	CBVHBuilder( RayTracingEnvironment *pEnv );
+	~CBVHBuilder();
+
+	void Build( void );
+	void BuildTask( int nTask );
+
+private:
+	void BuildNode( CUtlVector<CacheOptimizedBVHNode> &nodes, int nNode, int nFirstTri, int nTris,
+					int nDepth, bool bMakeTasks );
+	void MakeLeaf( CacheOptimizedBVHNode &node, int nFirstTri, int nTris );
+
+	RayTracingEnvironment *m_pEnv;
+	CUtlVector<BVHBuildTri_t> m_Tris;
+	int32 *m_pTriIndices;									// TriangleIndexList, partitioned in place
+	int m_nMinTaskTris;
+	CUtlVector<BVHBuildTask_t *> m_Tasks;
+};
+
+static CBVHBuilder *s_pBVHBuilder = NULL;
+
+static void BuildBVHSubtreeThread( int iThread, int nTask )
+{
+	s_pBVHBuilder->BuildTask( nTask );
+}
+
+
+CBVHBuilder::CBVHBuilder( RayTracingEnvironment *pEnv ) : m_pEnv( pEnv )
+{
+	int nTris = pEnv->OptimizedTriangleList.Count();
+	m_Tris.SetCount( nTris );
+	pEnv->TriangleIndexList.SetCount( nTris );
+	m_pTriIndices = pEnv->TriangleIndexList.Base();
+
+	for ( int t = 0; t < nTris; t++ )
+	{
+		CacheOptimizedTriangle const &tri = pEnv->OptimizedTriangleList[t];
+		BVHBuildTri_t &buildTri = m_Tris[t];
+		buildTri.m_vecMins = tri.Vertex( 0 );
+		buildTri.m_vecMaxs = tri.Vertex( 0 );
+		for ( int v = 1; v < 3; v++ )
+		{
+			VectorMin( tri.Vertex( v ), buildTri.m_vecMins, buildTri.m_vecMins );
+			VectorMax( tri.Vertex( v ), buildTri.m_vecMaxs, buildTri.m_vecMaxs );
+		}
+		buildTri.m_vecCenter = 0.5 * ( buildTri.m_vecMins + buildTri.m_vecMaxs );
+		m_pTriIndices[t] = t;
+	}
+
+	// this only depends on the triangle count, so the tree comes out the same for any number of
+	// threads.
+	m_nMinTaskTris = max( BVH_MIN_TASK_TRIANGLES, nTris / 256 );
+}
+
+CBVHBuilder::~CBVHBuilder()
+{
+	m_Tasks.PurgeAndDeleteElements();
+}
+
+
+void CBVHBuilder::MakeLeaf( CacheOptimizedBVHNode &node, int nFirstTri, int nTris )
+{
+	node.m_nChild = nFirstTri;
+	node.m_nFlags = BVHNODE_STATE_LEAF + ( nTris << 2 );
+}
+
+
+void CBVHBuilder::BuildNode( CUtlVector<CacheOptimizedBVHNode> &nodes, int nNode, int nFirstTri,
+							 int nTris, int nDepth, bool bMakeTasks )
+{
+	int32 *pTris = m_pTriIndices + nFirstTri;
+
+	Vector vecMins, vecMaxs, vecCenterMins, vecCenterMaxs;
+	ClearBounds( vecMins, vecMaxs );
+	ClearBounds( vecCenterMins, vecCenterMaxs );
+	for ( int t = 0; t < nTris; t++ )
+	{
+		BVHBuildTri_t const &tri = m_Tris[pTris[t]];
+		AddBoxToBounds( tri.m_vecMins, tri.m_vecMaxs, vecMins, vecMaxs );
+		AddBoxToBounds( tri.m_vecCenter, tri.m_vecCenter, vecCenterMins, vecCenterMaxs );
+	}
+
+	CacheOptimizedBVHNode &node = nodes[nNode];
+	for ( int c = 0; c < 3; c++ )
+	{
+		node.m_flMins[c] = vecMins[c];
+		node.m_flMaxs[c] = vecMaxs[c];
+	}
+
+	if ( bMakeTasks && ( nTris < m_nMinTaskTris ) )
+	{
+		// leave the rest of this subtree for a thread to build
+		BVHBuildTask_t *pTask = new BVHBuildTask_t;
+		pTask->m_nNode = nNode;
+		pTask->m_nFirstTri = nFirstTri;
+		pTask->m_nTris = nTris;
+		pTask->m_nDepth = nDepth;
+		m_Tasks.AddToTail( pTask );
+		return;
+	}
+
+	if ( ( nTris < 3 ) || ( nDepth >= BVH_MAX_TREE_DEPTH ) )
+	{
+		MakeLeaf( node, nFirstTri, nTris );
+		return;
+	}
+
+	// bin the triangle centers along each axis and find the cheapest split between bins
+	float flBestCost = 1.0e23;
+	int nBestAxis = -1;
+	int nBestSplit = 0;
+	float flBestBinScale = 0;
+	float flInvArea = 1.0 / BVHSurfaceArea( vecMins, vecMaxs );
+
+	for ( int nAxis = 0; nAxis < 3; nAxis++ )
+	{
+		float flExtent = vecCenterMaxs[nAxis] - vecCenterMins[nAxis];
+		if ( flExtent <= 0 )
+			continue;
+		float flBinScale = ( BVH_NUM_BINS * 0.9999 ) / flExtent;
+
+		int nBinCount[BVH_NUM_BINS];
+		Vector vecBinMins[BVH_NUM_BINS], vecBinMaxs[BVH_NUM_BINS];
+		for ( int b = 0; b < BVH_NUM_BINS; b++ )
+		{
+			nBinCount[b] = 0;
+			ClearBounds( vecBinMins[b], vecBinMaxs[b] );
+		}
+
+		for ( int t = 0; t < nTris; t++ )
+		{
+			BVHBuildTri_t const &tri = m_Tris[pTris[t]];
+			int b = (int)( ( tri.m_vecCenter[nAxis] - vecCenterMins[nAxis] ) * flBinScale );
+			nBinCount[b]++;
+			AddBoxToBounds( tri.m_vecMins, tri.m_vecMaxs, vecBinMins[b], vecBinMaxs[b] );
+		}
+
+		// sweep from the right to get the cost of everything at or above each split
+		float flRightCost[BVH_NUM_BINS];
+		Vector vecSweepMins, vecSweepMaxs;
+		ClearBounds( vecSweepMins, vecSweepMaxs );
+		int nRight = 0;
+		for ( int b = BVH_NUM_BINS - 1; b > 0; b-- )
+		{
+			nRight += nBinCount[b];
+			AddBoxToBounds( vecBinMins[b], vecBinMaxs[b], vecSweepMins, vecSweepMaxs );
+			flRightCost[b] = nRight ? nRight * BVHSurfaceArea( vecSweepMins, vecSweepMaxs ) : 0;
+		}
+
+		// then from the left, splitting so that bins < nSplit go left
+		ClearBounds( vecSweepMins, vecSweepMaxs );
+		int nLeft = 0;
+		for ( int nSplit = 1; nSplit < BVH_NUM_BINS; nSplit++ )
+		{
+			nLeft += nBinCount[nSplit - 1];
+			AddBoxToBounds( vecBinMins[nSplit - 1], vecBinMaxs[nSplit - 1], vecSweepMins, vecSweepMaxs );
+			if ( ( nLeft == 0 ) || ( nLeft == nTris ) )
+				continue;
+
+			float flCost = BVH_COST_OF_TRAVERSAL + BVH_COST_OF_INTERSECTION * flInvArea *
+				( nLeft * BVHSurfaceArea( vecSweepMins, vecSweepMaxs ) + flRightCost[nSplit] );
+			if ( flCost < flBestCost )
+			{
+				flBestCost = flCost;
+				nBestAxis = nAxis;
+				nBestSplit = nSplit;
+				flBestBinScale = flBinScale;
+			}
+		}
+	}
+
+	float flCostOfNoSplit = BVH_COST_OF_INTERSECTION * nTris;
+	if ( ( nTris <= BVH_MAX_LEAF_TRIANGLES ) && ( ( nBestAxis == -1 ) || ( flCostOfNoSplit <= flBestCost ) ) )
+	{
+		MakeLeaf( node, nFirstTri, nTris );
+		return;
+	}
+
+	int nLeft;
+	if ( nBestAxis == -1 )
+	{
+		// all the centers are at the same point, so there's no good split. Just halve the list to
+		// keep leaves small.
+		nBestAxis = 0;
+		nLeft = nTris / 2;
+	}
+	else
+	{
+		// partition the triangle indices so the ones going left come first
+		int i = 0, j = nTris - 1;
+		while ( i <= j )
+		{
+			BVHBuildTri_t const &tri = m_Tris[pTris[i]];
+			int b = (int)( ( tri.m_vecCenter[nBestAxis] - vecCenterMins[nBestAxis] ) * flBestBinScale );
+			if ( b < nBestSplit )
+			{
+				i++;
+			}
+			else
+			{
+				V_swap( pTris[i], pTris[j] );
+				j--;
+			}
+		}
+		nLeft = i;
+	}
+
+	int nLeftChild = nodes.AddMultipleToTail( 2 );
+	// node may have moved when the children were added
+	nodes[nNode].m_nChild = nLeftChild;
+	nodes[nNode].m_nFlags = nBestAxis;
+
+	BuildNode( nodes, nLeftChild, nFirstTri, nLeft, nDepth + 1, bMakeTasks );
+	BuildNode( nodes, nLeftChild + 1, nFirstTri + nLeft, nTris - nLeft, nDepth + 1, bMakeTasks );
+}
+
+
+void CBVHBuilder::BuildTask( int nTask )
+{
+	BVHBuildTask_t *pTask = m_Tasks[nTask];
+	pTask->m_Nodes.AddToTail();
+	BuildNode( pTask->m_Nodes, 0, pTask->m_nFirstTri, pTask->m_nTris, pTask->m_nDepth, false );
+}
+
+
+void CBVHBuilder::Build( void )
+{
+	CUtlVector<CacheOptimizedBVHNode> &tree = m_pEnv->OptimizedBVHTree;
+	tree.AddToTail();
+	BuildNode( tree, 0, 0, m_Tris.Count(), 0, true );
+
+	if ( m_Tasks.Count() )
+	{
+		// the caller prints its own progress
+		SuppressPacifier( true );
+		s_pBVHBuilder = this;
+		RunThreadsOnIndividual( m_Tasks.Count(), false, BuildBVHSubtreeThread );
+		s_pBVHBuilder = NULL;
+		SuppressPacifier( false );
+	}
+
+	// now, copy each subtree into the main tree. The subtree root replaces its placeholder node
+	// and the rest are appended, which keeps pairs of children next to each other.
+	for ( int i = 0; i < m_Tasks.Count(); i++ )
+	{
+		BVHBuildTask_t *pTask = m_Tasks[i];
+		int nBase = tree.Count() - 1;
+		tree.AddMultipleToTail( pTask->m_Nodes.Count() - 1 );
+		for ( int n = 0; n < pTask->m_Nodes.Count(); n++ )
+		{
+			CacheOptimizedBVHNode node = pTask->m_Nodes[n];
+			if ( !node.IsLeaf() )
+				node.m_nChild += nBase;
+			tree[n ? ( nBase + n ) : pTask->m_nNode] = node;
+		}
+	}
+}
+
+
+void RayTracingEnvironment::SetupBVH(void)
+{
+	OptimizedBVHTree.Purge();
+
+	CBVHBuilder builder( this );
+	builder.Build();
+
+	CacheOptimizedBVHNode const &root = OptimizedBVHTree[0];
+	m_MinBound.Init( root.m_flMins[0], root.m_flMins[1], root.m_flMins[2] );
+	m_MaxBound.Init( root.m_flMaxs[0], root.m_flMaxs[1], root.m_flMaxs[2] );
+
+	// now, convert all triangles to "intersection format"
+	for(int i=0;i<OptimizedTriangleList.Count();i++)
+		OptimizedTriangleList[i].ChangeIntoIntersectionFormat();
+}
+
+
+//-----------------------------------------------------------------------------
+// Traversal
+//-----------------------------------------------------------------------------
+void RayTracingEnvironment::TraceBVH4Rays(const FourRays &rays, fltx4 TMin, fltx4 TMax,
+										  int DirectionSignMask, RayTracingResult *rslt_out,
+										  int32 skip_id, ITransparentTriangleCallback *pCallback)
+{
+	memset(rslt_out->HitIds,0xff,sizeof(rslt_out->HitIds));
+
+	rslt_out->HitDistance=ReplicateX4(1.0e23);
+
+	rslt_out->surface_normal.DuplicateVector(Vector(0.,0.,0.));
+
+	if ( !OptimizedBVHTree.Count() )
+		return;
+
+	FourVectors OneOverRayDir=rays.direction;
+	OneOverRayDir.MakeReciprocalSaturate();
+
+	CacheOptimizedBVHNode const *pNodes = OptimizedBVHTree.Base();
+	int32 NodeStack[BVH_MAX_STACK_DEPTH];
+	int nStackDepth = 0;
+	int nNode = 0;
+	while ( 1 )
+	{
+		CacheOptimizedBVHNode const &node = pNodes[nNode];
+
+		// clip the rays against the node bounds. Rays which already hit something closer than
+		// the node don't need to visit it.
+		fltx4 NodeTMin = TMin;
+		fltx4 NodeTMax = MinSIMD( TMax, rslt_out->HitDistance );
+		for ( int c = 0; c < 3; c++ )
+		{
+			fltx4 isect_min_t=
+				MulSIMD(SubSIMD(ReplicateX4(node.m_flMins[c]),rays.origin[c]),OneOverRayDir[c]);
+			fltx4 isect_max_t=
+				MulSIMD(SubSIMD(ReplicateX4(node.m_flMaxs[c]),rays.origin[c]),OneOverRayDir[c]);
+			NodeTMin=MaxSIMD(NodeTMin,MinSIMD(isect_min_t,isect_max_t));
+			NodeTMax=MinSIMD(NodeTMax,MaxSIMD(isect_min_t,isect_max_t));
+		}
+
+		if ( IsAnyNegative( CmpLeSIMD( NodeTMin, NodeTMax ) ) )
+		{
+			if ( !node.IsLeaf() )
+			{
+				// visit the child on the near side of the split first, based on ray direction
+				int nNear = ( DirectionSignMask >> node.SplitAxis() ) & 1;
+				Assert( nStackDepth < BVH_MAX_STACK_DEPTH );
+				NodeStack[nStackDepth++] = node.m_nChild + ( nNear ^ 1 );
+				nNode = node.m_nChild + nNear;
+				continue;
+			}
+
+			int32 const *tlist = &( TriangleIndexList[node.m_nChild] );
+			for ( int ntris = node.NumberOfTrianglesInLeaf(); ntris; --ntris )
+			{
+				int tnum = *( tlist++ );
+				TriIntersectData_t const *tri = &( OptimizedTriangleList[tnum].m_Data.m_IntersectData );
+				if ( tri->m_nTriangleID != skip_id )
+					IntersectFourRaysWithTriangle( rays, tri, tnum, rslt_out, pCallback );
+			}
+		}
+
+		if ( !nStackDepth )
+			return;
+		nNode = NodeStack[--nStackDepth];
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Benchmark
+//-----------------------------------------------------------------------------
+void RayTracingEnvironment::BenchmarkAccelerationStructures(int nRays)
+{
+	// building either structure changes the triangles into intersection format, so keep a copy
+	// of them to rebuild from.
+	int nTris = OptimizedTriangleList.Count();
+	CUtlVector<CacheOptimizedTriangle> GeometryTris;
+	GeometryTris.SetCount( nTris );
+	Vector vecMins, vecMaxs;
+	ClearBounds( vecMins, vecMaxs );
+	for ( int t = 0; t < nTris; t++ )
+	{
+		GeometryTris[t] = OptimizedTriangleList[t];
+		for ( int v = 0; v < 3; v++ )
+			AddBoxToBounds( GeometryTris[t].Vertex( v ), GeometryTris[t].Vertex( v ), vecMins, vecMaxs );
+	}
+
+	// packets of 4 rays from a random point, in similar random directions, long enough to cross
+	// the whole world.
+	int nPackets = ( nRays + 3 ) / 4;
+	float flRayLength = ( vecMaxs - vecMins ).Length();
+	CUtlVector<Vector> RayOrigins, RayDirections;
+	RayOrigins.SetCount( nPackets );
+	RayDirections.SetCount( nPackets * 4 );
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	for ( int p = 0; p < nPackets; p++ )
+	{
+		RayOrigins[p].Init( random.RandomFloat( vecMins.x, vecMaxs.x ),
+							random.RandomFloat( vecMins.y, vecMaxs.y ),
+							random.RandomFloat( vecMins.z, vecMaxs.z ) );
+		Vector vecDir( random.RandomFloat( -1, 1 ), random.RandomFloat( -1, 1 ), random.RandomFloat( -1, 1 ) );
+		for ( int r = 0; r < 4; r++ )
+		{
+			Vector vecJitter( random.RandomFloat( -0.1, 0.1 ), random.RandomFloat( -0.1, 0.1 ), random.RandomFloat( -0.1, 0.1 ) );
+			RayDirections[p * 4 + r] = vecDir + vecJitter;
+			VectorNormalize( RayDirections[p * 4 + r] );
+		}
+	}
+
+	// run the selected structure last so it's the one left set up
+	uint32 nSaveFlags = Flags;
+	bool bSelectedBVH = ( nSaveFlags & RTE_FLAGS_USE_BVH ) != 0;
+	CUtlVector<int32> HitIds[2];
+	for ( int nPass = 0; nPass < 2; nPass++ )
+	{
+		bool bBVH = ( nPass == 1 ) ? bSelectedBVH : !bSelectedBVH;
+		Flags = bBVH ? ( nSaveFlags | RTE_FLAGS_USE_BVH ) : ( nSaveFlags & ~RTE_FLAGS_USE_BVH );
+
+		for ( int t = 0; t < nTris; t++ )
+			OptimizedTriangleList[t] = GeometryTris[t];
+		OptimizedKDTree.Purge();
+		OptimizedBVHTree.Purge();
+		TriangleIndexList.Purge();
+
+		double flStart = Plat_FloatTime();
+		SetupAccelerationStructure();
+		double flBuildTime = Plat_FloatTime() - flStart;
+
+		CUtlVector<int32> &hits = HitIds[bBVH];
+		hits.SetCount( nPackets * 4 );
+		fltx4 TMax = ReplicateX4( flRayLength );
+		flStart = Plat_FloatTime();
+		for ( int p = 0; p < nPackets; p++ )
+		{
+			FourRays rays;
+			rays.origin.DuplicateVector( RayOrigins[p] );
+			rays.direction.LoadAndSwizzle( RayDirections[p * 4], RayDirections[p * 4 + 1],
+										   RayDirections[p * 4 + 2], RayDirections[p * 4 + 3] );
+			RayTracingResult rslt;
+			Trace4Rays( rays, Four_Zeros, TMax, &rslt );
+			for ( int r = 0; r < 4; r++ )
+				hits[p * 4 + r] = rslt.HitIds[r];
+		}
+		double flTraceTime = max( Plat_FloatTime() - flStart, 1.0e-6 );
+
+		Msg( "%-8s: built in %.2f seconds (%d nodes), %.0f rays/second\n",
+			 bBVH ? "bvh" : "kd-tree", flBuildTime,
+			 bBVH ? OptimizedBVHTree.Count() : OptimizedKDTree.Count(),
+			 nPackets * 4 / flTraceTime );
+	}
+	Flags = nSaveFlags;
+
+	// rays that hit two triangles at exactly the same distance can legitimately differ
+	int nDifferent = 0;
+	for ( int r = 0; r < nPackets * 4; r++ )
+	{
+		if ( HitIds[0][r] != HitIds[1][r] )
+			nDifferent++;
+	}
+	Msg( "%d of %d rays hit different triangles\n", nDifferent, nPackets * 4 );
+}
@@ -0,0 +1,457 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+// $Id$
+//
+// 8-wide ray packets. Trace8Rays traces 8 rays at once through either the kd-tree or the bvh
+// using AVX when the cpu and os support it (see CheckAVXTechnology), and falls back to tracing
+// the two halves with Trace4Rays otherwise. The avx traversals are line for line the same as the
+// 4-wide ones in raytrace.cpp and bvh.cpp, so they find exactly the same hits.
+
+#include "raytrace.h"
+#include "raytrace_intersect.h"
+#include "tier1/processor_detect.h"
+
+// The avx code is only built where the compiler will emit avx intrinsics without compiling the
+// whole file for avx, since the file also holds the code run on cpus without it. gcc 4.9 and up
+// can do that for just the avx functions, see the target pragma below.
+#if ( defined( _WIN32 ) && !defined( _X360 ) && ( _MSC_VER >= 1600 ) ) || defined( __AVX__ )
+#define RAYTRACE_AVX
+#include <immintrin.h>
+#elif defined( __GNUC__ ) && !defined( __clang__ ) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define RAYTRACE_AVX
+#define RAYTRACE_AVX_TARGET_PRAGMA
+#include <immintrin.h>
+#endif
+
+
+int EightRays::CalculateDirectionSignMask(void) const
+{
+	int msk = m_Rays[0].CalculateDirectionSignMask();
+	if ( ( msk == -1 ) || ( m_Rays[1].CalculateDirectionSignMask() != msk ) )
+		return -1;
+	return msk;
+}
+
+
+bool RayTracingEnvironment::SupportsEightWideTracing(void)
+{
+#ifdef RAYTRACE_AVX
+	static bool s_bHasAVX = CheckAVXTechnology();
+	return s_bHasAVX;
+#else
+	return false;
+#endif
+}
+
+
+void RayTracingEnvironment::Trace8Rays(const EightRays &rays, const fltx4 TMin[2], const fltx4 TMax[2],
+									   RayTracingResult rslt_out[2],
+									   int32 skip_id, ITransparentTriangleCallback **ppCallbacks)
+{
+#ifdef RAYTRACE_AVX
+	if ( SupportsEightWideTracing() )
+	{
+		int msk = rays.CalculateDirectionSignMask();
+		if ( ( msk == -1 ) && ( Flags & RTE_FLAGS_USE_BVH ) )
+		{
+			// same as Trace4Rays - the bvh only uses the mask to order the children
+			msk = ( ( rays.m_Rays[0].direction.X(0) < 0 ) ? 1 : 0 ) |
+				( ( rays.m_Rays[0].direction.Y(0) < 0 ) ? 2 : 0 ) |
+				( ( rays.m_Rays[0].direction.Z(0) < 0 ) ? 4 : 0 );
+		}
+		if ( msk != -1 )
+		{
+			// the fallback below is counted by Trace4Rays
+			if ( s_bCountRays )
+				AddRayCount( 8 );
+
+			if ( Flags & RTE_FLAGS_USE_BVH )
+				TraceBVH8RaysAVX( rays, TMin, TMax, msk, rslt_out, skip_id, ppCallbacks );
+			else
+				TraceKD8RaysAVX( rays, TMin, TMax, msk, rslt_out, skip_id, ppCallbacks );
+			return;
+		}
+	}
+#endif
+
+	// no avx, or the halves go in different directions. Trace4Rays handles splitting up
+	// mismatched rays within each half.
+	for ( int h = 0; h < 2; h++ )
+	{
+		Trace4Rays( rays.m_Rays[h], TMin[h], TMax[h], &rslt_out[h], skip_id,
+					ppCallbacks ? ppCallbacks[h] : NULL );
+	}
+}
+
+
+#ifdef RAYTRACE_AVX
+
+#ifdef RAYTRACE_AVX_TARGET_PRAGMA
+// Everything from here down may use avx; it is only reached once SupportsEightWideTracing has
+// checked the cpu. The headers above were compiled without it, so their inline functions stay safe
+// to call from the rest of the tool.
+#pragma GCC push_options
+#pragma GCC target("avx")
+#endif
+
+// the rays in 8-wide form, with the reciprocal directions used for slab tests
+struct EightRaysAVX_t
+{
+	__m256 origin[3];
+	__m256 direction[3];
+	__m256 OneOverRayDir[3];
+};
+
+// 8-wide RayTracingResult, kept in registers while tracing and written out at the end
+struct EightRayResultsAVX_t
+{
+	__m256 HitIds;
+	__m256 HitDistance;
+	__m256 surface_normal[3];
+};
+
+struct NodeToVisit8
+{
+	CacheOptimizedKDNode const *node;
+	__m256 TMin;
+	__m256 TMax;
+};
+
+static FORCEINLINE __m256 CombineHalves( const fltx4 &lo, const fltx4 &hi )
+{
+	return _mm256_insertf128_ps( _mm256_castps128_ps256( lo ), hi, 1 );
+}
+
+static FORCEINLINE bool IsAnyNegative8( const __m256 &a )
+{
+	return _mm256_movemask_ps( a ) != 0;
+}
+
+static FORCEINLINE void LoadEightRays( const EightRays &rays, EightRaysAVX_t &out )
+{
+	// use the same reciprocal as the 4-wide tracers so slab tests agree exactly
+	FourVectors OneOverRayDir[2];
+	for ( int h = 0; h < 2; h++ )
+	{
+		OneOverRayDir[h] = rays.m_Rays[h].direction;
+		OneOverRayDir[h].MakeReciprocalSaturate();
+	}
+	for ( int c = 0; c < 3; c++ )
+	{
+		out.origin[c] = CombineHalves( rays.m_Rays[0].origin[c], rays.m_Rays[1].origin[c] );
+		out.direction[c] = CombineHalves( rays.m_Rays[0].direction[c], rays.m_Rays[1].direction[c] );
+		out.OneOverRayDir[c] = CombineHalves( OneOverRayDir[0][c], OneOverRayDir[1][c] );
+	}
+}
+
+static FORCEINLINE void ClearEightResults( EightRayResultsAVX_t &rslt )
+{
+	rslt.HitIds = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+	rslt.HitDistance = _mm256_set1_ps( 1.0e23f );
+	rslt.surface_normal[0] = rslt.surface_normal[1] = rslt.surface_normal[2] = _mm256_setzero_ps();
+}
+
+static FORCEINLINE void StoreEightResults( const EightRayResultsAVX_t &rslt, RayTracingResult rslt_out[2] )
+{
+	_mm_store_ps( (float *) rslt_out[0].HitIds, _mm256_castps256_ps128( rslt.HitIds ) );
+	_mm_store_ps( (float *) rslt_out[1].HitIds, _mm256_extractf128_ps( rslt.HitIds, 1 ) );
+	rslt_out[0].HitDistance = _mm256_castps256_ps128( rslt.HitDistance );
+	rslt_out[1].HitDistance = _mm256_extractf128_ps( rslt.HitDistance, 1 );
+	for ( int c = 0; c < 3; c++ )
+	{
+		rslt_out[0].surface_normal[c] = _mm256_castps256_ps128( rslt.surface_normal[c] );
+		rslt_out[1].surface_normal[c] = _mm256_extractf128_ps( rslt.surface_normal[c], 1 );
+	}
+	// avoid the penalty for switching back to sse code with the upper halves in use
+	_mm256_zeroupper();
+}
+
+// 8-wide IntersectFourRaysWithTriangle
+static FORCEINLINE void IntersectEightRaysWithTriangle( const EightRays &rays, const EightRaysAVX_t &wrays,
+														TriIntersectData_t const *tri, int32 tnum,
+														EightRayResultsAVX_t &rslt,
+														ITransparentTriangleCallback **ppCallbacks )
+{
+	n_intersection_calculations++;
+
+	const __m256 Epsilons = _mm256_set1_ps( 1.0e-10f );
+	const __m256 NegativeEpsilons = _mm256_set1_ps( -1.0e-10f );
+	const __m256 Ones = _mm256_set1_ps( 1.0f );
+
+	// compute plane intersection
+	__m256 Nx = _mm256_broadcast_ss( &tri->m_flNx );
+	__m256 Ny = _mm256_broadcast_ss( &tri->m_flNy );
+	__m256 Nz = _mm256_broadcast_ss( &tri->m_flNz );
+
+	__m256 DDotN = _mm256_mul_ps( wrays.direction[0], Nx );
+	DDotN = _mm256_add_ps( _mm256_mul_ps( wrays.direction[1], Ny ), DDotN );
+	DDotN = _mm256_add_ps( _mm256_mul_ps( wrays.direction[2], Nz ), DDotN );
+	// mask off zero or near zero (ray parallel to surface)
+	__m256 did_hit = _mm256_or_ps( _mm256_cmp_ps( DDotN, Epsilons, _CMP_GT_OQ ),
+								   _mm256_cmp_ps( DDotN, NegativeEpsilons, _CMP_LT_OQ ) );
+
+	__m256 ODotN = _mm256_mul_ps( wrays.origin[0], Nx );
+	ODotN = _mm256_add_ps( _mm256_mul_ps( wrays.origin[1], Ny ), ODotN );
+	ODotN = _mm256_add_ps( _mm256_mul_ps( wrays.origin[2], Nz ), ODotN );
+	__m256 numerator = _mm256_sub_ps( _mm256_broadcast_ss( &tri->m_flD ), ODotN );
+
+	__m256 isect_t = _mm256_div_ps( numerator, DDotN );
+	// now, we have the distance to the plane. lets update our mask
+	did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( isect_t, Epsilons, _CMP_GT_OQ ) );
+	did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( isect_t, rslt.HitDistance, _CMP_LT_OQ ) );
+
+	if ( ! IsAnyNegative8( did_hit ) )
+		return;
+
+	// now, check 3 edges
+	__m256 hitc1 = _mm256_add_ps( wrays.origin[tri->m_nCoordSelect0],
+								  _mm256_mul_ps( isect_t, wrays.direction[tri->m_nCoordSelect0] ) );
+	__m256 hitc2 = _mm256_add_ps( wrays.origin[tri->m_nCoordSelect1],
+								  _mm256_mul_ps( isect_t, wrays.direction[tri->m_nCoordSelect1] ) );
+
+	// do barycentric coordinate check
+	__m256 B0 = _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[0] ), hitc1 );
+	B0 = _mm256_add_ps( B0, _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[1] ), hitc2 ) );
+	B0 = _mm256_add_ps( B0, _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[2] ) );
+
+	did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B0, Epsilons, _CMP_GE_OQ ) );
+
+	__m256 B1 = _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[3] ), hitc1 );
+	B1 = _mm256_add_ps( B1, _mm256_mul_ps( _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[4] ), hitc2 ) );
+	B1 = _mm256_add_ps( B1, _mm256_broadcast_ss( &tri->m_ProjectedEdgeEquations[5] ) );
+
+	did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B1, Epsilons, _CMP_GE_OQ ) );
+
+	__m256 B2 = _mm256_add_ps( B1, B0 );
+	did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B2, Ones, _CMP_LE_OQ ) );
+
+	if ( ! IsAnyNegative8( did_hit ) )
+		return;
+
+	// if the triangle is transparent, let each half's callback decide, exactly as
+	// IntersectFourRaysWithTriangle would for that half on its own
+	if ( ( tri->m_nFlags & FCACHETRI_TRANSPARENT ) && ppCallbacks )
+	{
+		__m256 b2 = _mm256_sub_ps( Ones, B2 );
+		fltx4 HalfHit[2] = { _mm256_castps256_ps128( did_hit ), _mm256_extractf128_ps( did_hit, 1 ) };
+		fltx4 HalfB0[2] = { _mm256_castps256_ps128( B0 ), _mm256_extractf128_ps( B0, 1 ) };
+		fltx4 HalfB1[2] = { _mm256_castps256_ps128( B1 ), _mm256_extractf128_ps( B1, 1 ) };
+		fltx4 Halfb2[2] = { _mm256_castps256_ps128( b2 ), _mm256_extractf128_ps( b2, 1 ) };
+		for ( int h = 0; h < 2; h++ )
+		{
+			if ( ppCallbacks[h] && IsAnyNegative( HalfHit[h] ) )
+			{
+				if ( ppCallbacks[h]->VisitTriangle_ShouldContinue( *tri, rays.m_Rays[h], &HalfHit[h],
+																   &HalfB1[h], &Halfb2[h], &HalfB0[h], tnum ) )
+				{
+					HalfHit[h] = Four_Zeros;
+				}
+			}
+		}
+		did_hit = CombineHalves( HalfHit[0], HalfHit[1] );
+	}
+
+	// now, set the hit_id and closest_hit fields for any enabled rays
+	rslt.HitIds = _mm256_blendv_ps( rslt.HitIds, _mm256_castsi256_ps( _mm256_set1_epi32( tnum ) ), did_hit );
+	rslt.HitDistance = _mm256_blendv_ps( rslt.HitDistance, isect_t, did_hit );
+	rslt.surface_normal[0] = _mm256_blendv_ps( rslt.surface_normal[0], Nx, did_hit );
+	rslt.surface_normal[1] = _mm256_blendv_ps( rslt.surface_normal[1], Ny, did_hit );
+	rslt.surface_normal[2] = _mm256_blendv_ps( rslt.surface_normal[2], Nz, did_hit );
+}
+
+
+void RayTracingEnvironment::TraceKD8RaysAVX(const EightRays &rays, const fltx4 TMin4[2], const fltx4 TMax4[2],
+											int DirectionSignMask, RayTracingResult rslt_out[2],
+											int32 skip_id, ITransparentTriangleCallback **ppCallbacks)
+{
+	rays.m_Rays[0].Check();
+	rays.m_Rays[1].Check();
+
+	EightRaysAVX_t wrays;
+	LoadEightRays( rays, wrays );
+	EightRayResultsAVX_t rslt;
+	ClearEightResults( rslt );
+
+	__m256 TMin = CombineHalves( TMin4[0], TMin4[1] );
+	__m256 TMax = CombineHalves( TMax4[0], TMax4[1] );
+
+	// now, clip rays against bounding box
+	for ( int c = 0; c < 3; c++ )
+	{
+		__m256 isect_min_t = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( m_MinBound[c] ), wrays.origin[c] ),
+											wrays.OneOverRayDir[c] );
+		__m256 isect_max_t = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( m_MaxBound[c] ), wrays.origin[c] ),
+											wrays.OneOverRayDir[c] );
+		TMin = _mm256_max_ps( TMin, _mm256_min_ps( isect_min_t, isect_max_t ) );
+		TMax = _mm256_min_ps( TMax, _mm256_max_ps( isect_min_t, isect_max_t ) );
+	}
+
+	if ( IsAnyNegative8( _mm256_cmp_ps( TMin, TMax, _CMP_LE_OQ ) ) )
+	{
+		int32 mailboxids[MAILBOX_HASH_SIZE];				// used to avoid redundant triangle tests
+		memset( mailboxids, 0xff, sizeof( mailboxids ) );
+
+		// based on ray direction, whether to visit left or right node first
+		int front_idx[3], back_idx[3];
+		for ( int c = 0; c < 3; c++ )
+		{
+			front_idx[c] = ( DirectionSignMask >> c ) & 1;
+			back_idx[c] = front_idx[c] ^ 1;
+		}
+
+		NodeToVisit8 NodeQueue[MAX_NODE_STACK_LEN];
+		CacheOptimizedKDNode const *CurNode = &( OptimizedKDTree[0] );
+		NodeToVisit8 *stack_ptr = &NodeQueue[MAX_NODE_STACK_LEN];
+		while ( 1 )
+		{
+			while ( CurNode->NodeType() != KDNODE_STATE_LEAF )		// traverse until next leaf
+			{
+				int split_plane_number = CurNode->NodeType();
+				CacheOptimizedKDNode const *FrontChild = &( OptimizedKDTree[CurNode->LeftChild()] );
+
+				__m256 dist_to_sep_plane =					// dist=(split-org)/dir
+					_mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( CurNode->SplittingPlaneValue ),
+												  wrays.origin[split_plane_number] ),
+								   wrays.OneOverRayDir[split_plane_number] );
+				__m256 active = _mm256_cmp_ps( TMin, TMax, _CMP_LE_OQ );	// mask of which rays are active
+
+				// now, decide how to traverse children. can either do front,back, or do front
+				// and push back.
+				__m256 hits_front = _mm256_and_ps( active, _mm256_cmp_ps( dist_to_sep_plane, TMin, _CMP_GE_OQ ) );
+				if ( ! IsAnyNegative8( hits_front ) )
+				{
+					// missed the front. only traverse back
+					CurNode = FrontChild + back_idx[split_plane_number];
+					TMin = _mm256_max_ps( TMin, dist_to_sep_plane );
+				}
+				else
+				{
+					__m256 hits_back = _mm256_and_ps( active, _mm256_cmp_ps( dist_to_sep_plane, TMax, _CMP_LE_OQ ) );
+					if ( ! IsAnyNegative8( hits_back ) )
+					{
+						// missed the back - only need to traverse front node
+						CurNode = FrontChild + front_idx[split_plane_number];
+						TMax = _mm256_min_ps( TMax, dist_to_sep_plane );
+					}
+					else
+					{
+						// at least some rays hit both nodes.
+						// must push far, traverse near
+						Assert( stack_ptr > NodeQueue );
+						--stack_ptr;
+						stack_ptr->node = FrontChild + back_idx[split_plane_number];
+						stack_ptr->TMin = _mm256_max_ps( TMin, dist_to_sep_plane );
+						stack_ptr->TMax = TMax;
+						CurNode = FrontChild + front_idx[split_plane_number];
+						TMax = _mm256_min_ps( TMax, dist_to_sep_plane );
+					}
+				}
+			}
+			// hit a leaf! must do intersection check
+			int ntris = CurNode->NumberOfTrianglesInLeaf();
+			if ( ntris )
+			{
+				int32 const *tlist = &( TriangleIndexList[CurNode->TriangleIndexStart()] );
+				do
+				{
+					int tnum = *( tlist++ );
+					// check mailbox
+					int mbox_slot = tnum & ( MAILBOX_HASH_SIZE - 1 );
+					TriIntersectData_t const *tri = &( OptimizedTriangleList[tnum].m_Data.m_IntersectData );
+					if ( ( mailboxids[mbox_slot] != tnum ) && ( tri->m_nTriangleID != skip_id ) )
+					{
+						mailboxids[mbox_slot] = tnum;
+						IntersectEightRaysWithTriangle( rays, wrays, tri, tnum, rslt, ppCallbacks );
+					}
+				} while ( --ntris );
+				// now, check if all rays have terminated
+				if ( ! IsAnyNegative8( _mm256_cmp_ps( TMax, rslt.HitDistance, _CMP_LE_OQ ) ) )
+					break;
+			}
+
+			if ( stack_ptr == &NodeQueue[MAX_NODE_STACK_LEN] )
+				break;
+			// pop stack!
+			CurNode = stack_ptr->node;
+			TMin = stack_ptr->TMin;
+			TMax = stack_ptr->TMax;
+			stack_ptr++;
+		}
+	}
+
+	StoreEightResults( rslt, rslt_out );
+}
+
+
+void RayTracingEnvironment::TraceBVH8RaysAVX(const EightRays &rays, const fltx4 TMin4[2], const fltx4 TMax4[2],
+											 int DirectionSignMask, RayTracingResult rslt_out[2],
+											 int32 skip_id, ITransparentTriangleCallback **ppCallbacks)
+{
+	EightRayResultsAVX_t rslt;
+	ClearEightResults( rslt );
+
+	if ( OptimizedBVHTree.Count() )
+	{
+		EightRaysAVX_t wrays;
+		LoadEightRays( rays, wrays );
+
+		__m256 TMin = CombineHalves( TMin4[0], TMin4[1] );
+		__m256 TMax = CombineHalves( TMax4[0], TMax4[1] );
+
+		CacheOptimizedBVHNode const *pNodes = OptimizedBVHTree.Base();
+		int32 NodeStack[BVH_MAX_STACK_DEPTH];
+		int nStackDepth = 0;
+		int nNode = 0;
+		while ( 1 )
+		{
+			CacheOptimizedBVHNode const &node = pNodes[nNode];
+
+			// clip the rays against the node bounds. Rays which already hit something closer
+			// than the node don't need to visit it.
+			__m256 NodeTMin = TMin;
+			__m256 NodeTMax = _mm256_min_ps( TMax, rslt.HitDistance );
+			for ( int c = 0; c < 3; c++ )
+			{
+				__m256 isect_min_t = _mm256_mul_ps( _mm256_sub_ps( _mm256_broadcast_ss( &node.m_flMins[c] ), wrays.origin[c] ),
+													wrays.OneOverRayDir[c] );
+				__m256 isect_max_t = _mm256_mul_ps( _mm256_sub_ps( _mm256_broadcast_ss( &node.m_flMaxs[c] ), wrays.origin[c] ),
+													wrays.OneOverRayDir[c] );
+				NodeTMin = _mm256_max_ps( NodeTMin, _mm256_min_ps( isect_min_t, isect_max_t ) );
+				NodeTMax = _mm256_min_ps( NodeTMax, _mm256_max_ps( isect_min_t, isect_max_t ) );
+			}
+
+			if ( IsAnyNegative8( _mm256_cmp_ps( NodeTMin, NodeTMax, _CMP_LE_OQ ) ) )
+			{
+				if ( !node.IsLeaf() )
+				{
+					// visit the child on the near side of the split first, based on ray direction
+					int nNear = ( DirectionSignMask >> node.SplitAxis() ) & 1;
+					Assert( nStackDepth < BVH_MAX_STACK_DEPTH );
+					NodeStack[nStackDepth++] = node.m_nChild + ( nNear ^ 1 );
+					nNode = node.m_nChild + nNear;
+					continue;
+				}
+
+				int32 const *tlist = &( TriangleIndexList[node.m_nChild] );
+				for ( int ntris = node.NumberOfTrianglesInLeaf(); ntris; --ntris )
+				{
+					int tnum = *( tlist++ );
+					TriIntersectData_t const *tri = &( OptimizedTriangleList[tnum].m_Data.m_IntersectData );
+					if ( tri->m_nTriangleID != skip_id )
+						IntersectEightRaysWithTriangle( rays, wrays, tri, tnum, rslt, ppCallbacks );
+				}
+			}
+
+			if ( !nStackDepth )
+				break;
+			nNode = NodeStack[--nStackDepth];
+		}
+	}
+
+	StoreEightResults( rslt, rslt_out );
+}
+
+#ifdef RAYTRACE_AVX_TARGET_PRAGMA
+#pragma GCC pop_options
+#endif
+
+#endif // RAYTRACE_AVX
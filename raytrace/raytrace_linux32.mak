@@ -32,7 +32,9 @@ POSTBUILDCOMMAND=true
 
 
 CPPFILES= \
+    bvh.cpp \
     raytrace.cpp \
+    raytrace_avx.cpp \
     trace2.cpp \
     trace3.cpp \
 
@@ -58,6 +60,14 @@ $(OBJ_DIR)/_other_deps.P : $(OTHER_DEPENDENCIES)
 
 
 
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/bvh.P
+endif
+
+$(OBJ_DIR)/bvh.o : $(PWD)/bvh.cpp $(PWD)/raytrace_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
 ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
 -include $(OBJ_DIR)/raytrace.P
 endif
@@ -66,6 +76,14 @@ $(OBJ_DIR)/raytrace.o : $(PWD)/raytrace.cpp $(PWD)/raytrace_linux32.mak $(SRCROO
 	$(PRE_COMPILE_FILE)
 	$(COMPILE_FILE) $(POST_COMPILE_FILE)
 
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/raytrace_avx.P
+endif
+
+$(OBJ_DIR)/raytrace_avx.o : $(PWD)/raytrace_avx.cpp $(PWD)/raytrace_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
 ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
 -include $(OBJ_DIR)/trace2.P
 endif
@@ -311,6 +311,8 @@ inline void RayTracingEnvironment::FlushStreamEntry(RayStream &s,int msk)
 	fltx4 scl=ReciprocalSaturateSIMD(tmax);
 	s.PendingRays[msk].direction*=scl;					// normalize
 	RayTracingResult tmpresult;
+	if ( s_bCountRays )
+		AddRayCount( 4 );
 	Trace4Rays(s.PendingRays[msk],Four_Zeros,tmax,msk,&tmpresult);
 	// now, write out results
 	for(int r=0;r<4;r++)
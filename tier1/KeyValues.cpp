@@ -28,11 +28,13 @@
 #include "utlhash.h"
 #include "UtlSortVector.h"
 #include "convar.h"
+#include "kvimage.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
 
 static const char * s_LastFileLoadingFrom = "unknown"; // just needed for error messages
+static bool s_bUseCompiledCache = false;
 
 // Statics for the growable string table
 int (*KeyValues::s_pfGetSymbolForString)( const char *name, bool bCreate ) = &KeyValues::GetSymbolForStringClassic;
@@ -305,6 +307,15 @@ private:
 };
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Sets whether LoadFromFile goes through compiled images.
+//	See the comment in the header for more info.
+//-----------------------------------------------------------------------------
+void KeyValues::SetUseCompiledCache( bool bUseCache )
+{
+	s_bUseCompiledCache = bUseCache;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Sets whether the KeyValues system should use an arbitrarily growable
 //	string table. See the comment in the header for more info.
@@ -636,6 +647,17 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 #ifdef WIN32
 	Assert( IsX360() || ( IsPC() && _heapchk() == _HEAPOK ) );
 #endif
+
+	if ( s_bUseCompiledCache )
+	{
+		int nLoadFlags = ( m_bHasEscapeSequences ? KVIMAGE_FLAG_ESCAPE_SEQUENCES : 0 ) | ( m_bEvaluateConditionals ? 0 : KVIMAGE_FLAG_NO_CONDITIONALS );
+
+		// Falls back to the text if the image can't be built, so errors get reported the usual way
+		CKeyValuesImage image;
+		if ( image.LoadCached( filesystem, resourceName, pathID, nLoadFlags ) )
+			return image.MakeKeyValues( this );
+	}
+
 	FileHandle_t f = filesystem->Open(resourceName, "rb", pathID);
 	if ( !f )
 		return false;
@@ -658,7 +680,17 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 	{
 		buffer[fileSize] = 0; // null terminate file as EOF
 		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
-		bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+		// compiled images can be shipped in place of the text
+		CKeyValuesImage image;
+		if ( fileSize >= (int)sizeof( KVImageHeader_t ) && *(int *)buffer == KVIMAGE_ID )
+		{
+			bRetOK = image.Init( buffer, fileSize ) && image.MakeKeyValues( this );
+		}
+		else
+		{
+			bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+		}
 	}
 
 	((IFileSystem *)filesystem)->FreeOptimalReadBuffer( buffer );
@@ -273,12 +273,23 @@ void bf_write::WriteVarInt32( uint32 data )
 	}
 	else // Slow path
 	{
+		// Gather the encoded bytes four at a time rather than writing each one
+		uint32 nBytes = 0;
+		int nBits = 0;
 		while ( data > 0x7F ) 
 		{
-			WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+			nBytes |= ( (data & 0x7F) | 0x80 ) << nBits;
 			data >>= 7;
+			nBits += 8;
+			if ( nBits == 32 )
+			{
+				WriteUBitLong( nBytes, 32, false );
+				nBytes = 0;
+				nBits = 0;
+			}
 		}
-		WriteUBitLong( data & 0x7F, 8 );
+		nBytes |= data << nBits;
+		WriteUBitLong( nBytes, nBits + 8, false );
 	}
 }
 
@@ -387,12 +398,23 @@ void bf_write::WriteVarInt64( uint64 data )
 	}
 	else // slow path
 	{
+		// Gather the encoded bytes four at a time rather than writing each one
+		uint32 nBytes = 0;
+		int nBits = 0;
 		while ( data > 0x7F ) 
 		{
-			WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+			nBytes |= static_cast<uint32>( (data & 0x7F) | 0x80 ) << nBits;
 			data >>= 7;
+			nBits += 8;
+			if ( nBits == 32 )
+			{
+				WriteUBitLong( nBytes, 32, false );
+				nBytes = 0;
+				nBits = 0;
+			}
 		}
-		WriteUBitLong( data & 0x7F, 8 );
+		nBytes |= static_cast<uint32>( data ) << nBits;
+		WriteUBitLong( nBytes, nBits + 8, false );
 	}
 }
 
@@ -461,57 +483,46 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 		return false;
 	}
 
-	// Align output to dword boundary
-	while (((unsigned long)pOut & 3) != 0 && nBitsLeft >= 8)
-	{
-
-		WriteUBitLong( *pOut, 8, false );
-		++pOut;
-		nBitsLeft -= 8;
-	}
-	
-	if ( IsPC() && (nBitsLeft >= 32) && (m_iCurBit & 7) == 0 )
-	{
-		// current bit is byte aligned, do block copy
-		int numbytes = nBitsLeft >> 3; 
-		int numbits = numbytes << 3;
-		
-		Q_memcpy( (char*)m_pData+(m_iCurBit>>3), pOut, numbytes );
-		pOut += numbytes;
-		nBitsLeft -= numbits;
-		m_iCurBit += numbits;
-	}
-
 	// X360TBD: Can't write dwords in WriteBits because they'll get swapped
 	if ( IsPC() && nBitsLeft >= 32 )
 	{
-		unsigned long iBitsRight = (m_iCurBit & 31);
-		unsigned long iBitsLeft = 32 - iBitsRight;
-		unsigned long bitMaskLeft = g_BitWriteMasks[iBitsRight][32];
-		unsigned long bitMaskRight = g_BitWriteMasks[0][iBitsRight];
-
-		unsigned long *pData = &m_pData[m_iCurBit>>5];
-
-		// Read dwords.
-		while(nBitsLeft >= 32)
+		if ( (m_iCurBit & 7) == 0 )
 		{
-			unsigned long curData = *(unsigned long*)pOut;
-			pOut += sizeof(unsigned long);
-
-			*pData &= bitMaskLeft;
-			*pData |= curData << iBitsRight;
-
-			pData++; 
-
-			if ( iBitsLeft < 32 )
+			// current bit is byte aligned, do block copy
+			int numbytes = nBitsLeft >> 3; 
+			int numbits = numbytes << 3;
+			
+			Q_memcpy( (char*)m_pData+(m_iCurBit>>3), pOut, numbytes );
+			pOut += numbytes;
+			nBitsLeft -= numbits;
+			m_iCurBit += numbits;
+		}
+		else
+		{
+			// Shift whole dwords in through a 64 bit accumulator, so each output dword
+			// is stored once instead of being masked into two. The input needn't be aligned.
+			unsigned int iBitsRight = (m_iCurBit & 31);
+			unsigned long *pData = &m_pData[m_iCurBit>>5];
+			int nWords = nBitsLeft >> 5;
+
+			// Start with the bits already written to the first dword
+			uint64 nAccum = *pData & g_ExtraMasks[iBitsRight];
+			for ( int i = 0; i < nWords; i++ )
 			{
-				curData >>= iBitsLeft;
-				*pData &= bitMaskRight;
-				*pData |= curData;
+				uint32 curData;
+				Q_memcpy( &curData, pOut, sizeof( curData ) );
+				pOut += sizeof( curData );
+
+				nAccum |= (uint64)curData << iBitsRight;
+				*pData++ = (uint32)nAccum;
+				nAccum >>= 32;
 			}
 
-			nBitsLeft -= 32;
-			m_iCurBit += 32;
+			// What's left goes under the bits past the end of the copy
+			*pData = ( *pData & ~g_ExtraMasks[iBitsRight] ) | (uint32)nAccum;
+
+			nBitsLeft -= nWords << 5;
+			m_iCurBit += nWords << 5;
 		}
 	}
 
@@ -536,7 +547,14 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 
 bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 {
-	// This could be optimized a little by
+	// A byte aligned source can be copied straight out of its memory
+	if ( (pIn->m_iCurBit & 7) == 0 && nBits <= pIn->GetNumBitsLeft() )
+	{
+		WriteBits( pIn->m_pData + (pIn->m_iCurBit >> 3), nBits );
+		pIn->SeekRelative( nBits );
+		return !IsOverflowed();
+	}
+
 	while ( nBits > 32 )
 	{
 		WriteUBitLong( pIn->ReadUBitLong( 32 ), 32 );
@@ -548,6 +566,67 @@ bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 }
 
 
+//-----------------------------------------------------------------------------
+// Pack everything WriteBitCoord and WriteBitNormal write for a value into one
+// int, first bit lowest, so it takes one WriteUBitLong. Return the bit count.
+//-----------------------------------------------------------------------------
+static inline int EncodeBitCoord( const float f, unsigned int &bits )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	// The bit flags that indicate whether we have an integer and/or a fraction part.
+	bits = ( intval ? 1 : 0 ) | ( fractval ? 2 : 0 );
+	if ( !bits )
+		return 2;
+
+	// Then the sign bit, the integer and the fraction
+	bits |= signbit << 2;
+	int numbits = 3;
+	if ( intval )
+	{
+		// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
+		bits |= ( (unsigned int)( intval - 1 ) & ( (1 << COORD_INTEGER_BITS) - 1 ) ) << numbits;
+		numbits += COORD_INTEGER_BITS;
+	}
+	if ( fractval )
+	{
+		bits |= (unsigned int)fractval << numbits;
+		numbits += COORD_FRACTIONAL_BITS;
+	}
+	return numbits;
+}
+
+static inline int EncodeBitNormal( float f, unsigned int &bits )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+
+	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+
+	// clamp..
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	// The sign bit, then the fractional component
+	bits = signbit | ( fractval << 1 );
+	return 1 + NORMAL_FRACTIONAL_BITS;
+}
+
+// Collects fields for one WriteUBitLong per 32 bits
+static inline void AccumulateBits( bf_write *pBuf, uint64 &nAccum, int &nAccumBits, unsigned int bits, int numbits )
+{
+	nAccum |= (uint64)bits << nAccumBits;
+	nAccumBits += numbits;
+	if ( nAccumBits >= 32 )
+	{
+		pBuf->WriteUBitLong( (unsigned int)nAccum, 32, false );
+		nAccum >>= 32;
+		nAccumBits -= 32;
+	}
+}
+
 void bf_write::WriteBitAngle( float fAngle, int numbits )
 {
 	int d;
@@ -621,34 +700,9 @@ void bf_write::WriteBitCoord (const float f)
 #if defined( BB_PROFILING )
 	VPROF( "bf_write::WriteBitCoord" );
 #endif
-	int		signbit = (f <= -COORD_RESOLUTION);
-	int		intval = (int)abs(f);
-	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
-
-
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
-
-	if ( intval || fractval )
-	{
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
-	}
+	unsigned int bits;
+	int numbits = EncodeBitCoord( f, bits );
+	WriteUBitLong( bits, numbits, false );
 }
 
 void bf_write::WriteBitVec3Coord( const Vector& fa )
@@ -659,34 +713,38 @@ void bf_write::WriteBitVec3Coord( const Vector& fa )
 	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
 	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
-	WriteOneBit( zflag );
+	uint64 nAccum = xflag | ( yflag << 1 ) | ( zflag << 2 );
+	int nAccumBits = 3;
+	unsigned int bits;
+	int numbits;
 
 	if ( xflag )
-		WriteBitCoord( fa[0] );
+	{
+		numbits = EncodeBitCoord( fa[0], bits );
+		AccumulateBits( this, nAccum, nAccumBits, bits, numbits );
+	}
 	if ( yflag )
-		WriteBitCoord( fa[1] );
+	{
+		numbits = EncodeBitCoord( fa[1], bits );
+		AccumulateBits( this, nAccum, nAccumBits, bits, numbits );
+	}
 	if ( zflag )
-		WriteBitCoord( fa[2] );
+	{
+		numbits = EncodeBitCoord( fa[2], bits );
+		AccumulateBits( this, nAccum, nAccumBits, bits, numbits );
+	}
+
+	if ( nAccumBits )
+	{
+		WriteUBitLong( (unsigned int)nAccum, nAccumBits, false );
+	}
 }
 
 void bf_write::WriteBitNormal( float f )
 {
-	int	signbit = (f <= -NORMAL_RESOLUTION);
-
-	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
-	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
-
-	// clamp..
-	if (fractval > NORMAL_DENOMINATOR)
-		fractval = NORMAL_DENOMINATOR;
-
-	// Send the sign bit
-	WriteOneBit( signbit );
-
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	unsigned int bits;
+	int numbits = EncodeBitNormal( f, bits );
+	WriteUBitLong( bits, numbits, false );
 }
 
 void bf_write::WriteBitVec3Normal( const Vector& fa )
@@ -696,17 +754,30 @@ void bf_write::WriteBitVec3Normal( const Vector& fa )
 	xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
 	yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
+	uint64 nAccum = xflag | ( yflag << 1 );
+	int nAccumBits = 2;
+	unsigned int bits;
+	int numbits;
 
 	if ( xflag )
-		WriteBitNormal( fa[0] );
+	{
+		numbits = EncodeBitNormal( fa[0], bits );
+		AccumulateBits( this, nAccum, nAccumBits, bits, numbits );
+	}
 	if ( yflag )
-		WriteBitNormal( fa[1] );
+	{
+		numbits = EncodeBitNormal( fa[1], bits );
+		AccumulateBits( this, nAccum, nAccumBits, bits, numbits );
+	}
 	
 	// Write z sign bit
 	int	signbit = (fa[2] <= -NORMAL_RESOLUTION);
-	WriteOneBit( signbit );
+	AccumulateBits( this, nAccum, nAccumBits, signbit, 1 );
+
+	if ( nAccumBits )
+	{
+		WriteUBitLong( (unsigned int)nAccum, nAccumBits, false );
+	}
 }
 
 void bf_write::WriteBitAngles( const QAngle& fa )
@@ -769,11 +840,8 @@ bool bf_write::WriteString(const char *pStr)
 {
 	if(pStr)
 	{
-		do
-		{
-			WriteChar( *pStr );
-			++pStr;
-		} while( *(pStr-1) != 0 );
+		// Copied as a block, terminator included
+		WriteBytes( pStr, V_strlen( pStr ) + 1 );
 	}
 	else
 	{
@@ -883,23 +951,58 @@ void bf_read::ReadBits(void *pOutData, int nBits)
 	unsigned char *pOut = (unsigned char*)pOutData;
 	int nBitsLeft = nBits;
 
-	
-	// align output to dword boundary
-	while( ((size_t)pOut & 3) != 0 && nBitsLeft >= 8 )
+	// X360TBD: Can't read dwords in ReadBits because they'll get swapped
+	// Reads that run off the end go through ReadUBitLong below, which handles the overflow.
+	if ( IsPC() && nBitsLeft >= 32 && nBitsLeft <= GetNumBitsLeft() )
 	{
-		*pOut = (unsigned char)ReadUBitLong(8);
-		++pOut;
-		nBitsLeft -= 8;
+		if ( (m_iCurBit & 7) == 0 )
+		{
+			// current bit is byte aligned, do block copy
+			int numbytes = nBitsLeft >> 3;
+			int numbits = numbytes << 3;
+
+			Q_memcpy( pOut, m_pData + (m_iCurBit >> 3), numbytes );
+			pOut += numbytes;
+			nBitsLeft -= numbits;
+			m_iCurBit += numbits;
+		}
+		else
+		{
+			// Shift dwords out through a 64 bit accumulator, loading each input dword once.
+			// The output needn't be aligned.
+			const unsigned long *pData = (const unsigned long *)m_pData + (m_iCurBit >> 5);
+			int nWords = nBitsLeft >> 5;
+
+			int nAccumBits = 32 - (m_iCurBit & 31);
+			uint64 nAccum = *pData++ >> (m_iCurBit & 31);
+			for ( int i = 0; i < nWords; i++ )
+			{
+				if ( nAccumBits < 32 )
+				{
+					nAccum |= (uint64)*pData++ << nAccumBits;
+					nAccumBits += 32;
+				}
+
+				uint32 curData = (uint32)nAccum;
+				Q_memcpy( pOut, &curData, sizeof( curData ) );
+				pOut += sizeof( curData );
+				nAccum >>= 32;
+				nAccumBits -= 32;
+			}
+
+			nBitsLeft -= nWords << 5;
+			m_iCurBit += nWords << 5;
+		}
 	}
 
-	// X360TBD: Can't read dwords in ReadBits because they'll get swapped
 	if ( IsPC() )
 	{
 		// read dwords
 		while ( nBitsLeft >= 32 )
 		{
-			*((unsigned long*)pOut) = ReadUBitLong(32);
-			pOut += sizeof(unsigned long);
+			uint32 curData = ReadUBitLong(32);
+			Q_memcpy( pOut, &curData, sizeof( curData ) );
+			pOut += sizeof( curData );
 			nBitsLeft -= 32;
 		}
 	}
@@ -1024,6 +1127,21 @@ uint32 bf_read::ReadVarInt32()
 	int count = 0;
 	uint32 b;
 
+	// Byte aligned with room for the longest encoding: decode straight from memory
+	if ( (m_iCurBit & 7) == 0 && GetNumBitsLeft() >= bitbuf::kMaxVarint32Bytes * 8 )
+	{
+		const unsigned char *pIn = m_pData + (m_iCurBit >> 3);
+		do
+		{
+			b = pIn[count];
+			result |= (b & 0x7F) << (7 * count);
+			++count;
+		} while ( (b & 0x80) && count < bitbuf::kMaxVarint32Bytes );
+
+		m_iCurBit += count * 8;
+		return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarint32Bytes ) 
@@ -1044,6 +1162,21 @@ uint64 bf_read::ReadVarInt64()
 	int count = 0;
 	uint64 b;
 
+	// Byte aligned with room for the longest encoding: decode straight from memory
+	if ( (m_iCurBit & 7) == 0 && GetNumBitsLeft() >= bitbuf::kMaxVarintBytes * 8 )
+	{
+		const unsigned char *pIn = m_pData + (m_iCurBit >> 3);
+		do
+		{
+			b = pIn[count];
+			result |= static_cast<uint64>(b & 0x7F) << (7 * count);
+			++count;
+		} while ( (b & 0x80) && count < bitbuf::kMaxVarintBytes );
+
+		m_iCurBit += count * 8;
+		return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarintBytes ) 
@@ -1079,6 +1212,15 @@ unsigned int bf_read::ReadBitLong(int numbits, bool bSigned)
 }
 
 
+// Bits after the two flags of a coord, indexed by the flags less one: the sign
+// bit, then the integer and/or the fraction
+static const int s_BitCoordNumBits[3] =
+{
+	COORD_INTEGER_BITS + 1,
+	COORD_FRACTIONAL_BITS + 1,
+	COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS + 1
+};
+
 // Basic Coordinate Routines (these contain bit-field size AND fixed point scaling constants)
 float bf_read::ReadBitCoord (void)
 {
@@ -1090,26 +1232,28 @@ float bf_read::ReadBitCoord (void)
 
 
 	// Read the required integer and fraction flags
-	intval = ReadOneBit();
-	fractval = ReadOneBit();
+	unsigned int flags = ReadUBitLong( 2 );
 
 	// If we got either parse them, otherwise it's a zero.
-	if ( intval || fractval )
+	if ( flags )
 	{
-		// Read the sign bit
-		signbit = ReadOneBit();
+		// The sign bit, integer and fraction come in one read
+		unsigned int bits = ReadUBitLong( s_BitCoordNumBits[ flags-1 ] );
+		signbit = bits & 1;
+		bits >>= 1;
 
 		// If there's an integer, read it in
-		if ( intval )
+		if ( flags & 1 )
 		{
 			// Adjust the integers from [0..MAX_COORD_VALUE-1] to [1..MAX_COORD_VALUE]
-			intval = ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+			intval = ( bits & ( (1 << COORD_INTEGER_BITS) - 1 ) ) + 1;
+			bits >>= COORD_INTEGER_BITS;
 		}
 
 		// If there's a fraction, read it in
-		if ( fractval )
+		if ( flags & 2 )
 		{
-			fractval = ReadUBitLong( COORD_FRACTIONAL_BITS );
+			fractval = bits;
 		}
 
 		// Calculate the correct floating point value
@@ -1219,13 +1363,7 @@ unsigned int bf_read::ReadBitCoordBits (void)
 	if ( flags == 0 )
 		return 0;
 
-	static const int numbits_table[3] =
-	{
-		COORD_INTEGER_BITS + 1,
-		COORD_FRACTIONAL_BITS + 1,
-		COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS + 1
-	};
-	return ReadUBitLong( numbits_table[ flags-1 ] ) * 4 + flags;
+	return ReadUBitLong( s_BitCoordNumBits[ flags-1 ] ) * 4 + flags;
 }
 
 unsigned int bf_read::ReadBitCoordMPBits( bool bIntegral, bool bLowPrecision )
@@ -1276,9 +1414,10 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 	// the corresponding component will not be read and will be stack garbage.
 	fa.Init( 0, 0, 0 );
 
-	xflag = ReadOneBit();
-	yflag = ReadOneBit(); 
-	zflag = ReadOneBit();
+	unsigned int flags = ReadUBitLong( 3 );
+	xflag = flags & 1;
+	yflag = flags & 2;
+	zflag = flags & 4;
 
 	if ( xflag )
 		fa[0] = ReadBitCoord();
@@ -1290,11 +1429,10 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 
 float bf_read::ReadBitNormal (void)
 {
-	// Read the sign bit
-	int	signbit = ReadOneBit();
-
-	// Read the fractional part
-	unsigned int fractval = ReadUBitLong( NORMAL_FRACTIONAL_BITS );
+	// Read the sign bit and the fractional part
+	unsigned int bits = ReadUBitLong( 1 + NORMAL_FRACTIONAL_BITS );
+	int	signbit = bits & 1;
+	unsigned int fractval = bits >> 1;
 
 	// Calculate the correct floating point value
 	float value = (float)fractval * NORMAL_RESOLUTION;
@@ -1308,8 +1446,9 @@ float bf_read::ReadBitNormal (void)
 
 void bf_read::ReadBitVec3Normal( Vector& fa )
 {
-	int xflag = ReadOneBit();
-	int yflag = ReadOneBit(); 
+	unsigned int flags = ReadUBitLong( 2 );
+	int xflag = flags & 1;
+	int yflag = flags & 2;
 
 	if (xflag)
 		fa[0] = ReadBitNormal();
@@ -1377,8 +1516,39 @@ bool bf_read::ReadString( char *pStr, int maxLen, bool bLine, int *pOutNumChars
 	Assert( maxLen != 0 );
 
 	bool bTooSmall = false;
+	bool bDone = false;
 	int iChar = 0;
-	while(1)
+
+	// Byte aligned: scan the bytes in place instead of reading them one at a time
+	if ( (m_iCurBit & 7) == 0 )
+	{
+		const char *pIn = (const char *)m_pData + (m_iCurBit >> 3);
+		int nBytes = GetNumBitsLeft() >> 3;
+		int i = 0;
+		while ( i < nBytes )
+		{
+			char val = pIn[i++];
+			if ( val == 0 || ( bLine && val == '\n' ) )
+			{
+				bDone = true;
+				break;
+			}
+
+			if ( iChar < (maxLen-1) )
+			{
+				pStr[iChar] = val;
+				++iChar;
+			}
+			else
+			{
+				bTooSmall = true;
+			}
+		}
+		m_iCurBit += i << 3;
+	}
+
+	// Whatever's left, including running off the end
+	while( !bDone )
 	{
 		char val = ReadChar();
 		if ( val == 0 )
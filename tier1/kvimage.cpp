@@ -0,0 +1,1056 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compiled KeyValues images, see kvimage.h
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#if defined( _WIN32 ) && !defined( _X360 )
+#define WIN_32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined( POSIX )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include "kvimage.h"
+#include "filesystem.h"
+#include "tier1/strtools.h"
+#include "tier1/utlhashtable.h"
+#include "generichash.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define KVIMAGE_NAME_HASH_SEED	0x4b56424e
+
+
+//-----------------------------------------------------------------------------
+// Builds the node and string blocks of an image
+//-----------------------------------------------------------------------------
+class CKeyValuesImageWriter
+{
+public:
+	CKeyValuesImageWriter() : m_Strings( 0, 0, 0 ) {}
+
+	int AddString( const char *pString );
+	int AddKeys( KeyValues *pFirst, bool &bOk );
+
+	CUtlVector< KVImageNode_t > m_Nodes;
+	CUtlBuffer m_Strings;
+
+private:
+	CUtlHashtable< CUtlConstString, int > m_StringOffsets;
+};
+
+int CKeyValuesImageWriter::AddString( const char *pString )
+{
+	if ( !pString )
+	{
+		pString = "";
+	}
+
+	UtlHashHandle_t h = m_StringOffsets.Find( pString );
+	if ( h != m_StringOffsets.InvalidHandle() )
+		return m_StringOffsets.Element( h );
+
+	int nOffset = m_Strings.TellPut();
+	m_Strings.Put( pString, V_strlen( pString ) + 1 );
+	m_StringOffsets.Insert( pString, nOffset );
+	return nOffset;
+}
+
+//-----------------------------------------------------------------------------
+// Adds a key and its peers, each followed by its subkeys. Returns the index
+// of the first one, or -1 if there weren't any.
+//-----------------------------------------------------------------------------
+int CKeyValuesImageWriter::AddKeys( KeyValues *pFirst, bool &bOk )
+{
+	int nFirst = -1;
+	int nPrev = -1;
+	for ( KeyValues *pKey = pFirst; pKey; pKey = pKey->GetNextKey() )
+	{
+		int nNode = m_Nodes.AddToTail();
+		if ( nPrev >= 0 )
+		{
+			m_Nodes[nPrev].m_nNext = nNode;
+		}
+		else
+		{
+			nFirst = nNode;
+		}
+		nPrev = nNode;
+
+		KVImageNode_t node;
+		memset( &node, 0, sizeof( node ) );
+		node.m_nName = AddString( pKey->GetName() );
+		node.m_nNameHash = CKeyValuesImage::HashKeyName( pKey->GetName() );
+		node.m_nNext = -1;
+		node.m_nFirstChild = -1;
+		node.m_nString = -1;
+		node.m_nType = (unsigned char)pKey->GetDataType();
+
+		// Format numbers the way KeyValues::GetString does
+		char buf[64];
+		switch ( pKey->GetDataType() )
+		{
+		case KeyValues::TYPE_NONE:
+			node.m_nFirstChild = AddKeys( pKey->GetFirstSubKey(), bOk );
+			break;
+
+		case KeyValues::TYPE_STRING:
+			node.m_nString = AddString( pKey->GetString() );
+			break;
+
+		case KeyValues::TYPE_WSTRING:
+			{
+				// Saved as UTF-8, so these come back as plain strings
+				char utf8[512];
+				V_UnicodeToUTF8( pKey->GetWString(), utf8, sizeof( utf8 ) );
+				node.m_nType = KeyValues::TYPE_STRING;
+				node.m_nString = AddString( utf8 );
+			}
+			break;
+
+		case KeyValues::TYPE_INT:
+			node.m_iValue = pKey->GetInt();
+			V_snprintf( buf, sizeof( buf ), "%d", node.m_iValue );
+			node.m_nString = AddString( buf );
+			break;
+
+		case KeyValues::TYPE_FLOAT:
+			node.m_flValue = pKey->GetFloat();
+			V_snprintf( buf, sizeof( buf ), "%f", node.m_flValue );
+			node.m_nString = AddString( buf );
+			break;
+
+		case KeyValues::TYPE_UINT64:
+			{
+				uint64 nValue = pKey->GetUint64();
+				memcpy( node.m_Uint64, &nValue, sizeof( nValue ) );
+				V_snprintf( buf, sizeof( buf ), "%lld", nValue );
+				node.m_nString = AddString( buf );
+			}
+			break;
+
+		case KeyValues::TYPE_COLOR:
+			{
+				Color color = pKey->GetColor();
+				node.m_Color[0] = color[0];
+				node.m_Color[1] = color[1];
+				node.m_Color[2] = color[2];
+				node.m_Color[3] = color[3];
+			}
+			break;
+
+		default:
+			Warning( "KeyValues image: key \"%s\" is a pointer, which can't be saved\n", pKey->GetName() );
+			bOk = false;
+			break;
+		}
+
+		// AddKeys above may have moved m_Nodes
+		node.m_nNext = m_Nodes[nNode].m_nNext;
+		m_Nodes[nNode] = node;
+	}
+
+	return nFirst;
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds the files a KeyValues text file pulls in with #include and #base
+//-----------------------------------------------------------------------------
+static const char *ReadIncludeToken( const char *p, char *pToken, int nTokenSize, bool &bQuoted )
+{
+	for ( ;; )
+	{
+		while ( *p && V_isspace( (unsigned char)*p ) )
+		{
+			p++;
+		}
+
+		if ( p[0] == '/' && p[1] == '/' )
+		{
+			while ( *p && *p != '\n' )
+			{
+				p++;
+			}
+			continue;
+		}
+		break;
+	}
+
+	if ( !*p )
+		return NULL;
+
+	int nLen = 0;
+	bQuoted = ( *p == '"' );
+	if ( bQuoted )
+	{
+		p++;
+		while ( *p && *p != '"' )
+		{
+			if ( *p == '\\' && p[1] )
+			{
+				p++;
+			}
+			if ( nLen < nTokenSize - 1 )
+			{
+				pToken[nLen++] = *p;
+			}
+			p++;
+		}
+		if ( *p )
+		{
+			p++;
+		}
+	}
+	else if ( *p == '{' || *p == '}' )
+	{
+		pToken[nLen++] = *p++;
+	}
+	else
+	{
+		while ( *p && !V_isspace( (unsigned char)*p ) && *p != '"' && *p != '{' && *p != '}' )
+		{
+			if ( nLen < nTokenSize - 1 )
+			{
+				pToken[nLen++] = *p;
+			}
+			p++;
+		}
+	}
+
+	pToken[nLen] = 0;
+	return p;
+}
+
+//-----------------------------------------------------------------------------
+// Records a file (and, recursively, what it includes) as a source of an image.
+// pText gets the file's contents, null terminated. Missing includes are
+// recorded too, so the image goes stale if one turns up.
+//-----------------------------------------------------------------------------
+static bool AddSourceFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID,
+	CUtlVector< KVImageSourceFile_t > &sources, CUtlBuffer *pText )
+{
+	// Each file once. KeyValues would never finish loading an include cycle anyway.
+	for ( int i = 0; i < sources.Count(); i++ )
+	{
+		if ( !V_stricmp( sources[i].m_FileName.Get(), pFileName ) )
+			return true;
+	}
+
+	KVImageSourceFile_t &source = sources[ sources.AddToTail() ];
+	source.m_FileName = pFileName;
+	source.m_nFileTime = 0;
+	source.m_nFileSize = -1;
+	source.m_nCRC = 0;
+
+	CUtlBuffer buf;
+	if ( !pFileSystem->ReadFile( pFileName, pPathID, buf ) )
+		return false;
+
+	source.m_nFileTime = pFileSystem->GetFileTime( pFileName, pPathID );
+	source.m_nFileSize = buf.TellPut();
+	source.m_nCRC = CRC32_ProcessSingleBuffer( buf.Base(), buf.TellPut() );
+
+	// Double null terminated like KeyValues::LoadFromFile does, in case it's unicode
+	buf.PutChar( 0 );
+	buf.PutChar( 0 );
+
+	// #include and #base only count between top level keys
+	const char *p = (const char *)buf.Base();
+	char token[MAX_PATH];
+	bool bQuoted;
+	int nDepth = 0;
+	while ( ( p = ReadIncludeToken( p, token, sizeof( token ), bQuoted ) ) != NULL )
+	{
+		if ( !bQuoted && token[0] == '{' && !token[1] )
+		{
+			nDepth++;
+		}
+		else if ( !bQuoted && token[0] == '}' && !token[1] )
+		{
+			nDepth--;
+		}
+		else if ( nDepth == 0 && ( !V_stricmp( token, "#include" ) || !V_stricmp( token, "#base" ) ) )
+		{
+			p = ReadIncludeToken( p, token, sizeof( token ), bQuoted );
+			if ( !p )
+				break;
+
+			// The same path KeyValues::ParseIncludedKeys builds, found on any path like it is
+			char includePath[MAX_PATH];
+			V_ExtractFilePath( pFileName, includePath, sizeof( includePath ) );
+			V_strncat( includePath, token, sizeof( includePath ) );
+			AddSourceFile( pFileSystem, includePath, NULL, sources, NULL );
+		}
+	}
+
+	if ( pText )
+	{
+		pText->Swap( buf );
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Maps a file read only. Returns NULL if it can't.
+//-----------------------------------------------------------------------------
+static void *MapFileView( const char *pFullPath, int &nSize )
+{
+	nSize = 0;
+#if defined( _WIN32 ) && !defined( _X360 )
+	HANDLE hFile = CreateFileA( pFullPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	DWORD nFileSize = GetFileSize( hFile, NULL );
+	HANDLE hMapping = ( nFileSize && nFileSize != INVALID_FILE_SIZE ) ? CreateFileMappingA( hFile, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+	CloseHandle( hFile );
+	if ( !hMapping )
+		return NULL;
+
+	// The view keeps the mapping alive
+	void *pView = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( hMapping );
+	if ( !pView )
+		return NULL;
+
+	nSize = (int)nFileSize;
+	return pView;
+#elif defined( POSIX )
+	int fd = open( pFullPath, O_RDONLY );
+	if ( fd < 0 )
+		return NULL;
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_size <= 0 )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	void *pView = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( pView == MAP_FAILED )
+		return NULL;
+
+	nSize = (int)st.st_size;
+	return pView;
+#else
+	return NULL;
+#endif
+}
+
+static void UnmapFileView( void *pView, int nSize )
+{
+#if defined( _WIN32 ) && !defined( _X360 )
+	UnmapViewOfFile( pView );
+#elif defined( POSIX )
+	munmap( pView, nSize );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// constructor, destructor
+//-----------------------------------------------------------------------------
+CKeyValuesImage::CKeyValuesImage() : m_Buffer( 0, 0, 0 )
+{
+	m_pHeader = NULL;
+	m_pNodes = NULL;
+	m_pStrings = NULL;
+	m_pMappedView = NULL;
+	m_nMappedSize = 0;
+}
+
+CKeyValuesImage::~CKeyValuesImage()
+{
+	Purge();
+}
+
+void CKeyValuesImage::Purge()
+{
+	m_pHeader = NULL;
+	m_pNodes = NULL;
+	m_pStrings = NULL;
+	m_Buffer.Purge();
+
+	if ( m_pMappedView )
+	{
+		UnmapFileView( m_pMappedView, m_nMappedSize );
+		m_pMappedView = NULL;
+		m_nMappedSize = 0;
+	}
+}
+
+
+unsigned CKeyValuesImage::HashKeyName( const char *pName )
+{
+	return MurmurHash2LowerCase( pName, KVIMAGE_NAME_HASH_SEED );
+}
+
+int CKeyValuesImage::GetPlatformFlags()
+{
+	int nFlags = 0;
+	if ( IsX360() )
+		nFlags |= KVIMAGE_PLATFORM_X360;
+	if ( IsPC() )
+		nFlags |= KVIMAGE_PLATFORM_PC;
+	if ( IsWindows() )
+		nFlags |= KVIMAGE_PLATFORM_WINDOWS;
+	if ( IsOSX() )
+		nFlags |= KVIMAGE_PLATFORM_OSX;
+	if ( IsLinux() )
+		nFlags |= KVIMAGE_PLATFORM_LINUX;
+	if ( IsPosix() )
+		nFlags |= KVIMAGE_PLATFORM_POSIX;
+	return nFlags;
+}
+
+void CKeyValuesImage::GetCacheFileName( const char *pResourceName, char *pCacheName, int nCacheNameSize )
+{
+	V_snprintf( pCacheName, nCacheNameSize, "%s%s", pResourceName, KVIMAGE_CACHE_EXTENSION );
+}
+
+
+//-----------------------------------------------------------------------------
+// Uses an image in memory after checking that every offset in it is in range,
+// so a truncated or corrupt cache file is rejected rather than read past.
+//-----------------------------------------------------------------------------
+bool CKeyValuesImage::Init( const void *pData, int nSize )
+{
+	Purge();
+	return SetImage( pData, nSize );
+}
+
+bool CKeyValuesImage::SetImage( const void *pData, int nSize )
+{
+	const KVImageHeader_t *pHeader = (const KVImageHeader_t *)pData;
+	if ( !pData || nSize < (int)sizeof( KVImageHeader_t ) )
+		return false;
+
+	// A byte swapped id means another platform wrote it
+	if ( pHeader->m_nId != KVIMAGE_ID || pHeader->m_nVersion != KVIMAGE_VERSION || pHeader->m_nSize != nSize )
+		return false;
+
+	if ( pHeader->m_nDependencyCount < 0 || pHeader->m_nNodeCount < 0 || pHeader->m_nStringBytes <= 0 ||
+		 pHeader->m_nDependencyOffset < (int)sizeof( KVImageHeader_t ) ||
+		 pHeader->m_nDependencyCount > ( nSize - pHeader->m_nDependencyOffset ) / (int)sizeof( KVImageDependency_t ) ||
+		 pHeader->m_nNodeOffset < (int)sizeof( KVImageHeader_t ) ||
+		 pHeader->m_nNodeCount > ( nSize - pHeader->m_nNodeOffset ) / (int)sizeof( KVImageNode_t ) ||
+		 pHeader->m_nStringOffset < (int)sizeof( KVImageHeader_t ) ||
+		 pHeader->m_nStringBytes > nSize - pHeader->m_nStringOffset )
+		return false;
+
+	const byte *pBase = (const byte *)pData;
+	const char *pStrings = (const char *)( pBase + pHeader->m_nStringOffset );
+	if ( pStrings[pHeader->m_nStringBytes - 1] != 0 )
+		return false;
+
+	const KVImageDependency_t *pDependencies = (const KVImageDependency_t *)( pBase + pHeader->m_nDependencyOffset );
+	for ( int i = 0; i < pHeader->m_nDependencyCount; i++ )
+	{
+		if ( (unsigned)pDependencies[i].m_nFileName >= (unsigned)pHeader->m_nStringBytes )
+			return false;
+	}
+
+	const KVImageNode_t *pNodes = (const KVImageNode_t *)( pBase + pHeader->m_nNodeOffset );
+	for ( int i = 0; i < pHeader->m_nNodeCount; i++ )
+	{
+		const KVImageNode_t &node = pNodes[i];
+		if ( (unsigned)node.m_nName >= (unsigned)pHeader->m_nStringBytes ||
+			 node.m_nString >= pHeader->m_nStringBytes || node.m_nString < -1 ||
+			 node.m_nType >= KeyValues::TYPE_NUMTYPES || node.m_nType == KeyValues::TYPE_PTR || node.m_nType == KeyValues::TYPE_WSTRING )
+			return false;
+
+		// Links only point forward, so walking them always ends
+		if ( ( node.m_nNext != -1 && ( node.m_nNext <= i || node.m_nNext >= pHeader->m_nNodeCount ) ) ||
+			 ( node.m_nFirstChild != -1 && ( node.m_nFirstChild <= i || node.m_nFirstChild >= pHeader->m_nNodeCount ) ) )
+			return false;
+
+		if ( node.m_nType == KeyValues::TYPE_STRING && node.m_nString < 0 )
+			return false;
+	}
+
+	m_pHeader = pHeader;
+	m_pNodes = pNodes;
+	m_pStrings = pStrings;
+	return true;
+}
+
+
+bool CKeyValuesImage::LoadFromFile( IBaseFileSystem *pFileSystem, const char *pFileName, const char *pPathID )
+{
+	Purge();
+
+	// Loose files get mapped, files in packs get read
+	char fullPath[MAX_PATH];
+	IFileSystem *pFullFileSystem = (IFileSystem *)pFileSystem;
+	if ( pFullFileSystem->RelativePathToFullPath( pFileName, pPathID, fullPath, sizeof( fullPath ), FILTER_CULLPACK ) )
+	{
+		int nSize;
+		void *pView = MapFileView( fullPath, nSize );
+		if ( pView )
+		{
+			m_pMappedView = pView;
+			m_nMappedSize = nSize;
+			if ( SetImage( pView, nSize ) )
+				return true;
+
+			Purge();
+			return false;
+		}
+	}
+
+	if ( !pFileSystem->ReadFile( pFileName, pPathID, m_Buffer ) )
+		return false;
+
+	if ( SetImage( m_Buffer.Base(), m_Buffer.TellPut() ) )
+		return true;
+
+	Purge();
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// An image is current while all its sources have the time stamps they were
+// compiled with, or the same contents if a time stamp moved.
+//-----------------------------------------------------------------------------
+bool CKeyValuesImage::IsCurrent( IBaseFileSystem *pFileSystem, const char *pPathID ) const
+{
+	if ( !IsValid() )
+		return false;
+
+	const KVImageDependency_t *pDependencies = (const KVImageDependency_t *)( (const byte *)m_pHeader + m_pHeader->m_nDependencyOffset );
+	for ( int i = 0; i < m_pHeader->m_nDependencyCount; i++ )
+	{
+		const KVImageDependency_t &dependency = pDependencies[i];
+		const char *pFileName = String( dependency.m_nFileName );
+
+		// Includes are found on any path, like KeyValues does
+		const char *pFilePathID = ( i == 0 ) ? pPathID : NULL;
+
+		if ( dependency.m_nFileSize < 0 )
+		{
+			if ( pFileSystem->FileExists( pFileName, pFilePathID ) )
+				return false;
+			continue;
+		}
+
+		if ( dependency.m_nFileTime != 0 && pFileSystem->GetFileTime( pFileName, pFilePathID ) == dependency.m_nFileTime )
+			continue;
+
+		CUtlBuffer buf;
+		if ( !pFileSystem->ReadFile( pFileName, pFilePathID, buf ) )
+			return false;
+
+		if ( buf.TellPut() != dependency.m_nFileSize || CRC32_ProcessSingleBuffer( buf.Base(), buf.TellPut() ) != dependency.m_nCRC )
+			return false;
+	}
+
+	return true;
+}
+
+
+bool CKeyValuesImage::Compile( KeyValues *pRoot, int nLoadFlags, const CUtlVector< KVImageSourceFile_t > *pSources, CUtlBuffer &buf )
+{
+	CKeyValuesImageWriter writer;
+	writer.AddString( "" );
+
+	bool bOk = true;
+	writer.AddKeys( pRoot, bOk );
+	if ( !bOk )
+		return false;
+
+	int nDependencies = pSources ? pSources->Count() : 0;
+	CUtlVector< KVImageDependency_t > dependencies;
+	dependencies.SetCount( nDependencies );
+	for ( int i = 0; i < nDependencies; i++ )
+	{
+		const KVImageSourceFile_t &source = pSources->Element( i );
+		KVImageDependency_t &dependency = dependencies[i];
+		dependency.m_nFileTime = source.m_nFileTime;
+		dependency.m_nFileName = writer.AddString( source.m_FileName.Get() );
+		dependency.m_nFileSize = source.m_nFileSize;
+		dependency.m_nCRC = source.m_nCRC;
+		dependency.m_nPad = 0;
+	}
+
+	KVImageHeader_t header;
+	header.m_nId = KVIMAGE_ID;
+	header.m_nVersion = KVIMAGE_VERSION;
+	header.m_nFlags = ( nLoadFlags & KVIMAGE_LOAD_FLAGS ) | GetPlatformFlags();
+	header.m_nDependencyCount = nDependencies;
+	header.m_nDependencyOffset = sizeof( KVImageHeader_t );
+	header.m_nNodeCount = writer.m_Nodes.Count();
+	header.m_nNodeOffset = header.m_nDependencyOffset + nDependencies * sizeof( KVImageDependency_t );
+	header.m_nStringBytes = writer.m_Strings.TellPut();
+	header.m_nStringOffset = header.m_nNodeOffset + header.m_nNodeCount * sizeof( KVImageNode_t );
+	header.m_nSize = header.m_nStringOffset + header.m_nStringBytes;
+
+	buf.Purge();
+	buf.EnsureCapacity( header.m_nSize );
+	buf.Put( &header, sizeof( header ) );
+	buf.Put( dependencies.Base(), nDependencies * sizeof( KVImageDependency_t ) );
+	buf.Put( writer.m_Nodes.Base(), header.m_nNodeCount * sizeof( KVImageNode_t ) );
+	buf.Put( writer.m_Strings.Base(), header.m_nStringBytes );
+	return buf.IsValid();
+}
+
+
+bool CKeyValuesImage::CompileFile( IBaseFileSystem *pFileSystem, const char *pResourceName, const char *pPathID, int nLoadFlags, CUtlBuffer &buf )
+{
+	// Sources are recorded relative to the search path, so an image compiled
+	// ahead of time still checks out on an install somewhere else
+	char relativeName[MAX_PATH];
+	if ( V_IsAbsolutePath( pResourceName ) &&
+		 ( (IFileSystem *)pFileSystem )->FullPathToRelativePathEx( pResourceName, pPathID, relativeName, sizeof( relativeName ) ) )
+	{
+		pResourceName = relativeName;
+	}
+
+	CUtlVector< KVImageSourceFile_t > sources;
+	CUtlBuffer text;
+	if ( !AddSourceFile( pFileSystem, pResourceName, pPathID, sources, &text ) )
+		return false;
+
+	// Parsed from the text already read rather than with LoadFromFile, which
+	// may be the thing asking for this image
+	KeyValues *pKV = new KeyValues( pResourceName );
+	pKV->UsesEscapeSequences( ( nLoadFlags & KVIMAGE_FLAG_ESCAPE_SEQUENCES ) != 0 );
+	pKV->UsesConditionals( ( nLoadFlags & KVIMAGE_FLAG_NO_CONDITIONALS ) == 0 );
+
+	bool bOk = pKV->LoadFromBuffer( pResourceName, (const char *)text.Base(), pFileSystem ) &&
+		Compile( pKV, nLoadFlags, &sources, buf );
+
+	pKV->deleteThis();
+	return bOk;
+}
+
+
+//-----------------------------------------------------------------------------
+// Writes the new cache beside the old one and renames it into place, so a
+// process that has the old file mapped keeps reading the old contents.
+//-----------------------------------------------------------------------------
+static void WriteCacheFile( IBaseFileSystem *pFileSystem, const char *pCacheName, const char *pPathID, CUtlBuffer &buf )
+{
+	IFileSystem *pFullFileSystem = (IFileSystem *)pFileSystem;
+
+	char tempName[MAX_PATH];
+	V_snprintf( tempName, sizeof( tempName ), "%s.tmp", pCacheName );
+	if ( !pFileSystem->WriteFile( tempName, pPathID, buf ) )
+	{
+		DevMsg( "KeyValues image: couldn't write %s\n", tempName );
+		return;
+	}
+
+#ifdef _WIN32
+	// Windows won't rename over an existing file
+	pFullFileSystem->RemoveFile( pCacheName, pPathID );
+#endif
+	if ( !pFullFileSystem->RenameFile( tempName, pCacheName, pPathID ) )
+	{
+		DevMsg( "KeyValues image: couldn't replace %s\n", pCacheName );
+		pFullFileSystem->RemoveFile( tempName, pPathID );
+	}
+}
+
+bool CKeyValuesImage::LoadCached( IBaseFileSystem *pFileSystem, const char *pResourceName, const char *pPathID, int nLoadFlags, bool bUpdateCache )
+{
+	char cacheName[MAX_PATH];
+	GetCacheFileName( pResourceName, cacheName, sizeof( cacheName ) );
+
+	int nFlags = ( nLoadFlags & KVIMAGE_LOAD_FLAGS ) | GetPlatformFlags();
+	if ( LoadFromFile( pFileSystem, cacheName, pPathID ) )
+	{
+		if ( m_pHeader->m_nFlags == nFlags && IsCurrent( pFileSystem, pPathID ) )
+			return true;
+	}
+
+	Purge();
+	if ( !CompileFile( pFileSystem, pResourceName, pPathID, nLoadFlags, m_Buffer ) )
+	{
+		Purge();
+		return false;
+	}
+
+	if ( bUpdateCache )
+	{
+		WriteCacheFile( pFileSystem, cacheName, pPathID, m_Buffer );
+	}
+
+	return SetImage( m_Buffer.Base(), m_Buffer.TellPut() );
+}
+
+
+KeyValuesImageKey CKeyValuesImage::GetRoot() const
+{
+	if ( !IsValid() || !m_pHeader->m_nNodeCount )
+		return KeyValuesImageKey();
+
+	return KeyValuesImageKey( this, 0 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Gives a KeyValues the value (or subkeys) of a node
+//-----------------------------------------------------------------------------
+void CKeyValuesImage::FillKey( KeyValues *pKey, int nNode ) const
+{
+	const KVImageNode_t &node = Node( nNode );
+	switch ( node.m_nType )
+	{
+	case KeyValues::TYPE_NONE:
+		{
+			KeyValues *pLast = pKey->FindLastSubKey();
+			for ( int nChild = node.m_nFirstChild; nChild >= 0; nChild = Node( nChild ).m_nNext )
+			{
+				KeyValues *pChild = new KeyValues( String( Node( nChild ).m_nName ) );
+				pChild->m_bHasEscapeSequences = pKey->m_bHasEscapeSequences;
+				pChild->m_bEvaluateConditionals = pKey->m_bEvaluateConditionals;
+				FillKey( pChild, nChild );
+
+				if ( pLast )
+				{
+					pLast->m_pPeer = pChild;
+				}
+				else
+				{
+					pKey->m_pSub = pChild;
+				}
+				pLast = pChild;
+			}
+		}
+		break;
+
+	case KeyValues::TYPE_STRING:
+		{
+			const char *pString = String( node.m_nString );
+			int len = V_strlen( pString );
+			pKey->m_sValue = new char[len + 1];
+			memcpy( pKey->m_sValue, pString, len + 1 );
+		}
+		break;
+
+	case KeyValues::TYPE_INT:
+		pKey->m_iValue = node.m_iValue;
+		break;
+
+	case KeyValues::TYPE_FLOAT:
+		pKey->m_flValue = node.m_flValue;
+		break;
+
+	case KeyValues::TYPE_UINT64:
+		pKey->m_sValue = new char[sizeof( uint64 )];
+		memcpy( pKey->m_sValue, node.m_Uint64, sizeof( uint64 ) );
+		break;
+
+	case KeyValues::TYPE_COLOR:
+		memcpy( pKey->m_Color, node.m_Color, sizeof( node.m_Color ) );
+		break;
+	}
+
+	pKey->m_iDataType = node.m_nType;
+}
+
+KeyValues *CKeyValuesImage::MakeKey( int nNode ) const
+{
+	KeyValues *pKey = new KeyValues( String( Node( nNode ).m_nName ) );
+	pKey->UsesEscapeSequences( ( m_pHeader->m_nFlags & KVIMAGE_FLAG_ESCAPE_SEQUENCES ) != 0 );
+	pKey->UsesConditionals( ( m_pHeader->m_nFlags & KVIMAGE_FLAG_NO_CONDITIONALS ) == 0 );
+	FillKey( pKey, nNode );
+	return pKey;
+}
+
+bool CKeyValuesImage::MakeKeyValues( KeyValues *pDest ) const
+{
+	if ( !IsValid() )
+		return false;
+
+	if ( !m_pHeader->m_nNodeCount )
+		return true;
+
+	pDest->SetName( String( Node( 0 ).m_nName ) );
+	FillKey( pDest, 0 );
+
+	KeyValues *pPrev = pDest;
+	for ( int nNode = Node( 0 ).m_nNext; nNode >= 0; nNode = Node( nNode ).m_nNext )
+	{
+		KeyValues *pKey = new KeyValues( String( Node( nNode ).m_nName ) );
+		pKey->m_bHasEscapeSequences = pDest->m_bHasEscapeSequences;
+		pKey->m_bEvaluateConditionals = pDest->m_bEvaluateConditionals;
+		FillKey( pKey, nNode );
+
+		pPrev->SetNextKey( pKey );
+		pPrev = pKey;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// KeyValuesImageKey
+//-----------------------------------------------------------------------------
+const KVImageNode_t &KeyValuesImageKey::Node() const
+{
+	Assert( IsValid() );
+	return m_pImage->Node( m_nNode );
+}
+
+const char *KeyValuesImageKey::GetName() const
+{
+	if ( !IsValid() )
+		return "";
+
+	return m_pImage->String( Node().m_nName );
+}
+
+KeyValuesImageKey KeyValuesImageKey::FindKey( const char *keyName ) const
+{
+	// return the current key if a NULL subkey is asked for
+	if ( !IsValid() || !keyName || !keyName[0] )
+		return *this;
+
+	// look for '/' characters deliminating sub fields
+	char szBuf[256];
+	const char *subStr = strchr( keyName, '/' );
+	const char *searchStr = keyName;
+	if ( subStr )
+	{
+		int size = MIN( subStr - keyName, (int)sizeof( szBuf ) - 1 );
+		Q_memcpy( szBuf, keyName, size );
+		szBuf[size] = 0;
+		searchStr = szBuf;
+	}
+
+	unsigned nHash = CKeyValuesImage::HashKeyName( searchStr );
+	for ( int nChild = Node().m_nFirstChild; nChild >= 0; nChild = m_pImage->Node( nChild ).m_nNext )
+	{
+		const KVImageNode_t &child = m_pImage->Node( nChild );
+		if ( child.m_nNameHash == nHash && !V_stricmp( m_pImage->String( child.m_nName ), searchStr ) )
+		{
+			KeyValuesImageKey key( m_pImage, nChild );
+			return subStr ? key.FindKey( subStr + 1 ) : key;
+		}
+	}
+
+	return KeyValuesImageKey();
+}
+
+KeyValuesImageKey KeyValuesImageKey::GetFirstSubKey() const
+{
+	if ( !IsValid() || Node().m_nFirstChild < 0 )
+		return KeyValuesImageKey();
+
+	return KeyValuesImageKey( m_pImage, Node().m_nFirstChild );
+}
+
+KeyValuesImageKey KeyValuesImageKey::GetNextKey() const
+{
+	if ( !IsValid() || Node().m_nNext < 0 )
+		return KeyValuesImageKey();
+
+	return KeyValuesImageKey( m_pImage, Node().m_nNext );
+}
+
+KeyValuesImageKey KeyValuesImageKey::GetFirstTrueSubKey() const
+{
+	KeyValuesImageKey key = GetFirstSubKey();
+	while ( key.IsValid() && key.Node().m_nType != KeyValues::TYPE_NONE )
+	{
+		key = key.GetNextKey();
+	}
+	return key;
+}
+
+KeyValuesImageKey KeyValuesImageKey::GetNextTrueSubKey() const
+{
+	KeyValuesImageKey key = GetNextKey();
+	while ( key.IsValid() && key.Node().m_nType != KeyValues::TYPE_NONE )
+	{
+		key = key.GetNextKey();
+	}
+	return key;
+}
+
+KeyValuesImageKey KeyValuesImageKey::GetFirstValue() const
+{
+	KeyValuesImageKey key = GetFirstSubKey();
+	while ( key.IsValid() && key.Node().m_nType == KeyValues::TYPE_NONE )
+	{
+		key = key.GetNextKey();
+	}
+	return key;
+}
+
+KeyValuesImageKey KeyValuesImageKey::GetNextValue() const
+{
+	KeyValuesImageKey key = GetNextKey();
+	while ( key.IsValid() && key.Node().m_nType == KeyValues::TYPE_NONE )
+	{
+		key = key.GetNextKey();
+	}
+	return key;
+}
+
+int KeyValuesImageKey::GetInt( const char *keyName, int defaultValue ) const
+{
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return defaultValue;
+
+	const KVImageNode_t &node = key.Node();
+	switch ( node.m_nType )
+	{
+	case KeyValues::TYPE_STRING:
+		return atoi( m_pImage->String( node.m_nString ) );
+	case KeyValues::TYPE_FLOAT:
+		return (int)node.m_flValue;
+	case KeyValues::TYPE_UINT64:
+		// can't convert, since it would lose data
+		Assert( 0 );
+		return 0;
+	case KeyValues::TYPE_INT:
+	default:
+		return node.m_iValue;
+	}
+}
+
+uint64 KeyValuesImageKey::GetUint64( const char *keyName, uint64 defaultValue ) const
+{
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return defaultValue;
+
+	const KVImageNode_t &node = key.Node();
+	switch ( node.m_nType )
+	{
+	case KeyValues::TYPE_STRING:
+		return (uint64)V_atoi64( m_pImage->String( node.m_nString ) );
+	case KeyValues::TYPE_FLOAT:
+		return (int)node.m_flValue;
+	case KeyValues::TYPE_UINT64:
+		{
+			uint64 nValue;
+			memcpy( &nValue, node.m_Uint64, sizeof( nValue ) );
+			return nValue;
+		}
+	case KeyValues::TYPE_INT:
+	default:
+		return node.m_iValue;
+	}
+}
+
+float KeyValuesImageKey::GetFloat( const char *keyName, float defaultValue ) const
+{
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return defaultValue;
+
+	const KVImageNode_t &node = key.Node();
+	switch ( node.m_nType )
+	{
+	case KeyValues::TYPE_STRING:
+		return (float)atof( m_pImage->String( node.m_nString ) );
+	case KeyValues::TYPE_FLOAT:
+		return node.m_flValue;
+	case KeyValues::TYPE_INT:
+		return (float)node.m_iValue;
+	case KeyValues::TYPE_UINT64:
+		return (float)GetUint64( keyName );
+	default:
+		return 0.0f;
+	}
+}
+
+const char *KeyValuesImageKey::GetString( const char *keyName, const char *defaultValue ) const
+{
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return defaultValue;
+
+	// Numbers were formatted when the image was compiled
+	const KVImageNode_t &node = key.Node();
+	if ( node.m_nType == KeyValues::TYPE_NONE || node.m_nString < 0 )
+		return defaultValue;
+
+	return m_pImage->String( node.m_nString );
+}
+
+bool KeyValuesImageKey::GetBool( const char *keyName, bool defaultValue ) const
+{
+	if ( FindKey( keyName ).IsValid() )
+		return 0 != GetInt( keyName, 0 );
+
+	return defaultValue;
+}
+
+Color KeyValuesImageKey::GetColor( const char *keyName ) const
+{
+	Color color( 0, 0, 0, 0 );
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return color;
+
+	const KVImageNode_t &node = key.Node();
+	if ( node.m_nType == KeyValues::TYPE_COLOR )
+	{
+		color[0] = node.m_Color[0];
+		color[1] = node.m_Color[1];
+		color[2] = node.m_Color[2];
+		color[3] = node.m_Color[3];
+	}
+	else if ( node.m_nType == KeyValues::TYPE_FLOAT )
+	{
+		color[0] = node.m_flValue;
+	}
+	else if ( node.m_nType == KeyValues::TYPE_INT )
+	{
+		color[0] = node.m_iValue;
+	}
+	else if ( node.m_nType == KeyValues::TYPE_STRING )
+	{
+		// parse the colors out of the string
+		float a = 0.0f, b = 0.0f, c = 0.0f, d = 0.0f;
+		sscanf( m_pImage->String( node.m_nString ), "%f %f %f %f", &a, &b, &c, &d );
+		color[0] = (unsigned char)a;
+		color[1] = (unsigned char)b;
+		color[2] = (unsigned char)c;
+		color[3] = (unsigned char)d;
+	}
+	return color;
+}
+
+bool KeyValuesImageKey::IsEmpty( const char *keyName ) const
+{
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return true;
+
+	return key.Node().m_nType == KeyValues::TYPE_NONE && key.Node().m_nFirstChild < 0;
+}
+
+KeyValues::types_t KeyValuesImageKey::GetDataType( const char *keyName ) const
+{
+	KeyValuesImageKey key = FindKey( keyName );
+	if ( !key.IsValid() )
+		return KeyValues::TYPE_NONE;
+
+	return (KeyValues::types_t)key.Node().m_nType;
+}
+
+KeyValues *KeyValuesImageKey::MakeKeyValues() const
+{
+	if ( !IsValid() )
+		return NULL;
+
+	return m_pImage->MakeKey( m_nNode );
+}
@@ -310,3 +310,259 @@ void CUtlMemoryPool::Free( void *memBlock )
 }
 
 
+
+
+//-----------------------------------------------------------------------------
+// Thread safe pool
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::CMemoryPoolMT( int blockSize, int numElements, int growMode, const char *pszAllocOwner, int nAlignment ) :
+	CUtlMemoryPool( blockSize, numElements, growMode, pszAllocOwner, max( nAlignment, TSLIST_NODE_ALIGNMENT ) )
+{
+	m_nMagazineStride = AlignValue( (int)sizeof( Magazine_t ), 64 );
+	m_pMagazines = (byte *)MemAlloc_AllocAligned( NUM_MAGAZINES * m_nMagazineStride, 64 );
+	memset( m_pMagazines, 0, NUM_MAGAZINES * m_nMagazineStride );
+
+	m_pFreeList = new CTSListBase;
+	m_nNetAllocsUnmagazined = 0;
+	m_nContended = 0;
+	m_nGrows = 0;
+}
+
+CMemoryPoolMT::~CMemoryPoolMT()
+{
+	// Let CUtlMemoryPool report leaks by what's actually in use
+	m_BlocksAllocated = Count();
+
+	m_pFreeList->Detach();
+	delete m_pFreeList;
+	MemAlloc_FreeAligned( m_pMagazines );
+}
+
+
+//-----------------------------------------------------------------------------
+// Grabs the calling thread's magazine, or returns NULL if another thread that
+// hashes to the same one has it
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::Magazine_t *CMemoryPoolMT::LockMagazine()
+{
+	unsigned nHash = ( (unsigned)ThreadGetCurrentId() * 2654435761u ) >> 16;
+	Magazine_t *pMagazine = (Magazine_t *)( m_pMagazines + ( nHash % NUM_MAGAZINES ) * m_nMagazineStride );
+	if ( pMagazine->m_nLock || !ThreadInterlockedAssignIf( &pMagazine->m_nLock, 1, 0 ) )
+	{
+		ThreadInterlockedIncrement( &m_nContended );
+		return NULL;
+	}
+	return pMagazine;
+}
+
+void CMemoryPoolMT::UnlockMagazine( Magazine_t *pMagazine )
+{
+	ThreadInterlockedExchange( &pMagazine->m_nLock, 0 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Carves up to nCount new blocks out of the blobs, growing them if allowed
+//-----------------------------------------------------------------------------
+int CMemoryPoolMT::CarveBlocks( void **ppBlocks, int nCount )
+{
+	AUTO_LOCK( m_GrowMutex );
+	m_nGrows++;
+
+	int nCarved = 0;
+	while ( nCarved < nCount )
+	{
+		void *pBlock = CUtlMemoryPool::Alloc( m_BlockSize );
+		if ( !pBlock )
+			break;
+		ppBlocks[nCarved++] = pBlock;
+	}
+	return nCarved;
+}
+
+
+//-----------------------------------------------------------------------------
+// Moves a batch into an empty magazine
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::RefillMagazine( Magazine_t *pMagazine )
+{
+	Assert( pMagazine->m_nBlocks == 0 );
+	pMagazine->m_nRefills++;
+
+	int nBlocks = 0;
+	while ( nBlocks < MAGAZINE_BATCH )
+	{
+		void *pBlock = m_pFreeList->Pop();
+		if ( !pBlock )
+			break;
+		pMagazine->m_pBlocks[nBlocks++] = pBlock;
+	}
+
+	if ( nBlocks == 0 )
+	{
+		nBlocks = CarveBlocks( pMagazine->m_pBlocks, MAGAZINE_BATCH );
+	}
+
+	pMagazine->m_nBlocks = nBlocks;
+}
+
+
+//-----------------------------------------------------------------------------
+// Returns the oldest batch in a full magazine to the shared list
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::FlushMagazine( Magazine_t *pMagazine )
+{
+	Assert( pMagazine->m_nBlocks == MAGAZINE_SIZE );
+	pMagazine->m_nFlushes++;
+
+	for ( int i = 0; i < MAGAZINE_BATCH - 1; i++ )
+	{
+		( (TSLNodeBase_t *)pMagazine->m_pBlocks[i] )->Next = (TSLNodeBase_t *)pMagazine->m_pBlocks[i + 1];
+	}
+	m_pFreeList->PushChain( (TSLNodeBase_t *)pMagazine->m_pBlocks[0], (TSLNodeBase_t *)pMagazine->m_pBlocks[MAGAZINE_BATCH - 1], MAGAZINE_BATCH );
+
+	// Keep the most recently freed (and most likely cached) blocks
+	memmove( pMagazine->m_pBlocks, pMagazine->m_pBlocks + MAGAZINE_BATCH, ( MAGAZINE_SIZE - MAGAZINE_BATCH ) * sizeof( void * ) );
+	pMagazine->m_nBlocks = MAGAZINE_SIZE - MAGAZINE_BATCH;
+}
+
+
+void *CMemoryPoolMT::Alloc( size_t amount )
+{
+	if ( amount > (unsigned int)m_BlockSize )
+		return NULL;
+
+	void *pBlock = NULL;
+	Magazine_t *pMagazine = LockMagazine();
+	if ( pMagazine )
+	{
+		if ( pMagazine->m_nBlocks == 0 )
+		{
+			RefillMagazine( pMagazine );
+		}
+
+		if ( pMagazine->m_nBlocks )
+		{
+			pBlock = pMagazine->m_pBlocks[--pMagazine->m_nBlocks];
+			pMagazine->m_nNetAllocs++;
+			pMagazine->m_nAllocs++;
+		}
+
+		UnlockMagazine( pMagazine );
+		return pBlock;
+	}
+
+	pBlock = m_pFreeList->Pop();
+	if ( !pBlock )
+	{
+		CarveBlocks( &pBlock, 1 );
+	}
+
+	if ( pBlock )
+	{
+		ThreadInterlockedIncrement( &m_nNetAllocsUnmagazined );
+	}
+	return pBlock;
+}
+
+
+void *CMemoryPoolMT::AllocZero( size_t amount )
+{
+	void *mem = Alloc( amount );
+	if ( mem )
+	{
+		V_memset( mem, 0x00, amount );
+	}
+	return mem;
+}
+
+
+void CMemoryPoolMT::Free( void *pMem )
+{
+	if ( !pMem )
+		return;  // trying to delete NULL pointer, ignore
+
+#ifdef _DEBUG	
+	// invalidate the memory
+	memset( pMem, 0xDD, m_BlockSize );
+#endif
+
+	Magazine_t *pMagazine = LockMagazine();
+	if ( pMagazine )
+	{
+		if ( pMagazine->m_nBlocks == MAGAZINE_SIZE )
+		{
+			FlushMagazine( pMagazine );
+		}
+
+		pMagazine->m_pBlocks[pMagazine->m_nBlocks++] = pMem;
+		pMagazine->m_nNetAllocs--;
+		pMagazine->m_nFrees++;
+
+		UnlockMagazine( pMagazine );
+		return;
+	}
+
+	m_pFreeList->Push( (TSLNodeBase_t *)pMem );
+	ThreadInterlockedDecrement( &m_nNetAllocsUnmagazined );
+}
+
+
+void CMemoryPoolMT::Clear()
+{
+	AUTO_LOCK( m_GrowMutex );
+
+	m_pFreeList->Detach();
+	for ( int i = 0; i < NUM_MAGAZINES; i++ )
+	{
+		Magazine_t *pMagazine = (Magazine_t *)( m_pMagazines + i * m_nMagazineStride );
+		pMagazine->m_nBlocks = 0;
+		pMagazine->m_nNetAllocs = 0;
+	}
+	m_nNetAllocsUnmagazined = 0;
+
+	CUtlMemoryPool::Clear();
+}
+
+
+int CMemoryPoolMT::Count()
+{
+	int nCount = m_nNetAllocsUnmagazined;
+	for ( int i = 0; i < NUM_MAGAZINES; i++ )
+	{
+		nCount += ( (Magazine_t *)( m_pMagazines + i * m_nMagazineStride ) )->m_nNetAllocs;
+	}
+	return nCount;
+}
+
+
+void CMemoryPoolMT::GetStats( MemoryPoolMTStats_t &stats )
+{
+	memset( &stats, 0, sizeof( stats ) );
+	for ( int i = 0; i < NUM_MAGAZINES; i++ )
+	{
+		Magazine_t *pMagazine = (Magazine_t *)( m_pMagazines + i * m_nMagazineStride );
+		stats.m_nMagazineAllocs += pMagazine->m_nAllocs;
+		stats.m_nMagazineFrees += pMagazine->m_nFrees;
+		stats.m_nRefills += pMagazine->m_nRefills;
+		stats.m_nFlushes += pMagazine->m_nFlushes;
+	}
+	stats.m_nContended = m_nContended;
+	stats.m_nGrows = m_nGrows;
+}
+
+
+void CMemoryPoolMT::ResetStats()
+{
+	for ( int i = 0; i < NUM_MAGAZINES; i++ )
+	{
+		Magazine_t *pMagazine = (Magazine_t *)( m_pMagazines + i * m_nMagazineStride );
+		pMagazine->m_nAllocs = 0;
+		pMagazine->m_nFrees = 0;
+		pMagazine->m_nRefills = 0;
+		pMagazine->m_nFlushes = 0;
+	}
+	m_nContended = 0;
+	m_nGrows = 0;
+}
+
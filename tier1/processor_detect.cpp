@@ -12,6 +12,7 @@ bool CheckMMXTechnology(void) { return false; }
 bool CheckSSETechnology(void) { return false; }
 bool CheckSSE2Technology(void) { return false; }
 bool Check3DNowTechnology(void) { return false; }
+bool CheckAVXTechnology(void) { return false; }
 
 #elif defined( _WIN32 ) && !defined( _X360 )
 
@@ -269,6 +270,71 @@ bool Check3DNowTechnology(void)
     return retval;
 }
 
+bool CheckAVXTechnology(void)
+{
+    int retval = true;
+    unsigned int RegECX = 0;
+    unsigned int RegXCR0 = 0;
+
+#ifdef CPUID
+	_asm pushad;
+#endif
+
+	// Do we have support for the CPUID function?
+    __try
+	{
+        _asm
+		{
+#ifdef CPUID
+			xor ecx, ecx			// Clue the compiler that ECX is about to be used.
+#endif
+            mov eax, 1				// set up CPUID to return processor version and features
+            CPUID					// code bytes = 0fh,  0a2h
+            mov RegECX, ecx			// extended features returned in ecx
+		}
+    } 
+	__except(EXCEPTION_EXECUTE_HANDLER) 
+	{ 
+		retval = false; 
+	}
+
+	// If CPUID not supported, then certainly no AVX.
+    if (retval)
+	{
+		// bit 28 is set for AVX, bit 27 if the OS uses XSAVE and so can support XGETBV
+		if ( ( RegECX & 0x18000000 ) == 0x18000000 )
+		{
+			// The OS must also save the upper halves of the ymm registers on context switches,
+			// which it says in bits 1 and 2 of XCR0
+			__try
+			{
+				_asm
+				{
+					xor ecx, ecx
+					_emit 0x0f				// xgetbv; older assemblers don't know the mnemonic
+					_emit 0x01
+					_emit 0xd0
+					mov RegXCR0, eax
+				}
+			} 
+			__except(EXCEPTION_EXECUTE_HANDLER) 
+			{ 
+				retval = false; 
+			}
+
+			if ( ( RegXCR0 & 0x6 ) != 0x6 )
+				retval = false;
+		}
+		else
+			retval = false;
+	}
+#ifdef CPUID
+	_asm popad;
+#endif
+
+    return retval;
+}
+
 #pragma optimize( "", on )
 
 #endif // _WIN32
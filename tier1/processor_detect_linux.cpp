@@ -45,3 +45,18 @@ bool Check3DNowTechnology(void)
     }
     return false;
 }
+
+bool CheckAVXTechnology(void)
+{
+    unsigned long eax,ebx,ecx,unused;
+    cpuid(1,eax,ebx,ecx,unused);
+
+	// bit 28 is AVX, bit 27 says the OS uses XSAVE so xgetbv is available
+	if ( ( ecx & 0x18000000 ) != 0x18000000 )
+		return false;
+
+	// the OS must also save the ymm registers on context switches (XCR0 bits 1 and 2)
+	unsigned int xcr0, xcr0hi;
+	asm(".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+	return ( xcr0 & 0x6 ) == 0x6;
+}
@@ -14,80 +14,141 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+#define MIN_STRING_POOL_SLOTS	64
+#define STRING_POOL_HASH_SEED	0x2545f491
+
 //-----------------------------------------------------------------------------
-// Purpose: Comparison function for string sorted associative data structures
 //-----------------------------------------------------------------------------
 
-bool StrLess( const char * const &pszLeft, const char * const &pszRight )
+CStringPool::CStringPool()
+  : m_nStrings( 0 )
 {
-	return ( Q_stricmp( pszLeft, pszRight) < 0 );
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
-CStringPool::CStringPool()
-  : m_Strings( 32, 256, StrLess )
+CStringPool::~CStringPool()
 {
+	FreeAll();
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
-CStringPool::~CStringPool()
+unsigned int CStringPool::Count() const
 {
-	FreeAll();
+	return m_nStrings;
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
-unsigned int CStringPool::Count() const
+unsigned CStringPool::HashString( const char *pszValue )
 {
-	return m_Strings.Count();
+	return MurmurHash2LowerCase( pszValue, STRING_POOL_HASH_SEED );
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 const char * CStringPool::Find( const char *pszValue )
 {
-	unsigned short i = m_Strings.Find(pszValue);
-	if ( m_Strings.IsValidIndex(i) )
-		return m_Strings[i];
+	if ( !pszValue )
+		return NULL;
+
+	return Find( pszValue, HashString( pszValue ) );
+}
+
+const char * CStringPool::Find( const char *pszValue, unsigned nHash )
+{
+	Assert( nHash == HashString( pszValue ) );
+
+	if ( !m_Slots.Count() )
+		return NULL;
+
+	unsigned nMask = m_Slots.Count() - 1;
+	for ( unsigned i = nHash & nMask; m_Slots[i].m_pszValue; i = ( i + 1 ) & nMask )
+	{
+		if ( m_Slots[i].m_nHash == nHash && !Q_stricmp( m_Slots[i].m_pszValue, pszValue ) )
+			return m_Slots[i].m_pszValue;
+	}
 
 	return NULL;
 }
 
 const char * CStringPool::Allocate( const char *pszValue )
 {
-	char	*pszNew;
+	if ( !pszValue )
+		return NULL;
 
-	unsigned short i 	= m_Strings.Find(pszValue);
-	bool		   bNew = (i == m_Strings.InvalidIndex());
+	return Allocate( pszValue, HashString( pszValue ) );
+}
+
+const char * CStringPool::Allocate( const char *pszValue, unsigned nHash )
+{
+	const char *pszFound = Find( pszValue, nHash );
+	if ( pszFound )
+		return pszFound;
 
-	if ( !bNew )
-		return m_Strings[i];
+	if ( ( m_nStrings + 1 ) * 2 > (unsigned)m_Slots.Count() )
+	{
+		GrowHashTable();
+	}
 
-	pszNew = strdup( pszValue );
+	char *pszNew = strdup( pszValue );
 
-	if ( bNew )
-		m_Strings.Insert( pszNew );
+	unsigned nMask = m_Slots.Count() - 1;
+	unsigned i = nHash & nMask;
+	while ( m_Slots[i].m_pszValue )
+	{
+		i = ( i + 1 ) & nMask;
+	}
+	m_Slots[i].m_pszValue = pszNew;
+	m_Slots[i].m_nHash = nHash;
+	m_nStrings++;
 
 	return pszNew;
 }
 
+//-----------------------------------------------------------------------------
+// Doubles the slots and reinserts everything
+//-----------------------------------------------------------------------------
+
+void CStringPool::GrowHashTable()
+{
+	CUtlVector<HashSlot_t> oldSlots;
+	oldSlots.Swap( m_Slots );
+
+	int nSlots = max( oldSlots.Count() * 2, MIN_STRING_POOL_SLOTS );
+	m_Slots.SetCount( nSlots );
+	memset( m_Slots.Base(), 0, nSlots * sizeof( HashSlot_t ) );
+
+	unsigned nMask = nSlots - 1;
+	for ( int iOld = 0; iOld < oldSlots.Count(); iOld++ )
+	{
+		if ( !oldSlots[iOld].m_pszValue )
+			continue;
+
+		unsigned i = oldSlots[iOld].m_nHash & nMask;
+		while ( m_Slots[i].m_pszValue )
+		{
+			i = ( i + 1 ) & nMask;
+		}
+		m_Slots[i] = oldSlots[iOld];
+	}
+}
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
 void CStringPool::FreeAll()
 {
-	unsigned short i = m_Strings.FirstInorder();
-	while ( i != m_Strings.InvalidIndex() )
+	for ( int i = 0; i < m_Slots.Count(); i++ )
 	{
-		free( (void *)m_Strings[i] );
-		i = m_Strings.NextInorder(i);
+		free( (void *)m_Slots[i].m_pszValue );
 	}
-	m_Strings.RemoveAll();
+	m_Slots.Purge();
+	m_nStrings = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -46,6 +46,7 @@ CPPFILES= \
     ilocalize.cpp \
     interface.cpp \
     KeyValues.cpp \
+    kvimage.cpp \
     kvpacker.cpp \
     lzmaDecoder.cpp \
     mempool.cpp \
@@ -206,6 +207,14 @@ $(OBJ_DIR)/KeyValues.o : $(PWD)/KeyValues.cpp $(PWD)/tier1_linux32.mak $(SRCROOT
 	$(PRE_COMPILE_FILE)
 	$(COMPILE_FILE) $(POST_COMPILE_FILE)
 
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/kvimage.P
+endif
+
+$(OBJ_DIR)/kvimage.o : $(PWD)/kvimage.cpp $(PWD)/tier1_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
 ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
 -include $(OBJ_DIR)/kvpacker.P
 endif
@@ -22,6 +22,9 @@ TokenReader::TokenReader(void)
 	m_nLine = 1;
 	m_nErrorCount = 0;
 	m_bStuffed = false;
+	m_pBuffer = NULL;
+	m_nBufferSize = 0;
+	m_nBufferPos = 0;
 }
 
 
@@ -37,15 +40,51 @@ bool TokenReader::Open(const char *pszFilename)
 	m_nLine = 1;
 	m_nErrorCount = 0;
 	m_bStuffed = false;
+	m_pBuffer = NULL;
 	return(is_open() != 0);
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Reads tokens out of memory instead of a file. The buffer must stay
+//			valid until the reader is closed.
+// Input  : *pszFilename - Only used for error messages.
+//			*pBuffer - Text to read. It doesn't need to be NULL terminated.
+//			nBufferSize - Number of bytes in pBuffer.
+//			nFirstLine - Line number of the start of the buffer, for error messages.
+// Output : Returns true on success, false on failure.
+//-----------------------------------------------------------------------------
+bool TokenReader::OpenBuffer(const char *pszFilename, const char *pBuffer, int nBufferSize, int nFirstLine)
+{
+	if (is_open())
+	{
+		close();
+	}
+
+	Q_strncpy(m_szFilename, pszFilename, sizeof( m_szFilename ) );
+	m_nLine = nFirstLine;
+	m_nErrorCount = 0;
+	m_bStuffed = false;
+	m_pBuffer = pBuffer;
+	m_nBufferSize = nBufferSize;
+	m_nBufferPos = 0;
+	return(pBuffer != NULL);
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
 void TokenReader::Close()
 {
+	if (m_pBuffer != NULL)
+	{
+		m_pBuffer = NULL;
+		m_nBufferSize = 0;
+		m_nBufferPos = 0;
+		return;
+	}
+
 	close();
 }
 
@@ -215,11 +254,6 @@ trtoken_t TokenReader::NextToken(char *pszStore, int nSize)
 {
 	char *pStart = pszStore;
 
-	if (!is_open())
-	{
-		return TOKENEOF;
-	}
-
 	//
 	// If they stuffed a token, return that token.
 	//
@@ -229,6 +263,16 @@ trtoken_t TokenReader::NextToken(char *pszStore, int nSize)
 		Q_strncpy( pszStore, m_szStuffed, nSize );
 		return m_eStuffed;
 	}
+
+	if (m_pBuffer != NULL)
+	{
+		return NextTokenFromBuffer(pszStore, nSize);
+	}
+
+	if (!is_open())
+	{
+		return TOKENEOF;
+	}
 	
 	SkipWhiteSpace();
 
@@ -478,3 +522,383 @@ bool TokenReader::SkipWhiteSpace(void)
 	}
 }
 
+
+//-----------------------------------------------------------------------------
+// Purpose: Buffer version of NextToken. Splits the text the same way the file
+//			version does, but reads it straight out of memory.
+// Input  : pszStore - Pointer to a string that will receive the token.
+// Output : Returns the type of token that was read, or TOKENERROR.
+//-----------------------------------------------------------------------------
+trtoken_t TokenReader::NextTokenFromBuffer(char *pszStore, int nSize)
+{
+	char *pStart = pszStore;
+
+	SkipWhiteSpaceInBuffer();
+
+	if (m_nBufferPos >= m_nBufferSize)
+	{
+		return TOKENEOF;
+	}
+
+	unsigned char ch = m_pBuffer[m_nBufferPos++];
+
+	//
+	// Look for all the valid operators.
+	//
+	switch (ch)
+	{
+		case '@':
+		case ',':
+		case '!':
+		case '+':
+		case '&':
+		case '*':
+		case '$':
+		case '.':
+		case '=':
+		case ':':
+		case '[':
+		case ']':
+		case '(':
+		case ')':
+		case '{':
+		case '}':
+		case '\\':
+		{
+			pszStore[0] = ch;
+			pszStore[1] = 0;
+			return OPERATOR;
+		}
+	}
+
+	//
+	// Look for the start of a quoted string.
+	//
+	if (ch == '\"')
+	{
+		return GetStringFromBuffer(pszStore, nSize);
+	}
+
+	//
+	// Integers consist of numbers with an optional leading minus sign.
+	//
+	if (isdigit(ch) || (ch == '-'))
+	{
+		while (true)
+		{
+			if ( (pszStore - pStart + 1) < nSize )
+			{
+				*pszStore = ch;
+				pszStore++;
+			}
+
+			if (m_nBufferPos >= m_nBufferSize)
+			{
+				*pszStore = '\0';
+				return INTEGER;
+			}
+
+			ch = m_pBuffer[m_nBufferPos++];
+			if (ch == '-')
+			{
+				return TOKENERROR;
+			}
+
+			if (!isdigit(ch))
+			{
+				break;
+			}
+		}
+
+		//
+		// No identifier characters are allowed contiguous with numbers.
+		//
+		if (isalpha(ch) || (ch == '_'))
+		{
+			return TOKENERROR;
+		}
+
+		//
+		// Put back the non-numeric character for the next call.
+		//
+		m_nBufferPos--;
+		*pszStore = '\0';
+		return INTEGER;
+	}
+
+	//
+	// Identifiers consist of a consecutive string of alphanumeric
+	// characters and underscores.
+	//
+	if (!isalpha(ch) && (ch != '_'))
+	{
+		//
+		// The file version would return an empty identifier here forever. Hand
+		// back the character instead so the caller reports it.
+		//
+		pszStore[0] = ch;
+		pszStore[1] = 0;
+		return OPERATOR;
+	}
+
+	while (true)
+	{
+		if ( (pszStore - pStart + 1) < nSize )
+		{
+			*pszStore = ch;
+			pszStore++;
+		}
+
+		if (m_nBufferPos >= m_nBufferSize)
+		{
+			break;
+		}
+
+		ch = m_pBuffer[m_nBufferPos];
+		if (!isalpha(ch) && !isdigit(ch) && (ch != '_'))
+		{
+			break;
+		}
+
+		m_nBufferPos++;
+	}
+
+	*pszStore = '\0';
+	return IDENT;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Buffer version of GetString. Called after the open quote has been read.
+// Input  : pszStore - 
+//			nSize - 
+// Output : Returns STRING on success, or an error token.
+//-----------------------------------------------------------------------------
+trtoken_t TokenReader::GetStringFromBuffer(char *pszStore, int nSize)
+{
+	if (nSize <= 0)
+	{
+		return TOKENERROR;
+	}
+
+	char *pszEnd = pszStore + nSize - 1;
+
+	while (true)
+	{
+		//
+		// Copy up to the close quote.
+		//
+		while (true)
+		{
+			if (m_nBufferPos >= m_nBufferSize)
+			{
+				return TOKENEOF;
+			}
+
+			char ch = m_pBuffer[m_nBufferPos];
+			if (ch == '\"')
+			{
+				break;
+			}
+
+			if (ch == 0x0d)
+			{
+				//
+				// Newline encountered before closing quote -- unterminated string.
+				//
+				*pszStore = '\0';
+				return TOKENSTRINGTOOLONG;
+			}
+
+			m_nBufferPos++;
+
+			if (ch == '\0')
+			{
+				continue;
+			}
+
+			if (pszStore == pszEnd)
+			{
+				//
+				// Ran out of room in the destination buffer. Skip past the close-quote,
+				// terminate the string, and exit.
+				//
+				while ((m_nBufferPos < m_nBufferSize) && (m_pBuffer[m_nBufferPos++] != '\"'))
+				{
+				}
+
+				*pszStore = '\0';
+				return TOKENSTRINGTOOLONG;
+			}
+
+			if (ch == '\\')
+			{
+				//
+				// Backslash sequence - replace with the appropriate character. A backslash
+				// can't escape the close quote.
+				//
+				if ((m_nBufferPos >= m_nBufferSize) || (m_pBuffer[m_nBufferPos] == '\"'))
+				{
+					continue;
+				}
+
+				ch = m_pBuffer[m_nBufferPos++];
+				if (ch == 'n')
+				{
+					ch = '\n';
+				}
+			}
+
+			*pszStore++ = ch;
+		}
+
+		//
+		// Eat the close quote and any whitespace.
+		//
+		m_nBufferPos++;
+
+		bool bCombineStrings = SkipWhiteSpaceInBuffer();
+
+		//
+		// Combine consecutive quoted strings if the combine strings character was
+		// encountered between the two strings.
+		//
+		if (bCombineStrings && (m_nBufferPos < m_nBufferSize) && (m_pBuffer[m_nBufferPos] == '\"'))
+		{
+			//
+			// Eat the open quote and keep parsing this string.
+			//
+			m_nBufferPos++;
+		}
+		else
+		{
+			//
+			// Done with this string, terminate the string and exit.
+			//
+			*pszStore = '\0';
+			return STRING;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Buffer version of SkipWhiteSpace.
+// Output : Returns true if the whitespace contained the combine strings
+//			character '\', which is used to merge consecutive quoted strings.
+//-----------------------------------------------------------------------------
+bool TokenReader::SkipWhiteSpaceInBuffer(void)
+{
+	bool bCombineStrings = false;
+
+	while (m_nBufferPos < m_nBufferSize)
+	{
+		char ch = m_pBuffer[m_nBufferPos];
+
+		if ((ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == 0))
+		{
+			m_nBufferPos++;
+			continue;
+		}
+
+		if (ch == '+')
+		{
+			bCombineStrings = true;
+			m_nBufferPos++;
+			continue;
+		}
+
+		if (ch == '\n')
+		{
+			m_nLine++;
+			m_nBufferPos++;
+			continue;
+		}
+
+		//
+		// Check for the start of a comment. A lone slash is thrown away.
+		//
+		if (ch == '/')
+		{
+			m_nBufferPos++;
+			if ((m_nBufferPos < m_nBufferSize) && (m_pBuffer[m_nBufferPos] == '/'))
+			{
+				const char *pNewline = (const char *)memchr(m_pBuffer + m_nBufferPos, '\n', m_nBufferSize - m_nBufferPos);
+				m_nBufferPos = pNewline ? (pNewline - m_pBuffer) + 1 : m_nBufferSize;
+				m_nLine++;
+			}
+			continue;
+		}
+
+		break;
+	}
+
+	return(bCombineStrings);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Skips to just past the '}' that closes the block whose '{' was the
+//			last token read, without splitting what's in between into tokens.
+//			Quoted strings and comments are stepped over so braces inside them
+//			don't count. Only works when reading from a buffer.
+// Output : Returns false if the end of the buffer was reached first.
+//-----------------------------------------------------------------------------
+bool TokenReader::SkipBlock(void)
+{
+	Assert( m_pBuffer && !m_bStuffed );
+
+	int nDepth = 1;
+	while (m_nBufferPos < m_nBufferSize)
+	{
+		switch (m_pBuffer[m_nBufferPos++])
+		{
+			case '\n':
+			{
+				m_nLine++;
+				break;
+			}
+
+			case '\"':
+			{
+				// Newlines inside strings aren't counted, the same as when they are read.
+				const char *pQuote = (const char *)memchr(m_pBuffer + m_nBufferPos, '\"', m_nBufferSize - m_nBufferPos);
+				if (!pQuote)
+				{
+					m_nBufferPos = m_nBufferSize;
+					return false;
+				}
+				m_nBufferPos = (pQuote - m_pBuffer) + 1;
+				break;
+			}
+
+			case '/':
+			{
+				if ((m_nBufferPos < m_nBufferSize) && (m_pBuffer[m_nBufferPos] == '/'))
+				{
+					const char *pNewline = (const char *)memchr(m_pBuffer + m_nBufferPos, '\n', m_nBufferSize - m_nBufferPos);
+					m_nBufferPos = pNewline ? (pNewline - m_pBuffer) + 1 : m_nBufferSize;
+					m_nLine++;
+				}
+				break;
+			}
+
+			case '{':
+			{
+				nDepth++;
+				break;
+			}
+
+			case '}':
+			{
+				if (--nDepth == 0)
+				{
+					return true;
+				}
+				break;
+			}
+		}
+	}
+
+	return false;
+}
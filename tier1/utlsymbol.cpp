@@ -15,6 +15,7 @@
 #include "stringpool.h"
 #include "utlhashtable.h"
 #include "utlstring.h"
+#include "generichash.h"
 
 // Ensure that everybody has the right compiler version installed. The version
 // number can be obtained by looking at the compiler output when you type 'cl'
@@ -36,9 +37,58 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
-#define INVALID_STRING_INDEX CStringPoolIndex( 0xFFFF, 0xFFFF )
-
 #define MIN_STRING_POOL_SIZE	2048
+#define MAX_STRING_POOL_SHIFT	5		// pools grow to 64k
+
+#define SYMBOL_CHUNK_SHIFT		8
+#define SYMBOL_CHUNK_SIZE		( 1 << SYMBOL_CHUNK_SHIFT )
+#define SYMBOL_CHUNK_MASK		( SYMBOL_CHUNK_SIZE - 1 )
+
+#define MIN_SYMBOL_HASH_SLOTS	16
+#define SYMBOL_HASH_SEED		0x5f3759df
+
+//-----------------------------------------------------------------------------
+// The red-black tree layout CUtlSymbolTable and CUtlSymbolTableMT had before
+// the hash index. Prebuilt libraries (dmxloader, choreoobjects) were compiled
+// against it and embed tables in their own objects, so the tables must still
+// fit in the space those objects reserve for them.
+//-----------------------------------------------------------------------------
+namespace SymbolTableOldLayout
+{
+	struct StringPoolIndex_t
+	{
+		unsigned short m_iPool;
+		unsigned short m_iOffset;
+	};
+
+	class CLess
+	{
+	public:
+		CLess( int ignored = 0 ) {}
+		bool operator!() const { return false; }
+		bool operator()( const StringPoolIndex_t &left, const StringPoolIndex_t &right ) const { return false; }
+	};
+
+	class CTable
+	{
+		CUtlRBTree<StringPoolIndex_t, unsigned short, CLess> m_Lookup;
+		bool m_bInsensitive;
+		mutable const char* m_pUserSearchString;
+		CUtlVector<void*> m_StringPools;
+	};
+
+	class CTableMT : private CTable
+	{
+#if defined(WIN32) || defined(_WIN32)
+		mutable CThreadSpinRWLock m_lock;
+#else
+		mutable CThreadRWLock m_lock;
+#endif
+	};
+}
+
+COMPILE_TIME_ASSERT( sizeof( CUtlSymbolTable ) <= sizeof( SymbolTableOldLayout::CTable ) );
+COMPILE_TIME_ASSERT( sizeof( CUtlSymbolTableMT ) <= sizeof( SymbolTableOldLayout::CTableMT ) );
 
 //-----------------------------------------------------------------------------
 // globals
@@ -126,37 +176,21 @@ bool CUtlSymbol::operator==( const char* pStr ) const
 // symbol table stuff
 //-----------------------------------------------------------------------------
 
-inline const char* CUtlSymbolTable::StringFromIndex( const CStringPoolIndex &index ) const
+inline const char* CUtlSymbolTable::StringFromId( UtlSymId_t id ) const
 {
-	Assert( index.m_iPool < m_StringPools.Count() );
-	Assert( index.m_iOffset < m_StringPools[index.m_iPool]->m_TotalLen );
+	const ChunkDirectory_t *pDirectory = m_pDirectory;
+	Assert( pDirectory && (int)( id >> SYMBOL_CHUNK_SHIFT ) < pDirectory->m_nChunks );
 
-	return &m_StringPools[index.m_iPool]->m_Data[index.m_iOffset];
+	return pDirectory->m_pChunks[id >> SYMBOL_CHUNK_SHIFT][id & SYMBOL_CHUNK_MASK].m_pString;
 }
 
 
-bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStringPoolIndex &i2 ) const
+unsigned CUtlSymbolTable::HashString( const char* pString, bool caseInsensitive )
 {
-	// Need to do pointer math because CUtlSymbolTable is used in CUtlVectors, and hence
-	// can be arbitrarily moved in memory on a realloc. Yes, this is portable. In reality,
-	// right now at least, because m_LessFunc is the first member of CUtlRBTree, and m_Lookup
-	// is the first member of CUtlSymbolTabke, this == pTable
-	CUtlSymbolTable *pTable = (CUtlSymbolTable *)( (byte *)this - offsetof(CUtlSymbolTable::CTree, m_LessFunc) ) - offsetof(CUtlSymbolTable, m_Lookup );
-	const char* str1 = (i1 == INVALID_STRING_INDEX) ? pTable->m_pUserSearchString :
-													  pTable->StringFromIndex( i1 );
-	const char* str2 = (i2 == INVALID_STRING_INDEX) ? pTable->m_pUserSearchString :
-													  pTable->StringFromIndex( i2 );
-
-	if ( !str1 && str2 )
-		return false;
-	if ( !str2 && str1 )
-		return true;
-	if ( !str1 && !str2 )
-		return false;
-	if ( !pTable->m_bInsensitive )
-		return V_strcmp( str1, str2 ) < 0;
-	else
-		return V_stricmp( str1, str2 ) < 0;
+	if ( caseInsensitive )
+		return MurmurHash2LowerCase( pString, SYMBOL_HASH_SEED );
+
+	return MurmurHash2( pString, V_strlen( pString ), SYMBOL_HASH_SEED );
 }
 
 
@@ -164,8 +198,14 @@ bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStri
 // constructor, destructor
 //-----------------------------------------------------------------------------
 CUtlSymbolTable::CUtlSymbolTable( int growSize, int initSize, bool caseInsensitive ) : 
-	m_Lookup( growSize, initSize ), m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
+	m_pHashTable( NULL ), m_pDirectory( NULL ), m_nSymbols( 0 ), m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
 {
+	// Nothing is allocated until the first string is added
+	m_nInitialSlots = MIN_SYMBOL_HASH_SLOTS;
+	while ( m_nInitialSlots < initSize * 2 )
+	{
+		m_nInitialSlots <<= 1;
+	}
 }
 
 CUtlSymbolTable::~CUtlSymbolTable()
@@ -175,39 +215,151 @@ CUtlSymbolTable::~CUtlSymbolTable()
 }
 
 
+//-----------------------------------------------------------------------------
+// Probes the hash index. This runs without a lock in CUtlSymbolTableMT, so it
+// reads the id of a slot before anything the id refers to.
+//-----------------------------------------------------------------------------
+UtlSymId_t CUtlSymbolTable::FindId( const char *pString, unsigned nHash ) const
+{
+	const HashTable_t *pTable = m_pHashTable;
+	if ( !pTable )
+		return UTL_INVAL_SYMBOL;
+
+	unsigned nMask = pTable->m_nMask;
+	for ( unsigned i = nHash & nMask; ; i = ( i + 1 ) & nMask )
+	{
+		const HashSlot_t &slot = pTable->m_Slots[i];
+		UtlSymId_t id = *(volatile const UtlSymId_t *)&slot.m_Id;
+		if ( id == UTL_INVAL_SYMBOL )
+			return UTL_INVAL_SYMBOL;
+
+		ThreadMemoryBarrier();
+		if ( slot.m_nHash != nHash )
+			continue;
+
+		const char *pSymbol = StringFromId( id );
+		if ( !( m_bInsensitive ? V_stricmp( pSymbol, pString ) : V_strcmp( pSymbol, pString ) ) )
+			return id;
+	}
+}
+
+
 CUtlSymbol CUtlSymbolTable::Find( const char* pString ) const
 {	
 	if (!pString)
 		return CUtlSymbol();
-	
-	// Store a special context used to help with insertion
-	m_pUserSearchString = pString;
-	
-	// Passing this special invalid symbol makes the comparison function
-	// use the string passed in the context
-	UtlSymId_t idx = m_Lookup.Find( INVALID_STRING_INDEX );
 
-#ifdef _DEBUG
-	m_pUserSearchString = NULL;
-#endif
+	return CUtlSymbol( FindId( pString, HashString( pString ) ) );
+}
 
-	return CUtlSymbol( idx );
+
+CUtlSymbol CUtlSymbolTable::Find( const char* pString, unsigned nHash ) const
+{	
+	if (!pString)
+		return CUtlSymbol();
+
+	Assert( nHash == HashString( pString ) );
+	return CUtlSymbol( FindId( pString, nHash ) );
 }
 
 
-int CUtlSymbolTable::FindPoolWithSpace( int len )	const
+//-----------------------------------------------------------------------------
+// Copies a string into the pools. Pools get bigger as the table does, and
+// strings too big for one get a pool of their own.
+//-----------------------------------------------------------------------------
+const char* CUtlSymbolTable::CopyString( const char *pString )
 {
-	for ( int i=0; i < m_StringPools.Count(); i++ )
+	int len = V_strlen(pString) + 1;
+	int nPoolSize = MIN_STRING_POOL_SIZE << min( m_StringPools.Count(), MAX_STRING_POOL_SHIFT );
+
+	StringPool_t *pPool = m_StringPools.Count() ? m_StringPools.Tail() : NULL;
+	if ( !pPool || ( pPool->m_TotalLen - pPool->m_SpaceUsed ) < len )
+	{
+		bool bOwnPool = pPool && ( len > nPoolSize / 2 );
+		int newPoolSize = max( len, nPoolSize );
+		pPool = (StringPool_t*)malloc( sizeof( StringPool_t ) + newPoolSize - 1 );
+		pPool->m_TotalLen = newPoolSize;
+		pPool->m_SpaceUsed = 0;
+
+		// Keep filling the current pool after a big string
+		if ( bOwnPool )
+		{
+			m_StringPools.InsertBefore( m_StringPools.Count() - 1, pPool );
+		}
+		else
+		{
+			m_StringPools.AddToTail( pPool );
+		}
+	}
+
+	char *pCopy = &pPool->m_Data[pPool->m_SpaceUsed];
+	memcpy( pCopy, pString, len );
+	pPool->m_SpaceUsed += len;
+	return pCopy;
+}
+
+
+//-----------------------------------------------------------------------------
+// Replaces the hash index with one twice the size. The old one is kept for
+// lookups that are still probing it.
+//-----------------------------------------------------------------------------
+void CUtlSymbolTable::GrowHashTable()
+{
+	HashTable_t *pOldTable = m_pHashTable;
+	unsigned nSlots = pOldTable ? ( pOldTable->m_nMask + 1 ) * 2 : m_nInitialSlots;
+
+	HashTable_t *pTable = (HashTable_t*)malloc( sizeof( HashTable_t ) + ( nSlots - 1 ) * sizeof( HashSlot_t ) );
+	pTable->m_pRetired = pOldTable;
+	pTable->m_nMask = nSlots - 1;
+	for ( unsigned i = 0; i < nSlots; i++ )
+	{
+		pTable->m_Slots[i].m_nHash = 0;
+		pTable->m_Slots[i].m_Id = UTL_INVAL_SYMBOL;
+	}
+
+	for ( int i = 0; i < m_nSymbols; i++ )
 	{
-		StringPool_t *pPool = m_StringPools[i];
+		unsigned nHash = m_pDirectory->m_pChunks[i >> SYMBOL_CHUNK_SHIFT][i & SYMBOL_CHUNK_MASK].m_nHash;
+		unsigned iSlot = nHash & pTable->m_nMask;
+		while ( pTable->m_Slots[iSlot].m_Id != UTL_INVAL_SYMBOL )
+		{
+			iSlot = ( iSlot + 1 ) & pTable->m_nMask;
+		}
+		pTable->m_Slots[iSlot].m_nHash = nHash;
+		pTable->m_Slots[iSlot].m_Id = (UtlSymId_t)i;
+	}
 
-		if ( (pPool->m_TotalLen - pPool->m_SpaceUsed) >= len )
+	ThreadMemoryBarrier();
+	m_pHashTable = pTable;
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds the chunk that symbol m_nSymbols goes in, growing the directory if needed
+//-----------------------------------------------------------------------------
+void CUtlSymbolTable::AddChunk()
+{
+	int iChunk = m_nSymbols >> SYMBOL_CHUNK_SHIFT;
+
+	ChunkDirectory_t *pDirectory = m_pDirectory;
+	if ( !pDirectory || iChunk >= pDirectory->m_nChunks )
+	{
+		int nChunks = pDirectory ? pDirectory->m_nChunks * 2 : 4;
+		ChunkDirectory_t *pNewDirectory = (ChunkDirectory_t*)malloc( sizeof( ChunkDirectory_t ) + ( nChunks - 1 ) * sizeof( SymbolEntry_t* ) );
+		pNewDirectory->m_pRetired = pDirectory;
+		pNewDirectory->m_nChunks = nChunks;
+		memset( pNewDirectory->m_pChunks, 0, nChunks * sizeof( SymbolEntry_t* ) );
+		if ( pDirectory )
 		{
-			return i;
+			memcpy( pNewDirectory->m_pChunks, pDirectory->m_pChunks, pDirectory->m_nChunks * sizeof( SymbolEntry_t* ) );
 		}
+		pDirectory = pNewDirectory;
 	}
 
-	return -1;
+	pDirectory->m_pChunks[iChunk] = (SymbolEntry_t*)malloc( SYMBOL_CHUNK_SIZE * sizeof( SymbolEntry_t ) );
+
+	ThreadMemoryBarrier();
+	m_pDirectory = pDirectory;
 }
 
 
@@ -220,42 +372,57 @@ CUtlSymbol CUtlSymbolTable::AddString( const char* pString )
 	if (!pString) 
 		return CUtlSymbol( UTL_INVAL_SYMBOL );
 
-	CUtlSymbol id = Find( pString );
-	
-	if (id.IsValid())
-		return id;
+	return AddString( pString, HashString( pString ) );
+}
 
-	int len = V_strlen(pString) + 1;
 
-	// Find a pool with space for this string, or allocate a new one.
-	int iPool = FindPoolWithSpace( len );
-	if ( iPool == -1 )
+CUtlSymbol CUtlSymbolTable::AddString( const char* pString, unsigned nHash )
+{
+	if (!pString) 
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	Assert( nHash == HashString( pString ) );
+
+	UtlSymId_t id = FindId( pString, nHash );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	if ( (unsigned)m_nSymbols >= (unsigned)UTL_INVAL_SYMBOL )
 	{
-		// Add a new pool.
-		int newPoolSize = max( len, MIN_STRING_POOL_SIZE );
-		StringPool_t *pPool = (StringPool_t*)malloc( sizeof( StringPool_t ) + newPoolSize - 1 );
-		pPool->m_TotalLen = newPoolSize;
-		pPool->m_SpaceUsed = 0;
-		iPool = m_StringPools.AddToTail( pPool );
+		AssertMsg( 0, "CUtlSymbolTable is full\n" );
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
 	}
 
-	// Copy the string in.
-	StringPool_t *pPool = m_StringPools[iPool];
-	Assert( pPool->m_SpaceUsed < 0xFFFF );	// This should never happen, because if we had a string > 64k, it
-											// would have been given its entire own pool.
-	
-	unsigned short iStringOffset = pPool->m_SpaceUsed;
+	// Keep the index at most half full so probes stay short
+	if ( !m_pHashTable || (unsigned)( m_nSymbols + 1 ) * 2 > m_pHashTable->m_nMask + 1 )
+	{
+		GrowHashTable();
+	}
 
-	memcpy( &pPool->m_Data[pPool->m_SpaceUsed], pString, len );
-	pPool->m_SpaceUsed += len;
+	id = (UtlSymId_t)m_nSymbols;
+	if ( ( id & SYMBOL_CHUNK_MASK ) == 0 )
+	{
+		AddChunk();
+	}
 
-	// didn't find, insert the string into the vector.
-	CStringPoolIndex index;
-	index.m_iPool = iPool;
-	index.m_iOffset = iStringOffset;
+	SymbolEntry_t &entry = m_pDirectory->m_pChunks[id >> SYMBOL_CHUNK_SHIFT][id & SYMBOL_CHUNK_MASK];
+	entry.m_pString = CopyString( pString );
+	entry.m_nHash = nHash;
 
-	UtlSymId_t idx = m_Lookup.Insert( index );
-	return CUtlSymbol( idx );
+	HashTable_t *pTable = m_pHashTable;
+	unsigned iSlot = nHash & pTable->m_nMask;
+	while ( pTable->m_Slots[iSlot].m_Id != UTL_INVAL_SYMBOL )
+	{
+		iSlot = ( iSlot + 1 ) & pTable->m_nMask;
+	}
+	pTable->m_Slots[iSlot].m_nHash = nHash;
+
+	// Lookups can find the symbol as soon as its id is in the slot, so that goes last
+	ThreadMemoryBarrier();
+	pTable->m_Slots[iSlot].m_Id = id;
+	m_nSymbols++;
+
+	return CUtlSymbol( id );
 }
 
 
@@ -268,8 +435,8 @@ const char* CUtlSymbolTable::String( CUtlSymbol id ) const
 	if (!id.IsValid()) 
 		return "";
 	
-	Assert( m_Lookup.IsValidIndex((UtlSymId_t)id) );
-	return StringFromIndex( m_Lookup[id] );
+	Assert( (int)(UtlSymId_t)id < m_nSymbols );
+	return StringFromId( id );
 }
 
 
@@ -279,7 +446,31 @@ const char* CUtlSymbolTable::String( CUtlSymbol id ) const
 
 void CUtlSymbolTable::RemoveAll()
 {
-	m_Lookup.Purge();
+	HashTable_t *pTable = m_pHashTable;
+	while ( pTable )
+	{
+		HashTable_t *pRetired = pTable->m_pRetired;
+		free( pTable );
+		pTable = pRetired;
+	}
+	m_pHashTable = NULL;
+
+	ChunkDirectory_t *pDirectory = m_pDirectory;
+	if ( pDirectory )
+	{
+		for ( int i = 0; i < pDirectory->m_nChunks; i++ )
+		{
+			free( pDirectory->m_pChunks[i] );
+		}
+	}
+	while ( pDirectory )
+	{
+		ChunkDirectory_t *pRetired = pDirectory->m_pRetired;
+		free( pDirectory );
+		pDirectory = pRetired;
+	}
+	m_pDirectory = NULL;
+	m_nSymbols = 0;
 	
 	for ( int i=0; i < m_StringPools.Count(); i++ )
 		free( m_StringPools[i] );
@@ -434,3 +625,4 @@ void CUtlFilenameSymbolTable::RemoveAll()
 {
 	m_Strings->Purge();
 }
+
@@ -26,6 +26,7 @@
 #include "tier0/dbg.h"
 #include "lumpfiles.h"
 #include "vtf/vtf.h"
+#include "tier0/threadtools.h"
 
 //=============================================================================
 
@@ -3865,6 +3866,272 @@ const char *ResolveStaticPropToModel( const char *pPropName )
 	return g_StaticPropNames[iModel].String();
 }
 
+//-----------------------------------------------------------------------------
+// Runs a list of jobs on worker threads for a caller that consumes the results
+// in job order, e.g. to write them out. Workers only run a few jobs ahead of the
+// caller, so only that many results are ever held in memory at once.
+//-----------------------------------------------------------------------------
+#define MAX_BSP_JOB_THREADS			32
+#define BSP_JOBS_AHEAD_PER_THREAD	2
+
+class CBSPJobQueue
+{
+public:
+	typedef void (*JobFunc_t)( int iJob, void *pUserData );
+
+	CBSPJobQueue( int nJobs, JobFunc_t pJobFunc, void *pUserData );
+	~CBSPJobQueue();
+
+	// Waits for a job to be done. Call with the jobs in order, and call
+	// FinishJob once the job's results are no longer needed.
+	void WaitForJob( int iJob );
+	void FinishJob( int iJob );
+
+private:
+	static unsigned WorkerThread( void *pParam );
+	void ProcessJobs();
+
+	int						m_nJobs;
+	JobFunc_t				m_pJobFunc;
+	void					*m_pUserData;
+	int						m_nMaxJobsAhead;
+
+	CThreadFastMutex		m_Mutex;		// Guards m_iNextJob and m_nFinishedJobs.
+	int						m_iNextJob;
+	int						m_nFinishedJobs;
+	bool volatile			m_bAbort;
+	CUtlVector<long>		m_JobDone;
+	CThreadEvent			m_JobDoneEvent;
+	CThreadEvent			m_JobSlotEvent;	// Set when a worker might be able to start another job.
+
+	CUtlVector<ThreadHandle_t>	m_Threads;
+};
+
+CBSPJobQueue::CBSPJobQueue( int nJobs, JobFunc_t pJobFunc, void *pUserData )
+{
+	m_nJobs = nJobs;
+	m_pJobFunc = pJobFunc;
+	m_pUserData = pUserData;
+	m_iNextJob = 0;
+	m_nFinishedJobs = 0;
+	m_bAbort = false;
+	m_JobDone.SetCount( nJobs );
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		m_JobDone[i] = 0;
+	}
+
+	int nThreads = min( (int)GetCPUInformation()->m_nLogicalProcessors, MAX_BSP_JOB_THREADS );
+	nThreads = max( min( nThreads, nJobs ), 1 );
+	m_nMaxJobsAhead = nThreads * BSP_JOBS_AHEAD_PER_THREAD;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		m_Threads.AddToTail( CreateSimpleThread( WorkerThread, this ) );
+	}
+}
+
+CBSPJobQueue::~CBSPJobQueue()
+{
+	// stop anything the caller didn't wait for
+	m_bAbort = true;
+	m_JobSlotEvent.Set();
+	for ( int i = 0; i < m_Threads.Count(); i++ )
+	{
+		ThreadJoin( m_Threads[i] );
+		ReleaseThreadHandle( m_Threads[i] );
+	}
+}
+
+void CBSPJobQueue::WaitForJob( int iJob )
+{
+	while ( !m_JobDone[iJob] )
+	{
+		m_JobDoneEvent.Wait();
+	}
+}
+
+void CBSPJobQueue::FinishJob( int iJob )
+{
+	m_Mutex.Lock();
+	m_nFinishedJobs++;
+	m_Mutex.Unlock();
+	m_JobSlotEvent.Set();
+}
+
+unsigned CBSPJobQueue::WorkerThread( void *pParam )
+{
+	((CBSPJobQueue *)pParam)->ProcessJobs();
+	return 0;
+}
+
+void CBSPJobQueue::ProcessJobs()
+{
+	while ( !m_bAbort )
+	{
+		m_Mutex.Lock();
+		if ( m_iNextJob >= m_nJobs )
+		{
+			m_Mutex.Unlock();
+			break;
+		}
+		if ( m_iNextJob >= m_nFinishedJobs + m_nMaxJobsAhead )
+		{
+			// too far ahead of the caller, wait for it to catch up
+			m_Mutex.Unlock();
+			m_JobSlotEvent.Wait();
+			continue;
+		}
+		int iJob = m_iNextJob++;
+		bool bMoreSlots = ( m_iNextJob < m_nJobs && m_iNextJob < m_nFinishedJobs + m_nMaxJobsAhead );
+		m_Mutex.Unlock();
+
+		// the event only wakes one worker, pass it along if there's more to do
+		if ( bMoreSlots )
+		{
+			m_JobSlotEvent.Set();
+		}
+
+		m_pJobFunc( iJob, m_pUserData );
+
+		ThreadInterlockedExchange( &m_JobDone[iJob], 1 );
+		m_JobDoneEvent.Set();
+	}
+
+	// pass the wakeup along so the other workers see the abort too
+	m_JobSlotEvent.Set();
+}
+
+//-----------------------------------------------------------------------------
+// Converts one file from the pak file. relativeName is changed to the name of
+// the converted file, and the data to add to the pak ends up in either
+// sourceBuf or targetBuf. Runs on the CBSPJobQueue worker threads.
+//-----------------------------------------------------------------------------
+static CThreadFastMutex s_PakFileMutex;
+
+struct PakFileJob_t
+{
+	char		relativeName[MAX_PATH];
+	CUtlBuffer	sourceBuf;
+	CUtlBuffer	targetBuf;
+	bool		bOK;
+	bool		bConverted;
+};
+
+struct PakFileJobs_t
+{
+	const char					*pInFilename;
+	CUtlVector<PakFileJob_t *>	jobs;
+};
+
+static bool ConvertPakFile( const char *pInFilename, char *relativeName, CUtlBuffer &sourceBuf, CUtlBuffer &targetBuf, bool &bConverted )
+{
+	bConverted = false;
+
+	const char* pExtension = V_GetFileExtension( relativeName );
+	const char* pExt = 0;
+
+	s_PakFileMutex.Lock();
+	bool bOK = ReadFileFromPak( GetPakFile(), relativeName, false, sourceBuf );
+	s_PakFileMutex.Unlock();
+	if ( !bOK )
+	{
+		Warning( "Failed to load '%s' from lump pak for conversion or copy in '%s'.\n", relativeName, pInFilename );
+		return false;
+	}
+
+	if ( pExtension && !V_stricmp( pExtension, "vtf" ) )
+	{
+		bOK = g_pVTFConvertFunc( relativeName, sourceBuf, targetBuf, g_pCompressFunc );
+		if ( !bOK )
+		{
+			Warning( "Failed to convert '%s' in '%s'.\n", relativeName, pInFilename );
+			return false;
+		}
+
+		bConverted = true;
+		pExt = ".vtf";
+	}
+	else if ( pExtension && !V_stricmp( pExtension, "vhv" ) )
+	{			
+		CUtlBuffer tempBuffer;
+		if ( g_pVHVFixupFunc )
+		{
+			// caller supplied a fixup
+			const char *pModelName = ResolveStaticPropToModel( relativeName );
+			if ( !pModelName )
+			{
+				Warning( "Static Prop '%s' failed to resolve actual model in '%s'.\n", relativeName, pInFilename );
+				return false;
+			}
+
+			// output temp buffer may shrink, must use TellPut() to determine size
+			bOK = g_pVHVFixupFunc( relativeName, pModelName, sourceBuf, tempBuffer );
+			if ( !bOK )
+			{
+				Warning( "Failed to convert '%s' in '%s'.\n", relativeName, pInFilename );
+				return false;
+			}
+		}
+		else
+		{
+			// use the source buffer as-is
+			tempBuffer.EnsureCapacity( sourceBuf.TellMaxPut() );
+			tempBuffer.Put( sourceBuf.Base(), sourceBuf.TellMaxPut() );
+		}
+
+		// swap the VHV
+		targetBuf.EnsureCapacity( tempBuffer.TellPut() );
+		bOK = SwapVHV( targetBuf.Base(), tempBuffer.Base() );
+		if ( !bOK )
+		{
+			Warning( "Failed to swap '%s' in '%s'.\n", relativeName, pInFilename );
+			return false;
+		}
+		targetBuf.SeekPut( CUtlBuffer::SEEK_HEAD, tempBuffer.TellPut() );
+
+		if ( g_pCompressFunc )
+		{
+			CUtlBuffer compressedBuffer;
+			targetBuf.SeekGet( CUtlBuffer::SEEK_HEAD, sizeof( HardwareVerts::FileHeader_t ) );
+			bool bCompressed = g_pCompressFunc( targetBuf, compressedBuffer );
+			if ( bCompressed )
+			{
+				// copy all the header data off
+				CUtlBuffer headerBuffer;
+				headerBuffer.EnsureCapacity( sizeof( HardwareVerts::FileHeader_t ) );
+				headerBuffer.Put( targetBuf.Base(), sizeof( HardwareVerts::FileHeader_t ) );
+
+				// reform the target with the header and then the compressed data
+				targetBuf.Clear();
+				targetBuf.Put( headerBuffer.Base(), sizeof( HardwareVerts::FileHeader_t ) );
+				targetBuf.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
+			}
+
+			targetBuf.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+		}
+
+		bConverted = true;
+		pExt = ".vhv";
+	}
+
+	if ( bConverted )
+	{
+		// converted filename
+		V_StripExtension( relativeName, relativeName, MAX_PATH );
+		V_strcat( relativeName, ".360", MAX_PATH );
+		V_strcat( relativeName, pExt, MAX_PATH );
+	}
+
+	return true;
+}
+
+static void ConvertPakFileJob( int iJob, void *pUserData )
+{
+	PakFileJobs_t *pJobs = (PakFileJobs_t *)pUserData;
+	PakFileJob_t *pJob = pJobs->jobs[iJob];
+	pJob->bOK = ConvertPakFile( pJobs->pInFilename, pJob->relativeName, pJob->sourceBuf, pJob->targetBuf, pJob->bConverted );
+}
+
 //-----------------------------------------------------------------------------
 // Iterate files in pak file, distribute to converters
 // pak file will be ready for serialization upon completion
@@ -3873,11 +4140,12 @@ void ConvertPakFileContents( const char *pInFilename )
 {
 	IZip *newPakFile = IZip::CreateZip( NULL );
 
-	CUtlBuffer sourceBuf;
-	CUtlBuffer targetBuf;
-	bool bConverted;
 	CUtlVector< CUtlString > hdrFiles;
 
+	// the files are converted on worker threads and added to the new pak in the original order
+	PakFileJobs_t pakJobs;
+	pakJobs.pInFilename = pInFilename;
+
 	int id = -1;
 	int fileSize;
 	while ( 1 )
@@ -3887,115 +4155,43 @@ void ConvertPakFileContents( const char *pInFilename )
 		if ( id == -1)
 			break;
 
-		bConverted = false;
-		sourceBuf.Purge();
-		targetBuf.Purge();
-
-		const char* pExtension = V_GetFileExtension( relativeName );
-		const char* pExt = 0;
+		PakFileJob_t *pJob = new PakFileJob_t;
+		V_strncpy( pJob->relativeName, relativeName, sizeof( pJob->relativeName ) );
+		pakJobs.jobs.AddToTail( pJob );
+	}
 
-		bool bOK = ReadFileFromPak( GetPakFile(), relativeName, false, sourceBuf );
-		if ( !bOK )
+	{
+		CBSPJobQueue jobQueue( pakJobs.jobs.Count(), ConvertPakFileJob, &pakJobs );
+		for ( int i = 0; i < pakJobs.jobs.Count(); i++ )
 		{
-			Warning( "Failed to load '%s' from lump pak for conversion or copy in '%s'.\n", relativeName, pInFilename );
-			continue;
-		}
+			jobQueue.WaitForJob( i );
 
-		if ( pExtension && !V_stricmp( pExtension, "vtf" ) )
-		{
-			bOK = g_pVTFConvertFunc( relativeName, sourceBuf, targetBuf, g_pCompressFunc );
-			if ( !bOK )
-			{
-				Warning( "Failed to convert '%s' in '%s'.\n", relativeName, pInFilename );
-				continue;
-			}
-	
-			bConverted = true;
-			pExt = ".vtf";
-		}
-		else if ( pExtension && !V_stricmp( pExtension, "vhv" ) )
-		{			
-			CUtlBuffer tempBuffer;
-			if ( g_pVHVFixupFunc )
+			PakFileJob_t *pJob = pakJobs.jobs[i];
+			if ( pJob->bOK )
 			{
-				// caller supplied a fixup
-				const char *pModelName = ResolveStaticPropToModel( relativeName );
-				if ( !pModelName )
+				const char *relativeName = pJob->relativeName;
+				if ( !pJob->bConverted )
 				{
-					Warning( "Static Prop '%s' failed to resolve actual model in '%s'.\n", relativeName, pInFilename );
-					continue;
+					// straight copy
+					AddBufferToPak( newPakFile, relativeName, pJob->sourceBuf.Base(), pJob->sourceBuf.TellMaxPut(), false );
 				}
-
-				// output temp buffer may shrink, must use TellPut() to determine size
-				bOK = g_pVHVFixupFunc( relativeName, pModelName, sourceBuf, tempBuffer );
-				if ( !bOK )
+				else
 				{
-					Warning( "Failed to convert '%s' in '%s'.\n", relativeName, pInFilename );
-					continue;
+					AddBufferToPak( newPakFile, relativeName, pJob->targetBuf.Base(), pJob->targetBuf.TellMaxPut(), false );
 				}
-			}
-			else
-			{
-				// use the source buffer as-is
-				tempBuffer.EnsureCapacity( sourceBuf.TellMaxPut() );
-				tempBuffer.Put( sourceBuf.Base(), sourceBuf.TellMaxPut() );
-			}
-
-			// swap the VHV
-			targetBuf.EnsureCapacity( tempBuffer.TellPut() );
-			bOK = SwapVHV( targetBuf.Base(), tempBuffer.Base() );
-			if ( !bOK )
-			{
-				Warning( "Failed to swap '%s' in '%s'.\n", relativeName, pInFilename );
-				continue;
-			}
-			targetBuf.SeekPut( CUtlBuffer::SEEK_HEAD, tempBuffer.TellPut() );
 
-			if ( g_pCompressFunc )
-			{
-				CUtlBuffer compressedBuffer;
-				targetBuf.SeekGet( CUtlBuffer::SEEK_HEAD, sizeof( HardwareVerts::FileHeader_t ) );
-				bool bCompressed = g_pCompressFunc( targetBuf, compressedBuffer );
-				if ( bCompressed )
+				if ( V_stristr( relativeName, ".hdr" ) || V_stristr( relativeName, "_hdr" ) )
 				{
-					// copy all the header data off
-					CUtlBuffer headerBuffer;
-					headerBuffer.EnsureCapacity( sizeof( HardwareVerts::FileHeader_t ) );
-					headerBuffer.Put( targetBuf.Base(), sizeof( HardwareVerts::FileHeader_t ) );
-
-					// reform the target with the header and then the compressed data
-					targetBuf.Clear();
-					targetBuf.Put( headerBuffer.Base(), sizeof( HardwareVerts::FileHeader_t ) );
-					targetBuf.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
+					hdrFiles.AddToTail( relativeName );
 				}
 
-				targetBuf.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+				DevMsg( "Created '%s' in lump pak in '%s'.\n", relativeName, pInFilename );
 			}
 
-			bConverted = true;
-			pExt = ".vhv";
-		}
-
-		if ( !bConverted )
-		{
-			// straight copy
-			AddBufferToPak( newPakFile, relativeName, sourceBuf.Base(), sourceBuf.TellMaxPut(), false );
-		}
-		else
-		{
-			// converted filename
-			V_StripExtension( relativeName, relativeName, sizeof( relativeName ) );
-			V_strcat( relativeName, ".360", sizeof( relativeName ) );
-			V_strcat( relativeName, pExt, sizeof( relativeName ) );
-			AddBufferToPak( newPakFile, relativeName, targetBuf.Base(), targetBuf.TellMaxPut(), false );
+			delete pJob;
+			pakJobs.jobs[i] = NULL;
+			jobQueue.FinishJob( i );
 		}
-
-		if ( V_stristr( relativeName, ".hdr" ) || V_stristr( relativeName, "_hdr" ) )
-		{
-			hdrFiles.AddToTail( relativeName );
-		}
-
-		DevMsg( "Created '%s' in lump pak in '%s'.\n", relativeName, pInFilename );
 	}
 
 	// strip ldr version of hdr files
@@ -4400,73 +4596,129 @@ int SortLumpsByOffset( const SortedLump_t *pSortedLumpA, const SortedLump_t *pSo
 	return 0;
 }
 
-bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc )
+//-----------------------------------------------------------------------------
+// Lump compression jobs for CompressBSP, one per lump or game lump.
+//-----------------------------------------------------------------------------
+struct CompressJob_t
 {
-	CByteswap	byteSwap;
+	byte		*pData;
+	int			nDataSize;
+	CUtlBuffer	*pCompressed;	// NULL if the data didn't compress
+};
 
-	dgamelumpheader_t* pInGameLumpHeader = (dgamelumpheader_t*)(((byte *)pInBSPHeader) + pInBSPHeader->lumps[LUMP_GAME_LUMP].fileofs);
-	dgamelump_t* pInGameLump = (dgamelump_t*)(pInGameLumpHeader + 1);
+struct CompressJobs_t
+{
+	CompressFunc_t				pCompressFunc;
+	CUtlVector< CompressJob_t >	jobs;
+};
 
-	byteSwap.ActivateByteSwapping( true );
-	byteSwap.SwapFieldsToTargetEndian( pInGameLumpHeader );
-	byteSwap.SwapFieldsToTargetEndian( pInGameLump, pInGameLumpHeader->lumpCount );
+static void CompressJob( int iJob, void *pUserData )
+{
+	CompressJobs_t *pJobs = (CompressJobs_t *)pUserData;
+	CompressJob_t &job = pJobs->jobs[iJob];
 
-	unsigned int newOffset = outputBuffer.TellPut();
-	outputBuffer.Put( pInGameLumpHeader, sizeof( dgamelumpheader_t ) );
-	outputBuffer.Put( pInGameLump, pInGameLumpHeader->lumpCount * sizeof( dgamelump_t ) );
+	CUtlBuffer inputBuffer;
+	inputBuffer.SetExternalBuffer( job.pData, job.nDataSize, job.nDataSize );
 
-	dgamelumpheader_t* pOutGameLumpHeader = (dgamelumpheader_t*)((byte *)outputBuffer.Base() + newOffset);
-	dgamelump_t* pOutGameLump = (dgamelump_t*)(pOutGameLumpHeader + 1);
+	job.pCompressed = new CUtlBuffer;
+	if ( !pJobs->pCompressFunc( inputBuffer, *job.pCompressed ) )
+	{
+		delete job.pCompressed;
+		job.pCompressed = NULL;
+	}
+}
+
+static void AddCompressJob( CompressJobs_t &compressJobs, byte *pData, int nDataSize )
+{
+	CompressJob_t &job = compressJobs.jobs[ compressJobs.jobs.AddToTail() ];
+	job.pData = pData;
+	job.nDataSize = nDataSize;
+	job.pCompressed = NULL;
+}
+
+// Writes out a finished job, compressed if it compressed. Returns true if it did.
+static bool WriteCompressJob( FileHandle_t hFile, CBSPJobQueue &jobQueue, CompressJobs_t &compressJobs, int iJob )
+{
+	jobQueue.WaitForJob( iJob );
+
+	CompressJob_t &job = compressJobs.jobs[iJob];
+	bool bCompressed = ( job.pCompressed != NULL );
+	if ( bCompressed )
+	{
+		SafeWrite( hFile, job.pCompressed->Base(), job.pCompressed->TellPut() );
+		delete job.pCompressed;
+		job.pCompressed = NULL;
+	}
+	else
+	{
+		// as is
+		SafeWrite( hFile, job.pData, job.nDataSize );
+	}
+
+	jobQueue.FinishJob( iJob );
+	return bCompressed;
+}
+
+static void CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, FileHandle_t hFile, CBSPJobQueue &jobQueue, CompressJobs_t &compressJobs, int &iJob )
+{
+	CByteswap	byteSwap;
+
+	// CompressBSP already swapped the game lump directory to native
+	dgamelumpheader_t* pInGameLumpHeader = (dgamelumpheader_t*)(((byte *)pInBSPHeader) + pInBSPHeader->lumps[LUMP_GAME_LUMP].fileofs);
+	dgamelump_t* pInGameLump = (dgamelump_t*)(pInGameLumpHeader + 1);
 
 	// add a dummy terminal gamelump
 	// purposely NOT updating the .filelen to reflect the compressed size, but leaving as original size
 	// callers use the next entry offset to determine compressed size
-	pOutGameLumpHeader->lumpCount++;
-	dgamelump_t dummyLump = { 0 };
-	outputBuffer.Put( &dummyLump, sizeof( dgamelump_t ) );
+	dgamelumpheader_t outGameLumpHeader = *pInGameLumpHeader;
+	outGameLumpHeader.lumpCount++;
+	CUtlVector< dgamelump_t > outGameLumps;
+	outGameLumps.SetCount( outGameLumpHeader.lumpCount );
+	memcpy( outGameLumps.Base(), pInGameLump, pInGameLumpHeader->lumpCount * sizeof( dgamelump_t ) );
+	memset( &outGameLumps.Tail(), 0, sizeof( dgamelump_t ) );
+
+	// the directory gets written again once the offsets are known
+	unsigned int newOffset = g_pFileSystem->Tell( hFile );
+	SafeWrite( hFile, &outGameLumpHeader, sizeof( dgamelumpheader_t ) );
+	SafeWrite( hFile, outGameLumps.Base(), outGameLumps.Count() * sizeof( dgamelump_t ) );
 
 	for ( int i = 0; i < pInGameLumpHeader->lumpCount; i++ )
 	{
-		CUtlBuffer inputBuffer;
-		CUtlBuffer compressedBuffer;
-
-		pOutGameLump[i].fileofs = AlignBuffer( outputBuffer, 4 );
+		outGameLumps[i].fileofs = AlignFilePosition( hFile, 4 );
 
 		if ( pInGameLump[i].filelen )
 		{
-			inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pInGameLump[i].fileofs, pInGameLump[i].filelen, pInGameLump[i].filelen );
-
-			bool bCompressed = pCompressFunc( inputBuffer, compressedBuffer );
-			if ( bCompressed )
-			{
-				pOutGameLump[i].flags |= GAMELUMPFLAG_COMPRESSED;
-
-				outputBuffer.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
-				compressedBuffer.Purge();
-			}
-			else
+			if ( WriteCompressJob( hFile, jobQueue, compressJobs, iJob++ ) )
 			{
-				// as is
-				outputBuffer.Put( inputBuffer.Base(), inputBuffer.TellPut() );
+				outGameLumps[i].flags |= GAMELUMPFLAG_COMPRESSED;
 			}
 		}
 	}
 
 	// fix the dummy terminal lump
-	int lastLump = pOutGameLumpHeader->lumpCount-1;
-	pOutGameLump[lastLump].fileofs = outputBuffer.TellPut();
+	unsigned int endOffset = g_pFileSystem->Tell( hFile );
+	outGameLumps.Tail().fileofs = endOffset;
 
 	// fix the output for 360, swapping it back
-	byteSwap.SwapFieldsToTargetEndian( pOutGameLump, pOutGameLumpHeader->lumpCount );
-	byteSwap.SwapFieldsToTargetEndian( pOutGameLumpHeader );
+	byteSwap.ActivateByteSwapping( true );
+	byteSwap.SwapFieldsToTargetEndian( outGameLumps.Base(), outGameLumps.Count() );
+	byteSwap.SwapFieldsToTargetEndian( &outGameLumpHeader );
 
-	pOutBSPHeader->lumps[LUMP_GAME_LUMP].fileofs = newOffset;
-	pOutBSPHeader->lumps[LUMP_GAME_LUMP].filelen = outputBuffer.TellPut() - newOffset;
+	g_pFileSystem->Seek( hFile, newOffset, FILESYSTEM_SEEK_HEAD );
+	SafeWrite( hFile, &outGameLumpHeader, sizeof( dgamelumpheader_t ) );
+	SafeWrite( hFile, outGameLumps.Base(), outGameLumps.Count() * sizeof( dgamelump_t ) );
+	g_pFileSystem->Seek( hFile, endOffset, FILESYSTEM_SEEK_HEAD );
 
-	return true;
+	pOutBSPHeader->lumps[LUMP_GAME_LUMP].fileofs = newOffset;
+	pOutBSPHeader->lumps[LUMP_GAME_LUMP].filelen = endOffset - newOffset;
 }
 
-bool CompressBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc )
+//-----------------------------------------------------------------------------
+// Compresses the lumps of a 360 bsp and writes the result to pOutFilename.
+// The lumps and game lumps are compressed on worker threads and written out
+// as they finish, in the input's lump order.
+//-----------------------------------------------------------------------------
+static bool CompressBSP( CUtlBuffer &inputBuffer, const char *pOutFilename, CompressFunc_t pCompressFunc )
 {
 	CByteswap	byteSwap;
 
@@ -4481,11 +4733,8 @@ bool CompressBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFun
 	byteSwap.ActivateByteSwapping( true );
 	byteSwap.SwapFieldsToTargetEndian( pInBSPHeader );
 
-	// output will be smaller, use input size as upper bound
-	outputBuffer.EnsureCapacity( inputBuffer.TellMaxPut() );
-	outputBuffer.Put( pInBSPHeader, sizeof( dheader_t ) );
-
-	dheader_t *pOutBSPHeader = (dheader_t *)outputBuffer.Base();
+	dheader_t outBSPHeader = *pInBSPHeader;
+	dheader_t *pOutBSPHeader = &outBSPHeader;
 
 	// must adhere to input lump's offset order and process according to that, NOT lump num
 	// sort by offset order
@@ -4498,6 +4747,57 @@ bool CompressBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFun
 	}
 	sortedLumps.Sort( SortLumpsByOffset );
 
+	// queue up a compression job for everything in the order it gets written
+	CompressJobs_t compressJobs;
+	compressJobs.pCompressFunc = pCompressFunc;
+	for ( int i = 0; i < HEADER_LUMPS; ++i )
+	{
+		SortedLump_t *pSortedLump = &sortedLumps[i];
+		int lumpNum = pSortedLump->lumpNum;
+
+		if ( !pSortedLump->pLump->filelen || lumpNum == LUMP_PAKFILE )
+			continue;
+
+		if ( lumpNum == LUMP_GAME_LUMP )
+		{
+			// the game lump has to have each of its components individually compressed
+			dgamelumpheader_t* pInGameLumpHeader = (dgamelumpheader_t*)(((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs);
+			dgamelump_t* pInGameLump = (dgamelump_t*)(pInGameLumpHeader + 1);
+
+			byteSwap.SwapFieldsToTargetEndian( pInGameLumpHeader );
+			byteSwap.SwapFieldsToTargetEndian( pInGameLump, pInGameLumpHeader->lumpCount );
+
+			for ( int j = 0; j < pInGameLumpHeader->lumpCount; j++ )
+			{
+				if ( pInGameLump[j].filelen )
+				{
+					AddCompressJob( compressJobs, ((byte *)pInBSPHeader) + pInGameLump[j].fileofs, pInGameLump[j].filelen );
+				}
+			}
+		}
+		else
+		{
+			AddCompressJob( compressJobs, ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs, pSortedLump->pLump->filelen );
+		}
+	}
+
+	// write to a temp file next to the output and only replace the output once
+	// everything has been written, so a failure part way leaves the old bsp alone
+	char szTempFilename[MAX_PATH];
+	V_snprintf( szTempFilename, sizeof( szTempFilename ), "%s.tmp", pOutFilename );
+
+	FileHandle_t hFile = SafeOpenWrite( szTempFilename );
+	if ( !hFile )
+	{
+		return false;
+	}
+
+	// the header gets written again at the end
+	SafeWrite( hFile, pOutBSPHeader, sizeof( dheader_t ) );
+
+	CBSPJobQueue jobQueue( compressJobs.jobs.Count(), CompressJob, &compressJobs );
+	int iJob = 0;
+
 	// iterate in sorted order
 	for ( int i = 0; i < HEADER_LUMPS; ++i )
 	{
@@ -4516,43 +4816,30 @@ bool CompressBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFun
 			{
 				alignment = 2048;
 			}
-			unsigned int newOffset = AlignBuffer( outputBuffer, alignment );
+			unsigned int newOffset = AlignFilePosition( hFile, alignment );
 
 			// only set by compressed lumps, hides the uncompressed size
 			*((unsigned int *)pOutBSPHeader->lumps[lumpNum].fourCC) = 0;
 
-			CUtlBuffer inputBuffer;
-			inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs, pSortedLump->pLump->filelen, pSortedLump->pLump->filelen );
-
 			if ( lumpNum == LUMP_GAME_LUMP )
 			{
-				// the game lump has to have each of its components individually compressed
-				CompressGameLump( pInBSPHeader, pOutBSPHeader, outputBuffer, pCompressFunc );
+				CompressGameLump( pInBSPHeader, pOutBSPHeader, hFile, jobQueue, compressJobs, iJob );
 			}
 			else if ( lumpNum == LUMP_PAKFILE )
 			{
 				// add as is
 				pOutBSPHeader->lumps[lumpNum].fileofs = newOffset;
-				outputBuffer.Put( inputBuffer.Base(), inputBuffer.TellPut() );
+				SafeWrite( hFile, ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs, pSortedLump->pLump->filelen );
 			}
 			else
 			{
-				CUtlBuffer compressedBuffer;
-				bool bCompressed = pCompressFunc( inputBuffer, compressedBuffer );
-				if ( bCompressed )
+				pOutBSPHeader->lumps[lumpNum].fileofs = newOffset;
+				CompressJob_t &job = compressJobs.jobs[iJob];
+				if ( WriteCompressJob( hFile, jobQueue, compressJobs, iJob++ ) )
 				{
 					// placing the uncompressed size in the unused fourCC, will decode at runtime
-					*((unsigned int *)pOutBSPHeader->lumps[lumpNum].fourCC) = BigLong( inputBuffer.TellPut() );
-					pOutBSPHeader->lumps[lumpNum].filelen = compressedBuffer.TellPut();
-					pOutBSPHeader->lumps[lumpNum].fileofs = newOffset;
-					outputBuffer.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
-					compressedBuffer.Purge();
-				}
-				else
-				{
-					// add as is
-					pOutBSPHeader->lumps[lumpNum].fileofs = newOffset;
-					outputBuffer.Put( inputBuffer.Base(), inputBuffer.TellPut() );
+					*((unsigned int *)pOutBSPHeader->lumps[lumpNum].fourCC) = BigLong( job.nDataSize );
+					pOutBSPHeader->lumps[lumpNum].filelen = g_pFileSystem->Tell( hFile ) - newOffset;
 				}
 			}
 		}
@@ -4562,6 +4849,21 @@ bool CompressBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFun
 	byteSwap.SetTargetBigEndian( true );
 	byteSwap.SwapFieldsToTargetEndian( pOutBSPHeader );
 
+	g_pFileSystem->Seek( hFile, 0, FILESYSTEM_SEEK_HEAD );
+	SafeWrite( hFile, pOutBSPHeader, sizeof( dheader_t ) );
+	g_pFileSystem->Close( hFile );
+
+	// rename won't replace an existing file on win32, so only remove the old output if it has to
+	if ( !g_pFullFileSystem->RenameFile( szTempFilename, pOutFilename ) )
+	{
+		g_pFullFileSystem->RemoveFile( pOutFilename );
+		if ( !g_pFullFileSystem->RenameFile( szTempFilename, pOutFilename ) )
+		{
+			Warning( "Error! Couldn't rename %s to %s!\n", szTempFilename, pOutFilename );
+			return false;
+		}
+	}
+
 	return true;
 }
 
@@ -4767,22 +5069,12 @@ bool SwapBSPFile( const char *pInFilename, const char *pOutFilename, bool bSwapO
 			return false;
 		}
 
-		CUtlBuffer outputBuffer;
-		if ( !CompressBSP( inputBuffer, outputBuffer, pCompressFunc ) )
+		// streams the compressed lumps out to a temp file that replaces the uncompressed one
+		if ( !CompressBSP( inputBuffer, pOutFilename, pCompressFunc ) )
 		{
 			Warning( "Error! Failed to compress BSP '%s'!\n", pOutFilename ); 
 			return false;
 		}
-	
-		g_hBSPFile = SafeOpenWrite( pOutFilename );
-		if ( !g_hBSPFile )
-		{
-			Warning( "Error! Couldn't open output file %s - BSP swap failed!\n", pOutFilename ); 
-			return false;
-		}
-		SafeWrite( g_hBSPFile, outputBuffer.Base(), outputBuffer.TellPut() );
-		g_pFileSystem->Close( g_hBSPFile );
-		g_hBSPFile = 0;			
 	}
 
 	return true;
@@ -160,11 +160,26 @@ bool FileSystem_Init( const char *pBSPFilename, int maxMemoryUsage, FSInitType_t
 				return false;
 
 			g_pFileSystem = g_pFullFileSystem = VMPI_FileSystem_Init( maxMemoryUsage, g_pFullFileSystem );
+
+#if defined( POSIX )
+			// Workers read everything else from their own disk, but the map comes from the master.
+			char bspFilename[MAX_PATH];
+			V_strncpy( bspFilename, pBSPFilename, sizeof( bspFilename ) );
+			V_DefaultExtension( bspFilename, ".bsp", sizeof( bspFilename ) );
+			VMPI_FileSystem_ShareFile( bspFilename );
+#endif
 			SendQDirInfo();
 		}
 		else
 		{
+#if defined( POSIX )
+			if ( !FileSystem_Init_Normal( pBSPFilename, initType, bOnlyUseFilename ) )
+				return false;
+
+			g_pFileSystem = g_pFullFileSystem = VMPI_FileSystem_Init( maxMemoryUsage, g_pFullFileSystem );
+#else
 			g_pFileSystem = g_pFullFileSystem = VMPI_FileSystem_Init( maxMemoryUsage, NULL );
+#endif
 			RecvQDirInfo();
 		}
 		return true;
@@ -0,0 +1,69 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: The VMPI stats interface for POSIX builds. The stats database is
+//			reached through the Windows MySQL wrapper, so here it's never used
+//			and these just keep the tools running without it.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "tier0/dbg.h"
+#include "vmpi.h"
+#include "mpi_stats.h"
+
+
+// -------------------------------------------------------------------------------- //
+// VMPI_Stats interface.
+// -------------------------------------------------------------------------------- //
+
+void VMPI_Stats_InstallSpewHook()
+{
+}
+
+
+bool VMPI_Stats_Init_Master(
+	const char *pHostName,
+	const char *pDBName,
+	const char *pUserName,
+	const char *pBSPFilename,
+	unsigned long *pDBJobID )
+{
+	*pDBJobID = 0;
+	return false;
+}
+
+
+bool VMPI_Stats_Init_Worker( const char *pHostName, const char *pDBName, const char *pUserName, unsigned long DBJobID )
+{
+	return false;
+}
+
+
+void VMPI_Stats_Term()
+{
+}
+
+
+void StatsDB_InitStatsDatabase(
+	int argc,
+	char **argv,
+	const char *pDBInfoFilename )
+{
+	if ( g_bMPIMaster && ( g_bMPI_Stats || VMPI_IsParamUsed( mpi_Job_Watch ) ) )
+	{
+		Warning( "The VMPI stats database isn't supported on this platform, so %s and %s are ignored.\n",
+			VMPI_GetParamString( mpi_Stats ), VMPI_GetParamString( mpi_Job_Watch ) );
+	}
+}
+
+
+unsigned long StatsDB_GetUniqueJobID()
+{
+	return 0;
+}
+
+
+unsigned long VMPI_Stats_GetJobWorkerID()
+{
+	return 0;
+}
@@ -13,13 +13,23 @@
 
 #define	USED
 
+#ifdef _WIN32
 #include <windows.h>
+#elif defined( POSIX )
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
 #include "cmdlib.h"
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "pacifier.h"
 
-#define	MAX_THREADS	16
+#include "tier0/threadtools.h"
+
+#define	MAX_THREADS	MAX_TOOL_THREADS
+
+// Largest batch of work items a thread claims from its own queue at once.
+#define MAX_WORK_BATCH	32
 
 
 class CRunThreadsData
@@ -33,15 +43,179 @@ public:
 CRunThreadsData g_RunThreadsData[MAX_THREADS];
 
 
-int		dispatch;
 int		workcount;
 qboolean		pacifier;
 
 qboolean	threaded;
 bool g_bLowPriorityThreads = false;
+bool g_bPrintThreadStats = false;
 
-HANDLE g_ThreadHandles[MAX_THREADS];
 
+//-----------------------------------------------------------------------------
+// Work queues for GetThreadWork.
+//
+// Each thread owns a range of unclaimed work items [next, end), packed into
+// an int64 so it can be updated with one compare-exchange. The ranges are
+// interleaved: every range steps by the thread count, and thread i starts at
+// item i, so all the threads move through the work items together in
+// ascending order. Tools rely on that order; vvis sorts its portals so the
+// ones flowed early can be used to prune the later ones.
+//
+// The owner claims small batches from the front of its range; a thread that
+// runs dry steals half of what's left from the back of another thread's
+// range, which holds the items due to be reached last. Nothing here takes
+// ThreadLock.
+//-----------------------------------------------------------------------------
+#define WORK_RANGE( next, end )		( (int64)(uint32)(next) | ( (int64)(uint32)(end) << 32 ) )
+#define WORK_RANGE_NEXT( range )	( (int)(uint32)(range) )
+#define WORK_RANGE_END( range )		( (int)(uint32)( (uint64)(range) >> 32 ) )
+
+class ALIGN128 CThreadWorkQueue
+{
+public:
+	int64 volatile	m_Range;		// Unclaimed work items. Only ever changed with interlocked ops.
+
+	// The rest is only touched by the thread that owns the queue.
+	int				m_iBatchNext;	// Work items claimed by this thread but not handed out yet.
+	int				m_iBatchEnd;
+	int				m_nWorkItems;
+	int				m_nBatches;
+	int				m_nSteals;
+	double			m_flFinishTime;
+} ALIGN128_POST;
+
+// The extra queue at THREADINDEX_MAIN is used if GetThreadWork is called outside RunThreadsOn.
+CThreadWorkQueue g_WorkQueues[MAX_TOOL_THREADS+1];
+int g_nWorkQueues;
+
+// Index+1 of the calling thread's work queue, 0 for threads not started by RunThreads_Start.
+CThreadLocalInt<> g_iThreadWorkQueue;
+
+int volatile g_nDispatched;
+int volatile g_bPacifierBusy;
+
+ThreadStageStats_t g_ThreadStageStats;
+
+
+static inline int64 ReadWorkRange( int64 volatile *pRange )
+{
+	// A plain 64-bit read can tear on 32-bit builds.
+	return ThreadInterlockedCompareExchange64( pRange, 0, 0 );
+}
+
+
+// Every range steps by this many work items.
+static inline int WorkItemStride()
+{
+	return max( g_nWorkQueues, 1 );
+}
+
+// How many work items [iNext, iEnd) holds.
+static inline int CountWorkItems( int iNext, int iEnd )
+{
+	int nStride = WorkItemStride();
+	return ( iNext < iEnd ) ? ( iEnd - iNext + nStride - 1 ) / nStride : 0;
+}
+
+
+static void ResetWorkQueues( int nWorkItems, int nQueues )
+{
+	g_nWorkQueues = nQueues;
+	g_nDispatched = 0;
+	g_bPacifierBusy = 0;
+
+	for ( int i=0; i <= MAX_TOOL_THREADS; i++ )
+	{
+		CThreadWorkQueue &queue = g_WorkQueues[i];
+
+		// Deal the work items out like cards so the threads start next to each other.
+		int iFirst = 0, iEnd = 0;
+		if ( i < nQueues )
+		{
+			iFirst = i;
+			iEnd = nWorkItems;
+		}
+
+		queue.m_Range = WORK_RANGE( iFirst, iEnd );
+		queue.m_iBatchNext = queue.m_iBatchEnd = 0;
+		queue.m_nWorkItems = queue.m_nBatches = queue.m_nSteals = 0;
+		queue.m_flFinishTime = 0;
+	}
+}
+
+
+// Claim a batch from the front of the thread's own queue.
+static bool ClaimWorkBatch( CThreadWorkQueue &queue )
+{
+	while ( 1 )
+	{
+		int64 range = ReadWorkRange( &queue.m_Range );
+		int iNext = WORK_RANGE_NEXT( range );
+		int iEnd = WORK_RANGE_END( range );
+		int nItems = CountWorkItems( iNext, iEnd );
+		if ( nItems == 0 )
+			return false;
+
+		// Take smaller batches as the queue drains so there's something left to steal.
+		int nBatch = clamp( nItems / 8, 1, MAX_WORK_BATCH );
+		int iBatchEnd = min( iNext + nBatch * WorkItemStride(), iEnd );
+		if ( ThreadInterlockedAssignIf64( &queue.m_Range, WORK_RANGE( iBatchEnd, iEnd ), range ) )
+		{
+			queue.m_iBatchNext = iNext;
+			queue.m_iBatchEnd = iBatchEnd;
+			return true;
+		}
+	}
+}
+
+
+// Move half of the remaining work in another thread's queue into iQueue's queue.
+static bool StealWork( int iQueue )
+{
+	int iStart = ( iQueue < g_nWorkQueues ) ? iQueue + 1 : 0;
+	for ( int i=0; i < g_nWorkQueues; i++ )
+	{
+		int iVictim = ( iStart + i ) % g_nWorkQueues;
+		if ( iVictim == iQueue )
+			continue;
+
+		CThreadWorkQueue &victim = g_WorkQueues[iVictim];
+		while ( 1 )
+		{
+			int64 range = ReadWorkRange( &victim.m_Range );
+			int iNext = WORK_RANGE_NEXT( range );
+			int iEnd = WORK_RANGE_END( range );
+			int nItems = CountWorkItems( iNext, iEnd );
+			if ( nItems == 0 )
+				break;
+
+			// The thief's range keeps the victim's stride and starting point, so it's still interleaved.
+			int iSplit = iNext + ( nItems / 2 ) * WorkItemStride();
+			if ( ThreadInterlockedAssignIf64( &victim.m_Range, WORK_RANGE( iNext, iSplit ), range ) )
+			{
+				// Our own queue is empty here, and nobody else writes to an empty queue.
+				ThreadInterlockedExchange64( &g_WorkQueues[iQueue].m_Range, WORK_RANGE( iSplit, iEnd ) );
+				g_WorkQueues[iQueue].m_nSteals++;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+// The pacifier is only updated once per batch, and skipped if another thread is already drawing it.
+static void UpdateSampledPacifier( int nClaimed )
+{
+	int nDispatched = ThreadInterlockedExchangeAdd( &g_nDispatched, nClaimed );
+
+	if ( ThreadInterlockedAssignIf( &g_bPacifierBusy, 1, 0 ) )
+	{
+		UpdatePacifier( (float)nDispatched / workcount );
+		ThreadInterlockedExchange( &g_bPacifierBusy, 0 );
+	}
+}
 
 
 /*
@@ -52,23 +226,34 @@ GetThreadWork
 */
 int	GetThreadWork (void)
 {
-	int	r;
+	int iQueue = g_iThreadWorkQueue - 1;
+	if ( iQueue < 0 )
+		iQueue = THREADINDEX_MAIN;
 
-	ThreadLock ();
-
-	if (dispatch == workcount)
+	CThreadWorkQueue &queue = g_WorkQueues[iQueue];
+	if ( queue.m_iBatchNext >= queue.m_iBatchEnd )
 	{
-		ThreadUnlock ();
-		return -1;
+		while ( !ClaimWorkBatch( queue ) )
+		{
+			if ( !StealWork( iQueue ) )
+				return -1;
+		}
+
+		queue.m_nBatches++;
+		UpdateSampledPacifier( CountWorkItems( queue.m_iBatchNext, queue.m_iBatchEnd ) );
 	}
 
-	UpdatePacifier( (float)dispatch / workcount );
+	queue.m_nWorkItems++;
+	int iWorkItem = queue.m_iBatchNext;
+	queue.m_iBatchNext += WorkItemStride();
+	return iWorkItem;
+}
 
-	r = dispatch;
-	dispatch++;
-	ThreadUnlock ();
 
-	return r;
+int GetThreadIndex()
+{
+	int iQueue = g_iThreadWorkQueue - 1;
+	return ( iQueue < 0 ) ? THREADINDEX_MAIN : iQueue;
 }
 
 
@@ -98,6 +283,59 @@ void RunThreadsOnIndividual (int workcnt, qboolean showpacifier, ThreadWorkerFn
 }
 
 
+//-----------------------------------------------------------------------------
+// Scheduler stats
+//-----------------------------------------------------------------------------
+static void GatherThreadStageStats( int nWorkItems, double flStartTime, double flEndTime )
+{
+	ThreadStageStats_t &stats = g_ThreadStageStats;
+	memset( &stats, 0, sizeof( stats ) );
+	stats.m_nThreads = g_nWorkQueues;
+	stats.m_nWorkItems = nWorkItems;
+	stats.m_flWallTime = (float)( flEndTime - flStartTime );
+
+	int nMostWorkItems = 0;
+	for ( int i=0; i < g_nWorkQueues; i++ )
+	{
+		const CThreadWorkQueue &queue = g_WorkQueues[i];
+		stats.m_nBatches += queue.m_nBatches;
+		stats.m_nSteals += queue.m_nSteals;
+		stats.m_flIdleTime += (float)( flEndTime - queue.m_flFinishTime );
+		nMostWorkItems = max( nMostWorkItems, queue.m_nWorkItems );
+	}
+
+	if ( nWorkItems > 0 && g_nWorkQueues > 0 )
+	{
+		stats.m_flImbalance = (float)nMostWorkItems * g_nWorkQueues / nWorkItems;
+	}
+}
+
+
+const ThreadStageStats_t& GetThreadStageStats()
+{
+	return g_ThreadStageStats;
+}
+
+
+void PrintThreadStageStats()
+{
+	const ThreadStageStats_t &stats = g_ThreadStageStats;
+	Msg( "%-20s %d threads, %d items in %d batches, %d steals, %.2fs idle (%.1f%%), imbalance %.2f\n",
+		"",
+		stats.m_nThreads,
+		stats.m_nWorkItems,
+		stats.m_nBatches,
+		stats.m_nSteals,
+		stats.m_flIdleTime,
+		( stats.m_flWallTime > 0 ) ? stats.m_flIdleTime * 100.0f / ( stats.m_flWallTime * stats.m_nThreads ) : 0.0f,
+		stats.m_flImbalance );
+}
+
+
+int		numthreads = -1;
+static int enter;
+
+#ifdef _WIN32
 /*
 ===================================================================
 
@@ -106,9 +344,8 @@ WIN32
 ===================================================================
 */
 
-int		numthreads = -1;
 CRITICAL_SECTION		crit;
-static int enter;
+HANDLE g_ThreadHandles[MAX_THREADS];
 
 
 class CCritInit
@@ -136,8 +373,10 @@ void ThreadSetDefault (void)
 	{
 		GetSystemInfo (&info);
 		numthreads = info.dwNumberOfProcessors;
-		if (numthreads < 1 || numthreads > 32)
+		if (numthreads < 1)
 			numthreads = 1;
+		if (numthreads > MAX_TOOL_THREADS)
+			numthreads = MAX_TOOL_THREADS;
 	}
 
 	Msg ("%i threads\n", numthreads);
@@ -169,7 +408,9 @@ void ThreadUnlock (void)
 DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
 {
 	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
+	g_iThreadWorkQueue = pData->m_iThread + 1;
 	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
+	g_WorkQueues[pData->m_iThread].m_flFinishTime = Plat_FloatTime();
 	return 0;
 }
 
@@ -218,6 +459,107 @@ void RunThreads_End()
 
 	threaded = false;
 }
+
+#elif defined( POSIX )
+/*
+===================================================================
+
+POSIX
+
+===================================================================
+*/
+
+CThreadMutex	crit;
+ThreadHandle_t g_ThreadHandles[MAX_THREADS];
+
+
+void SetLowPriority()
+{
+	setpriority( PRIO_PROCESS, 0, 19 );
+}
+
+
+void ThreadSetDefault (void)
+{
+	if (numthreads == -1)	// not set manually
+	{
+		numthreads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+		if (numthreads < 1)
+			numthreads = 1;
+		if (numthreads > MAX_TOOL_THREADS)
+			numthreads = MAX_TOOL_THREADS;
+	}
+
+	Msg ("%i threads\n", numthreads);
+}
+
+
+void ThreadLock (void)
+{
+	if (!threaded)
+		return;
+	crit.Lock ();
+	if (enter)
+		Error ("Recursive ThreadLock\n");
+	enter = 1;
+}
+
+void ThreadUnlock (void)
+{
+	if (!threaded)
+		return;
+	if (!enter)
+		Error ("ThreadUnlock without lock\n");
+	enter = 0;
+	crit.Unlock ();
+}
+
+
+// This runs in the thread and dispatches a RunThreadsFn call.
+static unsigned InternalRunThreadsFn( void *pParameter )
+{
+	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
+	g_iThreadWorkQueue = pData->m_iThread + 1;
+	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
+	g_WorkQueues[pData->m_iThread].m_flFinishTime = Plat_FloatTime();
+	return 0;
+}
+
+
+// Thread priorities aren't changed here; SetLowPriority lowers the whole process instead.
+void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority )
+{
+	Assert( numthreads > 0 );
+	threaded = true;
+
+	if ( numthreads > MAX_TOOL_THREADS )
+		numthreads = MAX_TOOL_THREADS;
+
+	for ( int i=0; i < numthreads ;i++ )
+	{
+		g_RunThreadsData[i].m_iThread = i;
+		g_RunThreadsData[i].m_pUserData = pUserData;
+		g_RunThreadsData[i].m_Fn = fn;
+
+		g_ThreadHandles[i] = CreateSimpleThread( InternalRunThreadsFn, &g_RunThreadsData[i] );
+		if ( !g_ThreadHandles[i] )
+			Error( "RunThreads_Start: can't create thread %d\n", i );
+	}
+}
+
+
+void RunThreads_End()
+{
+	for ( int i=0; i < numthreads; i++ )
+	{
+		ThreadJoin( g_ThreadHandles[i] );
+		ReleaseThreadHandle( g_ThreadHandles[i] );
+	}
+
+	threaded = false;
+}
+
+#endif
 	
 
 /*
@@ -228,9 +570,9 @@ RunThreadsOn
 void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pUserData )
 {
 	int		start, end;
+	double	flStartTime, flEndTime;
 
 	start = Plat_FloatTime();
-	dispatch = 0;
 	workcount = workcnt;
 	StartPacifier("");
 	pacifier = showpacifier;
@@ -241,16 +583,25 @@ void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pU
 	return;
 #endif
 
-	
+	if ( numthreads > MAX_TOOL_THREADS )
+		numthreads = MAX_TOOL_THREADS;
+	ResetWorkQueues( workcnt, numthreads );
+
+	flStartTime = Plat_FloatTime();
 	RunThreads_Start( fn, pUserData );
 	RunThreads_End();
+	flEndTime = Plat_FloatTime();
 
+	GatherThreadStageStats( workcnt, flStartTime, flEndTime );
 
 	end = Plat_FloatTime();
 	if (pacifier)
 	{
 		EndPacifier(false);
 		printf (" (%i)\n", end-start);
+
+		if ( g_bPrintThreadStats )
+			PrintThreadStageStats();
 	}
 }
 
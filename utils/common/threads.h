@@ -18,7 +18,7 @@
 
 // Arrays that are indexed by thread should always be MAX_TOOL_THREADS+1
 // large so THREADINDEX_MAIN can be used from the main thread.
-#define MAX_TOOL_THREADS	16
+#define MAX_TOOL_THREADS	64
 #define THREADINDEX_MAIN	(MAX_TOOL_THREADS)
 
 
@@ -27,6 +27,9 @@ extern	int		numthreads;
 // If set to true, then all the threads that are created are low priority.
 extern bool	g_bLowPriorityThreads;
 
+// If set to true, RunThreadsOn prints the scheduler stats for each stage.
+extern bool g_bPrintThreadStats;
+
 typedef void (*ThreadWorkerFn)( int iThread, int iWorkItem );
 typedef void (*RunThreadsFn)( int iThread, void *pUserData );
 
@@ -56,6 +59,26 @@ void RunThreads_End();
 void ThreadLock (void);
 void ThreadUnlock (void);
 
+// Returns the index RunThreads_Start gave the calling thread, or THREADINDEX_MAIN
+// for threads it didn't start.
+int GetThreadIndex();
+
+
+// Scheduler stats for the last RunThreadsOn / RunThreadsOnIndividual stage.
+struct ThreadStageStats_t
+{
+	int		m_nThreads;
+	int		m_nWorkItems;
+	int		m_nBatches;			// Number of batches claimed from the per-thread work queues.
+	int		m_nSteals;			// Number of times a thread took work from another thread's queue.
+	float	m_flWallTime;		// Seconds from thread start to the last thread finishing.
+	float	m_flIdleTime;		// Seconds threads spent waiting for the slowest thread, summed over all threads.
+	float	m_flImbalance;		// Most work items done by one thread / average work items per thread.
+};
+
+const ThreadStageStats_t& GetThreadStageStats();
+void PrintThreadStageStats();
+
 
 #ifndef NO_THREAD_NAMES
 #define RunThreadsOn(n,p,f) { if (p) printf("%-20s ", #f ":"); RunThreadsOn(n,p,f); }
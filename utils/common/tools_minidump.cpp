@@ -5,9 +5,14 @@
 // $NoKeywords: $
 //=============================================================================//
 
+#ifdef _WIN32
 #include <windows.h>
 #include <dbghelp.h>
 #include "tier0/minidump.h"
+#elif defined( POSIX )
+#include <signal.h>
+#include <string.h>
+#endif
 #include "tools_minidump.h"
 
 static bool g_bToolsWriteFullMinidumps = false;
@@ -18,6 +23,8 @@ static ToolsExceptionHandler g_pCustomExceptionHandler = NULL;
 // Internal helpers.
 // --------------------------------------------------------------------------------- //
 
+#ifdef _WIN32
+
 static LONG __stdcall ToolsExceptionFilter( struct _EXCEPTION_POINTERS *ExceptionInfo )
 {
 	// Non VMPI workers write a minidump and show a crash dialog like normal.
@@ -37,6 +44,21 @@ static LONG __stdcall ToolsExceptionFilter_Custom( struct _EXCEPTION_POINTERS *E
 	return EXCEPTION_EXECUTE_HANDLER; // (never gets here anyway)
 }
 
+#elif defined( POSIX )
+
+static const int g_CrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+
+static void ToolsSignalHandler_Custom( int iSignal )
+{
+	// The signal number stands in for the exception code, and there's no exception info.
+	g_pCustomExceptionHandler( iSignal, NULL );
+	signal( iSignal, SIG_DFL );
+	raise( iSignal );
+}
+
+#endif
+
 
 // --------------------------------------------------------------------------------- //
 // Interface functions.
@@ -48,6 +70,8 @@ void EnableFullMinidumps( bool bFull )
 }
 
 
+#ifdef _WIN32
+
 void SetupDefaultToolsMinidumpHandler()
 {
 	SetUnhandledExceptionFilter( ToolsExceptionFilter );
@@ -59,3 +83,30 @@ void SetupToolsMinidumpHandler( ToolsExceptionHandler fn )
 	g_pCustomExceptionHandler = fn;
 	SetUnhandledExceptionFilter( ToolsExceptionFilter_Custom );
 }
+
+#elif defined( POSIX )
+
+// There are no minidumps here. Crashes go to the system's default handling (a core file,
+// if they're enabled) unless a custom handler is set.
+void SetupDefaultToolsMinidumpHandler()
+{
+}
+
+
+void SetupToolsMinidumpHandler( ToolsExceptionHandler fn )
+{
+	g_pCustomExceptionHandler = fn;
+
+	struct sigaction action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_handler = ToolsSignalHandler_Custom;
+	action.sa_flags = SA_RESETHAND;		// Crashing again inside the handler kills the process.
+	sigemptyset( &action.sa_mask );
+
+	for ( int i=0; i < (int)( sizeof( g_CrashSignals ) / sizeof( g_CrashSignals[0] ) ); i++ )
+	{
+		sigaction( g_CrashSignals[i], &action, NULL );
+	}
+}
+
+#endif
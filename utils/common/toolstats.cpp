@@ -0,0 +1,233 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-stage timing and counters for benchmarking the compile tools.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+#include <stdio.h>
+#include "cmdlib.h"
+#include "threads.h"
+#include "toolstats.h"
+#include "tier1/strtools.h"
+#include "utlvector.h"
+
+
+struct ToolStage_t
+{
+	char	m_Name[64];
+	double	m_flWallTime;
+	double	m_flCPUTime;
+	int64	m_nPeakRSS;		// KB
+};
+
+struct ToolCounter_t
+{
+	char	m_Name[64];
+	int64	m_nValue;
+};
+
+static bool g_bToolStatsEnabled = false;
+static char g_ToolStatsTool[64];
+static char g_ToolStatsFile[MAX_PATH];
+static double g_flToolStatsStartWall;
+static double g_flToolStatsStartCPU;
+
+static CUtlVector<ToolStage_t> g_ToolStages;
+static CUtlVector<ToolCounter_t> g_ToolCounters;
+
+// The stage in progress, or -1, and where its clocks started.
+static int g_iCurToolStage = -1;
+static double g_flCurStageStartWall;
+static double g_flCurStageStartCPU;
+
+
+//-----------------------------------------------------------------------------
+// User + kernel time for the whole process, in seconds.
+//-----------------------------------------------------------------------------
+static double GetProcessCPUTime()
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if ( !GetProcessTimes( GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime ) )
+		return 0;
+
+	uint64 nKernel = ( (uint64)kernelTime.dwHighDateTime << 32 ) | kernelTime.dwLowDateTime;
+	uint64 nUser = ( (uint64)userTime.dwHighDateTime << 32 ) | userTime.dwLowDateTime;
+	return (double)( nKernel + nUser ) * 1e-7;	// 100ns units
+#else
+	struct rusage usage;
+	if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+		return 0;
+
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1e-6;
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Peak resident set size of the process so far, in KB.
+//-----------------------------------------------------------------------------
+static int64 GetProcessPeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+		return 0;
+
+	return (int64)( counters.PeakWorkingSetSize / 1024 );
+#else
+	struct rusage usage;
+	if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+		return 0;
+
+#ifdef OSX
+	return (int64)usage.ru_maxrss / 1024;	// bytes on OSX
+#else
+	return (int64)usage.ru_maxrss;
+#endif
+#endif
+}
+
+
+void ToolStats_Init( const char *pToolName, const char *pFilename )
+{
+	Q_strncpy( g_ToolStatsTool, pToolName, sizeof( g_ToolStatsTool ) );
+	Q_strncpy( g_ToolStatsFile, pFilename, sizeof( g_ToolStatsFile ) );
+
+	g_ToolStages.Purge();
+	g_ToolCounters.Purge();
+	g_iCurToolStage = -1;
+
+	g_flToolStatsStartWall = Plat_FloatTime();
+	g_flToolStatsStartCPU = GetProcessCPUTime();
+	g_bToolStatsEnabled = true;
+}
+
+
+bool ToolStats_IsEnabled()
+{
+	return g_bToolStatsEnabled;
+}
+
+
+void ToolStats_BeginStage( const char *pStageName )
+{
+	if ( !g_bToolStatsEnabled )
+		return;
+
+	ToolStats_EndStage();
+
+	g_iCurToolStage = g_ToolStages.AddToTail();
+	ToolStage_t &stage = g_ToolStages[g_iCurToolStage];
+	Q_strncpy( stage.m_Name, pStageName, sizeof( stage.m_Name ) );
+	stage.m_flWallTime = 0;
+	stage.m_flCPUTime = 0;
+	stage.m_nPeakRSS = 0;
+
+	g_flCurStageStartWall = Plat_FloatTime();
+	g_flCurStageStartCPU = GetProcessCPUTime();
+}
+
+
+void ToolStats_EndStage()
+{
+	if ( !g_bToolStatsEnabled || g_iCurToolStage < 0 )
+		return;
+
+	ToolStage_t &stage = g_ToolStages[g_iCurToolStage];
+	stage.m_flWallTime = Plat_FloatTime() - g_flCurStageStartWall;
+	stage.m_flCPUTime = GetProcessCPUTime() - g_flCurStageStartCPU;
+	stage.m_nPeakRSS = GetProcessPeakRSS();
+	g_iCurToolStage = -1;
+}
+
+
+void ToolStats_SetCounter( const char *pCounterName, int64 nValue )
+{
+	if ( !g_bToolStatsEnabled )
+		return;
+
+	for ( int i = 0; i < g_ToolCounters.Count(); i++ )
+	{
+		if ( !Q_stricmp( g_ToolCounters[i].m_Name, pCounterName ) )
+		{
+			g_ToolCounters[i].m_nValue = nValue;
+			return;
+		}
+	}
+
+	ToolCounter_t &counter = g_ToolCounters[ g_ToolCounters.AddToTail() ];
+	Q_strncpy( counter.m_Name, pCounterName, sizeof( counter.m_Name ) );
+	counter.m_nValue = nValue;
+}
+
+
+//-----------------------------------------------------------------------------
+// Stage and counter names come from the tools, but quote them properly anyway.
+//-----------------------------------------------------------------------------
+static void WriteJSONString( FILE *fp, const char *pString )
+{
+	fputc( '"', fp );
+	for ( const char *p = pString; *p; p++ )
+	{
+		if ( *p == '"' || *p == '\\' )
+			fputc( '\\', fp );
+		fputc( *p, fp );
+	}
+	fputc( '"', fp );
+}
+
+
+bool ToolStats_Write()
+{
+	if ( !g_bToolStatsEnabled )
+		return false;
+
+	ToolStats_EndStage();
+
+	FILE *fp = fopen( g_ToolStatsFile, "w" );
+	if ( !fp )
+	{
+		Warning( "Can't write benchmark stats to %s\n", g_ToolStatsFile );
+		return false;
+	}
+
+	fprintf( fp, "{\n\t\"tool\": " );
+	WriteJSONString( fp, g_ToolStatsTool );
+	fprintf( fp, ",\n\t\"threads\": %d,\n", numthreads );
+	fprintf( fp, "\t\"wall_seconds\": %.3f,\n", Plat_FloatTime() - g_flToolStatsStartWall );
+	fprintf( fp, "\t\"cpu_seconds\": %.3f,\n", GetProcessCPUTime() - g_flToolStatsStartCPU );
+	fprintf( fp, "\t\"peak_rss_kb\": %lld,\n", (long long)GetProcessPeakRSS() );
+
+	fprintf( fp, "\t\"stages\": [" );
+	for ( int i = 0; i < g_ToolStages.Count(); i++ )
+	{
+		const ToolStage_t &stage = g_ToolStages[i];
+		fprintf( fp, "%s\n\t\t{ \"name\": ", i ? "," : "" );
+		WriteJSONString( fp, stage.m_Name );
+		fprintf( fp, ", \"wall_seconds\": %.3f, \"cpu_seconds\": %.3f, \"peak_rss_kb\": %lld }",
+			stage.m_flWallTime, stage.m_flCPUTime, (long long)stage.m_nPeakRSS );
+	}
+	fprintf( fp, "\n\t],\n" );
+
+	fprintf( fp, "\t\"counters\": {" );
+	for ( int i = 0; i < g_ToolCounters.Count(); i++ )
+	{
+		fprintf( fp, "%s\n\t\t", i ? "," : "" );
+		WriteJSONString( fp, g_ToolCounters[i].m_Name );
+		fprintf( fp, ": %lld", (long long)g_ToolCounters[i].m_nValue );
+	}
+	fprintf( fp, "\n\t}\n}\n" );
+
+	fclose( fp );
+	return true;
+}
@@ -0,0 +1,47 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-stage timing and counters for benchmarking the compile tools.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef TOOLSTATS_H
+#define TOOLSTATS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+#include "tier0/platform.h"
+
+
+// The tools call these around each stage of a compile. Nothing is recorded until
+// ToolStats_Init is called (the tools do that for -benchstats <file>), so the calls
+// are free in normal runs.
+//
+// ToolStats_Write saves everything as JSON:
+//	{
+//		"tool": "vrad", "threads": 8,
+//		"wall_seconds": 12.5, "cpu_seconds": 90.1, "peak_rss_kb": 420000,
+//		"stages": [ { "name": "direct", "wall_seconds": 3.2, "cpu_seconds": 24.9, "peak_rss_kb": 380000 }, ... ],
+//		"counters": { "rays_traced": 123456789, ... }
+//	}
+// peak_rss_kb on a stage is the process peak when the stage ended, so it only ever grows.
+// Counters are whatever the process that writes the file counted; under VMPI that's
+// only the master's share of the work.
+void ToolStats_Init( const char *pToolName, const char *pFilename );
+bool ToolStats_IsEnabled();
+
+// Starting a stage ends the one before it; stages don't nest.
+void ToolStats_BeginStage( const char *pStageName );
+void ToolStats_EndStage();
+
+// Sets a counter, adding it the first time it's used. Counters are written in the
+// order they were first set.
+void ToolStats_SetCounter( const char *pCounterName, int64 nValue );
+
+// Ends the current stage and writes the file. Returns false if it couldn't be written.
+bool ToolStats_Write();
+
+
+#endif // TOOLSTATS_H
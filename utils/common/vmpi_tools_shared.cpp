@@ -4,8 +4,13 @@
 //
 //=============================================================================//
 
+#ifdef _WIN32
 #include <windows.h>
 #include <dbghelp.h>
+#elif defined( POSIX )
+#include <string.h>
+#include <unistd.h>
+#endif
 #include "vmpi.h"
 #include "cmdlib.h"
 #include "vmpi_tools_shared.h"
@@ -13,6 +18,7 @@
 #include "mpi_stats.h"
 #include "iphelpers.h"
 #include "tier0/minidump.h"
+#include "tier0/threadtools.h"
 
 
 // ----------------------------------------------------------------------------- //
@@ -68,6 +74,7 @@ bool SharedDispatch( MessageBuffer *pBuf, int iSource, int iPacketID )
 			case 't':
 				Warning( "\nWorker '%s' dead: %s\n", VMPI_GetMachineName( iSource ), pInPos );
 				break;
+#ifdef _WIN32
 			case 'f':
 				{
 					int iFileSize = * reinterpret_cast< int const * >( pInPos );
@@ -125,6 +132,7 @@ bool SharedDispatch( MessageBuffer *pBuf, int iSource, int iPacketID )
 					}
 				}
 				break;
+#endif
 			}
 		}
 		return true;
@@ -180,6 +188,7 @@ void RecvDBInfo( CDBInfo *pInfo, unsigned long *pJobPrimaryID )
 	*pJobPrimaryID = g_JobPrimaryID;
 }
 
+#ifdef _WIN32
 // If the file is successfully opened, read and sent returns the size of the file in bytes
 // otherwise returns 0 and nothing is sent
 int VMPI_SendFileChunk( const void *pvChunkPrefix, int lenPrefix, tchar const *ptchFileName )
@@ -226,11 +235,12 @@ done:
 
 	return iResult;
 }
+#endif
 
 void VMPI_HandleCrash( const char *pMessage, void *pvExceptionInfo, bool bAssert )
 {
-	static LONG crashHandlerCount = 0;
-	if ( InterlockedIncrement( &crashHandlerCount ) == 1 )
+	static long volatile crashHandlerCount = 0;
+	if ( ThreadInterlockedIncrement( &crashHandlerCount ) == 1 )
 	{
 		Msg( "\nFAILURE: '%s' (assert: %d)\n", pMessage, bAssert );
 
@@ -244,6 +254,7 @@ void VMPI_HandleCrash( const char *pMessage, void *pvExceptionInfo, bool bAssert
 			strlen( pMessage ) + 1,
 			VMPI_MASTER_ID );
 
+#ifdef _WIN32
 		// Now attempt to create a minidump with the given exception information
 		if ( pvExceptionInfo )
 		{
@@ -263,15 +274,19 @@ void VMPI_HandleCrash( const char *pMessage, void *pvExceptionInfo, bool bAssert
 				::DeleteFile( tchMinidumpFileName );
 			}
 		}
+#endif
 
 		// Let the messages go out.
-		Sleep( 500 );
+		VMPI_Sleep( 500 );
 	}
 
-	InterlockedDecrement( &crashHandlerCount );
+	ThreadInterlockedDecrement( &crashHandlerCount );
 }
 
 
+#ifdef _WIN32
+
+
 // This is called if we crash inside our crash handler. It just terminates the process immediately.
 LONG __stdcall VMPI_SecondExceptionFilter( struct _EXCEPTION_POINTERS *ExceptionInfo )
 {
@@ -338,6 +353,22 @@ void VMPI_ExceptionFilter( unsigned long uCode, void *pvExceptionInfo )
 	TerminateProcess( GetCurrentProcess(), 1 );
 }
 
+#elif defined( POSIX )
+
+// On POSIX uCode is the signal number and there's no exception info.
+void VMPI_ExceptionFilter( unsigned long uCode, void *pvExceptionInfo )
+{
+	char chReason[64];
+	const char *pchName = strsignal( (int)uCode );
+	V_snprintf( chReason, sizeof( chReason ), "Signal %lu (%s)", uCode, pchName ? pchName : "unknown" );
+
+	VMPI_HandleCrash( chReason, pvExceptionInfo, true );
+
+	_exit( 1 );
+}
+
+#endif
+
 
 void HandleMPIDisconnect( int procID, const char *pReason )
 {
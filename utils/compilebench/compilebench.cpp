@@ -0,0 +1,719 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compile pipeline benchmark. Writes procedurally generated test maps,
+//			runs vbsp, vvis and vrad on each with -benchstats, and gathers the
+//			per-stage stats they write into one JSON report.
+//
+//			The maps only depend on the seed, so runs with the same seed on
+//			different builds compile exactly the same input.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#ifdef POSIX
+#include <sys/wait.h>
+#endif
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "vstdlib/random.h"
+#include "mathlib/mathlib.h"
+
+
+#define WALL_MATERIAL		"DEV/DEV_MEASUREGENERIC01B"
+#define FLOOR_MATERIAL		"DEV/DEV_MEASUREGENERIC01"
+#define DETAIL_MATERIAL		"DEV/DEV_MEASURECRATE01"
+#define DISP_MATERIAL		"NATURE/BLENDGROUNDTOGRASS008"
+#define SKY_MATERIAL		"TOOLS/TOOLSSKYBOX"
+#define NODRAW_MATERIAL		"TOOLS/TOOLSNODRAW"
+
+#define WALL_THICKNESS		16
+#define DEFAULT_PROP_MODEL	"models/props_junk/wood_crate001a.mdl"
+
+
+//-----------------------------------------------------------------------------
+// Writes a VMF. Solids go into the world between BeginWorld/EndWorld, or into
+// a brush entity between BeginEntity/EndEntity.
+//-----------------------------------------------------------------------------
+class CVMFWriter
+{
+public:
+	CVMFWriter( FILE *fp ) : m_fp( fp ), m_nNextID( 1 ) {}
+
+	void BeginWorld( const char *pSkyName );
+	void EndWorld();
+
+	void BeginEntity( const char *pClassName );
+	void KeyValue( const char *pKey, const char *pValue );
+	void KeyValueVector( const char *pKey, float x, float y, float z );
+	void EndEntity();
+
+	// An axial box. If nDispPower is set, the top face becomes a displacement
+	// with the given heights, (2^nDispPower+1)^2 of them, row by row.
+	void Box( const Vector &mins, const Vector &maxs, const char *pMaterial,
+			  const char *pTopMaterial = NULL, int nDispPower = 0, const float *pDispHeights = NULL );
+
+private:
+	void Side( const Vector &p0, const Vector &p1, const Vector &p2, const char *pMaterial,
+			   const char *pUAxis, const char *pVAxis, int nDispPower = 0, const float *pDispHeights = NULL );
+	void DispInfo( const Vector &start, int nPower, const float *pHeights );
+
+	FILE *m_fp;
+	int m_nNextID;
+};
+
+
+void CVMFWriter::BeginWorld( const char *pSkyName )
+{
+	fprintf( m_fp, "versioninfo\n{\n\t\"editorversion\" \"400\"\n\t\"editorbuild\" \"0\"\n"
+		"\t\"mapversion\" \"1\"\n\t\"formatversion\" \"100\"\n\t\"prefab\" \"0\"\n}\n" );
+	fprintf( m_fp, "world\n{\n\t\"id\" \"%d\"\n\t\"mapversion\" \"1\"\n\t\"classname\" \"worldspawn\"\n", m_nNextID++ );
+	fprintf( m_fp, "\t\"skyname\" \"%s\"\n", pSkyName );
+}
+
+void CVMFWriter::EndWorld()
+{
+	fprintf( m_fp, "}\n" );
+}
+
+void CVMFWriter::BeginEntity( const char *pClassName )
+{
+	fprintf( m_fp, "entity\n{\n\t\"id\" \"%d\"\n\t\"classname\" \"%s\"\n", m_nNextID++, pClassName );
+}
+
+void CVMFWriter::KeyValue( const char *pKey, const char *pValue )
+{
+	fprintf( m_fp, "\t\"%s\" \"%s\"\n", pKey, pValue );
+}
+
+void CVMFWriter::KeyValueVector( const char *pKey, float x, float y, float z )
+{
+	fprintf( m_fp, "\t\"%s\" \"%g %g %g\"\n", pKey, x, y, z );
+}
+
+void CVMFWriter::EndEntity()
+{
+	fprintf( m_fp, "}\n" );
+}
+
+void CVMFWriter::Side( const Vector &p0, const Vector &p1, const Vector &p2, const char *pMaterial,
+					   const char *pUAxis, const char *pVAxis, int nDispPower, const float *pDispHeights )
+{
+	fprintf( m_fp, "\t\tside\n\t\t{\n\t\t\t\"id\" \"%d\"\n", m_nNextID++ );
+	fprintf( m_fp, "\t\t\t\"plane\" \"(%g %g %g) (%g %g %g) (%g %g %g)\"\n",
+		p0.x, p0.y, p0.z, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z );
+	fprintf( m_fp, "\t\t\t\"material\" \"%s\"\n", pMaterial );
+	fprintf( m_fp, "\t\t\t\"uaxis\" \"%s\"\n\t\t\t\"vaxis\" \"%s\"\n", pUAxis, pVAxis );
+	fprintf( m_fp, "\t\t\t\"rotation\" \"0\"\n\t\t\t\"lightmapscale\" \"16\"\n\t\t\t\"smoothing_groups\" \"0\"\n" );
+
+	if ( nDispPower )
+	{
+		// starts at the first point's corner; vbsp finds the nearest corner itself
+		DispInfo( p0, nDispPower, pDispHeights );
+	}
+
+	fprintf( m_fp, "\t\t}\n" );
+}
+
+void CVMFWriter::DispInfo( const Vector &start, int nPower, const float *pHeights )
+{
+	int nVerts = ( 1 << nPower ) + 1;
+
+	fprintf( m_fp, "\t\t\tdispinfo\n\t\t\t{\n" );
+	fprintf( m_fp, "\t\t\t\t\"power\" \"%d\"\n", nPower );
+	fprintf( m_fp, "\t\t\t\t\"startposition\" \"[%g %g %g]\"\n", start.x, start.y, start.z );
+	fprintf( m_fp, "\t\t\t\t\"flags\" \"0\"\n\t\t\t\t\"elevation\" \"0\"\n\t\t\t\t\"subdiv\" \"0\"\n" );
+
+	static const char *s_pRowChunks[] = { "normals", "distances", "offsets", "alphas" };
+	for ( int iChunk = 0; iChunk < ARRAYSIZE( s_pRowChunks ); iChunk++ )
+	{
+		fprintf( m_fp, "\t\t\t\t%s\n\t\t\t\t{\n", s_pRowChunks[iChunk] );
+		for ( int iRow = 0; iRow < nVerts; iRow++ )
+		{
+			fprintf( m_fp, "\t\t\t\t\t\"row%d\" \"", iRow );
+			for ( int iCol = 0; iCol < nVerts; iCol++ )
+			{
+				const char *pSep = iCol ? " " : "";
+				switch ( iChunk )
+				{
+				case 0: fprintf( m_fp, "%s0 0 1", pSep ); break;
+				case 1: fprintf( m_fp, "%s%g", pSep, pHeights[iRow * nVerts + iCol] ); break;
+				case 2: fprintf( m_fp, "%s0 0 0", pSep ); break;
+				case 3: fprintf( m_fp, "%s0", pSep ); break;
+				}
+			}
+			fprintf( m_fp, "\"\n" );
+		}
+		fprintf( m_fp, "\t\t\t\t}\n" );
+	}
+
+	fprintf( m_fp, "\t\t\t}\n" );
+}
+
+void CVMFWriter::Box( const Vector &mins, const Vector &maxs, const char *pMaterial,
+					  const char *pTopMaterial, int nDispPower, const float *pDispHeights )
+{
+	float x1 = mins.x, y1 = mins.y, z1 = mins.z;
+	float x2 = maxs.x, y2 = maxs.y, z2 = maxs.z;
+
+	static const char *s_pXYU = "[1 0 0 0] 0.25";
+	static const char *s_pXYV = "[0 -1 0 0] 0.25";
+	static const char *s_pYZU = "[0 1 0 0] 0.25";
+	static const char *s_pXZU = "[1 0 0 0] 0.25";
+	static const char *s_pZV = "[0 0 -1 0] 0.25";
+
+	fprintf( m_fp, "\tsolid\n\t{\n\t\t\"id\" \"%d\"\n", m_nNextID++ );
+
+	// the points go clockwise seen from outside, the way hammer writes them
+	Side( Vector( x1, y2, z2 ), Vector( x2, y2, z2 ), Vector( x2, y1, z2 ), pTopMaterial ? pTopMaterial : pMaterial,
+		  s_pXYU, s_pXYV, nDispPower, pDispHeights );
+	Side( Vector( x1, y1, z1 ), Vector( x2, y1, z1 ), Vector( x2, y2, z1 ), pMaterial, s_pXYU, s_pXYV );
+	Side( Vector( x1, y2, z2 ), Vector( x1, y1, z2 ), Vector( x1, y1, z1 ), pMaterial, s_pYZU, s_pZV );
+	Side( Vector( x2, y2, z1 ), Vector( x2, y1, z1 ), Vector( x2, y1, z2 ), pMaterial, s_pYZU, s_pZV );
+	Side( Vector( x2, y2, z2 ), Vector( x1, y2, z2 ), Vector( x1, y2, z1 ), pMaterial, s_pXZU, s_pZV );
+	Side( Vector( x2, y1, z1 ), Vector( x1, y1, z1 ), Vector( x1, y1, z2 ), pMaterial, s_pXZU, s_pZV );
+
+	fprintf( m_fp, "\t}\n" );
+}
+
+
+//-----------------------------------------------------------------------------
+// Pieces shared by the fixtures
+//-----------------------------------------------------------------------------
+
+// Seals the box between mins and maxs with six walls, sky on top if pCeiling is the sky.
+static void WriteRoom( CVMFWriter &vmf, const Vector &mins, const Vector &maxs, const char *pCeiling )
+{
+	float t = WALL_THICKNESS;
+	vmf.Box( Vector( mins.x - t, mins.y - t, mins.z - t ), Vector( maxs.x + t, maxs.y + t, mins.z ), FLOOR_MATERIAL );
+	vmf.Box( Vector( mins.x - t, mins.y - t, maxs.z ), Vector( maxs.x + t, maxs.y + t, maxs.z + t ), pCeiling );
+	vmf.Box( Vector( mins.x - t, mins.y, mins.z ), Vector( mins.x, maxs.y, maxs.z ), WALL_MATERIAL );
+	vmf.Box( Vector( maxs.x, mins.y, mins.z ), Vector( maxs.x + t, maxs.y, maxs.z ), WALL_MATERIAL );
+	vmf.Box( Vector( mins.x - t, mins.y - t, mins.z ), Vector( maxs.x + t, mins.y, maxs.z ), WALL_MATERIAL );
+	vmf.Box( Vector( mins.x - t, maxs.y, mins.z ), Vector( maxs.x + t, maxs.y + t, maxs.z ), WALL_MATERIAL );
+}
+
+static void WritePlayerStart( CVMFWriter &vmf, const Vector &origin )
+{
+	vmf.BeginEntity( "info_player_start" );
+	vmf.KeyValueVector( "origin", origin.x, origin.y, origin.z );
+	vmf.KeyValue( "angles", "0 0 0" );
+	vmf.EndEntity();
+}
+
+static void WriteSun( CVMFWriter &vmf, const Vector &origin )
+{
+	vmf.BeginEntity( "light_environment" );
+	vmf.KeyValueVector( "origin", origin.x, origin.y, origin.z );
+	vmf.KeyValue( "angles", "0 30 0" );
+	vmf.KeyValue( "pitch", "-50" );
+	vmf.KeyValue( "_light", "255 240 220 300" );
+	vmf.KeyValue( "_ambient", "140 160 200 40" );
+	vmf.EndEntity();
+}
+
+// A grid of point lights across the room, nCount x nCount of them.
+static void WriteLightGrid( CVMFWriter &vmf, const Vector &mins, const Vector &maxs, int nCount )
+{
+	for ( int y = 0; y < nCount; y++ )
+	{
+		for ( int x = 0; x < nCount; x++ )
+		{
+			vmf.BeginEntity( "light" );
+			vmf.KeyValueVector( "origin",
+				mins.x + ( maxs.x - mins.x ) * ( x + 0.5f ) / nCount,
+				mins.y + ( maxs.y - mins.y ) * ( y + 0.5f ) / nCount,
+				mins.z + ( maxs.z - mins.z ) * 0.75f );
+			vmf.KeyValue( "_light", "255 255 255 300" );
+			vmf.EndEntity();
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Fixtures
+//-----------------------------------------------------------------------------
+
+// A big sky-lit field with a grid of flat blocks of random height on the ground.
+// Mostly tests vrad sky sampling and vbsp on a large open world.
+static void WriteOpenField( CVMFWriter &vmf, CUniformRandomStream &random )
+{
+	Vector mins( -4096, -4096, 0 ), maxs( 4096, 4096, 2048 );
+
+	vmf.BeginWorld( "sky_day01_01" );
+	WriteRoom( vmf, mins, maxs, SKY_MATERIAL );
+
+	const int nBlocks = 24;
+	float flSize = ( maxs.x - mins.x ) / nBlocks;
+	for ( int y = 0; y < nBlocks; y++ )
+	{
+		for ( int x = 0; x < nBlocks; x++ )
+		{
+			if ( random.RandomInt( 0, 3 ) != 0 )
+				continue;
+
+			float flHeight = 16 * random.RandomInt( 1, 24 );
+			Vector blockMins( mins.x + x * flSize, mins.y + y * flSize, 0 );
+			vmf.Box( blockMins, blockMins + Vector( flSize, flSize, flHeight ), WALL_MATERIAL );
+		}
+	}
+	vmf.EndWorld();
+
+	WritePlayerStart( vmf, Vector( 0, 0, 1024 ) );
+	WriteSun( vmf, Vector( 0, 0, 1536 ) );
+}
+
+// A room split into cells by walls with doorways, filled with small func_detail
+// blocks. Tests vbsp csg and face building, and vvis with lots of portals that the
+// detail doesn't add to.
+static void WriteDetailBrushes( CVMFWriter &vmf, CUniformRandomStream &random )
+{
+	Vector mins( -2048, -2048, 0 ), maxs( 2048, 2048, 512 );
+	const int nCells = 8;
+	float flCell = ( maxs.x - mins.x ) / nCells;
+
+	vmf.BeginWorld( "sky_day01_01" );
+	WriteRoom( vmf, mins, maxs, WALL_MATERIAL );
+
+	// inner walls, each with a doorway somewhere along it
+	for ( int i = 1; i < nCells; i++ )
+	{
+		float flWall = mins.x + i * flCell;
+		for ( int j = 0; j < nCells; j++ )
+		{
+			float flStart = mins.y + j * flCell;
+			float flDoor = flStart + 16 * random.RandomInt( 2, (int)( flCell / 16 ) - 8 );
+			vmf.Box( Vector( flWall - 8, flStart, 0 ), Vector( flWall + 8, flDoor, maxs.z ), WALL_MATERIAL );
+			vmf.Box( Vector( flWall - 8, flDoor + 96, 0 ), Vector( flWall + 8, flStart + flCell, maxs.z ), WALL_MATERIAL );
+			vmf.Box( Vector( flStart, flWall - 8, 0 ), Vector( flDoor, flWall + 8, maxs.z ), WALL_MATERIAL );
+			vmf.Box( Vector( flDoor + 96, flWall - 8, 0 ), Vector( flStart + flCell, flWall + 8, maxs.z ), WALL_MATERIAL );
+		}
+	}
+	vmf.EndWorld();
+
+	for ( int i = 0; i < 2000; i++ )
+	{
+		Vector origin( random.RandomFloat( mins.x + 64, maxs.x - 64 ), random.RandomFloat( mins.y + 64, maxs.y - 64 ), 0 );
+		origin.x = floor( origin.x / 8 ) * 8;
+		origin.y = floor( origin.y / 8 ) * 8;
+		Vector size( 8 * random.RandomInt( 1, 6 ), 8 * random.RandomInt( 1, 6 ), 8 * random.RandomInt( 1, 16 ) );
+
+		vmf.BeginEntity( "func_detail" );
+		vmf.Box( origin, origin + size, DETAIL_MATERIAL );
+		vmf.EndEntity();
+	}
+
+	WritePlayerStart( vmf, Vector( mins.x + flCell * 0.5f, mins.y + flCell * 0.5f, 64 ) );
+	WriteLightGrid( vmf, mins, maxs, nCells );
+}
+
+// Rolling terrain made of power 3 displacements under the sky. Tests displacement
+// building in vbsp and displacement lighting in vrad.
+static void WriteDisplacements( CVMFWriter &vmf, CUniformRandomStream &random )
+{
+	Vector mins( -4096, -4096, 0 ), maxs( 4096, 4096, 2048 );
+	const int nBlocks = 16;
+	const int nPower = 3;
+	const int nVerts = ( 1 << nPower ) + 1;
+	float flSize = ( maxs.x - mins.x ) / nBlocks;
+
+	vmf.BeginWorld( "sky_day01_01" );
+	WriteRoom( vmf, mins, maxs, SKY_MATERIAL );
+
+	float heights[nVerts * nVerts];
+	for ( int y = 0; y < nBlocks; y++ )
+	{
+		for ( int x = 0; x < nBlocks; x++ )
+		{
+			// Hills that are flat at the edges of each block, and the same whichever
+			// corner vbsp starts the rows from, so neighbors always line up.
+			float flHill = random.RandomFloat( 32, 384 );
+			float flBumps = random.RandomFloat( 0, 48 );
+			for ( int i = 0; i < nVerts; i++ )
+			{
+				for ( int j = 0; j < nVerts; j++ )
+				{
+					float u = M_PI * i / ( nVerts - 1 );
+					float v = M_PI * j / ( nVerts - 1 );
+					heights[i * nVerts + j] = flHill * sin( u ) * sin( v ) + flBumps * sin( 3 * u ) * sin( 3 * v );
+				}
+			}
+
+			// on top of the room's floor rather than flush with it
+			Vector blockMins( mins.x + x * flSize, mins.y + y * flSize, 0 );
+			vmf.Box( blockMins, blockMins + Vector( flSize, flSize, WALL_THICKNESS ), NODRAW_MATERIAL,
+				DISP_MATERIAL, nPower, heights );
+		}
+	}
+	vmf.EndWorld();
+
+	WritePlayerStart( vmf, Vector( 0, 0, 1024 ) );
+	WriteSun( vmf, Vector( 0, 0, 1536 ) );
+}
+
+// A room full of static props. Tests static prop emitting in vbsp and static prop
+// shadows and vertex lighting in vrad. The model has to exist in the game directory.
+static void WriteStaticProps( CVMFWriter &vmf, CUniformRandomStream &random, const char *pPropModel )
+{
+	Vector mins( -2048, -2048, 0 ), maxs( 2048, 2048, 512 );
+
+	vmf.BeginWorld( "sky_day01_01" );
+	WriteRoom( vmf, mins, maxs, WALL_MATERIAL );
+	vmf.EndWorld();
+
+	for ( int i = 0; i < 1500; i++ )
+	{
+		char angles[64];
+		Q_snprintf( angles, sizeof( angles ), "0 %d 0", random.RandomInt( 0, 359 ) );
+
+		vmf.BeginEntity( "prop_static" );
+		vmf.KeyValue( "model", pPropModel );
+		vmf.KeyValue( "angles", angles );
+		vmf.KeyValue( "solid", "6" );
+		vmf.KeyValue( "skin", "0" );
+		vmf.KeyValueVector( "origin", random.RandomFloat( mins.x + 64, maxs.x - 64 ), random.RandomFloat( mins.y + 64, maxs.y - 64 ), 0 );
+		vmf.EndEntity();
+	}
+
+	WritePlayerStart( vmf, Vector( 0, 0, 64 ) );
+	WriteLightGrid( vmf, mins, maxs, 6 );
+}
+
+
+enum Fixture_t
+{
+	FIXTURE_OPENFIELD = 0,
+	FIXTURE_DETAILBRUSHES,
+	FIXTURE_DISPLACEMENTS,
+	FIXTURE_STATICPROPS,
+
+	FIXTURE_COUNT
+};
+
+static const char *s_pFixtureNames[FIXTURE_COUNT] =
+{
+	"openfield",
+	"detailbrushes",
+	"displacements",
+	"staticprops",
+};
+
+
+//-----------------------------------------------------------------------------
+// Options
+//-----------------------------------------------------------------------------
+static int g_nSeed = 1;
+static int g_nThreads = -1;
+static bool g_bGenerateOnly = false;
+static bool g_bFixtureEnabled[FIXTURE_COUNT];
+static char g_BinDir[MAX_PATH];
+static char g_GameDir[MAX_PATH];
+static char g_OutDir[MAX_PATH];
+static char g_PropModel[MAX_PATH] = DEFAULT_PROP_MODEL;
+static char g_VRADArgs[1024];
+
+
+static bool WriteFixture( int iFixture, const char *pVMFName )
+{
+	FILE *fp = fopen( pVMFName, "w" );
+	if ( !fp )
+	{
+		fprintf( stderr, "Can't write %s\n", pVMFName );
+		return false;
+	}
+
+	// each fixture gets its own stream so enabling or disabling the others doesn't
+	// change it
+	CUniformRandomStream random;
+	random.SetSeed( g_nSeed * FIXTURE_COUNT + iFixture );
+
+	CVMFWriter vmf( fp );
+	switch ( iFixture )
+	{
+	case FIXTURE_OPENFIELD:		WriteOpenField( vmf, random ); break;
+	case FIXTURE_DETAILBRUSHES:	WriteDetailBrushes( vmf, random ); break;
+	case FIXTURE_DISPLACEMENTS:	WriteDisplacements( vmf, random ); break;
+	case FIXTURE_STATICPROPS:	WriteStaticProps( vmf, random, g_PropModel ); break;
+	}
+
+	fclose( fp );
+	printf( "Wrote %s\n", pVMFName );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Runs one of the tools on a fixture, asking it to write its stats to pStatsName.
+// Returns the tool's exit code, or 128 + the signal number if it was killed.
+//-----------------------------------------------------------------------------
+static int RunTool( const char *pTool, const char *pMapName, const char *pStatsName, const char *pExtraArgs )
+{
+	char exeName[MAX_PATH];
+	V_ComposeFileName( g_BinDir, pTool, exeName, sizeof( exeName ) );
+
+	char cmd[4096];
+	Q_snprintf( cmd, sizeof( cmd ), "\"%s\" -benchstats \"%s\"", exeName, pStatsName );
+	if ( g_nThreads > 0 )
+	{
+		Q_snprintf( cmd + Q_strlen( cmd ), sizeof( cmd ) - Q_strlen( cmd ), " -threads %d", g_nThreads );
+	}
+	if ( g_GameDir[0] )
+	{
+		Q_snprintf( cmd + Q_strlen( cmd ), sizeof( cmd ) - Q_strlen( cmd ), " -game \"%s\"", g_GameDir );
+	}
+	if ( pExtraArgs && pExtraArgs[0] )
+	{
+		Q_snprintf( cmd + Q_strlen( cmd ), sizeof( cmd ) - Q_strlen( cmd ), " %s", pExtraArgs );
+	}
+	Q_snprintf( cmd + Q_strlen( cmd ), sizeof( cmd ) - Q_strlen( cmd ), " \"%s\"", pMapName );
+
+#ifdef _WIN32
+	// cmd.exe strips the outer quotes when the line starts with one
+	char wrapped[4096 + 2];
+	Q_snprintf( wrapped, sizeof( wrapped ), "\"%s\"", cmd );
+	const char *pCmd = wrapped;
+#else
+	const char *pCmd = cmd;
+#endif
+
+	printf( "%s\n", cmd );
+	fflush( stdout );
+
+	// the tools write their stats file fresh, so don't let an old one pass for this run
+	remove( pStatsName );
+	int nStatus = system( pCmd );
+#ifdef POSIX
+	// system() returns a wait status here, not the exit code
+	if ( nStatus != -1 )
+	{
+		if ( WIFEXITED( nStatus ) )
+			return WEXITSTATUS( nStatus );
+		if ( WIFSIGNALED( nStatus ) )
+			return 128 + WTERMSIG( nStatus );
+	}
+#endif
+	return nStatus;
+}
+
+
+//-----------------------------------------------------------------------------
+// Copies a tool's stats file into the report, or null if it didn't write one.
+//-----------------------------------------------------------------------------
+static void AppendToolStats( FILE *fp, const char *pTool, const char *pStatsName, int nExitCode )
+{
+	fprintf( fp, "\t\t\t\"%s_exit_code\": %d,\n", pTool, nExitCode );
+	fprintf( fp, "\t\t\t\"%s\": ", pTool );
+
+	FILE *pStats = fopen( pStatsName, "rb" );
+	if ( !pStats )
+	{
+		fprintf( fp, "null" );
+		return;
+	}
+
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	char chunk[4096];
+	int nRead;
+	while ( ( nRead = fread( chunk, 1, sizeof( chunk ), pStats ) ) > 0 )
+	{
+		buf.Put( chunk, nRead );
+	}
+	fclose( pStats );
+
+	const char *pText = (const char *)buf.Base();
+	int nLen = buf.TellPut();
+	while ( nLen > 0 && V_isspace( pText[nLen - 1] ) )
+	{
+		nLen--;
+	}
+
+	// indent it to line up with the rest of the report
+	for ( int i = 0; i < nLen; i++ )
+	{
+		fputc( pText[i], fp );
+		if ( pText[i] == '\n' )
+			fprintf( fp, "\t\t\t" );
+	}
+}
+
+
+static void Usage()
+{
+	printf(
+		"usage  : compilebench [options...] <output directory>\n"
+		"\n"
+		"Writes the benchmark maps to the output directory, compiles each with vbsp,\n"
+		"vvis and vrad, and writes the per-stage times, cpu times, peak memory, rays\n"
+		"traced and portals processed to compilebench.json there.\n"
+		"\n"
+		"  -fixture <name>   : Only run this fixture. Can be given more than once.\n"
+		"                      openfield, detailbrushes, displacements or staticprops.\n"
+		"  -seed #           : Seed for generating the maps (default 1).\n"
+		"  -threads #        : Passed on to the tools.\n"
+		"  -game <directory> : Passed on to the tools.\n"
+		"  -bindir <dir>     : Where vbsp, vvis and vrad are (default: next to this exe).\n"
+		"  -propmodel <mdl>  : Model used by the staticprops fixture\n"
+		"                      (default " DEFAULT_PROP_MODEL ").\n"
+		"  -vradargs \"<args>\": Extra options for vrad, e.g. \"-final\".\n"
+		"  -generateonly     : Only write the maps.\n" );
+	exit( -1 );
+}
+
+
+int main( int argc, char **argv )
+{
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+	V_ExtractFilePath( argv[0], g_BinDir, sizeof( g_BinDir ) );
+
+	bool bAnyFixture = false;
+	int i;
+	for ( i = 1; i < argc - 1; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-fixture" ) && i + 2 < argc )
+		{
+			int iFixture;
+			for ( iFixture = 0; iFixture < FIXTURE_COUNT; iFixture++ )
+			{
+				if ( !Q_stricmp( argv[i + 1], s_pFixtureNames[iFixture] ) )
+					break;
+			}
+			if ( iFixture == FIXTURE_COUNT )
+			{
+				fprintf( stderr, "Unknown fixture \"%s\"\n", argv[i + 1] );
+				Usage();
+			}
+			g_bFixtureEnabled[iFixture] = true;
+			bAnyFixture = true;
+			i++;
+		}
+		else if ( !Q_stricmp( argv[i], "-seed" ) && i + 2 < argc )
+		{
+			g_nSeed = atoi( argv[++i] );
+		}
+		else if ( !Q_stricmp( argv[i], "-threads" ) && i + 2 < argc )
+		{
+			g_nThreads = atoi( argv[++i] );
+		}
+		else if ( !Q_stricmp( argv[i], "-game" ) && i + 2 < argc )
+		{
+			Q_strncpy( g_GameDir, argv[++i], sizeof( g_GameDir ) );
+		}
+		else if ( !Q_stricmp( argv[i], "-bindir" ) && i + 2 < argc )
+		{
+			Q_strncpy( g_BinDir, argv[++i], sizeof( g_BinDir ) );
+		}
+		else if ( !Q_stricmp( argv[i], "-propmodel" ) && i + 2 < argc )
+		{
+			Q_strncpy( g_PropModel, argv[++i], sizeof( g_PropModel ) );
+		}
+		else if ( !Q_stricmp( argv[i], "-vradargs" ) && i + 2 < argc )
+		{
+			Q_strncpy( g_VRADArgs, argv[++i], sizeof( g_VRADArgs ) );
+		}
+		else if ( !Q_stricmp( argv[i], "-generateonly" ) )
+		{
+			g_bGenerateOnly = true;
+		}
+		else
+		{
+			fprintf( stderr, "Unknown option \"%s\"\n", argv[i] );
+			Usage();
+		}
+	}
+
+	if ( i != argc - 1 || argv[i][0] == '-' )
+		Usage();
+
+	Q_MakeAbsolutePath( g_OutDir, sizeof( g_OutDir ), argv[i] );
+
+	if ( !bAnyFixture )
+	{
+		for ( int iFixture = 0; iFixture < FIXTURE_COUNT; iFixture++ )
+			g_bFixtureEnabled[iFixture] = true;
+	}
+
+	char reportName[MAX_PATH];
+	V_ComposeFileName( g_OutDir, "compilebench.json", reportName, sizeof( reportName ) );
+
+	FILE *fp = NULL;
+	if ( !g_bGenerateOnly )
+	{
+		fp = fopen( reportName, "w" );
+		if ( !fp )
+		{
+			fprintf( stderr, "Can't write %s\n", reportName );
+			return -1;
+		}
+		fprintf( fp, "{\n\t\"seed\": %d,\n\t\"threads\": %d,\n\t\"fixtures\": [", g_nSeed, g_nThreads );
+	}
+
+	bool bFirst = true;
+	int nFailedFixtures = 0;
+	for ( int iFixture = 0; iFixture < FIXTURE_COUNT; iFixture++ )
+	{
+		if ( !g_bFixtureEnabled[iFixture] )
+			continue;
+
+		const char *pName = s_pFixtureNames[iFixture];
+
+		char mapName[MAX_PATH], vmfName[MAX_PATH];
+		V_ComposeFileName( g_OutDir, pName, mapName, sizeof( mapName ) );
+		Q_snprintf( vmfName, sizeof( vmfName ), "%s.vmf", mapName );
+
+		if ( !WriteFixture( iFixture, vmfName ) )
+			return -1;
+
+		if ( g_bGenerateOnly )
+			continue;
+
+		static const char *s_pTools[] = { "vbsp", "vvis", "vrad" };
+		int nExitCodes[ARRAYSIZE( s_pTools )];
+		char statsNames[ARRAYSIZE( s_pTools )][MAX_PATH];
+		bool bFailed = false;
+		for ( int iTool = 0; iTool < ARRAYSIZE( s_pTools ); iTool++ )
+		{
+			Q_snprintf( statsNames[iTool], sizeof( statsNames[iTool] ), "%s_%s.json", mapName, s_pTools[iTool] );
+
+			// no point running the later tools on a map that didn't compile
+			nExitCodes[iTool] = bFailed ? -1 : RunTool( s_pTools[iTool], mapName, statsNames[iTool],
+				( iTool == 2 ) ? g_VRADArgs : NULL );
+			if ( nExitCodes[iTool] != 0 )
+			{
+				if ( !bFailed )
+					fprintf( stderr, "%s failed on %s (%d)\n", s_pTools[iTool], pName, nExitCodes[iTool] );
+				bFailed = true;
+				remove( statsNames[iTool] );
+			}
+		}
+		if ( bFailed )
+			nFailedFixtures++;
+
+		fprintf( fp, "%s\n\t\t{\n\t\t\t\"name\": \"%s\",\n", bFirst ? "" : ",", pName );
+		for ( int iTool = 0; iTool < ARRAYSIZE( s_pTools ); iTool++ )
+		{
+			AppendToolStats( fp, s_pTools[iTool], statsNames[iTool], nExitCodes[iTool] );
+			fprintf( fp, "%s\n", ( iTool + 1 < ARRAYSIZE( s_pTools ) ) ? "," : "" );
+		}
+		fprintf( fp, "\t\t}" );
+		bFirst = false;
+	}
+
+	if ( fp )
+	{
+		fprintf( fp, "\n\t]\n}\n" );
+		fclose( fp );
+		printf( "Wrote %s\n", reportName );
+	}
+
+	if ( nFailedFixtures )
+	{
+		fprintf( stderr, "%d fixture(s) failed to compile\n", nFailedFixtures );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,220 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compiles KeyValues text files into the images KeyValues loads
+//			when its compiled cache is on (see tier1/kvimage.h), so they can
+//			be built ahead of time, and times loading them both ways.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <stdio.h>
+#include <direct.h>
+#include "tier0/dbg.h"
+#include "tier0/icommandline.h"
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/KeyValues.h"
+#include "tier1/kvimage.h"
+#include "tier2/tier2.h"
+#include "filesystem.h"
+
+
+SpewRetval_t KVCompileOutputFunc( SpewType_t spewType, char const *pMsg )
+{
+	printf( "%s", pMsg );
+	fflush( stdout );
+
+	if ( spewType == SPEW_ERROR )
+		return SPEW_ABORT;
+	return ( spewType == SPEW_ASSERT ) ? SPEW_DEBUGGER : SPEW_CONTINUE;
+}
+
+static void Usage( void )
+{
+	Error( "Usage: kvcompile [-game <dir>] [-escapes] [-noconditionals] [-force] [-bench <count>] <file> [<file> ...]\n"
+		"  Writes <file>%s next to each file, unless it's already up to date.\n"
+		"  Files must be under the game directory (default: the current directory).\n", KVIMAGE_CACHE_EXTENSION );
+	exit( -1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Reads every value in an image without materializing it
+//-----------------------------------------------------------------------------
+static int WalkImageKeys( KeyValuesImageKey key, int &nStringBytes )
+{
+	int nKeys = 0;
+	for ( ; key.IsValid(); key = key.GetNextKey() )
+	{
+		nKeys++;
+		if ( key.GetDataType() == KeyValues::TYPE_NONE )
+		{
+			nKeys += WalkImageKeys( key.GetFirstSubKey(), nStringBytes );
+		}
+		else
+		{
+			nStringBytes += V_strlen( key.GetString() );
+		}
+	}
+	return nKeys;
+}
+
+//-----------------------------------------------------------------------------
+// Times loading a file as text, as a materialized image, and as an image
+// that's only read through
+//-----------------------------------------------------------------------------
+static void BenchmarkFile( const char *pFileName, int nLoadFlags, int nIterations )
+{
+	char cacheName[MAX_PATH];
+	CKeyValuesImage::GetCacheFileName( pFileName, cacheName, sizeof( cacheName ) );
+
+	KeyValues::SetUseCompiledCache( false );
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		KeyValues *pKV = new KeyValues( pFileName );
+		pKV->UsesEscapeSequences( ( nLoadFlags & KVIMAGE_FLAG_ESCAPE_SEQUENCES ) != 0 );
+		pKV->UsesConditionals( ( nLoadFlags & KVIMAGE_FLAG_NO_CONDITIONALS ) == 0 );
+		pKV->LoadFromFile( g_pFullFileSystem, pFileName );
+		pKV->deleteThis();
+	}
+	double flText = Plat_FloatTime() - flStart;
+
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		CKeyValuesImage image;
+		KeyValues *pKV = new KeyValues( pFileName );
+		if ( image.LoadFromFile( g_pFullFileSystem, cacheName ) && image.IsCurrent( g_pFullFileSystem, "GAME" ) )
+		{
+			image.MakeKeyValues( pKV );
+		}
+		pKV->deleteThis();
+	}
+	double flMaterialized = Plat_FloatTime() - flStart;
+
+	int nKeys = 0;
+	int nStringBytes = 0;
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		CKeyValuesImage image;
+		if ( image.LoadFromFile( g_pFullFileSystem, cacheName ) && image.IsCurrent( g_pFullFileSystem, "GAME" ) )
+		{
+			nKeys = WalkImageKeys( image.GetRoot(), nStringBytes );
+		}
+	}
+	double flView = Plat_FloatTime() - flStart;
+
+	Msg( "  %d keys: text %.3f ms, image %.3f ms (%.1fx), image read in place %.3f ms (%.1fx)\n",
+		nKeys,
+		flText * 1000.0 / nIterations,
+		flMaterialized * 1000.0 / nIterations, flText / MAX( flMaterialized, 1e-9 ),
+		flView * 1000.0 / nIterations, flText / MAX( flView, 1e-9 ) );
+}
+
+
+int main( int argc, char **argv )
+{
+	SpewOutputFunc( KVCompileOutputFunc );
+	CommandLine()->CreateCmdLine( argc, argv );
+	InitDefaultFileSystem();
+
+	int nLoadFlags = 0;
+	if ( CommandLine()->CheckParm( "-escapes" ) )
+	{
+		nLoadFlags |= KVIMAGE_FLAG_ESCAPE_SEQUENCES;
+	}
+	if ( CommandLine()->CheckParm( "-noconditionals" ) )
+	{
+		nLoadFlags |= KVIMAGE_FLAG_NO_CONDITIONALS;
+	}
+	bool bForce = CommandLine()->CheckParm( "-force" ) != NULL;
+	int nBenchIterations = CommandLine()->ParmValue( "-bench", 0 );
+
+	char pCurrentDirectory[MAX_PATH];
+	if ( _getcwd( pCurrentDirectory, sizeof( pCurrentDirectory ) ) == NULL )
+	{
+		fprintf( stderr, "Unable to get the current directory\n" );
+		return -1;
+	}
+
+	// Images record their sources relative to the game directory, so they
+	// can be built here and used on any install
+	char gameDirectory[MAX_PATH];
+	V_MakeAbsolutePath( gameDirectory, sizeof( gameDirectory ), CommandLine()->ParmValue( "-game", "." ), pCurrentDirectory );
+	g_pFullFileSystem->AddSearchPath( gameDirectory, "GAME" );
+
+	int nFiles = 0;
+	int nFailed = 0;
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( argv[i][0] == '-' )
+		{
+			if ( !V_stricmp( argv[i], "-bench" ) || !V_stricmp( argv[i], "-game" ) )
+			{
+				// skip the value
+				i++;
+			}
+			continue;
+		}
+
+		// Absolute names here; CompileFile records them relative to the game directory
+		char fileName[MAX_PATH];
+		V_MakeAbsolutePath( fileName, sizeof( fileName ), argv[i], pCurrentDirectory );
+		nFiles++;
+
+		char relativeName[MAX_PATH];
+		if ( !g_pFullFileSystem->FullPathToRelativePathEx( fileName, "GAME", relativeName, sizeof( relativeName ) ) )
+		{
+			Warning( "%s: not under the game directory %s\n", argv[i], gameDirectory );
+			nFailed++;
+			continue;
+		}
+
+		char cacheName[MAX_PATH];
+		CKeyValuesImage::GetCacheFileName( fileName, cacheName, sizeof( cacheName ) );
+
+		CKeyValuesImage image;
+		if ( !bForce && image.LoadFromFile( g_pFullFileSystem, cacheName ) &&
+			 image.GetHeader()->m_nFlags == ( nLoadFlags | CKeyValuesImage::GetPlatformFlags() ) &&
+			 image.IsCurrent( g_pFullFileSystem, "GAME" ) )
+		{
+			Msg( "%s: up to date\n", argv[i] );
+		}
+		else
+		{
+			// Unmap the old image before it's replaced
+			image.Purge();
+			if ( bForce )
+			{
+				g_pFullFileSystem->RemoveFile( cacheName );
+			}
+
+			if ( !image.LoadCached( g_pFullFileSystem, fileName, "GAME", nLoadFlags ) )
+			{
+				Warning( "%s: couldn't compile\n", argv[i] );
+				nFailed++;
+				continue;
+			}
+
+			const KVImageHeader_t *pHeader = image.GetHeader();
+			Msg( "%s: %d keys, %d files, %d bytes\n", argv[i], pHeader->m_nNodeCount, pHeader->m_nDependencyCount, pHeader->m_nSize );
+		}
+
+		if ( nBenchIterations > 0 )
+		{
+			image.Purge();
+			BenchmarkFile( fileName, nLoadFlags, nBenchIterations );
+		}
+	}
+
+	if ( !nFiles )
+	{
+		Usage();
+	}
+
+	return nFailed ? -1 : 0;
+}
@@ -0,0 +1,627 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks bf_write/bf_read's bulk, coord and varint routines against
+//			the field at a time versions they replaced, and times both.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <string.h>
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier1/bitbuf.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "coordsize.h"
+#include "mathlib/vector.h"
+#include "tier1bench.h"
+
+
+//-----------------------------------------------------------------------------
+// The bulk and coord routines the way they were before they went a word (or
+// a whole field) at a time, built only on the single field reads and writes.
+// The fuzz test checks the stream they produce and read is bit for bit the same.
+//-----------------------------------------------------------------------------
+class CBitBufReferenceOps
+{
+public:
+	static void WriteBits( bf_write &buf, const void *pData, int nBits )
+	{
+		const unsigned char *pIn = (const unsigned char *)pData;
+		for ( ; nBits >= 8; nBits -= 8 )
+		{
+			buf.WriteUBitLong( *pIn++, 8, false );
+		}
+		if ( nBits )
+		{
+			buf.WriteUBitLong( *pIn, nBits, false );
+		}
+	}
+
+	static void WriteBitsFromBuffer( bf_write &buf, bf_read &in, int nBits )
+	{
+		while ( nBits > 32 )
+		{
+			buf.WriteUBitLong( in.ReadUBitLong( 32 ), 32 );
+			nBits -= 32;
+		}
+		buf.WriteUBitLong( in.ReadUBitLong( nBits ), nBits );
+	}
+
+	static void WriteBitCoord( bf_write &buf, float f )
+	{
+		int		signbit = (f <= -COORD_RESOLUTION);
+		int		intval = (int)abs(f);
+		int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+		buf.WriteOneBit( intval );
+		buf.WriteOneBit( fractval );
+		if ( intval || fractval )
+		{
+			buf.WriteOneBit( signbit );
+			if ( intval )
+			{
+				buf.WriteUBitLong( (unsigned int)( intval - 1 ), COORD_INTEGER_BITS );
+			}
+			if ( fractval )
+			{
+				buf.WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
+			}
+		}
+	}
+
+	static void WriteBitVec3Coord( bf_write &buf, const Vector &v )
+	{
+		int flags[3];
+		for ( int i = 0; i < 3; i++ )
+		{
+			flags[i] = (v[i] >= COORD_RESOLUTION) || (v[i] <= -COORD_RESOLUTION);
+			buf.WriteOneBit( flags[i] );
+		}
+		for ( int i = 0; i < 3; i++ )
+		{
+			if ( flags[i] )
+			{
+				WriteBitCoord( buf, v[i] );
+			}
+		}
+	}
+
+	static void WriteBitNormal( bf_write &buf, float f )
+	{
+		int	signbit = (f <= -NORMAL_RESOLUTION);
+		unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+		if (fractval > NORMAL_DENOMINATOR)
+			fractval = NORMAL_DENOMINATOR;
+
+		buf.WriteOneBit( signbit );
+		buf.WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	}
+
+	static void WriteBitVec3Normal( bf_write &buf, const Vector &v )
+	{
+		int xflag = (v[0] >= NORMAL_RESOLUTION) || (v[0] <= -NORMAL_RESOLUTION);
+		int yflag = (v[1] >= NORMAL_RESOLUTION) || (v[1] <= -NORMAL_RESOLUTION);
+		buf.WriteOneBit( xflag );
+		buf.WriteOneBit( yflag );
+		if ( xflag )
+			WriteBitNormal( buf, v[0] );
+		if ( yflag )
+			WriteBitNormal( buf, v[1] );
+		buf.WriteOneBit( v[2] <= -NORMAL_RESOLUTION );
+	}
+
+	static void WriteVarInt32( bf_write &buf, uint32 data )
+	{
+		while ( data > 0x7F )
+		{
+			buf.WriteUBitLong( (data & 0x7F) | 0x80, 8 );
+			data >>= 7;
+		}
+		buf.WriteUBitLong( data & 0x7F, 8 );
+	}
+
+	static void WriteVarInt64( bf_write &buf, uint64 data )
+	{
+		while ( data > 0x7F )
+		{
+			buf.WriteUBitLong( (uint32)( (data & 0x7F) | 0x80 ), 8 );
+			data >>= 7;
+		}
+		buf.WriteUBitLong( (uint32)( data & 0x7F ), 8 );
+	}
+
+	static void WriteString( bf_write &buf, const char *pStr )
+	{
+		do
+		{
+			buf.WriteChar( *pStr );
+		} while ( *pStr++ );
+	}
+
+	static void ReadBits( bf_read &buf, void *pData, int nBits )
+	{
+		unsigned char *pOut = (unsigned char *)pData;
+		for ( ; nBits >= 8; nBits -= 8 )
+		{
+			*pOut++ = buf.ReadUBitLong( 8 );
+		}
+		if ( nBits )
+		{
+			*pOut = buf.ReadUBitLong( nBits );
+		}
+	}
+
+	static float ReadBitCoord( bf_read &buf )
+	{
+		int intval = buf.ReadOneBit();
+		int fractval = buf.ReadOneBit();
+		float value = 0.0f;
+		if ( intval || fractval )
+		{
+			int signbit = buf.ReadOneBit();
+			if ( intval )
+			{
+				intval = buf.ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+			}
+			if ( fractval )
+			{
+				fractval = buf.ReadUBitLong( COORD_FRACTIONAL_BITS );
+			}
+			value = intval + ((float)fractval * COORD_RESOLUTION);
+			if ( signbit )
+				value = -value;
+		}
+		return value;
+	}
+
+	static void ReadBitVec3Coord( bf_read &buf, Vector &v )
+	{
+		int flags[3];
+		for ( int i = 0; i < 3; i++ )
+		{
+			flags[i] = buf.ReadOneBit();
+		}
+		for ( int i = 0; i < 3; i++ )
+		{
+			v[i] = flags[i] ? ReadBitCoord( buf ) : 0.0f;
+		}
+	}
+
+	static float ReadBitNormal( bf_read &buf )
+	{
+		int	signbit = buf.ReadOneBit();
+		unsigned int fractval = buf.ReadUBitLong( NORMAL_FRACTIONAL_BITS );
+		float value = (float)fractval * NORMAL_RESOLUTION;
+		return signbit ? -value : value;
+	}
+
+	static void ReadBitVec3Normal( bf_read &buf, Vector &v )
+	{
+		int xflag = buf.ReadOneBit();
+		int yflag = buf.ReadOneBit();
+		v[0] = xflag ? ReadBitNormal( buf ) : 0.0f;
+		v[1] = yflag ? ReadBitNormal( buf ) : 0.0f;
+
+		int znegative = buf.ReadOneBit();
+		float fafafbfb = v[0] * v[0] + v[1] * v[1];
+		v[2] = ( fafafbfb < 1.0f ) ? sqrt( 1.0f - fafafbfb ) : 0.0f;
+		if ( znegative )
+			v[2] = -v[2];
+	}
+
+	static uint32 ReadVarInt32( bf_read &buf )
+	{
+		uint32 result = 0;
+		for ( int count = 0; count < bitbuf::kMaxVarint32Bytes; count++ )
+		{
+			uint32 b = buf.ReadUBitLong( 8 );
+			result |= (b & 0x7F) << (7 * count);
+			if ( !( b & 0x80 ) )
+				break;
+		}
+		return result;
+	}
+
+	static uint64 ReadVarInt64( bf_read &buf )
+	{
+		uint64 result = 0;
+		for ( int count = 0; count < bitbuf::kMaxVarintBytes; count++ )
+		{
+			uint64 b = buf.ReadUBitLong( 8 );
+			result |= (b & 0x7F) << (7 * count);
+			if ( !( b & 0x80 ) )
+				break;
+		}
+		return result;
+	}
+
+	static void ReadString( bf_read &buf, char *pStr, int maxLen )
+	{
+		int iChar = 0;
+		for ( char val = buf.ReadChar(); val; val = buf.ReadChar() )
+		{
+			if ( iChar < maxLen - 1 )
+			{
+				pStr[iChar++] = val;
+			}
+		}
+		pStr[iChar] = 0;
+	}
+};
+
+// The same through bf_write and bf_read
+class CBitBufOps
+{
+public:
+	static void WriteBits( bf_write &buf, const void *pData, int nBits ) { buf.WriteBits( pData, nBits ); }
+	static void WriteBitsFromBuffer( bf_write &buf, bf_read &in, int nBits ) { buf.WriteBitsFromBuffer( &in, nBits ); }
+	static void WriteBitVec3Coord( bf_write &buf, const Vector &v ) { buf.WriteBitVec3Coord( v ); }
+	static void WriteBitCoord( bf_write &buf, float f ) { buf.WriteBitCoord( f ); }
+	static void WriteBitVec3Normal( bf_write &buf, const Vector &v ) { buf.WriteBitVec3Normal( v ); }
+	static void WriteVarInt32( bf_write &buf, uint32 data ) { buf.WriteVarInt32( data ); }
+	static void WriteVarInt64( bf_write &buf, uint64 data ) { buf.WriteVarInt64( data ); }
+	static void WriteString( bf_write &buf, const char *pStr ) { buf.WriteString( pStr ); }
+
+	static void ReadBits( bf_read &buf, void *pData, int nBits ) { buf.ReadBits( pData, nBits ); }
+	static float ReadBitCoord( bf_read &buf ) { return buf.ReadBitCoord(); }
+	static void ReadBitVec3Coord( bf_read &buf, Vector &v ) { buf.ReadBitVec3Coord( v ); }
+	static void ReadBitVec3Normal( bf_read &buf, Vector &v ) { buf.ReadBitVec3Normal( v ); }
+	static uint32 ReadVarInt32( bf_read &buf ) { return buf.ReadVarInt32(); }
+	static uint64 ReadVarInt64( bf_read &buf ) { return buf.ReadVarInt64(); }
+	static void ReadString( bf_read &buf, char *pStr, int maxLen ) { buf.ReadString( pStr, maxLen ); }
+};
+
+enum BitBufBenchOpType_t
+{
+	BITBUF_OP_UBITLONG,
+	BITBUF_OP_COORD,
+	BITBUF_OP_VEC3COORD,
+	BITBUF_OP_VEC3NORMAL,
+	BITBUF_OP_VARINT32,
+	BITBUF_OP_VARINT64,
+	BITBUF_OP_STRING,
+	BITBUF_OP_BITS,
+	BITBUF_OP_BITSFROMBUFFER,
+};
+
+struct BitBufBenchOp_t
+{
+	int		m_nType;
+	int		m_nBits;
+	int		m_nOffset;		// into the source bytes or bits, or the string table
+	uint64	m_nValue;
+	Vector	m_Vec;
+};
+
+static const char *s_pBitBufBenchStrings[] =
+{
+	"",
+	"player",
+	"weapon_smg1",
+	"models/props_c17/oildrum001_explosive.mdl",
+	"The combine have taken the canals. Get to the boat and head north.",
+};
+
+#define BITBUF_BENCH_SOURCE_BYTES	1024
+#define BITBUF_BENCH_MAX_OP_BITS	400
+#define BITBUF_BENCH_OPS			64
+#define BITBUF_BENCH_BUFFER_BYTES	( BITBUF_BENCH_OPS * BITBUF_BENCH_MAX_OP_BITS / 8 + 64 )
+
+static inline unsigned BitBufBenchRand( unsigned &nRand )
+{
+	nRand = nRand * 1664525u + 1013904223u;
+	return nRand >> 8;
+}
+
+// Coords split between zero, fractions, whole numbers and both, inside the coord range
+static float BitBufBenchCoord( unsigned &nRand )
+{
+	float flSign = ( BitBufBenchRand( nRand ) & 1 ) ? -1.0f : 1.0f;
+	switch ( BitBufBenchRand( nRand ) & 3 )
+	{
+	case 0:		return 0.0f;
+	case 1:		return flSign * (float)( BitBufBenchRand( nRand ) % COORD_DENOMINATOR ) * COORD_RESOLUTION;
+	case 2:		return flSign * (float)( BitBufBenchRand( nRand ) % ( MAX_COORD_INTEGER - 1 ) + 1 );
+	default:	return flSign * (float)( BitBufBenchRand( nRand ) % ( ( MAX_COORD_INTEGER - 1 ) * 256 ) ) / 256.0f;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Makes a message: mostly small fields and coords, like an entity delta, plus
+// some varints, strings and blocks of bits
+//-----------------------------------------------------------------------------
+static void MakeBitBufBenchOps( BitBufBenchOp_t *pOps, int nOps, unsigned &nRand )
+{
+	for ( int i = 0; i < nOps; i++ )
+	{
+		BitBufBenchOp_t &op = pOps[i];
+		memset( &op, 0, sizeof( op ) );
+
+		unsigned nKind = BitBufBenchRand( nRand ) % 16;
+		op.m_nType = ( nKind < 6 ) ? BITBUF_OP_UBITLONG : (int)( nKind - 6 ) / 2 + BITBUF_OP_COORD;
+		if ( nKind == 12 || nKind == 13 )
+		{
+			op.m_nType = ( nKind == 12 ) ? BITBUF_OP_STRING : BITBUF_OP_BITS;
+		}
+		else if ( nKind >= 14 )
+		{
+			op.m_nType = ( nKind == 14 ) ? BITBUF_OP_VARINT64 : BITBUF_OP_BITSFROMBUFFER;
+		}
+
+		switch ( op.m_nType )
+		{
+		case BITBUF_OP_UBITLONG:
+			op.m_nBits = BitBufBenchRand( nRand ) % 32 + 1;
+			op.m_nValue = ( (uint64)BitBufBenchRand( nRand ) << 16 ^ BitBufBenchRand( nRand ) ) & ( 0xffffffffu >> ( 32 - op.m_nBits ) );
+			break;
+
+		case BITBUF_OP_COORD:
+		case BITBUF_OP_VEC3COORD:
+			op.m_Vec.Init( BitBufBenchCoord( nRand ), BitBufBenchCoord( nRand ), BitBufBenchCoord( nRand ) );
+			break;
+
+		case BITBUF_OP_VEC3NORMAL:
+			op.m_Vec.Init( (float)( BitBufBenchRand( nRand ) % 2001 ) / 1000.0f - 1.0f, (float)( BitBufBenchRand( nRand ) % 2001 ) / 1000.0f - 1.0f,
+				( BitBufBenchRand( nRand ) & 1 ) ? -0.5f : 0.5f );
+			break;
+
+		case BITBUF_OP_VARINT32:
+		case BITBUF_OP_VARINT64:
+			op.m_nValue = ( (uint64)BitBufBenchRand( nRand ) << 40 ) ^ ( (uint64)BitBufBenchRand( nRand ) << 20 ) ^ BitBufBenchRand( nRand );
+			op.m_nValue >>= BitBufBenchRand( nRand ) % 64;
+			if ( op.m_nType == BITBUF_OP_VARINT32 )
+			{
+				op.m_nValue = (uint32)op.m_nValue;
+			}
+			break;
+
+		case BITBUF_OP_STRING:
+			op.m_nOffset = BitBufBenchRand( nRand ) % ARRAYSIZE( s_pBitBufBenchStrings );
+			break;
+
+		case BITBUF_OP_BITS:
+			op.m_nBits = BitBufBenchRand( nRand ) % ( BITBUF_BENCH_MAX_OP_BITS + 1 );
+			op.m_nOffset = BitBufBenchRand( nRand ) % ( BITBUF_BENCH_SOURCE_BYTES - BITBUF_BENCH_MAX_OP_BITS / 8 );
+			break;
+
+		case BITBUF_OP_BITSFROMBUFFER:
+			op.m_nBits = BitBufBenchRand( nRand ) % BITBUF_BENCH_MAX_OP_BITS + 1;
+			op.m_nOffset = BitBufBenchRand( nRand ) % ( BITBUF_BENCH_SOURCE_BYTES * 8 - BITBUF_BENCH_MAX_OP_BITS );
+			break;
+		}
+	}
+}
+
+template < class OPS >
+static void WriteBitBufBenchOps( bf_write &buf, const BitBufBenchOp_t *pOps, int nOps, bf_read &source )
+{
+	for ( int i = 0; i < nOps; i++ )
+	{
+		const BitBufBenchOp_t &op = pOps[i];
+		switch ( op.m_nType )
+		{
+		case BITBUF_OP_UBITLONG:		buf.WriteUBitLong( (uint32)op.m_nValue, op.m_nBits );	break;
+		case BITBUF_OP_COORD:			OPS::WriteBitCoord( buf, op.m_Vec.x );					break;
+		case BITBUF_OP_VEC3COORD:		OPS::WriteBitVec3Coord( buf, op.m_Vec );				break;
+		case BITBUF_OP_VEC3NORMAL:		OPS::WriteBitVec3Normal( buf, op.m_Vec );				break;
+		case BITBUF_OP_VARINT32:		OPS::WriteVarInt32( buf, (uint32)op.m_nValue );			break;
+		case BITBUF_OP_VARINT64:		OPS::WriteVarInt64( buf, op.m_nValue );					break;
+		case BITBUF_OP_STRING:			OPS::WriteString( buf, s_pBitBufBenchStrings[op.m_nOffset] );	break;
+		case BITBUF_OP_BITS:			OPS::WriteBits( buf, source.m_pData + op.m_nOffset, op.m_nBits );	break;
+		case BITBUF_OP_BITSFROMBUFFER:
+			source.Seek( op.m_nOffset );
+			OPS::WriteBitsFromBuffer( buf, source, op.m_nBits );
+			break;
+		}
+	}
+}
+
+static inline void BitBufBenchDigest( uint32 &nDigest, uint32 nValue )
+{
+	nDigest = ( nDigest ^ nValue ) * 16777619u;
+}
+
+static inline void BitBufBenchDigestFloat( uint32 &nDigest, float flValue )
+{
+	uint32 nValue;
+	memcpy( &nValue, &flValue, sizeof( nValue ) );
+	BitBufBenchDigest( nDigest, nValue );
+}
+
+//-----------------------------------------------------------------------------
+// Reads a message back. Returns a digest of everything read, and clears bOk
+// if any integer, string or block of bits isn't what was written.
+//-----------------------------------------------------------------------------
+template < class OPS >
+static uint32 ReadBitBufBenchOps( bf_read &buf, const BitBufBenchOp_t *pOps, int nOps, bf_read &source, bool &bOk )
+{
+	uint32 nDigest = 2166136261u;
+	for ( int i = 0; i < nOps; i++ )
+	{
+		const BitBufBenchOp_t &op = pOps[i];
+		switch ( op.m_nType )
+		{
+		case BITBUF_OP_UBITLONG:
+			bOk = ( buf.ReadUBitLong( op.m_nBits ) == (uint32)op.m_nValue ) && bOk;
+			break;
+
+		case BITBUF_OP_COORD:
+			BitBufBenchDigestFloat( nDigest, OPS::ReadBitCoord( buf ) );
+			break;
+
+		case BITBUF_OP_VEC3COORD:
+		case BITBUF_OP_VEC3NORMAL:
+			{
+				Vector v;
+				if ( op.m_nType == BITBUF_OP_VEC3COORD )
+				{
+					OPS::ReadBitVec3Coord( buf, v );
+				}
+				else
+				{
+					OPS::ReadBitVec3Normal( buf, v );
+				}
+				BitBufBenchDigestFloat( nDigest, v.x );
+				BitBufBenchDigestFloat( nDigest, v.y );
+				BitBufBenchDigestFloat( nDigest, v.z );
+			}
+			break;
+
+		case BITBUF_OP_VARINT32:
+			bOk = ( OPS::ReadVarInt32( buf ) == (uint32)op.m_nValue ) && bOk;
+			break;
+
+		case BITBUF_OP_VARINT64:
+			bOk = ( OPS::ReadVarInt64( buf ) == op.m_nValue ) && bOk;
+			break;
+
+		case BITBUF_OP_STRING:
+			{
+				char str[256];
+				OPS::ReadString( buf, str, sizeof( str ) );
+				bOk = !V_strcmp( str, s_pBitBufBenchStrings[op.m_nOffset] ) && bOk;
+			}
+			break;
+
+		case BITBUF_OP_BITS:
+		case BITBUF_OP_BITSFROMBUFFER:
+			{
+				unsigned char bits[BITBUF_BENCH_MAX_OP_BITS / 8 + 1];
+				OPS::ReadBits( buf, bits, op.m_nBits );
+
+				// Compare a whole dword at a time against the source
+				int nSourceBit = ( op.m_nType == BITBUF_OP_BITS ) ? op.m_nOffset * 8 : op.m_nOffset;
+				bf_read in( bits, sizeof( bits ), op.m_nBits );
+				source.Seek( nSourceBit );
+				for ( int nBitsLeft = op.m_nBits; nBitsLeft > 0; nBitsLeft -= 32 )
+				{
+					int nBits = MIN( nBitsLeft, 32 );
+					bOk = ( in.ReadUBitLong( nBits ) == source.ReadUBitLong( nBits ) ) && bOk;
+				}
+			}
+			break;
+		}
+	}
+
+	BitBufBenchDigest( nDigest, buf.GetNumBitsRead() );
+	return nDigest;
+}
+
+//-----------------------------------------------------------------------------
+// Writes a random message both ways into buffers full of the same garbage, from
+// the same odd bit, and checks they come out identical and read back the same.
+//-----------------------------------------------------------------------------
+static bool FuzzBitBuf( unsigned &nRand, bf_read &source )
+{
+	BitBufBenchOp_t ops[BITBUF_BENCH_OPS];
+	int nOps = BitBufBenchRand( nRand ) % BITBUF_BENCH_OPS + 1;
+	MakeBitBufBenchOps( ops, nOps, nRand );
+
+	unsigned long referenceData[BITBUF_BENCH_BUFFER_BYTES / 4];
+	unsigned long data[BITBUF_BENCH_BUFFER_BYTES / 4];
+	for ( int i = 0; i < ARRAYSIZE( data ); i++ )
+	{
+		referenceData[i] = data[i] = BitBufBenchRand( nRand ) ^ ( BitBufBenchRand( nRand ) << 24 );
+	}
+
+	int nStartBit = BitBufBenchRand( nRand ) % 64;
+	bf_write referenceBuf( referenceData, sizeof( referenceData ) );
+	bf_write buf( data, sizeof( data ) );
+	referenceBuf.SeekToBit( nStartBit );
+	buf.SeekToBit( nStartBit );
+
+	WriteBitBufBenchOps< CBitBufReferenceOps >( referenceBuf, ops, nOps, source );
+	WriteBitBufBenchOps< CBitBufOps >( buf, ops, nOps, source );
+
+	bool bOk = !referenceBuf.IsOverflowed() && !buf.IsOverflowed() &&
+		referenceBuf.GetNumBitsWritten() == buf.GetNumBitsWritten() &&
+		!memcmp( referenceData, data, sizeof( data ) );
+
+	bf_read referenceIn( data, sizeof( data ) );
+	bf_read in( data, sizeof( data ) );
+	referenceIn.Seek( nStartBit );
+	in.Seek( nStartBit );
+
+	uint32 nReferenceDigest = ReadBitBufBenchOps< CBitBufReferenceOps >( referenceIn, ops, nOps, source, bOk );
+	uint32 nDigest = ReadBitBufBenchOps< CBitBufOps >( in, ops, nOps, source, bOk );
+	return bOk && nReferenceDigest == nDigest && !referenceIn.IsOverflowed() && !in.IsOverflowed();
+}
+
+template < class OPS >
+static double TimeBitBufWrites( const BitBufBenchOp_t *pMessages, int nMessageScripts, int nMessages, bf_read &source, int &nBits )
+{
+	unsigned long data[BITBUF_BENCH_BUFFER_BYTES / 4];
+	bf_write buf( data, sizeof( data ) );
+
+	nBits = 0;
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nMessages; i++ )
+	{
+		buf.Reset();
+		WriteBitBufBenchOps< OPS >( buf, pMessages + ( i % nMessageScripts ) * BITBUF_BENCH_OPS, BITBUF_BENCH_OPS, source );
+		nBits += buf.GetNumBitsWritten();
+	}
+	return Plat_FloatTime() - flStart;
+}
+
+template < class OPS >
+static double TimeBitBufReads( const BitBufBenchOp_t *pMessages, const unsigned long *pData, int nMessageScripts, int nMessages, bf_read &source, bool &bOk )
+{
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nMessages; i++ )
+	{
+		int nScript = i % nMessageScripts;
+		bf_read buf( pData + nScript * ( BITBUF_BENCH_BUFFER_BYTES / 4 ), BITBUF_BENCH_BUFFER_BYTES );
+		ReadBitBufBenchOps< OPS >( buf, pMessages + nScript * BITBUF_BENCH_OPS, BITBUF_BENCH_OPS, source, bOk );
+	}
+	return Plat_FloatTime() - flStart;
+}
+
+bool RunBitBufBenchmark( int nFuzzIterations, int nMessages )
+{
+	unsigned nRand = 12345;
+
+	unsigned long sourceData[BITBUF_BENCH_SOURCE_BYTES / 4];
+	for ( int i = 0; i < ARRAYSIZE( sourceData ); i++ )
+	{
+		sourceData[i] = BitBufBenchRand( nRand ) ^ ( BitBufBenchRand( nRand ) << 24 );
+	}
+	bf_read source( sourceData, sizeof( sourceData ) );
+
+	int nFuzzFailures = 0;
+	for ( int i = 0; i < nFuzzIterations; i++ )
+	{
+		nFuzzFailures += FuzzBitBuf( nRand, source ) ? 0 : 1;
+	}
+	Msg( "bitbuf fuzz: %d messages, %d differed from the reference\n", nFuzzIterations, nFuzzFailures );
+
+	// Cycle through a few hundred messages so the scripts stay in cache
+	const int nMessageScripts = 256;
+	CUtlVector< BitBufBenchOp_t > messages;
+	messages.SetCount( nMessageScripts * BITBUF_BENCH_OPS );
+	MakeBitBufBenchOps( messages.Base(), messages.Count(), nRand );
+
+	CUtlVector< unsigned long > data;
+	data.SetCount( nMessageScripts * BITBUF_BENCH_BUFFER_BYTES / 4 );
+	for ( int i = 0; i < nMessageScripts; i++ )
+	{
+		bf_write buf( data.Base() + i * ( BITBUF_BENCH_BUFFER_BYTES / 4 ), BITBUF_BENCH_BUFFER_BYTES );
+		WriteBitBufBenchOps< CBitBufOps >( buf, messages.Base() + i * BITBUF_BENCH_OPS, BITBUF_BENCH_OPS, source );
+	}
+
+	int nReferenceBits, nBits;
+	double flReferenceWrite = TimeBitBufWrites< CBitBufReferenceOps >( messages.Base(), nMessageScripts, nMessages, source, nReferenceBits );
+	double flWrite = TimeBitBufWrites< CBitBufOps >( messages.Base(), nMessageScripts, nMessages, source, nBits );
+
+	bool bOk = ( nFuzzFailures == 0 ) && ( nReferenceBits == nBits );
+	double flReferenceRead = TimeBitBufReads< CBitBufReferenceOps >( messages.Base(), data.Base(), nMessageScripts, nMessages, source, bOk );
+	double flRead = TimeBitBufReads< CBitBufOps >( messages.Base(), data.Base(), nMessageScripts, nMessages, source, bOk );
+
+	double flMB = nBits / ( 8.0 * 1024.0 * 1024.0 );
+	Msg( "bitbuf write: %d messages, %.1f MB/s field at a time, %.1f MB/s word at a time (%.2fx)\n",
+		nMessages, flMB / flReferenceWrite, flMB / flWrite, flReferenceWrite / flWrite );
+	Msg( "bitbuf read: %d messages, %.1f MB/s field at a time, %.1f MB/s word at a time (%.2fx)%s\n",
+		nMessages, flMB / flReferenceRead, flMB / flRead, flReferenceRead / flRead, bOk ? "" : " (WRONG RESULTS)" );
+	return bOk;
+}
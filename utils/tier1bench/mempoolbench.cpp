@@ -0,0 +1,218 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks CMemoryPoolMT hands each block to one thread at a time and
+//			times it against the mutex guarded CUtlMemoryPool it replaced.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier0/tslist.h"
+#include "tier1/mempool.h"
+#include "tier1/utlvector.h"
+#include "tier1bench.h"
+
+
+//-----------------------------------------------------------------------------
+// Microbenchmark. Each thread keeps a window of live blocks, stamped with its
+// id, and frees a pseudo-random one for every alloc once the window is full.
+// Every other block it frees came from the thread before it, so blocks also
+// migrate between threads (and magazines) the way they do in job systems.
+//-----------------------------------------------------------------------------
+#define MEMPOOL_BENCH_WINDOW	256
+
+// The first pointer's worth of a block is the list link while it's handed off
+#define MEMPOOL_BENCH_FIRST_STAMP	( (int)( sizeof( void * ) / sizeof( int ) ) )
+
+class CMemoryPoolLocked : public CUtlMemoryPool
+{
+public:
+	CMemoryPoolLocked( int blockSize, int numElements ) : CUtlMemoryPool( blockSize, numElements, UTLMEMORYPOOL_GROW_FAST, "mempool benchmark", TSLIST_NODE_ALIGNMENT ) {}
+
+	void*		Alloc()	{ AUTO_LOCK( m_mutex ); return CUtlMemoryPool::Alloc(); }
+	void		Free( void *pMem ) { AUTO_LOCK( m_mutex ); CUtlMemoryPool::Free( pMem ); }
+
+private:
+	CThreadFastMutex m_mutex;
+};
+
+template < class POOL >
+struct MemoryPoolBenchThread_t
+{
+	POOL				*m_pPool;
+	CTSListBase			*m_pHandoff;	// Blocks passed to the next thread
+	CTSListBase			*m_pIncoming;	// Blocks passed from the previous thread
+	int					m_nThread;
+	int					m_nPrevThread;
+	int					m_nAllocs;
+	int					m_nBlockSize;
+	volatile bool		*m_pbStart;
+	bool				m_bCorrupt;
+};
+
+template < class POOL >
+static bool FreeBenchBlock( MemoryPoolBenchThread_t<POOL> *pThread, void *pBlock, int nOwner )
+{
+	bool bOk = true;
+	int *pStamp = (int *)pBlock;
+	for ( int i = MEMPOOL_BENCH_FIRST_STAMP; i < pThread->m_nBlockSize / (int)sizeof( int ); i++ )
+	{
+		if ( pStamp[i] != nOwner )
+		{
+			bOk = false;
+		}
+	}
+	pThread->m_pPool->Free( pBlock );
+	return bOk;
+}
+
+template < class POOL >
+static unsigned MemoryPoolBenchThread( void *pParam )
+{
+	MemoryPoolBenchThread_t<POOL> *pThread = (MemoryPoolBenchThread_t<POOL> *)pParam;
+	void *pWindow[MEMPOOL_BENCH_WINDOW];
+	int nLive = 0;
+	unsigned nRand = pThread->m_nThread * 2654435761u + 1;
+
+	while ( !*pThread->m_pbStart )
+	{
+		ThreadPause();
+	}
+
+	for ( int i = 0; i < pThread->m_nAllocs; i++ )
+	{
+		void *pBlock = pThread->m_pPool->Alloc();
+		if ( !pBlock )
+		{
+			pThread->m_bCorrupt = true;
+			break;
+		}
+
+		int *pStamp = (int *)pBlock;
+		for ( int j = MEMPOOL_BENCH_FIRST_STAMP; j < pThread->m_nBlockSize / (int)sizeof( int ); j++ )
+		{
+			pStamp[j] = pThread->m_nThread;
+		}
+
+		if ( nLive == MEMPOOL_BENCH_WINDOW )
+		{
+			nRand = nRand * 1664525u + 1013904223u;
+			int nVictim = ( nRand >> 16 ) % MEMPOOL_BENCH_WINDOW;
+			if ( i & 1 )
+			{
+				pThread->m_pHandoff->Push( (TSLNodeBase_t *)pWindow[nVictim] );
+			}
+			else if ( !FreeBenchBlock( pThread, pWindow[nVictim], pThread->m_nThread ) )
+			{
+				pThread->m_bCorrupt = true;
+			}
+			pWindow[nVictim] = pBlock;
+		}
+		else
+		{
+			pWindow[nLive++] = pBlock;
+		}
+
+		// Free what the previous thread handed over
+		TSLNodeBase_t *pIncoming = pThread->m_pIncoming->Pop();
+		if ( pIncoming && !FreeBenchBlock( pThread, pIncoming, pThread->m_nPrevThread ) )
+		{
+			pThread->m_bCorrupt = true;
+		}
+	}
+
+	for ( int i = 0; i < nLive; i++ )
+	{
+		if ( !FreeBenchBlock( pThread, pWindow[i], pThread->m_nThread ) )
+		{
+			pThread->m_bCorrupt = true;
+		}
+	}
+	return 0;
+}
+
+template < class POOL >
+static bool RunMemoryPoolBenchmarkPass( POOL &pool, const char *pName, int nThreads, int nAllocsPerThread, int nBlockSize )
+{
+	CUtlVector< MemoryPoolBenchThread_t<POOL> > threads;
+	CUtlVector< ThreadHandle_t > handles;
+	CUtlVector< CTSListBase * > handoffs;
+	threads.SetCount( nThreads );
+	handles.SetCount( nThreads );
+	handoffs.SetCount( nThreads );
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		handoffs[i] = new CTSListBase;
+	}
+
+	volatile bool bStart = false;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		MemoryPoolBenchThread_t<POOL> &thread = threads[i];
+		thread.m_pPool = &pool;
+		thread.m_pHandoff = handoffs[i];
+		thread.m_pIncoming = handoffs[ ( i + nThreads - 1 ) % nThreads ];
+		thread.m_nThread = i;
+		thread.m_nPrevThread = ( i + nThreads - 1 ) % nThreads;
+		thread.m_nAllocs = nAllocsPerThread;
+		thread.m_nBlockSize = nBlockSize;
+		thread.m_pbStart = &bStart;
+		thread.m_bCorrupt = false;
+		handles[i] = CreateSimpleThread( MemoryPoolBenchThread<POOL>, &thread );
+	}
+
+	double flStart = Plat_FloatTime();
+	bStart = true;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		ThreadJoin( handles[i] );
+		ReleaseThreadHandle( handles[i] );
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	bool bOk = true;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		bOk = bOk && !threads[i].m_bCorrupt;
+
+		// Handed off blocks the next thread didn't get to
+		TSLNodeBase_t *pNode;
+		while ( ( pNode = handoffs[i]->Pop() ) != NULL )
+		{
+			pool.Free( pNode );
+		}
+		delete handoffs[i];
+	}
+
+	// One alloc and one free per iteration
+	double flOps = 2.0 * nThreads * nAllocsPerThread;
+	Msg( "%s: %d threads, %.1f ns per alloc/free, %.1f M ops/s%s\n", pName, nThreads,
+		1e9 * flElapsed * nThreads / flOps, flOps / flElapsed * 1e-6, bOk ? "" : " (CORRUPTED)" );
+	return bOk;
+}
+
+bool RunMemoryPoolMTBenchmark( int nThreads, int nAllocsPerThread, int nBlockSize )
+{
+	nBlockSize = max( nBlockSize, (int)( sizeof( void * ) + sizeof( int ) ) );
+
+	CMemoryPoolLocked lockedPool( nBlockSize, 1024 );
+	bool bOk = RunMemoryPoolBenchmarkPass( lockedPool, "CUtlMemoryPool + mutex", nThreads, nAllocsPerThread, nBlockSize );
+
+	CMemoryPoolMT pool( nBlockSize, 1024, UTLMEMORYPOOL_GROW_FAST, "mempool benchmark" );
+	bOk = RunMemoryPoolBenchmarkPass( pool, "CMemoryPoolMT", nThreads, nAllocsPerThread, nBlockSize ) && bOk;
+
+	MemoryPoolMTStats_t stats;
+	pool.GetStats( stats );
+	Msg( "CMemoryPoolMT stats: %lld magazine allocs, %lld magazine frees, %lld refills, %lld flushes, %lld contended, %lld grows\n",
+		(long long)stats.m_nMagazineAllocs, (long long)stats.m_nMagazineFrees, (long long)stats.m_nRefills,
+		(long long)stats.m_nFlushes, (long long)stats.m_nContended, (long long)stats.m_nGrows );
+
+	if ( pool.Count() != 0 )
+	{
+		Msg( "CMemoryPoolMT: %d blocks unaccounted for\n", pool.Count() );
+		bOk = false;
+	}
+	return bOk;
+}
@@ -0,0 +1,333 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks CUtlSymbolTable and CUtlSymbolTableMT give the same symbols
+//			as the red-black tree table they replaced, and times them.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+#include "tier1/utlrbtree.h"
+#include "tier1/utlsymbol.h"
+#include "tier1/utlvector.h"
+#include "tier1bench.h"
+
+
+// Name shapes seen while loading a level: resource paths plus a small set of
+// keyvalue and material keys that are looked up over and over.
+static const char *s_pSymbolBenchFormats[] =
+{
+	"models/props_c17/furniture_chair%03d.mdl",
+	"materials/concrete/concretefloor%03d",
+	"sound/ambient/machines/machine_hum%d.wav",
+	"$basetexture%d",
+	"scripts/talker/response_%d",
+	"%d_targetname",
+	"maps/cfg/%d",
+	"particles/fire_%d.pcf",
+};
+
+//-----------------------------------------------------------------------------
+// The table as it was before the hash index, a red-black tree ordered by
+// string, so the benchmark has something to compare against.
+//-----------------------------------------------------------------------------
+static bool SymbolBenchLess( const char * const &pLeft, const char * const &pRight )
+{
+	return V_stricmp( pLeft, pRight ) < 0;
+}
+
+class CRBTreeSymbolTable
+{
+public:
+	CRBTreeSymbolTable() : m_Tree( 0, 32, SymbolBenchLess )
+	{
+	}
+
+	~CRBTreeSymbolTable()
+	{
+		for ( UtlSymId_t i = m_Tree.FirstInorder(); i != m_Tree.InvalidIndex(); i = m_Tree.NextInorder( i ) )
+		{
+			free( (void *)m_Tree[i] );
+		}
+	}
+
+	UtlSymId_t AddString( const char *pString )
+	{
+		UtlSymId_t i = m_Tree.Find( pString );
+		if ( i != m_Tree.InvalidIndex() )
+			return i;
+		return m_Tree.Insert( strdup( pString ) );
+	}
+
+	UtlSymId_t Find( const char *pString ) const
+	{
+		return m_Tree.Find( pString );
+	}
+
+	const char *String( UtlSymId_t id ) const
+	{
+		return m_Tree[id];
+	}
+
+	// Only here so the benchmark passes compile for both tables
+	UtlSymId_t AddString( const char *pString, unsigned nHash ) { return AddString( pString ); }
+	UtlSymId_t Find( const char *pString, unsigned nHash ) const { return Find( pString ); }
+
+private:
+	CUtlRBTree<const char *, UtlSymId_t> m_Tree;
+};
+
+// ...and the old CUtlSymbolTableMT, which took a read or write lock for everything
+class CRBTreeSymbolTableLocked : private CRBTreeSymbolTable
+{
+public:
+	UtlSymId_t AddString( const char *pString )
+	{
+		m_lock.LockForWrite();
+		UtlSymId_t result = CRBTreeSymbolTable::AddString( pString );
+		m_lock.UnlockWrite();
+		return result;
+	}
+
+	UtlSymId_t Find( const char *pString ) const
+	{
+		m_lock.LockForRead();
+		UtlSymId_t result = CRBTreeSymbolTable::Find( pString );
+		m_lock.UnlockRead();
+		return result;
+	}
+
+	const char *String( UtlSymId_t id ) const
+	{
+		m_lock.LockForRead();
+		const char *pResult = CRBTreeSymbolTable::String( id );
+		m_lock.UnlockRead();
+		return pResult;
+	}
+
+private:
+#if defined(WIN32) || defined(_WIN32)
+	mutable CThreadSpinRWLock m_lock;
+#else
+	mutable CThreadRWLock m_lock;
+#endif
+};
+
+struct SymbolBenchNames_t
+{
+	CUtlVector<char *> m_Names;
+	CUtlVector<char *> m_UpperNames;	// the same names in upper case, for case insensitive hits
+	CUtlVector<unsigned> m_Hashes;
+};
+
+//-----------------------------------------------------------------------------
+// Adds every name in turn, each followed by lookups of random names. Lookups of
+// names that were added must give the same symbol back, and lookups of names
+// that weren't yet must miss.
+//-----------------------------------------------------------------------------
+template < class TABLE >
+static bool RunSymbolTableLoadPass( TABLE &table, const char *pName, const SymbolBenchNames_t &names, int nLookupsPerString, bool bPrecomputedHash )
+{
+	int nStrings = names.m_Names.Count();
+	CUtlVector<UtlSymId_t> ids;
+	ids.SetCount( nStrings );
+
+	bool bOk = true;
+	unsigned nRand = 12345;
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		ids[i] = bPrecomputedHash ? table.AddString( names.m_Names[i], names.m_Hashes[i] ) : table.AddString( names.m_Names[i] );
+
+		for ( int j = 0; j < nLookupsPerString; j++ )
+		{
+			nRand = nRand * 1664525u + 1013904223u;
+			int k = ( nRand >> 8 ) % nStrings;
+			const char *pString = ( nRand & 1 ) ? names.m_UpperNames[k] : names.m_Names[k];
+			if ( k > i )
+			{
+				UtlSymId_t id = bPrecomputedHash ? table.Find( pString, names.m_Hashes[k] ) : table.Find( pString );
+				bOk = bOk && ( id == UTL_INVAL_SYMBOL );
+			}
+			else
+			{
+				UtlSymId_t id = ( nRand & 2 ) ?
+					( bPrecomputedHash ? table.AddString( pString, names.m_Hashes[k] ) : table.AddString( pString ) ) :
+					( bPrecomputedHash ? table.Find( pString, names.m_Hashes[k] ) : table.Find( pString ) );
+				bOk = bOk && ( id == ids[k] );
+			}
+		}
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		bOk = bOk && !V_strcmp( table.String( ids[i] ), names.m_Names[i] );
+	}
+
+	double flOps = (double)nStrings * ( nLookupsPerString + 1 );
+	Msg( "%s: %d strings, %.1f ns per add/find, %.1f ms%s\n", pName, nStrings,
+		1e9 * flElapsed / flOps, flElapsed * 1e3, bOk ? "" : " (WRONG RESULTS)" );
+	return bOk;
+}
+
+template < class TABLE >
+struct SymbolBenchThread_t
+{
+	TABLE *m_pTable;
+	const SymbolBenchNames_t *m_pNames;
+	UtlSymId_t *m_pIds;
+	int m_nThread;
+	int m_nThreads;
+	int m_nLookupsPerString;
+	volatile bool *m_pbStart;
+	bool m_bWrong;
+};
+
+//-----------------------------------------------------------------------------
+// Each thread adds all the names, starting at a different place, and looks up
+// names it has already added in between. All threads must agree on the symbols.
+//-----------------------------------------------------------------------------
+template < class TABLE >
+static unsigned SymbolBenchThread( void *pParam )
+{
+	SymbolBenchThread_t<TABLE> *pThread = (SymbolBenchThread_t<TABLE> *)pParam;
+	const CUtlVector<char *> &names = pThread->m_pNames->m_Names;
+	int nStrings = names.Count();
+	int nFirst = pThread->m_nThread * nStrings / pThread->m_nThreads;
+
+	while ( !*pThread->m_pbStart )
+	{
+		ThreadPause();
+	}
+
+	unsigned nRand = 12345 + pThread->m_nThread;
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		int iName = ( nFirst + i ) % nStrings;
+		pThread->m_pIds[iName] = pThread->m_pTable->AddString( names[iName] );
+
+		for ( int j = 0; j < pThread->m_nLookupsPerString; j++ )
+		{
+			nRand = nRand * 1664525u + 1013904223u;
+			int k = ( nFirst + ( nRand >> 8 ) % ( i + 1 ) ) % nStrings;
+			if ( pThread->m_pTable->Find( pThread->m_pNames->m_UpperNames[k] ) != pThread->m_pIds[k] )
+			{
+				pThread->m_bWrong = true;
+			}
+		}
+	}
+	return 0;
+}
+
+template < class TABLE >
+static bool RunSymbolTableThreadedPass( TABLE &table, const char *pName, const SymbolBenchNames_t &names, int nThreads, int nLookupsPerString )
+{
+	int nStrings = names.m_Names.Count();
+	CUtlVector< SymbolBenchThread_t<TABLE> > threads;
+	CUtlVector< ThreadHandle_t > handles;
+	CUtlVector< UtlSymId_t > ids;
+	threads.SetCount( nThreads );
+	handles.SetCount( nThreads );
+	ids.SetCount( nThreads * nStrings );
+
+	volatile bool bStart = false;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		SymbolBenchThread_t<TABLE> &thread = threads[i];
+		thread.m_pTable = &table;
+		thread.m_pNames = &names;
+		thread.m_pIds = &ids[i * nStrings];
+		thread.m_nThread = i;
+		thread.m_nThreads = nThreads;
+		thread.m_nLookupsPerString = nLookupsPerString;
+		thread.m_pbStart = &bStart;
+		thread.m_bWrong = false;
+		handles[i] = CreateSimpleThread( SymbolBenchThread<TABLE>, &thread );
+	}
+
+	double flStart = Plat_FloatTime();
+	bStart = true;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		ThreadJoin( handles[i] );
+		ReleaseThreadHandle( handles[i] );
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	bool bOk = true;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		bOk = bOk && !threads[i].m_bWrong;
+	}
+	for ( int k = 0; k < nStrings; k++ )
+	{
+		for ( int i = 1; i < nThreads; i++ )
+		{
+			bOk = bOk && ( ids[i * nStrings + k] == ids[k] );
+		}
+		bOk = bOk && !V_strcmp( table.String( ids[k] ), names.m_Names[k] );
+	}
+
+	double flOps = (double)nThreads * nStrings * ( nLookupsPerString + 1 );
+	Msg( "%s: %d threads, %.1f ns per add/find, %.1f ms%s\n", pName, nThreads,
+		1e9 * flElapsed * nThreads / flOps, flElapsed * 1e3, bOk ? "" : " (WRONG RESULTS)" );
+	return bOk;
+}
+
+bool RunSymbolTableBenchmark( int nThreads, int nStrings, int nLookupsPerString )
+{
+	// Leave room for the invalid symbol with 16 bit ids
+	if ( sizeof( UtlSymId_t ) == sizeof( unsigned short ) )
+	{
+		nStrings = min( nStrings, 60000 );
+	}
+
+	SymbolBenchNames_t names;
+	names.m_Names.SetCount( nStrings );
+	names.m_UpperNames.SetCount( nStrings );
+	names.m_Hashes.SetCount( nStrings );
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		char name[MAX_PATH];
+		V_snprintf( name, sizeof( name ), s_pSymbolBenchFormats[i % ARRAYSIZE( s_pSymbolBenchFormats )], i / ARRAYSIZE( s_pSymbolBenchFormats ) );
+		names.m_Names[i] = strdup( name );
+		V_strupr( name );
+		names.m_UpperNames[i] = strdup( name );
+		names.m_Hashes[i] = CUtlSymbolTable::HashString( names.m_Names[i], true );
+	}
+
+	bool bOk = true;
+	{
+		CRBTreeSymbolTable table;
+		bOk = RunSymbolTableLoadPass( table, "rbtree symbol table", names, nLookupsPerString, false ) && bOk;
+	}
+	{
+		CUtlSymbolTable table( 0, 32, true );
+		bOk = RunSymbolTableLoadPass( table, "CUtlSymbolTable", names, nLookupsPerString, false ) && bOk;
+	}
+	{
+		CUtlSymbolTable table( 0, 32, true );
+		bOk = RunSymbolTableLoadPass( table, "CUtlSymbolTable, precomputed hashes", names, nLookupsPerString, true ) && bOk;
+	}
+	{
+		CRBTreeSymbolTableLocked table;
+		bOk = RunSymbolTableThreadedPass( table, "rbtree symbol table + rwlock", names, nThreads, nLookupsPerString ) && bOk;
+	}
+	{
+		CUtlSymbolTableMT table( 0, 32, true );
+		bOk = RunSymbolTableThreadedPass( table, "CUtlSymbolTableMT", names, nThreads, nLookupsPerString ) && bOk;
+	}
+
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		free( names.m_Names[i] );
+		free( names.m_UpperNames[i] );
+	}
+	return bOk;
+}
@@ -0,0 +1,71 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs the tier1 correctness checks and benchmarks. Exits non-zero
+//			if any implementation disagreed with the one it replaced.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <stdio.h>
+#include "tier0/dbg.h"
+#include "tier0/icommandline.h"
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1bench.h"
+
+
+SpewRetval_t Tier1BenchOutputFunc( SpewType_t spewType, char const *pMsg )
+{
+	printf( "%s", pMsg );
+	fflush( stdout );
+
+	if ( spewType == SPEW_ERROR )
+		return SPEW_ABORT;
+	return ( spewType == SPEW_ASSERT ) ? SPEW_DEBUGGER : SPEW_CONTINUE;
+}
+
+static void Usage( void )
+{
+	Error( "Usage: tier1bench [-quick] [-bitbuf] [-mempool] [-symbols]\n"
+		"  Runs the named tests, or all of them. -quick runs the correctness\n"
+		"  checks with short timings, for build verification.\n" );
+	exit( -1 );
+}
+
+static bool ShouldRun( const char *pTest, bool bAll )
+{
+	return bAll || CommandLine()->CheckParm( pTest ) != NULL;
+}
+
+
+int main( int argc, char **argv )
+{
+	SpewOutputFunc( Tier1BenchOutputFunc );
+	CommandLine()->CreateCmdLine( argc, argv );
+
+	if ( CommandLine()->CheckParm( "-help" ) || CommandLine()->CheckParm( "-?" ) )
+	{
+		Usage();
+	}
+
+	bool bQuick = CommandLine()->CheckParm( "-quick" ) != NULL;
+	bool bAll = !CommandLine()->CheckParm( "-bitbuf" ) && !CommandLine()->CheckParm( "-mempool" ) &&
+		!CommandLine()->CheckParm( "-symbols" );
+
+	int nFailed = 0;
+	if ( ShouldRun( "-bitbuf", bAll ) )
+	{
+		nFailed += RunBitBufBenchmark( bQuick ? 2000 : 20000, bQuick ? 20000 : 200000 ) ? 0 : 1;
+	}
+	if ( ShouldRun( "-mempool", bAll ) )
+	{
+		nFailed += RunMemoryPoolMTBenchmark( 4, bQuick ? 100000 : 1000000 ) ? 0 : 1;
+	}
+	if ( ShouldRun( "-symbols", bAll ) )
+	{
+		nFailed += RunSymbolTableBenchmark( 4, bQuick ? 5000 : 50000 ) ? 0 : 1;
+	}
+
+	Msg( nFailed ? "tier1bench: %d test(s) FAILED\n" : "tier1bench: all tests passed\n", nFailed );
+	return nFailed ? 1 : 0;
+}
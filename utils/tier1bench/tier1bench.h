@@ -0,0 +1,43 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Correctness checks and timings for tier1 containers and streams
+//			that have a faster implementation than the code they replaced.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef TIER1BENCH_H
+#define TIER1BENCH_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Writes random messages of coords, normals, varints, strings and blocks of
+// bits, at odd bit offsets, with the bulk routines and with the field at a
+// time versions they replaced, and checks the streams and what's read back
+// are identical. Then times entity delta like messages both ways. Prints
+// results with Msg and returns false if anything differed.
+//-----------------------------------------------------------------------------
+bool RunBitBufBenchmark( int nFuzzIterations, int nMessages );
+
+//-----------------------------------------------------------------------------
+// Runs nThreads threads doing nAllocsPerThread allocs and frees each against a
+// CMemoryPoolMT and against a mutex guarded CUtlMemoryPool, and reports the time
+// per operation and the contention stats through Msg. Returns false if a block
+// was handed to two threads at once.
+//-----------------------------------------------------------------------------
+bool RunMemoryPoolMTBenchmark( int nThreads = 4, int nAllocsPerThread = 1000000, int nBlockSize = 64 );
+
+//-----------------------------------------------------------------------------
+// Times adds and lookups of level load style names (resource paths and keyvalue
+// keys, each looked up many times) in the symbol tables, against the red-black
+// tree table they replaced, on one thread and then nThreads. Prints results with
+// Msg and returns false if any table gave a wrong answer.
+//-----------------------------------------------------------------------------
+bool RunSymbolTableBenchmark( int nThreads = 4, int nStrings = 50000, int nLookupsPerString = 20 );
+
+
+#endif // TIER1BENCH_H
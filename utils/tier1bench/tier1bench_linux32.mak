@@ -0,0 +1,114 @@
+NAME=tier1bench
+SRCROOT=../..
+TARGET_PLATFORM=linux32
+TARGET_PLATFORM_EXT=
+USE_VALVE_BINDIR=0
+PWD:=$(shell pwd)
+# If no configuration is specified, "release" will be used.
+ifeq "$(CFG)" ""
+	CFG = release
+endif
+
+GCC_ExtraCompilerFlags=
+GCC_ExtraLinkerFlags=
+SymbolVisibility=hidden
+OptimizerLevel=-gdwarf-2 -g2 $(OptimizerLevel_CompilerSpecific)
+SystemLibraries=
+DLL_EXT=.so
+SYM_EXT=.dbg
+FORCEINCLUDES= 
+ifeq "$(CFG)" "debug"
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DDEBUG -D_DEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=tier1bench -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/tier1bench -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+else
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DNDEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=tier1bench -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/tier1bench -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+endif
+INCLUDEDIRS += ../../common ../../public ../../public/tier0 ../../public/tier1 ../../thirdparty/SDL2 
+CONFTYPE=exe
+OUTPUTFILE=../../../game/bin/tier1bench
+
+
+POSTBUILDCOMMAND=true
+
+
+
+CPPFILES= \
+    ../../public/tier0/memoverride.cpp \
+    bitbufbench.cpp \
+    mempoolbench.cpp \
+    symboltablebench.cpp \
+    tier1bench.cpp \
+
+
+LIBFILES = \
+    ../../lib/public/linux32/tier1.a \
+    ../../lib/public/linux32/mathlib.a \
+    -L../../lib/public/linux32 -ltier0 \
+    -L../../lib/public/linux32 -lvstdlib \
+
+
+LIBFILENAMES = \
+    ../../lib/public/linux32/libtier0.so \
+    ../../lib/public/linux32/libvstdlib.so \
+    ../../lib/public/linux32/mathlib.a \
+    ../../lib/public/linux32/tier1.a \
+
+
+# Include the base makefile now.
+include $(SRCROOT)/devtools/makefile_base_posix.mak
+
+
+
+OTHER_DEPENDENCIES = \
+
+
+$(OBJ_DIR)/_other_deps.P : $(OTHER_DEPENDENCIES)
+	$(GEN_OTHER_DEPS)
+
+-include $(OBJ_DIR)/_other_deps.P
+
+
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/memoverride.P
+endif
+
+$(OBJ_DIR)/memoverride.o : $(PWD)/../../public/tier0/memoverride.cpp $(PWD)/tier1bench_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/bitbufbench.P
+endif
+
+$(OBJ_DIR)/bitbufbench.o : $(PWD)/bitbufbench.cpp $(PWD)/tier1bench_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/mempoolbench.P
+endif
+
+$(OBJ_DIR)/mempoolbench.o : $(PWD)/mempoolbench.cpp $(PWD)/tier1bench_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/symboltablebench.P
+endif
+
+$(OBJ_DIR)/symboltablebench.o : $(PWD)/symboltablebench.cpp $(PWD)/tier1bench_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/tier1bench.P
+endif
+
+$(OBJ_DIR)/tier1bench.o : $(PWD)/tier1bench.cpp $(PWD)/tier1bench_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+
+# Runs the correctness checks; fails if an implementation disagrees with the one it replaced
+check : all
+	$(OUTPUTFILE) -quick
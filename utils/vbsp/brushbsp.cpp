@@ -9,9 +9,10 @@
 #include "vbsp.h"
 
 
-int		c_nodes;
+// c_nodes changes on any thread, so it's updated with interlocked ops
+long volatile	c_nodes;
 int		c_nonvis;
-int		c_active_brushes;
+int		c_active_brushes;	// Summed from the thread pools after each BrushBSP.
 
 // if a brush just barely pokes onto the other side,
 // let it slide by without chopping
@@ -303,6 +304,38 @@ tree_t *AllocTree (void)
 	return tree;
 }
 
+//-----------------------------------------------------------------------------
+// Node and brush pools. BuildTree_r allocates and frees brushes constantly
+// (every candidate split plane splits the node volume), so each thread keeps
+// free lists of its own instead of going through the heap, and never has to
+// lock. Whatever a thread frees goes on its own lists, whoever allocated it.
+//-----------------------------------------------------------------------------
+#define MAX_POOLED_BRUSH_SIDES	64
+
+// Brushes are allocated with this in front of them so FreeBrush knows which free list they go on.
+struct BrushPoolHeader_t
+{
+	int					m_nMaxSides;
+	BrushPoolHeader_t	*m_pNext;
+};
+
+struct BspThreadPool_t
+{
+	BrushPoolHeader_t	*m_pFreeBrushes[MAX_POOLED_BRUSH_SIDES+1];
+	node_t				*m_pFreeNodes;
+	CUtlVector<int>		m_PlaneMarks;	// Planes SelectSplitSide has tried, marked with m_nPlaneMark.
+	int					m_nPlaneMark;
+	int					m_nNodes;		// Nodes BuildTree_r processed on this thread.
+	int					m_nNonVis;		// Of those, the ones split by a nonvisible side.
+	int					m_nActiveBrushes;	// Allocated minus freed on this thread; can go negative.
+	char				m_Pad[64];		// Keep threads off each other's cache lines.
+};
+
+static BspThreadPool_t	s_ThreadPools[MAX_TOOL_THREADS+1];
+static long volatile	s_NodeCount = 0;
+static long volatile	s_BrushId = 0;
+
+
 /*
 ================
 AllocNode
@@ -310,20 +343,35 @@ AllocNode
 */
 node_t *AllocNode (void)
 {
-	static int s_NodeCount = 0;
+	BspThreadPool_t &pool = s_ThreadPools[GetThreadIndex()];
 
 	node_t	*node;
 
-	node = (node_t*)malloc(sizeof(*node));
+	node = pool.m_pFreeNodes;
+	if (node)
+		pool.m_pFreeNodes = node->parent;
+	else
+		node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = ThreadInterlockedIncrement( &s_NodeCount ) - 1;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
+/*
+================
+FreeNode
+================
+*/
+void FreeNode (node_t *node)
+{
+	BspThreadPool_t &pool = s_ThreadPools[GetThreadIndex()];
+
+	node->parent = pool.m_pFreeNodes;
+	pool.m_pFreeNodes = node;
+}
+
 
 /*
 ================
@@ -332,17 +380,27 @@ AllocBrush
 */
 bspbrush_t *AllocBrush (int numsides)
 {
-	static int s_BrushId = 0;
+	BspThreadPool_t &pool = s_ThreadPools[GetThreadIndex()];
 
+	BrushPoolHeader_t	*pHeader;
 	bspbrush_t	*bb;
 	int			c;
 
 	c = (int)&(((bspbrush_t *)0)->sides[numsides]);
-	bb = (bspbrush_t*)malloc(c);
+	if (numsides <= MAX_POOLED_BRUSH_SIDES && pool.m_pFreeBrushes[numsides])
+	{
+		pHeader = pool.m_pFreeBrushes[numsides];
+		pool.m_pFreeBrushes[numsides] = pHeader->m_pNext;
+	}
+	else
+	{
+		pHeader = (BrushPoolHeader_t*)malloc(sizeof(BrushPoolHeader_t) + c);
+		pHeader->m_nMaxSides = numsides;
+	}
+	bb = (bspbrush_t*)(pHeader + 1);
 	memset (bb, 0, c);
-	bb->id = s_BrushId++;
-	if (numthreads == 1)
-		c_active_brushes++;
+	bb->id = ThreadInterlockedIncrement( &s_BrushId ) - 1;
+	pool.m_nActiveBrushes++;
 	return bb;
 }
 
@@ -353,14 +411,25 @@ FreeBrush
 */
 void FreeBrush (bspbrush_t *brushes)
 {
+	BspThreadPool_t &pool = s_ThreadPools[GetThreadIndex()];
+
 	int			i;
 
 	for (i=0 ; i<brushes->numsides ; i++)
 		if (brushes->sides[i].winding)
 			FreeWinding(brushes->sides[i].winding);
-	free (brushes);
-	if (numthreads == 1)
-		c_active_brushes--;
+
+	BrushPoolHeader_t *pHeader = (BrushPoolHeader_t*)brushes - 1;
+	if (pHeader->m_nMaxSides <= MAX_POOLED_BRUSH_SIDES)
+	{
+		pHeader->m_pNext = pool.m_pFreeBrushes[pHeader->m_nMaxSides];
+		pool.m_pFreeBrushes[pHeader->m_nMaxSides] = pHeader;
+	}
+	else
+	{
+		free (pHeader);
+	}
+	pool.m_nActiveBrushes--;
 }
 
 
@@ -839,6 +908,158 @@ qboolean CheckPlaneAgainstVolume (int pnum, node_t *node)
 	return good;
 }
 
+/*
+================
+EvaluateSplitPlane
+
+Gives a value estimate for splitting the brushes with side's plane.
+Returns false if the plane would produce a tiny volume.
+Doesn't touch the brushes, so it can run on several planes at once.
+================
+*/
+static qboolean EvaluateSplitPlane (bspbrush_t *brushes, node_t *node, side_t *side, int pnum, int *pValue)
+{
+	int			value;
+	bspbrush_t	*test;
+	int			s;
+	int			front, back, both, facing, splits;
+	int			bsplits;
+	int			epsilonbrush;
+	qboolean	hintsplit = false;
+
+	CheckPlaneAgainstParents (pnum, node);
+
+	if (!CheckPlaneAgainstVolume (pnum, node))
+		return false;	// would produce a tiny volume
+
+	front = 0;
+	back = 0;
+	both = 0;
+	facing = 0;
+	splits = 0;
+	epsilonbrush = 0;
+
+	for (test = brushes ; test ; test=test->next)
+	{
+		s = TestBrushToPlanenum (test, pnum, &bsplits, &hintsplit, &epsilonbrush);
+
+		splits += bsplits;
+		if (bsplits && (s&PSIDE_FACING) )
+			Error ("PSIDE_FACING with splits");
+
+		if (s & PSIDE_FACING)
+			facing++;
+		if (s & PSIDE_FRONT)
+			front++;
+		if (s & PSIDE_BACK)
+			back++;
+		if (s == PSIDE_BOTH)
+			both++;
+	}
+
+	// give a value estimate for using this plane
+	value =  5*facing - 5*splits - abs(front-back);
+//	value =  -5*splits;
+//	value =  5*facing - 5*splits;
+	if (g_MainMap->mapplanes[pnum].type < 3)
+		value+=5;		// axial is better
+	value -= epsilonbrush*1000;	// avoid!
+
+	// trans should split last
+	if ( side->surf & SURF_TRANS )
+	{
+		value -= 500;
+	}
+
+	// never split a hint side except with another hint
+	if (hintsplit && !(side->surf & SURF_HINT) )
+		value = -9999999;
+
+	// water should split first
+	if (side->contents & (CONTENTS_WATER | CONTENTS_SLIME))
+		value = 9999999;
+
+	*pValue = value;
+	return true;
+}
+
+
+struct SplitCandidate_t
+{
+	side_t		*m_pSide;
+	int			m_nPlane;
+	int			m_nValue;
+	qboolean	m_bValid;
+};
+
+struct SplitSearch_t
+{
+	bspbrush_t			*m_pBrushes;
+	node_t				*m_pNode;
+	SplitCandidate_t	*m_pCandidates;
+	int					m_nCandidates;
+	long volatile		m_nNextCandidate;
+};
+
+// Splits near the top of the tree test this many brushes against planes or more,
+// so SelectSplitSide spreads the planes across the threads when it can.
+#define MIN_THREADED_SPLIT_TESTS	(1 << 16)
+
+// While BuildTreeThreaded splits the top of the tree on one of its threads, the
+// others wait in BuildTree_Thread and help with whatever search is posted here.
+static int						s_iSplitThread = -1;	// The thread that may post searches
+static void * volatile			s_pSharedSearch = NULL;
+static long volatile			s_nSearchHelpers = 0;	// Threads that may be looking at s_pSharedSearch
+
+static void EvaluateSplitPlanes_Thread (int iThread, void *pUserData)
+{
+	SplitSearch_t *pSearch = (SplitSearch_t*)pUserData;
+	while (1)
+	{
+		int i = ThreadInterlockedIncrement (&pSearch->m_nNextCandidate) - 1;
+		if (i >= pSearch->m_nCandidates)
+			break;
+
+		SplitCandidate_t &candidate = pSearch->m_pCandidates[i];
+		candidate.m_bValid = EvaluateSplitPlane (pSearch->m_pBrushes, pSearch->m_pNode,
+			candidate.m_pSide, candidate.m_nPlane, &candidate.m_nValue);
+	}
+}
+
+// Evaluates the search's planes on this thread and on any threads waiting to help.
+static void EvaluateSplitPlanesShared (int iThread, SplitSearch_t *pSearch)
+{
+	ThreadInterlockedExchangePointer (&s_pSharedSearch, pSearch);
+	EvaluateSplitPlanes_Thread (iThread, pSearch);
+
+	// nobody new can pick the search up once it's withdrawn, so once the threads
+	// that already had it are done, every plane has been evaluated
+	ThreadInterlockedExchangePointer (&s_pSharedSearch, NULL);
+	while (s_nSearchHelpers)
+	{
+		ThreadPause ();
+	}
+	ThreadMemoryBarrier ();
+}
+
+// Called in a loop by threads that are waiting for BuildTreeThreaded's subtrees.
+static void HelpEvaluateSplitPlanes (int iThread)
+{
+	if (!s_pSharedSearch)
+	{
+		ThreadPause ();
+		return;
+	}
+
+	ThreadInterlockedIncrement (&s_nSearchHelpers);
+	SplitSearch_t *pSearch = (SplitSearch_t*)s_pSharedSearch;
+	if (pSearch)
+	{
+		EvaluateSplitPlanes_Thread (iThread, pSearch);
+	}
+	ThreadInterlockedDecrement (&s_nSearchHelpers);
+}
+
 /*
 ================
 SelectSplitSide
@@ -851,21 +1072,35 @@ Returns NULL if there are no valid planes to split with..
 
 side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 {
-	int			value, bestvalue;
+	BspThreadPool_t &pool = s_ThreadPools[GetThreadIndex()];
+
+	int			bestvalue;
 	bspbrush_t	*brush, *test;
 	side_t		*side, *bestside;
-	int			i, j, pass, numpasses;
+	int			i, pass, numpasses;
 	int			pnum;
-	int			s;
-	int			front, back, both, facing, splits;
+	int			nBrushes;
+	int			nFirst;
 	int			bsplits;
-	int			bestsplits;
 	int			epsilonbrush;
-	qboolean	hintsplit = false;
+	qboolean	hintsplit;
+	CUtlVector<SplitCandidate_t> candidates;
 
 	bestside = NULL;
 	bestvalue = -99999;
-	bestsplits = 0;
+
+	// Only the first side on each plane gets tried. Once a plane has been
+	// tested every side on it is facing one of the brushes, so it gets
+	// flagged as tested and skipped from then on.
+	if (pool.m_PlaneMarks.Count() < g_MainMap->nummapplanes)
+	{
+		int nOldCount = pool.m_PlaneMarks.Count();
+		pool.m_PlaneMarks.SetCount (g_MainMap->nummapplanes);
+		memset (pool.m_PlaneMarks.Base() + nOldCount, 0, (g_MainMap->nummapplanes - nOldCount) * sizeof(int));
+	}
+	int nMark = ++pool.m_nPlaneMark;
+
+	nBrushes = CountBrushList (brushes);
 
 	// the search order goes: visible-structural, nonvisible-structural
 	// If any valid plane is available in a pass, no further
@@ -873,6 +1108,7 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 	numpasses = 2;
 	for (pass = 0 ; pass < numpasses ; pass++)
 	{
+		nFirst = candidates.Count();
 		for (brush = brushes ; brush ; brush=brush->next)
 		{
 			for (i=0 ; i<brush->numsides ; i++)
@@ -895,79 +1131,40 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 				pnum = side->planenum;
 				pnum &= ~1;	// allways use positive facing plane
 
-				CheckPlaneAgainstParents (pnum, node);
-
-				if (!CheckPlaneAgainstVolume (pnum, node))
-					continue;	// would produce a tiny volume
-
-				front = 0;
-				back = 0;
-				both = 0;
-				facing = 0;
-				splits = 0;
-				epsilonbrush = 0;
-
-				for (test = brushes ; test ; test=test->next)
-				{
-					s = TestBrushToPlanenum (test, pnum, &bsplits, &hintsplit, &epsilonbrush);
-
-					splits += bsplits;
-					if (bsplits && (s&PSIDE_FACING) )
-						Error ("PSIDE_FACING with splits");
-
-					test->testside = s;
-					// if the brush shares this face, don't bother
-					// testing that facenum as a splitter again
-					if (s & PSIDE_FACING)
-					{
-						facing++;
-						for (j=0 ; j<test->numsides ; j++)
-						{
-							if ( (test->sides[j].planenum&~1) == pnum)
-								test->sides[j].tested = true;
-						}
-					}
-					if (s & PSIDE_FRONT)
-						front++;
-					if (s & PSIDE_BACK)
-						back++;
-					if (s == PSIDE_BOTH)
-						both++;
-				}
-
-				// give a value estimate for using this plane
-				value =  5*facing - 5*splits - abs(front-back);
-//					value =  -5*splits;
-//					value =  5*facing - 5*splits;
-				if (g_MainMap->mapplanes[pnum].type < 3)
-					value+=5;		// axial is better
-				value -= epsilonbrush*1000;	// avoid!
-
-				// trans should split last
-				if ( side->surf & SURF_TRANS )
-				{
-					value -= 500;
-				}
-
-				// never split a hint side except with another hint
-				if (hintsplit && !(side->surf & SURF_HINT) )
-					value = -9999999;
-
-				// water should split first
-				if (side->contents & (CONTENTS_WATER | CONTENTS_SLIME))
-					value = 9999999;
-
-				// save off the side test so we don't need
-				// to recalculate it when we actually seperate
-				// the brushes
-				if (value > bestvalue)
-				{
-					bestvalue = value;
-					bestside = side;
-					bestsplits = splits;
-					for (test = brushes ; test ; test=test->next)
-						test->side = test->testside;
-				}
+				if (pool.m_PlaneMarks[pnum] == nMark)
+					continue;
+				pool.m_PlaneMarks[pnum] = nMark;
+
+				SplitCandidate_t &candidate = candidates[ candidates.AddToTail() ];
+				candidate.m_pSide = side;
+				candidate.m_nPlane = pnum;
+			}
+		}
+
+		SplitSearch_t search;
+		search.m_pBrushes = brushes;
+		search.m_pNode = node;
+		search.m_pCandidates = candidates.Base() + nFirst;
+		search.m_nCandidates = candidates.Count() - nFirst;
+		search.m_nNextCandidate = 0;
+
+		if (GetThreadIndex() == s_iSplitThread &&
+			search.m_nCandidates * nBrushes >= MIN_THREADED_SPLIT_TESTS)
+		{
+			EvaluateSplitPlanesShared (GetThreadIndex(), &search);
+		}
+		else
+		{
+			EvaluateSplitPlanes_Thread (GetThreadIndex(), &search);
+		}
+
+		// take the first of the best planes, the same one the serial search would
+		for (i=nFirst ; i<candidates.Count() ; i++)
+		{
+			if (candidates[i].m_bValid && candidates[i].m_nValue > bestvalue)
+			{
+				bestvalue = candidates[i].m_nValue;
+				bestside = candidates[i].m_pSide;
 			}
 		}
 
@@ -976,16 +1173,27 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 		if (bestside)
 		{
 			if (pass > 0)
-			{
-				if (numthreads == 1)
-					c_nonvis++;
-			}
+				pool.m_nNonVis++;
 			break;
 		}
 	}
 
+	// save off the side test so we don't need
+	// to recalculate it when we actually seperate
+	// the brushes
+	if (bestside)
+	{
+		pnum = bestside->planenum & ~1;
+		epsilonbrush = 0;
+		for (test = brushes ; test ; test=test->next)
+		{
+			test->testside = TestBrushToPlanenum (test, pnum, &bsplits, &hintsplit, &epsilonbrush);
+			test->side = test->testside;
+		}
+	}
+
 	//
-	// clear all the tested flags we set
+	// clear all the tested flags
 	//
 	for (brush = brushes ; brush ; brush=brush->next)
 	{
@@ -1326,20 +1534,20 @@ void SplitBrushList (bspbrush_t *brushes,
 
 /*
 ================
-BuildTree_r
+SplitNode
+
+Picks a plane to split the node with and splits the brushes
+and the node volume between two new children.
+Returns false if the node is a leaf.
 ================
 */
-
-
-node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+static qboolean SplitNode (node_t *node, bspbrush_t *brushes, bspbrush_t *children[2])
 {
 	node_t		*newnode;
 	side_t		*bestside;
 	int			i;
-	bspbrush_t	*children[2];
 
-	if (numthreads == 1)
-		c_nodes++;
+	s_ThreadPools[GetThreadIndex()].m_nNodes++;
 
 	// find the best plane to use as a splitter
 	bestside = SelectSplitSide (brushes, node);
@@ -1350,7 +1558,7 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 		node->side = NULL;
 		node->planenum = -1;
 		LeafNode (node, brushes);
-		return node;
+		return false;
 	}
 			 
 	// this is a splitplane node
@@ -1371,6 +1579,25 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	SplitBrush (node->volume, node->planenum, &node->children[0]->volume,
 		&node->children[1]->volume);
 
+	return true;
+}
+
+
+/*
+================
+BuildTree_r
+================
+*/
+
+
+node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+{
+	int			i;
+	bspbrush_t	*children[2];
+
+	if (!SplitNode (node, brushes, children))
+		return node;
+
 	// recursively process children
 	for (i=0 ; i<2 ; i++)
 	{
@@ -1379,6 +1606,133 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 
 	return node;
 }
+
+
+//-----------------------------------------------------------------------------
+// Threaded tree building. One thread splits the top of the tree, with
+// SelectSplitSide spreading the planes across the other threads while they
+// wait, until there are enough subtrees to keep every thread busy. Then the
+// subtrees are built in parallel. A node only depends on its brushes, its
+// volume and its parents, so the tree comes out the same whichever thread
+// builds which part of it.
+//-----------------------------------------------------------------------------
+#define SUBTREES_PER_THREAD		8
+#define MIN_SUBTREE_BRUSHES		32		// Smaller subtrees aren't worth splitting up any further.
+
+struct BuildTreeTask_t
+{
+	node_t		*m_pNode;
+	bspbrush_t	*m_pBrushes;
+	int			m_nBrushes;
+};
+
+struct BuildTreeTasks_t
+{
+	CUtlVector<BuildTreeTask_t>	m_Tasks;
+	long volatile				m_nNextTask;
+	long volatile				m_bTasksReady;	// Set once the top of the tree is split
+};
+
+static int CompareBuildTreeTasks (const void *a, const void *b)
+{
+	// biggest first
+	return ((BuildTreeTask_t const *)b)->m_nBrushes - ((BuildTreeTask_t const *)a)->m_nBrushes;
+}
+
+// Splits the biggest subtree until there are enough to go around.
+static void SplitTopOfTree (BuildTreeTasks_t *pTasks)
+{
+	CUtlVector<BuildTreeTask_t> &tasks = pTasks->m_Tasks;
+	bspbrush_t	*children[2];
+	int			i;
+
+	while (tasks.Count() < numthreads * SUBTREES_PER_THREAD)
+	{
+		int iBiggest = -1;
+		for (i=0 ; i<tasks.Count() ; i++)
+		{
+			if (iBiggest < 0 || tasks[i].m_nBrushes > tasks[iBiggest].m_nBrushes)
+				iBiggest = i;
+		}
+		if (iBiggest < 0 || tasks[iBiggest].m_nBrushes < MIN_SUBTREE_BRUSHES)
+			break;
+
+		BuildTreeTask_t task = tasks[iBiggest];
+		tasks.FastRemove (iBiggest);
+		if (!SplitNode (task.m_pNode, task.m_pBrushes, children))
+			continue;
+
+		for (i=0 ; i<2 ; i++)
+		{
+			BuildTreeTask_t &child = tasks[ tasks.AddToTail() ];
+			child.m_pNode = task.m_pNode->children[i];
+			child.m_pBrushes = children[i];
+			child.m_nBrushes = CountBrushList (children[i]);
+		}
+	}
+
+	qsort (tasks.Base(), tasks.Count(), sizeof(BuildTreeTask_t), CompareBuildTreeTasks);
+}
+
+static void BuildTree_Thread (int iThread, void *pUserData)
+{
+	BuildTreeTasks_t *pTasks = (BuildTreeTasks_t*)pUserData;
+
+	if (iThread == s_iSplitThread)
+	{
+		SplitTopOfTree (pTasks);
+		ThreadInterlockedExchange (&pTasks->m_bTasksReady, 1);
+	}
+	else
+	{
+		while (!pTasks->m_bTasksReady)
+		{
+			HelpEvaluateSplitPlanes (iThread);
+		}
+		ThreadMemoryBarrier ();
+	}
+
+	while (1)
+	{
+		int i = ThreadInterlockedIncrement (&pTasks->m_nNextTask) - 1;
+		if (i >= pTasks->m_Tasks.Count())
+			break;
+
+		BuildTree_r (pTasks->m_Tasks[i].m_pNode, pTasks->m_Tasks[i].m_pBrushes);
+	}
+}
+
+static void BuildTreeThreaded (node_t *headnode, bspbrush_t *brushes)
+{
+	BuildTreeTasks_t	tasks;
+
+	BuildTreeTask_t &head = tasks.m_Tasks[ tasks.m_Tasks.AddToTail() ];
+	head.m_pNode = headnode;
+	head.m_pBrushes = brushes;
+	head.m_nBrushes = CountBrushList (brushes);
+	tasks.m_nNextTask = 0;
+	tasks.m_bTasksReady = 0;
+
+	// one set of threads for the whole tree: thread 0 splits the top while the
+	// rest help it pick planes, then they all build subtrees
+	s_iSplitThread = 0;
+	RunThreads_Start (BuildTree_Thread, &tasks);
+	RunThreads_End ();
+	s_iSplitThread = -1;
+}
+
+
+// Gives the nodes under node the ids they would have gotten from a serial build.
+static void NumberNodes_r (node_t *node, int *pNextId)
+{
+	if (node->planenum == PLANENUM_LEAF)
+		return;
+
+	node->children[0]->id = (*pNextId)++;
+	node->children[1]->id = (*pNextId)++;
+	NumberNodes_r (node->children[0], pNextId);
+	NumberNodes_r (node->children[1], pNextId);
+}
 	  
 
 //===========================================================
@@ -1439,18 +1793,43 @@ tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
 	qprintf ("%5i visible faces\n", c_faces);
 	qprintf ("%5i nonvisible faces\n", c_nonvisfaces);
 
-	c_nodes = 0;
-	c_nonvis = 0;
+	for (i=0 ; i<ARRAYSIZE(s_ThreadPools) ; i++)
+	{
+		s_ThreadPools[i].m_nNodes = 0;
+		s_ThreadPools[i].m_nNonVis = 0;
+	}
 	node = AllocNode ();
 
 	node->volume = BrushFromBounds (mins, maxs);
 
 	tree->headnode = node;
 
-	node = BuildTree_r (node, brushlist);
-	qprintf ("%5i visible nodes\n", c_nodes/2 - c_nonvis);
+	if (numthreads > 1)
+	{
+		BuildTreeThreaded (node, brushlist);
+
+		// the threads handed out node ids in whatever order they got to them
+		int nNextId = node->id + 1;
+		NumberNodes_r (node, &nNextId);
+	}
+	else
+	{
+		node = BuildTree_r (node, brushlist);
+	}
+
+	int nNodes = 0;
+	c_nonvis = 0;
+	c_active_brushes = 0;
+	for (i=0 ; i<ARRAYSIZE(s_ThreadPools) ; i++)
+	{
+		nNodes += s_ThreadPools[i].m_nNodes;
+		c_nonvis += s_ThreadPools[i].m_nNonVis;
+		c_active_brushes += s_ThreadPools[i].m_nActiveBrushes;
+	}
+	c_nodes = nNodes;
+	qprintf ("%5i visible nodes\n", nNodes/2 - c_nonvis);
 	qprintf ("%5i nonvis nodes\n", c_nonvis);
-	qprintf ("%5i leafs\n", (c_nodes+1)/2);
+	qprintf ("%5i leafs\n", (nNodes+1)/2);
 #if 0
 {	// debug code
 static node_t	*tnode;
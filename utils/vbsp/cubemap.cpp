@@ -13,6 +13,9 @@
 #include <KeyValues.h>
 #include "tier1/strtools.h"
 #include "tier1/utlsymbol.h"
+#include "tier1/utldict.h"
+#include "tier1/utlmap.h"
+#include "tier1/utlstring.h"
 #include "vtf/vtf.h"
 #include "materialpatch.h"
 #include "materialsystem/imaterialsystem.h"
@@ -66,6 +69,7 @@ typedef CUtlVector<int> IntVector_t;
 static CUtlVector<IntVector_t> s_EnvCubemapToBrushSides;
 
 static CUtlVector<char *> s_DefaultCubemapNames;
+static CUtlDict<int, int> s_DefaultCubemapNameIndex( k_eDictCompareTypeFilenames );
 static char g_IsCubemapTexData[MAX_MAP_TEXDATA];
 
 
@@ -526,6 +530,38 @@ static void GeneratePatchedName( const char *pMaterialName, const PatchInfo_t &i
 }
 
 
+//-----------------------------------------------------------------------------
+// What PatchEnvmapForMaterialAndDependents needs to know about a material. The
+// same materials get patched for every cubemap, so this is only read from the
+// .vmt the first time.
+//-----------------------------------------------------------------------------
+struct EnvmapPatchMaterial_t
+{
+	bool m_bHasEnvCubemap;
+	CUtlString m_DependentMaterial;			// empty if there isn't one
+	const char *m_pDependentMaterialVar;
+};
+
+static CUtlDict<EnvmapPatchMaterial_t, int> s_EnvmapPatchMaterials( k_eDictCompareTypeFilenames );
+
+static void FindEnvmapPatchMaterial( const char *pMaterialName, EnvmapPatchMaterial_t &material )
+{
+	int nIndex = s_EnvmapPatchMaterials.Find( pMaterialName );
+	if ( nIndex != s_EnvmapPatchMaterials.InvalidIndex() )
+	{
+		material = s_EnvmapPatchMaterials[nIndex];
+		return;
+	}
+
+	material.m_bHasEnvCubemap = DoesMaterialHaveKeyValuePair( pMaterialName, "$envmap", "env_cubemap" );
+	material.m_pDependentMaterialVar = NULL;
+	const char *pDependentMaterial = FindDependentMaterial( pMaterialName, &material.m_pDependentMaterialVar );
+	material.m_DependentMaterial = pDependentMaterial ? pDependentMaterial : "";
+
+	s_EnvmapPatchMaterials.Insert( pMaterialName, material );
+}
+
+
 //-----------------------------------------------------------------------------
 // Patches the $envmap for a material and all its dependents, returns true if any patching happened
 //-----------------------------------------------------------------------------
@@ -539,12 +575,14 @@ static bool PatchEnvmapForMaterialAndDependents( const char *pMaterialName, cons
 	// a specific non-env_cubemap $envmap to the source material at a later point. Bleah
 
 	// See if we have an $envmap to patch
-	bool bShouldPatchEnvCubemap = DoesMaterialHaveKeyValuePair( pMaterialName, "$envmap", "env_cubemap" );
+	EnvmapPatchMaterial_t material;
+	FindEnvmapPatchMaterial( pMaterialName, material );
+	bool bShouldPatchEnvCubemap = material.m_bHasEnvCubemap;
 
 	// See if we have a dependent material to patch
 	bool bDependentMaterialPatched = false;
-	const char *pDependentMaterialVar = NULL;
-	const char *pDependentMaterial = FindDependentMaterial( pMaterialName, &pDependentMaterialVar );
+	const char *pDependentMaterialVar = material.m_pDependentMaterialVar;
+	const char *pDependentMaterial = material.m_DependentMaterial.IsEmpty() ? NULL : material.m_DependentMaterial.Get();
 	if ( pDependentMaterial )
 	{
 		bDependentMaterialPatched = PatchEnvmapForMaterialAndDependents( pDependentMaterial, info, pCubemapTexture );
@@ -585,6 +623,24 @@ static bool PatchEnvmapForMaterialAndDependents( const char *pMaterialName, cons
 }
 
 
+//-----------------------------------------------------------------------------
+// Adds the .vtf for an $envmap texture to the cubemaps that get a copy of the
+// default cubemap, unless it's already there.
+//-----------------------------------------------------------------------------
+static void AddDefaultCubemapName( const char *pTextureName )
+{
+	char pFileName[1024];
+	int nLen = Q_snprintf( pFileName, 1024, "materials/%s.vtf", pTextureName );
+	if ( s_DefaultCubemapNameIndex.Find( pFileName ) != s_DefaultCubemapNameIndex.InvalidIndex() )
+		return;
+
+	int id = s_DefaultCubemapNames.AddToTail();
+	s_DefaultCubemapNames[id] = new char[ nLen + 1 ];
+	strcpy( s_DefaultCubemapNames[id], pFileName );
+	s_DefaultCubemapNameIndex.Insert( pFileName, id );
+}
+
+
 //-----------------------------------------------------------------------------
 // Finds a texinfo that has a particular 
 //-----------------------------------------------------------------------------
@@ -645,11 +701,7 @@ static int Cubemap_CreateTexInfo( int originalTexInfo, int origin[3] )
 			return originalTexInfo;
 		
 		// Store off the name of the cubemap that we need to create since we successfully patched
-		char pFileName[1024];
-		int nLen = Q_snprintf( pFileName, 1024, "materials/%s.vtf", pTextureName );
-		int id = s_DefaultCubemapNames.AddToTail();
-		s_DefaultCubemapNames[id] = new char[ nLen + 1 ];
-		strcpy( s_DefaultCubemapNames[id], pFileName );
+		AddDefaultCubemapName( pTextureName );
 
 		// Make a new texdata
 		nTexDataID = AddCloneTexData( pTexData, pGeneratedTexDataName );
@@ -682,17 +734,32 @@ static int Cubemap_CreateTexInfo( int originalTexInfo, int origin[3] )
 	return nTexInfoID;
 }
 
-static int SideIDToIndex( int brushSideID )
+//-----------------------------------------------------------------------------
+// Brush side ids to indices, for the sides env_cubemaps reference
+//-----------------------------------------------------------------------------
+static CUtlMap<int, int> s_SideIDToIndex( DefLessFunc( int ) );
+
+static void BuildSideIDToIndexMap( void )
 {
-	int i;
-	for( i = 0; i < g_MainMap->nummapbrushsides; i++ )
+	s_SideIDToIndex.RemoveAll();
+	for( int i = 0; i < g_MainMap->nummapbrushsides; i++ )
 	{
-		if( g_MainMap->brushsides[i].id == brushSideID )
+		// Keep the first side with each id
+		int id = g_MainMap->brushsides[i].id;
+		if ( s_SideIDToIndex.Find( id ) == s_SideIDToIndex.InvalidIndex() )
 		{
-			return i;
+			s_SideIDToIndex.Insert( id, i );
 		}
 	}
-	return -1;
+}
+
+static int SideIDToIndex( int brushSideID )
+{
+	int nIndex = s_SideIDToIndex.Find( brushSideID );
+	if ( nIndex == s_SideIDToIndex.InvalidIndex() )
+		return -1;
+
+	return s_SideIDToIndex[nIndex];
 }
 
 
@@ -705,6 +772,9 @@ void Cubemap_FixupBrushSidesMaterials( void )
 	Msg( "fixing up env_cubemap materials on brush sides...\n" );
 	Assert( s_EnvCubemapToBrushSides.Count() == g_nCubemapSamples );
 
+	BuildSideIDToIndexMap();
+	BeginDeferredMaterialPatches();
+
 	int cubemapID;
 	for( cubemapID = 0; cubemapID < g_nCubemapSamples; cubemapID++ )
 	{
@@ -738,6 +808,8 @@ void Cubemap_FixupBrushSidesMaterials( void )
 			}
 		}
 	}
+
+	FlushMaterialPatches();
 }
 
 
@@ -815,6 +887,7 @@ void Cubemap_InitCubemapSideData( void )
 	}
 
 	// Fill in cube map data.
+	BuildSideIDToIndexMap();
 	for ( int iCubemap = 0; iCubemap < g_nCubemapSamples; ++iCubemap )
 	{
 		IntVector_t &sideList = s_EnvCubemapToBrushSides[iCubemap];
@@ -832,8 +905,143 @@ void Cubemap_InitCubemapSideData( void )
 }
 
 //-----------------------------------------------------------------------------
+// A kd-tree over the cubemap samples for finding the closest one to a side. It's
+// stored implicitly: the range [lo,hi) of s_CubemapKDOrder is split at its middle
+// element on s_CubemapKDAxis[mid], with [lo,mid) below and (mid,hi) above it.
 //-----------------------------------------------------------------------------
-int Cubemap_FindClosestCubemap( const Vector &entityOrigin, side_t *pSide )
+static CUtlVector<int> s_CubemapKDOrder;
+static CUtlVector<int> s_CubemapKDAxis;
+
+static int s_nCubemapKDSortAxis;
+
+static int __cdecl CubemapKDCompare( const void *pA, const void *pB )
+{
+	int iA = *(const int *)pA;
+	int iB = *(const int *)pB;
+	int a = g_CubemapSamples[iA].origin[s_nCubemapKDSortAxis];
+	int b = g_CubemapSamples[iB].origin[s_nCubemapKDSortAxis];
+	if ( a != b )
+		return ( a < b ) ? -1 : 1;
+	return iA - iB;
+}
+
+static void BuildCubemapKDTree_r( int lo, int hi )
+{
+	if ( lo >= hi )
+		return;
+
+	int mins[3] = { INT_MAX, INT_MAX, INT_MAX };
+	int maxs[3] = { INT_MIN, INT_MIN, INT_MIN };
+	for ( int i = lo; i < hi; ++i )
+	{
+		const dcubemapsample_t &sample = g_CubemapSamples[ s_CubemapKDOrder[i] ];
+		for ( int j = 0; j < 3; ++j )
+		{
+			if ( sample.origin[j] < mins[j] )
+				mins[j] = sample.origin[j];
+			if ( sample.origin[j] > maxs[j] )
+				maxs[j] = sample.origin[j];
+		}
+	}
+
+	int nAxis = 0;
+	for ( int j = 1; j < 3; ++j )
+	{
+		if ( maxs[j] - mins[j] > maxs[nAxis] - mins[nAxis] )
+		{
+			nAxis = j;
+		}
+	}
+
+	s_nCubemapKDSortAxis = nAxis;
+	qsort( &s_CubemapKDOrder[lo], hi - lo, sizeof( int ), CubemapKDCompare );
+
+	int mid = ( lo + hi ) / 2;
+	s_CubemapKDAxis[mid] = nAxis;
+	BuildCubemapKDTree_r( lo, mid );
+	BuildCubemapKDTree_r( mid + 1, hi );
+}
+
+static void BuildCubemapKDTree( void )
+{
+	s_CubemapKDOrder.SetCount( g_nCubemapSamples );
+	s_CubemapKDAxis.SetCount( g_nCubemapSamples );
+	for ( int i = 0; i < g_nCubemapSamples; ++i )
+	{
+		s_CubemapKDOrder[i] = i;
+	}
+	BuildCubemapKDTree_r( 0, g_nCubemapSamples );
+}
+
+
+struct ClosestCubemapSearch_t
+{
+	Vector m_vecCenter;
+	const Vector *m_pFrontNormal;	// Only take cubemaps in front of this, if set
+	float m_flMinDist;
+	int m_iMinCubemap;
+};
+
+static void FindClosestCubemap_r( int lo, int hi, ClosestCubemapSearch_t &search )
+{
+	if ( lo >= hi )
+		return;
+
+	int mid = ( lo + hi ) / 2;
+	int iCubemap = s_CubemapKDOrder[mid];
+	dcubemapsample_t *pSample = &g_CubemapSamples[iCubemap];
+	Vector vecSampleOrigin( static_cast<float>( pSample->origin[0] ),
+							static_cast<float>( pSample->origin[1] ),
+							static_cast<float>( pSample->origin[2] ) );
+	Vector vecDelta;
+	VectorSubtract( vecSampleOrigin, search.m_vecCenter, vecDelta );
+
+	// Measure it the same way the brute force search did, so the same cubemap wins
+	// (ties go to the lowest index)
+	float flDist;
+	bool bCandidate = true;
+	if ( search.m_pFrontNormal )
+	{
+		flDist = vecDelta.NormalizeInPlace();
+		bCandidate = ( DotProduct( vecDelta, *search.m_pFrontNormal ) >= 0.0f );
+	}
+	else
+	{
+		flDist = vecDelta.Length();
+	}
+
+	if ( bCandidate && ( ( flDist < search.m_flMinDist ) || ( flDist == search.m_flMinDist && iCubemap < search.m_iMinCubemap ) ) )
+	{
+		search.m_flMinDist = flDist;
+		search.m_iMinCubemap = iCubemap;
+	}
+
+	int nAxis = s_CubemapKDAxis[mid];
+	float flPlaneDist = search.m_vecCenter[nAxis] - vecSampleOrigin[nAxis];
+	if ( flPlaneDist < 0.0f )
+	{
+		FindClosestCubemap_r( lo, mid, search );
+		if ( -flPlaneDist <= search.m_flMinDist + 1.0f )
+		{
+			FindClosestCubemap_r( mid + 1, hi, search );
+		}
+	}
+	else
+	{
+		FindClosestCubemap_r( mid + 1, hi, search );
+		if ( flPlaneDist <= search.m_flMinDist + 1.0f )
+		{
+			FindClosestCubemap_r( lo, mid, search );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Needs the kd-tree built by BuildCubemapKDTree. Only reads shared data, so it
+// can be called on several threads at once.
+//-----------------------------------------------------------------------------
+static int Cubemap_FindClosestCubemap( const Vector &entityOrigin, side_t *pSide )
 {
 	if ( !pSide )
 		return -1;
@@ -854,49 +1062,39 @@ int Cubemap_FindClosestCubemap( const Vector &entityOrigin, side_t *pSide )
 	vecCenter += entityOrigin;
 	plane_t *pPlane = &g_MainMap->mapplanes[pSide->planenum];
 
-	// Find the closest cubemap.
-	int iMinCubemap = -1;
-	float flMinDist = FLT_MAX;
-
 	// Look for cubemaps in front of the surface first.
-	for ( int iCubemap = 0; iCubemap < g_nCubemapSamples; ++iCubemap )
-	{	
-		dcubemapsample_t *pSample = &g_CubemapSamples[iCubemap];
-		Vector vecSampleOrigin( static_cast<float>( pSample->origin[0] ),
-								static_cast<float>( pSample->origin[1] ),
-								static_cast<float>( pSample->origin[2] ) );
-		Vector vecDelta;
-		VectorSubtract( vecSampleOrigin, vecCenter, vecDelta );
-		float flDist = vecDelta.NormalizeInPlace();
-		float flDot = DotProduct( vecDelta, pPlane->normal );
-		if ( ( flDot >= 0.0f ) && ( flDist < flMinDist ) )
-		{
-			flMinDist = flDist;
-			iMinCubemap = iCubemap;
-		}
-	}
+	ClosestCubemapSearch_t search;
+	search.m_vecCenter = vecCenter;
+	search.m_pFrontNormal = &pPlane->normal;
+	search.m_flMinDist = FLT_MAX;
+	search.m_iMinCubemap = -1;
+	FindClosestCubemap_r( 0, s_CubemapKDOrder.Count(), search );
 
 	// Didn't find anything in front search for closest.
-	if( iMinCubemap == -1 )
-	{
-		for ( int iCubemap = 0; iCubemap < g_nCubemapSamples; ++iCubemap )
-		{	
-			dcubemapsample_t *pSample = &g_CubemapSamples[iCubemap];
-			Vector vecSampleOrigin( static_cast<float>( pSample->origin[0] ),
-				static_cast<float>( pSample->origin[1] ),
-				static_cast<float>( pSample->origin[2] ) );
-			Vector vecDelta;
-			VectorSubtract( vecSampleOrigin, vecCenter, vecDelta );
-			float flDist = vecDelta.Length();
-			if ( flDist < flMinDist )
-			{
-				flMinDist = flDist;
-				iMinCubemap = iCubemap;
-			}
-		}
+	if( search.m_iMinCubemap == -1 )
+	{
+		search.m_pFrontNormal = NULL;
+		FindClosestCubemap_r( 0, s_CubemapKDOrder.Count(), search );
 	}
 
-	return iMinCubemap;
+	return search.m_iMinCubemap;
+}
+
+
+//-----------------------------------------------------------------------------
+// Picks the closest cubemap for every side that needs one on all threads
+//-----------------------------------------------------------------------------
+static CUtlVector<int> s_SideToEntityIndex;
+static CUtlVector<int> s_SideClosestCubemap;
+
+static void FindClosestCubemapThread( int iThread, int iSide )
+{
+	s_SideClosestCubemap[iSide] = -1;
+	if ( !SideHasCubemapAndWasntManuallyReferenced( iSide ) )
+		return;
+
+	int currentEntity = s_SideToEntityIndex[iSide];
+	s_SideClosestCubemap[iSide] = Cubemap_FindClosestCubemap( g_MainMap->entities[currentEntity].origin, &g_MainMap->brushsides[iSide] );
 }
 
 
@@ -909,12 +1107,11 @@ void Cubemap_AttachDefaultCubemapToSpecularSides( void )
 	Cubemap_InitCubemapSideData();
 
 	// build a mapping from side to entity id so that we can get the entity origin
-	CUtlVector<int> sideToEntityIndex;
-	sideToEntityIndex.SetCount(g_MainMap->nummapbrushsides);
+	s_SideToEntityIndex.SetCount(g_MainMap->nummapbrushsides);
 	int i;
 	for ( i = 0; i < g_MainMap->nummapbrushsides; i++ )
 	{
-		sideToEntityIndex[i] = -1;
+		s_SideToEntityIndex[i] = -1;
 	}
 
 	for ( i = 0; i < g_MainMap->nummapbrushes; i++ )
@@ -924,20 +1121,20 @@ void Cubemap_AttachDefaultCubemapToSpecularSides( void )
 		{
 			side_t *side = &g_MainMap->mapbrushes[i].original_sides[j];
 			int sideIndex = side - g_MainMap->brushsides;
-			sideToEntityIndex[sideIndex] = entityIndex;
+			s_SideToEntityIndex[sideIndex] = entityIndex;
 		}
 	}
 
+	BuildCubemapKDTree();
+	s_SideClosestCubemap.SetCount( g_MainMap->nummapbrushsides );
+	RunThreadsOnIndividual( g_MainMap->nummapbrushsides, false, FindClosestCubemapThread );
+
+	BeginDeferredMaterialPatches();
+
 	for ( int iSide = 0; iSide < g_MainMap->nummapbrushsides; ++iSide )
 	{
 		side_t *pSide = &g_MainMap->brushsides[iSide];
-		if ( !SideHasCubemapAndWasntManuallyReferenced( iSide ) )
-			continue;
-
-
-		int currentEntity = sideToEntityIndex[iSide];
-
-		int iCubemap = Cubemap_FindClosestCubemap( g_MainMap->entities[currentEntity].origin, pSide );
+		int iCubemap = s_SideClosestCubemap[iSide];
 		if ( iCubemap == -1 )
 			continue;
 
@@ -953,16 +1150,22 @@ void Cubemap_AttachDefaultCubemapToSpecularSides( void )
 			pSide->pMapDisp->face.texinfo = pSide->texinfo;
 		}
 	}
+
+	FlushMaterialPatches();
+
+	s_SideToEntityIndex.Purge();
+	s_SideClosestCubemap.Purge();
+	s_CubemapKDOrder.Purge();
+	s_CubemapKDAxis.Purge();
 }
 
 // Populate with cubemaps that were skipped
 void Cubemap_AddUnreferencedCubemaps()
 {
 	char				pTextureName[1024];
-	char				pFileName[1024];
 	PatchInfo_t			info;
 	dcubemapsample_t	*pSample;
-	int					i,j;
+	int					i;
 
 	for ( i=0; i<g_nCubemapSamples; ++i )
 	{
@@ -976,21 +1179,6 @@ void Cubemap_AddUnreferencedCubemaps()
 		GeneratePatchedName( "c", info, false, pTextureName, 1024 );
 		
 		// find or add
-		for ( j=0; j<s_DefaultCubemapNames.Count(); ++j )
-		{
-			if ( !stricmp( s_DefaultCubemapNames[j], pTextureName ) )
-			{
-				// already added
-				break;
-			}
-		}
-		if ( j == s_DefaultCubemapNames.Count() )
-		{
-			int nLen = Q_snprintf( pFileName, 1024, "materials/%s.vtf", pTextureName );
-
-			int id = s_DefaultCubemapNames.AddToTail();
-			s_DefaultCubemapNames[id] = new char[nLen + 1];
-			strcpy( s_DefaultCubemapNames[id], pFileName );
-		}
+		AddDefaultCubemapName( pTextureName );
 	}
 }
@@ -100,6 +100,65 @@ static CUtlVector<DetailObjectLump_t>		s_DetailObjectLump;
 static CUtlVector<DetailSpriteDictLump_t>	s_DetailSpriteDictLump;
 
 
+//-----------------------------------------------------------------------------
+// Each face places its details with its own random numbers, seeded from its
+// hammer face id, so where they land doesn't depend on which thread placed
+// them. Rand() is the generator the MSVC runtime's rand() uses, so maps keep
+// the layout they got when every face reseeded the global one.
+//-----------------------------------------------------------------------------
+class CDetailRandom
+{
+public:
+	CDetailRandom( int nSeed ) : m_nRandState( nSeed ), m_Gaussian( &m_Uniform )
+	{
+		m_Uniform.SetSeed( nSeed );
+	}
+
+	int Rand()
+	{
+		m_nRandState = m_nRandState * 214013 + 2531011;
+		return ( m_nRandState >> 16 ) & VALVE_RAND_MAX;
+	}
+
+	float RandFloat()
+	{
+		return Rand() / (float)VALVE_RAND_MAX;
+	}
+
+	float RandomGaussianFloat( float flMean, float flStdDev )
+	{
+		return m_Gaussian.RandomFloat( flMean, flStdDev );
+	}
+
+private:
+	unsigned int			m_nRandState;
+	CUniformRandomStream	m_Uniform;
+	CGaussianRandomStream	m_Gaussian;
+};
+
+
+//-----------------------------------------------------------------------------
+// A detail placed on a face, waiting to go into the lump
+//-----------------------------------------------------------------------------
+struct PlacedDetail_t
+{
+	const DetailModel_t	*m_pModel;
+	Vector				m_Origin;
+	QAngle				m_Angles;
+	float				m_flScale;
+	int					m_nLeaf;
+};
+
+struct DetailFace_t
+{
+	int					m_nFace;
+	DetailObject_t		*m_pDetail;
+};
+
+static CUtlVector<DetailFace_t>						s_DetailFaces;
+static CUtlVector< CUtlVector<PlacedDetail_t> >		s_PlacedDetails;	// Parallel to s_DetailFaces
+
+
 //-----------------------------------------------------------------------------
 // Parses the key-value pairs in the detail.rad file
 //-----------------------------------------------------------------------------
@@ -319,7 +378,7 @@ void LoadEmitDetailObjectDictionary( const char* pGameDir )
 //-----------------------------------------------------------------------------
 // Selects a detail group
 //-----------------------------------------------------------------------------
-static int SelectGroup( const DetailObject_t& detail, float alpha )
+static int SelectGroup( const DetailObject_t& detail, float alpha, CDetailRandom &random )
 {
 	// Find the two groups whose alpha we're between...
 	int start, end;
@@ -345,7 +404,7 @@ static int SelectGroup( const DetailObject_t& detail, float alpha )
 	}
 
 	// Pick a number, any number...
-	float r = rand() / (float)VALVE_RAND_MAX;
+	float r = random.RandFloat();
 
 	// When dist == 0, we *always* want start.
 	// When dist == 1, we *always* want end
@@ -357,10 +416,10 @@ static int SelectGroup( const DetailObject_t& detail, float alpha )
 //-----------------------------------------------------------------------------
 // Selects a detail object
 //-----------------------------------------------------------------------------
-static int SelectDetail( DetailObjectGroup_t const& group )
+static int SelectDetail( DetailObjectGroup_t const& group, CDetailRandom &random )
 {
 	// Pick a number, any number...
-	float r = rand() / (float)VALVE_RAND_MAX;
+	float r = random.RandFloat();
 
 	// Look through the list of models + pick the one associated with this number
 	for ( int i = 0; i < group.m_Models.Count(); ++i )
@@ -409,11 +468,10 @@ static int AddDetailSpriteDictLump( const Vector2D *pPos, const Vector2D *pTex )
 
 
 //-----------------------------------------------------------------------------
-// Computes the leaf that the detail lies in
+// Computes the leaf that the detail lies in, starting at a node known to hold it
 //-----------------------------------------------------------------------------
-static int ComputeDetailLeaf( const Vector& pt )
+static int ComputeDetailLeaf( const Vector& pt, int node = 0 )
 {
-	int node = 0;
 	while( node >= 0 )
 	{
 		dnode_t* pNode = &dnodes[node];
@@ -429,6 +487,121 @@ static int ComputeDetailLeaf( const Vector& pt )
 }
 
 
+//-----------------------------------------------------------------------------
+// A grid over the world that remembers, for each cell, the deepest node that
+// has the whole cell on one side of every plane above it. Leaf lookups start
+// there instead of at the root, which skips most of the tree for the millions
+// of points a big displacement terrain can produce.
+//-----------------------------------------------------------------------------
+#define DETAIL_LEAF_GRID_MAX_CELLS		64		// per axis
+#define DETAIL_LEAF_GRID_MIN_CELL_SIZE	64.0f
+
+class CDetailLeafGrid
+{
+public:
+	void Init();
+	int FindLeaf( const Vector& pt ) const;
+
+private:
+	int FindCellNode( const Vector& mins, const Vector& maxs ) const;
+
+	Vector			m_vecMins;
+	float			m_flCellSize;
+	int				m_nCells[3];
+	CUtlVector<int>	m_CellNodes;
+};
+
+static CDetailLeafGrid s_DetailLeafGrid;
+
+void CDetailLeafGrid::Init()
+{
+	m_CellNodes.Purge();
+	m_nCells[0] = m_nCells[1] = m_nCells[2] = 0;
+	if ( numnodes == 0 )
+		return;
+
+	Vector vecMaxs;
+	for ( int i = 0; i < 3; ++i )
+	{
+		m_vecMins[i] = dnodes[0].mins[i];
+		vecMaxs[i] = dnodes[0].maxs[i];
+	}
+
+	Vector vecSize = vecMaxs - m_vecMins;
+	m_flCellSize = MAX( MAX( MAX( vecSize.x, vecSize.y ), vecSize.z ) / DETAIL_LEAF_GRID_MAX_CELLS, DETAIL_LEAF_GRID_MIN_CELL_SIZE );
+	for ( int i = 0; i < 3; ++i )
+	{
+		m_nCells[i] = clamp( (int)ceil( vecSize[i] / m_flCellSize ), 1, DETAIL_LEAF_GRID_MAX_CELLS );
+	}
+
+	m_CellNodes.SetCount( m_nCells[0] * m_nCells[1] * m_nCells[2] );
+
+	int nCell = 0;
+	for ( int z = 0; z < m_nCells[2]; ++z )
+	{
+		for ( int y = 0; y < m_nCells[1]; ++y )
+		{
+			for ( int x = 0; x < m_nCells[0]; ++x, ++nCell )
+			{
+				// Pad the cell so points that round into it from outside still land inside the box.
+				Vector mins( m_vecMins.x + x * m_flCellSize - 1.0f, m_vecMins.y + y * m_flCellSize - 1.0f, m_vecMins.z + z * m_flCellSize - 1.0f );
+				Vector maxs( mins.x + m_flCellSize + 2.0f, mins.y + m_flCellSize + 2.0f, mins.z + m_flCellSize + 2.0f );
+				m_CellNodes[nCell] = FindCellNode( mins, maxs );
+			}
+		}
+	}
+}
+
+int CDetailLeafGrid::FindCellNode( const Vector& mins, const Vector& maxs ) const
+{
+	Vector vecCenter = ( mins + maxs ) * 0.5f;
+	Vector vecExtents = maxs - vecCenter;
+
+	int node = 0;
+	while( node >= 0 )
+	{
+		dnode_t* pNode = &dnodes[node];
+		dplane_t* pPlane = &dplanes[pNode->planenum];
+
+		float flDist = DotProduct( vecCenter, pPlane->normal ) - pPlane->dist;
+		float flRadius = fabs( vecExtents.x * pPlane->normal.x ) + fabs( vecExtents.y * pPlane->normal.y ) + fabs( vecExtents.z * pPlane->normal.z );
+
+		// Only go down a side when every point of the box is clearly on it, so that
+		// ComputeDetailLeaf's test couldn't have gone the other way for any of them.
+		if ( flDist - flRadius > ON_EPSILON )
+			node = pNode->children[0];
+		else if ( flDist + flRadius < -ON_EPSILON )
+			node = pNode->children[1];
+		else
+			break;
+	}
+
+	return node;
+}
+
+int CDetailLeafGrid::FindLeaf( const Vector& pt ) const
+{
+	int node = 0;
+	if ( m_CellNodes.Count() )
+	{
+		int nCell[3];
+		for ( int i = 0; i < 3; ++i )
+		{
+			nCell[i] = (int)floor( ( pt[i] - m_vecMins[i] ) / m_flCellSize );
+		}
+
+		if ( nCell[0] >= 0 && nCell[0] < m_nCells[0] && 
+			 nCell[1] >= 0 && nCell[1] < m_nCells[1] && 
+			 nCell[2] >= 0 && nCell[2] < m_nCells[2] )
+		{
+			node = m_CellNodes[ ( nCell[2] * m_nCells[1] + nCell[1] ) * m_nCells[0] + nCell[0] ];
+		}
+	}
+
+	return ComputeDetailLeaf( pt, node );
+}
+
+
 //-----------------------------------------------------------------------------
 // Make sure the details are compiled with static prop
 //-----------------------------------------------------------------------------
@@ -457,7 +630,7 @@ static bool IsModelValid( const char* pModelName )
 // Add a detail to the lump.
 //-----------------------------------------------------------------------------
 static int s_nDetailOverflow = 0;
-static void AddDetailToLump( const char* pModelName, const Vector& pt, const QAngle& angles, int nOrientation )
+static void AddDetailToLump( const char* pModelName, const Vector& pt, const QAngle& angles, int nOrientation, int nLeaf )
 {
 	Assert( pt.IsValid() && angles.IsValid() );
 
@@ -478,7 +651,7 @@ static void AddDetailToLump( const char* pModelName, const Vector& pt, const QAn
 	objectLump.m_DetailModel = AddDetailDictLump( pModelName ); 
 	VectorCopy( angles, objectLump.m_Angles );
 	VectorCopy( pt, objectLump.m_Origin );
-	objectLump.m_Leaf = ComputeDetailLeaf(pt);
+	objectLump.m_Leaf = nLeaf;
 	objectLump.m_Lighting.r = 255;
 	objectLump.m_Lighting.g = 255;
 	objectLump.m_Lighting.b = 255;
@@ -493,7 +666,7 @@ static void AddDetailToLump( const char* pModelName, const Vector& pt, const QAn
 //-----------------------------------------------------------------------------
 // Add a detail sprite to the lump.
 //-----------------------------------------------------------------------------
-static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAngles, int nOrientation,
+static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAngles, int nOrientation, int nLeaf,
 								  const Vector2D *pPos, const Vector2D *pTex, float flScale, int iType,
 									int iShapeAngle = 0, int iShapeSize = 0, int iSwayAmount = 0 )
 {
@@ -509,7 +682,7 @@ static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAng
 	objectLump.m_DetailModel = AddDetailSpriteDictLump( pPos, pTex ); 
 	VectorCopy( vecAngles, objectLump.m_Angles );
 	VectorCopy( vecOrigin, objectLump.m_Origin );
-	objectLump.m_Leaf = ComputeDetailLeaf(vecOrigin);
+	objectLump.m_Leaf = nLeaf;
 	objectLump.m_Lighting.r = 255;
 	objectLump.m_Lighting.g = 255;
 	objectLump.m_Lighting.b = 255;
@@ -524,11 +697,12 @@ static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAng
 	objectLump.m_SwayAmount = iSwayAmount;
 }
 
-static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAngles, DetailModel_t const& model, float flScale )
+static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAngles, DetailModel_t const& model, float flScale, int nLeaf )
 {
 	AddDetailSpriteToLump( vecOrigin,
 		vecAngles,
 		model.m_Orientation,
+		nLeaf,
 		model.m_Pos,
 		model.m_Tex,
 		flScale,
@@ -545,7 +719,8 @@ static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAng
 // (only when not in the debugger?)
 // Printing the values of normal at the bottom of the function fixes it as does
 // disabling global optimizations.
-static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vector& normal )
+static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vector& normal, 
+						CDetailRandom &random, CUtlVector<PlacedDetail_t> &placed )
 {
 	// But only place it on the surface if it meets the angle constraints...
 	float cosAngle = normal.z;
@@ -560,7 +735,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 		float probability = (cosAngle - model.m_MaxCosAngle) / 
 			(model.m_MinCosAngle - model.m_MaxCosAngle);
 
-		float t = rand() / (float)VALVE_RAND_MAX;
+		float t = random.RandFloat();
 		if (t > probability)
 			return;
 	}
@@ -570,7 +745,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 	if (model.m_Flags & MODELFLAG_UPRIGHT)
 	{
 		// If it's upright, we just select a random yaw
-		angles.Init( 0, 360.0f * rand() / (float)VALVE_RAND_MAX, 0.0f );
+		angles.Init( 0, 360.0f * random.Rand() / (float)VALVE_RAND_MAX, 0.0f );
 	}
 	else
 	{
@@ -594,7 +769,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 		matrix.SetBasisVectors( xaxis, yaxis, zaxis );
 		matrix.SetTranslation( vec3_origin );
 
-		float rotAngle = 360.0f * rand() / (float)VALVE_RAND_MAX;
+		float rotAngle = 360.0f * random.Rand() / (float)VALVE_RAND_MAX;
 		VMatrix rot = SetupMatrixAxisRot( Vector( 0, 0, 1 ), rotAngle );
 		matrix = matrix * rot;
 
@@ -603,26 +778,46 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 
 	// FIXME: We may also want a purely random rotation too
 
-	// Insert an element into the object dictionary if it aint there...
-	switch ( model.m_Type )
+	// Sprites and procedural models made from sprites can be scaled
+	float flScale = 1.0f;
+	if ( ( model.m_Type != DETAIL_PROP_TYPE_MODEL ) && ( model.m_flRandomScaleStdDev != 0.0f ) )
+	{
+		flScale = fabs( random.RandomGaussianFloat( 1.0f, model.m_flRandomScaleStdDev ) );
+	}
+
+	// The lump itself is filled in face order once every face is done
+	PlacedDetail_t &detail = placed[placed.AddToTail()];
+	detail.m_pModel = &model;
+	detail.m_Origin = pt;
+	detail.m_Angles = angles;
+	detail.m_flScale = flScale;
+	detail.m_nLeaf = s_DetailLeafGrid.FindLeaf( pt );
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds a face's details to the lump
+//-----------------------------------------------------------------------------
+static void AddPlacedDetailsToLump( const CUtlVector<PlacedDetail_t> &placed )
+{
+	for ( int i = 0; i < placed.Count(); ++i )
 	{
-	case DETAIL_PROP_TYPE_MODEL:
-		AddDetailToLump( model.m_ModelName.String(), pt, angles, model.m_Orientation );
-		break;
+		const PlacedDetail_t &detail = placed[i];
+		const DetailModel_t &model = *detail.m_pModel;
 
-	// Sprites and procedural models made from sprites
-	case DETAIL_PROP_TYPE_SPRITE:
-	default:
+		// Insert an element into the object dictionary if it aint there...
+		switch ( model.m_Type )
 		{
-			float flScale = 1.0f;
-			if ( model.m_flRandomScaleStdDev != 0.0f ) 
-			{
-				flScale = fabs( RandomGaussianFloat( 1.0f, model.m_flRandomScaleStdDev ) );
-			}
+		case DETAIL_PROP_TYPE_MODEL:
+			AddDetailToLump( model.m_ModelName.String(), detail.m_Origin, detail.m_Angles, model.m_Orientation, detail.m_nLeaf );
+			break;
 
-			AddDetailSpriteToLump( pt, angles, model, flScale );
+		// Sprites and procedural models made from sprites
+		case DETAIL_PROP_TYPE_SPRITE:
+		default:
+			AddDetailSpriteToLump( detail.m_Origin, detail.m_Angles, model, detail.m_flScale, detail.m_nLeaf );
+			break;
 		}
-		break;
 	}
 }
 
@@ -630,7 +825,8 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 //-----------------------------------------------------------------------------
 // Places Detail Objects on a face
 //-----------------------------------------------------------------------------
-static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
+static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail, 
+									CDetailRandom &random, CUtlVector<PlacedDetail_t> &placed )
 {
 	if (pFace->numedges < 3)
 		return;
@@ -666,8 +862,8 @@ static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
 		for (int i = 0; i < numSamples; ++i )
 		{
 			// Create a random sample...
-			float u = rand() / (float)VALVE_RAND_MAX;
-			float v = rand() / (float)VALVE_RAND_MAX;
+			float u = random.RandFloat();
+			float v = random.RandFloat();
 			if (v > 1.0f - u)
 			{
 				u = 1.0f - u;
@@ -679,10 +875,10 @@ static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
 			float alpha = 1.0f;
 
 			// Select a group based on the alpha value
-			int group = SelectGroup( detail, alpha );
+			int group = SelectGroup( detail, alpha, random );
 
 			// Now that we've got a group, choose a detail
-			int model = SelectDetail( detail.m_Groups[group] );
+			int model = SelectDetail( detail.m_Groups[group], random );
 			if (model < 0)
 				continue;
 
@@ -692,7 +888,7 @@ static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
 			VectorMA( pt, v, e2, pt );
 			VectorDivide( areaVec, -normalLength, normal );
 
-			PlaceDetail( detail.m_Groups[group].m_Models[model], pt, normal );
+			PlaceDetail( detail.m_Groups[group].m_Models[model], pt, normal, random, placed );
 		}
 	}
 }
@@ -734,8 +930,8 @@ static float ComputeDisplacementFaceArea( dface_t* pFace )
 //-----------------------------------------------------------------------------
 // Places Detail Objects on a face
 //-----------------------------------------------------------------------------
-static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace, 
-						DetailObject_t& detail, CCoreDispInfo& coreDispInfo )
+static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace, DetailObject_t& detail, CCoreDispInfo& coreDispInfo, 
+						CDetailRandom &random, CUtlVector<PlacedDetail_t> &placed )
 {
 	assert(pFace->numedges == 4);
 
@@ -752,8 +948,8 @@ static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace,
 	for (int i = 0; i < numSamples; ++i )
 	{
 		// Create a random sample...
-		float u = rand() / (float)VALVE_RAND_MAX;
-		float v = rand() / (float)VALVE_RAND_MAX;
+		float u = random.RandFloat();
+		float v = random.RandFloat();
 
 		// Compute alpha
 		float alpha;
@@ -762,15 +958,15 @@ static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace,
 		alpha /= 255.0f;
 
 		// Select a group based on the alpha value
-		int group = SelectGroup( detail, alpha );
+		int group = SelectGroup( detail, alpha, random );
 
 		// Now that we've got a group, choose a detail
-		int model = SelectDetail( detail.m_Groups[group] );
+		int model = SelectDetail( detail.m_Groups[group], random );
 		if (model < 0)
 			continue;
 
 		// Got a detail! Place it on the surface...
-		PlaceDetail( detail.m_Groups[group].m_Models[model], pt, normal );
+		PlaceDetail( detail.m_Groups[group].m_Models[model], pt, normal, random, placed );
 	}
 }
 
@@ -829,19 +1025,50 @@ static void SetLumpData( )
 }
 
 
+//-----------------------------------------------------------------------------
+// Places Detail Objects on one of the faces in s_DetailFaces
+//-----------------------------------------------------------------------------
+static void EmitDetailObjectsOnFaceThread( int iThread, int iDetailFace )
+{
+	int j = s_DetailFaces[iDetailFace].m_nFace;
+	DetailObject_t& detail = *s_DetailFaces[iDetailFace].m_pDetail;
+	CUtlVector<PlacedDetail_t> &placed = s_PlacedDetails[iDetailFace];
+
+	// Initialize the Random Number generators for detail prop placement based on the hammer Face num.
+	int	detailpropseed = dfaceids[j].hammerfaceid;
+#ifdef WARNSEEDNUMBER
+	Warning( "[%d]\n",detailpropseed );
+#endif
+	CDetailRandom random( detailpropseed );
+
+	if (dfaces[j].dispinfo < 0)
+	{
+		EmitDetailObjectsOnFace( &dfaces[j], detail, random, placed );
+	}
+	else
+	{
+		// Get a CCoreDispInfo. All we need is the triangles and lightmap texture coordinates.
+		mapdispinfo_t *pMapDisp = &mapdispinfo[dfaces[j].dispinfo];
+		CCoreDispInfo coreDispInfo;
+		DispMapToCoreDispInfo( pMapDisp, &coreDispInfo, NULL, NULL );
+
+		EmitDetailObjectsOnDisplacementFace( &dfaces[j], detail, coreDispInfo, random, placed );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Places Detail Objects in the level
 //-----------------------------------------------------------------------------
 void EmitDetailModels()
 {
-	StartPacifier("Placing detail props : ");
+	s_DetailLeafGrid.Init();
+	s_DetailFaces.RemoveAll();
 
-	// Place stuff on each face
+	// Find the faces that get detail objects. The material system is only touched here.
 	dface_t* pFace = dfaces;
 	for (int j = 0; j < numfaces; ++j)
 	{
-		UpdatePacifier( (float)j / (float)numfaces );
-
 		// Get at the material associated with this face
 		texinfo_t* pTexInfo = &texinfo[pFace[j].texinfo];
 		dtexdata_t* pTexData = GetTexData( pTexInfo->texdata );
@@ -872,30 +1099,22 @@ void EmitDetailModels()
 		}
 
 		// Emit objects on a particular face
-		DetailObject_t& detail = s_DetailObjectDict[objectType];
-
-		// Initialize the Random Number generators for detail prop placement based on the hammer Face num.
-		int	detailpropseed = dfaceids[j].hammerfaceid;
-#ifdef WARNSEEDNUMBER
-		Warning( "[%d]\n",detailpropseed );
-#endif
-		srand( detailpropseed );
-		RandomSeed( detailpropseed );
+		DetailFace_t &detailFace = s_DetailFaces[s_DetailFaces.AddToTail()];
+		detailFace.m_nFace = j;
+		detailFace.m_pDetail = &s_DetailObjectDict[objectType];
+	}
 
-		if (pFace[j].dispinfo < 0)
-		{
-			EmitDetailObjectsOnFace( &pFace[j], detail );
-		}
-		else
-		{
-			// Get a CCoreDispInfo. All we need is the triangles and lightmap texture coordinates.
-			mapdispinfo_t *pMapDisp = &mapdispinfo[pFace[j].dispinfo];
-			CCoreDispInfo coreDispInfo;
-			DispMapToCoreDispInfo( pMapDisp, &coreDispInfo, NULL, NULL );
+	// Place stuff on each face
+	s_PlacedDetails.Purge();
+	s_PlacedDetails.SetCount( s_DetailFaces.Count() );
+	RunThreadsOnIndividual( s_DetailFaces.Count(), true, EmitDetailObjectsOnFaceThread );
 
-			EmitDetailObjectsOnDisplacementFace( &pFace[j], detail, coreDispInfo );
-		}
+	for (int j = 0; j < s_PlacedDetails.Count(); ++j)
+	{
+		AddPlacedDetailsToLump( s_PlacedDetails[j] );
 	}
+	s_PlacedDetails.Purge();
+	s_DetailFaces.Purge();
 
 	// Emit specifically specified detail props
 	Vector origin;
@@ -912,7 +1131,7 @@ void EmitDetailModels()
 			char* pModelName = ValueForKey( &entities[i], "model" );
 			int nOrientation = IntForKey( &entities[i], "detailOrientation" );
 
-			AddDetailToLump( pModelName, origin, angles, nOrientation );
+			AddDetailToLump( pModelName, origin, angles, nOrientation, s_DetailLeafGrid.FindLeaf( origin ) );
 
 			// strip this ent from the .bsp file
 			entities[i].epairs = 0;
@@ -937,15 +1156,13 @@ void EmitDetailModels()
 			tex[0] /= flTextureSize;
 			tex[1] /= flTextureSize;
 
-			AddDetailSpriteToLump( origin, angles, nOrientation, pos, tex, 1.0f, DETAIL_PROP_TYPE_SPRITE );
+			AddDetailSpriteToLump( origin, angles, nOrientation, s_DetailLeafGrid.FindLeaf( origin ), pos, tex, 1.0f, DETAIL_PROP_TYPE_SPRITE );
 
 			// strip this ent from the .bsp file
 			entities[i].epairs = 0;
 			continue;
 		}
 	}
-
-	EndPacifier( true );
 }
 
 
@@ -9,6 +9,7 @@
 
 #include "vbsp.h"
 #include "utlvector.h"
+#include "tier1/utlhashtable.h"
 #include "utilmatlib.h"
 #include <float.h>
 #include "mstristrip.h"
@@ -51,54 +52,73 @@ int		firstmodelface;
 
 int	c_tryedges;
 
-Vector	edge_dir;
-Vector	edge_start;
-vec_t	edge_len;
-
-int		num_edge_verts;
-int		edge_verts[MAX_MAP_VERTS];
-
 
 float	g_maxLightmapDimension = 32;
 
 
 face_t *NewFaceFromFace (face_t *f);
 
-// Used to speed up GetEdge2(). Holds a list of edges connected to each vert.
-CUtlVector<int> g_VertEdgeList[MAX_MAP_VERTS];
-
 
 //===========================================================================
 
-typedef struct hashvert_s
+// Hashes three cell coordinates packed into the low 48 bits
+struct CellKeyHashFunctor
 {
-	struct hashvert_s	*next;
-	int		num;
-} hashvert_t;
+	unsigned int operator()( uint64 key ) const
+	{
+		return Mix32HashFunctor()( (uint32)key ^ ( (uint32)( key >> 32 ) * 0x9E3779B1 ) );
+	}
+};
 
-#define HASH_BITS	7
-#define	HASH_SIZE	(COORD_EXTENT>>HASH_BITS)
+typedef CUtlHashtable< uint64, int, CellKeyHashFunctor > CellHash_t;
+
+inline uint64 CellKey( int x, int y, int z )
+{
+	return (uint64)( x & 0xFFFF ) | ( (uint64)( y & 0xFFFF ) << 16 ) | ( (uint64)( z & 0xFFFF ) << 32 );
+}
 
 
-int	vertexchain[MAX_MAP_VERTS];		// the next vertex in a hash chain
-int	hashverts[HASH_SIZE*HASH_SIZE];	// a vertex number, or 0 for no verts
+// Vertexes are welded by looking them up in the unit cell around the nearest
+// integral point. Cells are kept in an open addressing hash sized to the
+// number of points in the model, so lookups don't depend on how the geometry
+// is spread out.
+static CellHash_t	s_VertexCells;						// the last vertex emitted in each cell
+int			vertexchain[MAX_MAP_VERTS];			// the next vertex in a hash chain, or -1
+static CUtlVector<int>	s_HashedVerts;					// every vertex in s_VertexCells
 
 //face_t		*edgefaces[MAX_MAP_EDGES][2];
 
 //============================================================================
 
 
-unsigned HashVec (Vector& vec)
+void VertexCell (Vector& vec, int cell[3])
+{
+	for (int i=0 ; i<3 ; i++)
+	{
+		cell[i] = MAX_COORD_INTEGER + (int)floor(vec[i]+0.5);
+		if ( cell[i] < 0 || cell[i] >= COORD_EXTENT )
+			Error ("VertexCell: point outside valid range");
+	}
+}
+
+static int FindVertexInCell (Vector& vert, int x, int y, int z)
 {
-	int			x, y;
+	if ( x < 0 || x >= COORD_EXTENT || y < 0 || y >= COORD_EXTENT || z < 0 || z >= COORD_EXTENT )
+		return -1;
 
-	x = (MAX_COORD_INTEGER + (int)(vec[0]+0.5)) >> HASH_BITS;
-	y = (MAX_COORD_INTEGER + (int)(vec[1]+0.5)) >> HASH_BITS;
+	UtlHashHandle_t h = s_VertexCells.Find( CellKey( x, y, z ) );
+	if ( h == s_VertexCells.InvalidHandle() )
+		return -1;
 
-	if ( x < 0 || x >= HASH_SIZE || y < 0 || y >= HASH_SIZE )
-		Error ("HashVec: point outside valid range");
-	
-	return y*HASH_SIZE + x;
+	for (int vnum=s_VertexCells[h] ; vnum >= 0 ; vnum=vertexchain[vnum])
+	{
+		Vector& p = dvertexes[vnum].point;
+		if ( fabs(p[0]-vert[0])<POINT_EPSILON
+		&& fabs(p[1]-vert[1])<POINT_EPSILON
+		&& fabs(p[2]-vert[2])<POINT_EPSILON )
+			return vnum;
+	}
+	return -1;
 }
 
 #ifdef USE_HASHING
@@ -111,10 +131,10 @@ Uses hashing
 */
 int	GetVertexnum (Vector& in)
 {
-	int			h;
 	int			i;
 	Vector		vert;
 	int			vnum;
+	int			cell[3];
 
 	c_totalverts++;
 
@@ -126,15 +146,39 @@ int	GetVertexnum (Vector& in)
 			vert[i] = in[i];
 	}
 	
-	h = HashVec (vert);
-	
-	for (vnum=hashverts[h] ; vnum ; vnum=vertexchain[vnum])
+	VertexCell (vert, cell);
+
+	vnum = FindVertexInCell (vert, cell[0], cell[1], cell[2]);
+	if (vnum >= 0)
+		return vnum;
+
+	// a match can be in a neighboring cell if the point is within POINT_EPSILON of its wall
+	int		side[3];
+	for (i=0 ; i<3 ; i++)
 	{
-		Vector& p = dvertexes[vnum].point;
-		if ( fabs(p[0]-vert[0])<POINT_EPSILON
-		&& fabs(p[1]-vert[1])<POINT_EPSILON
-		&& fabs(p[2]-vert[2])<POINT_EPSILON )
-			return vnum;
+		float frac = vert[i] - (cell[i] - MAX_COORD_INTEGER);
+		if (frac > 0.5 - POINT_EPSILON)
+			side[i] = 1;
+		else if (frac < -0.5 + POINT_EPSILON)
+			side[i] = -1;
+		else
+			side[i] = 0;
+	}
+
+	if (side[0] || side[1] || side[2])
+	{
+		for (i=1 ; i<8 ; i++)
+		{
+			if ( ((i & 1) && !side[0]) || ((i & 2) && !side[1]) || ((i & 4) && !side[2]) )
+				continue;
+
+			vnum = FindVertexInCell (vert, 
+				cell[0] + ((i & 1) ? side[0] : 0), 
+				cell[1] + ((i & 2) ? side[1] : 0), 
+				cell[2] + ((i & 4) ? side[2] : 0));
+			if (vnum >= 0)
+				return vnum;
+		}
 	}
 	
 // emit a vertex
@@ -145,8 +189,11 @@ int	GetVertexnum (Vector& in)
 	dvertexes[numvertexes].point[1] = vert[1];
 	dvertexes[numvertexes].point[2] = vert[2];
 
-	vertexchain[numvertexes] = hashverts[h];
-	hashverts[h] = numvertexes;
+	bool	inserted;
+	UtlHashHandle_t h = s_VertexCells.Insert( CellKey( cell[0], cell[1], cell[2] ), numvertexes, &inserted );
+	vertexchain[numvertexes] = inserted ? -1 : s_VertexCells[h];
+	s_VertexCells[h] = numvertexes;
+	s_HashedVerts.AddToTail( numvertexes );
 
 	c_uniqueverts++;
 
@@ -331,68 +378,200 @@ void EmitLeafFaceVertexes( face_t **ppLeafFaceList )
 }
 
 
-#ifdef USE_HASHING
+//===========================================================================
+//
+// T-junctions
+//
+// Every face works out its new vertex ring, and the triangles to use if it
+// has no good start vertex, on the worker threads. The vertexes they are
+// checked against don't change while that happens. The faces are then
+// updated one at a time in the order they were visited, so the face splits
+// and primitives come out the same however the work was divided.
+//
+//===========================================================================
+
+// Vertexes the t-junction search can find, bucketed into cubes
+#define TJUNC_CELL_BITS		6
+#define TJUNC_CELL_SIZE		(1<<TJUNC_CELL_BITS)
+
+// How far from an edge to look for vertexes. Anything within OFF_EPSILON is on it.
+#define TJUNC_SEARCH_PAD	(2*OFF_EPSILON)
+
+static CellHash_t		s_TJuncCells;			// cell -> index into s_TJuncCellStart
+static CUtlVector<int>	s_TJuncCellStart;		// each cell's first entry in s_TJuncCellVerts, plus one past the end
+static CUtlVector<int>	s_TJuncCellVerts;
+
+struct tjuncface_t
+{
+	face_t	**pList;
+	face_t	*f;
+};
+
+// What fixing a face's edges came up with
+struct tjuncresult_t
+{
+	CUtlVector<int>	superverts;			// empty if the face collapsed
+	int				base;
+	qboolean		badstartvert;
+	CUtlVector<int>	triangles;			// indices into superverts if it has to be retriangulated
+	int				degenerate;
+	int				tjunctions;
+};
+
+// Scratch space for one thread
+struct tjunccontext_t
+{
+	Vector			edge_dir;
+	Vector			edge_start;
+	CUtlVector<int>	edge_verts;
+	int				superverts[MAX_SUPERVERTS];
+	int				numsuperverts;
+	int				degenerate;
+	int				tjunctions;
+};
+
+static CUtlVector<tjuncface_t>		s_TJuncFaces;
+static CUtlVector<tjuncresult_t>	s_TJuncResults;		// parallel to s_TJuncFaces
+static CUtlVector<tjunccontext_t>	s_TJuncContexts;	// one per thread
+
+
+static int TJuncCell (vec_t v)
+{
+	return (MAX_COORD_INTEGER + (int)floor(v)) >> TJUNC_CELL_BITS;
+}
+
 /*
 ==========
-FindEdgeVerts
+BuildTJuncCells
 
-Uses the hash tables to cut down to a small number
+Buckets every welded vertex so far by cell
 ==========
 */
-void FindEdgeVerts (Vector& v1, Vector& v2)
-{
-	int		x1, x2, y1, y2, t;
-	int		x, y;
-	int		vnum;
-
-#if 0
+static void BuildTJuncCells (void)
 {
 	int		i;
-	num_edge_verts = numvertexes-1;
-	for (i=0 ; i<numvertexes-1 ; i++)
-		edge_verts[i] = i+1;
-}
-#endif
+	int		nVerts = s_HashedVerts.Count();
 
-	x1 = (MAX_COORD_INTEGER + (int)(v1[0]+0.5)) >> HASH_BITS;
-	y1 = (MAX_COORD_INTEGER + (int)(v1[1]+0.5)) >> HASH_BITS;
-	x2 = (MAX_COORD_INTEGER + (int)(v2[0]+0.5)) >> HASH_BITS;
-	y2 = (MAX_COORD_INTEGER + (int)(v2[1]+0.5)) >> HASH_BITS;
+	s_TJuncCells.RemoveAll();
+	s_TJuncCells.Reserve( nVerts );
+	s_TJuncCellStart.RemoveAll();
 
-	if (x1 > x2)
+	CUtlVector<int> vertCell;
+	vertCell.SetCount( nVerts );
+	for (i=0 ; i<nVerts ; i++)
 	{
-		t = x1;
-		x1 = x2;
-		x2 = t;
+		Vector& p = dvertexes[s_HashedVerts[i]].point;
+
+		bool inserted;
+		UtlHashHandle_t h = s_TJuncCells.Insert( CellKey( TJuncCell(p[0]), TJuncCell(p[1]), TJuncCell(p[2]) ), s_TJuncCellStart.Count(), &inserted );
+		if (inserted)
+			s_TJuncCellStart.AddToTail( 0 );
+
+		vertCell[i] = s_TJuncCells[h];
+		s_TJuncCellStart[vertCell[i]]++;
 	}
-	if (y1 > y2)
+
+	// turn the counts into offsets
+	int nCells = s_TJuncCellStart.Count();
+	int total = 0;
+	for (i=0 ; i<nCells ; i++)
 	{
-		t = y1;
-		y1 = y2;
-		y2 = t;
+		int count = s_TJuncCellStart[i];
+		s_TJuncCellStart[i] = total;
+		total += count;
 	}
-#if 0
-	x1--;
-	x2++;
-	y1--;
-	y2++;
-	if (x1 < 0)
-		x1 = 0;
-	if (x2 >= HASH_SIZE)
-		x2 = HASH_SIZE;
-	if (y1 < 0)
-		y1 = 0;
-	if (y2 >= HASH_SIZE)
-		y2 = HASH_SIZE;
-#endif
-	num_edge_verts = 0;
-	for (x=x1 ; x <= x2 ; x++)
+	s_TJuncCellStart.AddToTail( total );
+
+	CUtlVector<int> next;
+	next.CopyArray( s_TJuncCellStart.Base(), nCells );
+	s_TJuncCellVerts.SetCount( total );
+	for (i=0 ; i<nVerts ; i++)
 	{
-		for (y=y1 ; y <= y2 ; y++)
+		s_TJuncCellVerts[next[vertCell[i]]++] = s_HashedVerts[i];
+	}
+}
+
+static void AddTJuncCellVerts (tjunccontext_t &ctx, int x, int y, int z)
+{
+	UtlHashHandle_t h = s_TJuncCells.Find( CellKey( x, y, z ) );
+	if ( h == s_TJuncCells.InvalidHandle() )
+		return;
+
+	int cell = s_TJuncCells[h];
+	ctx.edge_verts.AddMultipleToTail( s_TJuncCellStart[cell+1] - s_TJuncCellStart[cell], &s_TJuncCellVerts[s_TJuncCellStart[cell]] );
+}
+
+#ifdef USE_HASHING
+/*
+==========
+FindEdgeVerts
+
+Collects the vertexes in the cells within TJUNC_SEARCH_PAD of the edge.
+The edge is walked a slab of cells at a time along its longest axis, so
+a long diagonal edge doesn't sweep its whole bounding box.
+==========
+*/
+void FindEdgeVerts (tjunccontext_t &ctx, Vector& v1, Vector& v2)
+{
+	int		i;
+	Vector	delta;
+
+	ctx.edge_verts.RemoveAll();
+
+	VectorSubtract (v2, v1, delta);
+	int major = 0;
+	for (i=1 ; i<3 ; i++)
+	{
+		if (fabs(delta[i]) > fabs(delta[major]))
+			major = i;
+	}
+	int axis1 = (major+1)%3;
+	int axis2 = (major+2)%3;
+
+	int first = TJuncCell (MIN(v1[major], v2[major]) - TJUNC_SEARCH_PAD);
+	int last = TJuncCell (MAX(v1[major], v2[major]) + TJUNC_SEARCH_PAD);
+	for (int c=first ; c<=last ; c++)
+	{
+		// the part of the edge that is near this slab
+		vec_t t0 = 0;
+		vec_t t1 = 1;
+		if (delta[major] != 0)
 		{
-			for (vnum=hashverts[y*HASH_SIZE+x] ; vnum ; vnum=vertexchain[vnum])
+			vec_t slabMin = c * TJUNC_CELL_SIZE - MAX_COORD_INTEGER - TJUNC_SEARCH_PAD;
+			vec_t slabMax = slabMin + TJUNC_CELL_SIZE + 2*TJUNC_SEARCH_PAD;
+			t0 = (slabMin - v1[major]) / delta[major];
+			t1 = (slabMax - v1[major]) / delta[major];
+			if (t0 > t1)
 			{
-				edge_verts[num_edge_verts++] = vnum;
+				vec_t t = t0;
+				t0 = t1;
+				t1 = t;
+			}
+			t0 = MAX(t0, 0);
+			t1 = MIN(t1, 1);
+			if (t0 > t1)
+				continue;
+		}
+
+		int mins[3], maxs[3];
+		mins[major] = maxs[major] = c;
+		for (i=1 ; i<3 ; i++)
+		{
+			int axis = (i == 1) ? axis1 : axis2;
+			vec_t a = v1[axis] + t0 * delta[axis];
+			vec_t b = v1[axis] + t1 * delta[axis];
+			mins[axis] = TJuncCell (MIN(a, b) - TJUNC_SEARCH_PAD);
+			maxs[axis] = TJuncCell (MAX(a, b) + TJUNC_SEARCH_PAD);
+		}
+
+		for (int x=mins[0] ; x<=maxs[0] ; x++)
+		{
+			for (int y=mins[1] ; y<=maxs[1] ; y++)
+			{
+				for (int z=mins[2] ; z<=maxs[2] ; z++)
+				{
+					AddTJuncCellVerts (ctx, x, y, z);
+				}
 			}
 		}
 	}
@@ -406,13 +585,9 @@ FindEdgeVerts
 Forced a dumb check of everything
 ==========
 */
-void FindEdgeVerts (Vector& v1, Vector& v2)
+void FindEdgeVerts (tjunccontext_t &ctx, Vector& v1, Vector& v2)
 {
-	int		i;
-
-	num_edge_verts = numvertexes-1;
-	for (i=0 ; i<num_edge_verts ; i++)
-		edge_verts[i] = i+1;
+	ctx.edge_verts.CopyArray( s_HashedVerts.Base(), s_HashedVerts.Count() );
 }
 #endif
 
@@ -423,7 +598,7 @@ TestEdge
 Can be recursively reentered
 ==========
 */
-void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
+void TestEdge (tjunccontext_t &ctx, vec_t start, vec_t end, int p1, int p2, int startvert)
 {
 	int		j, k;
 	vec_t	dist;
@@ -435,23 +610,23 @@ void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
 
 	if (p1 == p2)
 	{
-		c_degenerate++;
+		ctx.degenerate++;
 		return;		// degenerate edge
 	}
 
-	for (k=startvert ; k<num_edge_verts ; k++)
+	for (k=startvert ; k<ctx.edge_verts.Count() ; k++)
 	{
-		j = edge_verts[k];
+		j = ctx.edge_verts[k];
 		if (j==p1 || j == p2)
 			continue;
 
 		VectorCopy (dvertexes[j].point, p);
 
-		VectorSubtract (p, edge_start, delta);
-		dist = DotProduct (delta, edge_dir);
+		VectorSubtract (p, ctx.edge_start, delta);
+		dist = DotProduct (delta, ctx.edge_dir);
 		if (dist <=start || dist >= end)
 			continue;		// off an end
-		VectorMA (edge_start, dist, edge_dir, exact);
+		VectorMA (ctx.edge_start, dist, ctx.edge_dir, exact);
 		VectorSubtract (p, exact, off);
 		error = off.Length();
 
@@ -459,17 +634,17 @@ void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
 			continue;		// not on the edge
 
 		// break the edge
-		c_tjunctions++;
-		TestEdge (start, dist, p1, j, k+1);
-		TestEdge (dist, end, j, p2, k+1);
+		ctx.tjunctions++;
+		TestEdge (ctx, start, dist, p1, j, k+1);
+		TestEdge (ctx, dist, end, j, p2, k+1);
 		return;
 	}
 
 	// the edge p1 to p2 is now free of tjunctions
-	if (numsuperverts >= MAX_SUPERVERTS)
+	if (ctx.numsuperverts >= MAX_SUPERVERTS)
 		Error ("Edge with too many vertices due to t-junctions.  Max %d verts along an edge!\n", MAX_SUPERVERTS);
-	superverts[numsuperverts] = p1;
-	numsuperverts++;
+	ctx.superverts[ctx.numsuperverts] = p1;
+	ctx.numsuperverts++;
 }
 
 
@@ -582,21 +757,21 @@ void Triangulate_r( CUtlVector<int> &out, const CUtlVector<int> &inIndices, cons
 ==================
 FixFaceEdges
 
+Works out what fixing the t-junctions on a face's edges does to it. The
+face itself is left alone; see ApplyFaceEdges.
 ==================
 */
-void FixFaceEdges (face_t **pList, face_t *f)
+void FixFaceEdges (tjunccontext_t &ctx, face_t *f, tjuncresult_t &result)
 {
 	int		p1, p2;
 	int		i;
 	Vector	e2;
 	vec_t	len;
 	int		count[MAX_SUPERVERTS], start[MAX_SUPERVERTS];
-	int		base;
-
-	if (f->merged || f->split[0] || f->split[1])
-		return;
 
-	numsuperverts = 0;
+	ctx.numsuperverts = 0;
+	ctx.degenerate = 0;
+	ctx.tjunctions = 0;
 
 	int originalPoints = f->numpoints;
 	for (i=0 ; i<f->numpoints ; i++)
@@ -604,24 +779,29 @@ void FixFaceEdges (face_t **pList, face_t *f)
 		p1 = f->vertexnums[i];
 		p2 = f->vertexnums[(i+1)%f->numpoints];
 
-		VectorCopy (dvertexes[p1].point, edge_start);
+		VectorCopy (dvertexes[p1].point, ctx.edge_start);
 		VectorCopy (dvertexes[p2].point, e2);
 
-		FindEdgeVerts (edge_start, e2);
+		FindEdgeVerts (ctx, ctx.edge_start, e2);
 
-		VectorSubtract (e2, edge_start, edge_dir);
-		len = VectorNormalize (edge_dir);
+		VectorSubtract (e2, ctx.edge_start, ctx.edge_dir);
+		len = VectorNormalize (ctx.edge_dir);
 
-		start[i] = numsuperverts;
-		TestEdge (0, len, p1, p2, 0);
+		start[i] = ctx.numsuperverts;
+		TestEdge (ctx, 0, len, p1, p2, 0);
 
-		count[i] = numsuperverts - start[i];
+		count[i] = ctx.numsuperverts - start[i];
 	}
 
-	if (numsuperverts < 3)
+	result.degenerate = ctx.degenerate;
+	result.tjunctions = ctx.tjunctions;
+	result.superverts.RemoveAll();
+	result.triangles.RemoveAll();
+	result.badstartvert = false;
+	result.base = 0;
+
+	if (ctx.numsuperverts < 3)
 	{	// entire face collapsed
-		f->numpoints = 0;
-		c_facecollapse++;
 		return;
 	}
 
@@ -635,26 +815,23 @@ void FixFaceEdges (face_t **pList, face_t *f)
 	}
 	if (i == f->numpoints)
 	{
-		f->badstartvert = true;
-		c_badstartverts++;
-		base = 0;
+		result.badstartvert = true;
+		result.base = 0;
 
 	}
 	else
 	{	// rotate the vertex order
-		base = start[i];
+		result.base = start[i];
 	}
 
-	// this may fragment the face if > MAXEDGES
-	FaceFromSuperverts (pList, f, base);
+	result.superverts.CopyArray( ctx.superverts, ctx.numsuperverts );
 
 	// if this is the world, then re-triangulate to sew cracks
-	if ( f->badstartvert && entity_num == 0 )
+	if ( ( result.badstartvert || f->badstartvert ) && entity_num == 0 )
 	{
 		CUtlVector<face_vert_table_t> poly;
 		CUtlVector<int> inIndices;
-		CUtlVector<int> outIndices;
-		poly.AddMultipleToTail( numsuperverts );
+		poly.AddMultipleToTail( ctx.numsuperverts );
 		for ( i = 0; i < originalPoints; i++ )
 		{
 			// edge may not have output any points.  Don't mark
@@ -664,22 +841,61 @@ void FixFaceEdges (face_t **pList, face_t *f)
 			// we'll use this as a fast "is collinear" test
 			for ( int j = 0; j <= count[i]; j++ )
 			{
-				int polyIndex = (start[i] + j) % numsuperverts;
+				int polyIndex = (start[i] + j) % ctx.numsuperverts;
 				poly[polyIndex].AddEdge( i );
 			}
 		}
-		for ( i = 0; i < numsuperverts; i++ )
+		for ( i = 0; i < ctx.numsuperverts; i++ )
 		{
 			inIndices.AddToTail( i );
 		}
-		Triangulate_r( outIndices, inIndices, poly );
+		Triangulate_r( result.triangles, inIndices, poly );
+	}
+}
+
+/*
+==================
+ApplyFaceEdges
+
+Puts what FixFaceEdges worked out into the face
+==================
+*/
+void ApplyFaceEdges (face_t **pList, face_t *f, const tjuncresult_t &result)
+{
+	int		i;
+
+	c_degenerate += result.degenerate;
+	c_tjunctions += result.tjunctions;
+
+	if (result.superverts.Count() < 3)
+	{	// entire face collapsed
+		f->numpoints = 0;
+		c_facecollapse++;
+		return;
+	}
+
+	if (result.badstartvert)
+	{
+		f->badstartvert = true;
+		c_badstartverts++;
+	}
+
+	numsuperverts = result.superverts.Count();
+	memcpy (superverts, result.superverts.Base(), numsuperverts * sizeof(int));
+
+	// this may fragment the face if > MAXEDGES
+	FaceFromSuperverts (pList, f, result.base);
+
+	// if this is the world, then re-triangulate to sew cracks
+	if ( result.triangles.Count() )
+	{
 		dprimitive_t &newPrim = g_primitives[g_numprimitives];
 		f->firstPrimID = g_numprimitives;
 		g_numprimitives++;
 		f->numPrims = 1;
 		newPrim.firstIndex = g_numprimindices;
 		newPrim.firstVert = g_numprimverts;
-		newPrim.indexCount = outIndices.Count();
+		newPrim.indexCount = result.triangles.Count();
 		newPrim.vertCount = 0;
 		newPrim.type = PRIM_TRILIST;
 		g_numprimindices += newPrim.indexCount;
@@ -687,13 +903,58 @@ void FixFaceEdges (face_t **pList, face_t *f)
 		{
 			Error("Too many t-junctions to fix up! (%d prims, max %d :: %d indices, max %d)\n", g_numprimitives, MAX_MAP_PRIMITIVES, g_numprimindices, MAX_MAP_PRIMINDICES );
 		}
-		for ( i = 0; i < outIndices.Count(); i++ )
+		for ( i = 0; i < result.triangles.Count(); i++ )
 		{
-			g_primindices[newPrim.firstIndex + i] = outIndices[i];
+			g_primindices[newPrim.firstIndex + i] = result.triangles[i];
 		}
 	}
 }
 
+static void AddTJuncFace (face_t **pList, face_t *f)
+{
+	if (f->merged || f->split[0] || f->split[1])
+		return;
+
+	tjuncface_t &face = s_TJuncFaces[s_TJuncFaces.AddToTail()];
+	face.pList = pList;
+	face.f = f;
+}
+
+static void FixFaceEdgesThread (int iThread, int iFace)
+{
+	FixFaceEdges (s_TJuncContexts[iThread], s_TJuncFaces[iFace].f, s_TJuncResults[iFace]);
+}
+
+/*
+==================
+FixTJuncFaces
+
+Fixes the t-junctions on every face in s_TJuncFaces
+==================
+*/
+static void FixTJuncFaces (void)
+{
+	int		i;
+
+	if (!s_TJuncFaces.Count())
+		return;
+
+	BuildTJuncCells ();
+
+	s_TJuncContexts.SetCount (MAX_TOOL_THREADS);
+	s_TJuncResults.SetCount (s_TJuncFaces.Count());
+	RunThreadsOnIndividual (s_TJuncFaces.Count(), false, FixFaceEdgesThread);
+
+	for (i=0 ; i<s_TJuncFaces.Count() ; i++)
+	{
+		ApplyFaceEdges (s_TJuncFaces[i].pList, s_TJuncFaces[i].f, s_TJuncResults[i]);
+	}
+
+	s_TJuncFaces.Purge();
+	s_TJuncResults.Purge();
+	s_TJuncContexts.Purge();
+}
+
 /*
 ==================
 FixEdges_r
@@ -710,12 +971,18 @@ void FixEdges_r (node_t *node)
 	}
 
 	for (f=node->faces ; f ; f=f->next)
-		FixFaceEdges (&node->faces, f);
+		AddTJuncFace (&node->faces, f);
 
 	for (i=0 ; i<2 ; i++)
 		FixEdges_r (node->children[i]);
 }
 
+void FixNodeFaceEdges (node_t *headnode)
+{
+	FixEdges_r (headnode);
+	FixTJuncFaces ();
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: Fix the t-junctions on detail faces
@@ -726,8 +993,29 @@ void FixLeafFaceEdges( face_t **ppLeafFaceList )
 
 	for ( f = *ppLeafFaceList; f; f = f->next )
 	{
-		FixFaceEdges( ppLeafFaceList, f );
+		AddTJuncFace( ppLeafFaceList, f );
+	}
+	FixTJuncFaces();
+}
+
+
+static int CountFacePoints (face_t *pFaces)
+{
+	int count = 0;
+	for (face_t *f=pFaces ; f ; f=f->next)
+	{
+		if (f->w)
+			count += f->w->numpoints;
 	}
+	return count;
+}
+
+static int CountNodeFacePoints_r (node_t *node)
+{
+	if (node->planenum == PLANENUM_LEAF)
+		return 0;
+
+	return CountFacePoints (node->faces) + CountNodeFacePoints_r (node->children[0]) + CountNodeFacePoints_r (node->children[1]);
 }
 
 /*
@@ -741,8 +1029,9 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 {
 	// snap and merge all vertexes
 	qprintf ("---- snap verts ----\n");
-	memset (hashverts, 0, sizeof(hashverts));
-	memset (vertexchain, 0, sizeof(vertexchain));
+	s_VertexCells.RemoveAll();
+	s_VertexCells.Reserve( CountNodeFacePoints_r (headnode) + CountFacePoints (pLeafFaceList) );
+	s_HashedVerts.RemoveAll();
 	c_totalverts = 0;
 	c_uniqueverts = 0;
 	c_faceoverflows = 0;
@@ -759,7 +1048,7 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 	
 	if ( g_bAllowDetailCracks )
 	{
-		FixEdges_r (headnode);
+		FixNodeFaceEdges (headnode);
 		EmitLeafFaceVertexes( &pLeafFaceList );
 		FixLeafFaceEdges( &pLeafFaceList );
 	}
@@ -768,7 +1057,7 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 		EmitLeafFaceVertexes( &pLeafFaceList );
 		if (!notjunc)
 		{
-			FixEdges_r (headnode);
+			FixNodeFaceEdges (headnode);
 			FixLeafFaceEdges( &pLeafFaceList );
 		}
 	}
@@ -839,28 +1128,26 @@ void FreeFaceList( face_t *pFaces )
 
 //========================================================
 
-void GetEdge2_InitOptimizedList()
+// Used to speed up GetEdge2(). Edges with the same v[0] and v[1] are chained
+// together in the order they were added, and the chains are hashed by the pair.
+struct edgechain_t
 {
-	for( int i=0; i < MAX_MAP_VERTS; i++ )
-		g_VertEdgeList[i].RemoveAll();
-}
+	int		first;
+	int		last;
+};
 
+static CUtlHashtable< uint32, edgechain_t >	s_EdgeChains;
+static int	s_NextEdgeInChain[MAX_MAP_EDGES];		// -1 at the end of a chain
 
-void IntSort( CUtlVector<int> &theList )
+inline uint32 EdgeKey( int v1, int v2 )
 {
-	for( int i=0; i < theList.Size()-1; i++ )
-	{
-		if( theList[i] > theList[i+1] )
-		{
-			int temp = theList[i];
-			theList[i] = theList[i+1];
-			theList[i+1] = temp;
-			if( i > 0 )
-				i -= 2;
-			else
-				i = -1;
-		}
-	}
+	COMPILE_TIME_ASSERT( MAX_MAP_VERTS <= 0x10000 );
+	return (uint32)v1 | ( (uint32)v2 << 16 );
+}
+
+void GetEdge2_InitOptimizedList()
+{
+	s_EdgeChains.RemoveAll();
 }
 
 
@@ -869,10 +1156,16 @@ int AddEdge( int v1, int v2, face_t *f )
 	if (numedges >= MAX_MAP_EDGES)
 		Error ("Too many edges in map, max == %d", MAX_MAP_EDGES);
 
-	g_VertEdgeList[v1].AddToTail( numedges );
-	g_VertEdgeList[v2].AddToTail( numedges );
-	IntSort( g_VertEdgeList[v1] );
-	IntSort( g_VertEdgeList[v2] );
+	edgechain_t chain;
+	chain.first = chain.last = numedges;
+	bool inserted;
+	UtlHashHandle_t h = s_EdgeChains.Insert( EdgeKey( v1, v2 ), chain, &inserted );
+	if ( !inserted )
+	{
+		s_NextEdgeInChain[s_EdgeChains[h].last] = numedges;
+		s_EdgeChains[h].last = numedges;
+	}
+	s_NextEdgeInChain[numedges] = -1;
 			  
 	dedge_t *edge = &dedges[numedges];
 	numedges++;
@@ -900,11 +1193,11 @@ int GetEdge2 (int v1, int v2,  face_t *f)
 
 	if (!noshare)
 	{
-		// Check all edges connected to v1.
-		CUtlVector<int> &theList = g_VertEdgeList[v1];
-		for( int i=0; i < theList.Size(); i++ )
+		// Check all edges going from v2 to v1.
+		UtlHashHandle_t h = s_EdgeChains.Find( EdgeKey( v2, v1 ) );
+		int iFirstEdge = ( h != s_EdgeChains.InvalidHandle() ) ? s_EdgeChains[h].first : -1;
+		for( int iEdge = iFirstEdge; iEdge >= 0; iEdge = s_NextEdgeInChain[iEdge] )
 		{
-			int iEdge = theList[i];
 			edge = &dedges[iEdge];
 			if (v1 == edge->v[1] && v2 == edge->v[0] && edgefaces[iEdge][0]->contents == f->contents)
 			{
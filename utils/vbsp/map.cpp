@@ -32,6 +32,8 @@
 											// currently don't know how that number was 
 											// come to (cab) - this is 0.01 of an inch
 											// for clipping brush solids
+struct PreparsedSolid_t;
+
 struct LoadSide_t
 {
 	mapbrush_t *pBrush;
@@ -41,6 +43,8 @@ struct LoadSide_t
 	int nBaseContents;
 	Vector planepts[3];
 	brush_texture_t	td;
+	const PreparsedSolid_t *pPreparsed;	// Set when the side is replayed from a preparsed solid
+	int nEvent;							// Position in pPreparsed's events
 };
 
 
@@ -805,6 +809,43 @@ void CMapFile::RemoveContentsDetailFromEntity( entity_t *mapent )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Splits a displacement row into its values the same way strtok does,
+//			but keeps its position in the caller's pointer instead of a static so
+//			rows can be read on several threads at once.
+// Input  : ppszRow - Current position in the row. Advanced past the value.
+// Output : Returns the next value, or NULL at the end of the row.
+//-----------------------------------------------------------------------------
+static char *NextDispRowValue(char **ppszRow)
+{
+	char *pszValue = *ppszRow;
+	while (*pszValue == ' ')
+	{
+		pszValue++;
+	}
+
+	if (*pszValue == '\0')
+	{
+		*ppszRow = pszValue;
+		return(NULL);
+	}
+
+	char *pszEnd = pszValue;
+	while ((*pszEnd != '\0') && (*pszEnd != ' '))
+	{
+		pszEnd++;
+	}
+
+	if (*pszEnd != '\0')
+	{
+		*pszEnd++ = '\0';
+	}
+
+	*ppszRow = pszEnd;
+	return(pszValue);
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *pFile - 
@@ -830,17 +871,18 @@ ChunkFileResult_t LoadDispDistancesKeyCallback(const char *szKey, const char *sz
 	{
 		char szBuf[MAX_KEYVALUE_LEN];
 		strcpy(szBuf, szValue);
+		char *pszRow = szBuf;
 
 		int nCols = (1 << pMapDispInfo->power) + 1;
 		int nRow = atoi(&szKey[3]);
 
-		char *pszNext = strtok(szBuf, " ");
+		char *pszNext = NextDispRowValue(&pszRow);
 		int nIndex = nRow * nCols;
 
 		while (pszNext != NULL)
 		{
 			pMapDispInfo->dispDists[nIndex] = (float)atof(pszNext);
-			pszNext = strtok(NULL, " ");
+			pszNext = NextDispRowValue(&pszRow);
 			nIndex++;
 		}
 	}
@@ -850,11 +892,9 @@ ChunkFileResult_t LoadDispDistancesKeyCallback(const char *szKey, const char *sz
 
 
 //-----------------------------------------------------------------------------
-// Purpose: load in the displacement info "chunk" from the .map file into the
-//          vbsp map displacement info data structure
-// Output : return the index of the map displacement info
+// Purpose: Hands out the next displacement info slot.
 //-----------------------------------------------------------------------------
-ChunkFileResult_t LoadDispInfoCallback(CChunkFile *pFile, mapdispinfo_t **ppMapDispInfo )
+static mapdispinfo_t *AllocMapDispInfo( void )
 {
     //
     // check to see if we exceeded the maximum displacement info list size
@@ -868,6 +908,16 @@ ChunkFileResult_t LoadDispInfoCallback(CChunkFile *pFile, mapdispinfo_t **ppMapD
     mapdispinfo_t *pMapDispInfo = &mapdispinfo[nummapdispinfo];
     nummapdispinfo++;
 
+	return pMapDispInfo;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the keys and subchunks of a dispinfo chunk into pMapDispInfo.
+//			This doesn't touch any globals so it can run on any thread.
+//-----------------------------------------------------------------------------
+static ChunkFileResult_t ReadDispInfoChunk(CChunkFile *pFile, mapdispinfo_t *pMapDispInfo)
+{
 	//
 	// Set up handlers for the subchunks that we are interested in.
 	//
@@ -889,6 +939,20 @@ ChunkFileResult_t LoadDispInfoCallback(CChunkFile *pFile, mapdispinfo_t **ppMapD
 	ChunkFileResult_t eResult = pFile->ReadChunk((KeyHandler_t)LoadDispInfoKeyCallback, pMapDispInfo);
 	pFile->PopHandlers();
 
+	return(eResult);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: load in the displacement info "chunk" from the .map file into the
+//          vbsp map displacement info data structure
+// Output : return the index of the map displacement info
+//-----------------------------------------------------------------------------
+ChunkFileResult_t LoadDispInfoCallback(CChunkFile *pFile, mapdispinfo_t **ppMapDispInfo )
+{
+	mapdispinfo_t *pMapDispInfo = AllocMapDispInfo();
+	ChunkFileResult_t eResult = ReadDispInfoChunk(pFile, pMapDispInfo);
+
 	if (eResult == ChunkFile_Ok)
 	{
 		// return a pointer to the displacement info
@@ -978,13 +1042,14 @@ ChunkFileResult_t LoadDispNormalsKeyCallback(const char *szKey, const char *szVa
 	{
 		char szBuf[MAX_KEYVALUE_LEN];
 		strcpy(szBuf, szValue);
+		char *pszRow = szBuf;
 
 		int nCols = (1 << pMapDispInfo->power) + 1;
 		int nRow = atoi(&szKey[3]);
 
-		char *pszNext0 = strtok(szBuf, " ");
-		char *pszNext1 = strtok(NULL, " ");
-		char *pszNext2 = strtok(NULL, " ");
+		char *pszNext0 = NextDispRowValue(&pszRow);
+		char *pszNext1 = NextDispRowValue(&pszRow);
+		char *pszNext2 = NextDispRowValue(&pszRow);
 
 		int nIndex = nRow * nCols;
 
@@ -994,9 +1059,9 @@ ChunkFileResult_t LoadDispNormalsKeyCallback(const char *szKey, const char *szVa
 			pMapDispInfo->vectorDisps[nIndex][1] = (float)atof(pszNext1);
 			pMapDispInfo->vectorDisps[nIndex][2] = (float)atof(pszNext2);
 
-			pszNext0 = strtok(NULL, " ");
-			pszNext1 = strtok(NULL, " ");
-			pszNext2 = strtok(NULL, " ");
+			pszNext0 = NextDispRowValue(&pszRow);
+			pszNext1 = NextDispRowValue(&pszRow);
+			pszNext2 = NextDispRowValue(&pszRow);
 
 			nIndex++;
 		}
@@ -1032,13 +1097,14 @@ ChunkFileResult_t LoadDispOffsetsKeyCallback(const char *szKey, const char *szVa
 	{
 		char szBuf[MAX_KEYVALUE_LEN];
 		strcpy(szBuf, szValue);
+		char *pszRow = szBuf;
 
 		int nCols = (1 << pMapDispInfo->power) + 1;
 		int nRow = atoi(&szKey[3]);
 
-		char *pszNext0 = strtok(szBuf, " ");
-		char *pszNext1 = strtok(NULL, " ");
-		char *pszNext2 = strtok(NULL, " ");
+		char *pszNext0 = NextDispRowValue(&pszRow);
+		char *pszNext1 = NextDispRowValue(&pszRow);
+		char *pszNext2 = NextDispRowValue(&pszRow);
 
 		int nIndex = nRow * nCols;
 
@@ -1048,9 +1114,9 @@ ChunkFileResult_t LoadDispOffsetsKeyCallback(const char *szKey, const char *szVa
 			pMapDispInfo->vectorOffsets[nIndex][1] = (float)atof(pszNext1);
 			pMapDispInfo->vectorOffsets[nIndex][2] = (float)atof(pszNext2);
 
-			pszNext0 = strtok(NULL, " ");
-			pszNext1 = strtok(NULL, " ");
-			pszNext2 = strtok(NULL, " ");
+			pszNext0 = NextDispRowValue(&pszRow);
+			pszNext1 = NextDispRowValue(&pszRow);
+			pszNext2 = NextDispRowValue(&pszRow);
 
 			nIndex++;
 		}
@@ -1073,13 +1139,14 @@ ChunkFileResult_t LoadDispOffsetNormalsKeyCallback(const char *szKey, const char
 	{
 		char szBuf[MAX_KEYVALUE_LEN];
 		strcpy(szBuf, szValue);
+		char *pszRow = szBuf;
 
 		int nCols = (1 << pMapDispInfo->power) + 1;
 		int nRow = atoi(&szKey[3]);
 
-		char *pszNext0 = strtok(szBuf, " ");
-		char *pszNext1 = strtok(NULL, " ");
-		char *pszNext2 = strtok(NULL, " ");
+		char *pszNext0 = NextDispRowValue(&pszRow);
+		char *pszNext1 = NextDispRowValue(&pszRow);
+		char *pszNext2 = NextDispRowValue(&pszRow);
 
 		int nIndex = nRow * nCols;
 
@@ -1089,9 +1156,9 @@ ChunkFileResult_t LoadDispOffsetNormalsKeyCallback(const char *szKey, const char
 			pMapDispInfo->m_offsetNormals[nIndex][1] = (float)atof(pszNext1);
 			pMapDispInfo->m_offsetNormals[nIndex][2] = (float)atof(pszNext2);
 
-			pszNext0 = strtok(NULL, " ");
-			pszNext1 = strtok(NULL, " ");
-			pszNext2 = strtok(NULL, " ");
+			pszNext0 = NextDispRowValue(&pszRow);
+			pszNext1 = NextDispRowValue(&pszRow);
+			pszNext2 = NextDispRowValue(&pszRow);
 
 			nIndex++;
 		}
@@ -1128,18 +1195,19 @@ ChunkFileResult_t LoadDispAlphasKeyCallback(const char *szKey, const char *szVal
 	{
 		char szBuf[MAX_KEYVALUE_LEN];
 		strcpy(szBuf, szValue);
+		char *pszRow = szBuf;
 
 		int nCols = (1 << pMapDispInfo->power) + 1;
 		int nRow = atoi(&szKey[3]);
 
-		char *pszNext0 = strtok(szBuf, " ");
+		char *pszNext0 = NextDispRowValue(&pszRow);
 
 		int nIndex = nRow * nCols;
 
 		while (pszNext0 != NULL)
 		{
 			pMapDispInfo->alphaValues[nIndex] = (float)atof(pszNext0);
-			pszNext0 = strtok(NULL, " ");
+			pszNext0 = NextDispRowValue(&pszRow);
 			nIndex++;
 		}
 	}
@@ -1162,11 +1230,12 @@ ChunkFileResult_t LoadDispTriangleTagsKeyCallback(const char *szKey, const char
 	{
 		char szBuf[MAX_KEYVALUE_LEN];
 		strcpy( szBuf, szValue );
+		char *pszRow = szBuf;
 
 		int nCols = ( 1 << pMapDispInfo->power );
 		int nRow = atoi( &szKey[3] );
 
-		char *pszNext = strtok( szBuf, " " );
+		char *pszNext = NextDispRowValue(&pszRow);
 
 		int nIndex = nRow * nCols;
 		int iTri = nIndex * 2;
@@ -1202,7 +1271,7 @@ ChunkFileResult_t LoadDispTriangleTagsKeyCallback(const char *szKey, const char
 			}
 
 			pMapDispInfo->triTags[iTri] = nTriTags;
-			pszNext = strtok( NULL, " " );
+			pszNext = NextDispRowValue(&pszRow);
 			iTri++;
 		}
 	}
@@ -2523,6 +2592,423 @@ void CMapFile::MergeOverlays( entity_t *pInstanceEntity, CMapFile *Instance, Vec
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Parses the three points of a side's "plane" key.
+// Output : Returns what sscanf returned. Only that many values are filled in.
+//-----------------------------------------------------------------------------
+static int ParseSidePlanePoints( const char *szValue, float flValues[9] )
+{
+	return sscanf( szValue, "(%f %f %f) (%f %f %f) (%f %f %f)",
+		&flValues[0], &flValues[1], &flValues[2],
+		&flValues[3], &flValues[4], &flValues[5],
+		&flValues[6], &flValues[7], &flValues[8] );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Parses a side's "uaxis" or "vaxis" key: the axis, the shift and the
+//			texture scale.
+// Output : Returns what sscanf returned. Only that many values are filled in.
+//-----------------------------------------------------------------------------
+static int ParseSideTextureAxis( const char *szValue, float flValues[5] )
+{
+	return sscanf( szValue, "[%f %f %f %f] %f", &flValues[0], &flValues[1], &flValues[2], &flValues[3], &flValues[4] );
+}
+
+
+static void SetSidePlanePoints( LoadSide_t *pSideInfo, const float *flValues, int nRead )
+{
+	for ( int i = 0; i < nRead; i++ )
+	{
+		pSideInfo->planepts[i / 3][i % 3] = flValues[i];
+	}
+
+	if (nRead != 9)
+	{
+		g_MapError.ReportError("parsing plane definition");
+	}
+}
+
+
+static void SetSideTextureAxis( LoadSide_t *pSideInfo, int nAxis, const float *flValues, int nRead )
+{
+	brush_texture_t &td = pSideInfo->td;
+	float *pDest[5] = 
+	{
+		nAxis ? &td.VAxis[0] : &td.UAxis[0],
+		nAxis ? &td.VAxis[1] : &td.UAxis[1],
+		nAxis ? &td.VAxis[2] : &td.UAxis[2],
+		&td.shift[nAxis],
+		&td.textureWorldUnitsPerTexel[nAxis]
+	};
+
+	for ( int i = 0; i < nRead; i++ )
+	{
+		*pDest[i] = flValues[i];
+	}
+
+	if (nRead != 5)
+	{
+		g_MapError.ReportError( nAxis ? "parsing V axis definition" : "parsing U axis definition" );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Preparsing solids
+//
+// Most of a VMF is solids, and most of the time spent reading one goes into
+// splitting their sides and displacements into keys and parsing the numbers
+// in them. When the map is memory mapped, LoadMapFile first finds every solid
+// in the world and entity chunks by matching braces, then reads them all on
+// the worker threads into a list of events: the keys in file order, with the
+// plane, texture axis and displacement values already parsed. The solid and
+// side callbacks replay those events when they reach each solid instead of
+// reading it, so everything that depends on order (planes, texinfos,
+// displacement slots, error reporting) happens exactly as before. A solid that
+// didn't read cleanly on its thread is read in place so its error comes out
+// the usual way.
+//-----------------------------------------------------------------------------
+
+enum PreparsedEventType_t
+{
+	PREPARSED_SOLID_KEY = 0,
+	PREPARSED_SIDE_BEGIN,
+	PREPARSED_SIDE_KEY,			// A side key that isn't parsed ahead of time
+	PREPARSED_SIDE_PLANE,
+	PREPARSED_SIDE_UAXIS,
+	PREPARSED_SIDE_VAXIS,
+	PREPARSED_SIDE_DISPINFO,
+	PREPARSED_SIDE_END
+};
+
+struct PreparsedEvent_t
+{
+	unsigned char	m_nType;
+	signed char		m_nRead;	// What sscanf returned for the plane and axis events
+	int				m_nData;	// Offset of the key in m_Strings, of the values in m_Values, or the index in m_DispInfos
+};
+
+struct PreparsedSolid_t
+{
+	PreparsedSolid_t() : m_nStart( 0 ), m_nEnd( 0 ), m_nLine( 0 ), m_bParsed( false ) {}
+	~PreparsedSolid_t()	{ Purge(); }
+
+	void Purge()
+	{
+		m_Events.Purge();
+		m_Strings.Purge();
+		m_Values.Purge();
+		m_DispInfos.PurgeAndDeleteElements();
+	}
+
+	PreparsedEvent_t &AddEvent( int nType, int nData = 0 )
+	{
+		PreparsedEvent_t &event = m_Events[m_Events.AddToTail()];
+		event.m_nType = nType;
+		event.m_nRead = 0;
+		event.m_nData = nData;
+		return event;
+	}
+
+	// Stores the key followed by the value.
+	int AddKey( const char *szKey, const char *szValue )
+	{
+		int nKey = m_Strings.Count();
+		m_Strings.AddMultipleToTail( V_strlen( szKey ) + 1, szKey );
+		m_Strings.AddMultipleToTail( V_strlen( szValue ) + 1, szValue );
+		return nKey;
+	}
+
+	const char *GetKey( const PreparsedEvent_t &event ) const	{ return &m_Strings[event.m_nData]; }
+	const char *GetValue( const PreparsedEvent_t &event ) const	{ return &m_Strings[event.m_nData + V_strlen( GetKey( event ) ) + 1]; }
+
+	int				m_nStart;		// Buffer offset just past the solid's open brace
+	int				m_nEnd;			// Buffer offset just past its close brace
+	int				m_nLine;		// Line the solid starts on
+	bool			m_bParsed;		// False if it has to be read in place
+
+	CUtlVector<PreparsedEvent_t>	m_Events;
+	CUtlVector<char>				m_Strings;
+	CUtlVector<float>				m_Values;
+	CUtlVector<mapdispinfo_t*>		m_DispInfos;
+};
+
+static CChunkFile							*g_pPreparsedFile = NULL;
+static CUtlVector<PreparsedSolid_t*>		g_PreparsedSolids;
+static int									g_iNextPreparsedSolid = 0;
+
+
+static ChunkFileResult_t PreparseSolidKeyCallback( const char *szKey, const char *szValue, PreparsedSolid_t *pSolid )
+{
+	pSolid->AddEvent( PREPARSED_SOLID_KEY, pSolid->AddKey( szKey, szValue ) );
+	return ChunkFile_Ok;
+}
+
+
+static ChunkFileResult_t PreparseSideKeyCallback( const char *szKey, const char *szValue, PreparsedSolid_t *pSolid )
+{
+	int nType = PREPARSED_SIDE_KEY;
+	if ( !stricmp( szKey, "plane" ) )
+	{
+		nType = PREPARSED_SIDE_PLANE;
+	}
+	else if ( !stricmp( szKey, "uaxis" ) )
+	{
+		nType = PREPARSED_SIDE_UAXIS;
+	}
+	else if ( !stricmp( szKey, "vaxis" ) )
+	{
+		nType = PREPARSED_SIDE_VAXIS;
+	}
+
+	if ( nType == PREPARSED_SIDE_KEY )
+	{
+		pSolid->AddEvent( nType, pSolid->AddKey( szKey, szValue ) );
+		return ChunkFile_Ok;
+	}
+
+	float flValues[9];
+	int nRead = ( nType == PREPARSED_SIDE_PLANE ) ? ParseSidePlanePoints( szValue, flValues ) : ParseSideTextureAxis( szValue, flValues );
+
+	PreparsedEvent_t &event = pSolid->AddEvent( nType, pSolid->m_Values.Count() );
+	event.m_nRead = nRead;
+	if ( nRead > 0 )
+	{
+		pSolid->m_Values.AddMultipleToTail( nRead, flValues );
+	}
+
+	return ChunkFile_Ok;
+}
+
+
+static ChunkFileResult_t PreparseDispInfoCallback( CChunkFile *pFile, PreparsedSolid_t *pSolid )
+{
+	mapdispinfo_t *pMapDispInfo = new mapdispinfo_t;
+	memset( pMapDispInfo, 0, sizeof( *pMapDispInfo ) );
+
+	pSolid->AddEvent( PREPARSED_SIDE_DISPINFO, pSolid->m_DispInfos.AddToTail( pMapDispInfo ) );
+	return ReadDispInfoChunk( pFile, pMapDispInfo );
+}
+
+
+static ChunkFileResult_t PreparseSideCallback( CChunkFile *pFile, PreparsedSolid_t *pSolid )
+{
+	pSolid->AddEvent( PREPARSED_SIDE_BEGIN );
+
+	CChunkHandlerMap Handlers;
+	Handlers.AddHandler( "dispinfo", ( ChunkHandler_t )PreparseDispInfoCallback, pSolid );
+
+	pFile->PushHandlers( &Handlers );
+	ChunkFileResult_t eResult = pFile->ReadChunk( ( KeyHandler_t )PreparseSideKeyCallback, pSolid );
+	pFile->PopHandlers();
+
+	pSolid->AddEvent( PREPARSED_SIDE_END );
+	return eResult;
+}
+
+
+static void PreparseSolidThread( int iThread, int iSolid )
+{
+	PreparsedSolid_t *pSolid = g_PreparsedSolids[iSolid];
+
+	int nBufferSize;
+	const char *pBuffer = g_pPreparsedFile->GetBuffer( &nBufferSize );
+
+	// Only the solid's own text is visible to this reader, so it can't wander into the next one.
+	CChunkFile File;
+	File.OpenBuffer( "", pBuffer + pSolid->m_nStart, pSolid->m_nEnd - pSolid->m_nStart, pSolid->m_nLine );
+
+	CChunkHandlerMap Handlers;
+	Handlers.AddHandler( "side", ( ChunkHandler_t )PreparseSideCallback, pSolid );
+
+	File.PushHandlers( &Handlers );
+	ChunkFileResult_t eResult = File.ReadChunk( ( KeyHandler_t )PreparseSolidKeyCallback, pSolid );
+	File.PopHandlers();
+
+	pSolid->m_bParsed = ( eResult == ChunkFile_Ok ) && ( File.GetBufferOffset() == pSolid->m_nEnd - pSolid->m_nStart );
+	if ( !pSolid->m_bParsed )
+	{
+		pSolid->Purge();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the solids in a memory mapped VMF and reads them on all threads.
+//-----------------------------------------------------------------------------
+static void PreparseVMFSolids( CChunkFile *pFile, const char *pszFileName )
+{
+	int nBufferSize;
+	const char *pBuffer = pFile->GetBuffer( &nBufferSize );
+	if ( !pBuffer || numthreads <= 1 )
+		return;
+
+	//
+	// Walk the top level chunks. Solids only count if they are directly inside a world
+	// or entity chunk since that's the only place LoadEntityCallback looks for them.
+	// Anything the scan doesn't understand is left for the real read to report.
+	//
+	CChunkFile Scan;
+	Scan.OpenBuffer( pszFileName, pBuffer, nBufferSize );
+
+	bool bInEntity = false;
+	while ( true )
+	{
+		char szName[MAX_KEYVALUE_LEN];
+		char szValue[MAX_KEYVALUE_LEN];
+		ChunkType_t eChunkType;
+
+		ChunkFileResult_t eResult = Scan.ReadNext( szName, szValue, sizeof( szValue ), eChunkType );
+		if ( eResult == ChunkFile_EndOfChunk )
+		{
+			bInEntity = false;
+			continue;
+		}
+
+		if ( eResult != ChunkFile_Ok )
+			break;
+
+		if ( eChunkType != ChunkType_Chunk )
+			continue;
+
+		if ( !bInEntity && ( !stricmp( szName, "world" ) || !stricmp( szName, "entity" ) ) )
+		{
+			bInEntity = true;
+			continue;
+		}
+
+		PreparsedSolid_t *pSolid = NULL;
+		if ( bInEntity && !stricmp( szName, "solid" ) )
+		{
+			pSolid = new PreparsedSolid_t;
+			pSolid->m_nStart = Scan.GetBufferOffset();
+			pSolid->m_nLine = Scan.GetLine();
+		}
+
+		if ( Scan.SkipChunk() != ChunkFile_Ok )
+		{
+			delete pSolid;
+			break;
+		}
+
+		if ( pSolid )
+		{
+			pSolid->m_nEnd = Scan.GetBufferOffset();
+			g_PreparsedSolids.AddToTail( pSolid );
+		}
+	}
+
+	g_pPreparsedFile = pFile;
+	g_iNextPreparsedSolid = 0;
+
+	RunThreadsOnIndividual( g_PreparsedSolids.Count(), false, PreparseSolidThread );
+}
+
+
+static void FreePreparsedVMFSolids()
+{
+	g_PreparsedSolids.PurgeAndDeleteElements();
+	g_pPreparsedFile = NULL;
+	g_iNextPreparsedSolid = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the preparsed copy of the solid pFile has just entered, or
+//			NULL if it has to be read in place.
+//-----------------------------------------------------------------------------
+static PreparsedSolid_t *GetPreparsedSolid( CChunkFile *pFile )
+{
+	if ( pFile != g_pPreparsedFile )
+		return NULL;
+
+	int nOffset = pFile->GetBufferOffset();
+	while ( ( g_iNextPreparsedSolid < g_PreparsedSolids.Count() ) && ( g_PreparsedSolids[g_iNextPreparsedSolid]->m_nStart < nOffset ) )
+	{
+		g_iNextPreparsedSolid++;
+	}
+
+	if ( g_iNextPreparsedSolid == g_PreparsedSolids.Count() )
+		return NULL;
+
+	PreparsedSolid_t *pSolid = g_PreparsedSolids[g_iNextPreparsedSolid];
+	if ( ( pSolid->m_nStart != nOffset ) || !pSolid->m_bParsed )
+		return NULL;
+
+	g_iNextPreparsedSolid++;
+	return pSolid;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Does what reading a side chunk's keys and dispinfo would have done.
+//			pSideInfo->nEvent is on the side's PREPARSED_SIDE_BEGIN event and is
+//			left on its PREPARSED_SIDE_END event.
+//-----------------------------------------------------------------------------
+static void ReplayPreparsedSide( LoadSide_t *pSideInfo )
+{
+	const PreparsedSolid_t *pSolid = pSideInfo->pPreparsed;
+	while ( ++pSideInfo->nEvent < pSolid->m_Events.Count() )
+	{
+		const PreparsedEvent_t &event = pSolid->m_Events[pSideInfo->nEvent];
+		switch ( event.m_nType )
+		{
+		case PREPARSED_SIDE_KEY:
+			LoadSideKeyCallback( pSolid->GetKey( event ), pSolid->GetValue( event ), pSideInfo );
+			break;
+
+		case PREPARSED_SIDE_PLANE:
+			SetSidePlanePoints( pSideInfo, pSolid->m_Values.Base() + event.m_nData, event.m_nRead );
+			break;
+
+		case PREPARSED_SIDE_UAXIS:
+		case PREPARSED_SIDE_VAXIS:
+			SetSideTextureAxis( pSideInfo, ( event.m_nType == PREPARSED_SIDE_VAXIS ), pSolid->m_Values.Base() + event.m_nData, event.m_nRead );
+			break;
+
+		case PREPARSED_SIDE_DISPINFO:
+			{
+				// The slot has never been used, so copying the whole thing over it is the
+				// same as reading the chunk into it.
+				mapdispinfo_t *pMapDispInfo = AllocMapDispInfo();
+				memcpy( pMapDispInfo, pSolid->m_DispInfos[event.m_nData], sizeof( *pMapDispInfo ) );
+				pSideInfo->pSide->pMapDisp = pMapDispInfo;
+			}
+			break;
+
+		case PREPARSED_SIDE_END:
+			return;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Does what reading a solid chunk would have done, and frees the
+//			preparsed copy.
+//-----------------------------------------------------------------------------
+static void ReplayPreparsedSolid( PreparsedSolid_t *pSolid, LoadSide_t *pSideInfo )
+{
+	pSideInfo->pPreparsed = pSolid;
+	for ( pSideInfo->nEvent = 0; pSideInfo->nEvent < pSolid->m_Events.Count(); pSideInfo->nEvent++ )
+	{
+		const PreparsedEvent_t &event = pSolid->m_Events[pSideInfo->nEvent];
+		if ( event.m_nType == PREPARSED_SOLID_KEY )
+		{
+			LoadSolidKeyCallback( pSolid->GetKey( event ), pSolid->GetValue( event ), pSideInfo->pBrush );
+		}
+		else if ( event.m_nType == PREPARSED_SIDE_BEGIN )
+		{
+			LoadSideCallback( NULL, pSideInfo );
+		}
+	}
+	pSideInfo->pPreparsed = NULL;
+
+	pSolid->Purge();
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Loads a VMF or MAP file. If the file has a .MAP extension, the MAP
 //			loader is used, otherwise the file is assumed to be in VMF format.
@@ -2591,6 +3077,8 @@ bool LoadMapFile( const char *pszFileName )
 			Handlers.AddHandler("world", (ChunkHandler_t)LoadEntityCallback, 0);
 			Handlers.AddHandler("entity", (ChunkHandler_t)LoadEntityCallback, 0);
 
+			PreparseVMFSolids(&File, pszFileName);
+
 			File.PushHandlers(&Handlers);
 
 			//
@@ -2602,6 +3090,8 @@ bool LoadMapFile( const char *pszFileName )
 			}
 
 			File.PopHandlers();
+
+			FreePreparsedVMFSolids();
 		}
 		else
 		{
@@ -2689,18 +3179,26 @@ ChunkFileResult_t CMapFile::LoadSideCallback(CChunkFile *pFile, LoadSide_t *pSid
 	// initialize the displacement info
 	pSideInfo->pSide->pMapDisp = NULL;
 
-	//
-	// Set up handlers for the subchunks that we are interested in.
-	//
-	CChunkHandlerMap Handlers;
-	Handlers.AddHandler( "dispinfo", ( ChunkHandler_t )LoadDispInfoCallback, &side->pMapDisp );
+	ChunkFileResult_t eResult = ChunkFile_Ok;
+	if (pSideInfo->pPreparsed)
+	{
+		ReplayPreparsedSide(pSideInfo);
+	}
+	else
+	{
+		//
+		// Set up handlers for the subchunks that we are interested in.
+		//
+		CChunkHandlerMap Handlers;
+		Handlers.AddHandler( "dispinfo", ( ChunkHandler_t )LoadDispInfoCallback, &side->pMapDisp );
 
-	//
-	// Read the side chunk.
-	//
-	pFile->PushHandlers(&Handlers);
-	ChunkFileResult_t eResult = pFile->ReadChunk((KeyHandler_t)LoadSideKeyCallback, pSideInfo);
-	pFile->PopHandlers();
+		//
+		// Read the side chunk.
+		//
+		pFile->PushHandlers(&Handlers);
+		eResult = pFile->ReadChunk((KeyHandler_t)LoadSideKeyCallback, pSideInfo);
+		pFile->PopHandlers();
+	}
 
 	if (eResult == ChunkFile_Ok)
 	{
@@ -2807,15 +3305,8 @@ ChunkFileResult_t LoadSideKeyCallback(const char *szKey, const char *szValue, Lo
 {
 	if (!stricmp(szKey, "plane"))
 	{
-		int nRead = sscanf(szValue, "(%f %f %f) (%f %f %f) (%f %f %f)",
-			&pSideInfo->planepts[0][0], &pSideInfo->planepts[0][1], &pSideInfo->planepts[0][2],
-			&pSideInfo->planepts[1][0], &pSideInfo->planepts[1][1], &pSideInfo->planepts[1][2],
-			&pSideInfo->planepts[2][0],  &pSideInfo->planepts[2][1],  &pSideInfo->planepts[2][2]);
-
-		if (nRead != 9)
-		{
-			g_MapError.ReportError("parsing plane definition");
-		}
+		float flValues[9];
+		SetSidePlanePoints(pSideInfo, flValues, ParseSidePlanePoints(szValue, flValues));
 	}
 	else if (!stricmp(szKey, "material"))
 	{
@@ -2838,19 +3329,13 @@ ChunkFileResult_t LoadSideKeyCallback(const char *szKey, const char *szValue, Lo
 	}
 	else if (!stricmp(szKey, "uaxis"))
 	{
-		int nRead = sscanf(szValue, "[%f %f %f %f] %f", &pSideInfo->td.UAxis[0], &pSideInfo->td.UAxis[1], &pSideInfo->td.UAxis[2], &pSideInfo->td.shift[0], &pSideInfo->td.textureWorldUnitsPerTexel[0]);
-		if (nRead != 5)
-		{
-			g_MapError.ReportError("parsing U axis definition");
-		}
+		float flValues[5];
+		SetSideTextureAxis(pSideInfo, 0, flValues, ParseSideTextureAxis(szValue, flValues));
 	}
 	else if (!stricmp(szKey, "vaxis"))
 	{
-		int nRead = sscanf(szValue, "[%f %f %f %f] %f", &pSideInfo->td.VAxis[0], &pSideInfo->td.VAxis[1], &pSideInfo->td.VAxis[2], &pSideInfo->td.shift[1], &pSideInfo->td.textureWorldUnitsPerTexel[1]);
-		if (nRead != 5)
-		{
-			g_MapError.ReportError("parsing V axis definition");
-		}
+		float flValues[5];
+		SetSideTextureAxis(pSideInfo, 1, flValues, ParseSideTextureAxis(szValue, flValues));
 	}
 	else if (!stricmp(szKey, "lightmapscale"))
 	{
@@ -2978,19 +3463,37 @@ ChunkFileResult_t CMapFile::LoadSolidCallback(CChunkFile *pFile, LoadEntity_t *p
 	SideInfo.nSideIndex = 0;
 	SideInfo.nBaseContents = pLoadEntity->nBaseContents;
 	SideInfo.nBaseFlags = pLoadEntity->nBaseFlags;
+	SideInfo.pPreparsed = NULL;
+	SideInfo.nEvent = 0;
 
-	//
-	// Set up handlers for the subchunks that we are interested in.
-	//
-	CChunkHandlerMap Handlers;
-	Handlers.AddHandler("side", (ChunkHandler_t)::LoadSideCallback, &SideInfo);
+	ChunkFileResult_t eResult;
+	PreparsedSolid_t *pPreparsed = GetPreparsedSolid(pFile);
+	if (pPreparsed)
+	{
+		//
+		// The solid was read on another thread. Step over its text and apply what was read.
+		//
+		eResult = pFile->SkipChunk();
+		if (eResult == ChunkFile_Ok)
+		{
+			ReplayPreparsedSolid(pPreparsed, &SideInfo);
+		}
+	}
+	else
+	{
+		//
+		// Set up handlers for the subchunks that we are interested in.
+		//
+		CChunkHandlerMap Handlers;
+		Handlers.AddHandler("side", (ChunkHandler_t)::LoadSideCallback, &SideInfo);
 
-	//
-	// Read the solid chunk.
-	//
-	pFile->PushHandlers(&Handlers);
-	ChunkFileResult_t eResult = pFile->ReadChunk((KeyHandler_t)LoadSolidKeyCallback, b);
-	pFile->PopHandlers();
+		//
+		// Read the solid chunk.
+		//
+		pFile->PushHandlers(&Handlers);
+		eResult = pFile->ReadChunk((KeyHandler_t)LoadSolidKeyCallback, b);
+		pFile->PopHandlers();
+	}
 
 	if (eResult == ChunkFile_Ok)
 	{
@@ -13,6 +13,8 @@
 #include "bsplib.h"
 #include "materialpatch.h"
 #include "tier1/strtools.h"
+#include "tier1/utldict.h"
+#include "tier1/utlstring.h"
 
 // case insensitive
 static CUtlSymbolTable s_SymbolTable( 0, 32, true );
@@ -86,21 +88,14 @@ void CreateMaterialPatchRecursive( KeyValues *pOriginalKeyValues, KeyValues *pPa
 }
 
 //-----------------------------------------------------------------------------
-// A version which allows you to patch multiple key values
+// Builds the text of a patched .vmt which includes pOldVMTFile. For PATCH_REPLACE,
+// pUnpatchedVMTFile is the original material the keys are matched against.
+// Doesn't touch the translation table or pak file, so it's safe to call on
+// several threads at once.
 //-----------------------------------------------------------------------------
-void CreateMaterialPatch( const char *pOriginalMaterialName, const char *pNewMaterialName,
-						 int nKeys, const MaterialPatchInfo_t *pInfo, MaterialPatchType_t nPatchType )
-{	
-	char pOldVMTFile[ 512 ];
-	char pNewVMTFile[ 512 ];
-
-	AddNewTranslation( pOriginalMaterialName, pNewMaterialName );
-	
-	Q_snprintf( pOldVMTFile, 512, "materials/%s.vmt", pOriginalMaterialName );
-	Q_snprintf( pNewVMTFile, 512, "materials/%s.vmt", pNewMaterialName );
-
-//	printf( "Creating material patch file %s which points at %s\n", newVMTFile, oldVMTFile );
-
+static bool BuildMaterialPatch( const char *pOldVMTFile, const char *pUnpatchedVMTFile, const char *pNewMaterialName,
+							   int nKeys, const MaterialPatchInfo_t *pInfo, MaterialPatchType_t nPatchType, CUtlBuffer &buf )
+{
 	KeyValues *kv = new KeyValues( "patch" );
 	if ( !kv )
 	{
@@ -114,15 +109,14 @@ void CreateMaterialPatch( const char *pOriginalMaterialName, const char *pNewMat
 
 	if( nPatchType == PATCH_REPLACE )
 	{
-		char name[512];
-		Q_snprintf( name, 512, "materials/%s.vmt", GetOriginalMaterialNameForPatchedMaterial( pOriginalMaterialName ) );
 		KeyValues *origkv = new KeyValues( "blah" );
 
-		if ( !origkv->LoadFromFile( g_pFileSystem, name ) )
+		if ( !origkv->LoadFromFile( g_pFileSystem, pUnpatchedVMTFile ) )
 		{
 			origkv->deleteThis();
+			kv->deleteThis();
 			Assert( 0 );
-			return;
+			return false;
 		}
 
 		CreateMaterialPatchRecursive( origkv, section, nKeys, pInfo );
@@ -137,14 +131,158 @@ void CreateMaterialPatch( const char *pOriginalMaterialName, const char *pNewMat
 	}
 	
 	// Write patched .vmt into a memory buffer
-	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
 	kv->RecursiveSaveToFile( buf, 0 );
 
-	// Add to pak file for this .bsp
-	AddBufferToPak( GetPakFile(), pNewVMTFile, (void*)buf.Base(), buf.TellPut(), true );
-
 	// Cleanup
 	kv->deleteThis();
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Patches queued up between BeginDeferredMaterialPatches and FlushMaterialPatches
+//-----------------------------------------------------------------------------
+struct DeferredPatchKey_t
+{
+	CUtlString m_Key;
+	CUtlString m_RequiredOriginalValue;
+	bool m_bRequireOriginalValue;
+	CUtlString m_Value;
+};
+
+struct DeferredMaterialPatch_t
+{
+	CUtlString m_NewMaterialName;
+	CUtlString m_OldVMTFile;
+	CUtlString m_UnpatchedVMTFile;
+	CUtlString m_NewVMTFile;
+	MaterialPatchType_t m_nPatchType;
+	CUtlVector<DeferredPatchKey_t> m_Keys;
+
+	CUtlBuffer m_Buffer;
+	bool m_bBuilt;
+
+	DeferredMaterialPatch_t() : m_Buffer( 0, 0, CUtlBuffer::TEXT_BUFFER ), m_bBuilt( false ) {}
+};
+
+static bool s_bDeferMaterialPatches = false;
+static CUtlVector<DeferredMaterialPatch_t *> s_DeferredPatches;
+
+// Maps a patched .vmt name to its index in s_DeferredPatches
+static CUtlDict<int, int> s_DeferredPatchIndex( k_eDictCompareTypeFilenames );
+
+
+void BeginDeferredMaterialPatches()
+{
+	Assert( !s_bDeferMaterialPatches );
+	s_bDeferMaterialPatches = true;
+}
+
+
+static void BuildDeferredMaterialPatchThread( int iThread, int iPatch )
+{
+	DeferredMaterialPatch_t *pPatch = s_DeferredPatches[iPatch];
+
+	MaterialPatchInfo_t *pInfo = (MaterialPatchInfo_t *)stackalloc( pPatch->m_Keys.Count() * sizeof( MaterialPatchInfo_t ) );
+	for ( int i = 0; i < pPatch->m_Keys.Count(); ++i )
+	{
+		const DeferredPatchKey_t &key = pPatch->m_Keys[i];
+		pInfo[i].m_pKey = key.m_Key.Get();
+		pInfo[i].m_pRequiredOriginalValue = key.m_bRequireOriginalValue ? key.m_RequiredOriginalValue.Get() : NULL;
+		pInfo[i].m_pValue = key.m_Value.Get();
+	}
+
+	pPatch->m_bBuilt = BuildMaterialPatch( pPatch->m_OldVMTFile.Get(), pPatch->m_UnpatchedVMTFile.Get(), pPatch->m_NewMaterialName.Get(),
+		pPatch->m_Keys.Count(), pInfo, pPatch->m_nPatchType, pPatch->m_Buffer );
+}
+
+
+void FlushMaterialPatches()
+{
+	Assert( s_bDeferMaterialPatches );
+	s_bDeferMaterialPatches = false;
+
+	RunThreadsOnIndividual( s_DeferredPatches.Count(), false, BuildDeferredMaterialPatchThread );
+
+	// The pak file isn't thread safe, and this keeps it in a consistent order
+	for ( int i = 0; i < s_DeferredPatches.Count(); ++i )
+	{
+		DeferredMaterialPatch_t *pPatch = s_DeferredPatches[i];
+		if ( pPatch->m_bBuilt )
+		{
+			AddBufferToPak( GetPakFile(), pPatch->m_NewVMTFile.Get(), pPatch->m_Buffer.Base(), pPatch->m_Buffer.TellPut(), true );
+		}
+	}
+
+	s_DeferredPatches.PurgeAndDeleteElements();
+	s_DeferredPatchIndex.Purge();
+}
+
+
+static void DeferMaterialPatch( const char *pOldVMTFile, const char *pUnpatchedVMTFile, const char *pNewMaterialName, const char *pNewVMTFile,
+							   int nKeys, const MaterialPatchInfo_t *pInfo, MaterialPatchType_t nPatchType )
+{
+	// Patching the same material twice replaces the first patch in the pak, so do the same here
+	DeferredMaterialPatch_t *pPatch;
+	int nIndex = s_DeferredPatchIndex.Find( pNewVMTFile );
+	if ( nIndex != s_DeferredPatchIndex.InvalidIndex() )
+	{
+		pPatch = s_DeferredPatches[ s_DeferredPatchIndex[nIndex] ];
+		pPatch->m_Keys.RemoveAll();
+	}
+	else
+	{
+		pPatch = new DeferredMaterialPatch_t;
+		s_DeferredPatchIndex.Insert( pNewVMTFile, s_DeferredPatches.AddToTail( pPatch ) );
+	}
+
+	pPatch->m_NewMaterialName = pNewMaterialName;
+	pPatch->m_OldVMTFile = pOldVMTFile;
+	pPatch->m_UnpatchedVMTFile = pUnpatchedVMTFile;
+	pPatch->m_NewVMTFile = pNewVMTFile;
+	pPatch->m_nPatchType = nPatchType;
+	pPatch->m_bBuilt = false;
+	for ( int i = 0; i < nKeys; ++i )
+	{
+		DeferredPatchKey_t &key = pPatch->m_Keys[ pPatch->m_Keys.AddToTail() ];
+		key.m_Key = pInfo[i].m_pKey;
+		key.m_bRequireOriginalValue = ( pInfo[i].m_pRequiredOriginalValue != NULL );
+		key.m_RequiredOriginalValue = pInfo[i].m_pRequiredOriginalValue ? pInfo[i].m_pRequiredOriginalValue : "";
+		key.m_Value = pInfo[i].m_pValue;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// A version which allows you to patch multiple key values
+//-----------------------------------------------------------------------------
+void CreateMaterialPatch( const char *pOriginalMaterialName, const char *pNewMaterialName,
+						 int nKeys, const MaterialPatchInfo_t *pInfo, MaterialPatchType_t nPatchType )
+{	
+	char pOldVMTFile[ 512 ];
+	char pNewVMTFile[ 512 ];
+	char pUnpatchedVMTFile[ 512 ];
+
+	AddNewTranslation( pOriginalMaterialName, pNewMaterialName );
+	
+	Q_snprintf( pOldVMTFile, 512, "materials/%s.vmt", pOriginalMaterialName );
+	Q_snprintf( pNewVMTFile, 512, "materials/%s.vmt", pNewMaterialName );
+	Q_snprintf( pUnpatchedVMTFile, 512, "materials/%s.vmt", GetOriginalMaterialNameForPatchedMaterial( pOriginalMaterialName ) );
+
+//	printf( "Creating material patch file %s which points at %s\n", newVMTFile, oldVMTFile );
+
+	if ( s_bDeferMaterialPatches )
+	{
+		DeferMaterialPatch( pOldVMTFile, pUnpatchedVMTFile, pNewMaterialName, pNewVMTFile, nKeys, pInfo, nPatchType );
+		return;
+	}
+
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if ( !BuildMaterialPatch( pOldVMTFile, pUnpatchedVMTFile, pNewMaterialName, nKeys, pInfo, nPatchType, buf ) )
+		return;
+
+	// Add to pak file for this .bsp
+	AddBufferToPak( GetPakFile(), pNewVMTFile, (void*)buf.Base(), buf.TellPut(), true );
 }
 
 
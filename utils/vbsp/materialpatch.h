@@ -36,6 +36,13 @@ void CreateMaterialPatch( const char *pOriginalMaterialName, const char *pNewMat
 void CreateMaterialPatch( const char *pOriginalMaterialName, const char *pNewMaterialName,
 						 int nKeys, const MaterialPatchInfo_t *pInfo, MaterialPatchType_t nPatchType );
 
+// Between these, CreateMaterialPatch records the name translation right away but
+// queues the .vmt. FlushMaterialPatches builds the queued patches on all threads
+// and adds them to the pak file in the order they were created, so nothing may
+// read them back from the pak until then.
+void BeginDeferredMaterialPatches();
+void FlushMaterialPatches();
+
 // This gets a keyvalue from the *unpatched* version of the passed-in material
 bool GetValueFromMaterial( const char *pMaterialName, const char *pKey, char *pValue, int len );
 
@@ -13,8 +13,9 @@
 #include "csg.h"
 #include "fmtstr.h"
 
-int		c_active_portals;
-int		c_peak_portals;
+// Portals are made and freed on any thread, so these are updated with interlocked ops
+long volatile	c_active_portals;
+long volatile	c_peak_portals;
 int		c_boundary;
 int		c_boundary_sides;
 
@@ -29,10 +30,10 @@ portal_t *AllocPortal (void)
 
 	portal_t	*p;
 	
-	if (numthreads == 1)
-		c_active_portals++;
-	if (c_active_portals > c_peak_portals)
-		c_peak_portals = c_active_portals;
+	long nActive = ThreadInterlockedIncrement( &c_active_portals );
+	long nPeak;
+	while ( nActive > ( nPeak = c_peak_portals ) && !ThreadInterlockedAssignIf( &c_peak_portals, nActive, nPeak ) )
+		;
 	
 	p = (portal_t*)malloc (sizeof(portal_t));
 	memset (p, 0, sizeof(portal_t));
@@ -46,8 +47,7 @@ void FreePortal (portal_t *p)
 {
 	if (p->winding)
 		FreeWinding (p->winding);
-	if (numthreads == 1)
-		c_active_portals--;
+	ThreadInterlockedDecrement( &c_active_portals );
 	free (p);
 }
 
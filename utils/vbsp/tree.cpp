@@ -7,7 +7,7 @@
 //=============================================================================//
 #include "vbsp.h"
 
-extern	int	c_nodes;
+extern	long volatile	c_nodes;
 
 void RemovePortalFromNode (portal_t *portal, node_t *l);
 
@@ -90,9 +90,8 @@ void FreeTree_r (node_t *node)
 	if (node->volume)
 		FreeBrush (node->volume);
 
-	if (numthreads == 1)
-		c_nodes--;
-	free (node);
+	ThreadInterlockedDecrement( &c_nodes );
+	FreeNode (node);
 }
 
 
@@ -19,6 +19,8 @@
 #include "loadcmdline.h"
 #include "byteswap.h"
 #include "worldvertextransitionfixup.h"
+#include "pacifier.h"
+#include "toolstats.h"
 
 extern float		g_maxLightmapDimension;
 
@@ -255,8 +257,25 @@ void ProcessWorldModel (void)
 	{
 		qprintf ("--------------------------------------------\n");
 
-		RunThreadsOnIndividual ((block_xh-block_xl+1)*(block_yh-block_yl+1),
-			!verbose, ProcessBlock_Thread);
+		// The blocks go one at a time; BrushBSP spreads each one across the threads.
+		int nBlocks = (block_xh-block_xl+1)*(block_yh-block_yl+1);
+		float flBlockStart = Plat_FloatTime();
+		if (!verbose)
+		{
+			Msg ("%-20s ", "ProcessBlock_Thread:");
+			StartPacifier ("");
+		}
+		for (int iBlock = 0; iBlock < nBlocks; iBlock++)
+		{
+			ProcessBlock_Thread (THREADINDEX_MAIN, iBlock);
+			if (!verbose)
+				UpdatePacifier ((float)(iBlock + 1) / nBlocks);
+		}
+		if (!verbose)
+		{
+			EndPacifier (false);
+			Msg (" (%d)\n", (int)(Plat_FloatTime() - flBlockStart));
+		}
 
 		//
 		// build the division tree
@@ -829,6 +848,8 @@ void ProcessModels (void)
 	// Remove them from the list of models to process below
 	EmitOccluderBrushes( );
 
+	ToolStats_BeginStage( "models" );
+
 	for ( entity_num=0; entity_num < num_entities; ++entity_num )
 	{
 		entity_t *pEntity = &entities[entity_num];
@@ -1129,6 +1150,11 @@ int RunVBSP( int argc, char **argv )
 		{
 			EnableFullMinidumps( true );
 		}
+		else if ( !Q_stricmp( argv[i], "-benchstats" ) )
+		{
+			ToolStats_Init( "vbsp", argv[i+1] );
+			i++;
+		}
 		else if (argv[i][0] == '-')
 		{
 			Warning("VBSP: Unknown option \"%s\"\n\n", argv[i]);
@@ -1212,6 +1238,8 @@ int RunVBSP( int argc, char **argv )
 				"  -nox360		   : Disable generation Xbox360 version of vsp (default)\n"
 				"  -replacematerials : Substitute materials according to materialsub.txt in content\\maps\n"
 				"  -FullMinidumps  : Write large minidumps on crash.\n"
+				"  -benchstats <file>: Write the time, cpu time and peak memory of each stage\n"
+				"                    to <file> as JSON.\n"
 				);
 			}
 
@@ -1228,6 +1256,8 @@ int RunVBSP( int argc, char **argv )
 		SetLowPriority();
 	}
 
+	ToolStats_BeginStage( "loadmap" );
+
 	if( ( g_nDXLevel != 0 ) && ( g_nDXLevel < 80 ) )
 	{
 		g_BumpAll = false;
@@ -1242,7 +1272,6 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
-	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
 	char logFile[512];
@@ -1380,6 +1409,15 @@ int RunVBSP( int argc, char **argv )
 	GetHourMinuteSecondsString( (int)( end - start ), str, sizeof( str ) );
 	Msg( "%s elapsed\n", str );
 
+	if ( ToolStats_IsEnabled() )
+	{
+		ToolStats_SetCounter( "brushes", g_MainMap->nummapbrushes );
+		ToolStats_SetCounter( "faces", numfaces );
+		ToolStats_SetCounter( "leafs", numleafs );
+		ToolStats_SetCounter( "dispinfos", g_dispinfo.Count() );
+		ToolStats_Write();
+	}
+
 	DeleteCmdLine( argc, argv );
 	ReleasePakFileLumps();
 	DeleteMaterialReplacementKeys();
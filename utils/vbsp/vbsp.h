@@ -471,6 +471,7 @@ void SplitBrush (bspbrush_t *brush, int planenum,
 
 tree_t *AllocTree (void);
 node_t *AllocNode (void);
+void FreeNode (node_t *node);
 bspbrush_t *AllocBrush (int numsides);
 int	CountBrushList (bspbrush_t *brushes);
 void FreeBrush (bspbrush_t *brushes);
@@ -15,6 +15,7 @@
 #include "utilmatlib.h"
 #include "utldict.h"
 #include "map.h"
+#include "toolstats.h"
 
 int		c_nofaces;
 int		c_facenodes;
@@ -1237,6 +1238,8 @@ EndBSPFile
 */
 void EndBSPFile (void)
 {
+	ToolStats_BeginStage( "emitfaces" );
+
 	// Mark noshadow faces.
 	MarkNoShadowFaces();
 
@@ -1257,6 +1260,7 @@ void EndBSPFile (void)
 	OverlayTransition_EmitOverlayFaces();
 
 	// phys collision needs dispinfo to operate (needs to generate phys collision for displacement surfs)
+	ToolStats_BeginStage( "physcollision" );
 	EmitPhysCollision();
 
 	// We can't calculate this properly until vvis (since we need vis to do this), so we set
@@ -1264,9 +1268,11 @@ void EndBSPFile (void)
 	ClearDistToClosestWater();
 
 	// Emit static props found in the .vmf file
+	ToolStats_BeginStage( "staticprops" );
 	EmitStaticProps();
 
 	// Place detail props found in .vmf and based on material properties
+	ToolStats_BeginStage( "detailprops" );
 	EmitDetailObjects();
 
 	// Compute bounds after creating disp info because we need to reference it
@@ -1287,6 +1293,7 @@ void EndBSPFile (void)
 	char	targetPath[1024];
 	GetPlatformMapPath( source, targetPath, g_nDXLevel, 1024 );
 	Msg ("Writing %s\n", targetPath);
+	ToolStats_BeginStage( "writebsp" );
 	WriteBSPFile (targetPath);
 }
 
@@ -0,0 +1,226 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+//
+// MessageBuffer - handy for packing and upacking
+// structures to be sent as messages
+//
+#include <stdlib.h>
+#include <string.h>
+#include "messbuf.h"
+
+
+//-----------------------------------------------------------------------------
+// Construction
+//-----------------------------------------------------------------------------
+MessageBuffer::MessageBuffer()
+{
+	size = DEFAULT_MESSAGE_BUFFER_SIZE;
+	data = (char *)malloc( size );
+	len = 0;
+	offset = 0;
+}
+
+MessageBuffer::MessageBuffer( int minsize )
+{
+	size = ( minsize > 0 ) ? minsize : DEFAULT_MESSAGE_BUFFER_SIZE;
+	data = (char *)malloc( size );
+	len = 0;
+	offset = 0;
+}
+
+MessageBuffer::~MessageBuffer()
+{
+	free( data );
+}
+
+
+//-----------------------------------------------------------------------------
+// Accessors
+//-----------------------------------------------------------------------------
+int MessageBuffer::getSize()
+{
+	return size;
+}
+
+int MessageBuffer::getLen()
+{
+	return len;
+}
+
+int MessageBuffer::setLen( int nLength )
+{
+	if ( nLength < 0 )
+		return -1;
+
+	if ( nLength > size )
+		resize( nLength );
+
+	len = nLength;
+	if ( offset > len )
+		offset = len;
+
+	return len;
+}
+
+int MessageBuffer::getOffset()
+{
+	return offset;
+}
+
+int MessageBuffer::setOffset( int nOffset )
+{
+	if ( nOffset < 0 || nOffset > len )
+		return -1;
+
+	offset = nOffset;
+	return offset;
+}
+
+
+//-----------------------------------------------------------------------------
+// Appends bytes to the end of the buffer. Returns the new length.
+//-----------------------------------------------------------------------------
+int MessageBuffer::write( void const *p, int bytes )
+{
+	if ( bytes < 0 )
+		return -1;
+
+	if ( len + bytes > size )
+		resize( len + bytes );
+
+	memcpy( data + len, p, bytes );
+	len += bytes;
+	return len;
+}
+
+//-----------------------------------------------------------------------------
+// Overwrites bytes at loc, growing the buffer if they run past the end.
+//-----------------------------------------------------------------------------
+int MessageBuffer::update( int loc, void const *p, int bytes )
+{
+	if ( loc < 0 || bytes < 0 )
+		return -1;
+
+	if ( loc + bytes > size )
+		resize( loc + bytes );
+
+	memcpy( data + loc, p, bytes );
+	if ( loc + bytes > len )
+		len = loc + bytes;
+
+	return len;
+}
+
+//-----------------------------------------------------------------------------
+// Copies bytes out from loc without moving the read offset. Returns -1 if
+// there aren't enough bytes.
+//-----------------------------------------------------------------------------
+int MessageBuffer::extract( int loc, void *p, int bytes )
+{
+	if ( loc < 0 || bytes < 0 || loc + bytes > len )
+		return -1;
+
+	memcpy( p, data + loc, bytes );
+	return loc + bytes;
+}
+
+//-----------------------------------------------------------------------------
+// Copies bytes out from the read offset and advances it. Returns -1 if
+// there aren't enough bytes.
+//-----------------------------------------------------------------------------
+int MessageBuffer::read( void *p, int bytes )
+{
+	if ( bytes < 0 || offset + bytes > len )
+		return -1;
+
+	memcpy( p, data + offset, bytes );
+	offset += bytes;
+	return offset;
+}
+
+int MessageBuffer::WriteString( const char *pString )
+{
+	return write( pString, strlen( pString ) + 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Reads a null-terminated string. Returns -1 if it isn't terminated or
+// doesn't fit in pOut.
+//-----------------------------------------------------------------------------
+int MessageBuffer::ReadString( char *pOut, int bufferLength )
+{
+	int nMax = len - offset;
+	if ( nMax > bufferLength )
+		nMax = bufferLength;
+
+	for ( int i = 0; i < nMax; i++ )
+	{
+		pOut[i] = data[offset + i];
+		if ( pOut[i] == 0 )
+		{
+			offset += i + 1;
+			return offset;
+		}
+	}
+
+	if ( bufferLength > 0 )
+		pOut[0] = 0;
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Empties the buffer
+//-----------------------------------------------------------------------------
+void MessageBuffer::clear()
+{
+	memset( data, 0, size );
+	offset = 0;
+	len = 0;
+}
+
+void MessageBuffer::clear( int minsize )
+{
+	if ( minsize > size )
+		resize( minsize );
+
+	clear();
+}
+
+void MessageBuffer::reset( int minsize )
+{
+	if ( minsize > size )
+		resize( minsize );
+
+	offset = 0;
+	len = 0;
+}
+
+void MessageBuffer::print( FILE *ofile, int num )
+{
+	fprintf( ofile, "Len: %d Offset: %d Size: %d\n", len, offset, size );
+
+	if ( num > len )
+		num = len;
+
+	for ( int i = 0; i < num; i++ )
+	{
+		fprintf( ofile, "%02x%c", (unsigned char)data[i], ( ( i & 15 ) == 15 ) ? '\n' : ' ' );
+	}
+	fprintf( ofile, "\n" );
+}
+
+void MessageBuffer::resize( int minsize )
+{
+	int nNewSize = size * 2;
+	if ( nNewSize < minsize )
+		nNewSize = minsize;
+
+	data = (char *)realloc( data, nNewSize );
+	size = nNewSize;
+}
@@ -0,0 +1,654 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: DistributeWork for the portable VMPI backend.
+//
+//			Workers pull work units from the master instead of having them
+//			pushed. Each worker asks for enough to keep twice its thread count
+//			busy and asks again before its threads run dry, so faster machines
+//			end up taking more of the job. Units held by a worker that goes away
+//			are handed out again, and once everything has been handed out, idle
+//			workers get second copies of units still outstanding elsewhere so a
+//			slow machine can't hold up the end of a stage. The first result in
+//			wins. The master works on units with its own threads too, unless
+//			-mpi_NoMasterWorkerThreads is used.
+//
+//=============================================================================//
+
+#include "vmpi_posix.h"
+#include "vmpi_distribute_work.h"
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+#include "tier1/utllinkedlist.h"
+
+
+// Subpacket IDs used under the packet ID passed to DistributeWork.
+#define DW_SUBPACKETID_REQUEST		0	// worker -> master: iCall, nWanted
+#define DW_SUBPACKETID_ASSIGN		1	// master -> worker: iCall, nUnits, uint64 units[nUnits]
+#define DW_SUBPACKETID_RESULTS		2	// worker -> master: iCall, uint64 iWorkUnit, app data
+#define DW_SUBPACKETID_DONE			3	// master -> workers: iCall
+
+#define DW_MAX_THREADS				32
+#define DW_UPDATE_INTERVAL			0.2
+
+
+enum
+{
+	WU_PENDING=0,
+	WU_ASSIGNED,
+	WU_DUPLICATED,		// Assigned to two workers.
+	WU_DONE
+};
+
+
+struct DWWorker_t
+{
+	DWWorker_t()
+	{
+		m_iWaitingCall = -1;
+		m_nWanted = 0;
+		m_nCompleted = 0;
+	}
+
+	CUtlVector<uint64>	m_Assigned;		// Units it has been given in the current call and hasn't sent back.
+	int					m_iWaitingCall;	// Call it asked for work in that we couldn't give it any for yet.
+	int					m_nWanted;
+	uint64				m_nCompleted;	// Over all calls.
+};
+
+
+IWorkUnitDistributorCallbacks *g_pDistributeWorkCallbacks = NULL;
+
+static CThreadFastMutex s_Mutex;
+
+static int s_iCurrentCall = 0;
+static bool s_bDistributing = false;
+static volatile bool s_bStopThreads = false;
+
+static char s_cPacketID;
+static ProcessWorkUnitFn s_ProcessFn;
+static ReceiveWorkUnitFn s_ReceiveFn;
+
+static CUtlVector<ThreadHandle_t> s_Threads;
+
+// Master state.
+static uint64 s_nWorkUnits;
+static uint64 s_iNextWorkUnit;				// Units before this have been handed out at least once.
+static uint64 s_nCompleted;
+static uint64 s_iFirstIncomplete;			// For OnWorkUnitsCompleted.
+static CUtlVector<unsigned char> s_WUState;
+static CUtlVector<uint64> s_ReturnedWUs;	// Units given back by workers that went away.
+static CUtlVector<DWWorker_t*> s_Workers;	// Indexed by proc ID.
+static uint64 s_nMasterCompleted;			// Done by the master's threads, over all calls.
+static bool s_bHandlersInstalled = false;
+
+// Worker state.
+static CUtlLinkedList<uint64, int> s_WorkerQueue;
+static int s_nWorkerInProgress;
+static int s_iLastDoneCall = 0;
+static bool s_bRequestOutstanding;
+static CThreadEvent s_WorkAvailableEvent;
+
+
+// ----------------------------------------------------------------------------- //
+// Master.
+// ----------------------------------------------------------------------------- //
+
+static DWWorker_t* GetWorker( int iProc )
+{
+	while ( s_Workers.Count() <= iProc )
+	{
+		s_Workers.AddToTail( new DWWorker_t );
+	}
+	return s_Workers[iProc];
+}
+
+//-----------------------------------------------------------------------------
+// Takes a unit that nobody has. Call with s_Mutex held.
+//-----------------------------------------------------------------------------
+static bool TakeWorkUnit( uint64 *piWorkUnit )
+{
+	while ( s_ReturnedWUs.Count() )
+	{
+		uint64 iWorkUnit = s_ReturnedWUs.Tail();
+		s_ReturnedWUs.RemoveMultipleFromTail( 1 );
+		if ( s_WUState[iWorkUnit] == WU_PENDING )
+		{
+			s_WUState[iWorkUnit] = WU_ASSIGNED;
+			*piWorkUnit = iWorkUnit;
+			return true;
+		}
+	}
+
+	while ( s_iNextWorkUnit < s_nWorkUnits )
+	{
+		uint64 iWorkUnit = s_iNextWorkUnit++;
+		if ( s_WUState[iWorkUnit] == WU_PENDING )
+		{
+			s_WUState[iWorkUnit] = WU_ASSIGNED;
+			*piWorkUnit = iWorkUnit;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Once everything is handed out, picks a unit another worker is still sitting
+// on, newest first since it's the least likely to have been started. Call with
+// s_Mutex held.
+//-----------------------------------------------------------------------------
+static bool TakeDuplicateWorkUnit( int iRequester, uint64 *piWorkUnit )
+{
+	int iBest = -1;
+	for ( int i=0; i < s_Workers.Count(); i++ )
+	{
+		if ( i == iRequester || !VMPI_IsProcConnected( i ) )
+			continue;
+
+		if ( iBest == -1 || s_Workers[i]->m_Assigned.Count() > s_Workers[iBest]->m_Assigned.Count() )
+			iBest = i;
+	}
+
+	if ( iBest == -1 )
+		return false;
+
+	CUtlVector<uint64> &assigned = s_Workers[iBest]->m_Assigned;
+	for ( int i=assigned.Count()-1; i >= 0; i-- )
+	{
+		if ( s_WUState[assigned[i]] == WU_ASSIGNED )
+		{
+			s_WUState[assigned[i]] = WU_DUPLICATED;
+			*piWorkUnit = assigned[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void SendDone( int iCall, int iDest )
+{
+	char packet[2 + sizeof( int )] = { s_cPacketID, DW_SUBPACKETID_DONE };
+	memcpy( &packet[2], &iCall, sizeof( iCall ) );
+	VMPI_SendData( packet, sizeof( packet ), iDest );
+}
+
+//-----------------------------------------------------------------------------
+// Sends a worker up to nWanted units. If there's nothing to give, the request
+// is held until some units come back.
+//-----------------------------------------------------------------------------
+static void AssignWork( int iWorker, int nWanted )
+{
+	DWWorker_t *pWorker = GetWorker( iWorker );
+
+	MessageBuffer mb;
+	char cPacketID[2] = { s_cPacketID, DW_SUBPACKETID_ASSIGN };
+	mb.write( cPacketID, sizeof( cPacketID ) );
+	mb.write( &s_iCurrentCall, sizeof( s_iCurrentCall ) );
+	int iCountOffset = mb.getLen();
+	int nUnits = 0;
+	mb.write( &nUnits, sizeof( nUnits ) );
+
+	s_Mutex.Lock();
+	uint64 iWorkUnit;
+	while ( nUnits < nWanted && ( TakeWorkUnit( &iWorkUnit ) || TakeDuplicateWorkUnit( iWorker, &iWorkUnit ) ) )
+	{
+		mb.write( &iWorkUnit, sizeof( iWorkUnit ) );
+		pWorker->m_Assigned.AddToTail( iWorkUnit );
+		++nUnits;
+	}
+	s_Mutex.Unlock();
+
+	if ( nUnits == 0 )
+	{
+		pWorker->m_iWaitingCall = s_iCurrentCall;
+		pWorker->m_nWanted = nWanted;
+		return;
+	}
+
+	pWorker->m_iWaitingCall = -1;
+	mb.update( iCountOffset, &nUnits, sizeof( nUnits ) );
+	VMPI_SendData( mb.data, mb.getLen(), iWorker );
+}
+
+static void ServiceWaitingWorkers()
+{
+	for ( int i=0; i < s_Workers.Count(); i++ )
+	{
+		if ( s_Workers[i]->m_iWaitingCall == s_iCurrentCall && VMPI_IsProcConnected( i ) )
+			AssignWork( i, s_Workers[i]->m_nWanted );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Puts back everything a lost worker was holding.
+//-----------------------------------------------------------------------------
+static void DistributeWork_HandleDisconnect( int procID, const char *pReason )
+{
+	if ( !g_bMPIMaster || procID >= s_Workers.Count() )
+		return;
+
+	DWWorker_t *pWorker = s_Workers[procID];
+	pWorker->m_iWaitingCall = -1;
+	if ( !s_bDistributing )
+	{
+		pWorker->m_Assigned.Purge();
+		return;
+	}
+
+	s_Mutex.Lock();
+	for ( int i=0; i < pWorker->m_Assigned.Count(); i++ )
+	{
+		uint64 iWorkUnit = pWorker->m_Assigned[i];
+		if ( s_WUState[iWorkUnit] == WU_DUPLICATED )
+		{
+			// Someone else still has a copy.
+			s_WUState[iWorkUnit] = WU_ASSIGNED;
+		}
+		else if ( s_WUState[iWorkUnit] == WU_ASSIGNED )
+		{
+			s_WUState[iWorkUnit] = WU_PENDING;
+			s_ReturnedWUs.AddToTail( iWorkUnit );
+		}
+	}
+	int nReturned = pWorker->m_Assigned.Count();
+	pWorker->m_Assigned.Purge();
+	s_Mutex.Unlock();
+
+	if ( nReturned )
+	{
+		s_WorkAvailableEvent.Set();
+		if ( g_iVMPIVerboseLevel >= 1 )
+			Msg( "VMPI: handing out the %d work units %s was holding again.\n", nReturned, VMPI_GetMachineName( procID ) );
+	}
+
+	ServiceWaitingWorkers();
+}
+
+static void OnWorkerRequest( int iSource, int iCall, int nWanted )
+{
+	if ( iCall < s_iCurrentCall || ( iCall == s_iCurrentCall && !s_bDistributing ) )
+	{
+		// It's behind (it joined late). Let it skip the stage.
+		SendDone( iCall, iSource );
+	}
+	else if ( iCall > s_iCurrentCall )
+	{
+		// It got ahead of us. Serve it when we start this call.
+		DWWorker_t *pWorker = GetWorker( iSource );
+		pWorker->m_iWaitingCall = iCall;
+		pWorker->m_nWanted = nWanted;
+	}
+	else
+	{
+		AssignWork( iSource, nWanted );
+	}
+}
+
+static void OnWorkerResults( int iSource, int iCall, uint64 iWorkUnit, MessageBuffer *pBuf )
+{
+	if ( iCall != s_iCurrentCall || !s_bDistributing || iWorkUnit >= s_nWorkUnits )
+		return;
+
+	DWWorker_t *pWorker = GetWorker( iSource );
+	pWorker->m_Assigned.FindAndRemove( iWorkUnit );
+
+	s_Mutex.Lock();
+	bool bDuplicate = ( s_WUState[iWorkUnit] == WU_DONE );
+	if ( !bDuplicate )
+	{
+		s_WUState[iWorkUnit] = WU_DONE;
+		++s_nCompleted;
+	}
+	s_Mutex.Unlock();
+
+	if ( bDuplicate )
+		return;
+
+	++pWorker->m_nCompleted;
+	s_ReceiveFn( iWorkUnit, pBuf, iSource );
+}
+
+static unsigned MasterThreadFn( void *pParam )
+{
+	int iThread = (int)(intp)pParam;
+
+	while ( !s_bStopThreads )
+	{
+		uint64 iWorkUnit;
+		s_Mutex.Lock();
+		bool bGotOne = TakeWorkUnit( &iWorkUnit );
+		s_Mutex.Unlock();
+		if ( !bGotOne )
+		{
+			// Units held by workers can still come back if they go away.
+			s_WorkAvailableEvent.Wait( 50 );
+			continue;
+		}
+
+		s_ProcessFn( iThread, iWorkUnit, NULL );
+
+		s_Mutex.Lock();
+		if ( s_WUState[iWorkUnit] != WU_DONE )
+		{
+			s_WUState[iWorkUnit] = WU_DONE;
+			++s_nCompleted;
+			++s_nMasterCompleted;
+		}
+		s_Mutex.Unlock();
+	}
+
+	return 0;
+}
+
+static void StartThreads( ThreadFunc_t fn, int nThreads )
+{
+	s_bStopThreads = false;
+	for ( int i=0; i < nThreads; i++ )
+	{
+		ThreadHandle_t hThread = CreateSimpleThread( fn, (void *)(intp)i );
+		if ( hThread )
+			s_Threads.AddToTail( hThread );
+	}
+}
+
+static void StopThreads()
+{
+	s_bStopThreads = true;
+	s_WorkAvailableEvent.Set();
+	for ( int i=0; i < s_Threads.Count(); i++ )
+	{
+		ThreadJoin( s_Threads[i] );
+		ReleaseThreadHandle( s_Threads[i] );
+	}
+	s_Threads.Purge();
+}
+
+static void ReportCompletedWorkUnits()
+{
+	s_Mutex.Lock();
+	uint64 iFirstIncomplete = s_iFirstIncomplete;
+	while ( iFirstIncomplete < s_nWorkUnits && s_WUState[iFirstIncomplete] == WU_DONE )
+		++iFirstIncomplete;
+	s_Mutex.Unlock();
+
+	if ( iFirstIncomplete != s_iFirstIncomplete )
+	{
+		s_iFirstIncomplete = iFirstIncomplete;
+		if ( g_pDistributeWorkCallbacks )
+			g_pDistributeWorkCallbacks->OnWorkUnitsCompleted( iFirstIncomplete );
+	}
+}
+
+static void DistributeWork_Master( uint64 nWorkUnits )
+{
+	if ( !s_bHandlersInstalled )
+	{
+		VMPI_AddDisconnectHandler( DistributeWork_HandleDisconnect );
+		s_bHandlersInstalled = true;
+	}
+
+	s_nWorkUnits = nWorkUnits;
+	s_iNextWorkUnit = 0;
+	s_nCompleted = 0;
+	s_iFirstIncomplete = 0;
+	s_ReturnedWUs.Purge();
+	s_WUState.SetCount( (int)nWorkUnits );
+	if ( nWorkUnits )
+		memset( s_WUState.Base(), WU_PENDING, nWorkUnits );
+
+	for ( int i=0; i < s_Workers.Count(); i++ )
+		s_Workers[i]->m_Assigned.Purge();
+
+	// The last call's StopThreads set this, and StartThreads won't clear it with -mpi_NoMasterWorkerThreads.
+	s_bStopThreads = false;
+	s_bDistributing = true;
+	ServiceWaitingWorkers();
+
+	if ( !VMPI_IsParamUsed( mpi_NoMasterWorkerThreads ) )
+	{
+		StartThreads( MasterThreadFn, MIN( VMPI_GetNumWorkerThreads(), DW_MAX_THREADS ) );
+	}
+
+	double flNextUpdate = 0;
+	while ( 1 )
+	{
+		s_Mutex.Lock();
+		bool bFinished = ( s_nCompleted >= s_nWorkUnits );
+		s_Mutex.Unlock();
+		if ( bFinished || s_bStopThreads )
+			break;
+
+		VMPI_DispatchNextMessage( 20 );
+		ReportCompletedWorkUnits();
+
+		if ( Plat_FloatTime() >= flNextUpdate )
+		{
+			flNextUpdate = Plat_FloatTime() + DW_UPDATE_INTERVAL;
+			if ( g_pDistributeWorkCallbacks && g_pDistributeWorkCallbacks->Update() )
+				break;
+		}
+	}
+
+	StopThreads();
+	ReportCompletedWorkUnits();
+
+	s_bDistributing = false;
+	SendDone( s_iCurrentCall, VMPI_SEND_TO_ALL );
+
+	if ( VMPI_IsParamUsed( mpi_ShowDistributeWorkStats ) )
+	{
+		for ( int i=0; i < VMPI_GetCurrentNumberOfConnections(); i++ )
+		{
+			if ( uint64 nCompleted = VMPI_GetNumWorkUnitsCompleted( i ) )
+				Msg( "  %-32s %llu work units\n", VMPI_GetMachineName( i ), (unsigned long long)nCompleted );
+		}
+	}
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Worker.
+// ----------------------------------------------------------------------------- //
+
+static unsigned WorkerThreadFn( void *pParam )
+{
+	int iThread = (int)(intp)pParam;
+	MessageBuffer mb;
+
+	while ( !s_bStopThreads )
+	{
+		s_Mutex.Lock();
+		bool bGotOne = ( s_WorkerQueue.Count() > 0 );
+		uint64 iWorkUnit = 0;
+		if ( bGotOne )
+		{
+			iWorkUnit = s_WorkerQueue[s_WorkerQueue.Head()];
+			s_WorkerQueue.Remove( s_WorkerQueue.Head() );
+			++s_nWorkerInProgress;
+		}
+		s_Mutex.Unlock();
+
+		if ( !bGotOne )
+		{
+			s_WorkAvailableEvent.Wait( 50 );
+			continue;
+		}
+
+		char cPacketID[2] = { s_cPacketID, DW_SUBPACKETID_RESULTS };
+		mb.reset( DEFAULT_MESSAGE_BUFFER_SIZE );
+		mb.write( cPacketID, sizeof( cPacketID ) );
+		mb.write( &s_iCurrentCall, sizeof( s_iCurrentCall ) );
+		mb.write( &iWorkUnit, sizeof( iWorkUnit ) );
+
+		s_ProcessFn( iThread, iWorkUnit, &mb );
+
+		VMPI_SendData( mb.data, mb.getLen(), VMPI_MASTER_ID );
+
+		s_Mutex.Lock();
+		--s_nWorkerInProgress;
+		s_Mutex.Unlock();
+	}
+
+	return 0;
+}
+
+static void RequestWork( int nWanted )
+{
+	char packet[2 + 2 * sizeof( int )] = { s_cPacketID, DW_SUBPACKETID_REQUEST };
+	memcpy( &packet[2], &s_iCurrentCall, sizeof( int ) );
+	memcpy( &packet[2 + sizeof( int )], &nWanted, sizeof( int ) );
+	VMPI_SendData( packet, sizeof( packet ), VMPI_MASTER_ID );
+	s_bRequestOutstanding = true;
+}
+
+static void DistributeWork_Worker()
+{
+	int nThreads = MIN( VMPI_GetNumWorkerThreads(), DW_MAX_THREADS );
+
+	s_WorkerQueue.Purge();
+	s_nWorkerInProgress = 0;
+	s_bRequestOutstanding = false;
+
+	StartThreads( WorkerThreadFn, nThreads );
+
+	while ( s_iLastDoneCall < s_iCurrentCall && VMPI_IsProcConnected( VMPI_MASTER_ID ) )
+	{
+		// Ask for more before the threads run out so they never sit idle waiting on the network.
+		s_Mutex.Lock();
+		int nQueued = s_WorkerQueue.Count();
+		int nHeld = nQueued + s_nWorkerInProgress;
+		s_Mutex.Unlock();
+
+		if ( !s_bRequestOutstanding && nQueued < nThreads )
+		{
+			RequestWork( nThreads * 2 - nHeld );
+		}
+
+		VMPI_DispatchNextMessage( 20 );
+	}
+
+	// Finish what's in progress. Anything still queued was done by someone else.
+	s_Mutex.Lock();
+	s_WorkerQueue.Purge();
+	s_Mutex.Unlock();
+	StopThreads();
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Public interface.
+// ----------------------------------------------------------------------------- //
+
+EWorkUnitDistributor VMPI_GetActiveWorkUnitDistributor()
+{
+	return k_eWorkUnitDistributor_Default;
+}
+
+
+uint64 VMPI_GetNumWorkUnitsCompleted( int iProc )
+{
+	uint64 nCompleted = ( iProc == VMPI_MASTER_ID ) ? s_nMasterCompleted : 0;
+	if ( iProc >= 0 && iProc < s_Workers.Count() )
+		nCompleted += s_Workers[iProc]->m_nCompleted;
+
+	return nCompleted;
+}
+
+
+bool DistributeWorkDispatch( MessageBuffer *pBuf, int iSource, int iPacketID )
+{
+	if ( pBuf->getLen() < 2 + (int)sizeof( int ) )
+		return false;
+
+	int iCall;
+	pBuf->setOffset( 2 );
+	pBuf->read( &iCall, sizeof( iCall ) );
+
+	switch ( pBuf->data[1] )
+	{
+		case DW_SUBPACKETID_REQUEST:
+		{
+			int nWanted;
+			if ( g_bMPIMaster && pBuf->read( &nWanted, sizeof( nWanted ) ) >= 0 )
+				OnWorkerRequest( iSource, iCall, nWanted );
+		}
+		return true;
+
+		case DW_SUBPACKETID_RESULTS:
+		{
+			uint64 iWorkUnit;
+			if ( g_bMPIMaster && pBuf->read( &iWorkUnit, sizeof( iWorkUnit ) ) >= 0 )
+				OnWorkerResults( iSource, iCall, iWorkUnit, pBuf );
+		}
+		return true;
+
+		case DW_SUBPACKETID_ASSIGN:
+		{
+			int nUnits;
+			if ( g_bMPIMaster || pBuf->read( &nUnits, sizeof( nUnits ) ) < 0 )
+				return true;
+
+			if ( iCall == s_iCurrentCall )
+			{
+				s_bRequestOutstanding = false;
+
+				s_Mutex.Lock();
+				for ( int i=0; i < nUnits; i++ )
+				{
+					uint64 iWorkUnit;
+					if ( pBuf->read( &iWorkUnit, sizeof( iWorkUnit ) ) < 0 )
+						break;
+					s_WorkerQueue.AddToTail( iWorkUnit );
+				}
+				s_Mutex.Unlock();
+
+				s_WorkAvailableEvent.Set();
+			}
+		}
+		return true;
+
+		case DW_SUBPACKETID_DONE:
+		{
+			if ( !g_bMPIMaster && iCall > s_iLastDoneCall )
+				s_iLastDoneCall = iCall;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+
+double DistributeWork(
+	uint64 nWorkUnits,
+	char cPacketID,
+	ProcessWorkUnitFn processFn,
+	ReceiveWorkUnitFn receiveFn
+	)
+{
+	double flStartTime = Plat_FloatTime();
+
+	// The master and the workers make the same DistributeWork calls in the same order,
+	// so the call number tells which stage a packet belongs to.
+	++s_iCurrentCall;
+	s_cPacketID = cPacketID;
+	s_ProcessFn = processFn;
+	s_ReceiveFn = receiveFn;
+
+	if ( g_bMPIMaster )
+		DistributeWork_Master( nWorkUnits );
+	else
+		DistributeWork_Worker();
+
+	return Plat_FloatTime() - flStartTime;
+}
+
+
+void DistributeWork_Cancel()
+{
+	StopThreads();
+}
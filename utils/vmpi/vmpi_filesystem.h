@@ -49,5 +49,11 @@ CreateInterfaceFn VMPI_FileSystem_GetFactory();
 // or else it won't find the file.
 void VMPI_FileSystem_CreateVirtualFile( const char *pFilename, const void *pData, unsigned long fileLength );
 
+#if defined( POSIX )
+// Called on the master. Workers get this file's contents from the master instead of their
+// own disk, whatever path ID they open it with. Returns false if the master can't read it.
+bool VMPI_FileSystem_ShareFile( const char *pFilename );
+#endif
+
 
 #endif // VMPI_FILESYSTEM_H
@@ -0,0 +1,657 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: VMPI filesystem for the portable VMPI backend.
+//
+//			Workers read game content through their own filesystem, so they
+//			need the same content on disk as the master (the same machine or a
+//			shared mount). Only virtual files and files the master shares with
+//			VMPI_FileSystem_ShareFile come from the master. Each of those is put
+//			in a POSIX shared memory object once; workers on the master's machine
+//			map it, and workers on other machines ask for a copy of the bytes.
+//
+//=============================================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vmpi_posix.h"
+#include "vmpi_filesystem.h"
+#include "filesystem_passthru.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+
+
+// Subpacket IDs under VMPI_PACKETID_FILESYSTEM.
+#define FS_SUBPACKETID_SHARED_FILE		0	// master -> workers: name, shared memory name, size, bAnyPathID
+#define FS_SUBPACKETID_REQUEST_DATA		1	// worker -> master: name
+#define FS_SUBPACKETID_FILE_DATA		2	// master -> worker: name, size
+#define FS_SUBPACKETID_FILE_BYTES		3	// master -> worker: the bytes for the last FILE_DATA
+
+// How long a worker waits for a file the master has announced but not sent yet.
+#define FS_FILE_DATA_TIMEOUT			120.0
+
+
+class CVMPISharedFile
+{
+public:
+	CVMPISharedFile()
+	{
+		m_pData = NULL;
+		m_nSize = 0;
+		m_bMapped = false;
+		m_bAnyPathID = false;
+		m_bHaveData = false;
+	}
+
+	char			m_Name[MAX_PATH];
+	char			m_SharedMemoryName[64];
+	const char		*m_pData;
+	unsigned int	m_nSize;
+	bool			m_bMapped;		// m_pData is a shared memory mapping instead of a heap copy.
+	bool			m_bAnyPathID;	// Found with any path ID, not just VMPI_VIRTUAL_FILES_PATH_ID.
+	bool			m_bHaveData;	// False until a remote worker gets its copy.
+};
+
+
+// What an open handle to a shared file points at. Handles from the passthru filesystem are
+// told apart by looking them up in s_OpenFiles.
+struct VMPIOpenFile_t
+{
+	CVMPISharedFile		*m_pFile;
+	unsigned int		m_Pos;
+};
+
+
+static CUtlVector<CVMPISharedFile*> s_SharedFiles;
+static CUtlVector<VMPIOpenFile_t*> s_OpenFiles;
+static CThreadFastMutex s_FilesMutex;
+static bool s_bFileAccessDisabled = false;
+static bool s_bAtExitInstalled = false;
+
+
+//-----------------------------------------------------------------------------
+// Turns a filename into the form the master and workers both look it up by.
+//-----------------------------------------------------------------------------
+static void NormalizeFilename( IBaseFileSystem *pFileSystem, const char *pFilename, bool bResolvePath, char *pOut, int outLen )
+{
+	const char *pFullPath = NULL;
+	if ( bResolvePath && !V_IsAbsolutePath( pFilename ) )
+	{
+		IFileSystem *pFullFileSystem = (IFileSystem *)pFileSystem;
+		if ( pFullFileSystem )
+			pFullPath = pFullFileSystem->RelativePathToFullPath( pFilename, NULL, pOut, outLen );
+
+		if ( !pFullPath )
+		{
+			char cwd[MAX_PATH];
+			if ( getcwd( cwd, sizeof( cwd ) ) )
+			{
+				V_ComposeFileName( cwd, pFilename, pOut, outLen );
+				pFullPath = pOut;
+			}
+		}
+	}
+
+	if ( !pFullPath )
+		V_strncpy( pOut, pFilename, outLen );
+
+	V_FixSlashes( pOut, '/' );
+	V_FixDoubleSlashes( pOut );
+}
+
+static CVMPISharedFile* FindSharedFile( const char *pNormalizedName, bool bVirtualPathID )
+{
+	AUTO_LOCK( s_FilesMutex );
+	for ( int i=0; i < s_SharedFiles.Count(); i++ )
+	{
+		CVMPISharedFile *pFile = s_SharedFiles[i];
+		if ( ( bVirtualPathID || pFile->m_bAnyPathID ) && V_stricmp( pFile->m_Name, pNormalizedName ) == 0 )
+			return pFile;
+	}
+	return NULL;
+}
+
+static VMPIOpenFile_t* FindOpenFile( FileHandle_t hFile )
+{
+	AUTO_LOCK( s_FilesMutex );
+	int i = s_OpenFiles.Find( (VMPIOpenFile_t *)hFile );
+	return ( i == s_OpenFiles.InvalidIndex() ) ? NULL : s_OpenFiles[i];
+}
+
+//-----------------------------------------------------------------------------
+// A worker on another machine can't map the master's shared memory, so it
+// waits here for its own copy.
+//-----------------------------------------------------------------------------
+static bool WaitForFileData( CVMPISharedFile *pFile )
+{
+	double flGiveUpTime = Plat_FloatTime() + FS_FILE_DATA_TIMEOUT;
+	while ( !pFile->m_bHaveData )
+	{
+		if ( !VMPI_IsProcConnected( VMPI_MASTER_ID ) || Plat_FloatTime() > flGiveUpTime )
+			return false;
+
+		VMPI_DispatchNextMessage( 100 );
+	}
+	return true;
+}
+
+static void UnlinkSharedMemory()
+{
+	for ( int i=0; i < s_SharedFiles.Count(); i++ )
+	{
+		if ( g_bMPIMaster && s_SharedFiles[i]->m_SharedMemoryName[0] )
+		{
+			shm_unlink( s_SharedFiles[i]->m_SharedMemoryName );
+			s_SharedFiles[i]->m_SharedMemoryName[0] = 0;
+		}
+	}
+}
+
+
+// ----------------------------------------------------------------------------- //
+// The filesystem hook.
+// ----------------------------------------------------------------------------- //
+
+class CVMPIFileSystem : public CFileSystemPassThru
+{
+public:
+	virtual FileHandle_t Open( const char *pFileName, const char *pOptions, const char *pathID )
+	{
+		if ( s_bFileAccessDisabled )
+			Error( "VMPI: file access is disabled (tried to open %s).", pFileName );
+
+		if ( CVMPISharedFile *pFile = FindReadableFile( pFileName, pOptions, pathID ) )
+		{
+			VMPIOpenFile_t *pOpenFile = new VMPIOpenFile_t;
+			pOpenFile->m_pFile = pFile;
+			pOpenFile->m_Pos = 0;
+
+			AUTO_LOCK( s_FilesMutex );
+			s_OpenFiles.AddToTail( pOpenFile );
+			return (FileHandle_t)pOpenFile;
+		}
+
+		if ( pathID && !V_stricmp( pathID, VMPI_VIRTUAL_FILES_PATH_ID ) )
+			return FILESYSTEM_INVALID_HANDLE;
+
+		return BaseClass::Open( pFileName, pOptions, pathID );
+	}
+
+	virtual void Close( FileHandle_t file )
+	{
+		if ( VMPIOpenFile_t *pOpenFile = FindOpenFile( file ) )
+		{
+			AUTO_LOCK( s_FilesMutex );
+			s_OpenFiles.FindAndRemove( pOpenFile );
+			delete pOpenFile;
+			return;
+		}
+
+		BaseClass::Close( file );
+	}
+
+	virtual int Read( void* pOutput, int size, FileHandle_t file )
+	{
+		if ( VMPIOpenFile_t *pOpenFile = FindOpenFile( file ) )
+		{
+			unsigned int nRemaining = pOpenFile->m_pFile->m_nSize - pOpenFile->m_Pos;
+			int nRead = MIN( (unsigned int)MAX( size, 0 ), nRemaining );
+			memcpy( pOutput, pOpenFile->m_pFile->m_pData + pOpenFile->m_Pos, nRead );
+			pOpenFile->m_Pos += nRead;
+			return nRead;
+		}
+
+		return BaseClass::Read( pOutput, size, file );
+	}
+
+	virtual int ReadEx( void* pOutput, int sizeDest, int size, FileHandle_t file )
+	{
+		if ( FindOpenFile( file ) )
+			return Read( pOutput, MIN( sizeDest, size ), file );
+
+		return BaseClass::ReadEx( pOutput, sizeDest, size, file );
+	}
+
+	virtual int Write( void const* pInput, int size, FileHandle_t file )
+	{
+		if ( FindOpenFile( file ) )
+			return 0;
+
+		return BaseClass::Write( pInput, size, file );
+	}
+
+	virtual void Seek( FileHandle_t file, int pos, FileSystemSeek_t seekType )
+	{
+		if ( VMPIOpenFile_t *pOpenFile = FindOpenFile( file ) )
+		{
+			int nBase = 0;
+			if ( seekType == FILESYSTEM_SEEK_CURRENT )
+				nBase = pOpenFile->m_Pos;
+			else if ( seekType == FILESYSTEM_SEEK_TAIL )
+				nBase = pOpenFile->m_pFile->m_nSize;
+
+			pOpenFile->m_Pos = MIN( (unsigned int)MAX( nBase + pos, 0 ), pOpenFile->m_pFile->m_nSize );
+			return;
+		}
+
+		BaseClass::Seek( file, pos, seekType );
+	}
+
+	virtual unsigned int Tell( FileHandle_t file )
+	{
+		if ( VMPIOpenFile_t *pOpenFile = FindOpenFile( file ) )
+			return pOpenFile->m_Pos;
+
+		return BaseClass::Tell( file );
+	}
+
+	virtual unsigned int Size( FileHandle_t file )
+	{
+		if ( VMPIOpenFile_t *pOpenFile = FindOpenFile( file ) )
+			return pOpenFile->m_pFile->m_nSize;
+
+		return BaseClass::Size( file );
+	}
+
+	virtual unsigned int Size( const char *pFileName, const char *pPathID )
+	{
+		if ( CVMPISharedFile *pFile = FindReadableFile( pFileName, "rb", pPathID ) )
+			return pFile->m_nSize;
+
+		return BaseClass::Size( pFileName, pPathID );
+	}
+
+	virtual void Flush( FileHandle_t file )
+	{
+		if ( !FindOpenFile( file ) )
+			BaseClass::Flush( file );
+	}
+
+	virtual bool IsOk( FileHandle_t file )
+	{
+		if ( FindOpenFile( file ) )
+			return true;
+
+		return BaseClass::IsOk( file );
+	}
+
+	virtual bool EndOfFile( FileHandle_t file )
+	{
+		if ( VMPIOpenFile_t *pOpenFile = FindOpenFile( file ) )
+			return pOpenFile->m_Pos >= pOpenFile->m_pFile->m_nSize;
+
+		return BaseClass::EndOfFile( file );
+	}
+
+	virtual char *ReadLine( char *pOutput, int maxChars, FileHandle_t file )
+	{
+		VMPIOpenFile_t *pOpenFile = FindOpenFile( file );
+		if ( !pOpenFile )
+			return BaseClass::ReadLine( pOutput, maxChars, file );
+
+		const CVMPISharedFile *pFile = pOpenFile->m_pFile;
+		if ( maxChars <= 0 || pOpenFile->m_Pos >= pFile->m_nSize )
+			return NULL;
+
+		int nChars = 0;
+		while ( nChars < maxChars - 1 && pOpenFile->m_Pos < pFile->m_nSize )
+		{
+			char c = pFile->m_pData[pOpenFile->m_Pos++];
+			pOutput[nChars++] = c;
+			if ( c == '\n' )
+				break;
+		}
+		pOutput[nChars] = 0;
+		return pOutput;
+	}
+
+	virtual void SetBufferSize( FileHandle_t file, unsigned nBytes )
+	{
+		if ( !FindOpenFile( file ) )
+			BaseClass::SetBufferSize( file, nBytes );
+	}
+
+	virtual bool FileExists( const char *pFileName, const char *pPathID )
+	{
+		if ( FindReadableFile( pFileName, "rb", pPathID ) )
+			return true;
+
+		return BaseClass::FileExists( pFileName, pPathID );
+	}
+
+	virtual bool ReadFile( const char *pFileName, const char *pPath, CUtlBuffer &buf, int nMaxBytes, int nStartingByte, FSAllocFunc_t pfnAlloc )
+	{
+		CVMPISharedFile *pFile = FindReadableFile( pFileName, "rb", pPath );
+		if ( !pFile )
+			return BaseClass::ReadFile( pFileName, pPath, buf, nMaxBytes, nStartingByte, pfnAlloc );
+
+		unsigned int nStart = MIN( (unsigned int)MAX( nStartingByte, 0 ), pFile->m_nSize );
+		unsigned int nBytes = pFile->m_nSize - nStart;
+		if ( nMaxBytes > 0 )
+			nBytes = MIN( nBytes, (unsigned int)nMaxBytes );
+
+		buf.Put( pFile->m_pData + nStart, nBytes );
+		return true;
+	}
+
+public:
+	typedef CFileSystemPassThru BaseClass;
+
+	IFileSystem *m_pPassThru;
+
+private:
+	// Returns the shared file to read if this is a read-only open of one.
+	CVMPISharedFile* FindReadableFile( const char *pFileName, const char *pOptions, const char *pathID )
+	{
+		if ( !s_SharedFiles.Count() || !pOptions || strchr( pOptions, 'w' ) || strchr( pOptions, 'a' ) || strchr( pOptions, '+' ) )
+			return NULL;
+
+		bool bVirtualPathID = ( pathID && !V_stricmp( pathID, VMPI_VIRTUAL_FILES_PATH_ID ) );
+
+		char normalized[MAX_PATH];
+		NormalizeFilename( m_pPassThru, pFileName, !bVirtualPathID, normalized, sizeof( normalized ) );
+
+		CVMPISharedFile *pFile = FindSharedFile( normalized, bVirtualPathID );
+		if ( !pFile || !WaitForFileData( pFile ) )
+			return NULL;
+
+		return pFile;
+	}
+};
+
+static CVMPIFileSystem s_VMPIFileSystem;
+
+
+// ----------------------------------------------------------------------------- //
+// Packets.
+// ----------------------------------------------------------------------------- //
+
+static void SendFileData( CVMPISharedFile *pFile, int iDest )
+{
+	char cPacketID[2] = { VMPI_PACKETID_FILESYSTEM, FS_SUBPACKETID_FILE_DATA };
+	VMPI_Send3Chunks(
+		cPacketID, sizeof( cPacketID ),
+		pFile->m_Name, V_strlen( pFile->m_Name ) + 1,
+		&pFile->m_nSize, sizeof( pFile->m_nSize ),
+		iDest );
+
+	// The bytes go separately so a big file isn't copied into one more buffer.
+	char cDataPacketID[2] = { VMPI_PACKETID_FILESYSTEM, FS_SUBPACKETID_FILE_BYTES };
+	VMPI_Send2Chunks( cDataPacketID, sizeof( cDataPacketID ), pFile->m_pData, pFile->m_nSize, iDest );
+}
+
+static bool FileSystemDispatch( MessageBuffer *pBuf, int iSource, int iPacketID )
+{
+	if ( pBuf->getLen() < 2 )
+		return false;
+
+	static CVMPISharedFile *s_pIncomingFile = NULL;
+
+	pBuf->setOffset( 2 );
+	switch ( pBuf->data[1] )
+	{
+		case FS_SUBPACKETID_SHARED_FILE:
+		{
+			if ( g_bMPIMaster )
+				return true;
+
+			CVMPISharedFile *pFile = new CVMPISharedFile;
+			unsigned char bAnyPathID = 0;
+			if ( pBuf->ReadString( pFile->m_Name, sizeof( pFile->m_Name ) ) < 0 ||
+				pBuf->ReadString( pFile->m_SharedMemoryName, sizeof( pFile->m_SharedMemoryName ) ) < 0 ||
+				pBuf->read( &pFile->m_nSize, sizeof( pFile->m_nSize ) ) < 0 ||
+				pBuf->read( &bAnyPathID, sizeof( bAnyPathID ) ) < 0 )
+			{
+				delete pFile;
+				return true;
+			}
+			pFile->m_bAnyPathID = ( bAnyPathID != 0 );
+
+			if ( VMPI_IsProcLocal( VMPI_MASTER_ID ) )
+			{
+				int fd = shm_open( pFile->m_SharedMemoryName, O_RDONLY, 0 );
+				if ( fd != -1 )
+				{
+					void *pData = mmap( NULL, MAX( pFile->m_nSize, 1u ), PROT_READ, MAP_SHARED, fd, 0 );
+					close( fd );
+					if ( pData != MAP_FAILED )
+					{
+						pFile->m_pData = (const char *)pData;
+						pFile->m_bMapped = true;
+						pFile->m_bHaveData = true;
+					}
+				}
+			}
+
+			if ( !pFile->m_bHaveData )
+			{
+				// Either the master is on another machine or we couldn't map it. Get a copy.
+				char cPacketID[2] = { VMPI_PACKETID_FILESYSTEM, FS_SUBPACKETID_REQUEST_DATA };
+				VMPI_Send2Chunks( cPacketID, sizeof( cPacketID ), pFile->m_Name, V_strlen( pFile->m_Name ) + 1, VMPI_MASTER_ID );
+			}
+
+			AUTO_LOCK( s_FilesMutex );
+			s_SharedFiles.AddToTail( pFile );
+		}
+		return true;
+
+		case FS_SUBPACKETID_REQUEST_DATA:
+		{
+			char name[MAX_PATH];
+			if ( !g_bMPIMaster || pBuf->ReadString( name, sizeof( name ) ) < 0 )
+				return true;
+
+			// Virtual file names are never resolved, shared file names always are, so both match here.
+			for ( int i=0; i < s_SharedFiles.Count(); i++ )
+			{
+				if ( V_stricmp( s_SharedFiles[i]->m_Name, name ) == 0 )
+				{
+					SendFileData( s_SharedFiles[i], iSource );
+					break;
+				}
+			}
+		}
+		return true;
+
+		case FS_SUBPACKETID_FILE_DATA:
+		{
+			char name[MAX_PATH];
+			unsigned int nSize;
+			s_pIncomingFile = NULL;
+			if ( g_bMPIMaster || pBuf->ReadString( name, sizeof( name ) ) < 0 || pBuf->read( &nSize, sizeof( nSize ) ) < 0 )
+				return true;
+
+			for ( int i=0; i < s_SharedFiles.Count(); i++ )
+			{
+				if ( V_stricmp( s_SharedFiles[i]->m_Name, name ) == 0 && !s_SharedFiles[i]->m_bHaveData && s_SharedFiles[i]->m_nSize == nSize )
+				{
+					s_pIncomingFile = s_SharedFiles[i];
+					break;
+				}
+			}
+		}
+		return true;
+
+		case FS_SUBPACKETID_FILE_BYTES:
+		{
+			CVMPISharedFile *pFile = s_pIncomingFile;
+			s_pIncomingFile = NULL;
+			if ( !pFile || pBuf->getLen() - 2 != (int)pFile->m_nSize )
+				return true;
+
+			char *pData = (char *)malloc( MAX( pFile->m_nSize, 1u ) );
+			memcpy( pData, &pBuf->data[2], pFile->m_nSize );
+			pFile->m_pData = pData;
+			pFile->m_bHaveData = true;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+CDispatchReg g_VMPIFileSystemReg( VMPI_PACKETID_FILESYSTEM, FileSystemDispatch );
+
+
+//-----------------------------------------------------------------------------
+// Puts a copy of the data in shared memory and tells the workers about it.
+//-----------------------------------------------------------------------------
+static void CreateSharedFile( const char *pNormalizedName, const void *pData, unsigned long fileLength, bool bAnyPathID )
+{
+	Assert( g_bMPIMaster );
+
+	if ( !s_bAtExitInstalled )
+	{
+		// Error() exits without going through VMPI_FileSystem_Term, so make sure the objects don't outlive us.
+		atexit( UnlinkSharedMemory );
+		s_bAtExitInstalled = true;
+	}
+
+	CVMPISharedFile *pFile = new CVMPISharedFile;
+	V_strncpy( pFile->m_Name, pNormalizedName, sizeof( pFile->m_Name ) );
+	V_snprintf( pFile->m_SharedMemoryName, sizeof( pFile->m_SharedMemoryName ), "%s%d", VMPI_GetSharedMemoryPrefix(), s_SharedFiles.Count() );
+	pFile->m_nSize = fileLength;
+	pFile->m_bAnyPathID = bAnyPathID;
+	pFile->m_bHaveData = true;
+
+	int fd = shm_open( pFile->m_SharedMemoryName, O_CREAT | O_EXCL | O_RDWR, 0600 );
+	void *pMapped = MAP_FAILED;
+	if ( fd != -1 )
+	{
+		if ( ftruncate( fd, MAX( fileLength, 1ul ) ) == 0 )
+			pMapped = mmap( NULL, MAX( fileLength, 1ul ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		close( fd );
+	}
+
+	if ( pMapped != MAP_FAILED )
+	{
+		memcpy( pMapped, pData, fileLength );
+		pFile->m_pData = (const char *)pMapped;
+		pFile->m_bMapped = true;
+	}
+	else
+	{
+		// The workers will ask for copies instead.
+		Warning( "VMPI: can't put %s in shared memory.\n", pNormalizedName );
+		if ( fd != -1 )
+			shm_unlink( pFile->m_SharedMemoryName );
+		pFile->m_SharedMemoryName[0] = 0;
+
+		char *pCopy = (char *)malloc( MAX( fileLength, 1ul ) );
+		memcpy( pCopy, pData, fileLength );
+		pFile->m_pData = pCopy;
+	}
+
+	{
+		AUTO_LOCK( s_FilesMutex );
+		s_SharedFiles.AddToTail( pFile );
+	}
+
+	// Workers that join later get this with the other persistent packets, so it always
+	// reaches them ahead of whatever the app sends to say the file is there.
+	MessageBuffer mb;
+	char cPacketID[2] = { VMPI_PACKETID_FILESYSTEM, FS_SUBPACKETID_SHARED_FILE };
+	unsigned char bAnyPathIDByte = bAnyPathID;
+	mb.write( cPacketID, sizeof( cPacketID ) );
+	mb.WriteString( pFile->m_Name );
+	mb.WriteString( pFile->m_SharedMemoryName );
+	mb.write( &pFile->m_nSize, sizeof( pFile->m_nSize ) );
+	mb.write( &bAnyPathIDByte, sizeof( bAnyPathIDByte ) );
+	VMPI_SendData( mb.data, mb.getLen(), VMPI_PERSISTENT );
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Public interface.
+// ----------------------------------------------------------------------------- //
+
+IFileSystem* VMPI_FileSystem_Init( int maxFileSystemMemoryUsage, IFileSystem *pPassThru )
+{
+	if ( !pPassThru )
+		Error( "VMPI: this platform's VMPI filesystem needs a local filesystem on the workers too." );
+
+	s_VMPIFileSystem.InitPassThru( pPassThru, false );
+	s_VMPIFileSystem.m_pPassThru = pPassThru;
+	return &s_VMPIFileSystem;
+}
+
+
+IFileSystem* VMPI_FileSystem_Term()
+{
+	IFileSystem *pPassThru = s_VMPIFileSystem.m_pPassThru;
+
+	UnlinkSharedMemory();
+
+	AUTO_LOCK( s_FilesMutex );
+	s_OpenFiles.PurgeAndDeleteElements();
+	for ( int i=0; i < s_SharedFiles.Count(); i++ )
+	{
+		CVMPISharedFile *pFile = s_SharedFiles[i];
+		if ( pFile->m_bMapped )
+			munmap( (void *)pFile->m_pData, MAX( pFile->m_nSize, 1u ) );
+		else
+			free( (void *)pFile->m_pData );
+	}
+	s_SharedFiles.PurgeAndDeleteElements();
+
+	s_VMPIFileSystem.m_pPassThru = NULL;
+	return pPassThru;
+}
+
+
+void VMPI_FileSystem_DisableFileAccess()
+{
+	s_bFileAccessDisabled = true;
+}
+
+
+static void* VMPI_FileSystem_Factory( const char *pName, int *pReturnCode )
+{
+	void *pInterface = NULL;
+	if ( !V_strcmp( pName, FILESYSTEM_INTERFACE_VERSION ) )
+		pInterface = (IFileSystem *)&s_VMPIFileSystem;
+	else if ( !V_strcmp( pName, BASEFILESYSTEM_INTERFACE_VERSION ) )
+		pInterface = (IBaseFileSystem *)&s_VMPIFileSystem;
+	else if ( s_VMPIFileSystem.m_pPassThru )
+		pInterface = s_VMPIFileSystem.m_pPassThru->QueryInterface( pName );
+
+	if ( pReturnCode )
+		*pReturnCode = pInterface ? IFACE_OK : IFACE_FAILED;
+	return pInterface;
+}
+
+CreateInterfaceFn VMPI_FileSystem_GetFactory()
+{
+	return VMPI_FileSystem_Factory;
+}
+
+
+void VMPI_FileSystem_CreateVirtualFile( const char *pFilename, const void *pData, unsigned long fileLength )
+{
+	char normalized[MAX_PATH];
+	NormalizeFilename( s_VMPIFileSystem.m_pPassThru, pFilename, false, normalized, sizeof( normalized ) );
+	CreateSharedFile( normalized, pData, fileLength, false );
+}
+
+
+bool VMPI_FileSystem_ShareFile( const char *pFilename )
+{
+	if ( !g_bMPIMaster || !s_VMPIFileSystem.m_pPassThru )
+		return false;
+
+	CUtlBuffer buf;
+	if ( !s_VMPIFileSystem.m_pPassThru->ReadFile( pFilename, NULL, buf ) )
+		return false;
+
+	char normalized[MAX_PATH];
+	NormalizeFilename( s_VMPIFileSystem.m_pPassThru, pFilename, true, normalized, sizeof( normalized ) );
+	CreateSharedFile( normalized, buf.Base(), buf.TellMaxPut(), true );
+	return true;
+}
@@ -28,4 +28,8 @@ VMPI_PARAM( mpi_Stats_TextOutput,			VMPI_PARAM_SDK_HIDDEN,	"Enables the workers
 VMPI_PARAM( mpi_pw,							VMPI_PARAM_SDK_HIDDEN,	"Non-SDK only. Sets a password on the VMPI job. Workers must also use the same -mpi_pw [password] argument or else the master will ignore their requests to join the job." )
 VMPI_PARAM( mpi_CalcShuffleCRC,				VMPI_PARAM_SDK_HIDDEN,	"Calculate a CRC for shuffled work unit arrays in the SDK work unit distributor." )
 VMPI_PARAM( mpi_Job_Watch,					VMPI_PARAM_SDK_HIDDEN,	"Automatically launches vmpi_job_watch.exe on the job." )
-VMPI_PARAM( mpi_Local,						VMPI_PARAM_SDK_HIDDEN,	"Similar to -mpi_AutoLocalWorker, but the automatically-spawned worker's console window is hidden." )
\ No newline at end of file
+VMPI_PARAM( mpi_Local,						VMPI_PARAM_SDK_HIDDEN,	"Similar to -mpi_AutoLocalWorker, but the automatically-spawned worker's console window is hidden." )
+#if defined( POSIX )
+VMPI_PARAM( mpi_LocalWorkers,				0,						"Used on the master's machine. Start this many worker processes on the local machine. The CPUs are split between the master and the local workers unless -threads is given." )
+VMPI_PARAM( mpi_Bind,						0,						"Used on the master. The address of the network interface that workers on other machines connect to, which also needs -mpi_pw. Otherwise the master only listens on the loopback interface." )
+#endif
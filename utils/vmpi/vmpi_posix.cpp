@@ -0,0 +1,1438 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Portable VMPI backend for platforms without the VMPI service.
+//
+//			The master listens on a Unix domain socket for the workers it starts
+//			on its own machine (-mpi_Local, -mpi_AutoLocalWorker, -mpi_LocalWorkers)
+//			and on a TCP port for workers started by hand with
+//			-mpi_worker <master>[:port]. The TCP port is on the loopback interface
+//			unless -mpi_Bind names another one. Every packet goes over the stream
+//			as a 32-bit length followed by the payload. All the receiving is done on
+//			the thread that calls VMPI_DispatchNextMessage; any thread can send.
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+#include "vmpi_posix.h"
+#include "vmpi_distribute_work.h"
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "tier1/utllinkedlist.h"
+
+
+// Packets bigger than this are treated as a corrupt stream.
+#define VMPI_MAX_PACKET_SIZE		( 512 * 1024 * 1024 )
+
+// Nothing is taken on trust before the handshake: the hellos have to fit in this,
+// and the master drops connections that haven't said hello in time.
+#define VMPI_MAX_HELLO_SIZE			512
+#define VMPI_HELLO_TIMEOUT			10.0
+
+// How long a worker keeps trying to reach the master without -mpi_Retry.
+#define VMPI_CONNECT_TIMEOUT		10.0
+
+#define VMPI_MAX_WORKER_THREADS		32
+
+// Packet lengths and the handshake are in network byte order. Everything else goes
+// over the wire in the sender's byte order, so the handshake makes sure the master
+// and the worker agree on it.
+#define VMPI_BYTE_ORDER_MARK		0x01020304
+
+#ifdef MSG_NOSIGNAL
+	#define VMPI_SEND_FLAGS			MSG_NOSIGNAL
+#else
+	#define VMPI_SEND_FLAGS			0
+#endif
+
+
+bool	g_bUseMPI = false;
+bool	g_bMPIMaster = false;
+int		g_iVMPIVerboseLevel = 0;
+bool	g_bMPI_Stats = false;
+bool	g_bMPI_StatsTextOutput = false;
+
+int		g_nBytesSent = 0;
+int		g_nMessagesSent = 0;
+int		g_nBytesReceived = 0;
+int		g_nMessagesReceived = 0;
+int		g_nMulticastBytesSent = 0;
+int		g_nMulticastBytesReceived = 0;
+
+int		g_nMaxWorkerCount = 0;
+
+
+// ----------------------------------------------------------------------------- //
+// Command line parameters.
+// ----------------------------------------------------------------------------- //
+
+struct VMPIParam_t
+{
+	const char	*m_pName;
+	int			m_Flags;
+	const char	*m_pHelpText;
+};
+
+#define VMPI_PARAM( paramName, paramFlags, helpText ) { "-" #paramName, paramFlags, helpText },
+static VMPIParam_t s_VMPIParams[] =
+{
+	{ "", 0, "" },		// k_eVMPICmdLineParam_FirstParam
+	{ "-mpi", 0, "Use VMPI to distribute the work." },
+	#include "vmpi_parameters.h"
+};
+#undef VMPI_PARAM
+
+
+// ----------------------------------------------------------------------------- //
+// Connections.
+// ----------------------------------------------------------------------------- //
+
+class CVMPIConnection
+{
+public:
+	CVMPIConnection()
+	{
+		m_Socket = -1;
+		m_iProcID = -1;
+		m_bConnected = false;
+		m_bLocal = false;
+		m_bUnixSocket = false;
+		m_bMachineNameSet = false;
+		m_MachineName[0] = 0;
+		m_JobWorkerID = 0xFFFFFFFF;
+		m_flAcceptTime = 0;
+	}
+
+	int					m_Socket;
+	int					m_iProcID;			// -1 until a worker has said hello.
+	bool				m_bConnected;
+	bool				m_bLocal;
+	bool				m_bUnixSocket;
+	bool				m_bMachineNameSet;
+	char				m_MachineName[128];
+	unsigned long		m_JobWorkerID;
+	double				m_flAcceptTime;		// When the master accepted it, for the hello timeout.
+
+	CThreadFastMutex	m_SendMutex;		// Held while a packet is written and while the socket is closed.
+	CUtlVector<char>	m_RecvBuf;			// Bytes received that don't make up a whole packet yet.
+};
+
+
+struct VMPIMessage_t
+{
+	int					m_iSource;
+	bool				m_bDisconnect;
+	CUtlVector<char>	m_Data;				// The packet, or the reason text for a disconnect.
+};
+
+
+static bool s_bInitialized = false;
+static VMPIRunMode s_RunMode = VMPI_RUN_NETWORKED;
+
+static CUtlVector<CVMPIConnection*>	s_Connections;			// Indexed by proc ID.
+static CUtlVector<CVMPIConnection*>	s_PendingConnections;	// Accepted by the master, waiting for their hello.
+static CUtlVector<CVMPIConnection*>	s_RejectedConnections;	// Closed before they got a proc ID.
+static int s_iMyProcID = -1;
+
+static int s_UnixListenSocket = -1;
+static int s_TCPListenSocket = -1;
+static char s_UnixSocketPath[256];
+static char s_SharedMemoryPrefix[64];
+
+static CUtlLinkedList<VMPIMessage_t*, int>	s_Messages;
+static CUtlVector< CUtlVector<char>* >		s_PersistentPackets;
+
+static VMPIDispatchFn s_DispatchFns[MAX_VMPI_PACKET_IDS];
+static CUtlVector<VMPI_Disconnect_Handler>	s_DisconnectHandlers;
+static CUtlVector<VMPI_Connect_Handler>		s_ConnectHandlers;
+
+static CUtlVector<pid_t>	s_LocalWorkerPIDs;
+static CUtlVector<char*>	s_Argv;
+static char s_ExePath[512];
+
+static char s_LocalMachineName[128];
+static char s_CurrentStage[128];
+static int s_nWorkerThreads = 1;
+
+static CThreadFastMutex s_StatsMutex;
+
+
+// ----------------------------------------------------------------------------- //
+// Socket helpers.
+// ----------------------------------------------------------------------------- //
+
+static bool SendAll( int sock, const void *pData, int nBytes )
+{
+	const char *pCur = (const char *)pData;
+	while ( nBytes > 0 )
+	{
+		ssize_t nSent = send( sock, pCur, nBytes, VMPI_SEND_FLAGS );
+		if ( nSent < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+
+		pCur += nSent;
+		nBytes -= nSent;
+	}
+	return true;
+}
+
+static void SetCloseOnExec( int sock )
+{
+	fcntl( sock, F_SETFD, fcntl( sock, F_GETFD ) | FD_CLOEXEC );
+}
+
+static void SetNoDelay( int sock )
+{
+	int on = 1;
+	setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Writes one packet. Safe to call from any thread. If the write fails, the
+// socket is shut down so the dispatch loop sees the disconnect.
+//-----------------------------------------------------------------------------
+static bool SendPacket( CVMPIConnection *pConn, void const * const *pChunks, const int *pChunkLengths, int nChunks )
+{
+	int nTotal = 0;
+	for ( int i=0; i < nChunks; i++ )
+		nTotal += pChunkLengths[i];
+
+	pConn->m_SendMutex.Lock();
+
+	bool bOk = pConn->m_bConnected && pConn->m_Socket != -1;
+	if ( bOk )
+	{
+		uint32 nLength = htonl( nTotal );
+		bOk = SendAll( pConn->m_Socket, &nLength, sizeof( nLength ) );
+		for ( int i=0; i < nChunks && bOk; i++ )
+		{
+			bOk = SendAll( pConn->m_Socket, pChunks[i], pChunkLengths[i] );
+		}
+
+		if ( !bOk )
+		{
+			shutdown( pConn->m_Socket, SHUT_RDWR );
+		}
+	}
+
+	pConn->m_SendMutex.Unlock();
+
+	if ( bOk )
+	{
+		s_StatsMutex.Lock();
+		g_nBytesSent += nTotal + sizeof( uint32 );
+		++g_nMessagesSent;
+		s_StatsMutex.Unlock();
+	}
+	return bOk;
+}
+
+static bool SendPacket( CVMPIConnection *pConn, const void *pData, int nBytes )
+{
+	return SendPacket( pConn, &pData, &nBytes, 1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Closes a connection and queues up the disconnect so the handlers are called
+// in order with the packets that came in before it.
+//-----------------------------------------------------------------------------
+static void CloseConnection( CVMPIConnection *pConn, const char *pReason )
+{
+	if ( !pConn->m_bConnected )
+		return;
+
+	pConn->m_SendMutex.Lock();
+	pConn->m_bConnected = false;
+	close( pConn->m_Socket );
+	pConn->m_Socket = -1;
+	pConn->m_SendMutex.Unlock();
+
+	pConn->m_RecvBuf.Purge();
+
+	if ( pConn->m_iProcID < 0 )
+	{
+		// Still in the middle of the handshake. Packets may still be walking it, so don't free it yet.
+		s_PendingConnections.FindAndRemove( pConn );
+		s_RejectedConnections.AddToTail( pConn );
+		return;
+	}
+
+	VMPIMessage_t *pMsg = new VMPIMessage_t;
+	pMsg->m_iSource = pConn->m_iProcID;
+	pMsg->m_bDisconnect = true;
+	pMsg->m_Data.CopyArray( pReason, V_strlen( pReason ) + 1 );
+	s_Messages.AddToTail( pMsg );
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Handshake. The ints are in network byte order.
+//
+// Worker -> master:	int version, int byte order mark, password string, machine name string
+// Master -> worker:	int version, int proc ID, machine name string
+// ----------------------------------------------------------------------------- //
+
+static void WriteNetworkInt( MessageBuffer *pBuf, int nValue )
+{
+	uint32 nNetValue = htonl( (uint32)nValue );
+	pBuf->write( &nNetValue, sizeof( nNetValue ) );
+}
+
+static bool ReadNetworkInt( MessageBuffer *pBuf, int *pValue )
+{
+	uint32 nNetValue;
+	if ( pBuf->read( &nNetValue, sizeof( nNetValue ) ) < 0 )
+		return false;
+
+	*pValue = (int)ntohl( nNetValue );
+	return true;
+}
+
+static const char* GetPassword()
+{
+	const char *pPassword = VMPI_FindArg( s_Argv.Count() - 1, s_Argv.Base(), VMPI_GetParamString( mpi_pw ), "" );
+	return pPassword ? pPassword : "";
+}
+
+static void SendHello( CVMPIConnection *pConn, int iProcID )
+{
+	MessageBuffer mb;
+	WriteNetworkInt( &mb, VMPI_PROTOCOL_VERSION );
+	if ( iProcID >= 0 )
+	{
+		WriteNetworkInt( &mb, iProcID );
+	}
+	else
+	{
+		// The mark is written in our own byte order so the master can compare it with its own.
+		uint32 nByteOrderMark = VMPI_BYTE_ORDER_MARK;
+		mb.write( &nByteOrderMark, sizeof( nByteOrderMark ) );
+		mb.WriteString( GetPassword() );
+	}
+	mb.WriteString( s_LocalMachineName );
+
+	SendPacket( pConn, mb.data, mb.getLen() );
+}
+
+static int CountConnectedWorkers()
+{
+	int nWorkers = 0;
+	for ( int i=0; i < s_Connections.Count(); i++ )
+	{
+		if ( i != VMPI_MASTER_ID && s_Connections[i]->m_bConnected )
+			++nWorkers;
+	}
+	return nWorkers;
+}
+
+//-----------------------------------------------------------------------------
+// The master got the first packet from a new connection.
+//-----------------------------------------------------------------------------
+static void OnWorkerHello( CVMPIConnection *pConn, MessageBuffer *pBuf )
+{
+	s_PendingConnections.FindAndRemove( pConn );
+
+	int nVersion;
+	uint32 nByteOrderMark;
+	char password[256], machineName[128];
+	if ( !ReadNetworkInt( pBuf, &nVersion ) ||
+		nVersion != VMPI_PROTOCOL_VERSION ||
+		pBuf->read( &nByteOrderMark, sizeof( nByteOrderMark ) ) < 0 ||
+		pBuf->ReadString( password, sizeof( password ) ) < 0 ||
+		pBuf->ReadString( machineName, sizeof( machineName ) ) < 0 )
+	{
+		Warning( "VMPI: rejecting a worker with the wrong protocol version.\n" );
+		CloseConnection( pConn, "" );
+		return;
+	}
+
+	if ( nByteOrderMark != VMPI_BYTE_ORDER_MARK )
+	{
+		Warning( "VMPI: rejecting worker %s, it uses a different byte order.\n", machineName );
+		CloseConnection( pConn, "" );
+		return;
+	}
+
+	// Every worker has to give the job's password, even an empty one.
+	if ( V_strcmp( GetPassword(), password ) != 0 )
+	{
+		Warning( "VMPI: rejecting worker %s, wrong %s.\n", machineName, VMPI_GetParamString( mpi_pw ) );
+		CloseConnection( pConn, "" );
+		return;
+	}
+
+	if ( g_nMaxWorkerCount > 0 && CountConnectedWorkers() >= g_nMaxWorkerCount )
+	{
+		CloseConnection( pConn, "" );
+		return;
+	}
+
+	V_strncpy( pConn->m_MachineName, machineName, sizeof( pConn->m_MachineName ) );
+	pConn->m_bMachineNameSet = true;
+	pConn->m_bLocal = pConn->m_bUnixSocket || V_stricmp( machineName, s_LocalMachineName ) == 0;
+	pConn->m_iProcID = s_Connections.AddToTail( pConn );
+
+	SendHello( pConn, pConn->m_iProcID );
+
+	// Bring it up to date with everything that was sent to all the workers so far.
+	for ( int i=0; i < s_PersistentPackets.Count(); i++ )
+	{
+		SendPacket( pConn, s_PersistentPackets[i]->Base(), s_PersistentPackets[i]->Count() );
+	}
+
+	Msg( "VMPI: worker %d (%s%s) connected.\n", pConn->m_iProcID, machineName, pConn->m_bLocal ? ", local" : "" );
+
+	for ( int i=0; i < s_ConnectHandlers.Count(); i++ )
+	{
+		s_ConnectHandlers[i]( pConn->m_iProcID );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The worker got the master's answer to its hello.
+//-----------------------------------------------------------------------------
+static void OnMasterHello( CVMPIConnection *pConn, MessageBuffer *pBuf )
+{
+	int nVersion, iProcID;
+	char machineName[128];
+	if ( !ReadNetworkInt( pBuf, &nVersion ) ||
+		!ReadNetworkInt( pBuf, &iProcID ) ||
+		pBuf->ReadString( machineName, sizeof( machineName ) ) < 0 ||
+		nVersion != VMPI_PROTOCOL_VERSION )
+	{
+		CloseConnection( pConn, "protocol version mismatch" );
+		return;
+	}
+
+	V_strncpy( pConn->m_MachineName, machineName, sizeof( pConn->m_MachineName ) );
+	pConn->m_bMachineNameSet = true;
+	s_iMyProcID = iProcID;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Receiving.
+// ----------------------------------------------------------------------------- //
+
+// True until the other side's hello has been accepted.
+static bool IsInHandshake( CVMPIConnection *pConn )
+{
+	return pConn->m_iProcID < 0 || ( !g_bMPIMaster && s_iMyProcID < 0 );
+}
+
+static void OnPacket( CVMPIConnection *pConn, const char *pData, int nBytes )
+{
+	s_StatsMutex.Lock();
+	g_nBytesReceived += nBytes + sizeof( uint32 );
+	++g_nMessagesReceived;
+	s_StatsMutex.Unlock();
+
+	if ( IsInHandshake( pConn ) )
+	{
+		MessageBuffer mb( nBytes );
+		mb.write( pData, nBytes );
+		if ( g_bMPIMaster )
+			OnWorkerHello( pConn, &mb );
+		else
+			OnMasterHello( pConn, &mb );
+		return;
+	}
+
+	VMPIMessage_t *pMsg = new VMPIMessage_t;
+	pMsg->m_iSource = pConn->m_iProcID;
+	pMsg->m_bDisconnect = false;
+	pMsg->m_Data.CopyArray( pData, nBytes );
+	s_Messages.AddToTail( pMsg );
+}
+
+static void ReadFromConnection( CVMPIConnection *pConn )
+{
+	CUtlVector<char> &buf = pConn->m_RecvBuf;
+
+	// Read straight into the buffer, sized for the rest of the packet once we know its length.
+	// Until the handshake is done, only a hello's worth is ever held.
+	int nWanted = 64 * 1024;
+	if ( IsInHandshake( pConn ) )
+	{
+		nWanted = VMPI_MAX_HELLO_SIZE + sizeof( uint32 ) - buf.Count();
+	}
+	else if ( buf.Count() >= (int)sizeof( uint32 ) )
+	{
+		uint32 nLength = ntohl( *(uint32 *)buf.Base() );
+		if ( nLength <= VMPI_MAX_PACKET_SIZE )
+			nWanted = MAX( nWanted, (int)( nLength + sizeof( uint32 ) ) - buf.Count() );
+	}
+
+	int nOldCount = buf.Count();
+	buf.AddMultipleToTail( nWanted );
+	ssize_t nRead = recv( pConn->m_Socket, buf.Base() + nOldCount, nWanted, 0 );
+	buf.SetCountNonDestructively( nOldCount + MAX( (int)nRead, 0 ) );
+
+	if ( nRead == 0 || ( nRead < 0 && errno != EINTR && errno != EAGAIN ) )
+	{
+		CloseConnection( pConn, nRead == 0 ? "connection closed" : strerror( errno ) );
+		return;
+	}
+
+	// Pull out all the whole packets.
+	int nUsed = 0;
+	while ( buf.Count() - nUsed >= (int)sizeof( uint32 ) )
+	{
+		uint32 nLength = ntohl( *(uint32 *)( buf.Base() + nUsed ) );
+		if ( nLength > ( IsInHandshake( pConn ) ? VMPI_MAX_HELLO_SIZE : VMPI_MAX_PACKET_SIZE ) )
+		{
+			CloseConnection( pConn, "invalid packet size" );
+			return;
+		}
+
+		if ( buf.Count() - nUsed < (int)( nLength + sizeof( uint32 ) ) )
+			break;
+
+		OnPacket( pConn, buf.Base() + nUsed + sizeof( uint32 ), nLength );
+		if ( !pConn->m_bConnected || pConn->m_Socket == -1 )
+			return;
+
+		nUsed += nLength + sizeof( uint32 );
+	}
+
+	if ( nUsed )
+	{
+		buf.RemoveMultiple( 0, nUsed );
+	}
+}
+
+static void AcceptConnection( int listenSocket, bool bUnixSocket )
+{
+	int sock = accept( listenSocket, NULL, NULL );
+	if ( sock < 0 )
+		return;
+
+	SetCloseOnExec( sock );
+	if ( !bUnixSocket )
+	{
+		SetNoDelay( sock );
+	}
+
+	CVMPIConnection *pConn = new CVMPIConnection;
+	pConn->m_Socket = sock;
+	pConn->m_bConnected = true;
+	pConn->m_bUnixSocket = bUnixSocket;
+	pConn->m_flAcceptTime = Plat_FloatTime();
+	s_PendingConnections.AddToTail( pConn );
+}
+
+//-----------------------------------------------------------------------------
+// Waits up to timeoutMS for data on any socket and turns it into messages.
+//-----------------------------------------------------------------------------
+static void PollSockets( int timeoutMS )
+{
+	CUtlVector<pollfd> fds;
+	CUtlVector<CVMPIConnection*> fdConnections;
+
+	// Nothing refers to the rejected connections outside a call to this, so they can go now.
+	s_RejectedConnections.PurgeAndDeleteElements();
+
+	double flTime = Plat_FloatTime();
+	for ( int i=s_PendingConnections.Count()-1; i >= 0; i-- )
+	{
+		if ( flTime - s_PendingConnections[i]->m_flAcceptTime > VMPI_HELLO_TIMEOUT )
+		{
+			CloseConnection( s_PendingConnections[i], "" );
+		}
+	}
+
+	for ( int i=0; i < s_Connections.Count(); i++ )
+	{
+		if ( s_Connections[i]->m_bConnected && s_Connections[i]->m_Socket != -1 )
+		{
+			pollfd fd = { s_Connections[i]->m_Socket, POLLIN, 0 };
+			fds.AddToTail( fd );
+			fdConnections.AddToTail( s_Connections[i] );
+		}
+	}
+
+	for ( int i=0; i < s_PendingConnections.Count(); i++ )
+	{
+		pollfd fd = { s_PendingConnections[i]->m_Socket, POLLIN, 0 };
+		fds.AddToTail( fd );
+		fdConnections.AddToTail( s_PendingConnections[i] );
+	}
+
+	int iFirstListenSocket = fds.Count();
+	if ( s_UnixListenSocket != -1 )
+	{
+		pollfd fd = { s_UnixListenSocket, POLLIN, 0 };
+		fds.AddToTail( fd );
+	}
+	if ( s_TCPListenSocket != -1 )
+	{
+		pollfd fd = { s_TCPListenSocket, POLLIN, 0 };
+		fds.AddToTail( fd );
+	}
+
+	if ( fds.Count() == 0 )
+	{
+		ThreadSleep( timeoutMS );
+		return;
+	}
+
+	if ( poll( fds.Base(), fds.Count(), timeoutMS ) <= 0 )
+		return;
+
+	for ( int i=0; i < iFirstListenSocket; i++ )
+	{
+		if ( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) )
+		{
+			ReadFromConnection( fdConnections[i] );
+		}
+	}
+
+	for ( int i=iFirstListenSocket; i < fds.Count(); i++ )
+	{
+		if ( fds[i].revents & POLLIN )
+		{
+			AcceptConnection( fds[i].fd, fds[i].fd == s_UnixListenSocket );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Pulls the next message off the queue, waiting up to timeout ms for one.
+//-----------------------------------------------------------------------------
+static VMPIMessage_t* GetNextMessage( unsigned long timeout )
+{
+	double flEndTime = Plat_FloatTime() + timeout * 0.001;
+	while ( s_Messages.Count() == 0 )
+	{
+		int timeoutMS = 1000;
+		if ( timeout != VMPI_TIMEOUT_INFINITE )
+		{
+			timeoutMS = (int)( ( flEndTime - Plat_FloatTime() ) * 1000 );
+			timeoutMS = MIN( MAX( timeoutMS, 0 ), 1000 );
+		}
+
+		PollSockets( timeoutMS );
+
+		if ( s_Messages.Count() == 0 && timeout != VMPI_TIMEOUT_INFINITE && Plat_FloatTime() >= flEndTime )
+			return NULL;
+	}
+
+	int iHead = s_Messages.Head();
+	VMPIMessage_t *pMsg = s_Messages[iHead];
+	s_Messages.Remove( iHead );
+	return pMsg;
+}
+
+static void DispatchMessage( VMPIMessage_t *pMsg )
+{
+	if ( pMsg->m_bDisconnect )
+	{
+		for ( int i=0; i < s_DisconnectHandlers.Count(); i++ )
+		{
+			s_DisconnectHandlers[i]( pMsg->m_iSource, pMsg->m_Data.Base() );
+		}
+	}
+	else if ( pMsg->m_Data.Count() > 0 )
+	{
+		int iPacketID = (unsigned char)pMsg->m_Data[0];
+		if ( iPacketID < MAX_VMPI_PACKET_IDS && s_DispatchFns[iPacketID] )
+		{
+			MessageBuffer mb( pMsg->m_Data.Count() );
+			mb.write( pMsg->m_Data.Base(), pMsg->m_Data.Count() );
+			s_DispatchFns[iPacketID]( &mb, pMsg->m_iSource, iPacketID );
+		}
+		else if ( g_iVMPIVerboseLevel >= 1 )
+		{
+			Warning( "VMPI: no handler for packet ID %d from %s.\n", iPacketID, VMPI_GetMachineName( pMsg->m_iSource ) );
+		}
+	}
+
+	delete pMsg;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Master and worker startup.
+// ----------------------------------------------------------------------------- //
+
+static bool IsArgUsed( const char *pName )
+{
+	return VMPI_FindArg( s_Argv.Count() - 1, s_Argv.Base(), pName, "" ) != NULL;
+}
+
+static int GetNumLocalWorkers( VMPIRunMode runMode )
+{
+	const char *pCount = VMPI_FindArg( s_Argv.Count() - 1, s_Argv.Base(), VMPI_GetParamString( mpi_LocalWorkers ), "1" );
+	if ( pCount )
+		return MAX( atoi( pCount ), 0 );
+
+	if ( runMode == VMPI_RUN_LOCAL || IsArgUsed( VMPI_GetParamString( mpi_AutoLocalWorker ) ) )
+		return 1;
+
+	return 0;
+}
+
+static void SpawnLocalWorkers( int nWorkers, bool bPassThreads )
+{
+	char workerAddr[300], threads[16];
+	V_snprintf( workerAddr, sizeof( workerAddr ), "unix:%s", s_UnixSocketPath );
+	V_snprintf( threads, sizeof( threads ), "%d", s_nWorkerThreads );
+
+	CUtlVector<char*> argv;
+	argv.AddToTail( s_Argv[0] );
+	argv.AddToTail( (char *)VMPI_GetParamString( mpi_Worker ) );
+	argv.AddToTail( workerAddr );
+	if ( bPassThreads )
+	{
+		argv.AddToTail( (char *)"-threads" );
+		argv.AddToTail( threads );
+	}
+
+	// Everything else goes through except the args that would make the worker a master.
+	for ( int i=1; i < s_Argv.Count() - 1; i++ )
+	{
+		const char *pArg = s_Argv[i];
+		if ( !V_stricmp( pArg, "-mpi" ) ||
+			!V_stricmp( pArg, VMPI_GetParamString( mpi_Local ) ) ||
+			!V_stricmp( pArg, VMPI_GetParamString( mpi_AutoLocalWorker ) ) )
+		{
+			continue;
+		}
+
+		if ( !V_stricmp( pArg, VMPI_GetParamString( mpi_Port ) ) ||
+			!V_stricmp( pArg, VMPI_GetParamString( mpi_Bind ) ) ||
+			!V_stricmp( pArg, VMPI_GetParamString( mpi_LocalWorkers ) ) )
+		{
+			if ( i + 1 < s_Argv.Count() - 1 && s_Argv[i+1][0] != '-' )
+				++i;
+			continue;
+		}
+
+		argv.AddToTail( s_Argv[i] );
+	}
+	argv.AddToTail( NULL );
+
+	for ( int i=0; i < nWorkers; i++ )
+	{
+		pid_t pid = fork();
+		if ( pid == 0 )
+		{
+			execv( s_ExePath, argv.Base() );
+			execvp( argv[0], argv.Base() );
+			_exit( 1 );
+		}
+
+		if ( pid < 0 )
+		{
+			Warning( "VMPI: unable to start a local worker (%s).\n", strerror( errno ) );
+			break;
+		}
+
+		s_LocalWorkerPIDs.AddToTail( pid );
+	}
+}
+
+static bool StartMaster( VMPIRunMode runMode )
+{
+	// Remote workers can only reach us on the interface we're told to use, and
+	// never from off this machine without a password.
+	in_addr bindAddr;
+	bindAddr.s_addr = htonl( INADDR_LOOPBACK );
+	const char *pBindAddr = VMPI_FindArg( s_Argv.Count() - 1, s_Argv.Base(), VMPI_GetParamString( mpi_Bind ), "" );
+	if ( pBindAddr )
+	{
+		if ( !pBindAddr[0] || inet_pton( AF_INET, pBindAddr, &bindAddr ) != 1 )
+		{
+			Warning( "VMPI: %s needs the IPv4 address of one of this machine's interfaces.\n", VMPI_GetParamString( mpi_Bind ) );
+			return false;
+		}
+
+		if ( ( ntohl( bindAddr.s_addr ) >> 24 ) != 127 && !GetPassword()[0] )
+		{
+			Warning( "VMPI: %s needs %s so strangers can't join the job.\n", VMPI_GetParamString( mpi_Bind ), VMPI_GetParamString( mpi_pw ) );
+			return false;
+		}
+	}
+
+	g_bMPIMaster = true;
+	s_iMyProcID = VMPI_MASTER_ID;
+
+	CVMPIConnection *pSelf = new CVMPIConnection;
+	pSelf->m_iProcID = VMPI_MASTER_ID;
+	pSelf->m_bConnected = true;
+	pSelf->m_bLocal = true;
+	pSelf->m_bMachineNameSet = true;
+	V_strncpy( pSelf->m_MachineName, s_LocalMachineName, sizeof( pSelf->m_MachineName ) );
+	s_Connections.AddToTail( pSelf );
+
+	// Local workers connect here.
+	V_snprintf( s_UnixSocketPath, sizeof( s_UnixSocketPath ), "/tmp/vmpi_%d.sock", (int)getpid() );
+	unlink( s_UnixSocketPath );
+
+	s_UnixListenSocket = socket( AF_UNIX, SOCK_STREAM, 0 );
+	sockaddr_un unixAddr;
+	memset( &unixAddr, 0, sizeof( unixAddr ) );
+	unixAddr.sun_family = AF_UNIX;
+	V_strncpy( unixAddr.sun_path, s_UnixSocketPath, sizeof( unixAddr.sun_path ) );
+	if ( s_UnixListenSocket == -1 ||
+		bind( s_UnixListenSocket, (sockaddr *)&unixAddr, sizeof( unixAddr ) ) != 0 ||
+		chmod( s_UnixSocketPath, S_IRUSR | S_IWUSR ) != 0 ||
+		listen( s_UnixListenSocket, 64 ) != 0 )
+	{
+		Warning( "VMPI: can't listen on %s (%s).\n", s_UnixSocketPath, strerror( errno ) );
+		if ( s_UnixListenSocket != -1 )
+			close( s_UnixListenSocket );
+		s_UnixListenSocket = -1;
+		s_UnixSocketPath[0] = 0;
+	}
+	else
+	{
+		SetCloseOnExec( s_UnixListenSocket );
+	}
+
+	// Workers on other machines connect here.
+	int iFirstPort = VMPI_MASTER_FIRST_PORT, iLastPort = VMPI_MASTER_LAST_PORT;
+	const char *pPort = VMPI_FindArg( s_Argv.Count() - 1, s_Argv.Base(), VMPI_GetParamString( mpi_Port ), NULL );
+	if ( pPort )
+	{
+		iFirstPort = iLastPort = atoi( pPort );
+	}
+
+	s_TCPListenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+	if ( s_TCPListenSocket != -1 )
+	{
+		int on = 1;
+		setsockopt( s_TCPListenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+		SetCloseOnExec( s_TCPListenSocket );
+
+		int iPort;
+		for ( iPort = iFirstPort; iPort <= iLastPort; iPort++ )
+		{
+			sockaddr_in addr;
+			memset( &addr, 0, sizeof( addr ) );
+			addr.sin_family = AF_INET;
+			addr.sin_addr = bindAddr;
+			addr.sin_port = htons( iPort );
+			if ( bind( s_TCPListenSocket, (sockaddr *)&addr, sizeof( addr ) ) == 0 && listen( s_TCPListenSocket, 64 ) == 0 )
+				break;
+		}
+
+		if ( iPort > iLastPort )
+		{
+			Warning( "VMPI: can't listen on TCP ports %d-%d, only local workers can join.\n", iFirstPort, iLastPort );
+			close( s_TCPListenSocket );
+			s_TCPListenSocket = -1;
+		}
+		else
+		{
+			char addrString[INET_ADDRSTRLEN];
+			inet_ntop( AF_INET, &bindAddr, addrString, sizeof( addrString ) );
+			Msg( "VMPI: master listening on %s:%d.\n", addrString, iPort );
+		}
+	}
+
+	if ( s_UnixListenSocket == -1 && s_TCPListenSocket == -1 )
+		return false;
+
+	int nLocalWorkers = GetNumLocalWorkers( runMode );
+	if ( nLocalWorkers > 0 && s_UnixListenSocket != -1 )
+	{
+		// Split the CPUs between the master and the local workers unless told otherwise.
+		bool bPassThreads = !IsArgUsed( "-threads" );
+		if ( bPassThreads )
+		{
+			int nProcesses = nLocalWorkers + ( IsArgUsed( VMPI_GetParamString( mpi_NoMasterWorkerThreads ) ) ? 0 : 1 );
+			s_nWorkerThreads = MAX( s_nWorkerThreads / nProcesses, 1 );
+		}
+
+		SpawnLocalWorkers( nLocalWorkers, bPassThreads );
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// pAddr is "unix:<path>" or "<host>[:port]".
+//-----------------------------------------------------------------------------
+static int OpenSocketToMaster( const char *pAddr )
+{
+	if ( !V_strnicmp( pAddr, "unix:", 5 ) )
+	{
+		int sock = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if ( sock == -1 )
+			return -1;
+
+		sockaddr_un addr;
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sun_family = AF_UNIX;
+		V_strncpy( addr.sun_path, pAddr + 5, sizeof( addr.sun_path ) );
+		if ( connect( sock, (sockaddr *)&addr, sizeof( addr ) ) != 0 )
+		{
+			close( sock );
+			return -1;
+		}
+		return sock;
+	}
+
+	char host[256];
+	V_strncpy( host, pAddr, sizeof( host ) );
+	char port[16];
+	V_snprintf( port, sizeof( port ), "%d", VMPI_MASTER_FIRST_PORT );
+	if ( char *pColon = strchr( host, ':' ) )
+	{
+		*pColon = 0;
+		V_strncpy( port, pColon + 1, sizeof( port ) );
+	}
+
+	addrinfo hints, *pResults = NULL;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ( getaddrinfo( host, port, &hints, &pResults ) != 0 )
+		return -1;
+
+	int sock = -1;
+	for ( addrinfo *pCur = pResults; pCur && sock == -1; pCur = pCur->ai_next )
+	{
+		sock = socket( pCur->ai_family, pCur->ai_socktype, pCur->ai_protocol );
+		if ( sock != -1 && connect( sock, pCur->ai_addr, pCur->ai_addrlen ) != 0 )
+		{
+			close( sock );
+			sock = -1;
+		}
+	}
+	freeaddrinfo( pResults );
+
+	if ( sock != -1 )
+	{
+		SetNoDelay( sock );
+	}
+	return sock;
+}
+
+static bool ConnectToMaster( const char *pAddr )
+{
+	bool bRetry = IsArgUsed( VMPI_GetParamString( mpi_Retry ) );
+	double flGiveUpTime = Plat_FloatTime() + VMPI_CONNECT_TIMEOUT;
+
+	int sock;
+	while ( ( sock = OpenSocketToMaster( pAddr ) ) == -1 )
+	{
+		if ( !bRetry && Plat_FloatTime() > flGiveUpTime )
+		{
+			Warning( "VMPI: can't connect to the master at %s.\n", pAddr );
+			return false;
+		}
+		ThreadSleep( 250 );
+	}
+	SetCloseOnExec( sock );
+
+	CVMPIConnection *pMaster = new CVMPIConnection;
+	pMaster->m_Socket = sock;
+	pMaster->m_iProcID = VMPI_MASTER_ID;
+	pMaster->m_bConnected = true;
+	pMaster->m_bUnixSocket = !V_strnicmp( pAddr, "unix:", 5 );
+	pMaster->m_bLocal = pMaster->m_bUnixSocket;
+	s_Connections.AddToTail( pMaster );
+
+	SendHello( pMaster, -1 );
+
+	flGiveUpTime = Plat_FloatTime() + VMPI_CONNECT_TIMEOUT;
+	while ( s_iMyProcID < 0 )
+	{
+		if ( !pMaster->m_bConnected || Plat_FloatTime() > flGiveUpTime )
+		{
+			Warning( "VMPI: the master at %s didn't accept us.\n", pAddr );
+			return false;
+		}
+		PollSockets( 100 );
+	}
+
+	if ( !pMaster->m_bUnixSocket )
+	{
+		pMaster->m_bLocal = ( V_stricmp( pMaster->m_MachineName, s_LocalMachineName ) == 0 );
+	}
+
+	// Pad the table so proc IDs index it on the worker too.
+	while ( s_Connections.Count() <= s_iMyProcID )
+	{
+		CVMPIConnection *pConn = new CVMPIConnection;
+		pConn->m_iProcID = s_Connections.Count();
+		s_Connections.AddToTail( pConn );
+	}
+	s_Connections[s_iMyProcID]->m_bLocal = true;
+	s_Connections[s_iMyProcID]->m_bMachineNameSet = true;
+	V_strncpy( s_Connections[s_iMyProcID]->m_MachineName, s_LocalMachineName, sizeof( s_Connections[s_iMyProcID]->m_MachineName ) );
+
+	return true;
+}
+
+
+// ----------------------------------------------------------------------------- //
+// Public interface.
+// ----------------------------------------------------------------------------- //
+
+CDispatchReg::CDispatchReg( int iPacketID, VMPIDispatchFn fn )
+{
+	Assert( iPacketID >= 0 && iPacketID < MAX_VMPI_PACKET_IDS );
+	Assert( !s_DispatchFns[iPacketID] );
+	s_DispatchFns[iPacketID] = fn;
+}
+
+
+bool VMPI_Init(
+	int &argc,
+	char **&argv,
+	const char *pDependencyFilename,
+	VMPI_Disconnect_Handler handler,
+	VMPIRunMode runMode,
+	bool bConnectingAsService
+	)
+{
+	signal( SIGPIPE, SIG_IGN );
+
+	g_bUseMPI = true;
+	s_bInitialized = true;
+	s_RunMode = runMode;
+
+	// Keep a copy of the command line for spawning local workers and -mpi_AutoRestart.
+	for ( int i=0; i < argc; i++ )
+	{
+		s_Argv.AddToTail( strdup( argv[i] ) );
+	}
+	s_Argv.AddToTail( NULL );
+
+	ssize_t nExePathLen = readlink( "/proc/self/exe", s_ExePath, sizeof( s_ExePath ) - 1 );
+	if ( nExePathLen > 0 )
+		s_ExePath[nExePathLen] = 0;
+	else
+		V_strncpy( s_ExePath, argv[0], sizeof( s_ExePath ) );
+
+	if ( gethostname( s_LocalMachineName, sizeof( s_LocalMachineName ) ) != 0 )
+		V_strncpy( s_LocalMachineName, "localhost", sizeof( s_LocalMachineName ) );
+	s_LocalMachineName[sizeof( s_LocalMachineName ) - 1] = 0;
+
+	V_snprintf( s_SharedMemoryPrefix, sizeof( s_SharedMemoryPrefix ), "/vmpi_%d_", (int)getpid() );
+
+	if ( const char *pVerbose = VMPI_FindArg( argc, argv, VMPI_GetParamString( mpi_Verbose ), "1" ) )
+		g_iVMPIVerboseLevel = atoi( pVerbose );
+
+	if ( const char *pCount = VMPI_FindArg( argc, argv, VMPI_GetParamString( mpi_WorkerCount ), "0" ) )
+		g_nMaxWorkerCount = atoi( pCount );
+
+	s_nWorkerThreads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+	if ( const char *pThreads = VMPI_FindArg( argc, argv, "-threads", NULL ) )
+		s_nWorkerThreads = atoi( pThreads );
+	s_nWorkerThreads = MIN( MAX( s_nWorkerThreads, 1 ), VMPI_MAX_WORKER_THREADS );
+
+	if ( handler )
+	{
+		VMPI_AddDisconnectHandler( handler );
+	}
+
+	const char *pMasterAddr = VMPI_FindArg( argc, argv, VMPI_GetParamString( mpi_Worker ), "" );
+	if ( pMasterAddr )
+	{
+		if ( !pMasterAddr[0] )
+		{
+			Warning( "VMPI: %s needs the address of the master.\n", VMPI_GetParamString( mpi_Worker ) );
+			return false;
+		}
+
+		g_bMPIMaster = false;
+		return ConnectToMaster( pMasterAddr );
+	}
+
+	return StartMaster( runMode );
+}
+
+
+void VMPI_Init_PatchMaster( int argc, char **argv )
+{
+	Error( "VMPI: patching the VMPI service isn't supported on this platform." );
+}
+
+
+void VMPI_Finalize()
+{
+	if ( !s_bInitialized )
+		return;
+	s_bInitialized = false;
+
+	DistributeWork_Cancel();
+
+	for ( int i=0; i < s_Connections.Count(); i++ )
+	{
+		CVMPIConnection *pConn = s_Connections[i];
+		pConn->m_SendMutex.Lock();
+		if ( pConn->m_Socket != -1 )
+			close( pConn->m_Socket );
+		pConn->m_Socket = -1;
+		pConn->m_bConnected = false;
+		pConn->m_SendMutex.Unlock();
+	}
+
+	for ( int i=0; i < s_PendingConnections.Count(); i++ )
+	{
+		close( s_PendingConnections[i]->m_Socket );
+	}
+	s_PendingConnections.PurgeAndDeleteElements();
+	s_RejectedConnections.PurgeAndDeleteElements();
+
+	if ( s_UnixListenSocket != -1 )
+	{
+		close( s_UnixListenSocket );
+		unlink( s_UnixSocketPath );
+		s_UnixListenSocket = -1;
+	}
+	if ( s_TCPListenSocket != -1 )
+	{
+		close( s_TCPListenSocket );
+		s_TCPListenSocket = -1;
+	}
+
+	// The local workers quit when they see the master go away. Give them a moment, then make sure.
+	double flGiveUpTime = Plat_FloatTime() + 5;
+	for ( int i=0; i < s_LocalWorkerPIDs.Count(); i++ )
+	{
+		while ( waitpid( s_LocalWorkerPIDs[i], NULL, WNOHANG ) == 0 )
+		{
+			if ( Plat_FloatTime() > flGiveUpTime )
+			{
+				kill( s_LocalWorkerPIDs[i], SIGKILL );
+				waitpid( s_LocalWorkerPIDs[i], NULL, 0 );
+				break;
+			}
+			ThreadSleep( 10 );
+		}
+	}
+	s_LocalWorkerPIDs.Purge();
+}
+
+
+VMPIRunMode VMPI_GetRunMode()
+{
+	return s_RunMode;
+}
+
+
+VMPIFileSystemMode VMPI_GetFileSystemMode()
+{
+	return VMPI_FILESYSTEM_TCP;
+}
+
+
+int VMPI_GetCurrentNumberOfConnections()
+{
+	return s_Connections.Count();
+}
+
+
+bool VMPI_DispatchUntil( MessageBuffer *pBuf, int *pSource, int packetID, int subPacketID, bool bWait )
+{
+	while ( 1 )
+	{
+		VMPIMessage_t *pMsg = GetNextMessage( bWait ? VMPI_TIMEOUT_INFINITE : 0 );
+		if ( !pMsg )
+			return false;
+
+		const CUtlVector<char> &data = pMsg->m_Data;
+		if ( !pMsg->m_bDisconnect && data.Count() >= 1 && (unsigned char)data[0] == packetID &&
+			( subPacketID == -1 || ( data.Count() >= 2 && (unsigned char)data[1] == subPacketID ) ) )
+		{
+			pBuf->reset( data.Count() );
+			pBuf->write( data.Base(), data.Count() );
+			pBuf->setOffset( 0 );
+			if ( pSource )
+				*pSource = pMsg->m_iSource;
+
+			delete pMsg;
+			return true;
+		}
+
+		DispatchMessage( pMsg );
+	}
+}
+
+
+bool VMPI_DispatchNextMessage( unsigned long timeout )
+{
+	VMPIMessage_t *pMsg = GetNextMessage( timeout );
+	if ( !pMsg )
+		return false;
+
+	DispatchMessage( pMsg );
+	return true;
+}
+
+
+void VMPI_HandleSocketErrors( unsigned long timeout )
+{
+	PollSockets( (int)timeout );
+}
+
+
+bool VMPI_SendChunks( void const * const *pChunks, const int *pChunkLengths, int nChunks, int iDest, int fVMPISendFlags )
+{
+	if ( iDest == VMPI_PERSISTENT )
+	{
+		Assert( g_bMPIMaster );
+
+		CUtlVector<char> *pPacket = new CUtlVector<char>;
+		for ( int i=0; i < nChunks; i++ )
+		{
+			pPacket->AddMultipleToTail( pChunkLengths[i], (const char *)pChunks[i] );
+		}
+		s_PersistentPackets.AddToTail( pPacket );
+
+		iDest = VMPI_SEND_TO_ALL;
+	}
+
+	if ( iDest == VMPI_SEND_TO_ALL )
+	{
+		bool bOk = true;
+		for ( int i=0; i < s_Connections.Count(); i++ )
+		{
+			if ( i != s_iMyProcID && s_Connections[i]->m_bConnected )
+				bOk &= SendPacket( s_Connections[i], pChunks, pChunkLengths, nChunks );
+		}
+		return bOk;
+	}
+
+	if ( iDest < 0 || iDest >= s_Connections.Count() || iDest == s_iMyProcID )
+		return false;
+
+	return SendPacket( s_Connections[iDest], pChunks, pChunkLengths, nChunks );
+}
+
+
+bool VMPI_SendData( void *pData, int nBytes, int iDest, int fVMPISendFlags )
+{
+	return VMPI_SendChunks( &pData, &nBytes, 1, iDest, fVMPISendFlags );
+}
+
+
+bool VMPI_Send2Chunks( const void *pChunk1, int chunk1Len, const void *pChunk2, int chunk2Len, int iDest, int fVMPISendFlags )
+{
+	const void *pChunks[2] = { pChunk1, pChunk2 };
+	int chunkLengths[2] = { chunk1Len, chunk2Len };
+	return VMPI_SendChunks( pChunks, chunkLengths, 2, iDest, fVMPISendFlags );
+}
+
+
+bool VMPI_Send3Chunks( const void *pChunk1, int chunk1Len, const void *pChunk2, int chunk2Len, const void *pChunk3, int chunk3Len, int iDest, int fVMPISendFlags )
+{
+	const void *pChunks[3] = { pChunk1, pChunk2, pChunk3 };
+	int chunkLengths[3] = { chunk1Len, chunk2Len, chunk3Len };
+	return VMPI_SendChunks( pChunks, chunkLengths, 3, iDest, fVMPISendFlags );
+}
+
+
+void VMPI_FlushGroupedPackets( unsigned long msInterval )
+{
+	// Packets always go out right away here.
+}
+
+
+void VMPI_AddDisconnectHandler( VMPI_Disconnect_Handler handler )
+{
+	s_DisconnectHandlers.AddToTail( handler );
+}
+
+
+void VMPI_AddConnectHandler( VMPI_Connect_Handler handler )
+{
+	s_ConnectHandlers.AddToTail( handler );
+}
+
+
+bool VMPI_IsProcConnected( int procID )
+{
+	if ( procID < 0 || procID >= s_Connections.Count() )
+		return false;
+
+	return s_Connections[procID]->m_bConnected || procID == s_iMyProcID;
+}
+
+
+bool VMPI_IsProcAService( int procID )
+{
+	return false;
+}
+
+
+bool VMPI_IsProcLocal( int procID )
+{
+	if ( procID < 0 || procID >= s_Connections.Count() )
+		return false;
+
+	return s_Connections[procID]->m_bLocal;
+}
+
+
+int VMPI_GetMyProcID()
+{
+	return s_iMyProcID;
+}
+
+
+const char* VMPI_GetSharedMemoryPrefix()
+{
+	return s_SharedMemoryPrefix;
+}
+
+
+int VMPI_GetNumWorkerThreads()
+{
+	return s_nWorkerThreads;
+}
+
+
+void VMPI_Sleep( unsigned long ms )
+{
+	ThreadSleep( ms );
+}
+
+
+const char* VMPI_GetLocalMachineName()
+{
+	return s_LocalMachineName;
+}
+
+
+const char* VMPI_GetMachineName( int iProc )
+{
+	if ( iProc < 0 || iProc >= s_Connections.Count() || !s_Connections[iProc]->m_bMachineNameSet )
+		return "<unknown>";
+
+	return s_Connections[iProc]->m_MachineName;
+}
+
+
+bool VMPI_HasMachineNameBeenSet( int iProc )
+{
+	if ( iProc < 0 || iProc >= s_Connections.Count() )
+		return false;
+
+	return s_Connections[iProc]->m_bMachineNameSet;
+}
+
+
+unsigned long VMPI_GetJobWorkerID( int iProc )
+{
+	if ( iProc < 0 || iProc >= s_Connections.Count() )
+		return 0xFFFFFFFF;
+
+	return s_Connections[iProc]->m_JobWorkerID;
+}
+
+
+void VMPI_SetJobWorkerID( int iProc, unsigned long jobWorkerID )
+{
+	if ( iProc >= 0 && iProc < s_Connections.Count() )
+		s_Connections[iProc]->m_JobWorkerID = jobWorkerID;
+}
+
+
+const char* VMPI_FindArg( int argc, char **argv, const char *pName, const char *pDefault )
+{
+	for ( int i=0; i < argc; i++ )
+	{
+		if ( V_stricmp( argv[i], pName ) == 0 )
+		{
+			if ( i + 1 < argc && argv[i+1][0] != '-' )
+				return argv[i+1];
+
+			return pDefault;
+		}
+	}
+
+	return NULL;
+}
+
+
+void VMPI_GetCurrentStage( char *pOut, int strLen )
+{
+	V_strncpy( pOut, s_CurrentStage, strLen );
+}
+
+
+void VMPI_SetCurrentStage( const char *pCurStage )
+{
+	V_strncpy( s_CurrentStage, pCurStage, sizeof( s_CurrentStage ) );
+}
+
+
+void VMPI_InviteDebugWorkers()
+{
+}
+
+
+bool VMPI_IsSDKMode()
+{
+	return false;
+}
+
+
+const char* VMPI_GetParamString( EVMPICmdLineParam eParam )
+{
+	Assert( eParam > k_eVMPICmdLineParam_FirstParam && eParam < k_eVMPICmdLineParam_LastParam );
+	return s_VMPIParams[eParam].m_pName;
+}
+
+
+int VMPI_GetParamFlags( EVMPICmdLineParam eParam )
+{
+	Assert( eParam > k_eVMPICmdLineParam_FirstParam && eParam < k_eVMPICmdLineParam_LastParam );
+	return s_VMPIParams[eParam].m_Flags;
+}
+
+
+const char* VMPI_GetParamHelpString( EVMPICmdLineParam eParam )
+{
+	Assert( eParam > k_eVMPICmdLineParam_FirstParam && eParam < k_eVMPICmdLineParam_LastParam );
+	return s_VMPIParams[eParam].m_pHelpText;
+}
+
+
+bool VMPI_IsParamUsed( EVMPICmdLineParam eParam )
+{
+	return IsArgUsed( VMPI_GetParamString( eParam ) );
+}
+
+
+bool VMPI_HandleAutoRestart()
+{
+	if ( g_bMPIMaster || !VMPI_IsParamUsed( mpi_AutoRestart ) )
+		return false;
+
+	Msg( "VMPI: restarting to wait for the next job.\n" );
+	VMPI_Finalize();
+	execv( s_ExePath, s_Argv.Base() );
+	return false;
+}
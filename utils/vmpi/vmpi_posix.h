@@ -0,0 +1,39 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Internal interface between the pieces of the portable VMPI backend
+//			(vmpi_posix.cpp, vmpi_distribute_work_posix.cpp, vmpi_filesystem_posix.cpp).
+//
+//=============================================================================//
+
+#ifndef VMPI_POSIX_H
+#define VMPI_POSIX_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+#include "vmpi.h"
+
+
+// Called on the master when a worker has finished connecting, after it has been sent
+// the persistent packets.
+typedef void (*VMPI_Connect_Handler)( int procID );
+void VMPI_AddConnectHandler( VMPI_Connect_Handler handler );
+
+// Returns true if the process runs on this machine and can map our shared memory.
+bool VMPI_IsProcLocal( int procID );
+
+// Returns this process's ID. The master is always VMPI_MASTER_ID.
+int VMPI_GetMyProcID();
+
+// Shared memory objects created by this job have names that start with this.
+const char* VMPI_GetSharedMemoryPrefix();
+
+// How many threads this process should use to process work units.
+int VMPI_GetNumWorkerThreads();
+
+// How many work units a process has finished in all the DistributeWork calls so far.
+uint64 VMPI_GetNumWorkUnitsCompleted( int iProc );
+
+
+#endif // VMPI_POSIX_H
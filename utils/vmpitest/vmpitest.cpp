@@ -0,0 +1,239 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs a small job on this machine to check the portable VMPI
+//			backend. The master starts local worker processes, hands them two
+//			stages of work units with DistributeWork and checks that every unit
+//			came back once with the right results. Exits non-zero if anything
+//			was missing or wrong.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "vmpi.h"
+#include "vmpi_distribute_work.h"
+#include "vmpi_posix.h"
+#include "messbuf.h"
+
+
+#define VMPITEST_DISTRIBUTEWORK_PACKETID	2
+
+#define DEFAULT_WORK_UNITS		2000
+#define DEFAULT_LOCAL_WORKERS	"2"
+#define MAX_EXTRA_BYTES			64		// Results vary in size so packets don't all look alike.
+#define STAGE_TIMEOUT			60.0	// Seconds to wait for a stage before giving up.
+
+CDispatchReg g_DistributeWorkReg( VMPITEST_DISTRIBUTEWORK_PACKETID, DistributeWorkDispatch );
+
+static int g_iStage;
+static uint64 g_nWorkUnits = DEFAULT_WORK_UNITS;
+static CUtlVector<long> g_TimesReceived;	// Master threads and the dispatch thread both count here.
+static int g_nBadResults;
+
+
+SpewRetval_t VMPITestOutputFunc( SpewType_t spewType, char const *pMsg )
+{
+	printf( "%s", pMsg );
+	fflush( stdout );
+
+	if ( spewType == SPEW_ERROR )
+		return SPEW_ABORT;
+	return ( spewType == SPEW_ASSERT ) ? SPEW_DEBUGGER : SPEW_CONTINUE;
+}
+
+static void Usage( void )
+{
+	Error( "Usage: vmpitest [-units n] [-mpi_LocalWorkers n] [VMPI options]\n"
+		"  Runs a job on local worker processes and checks the results.\n"
+		"  The master leaves all the work to the workers unless it's given\n"
+		"  -mpi_LocalWorkers 0.\n" );
+	exit( -1 );
+}
+
+static const char *FindArg( int argc, char **argv, const char *pName )
+{
+	for ( int i=1; i < argc; i++ )
+	{
+		if ( !V_stricmp( argv[i], pName ) )
+			return ( i+1 < argc ) ? argv[i+1] : "";
+	}
+	return NULL;
+}
+
+// The expected result for a work unit. Workers and the master compute it the same way.
+static uint64 WorkUnitResult( int iStage, uint64 iWorkUnit )
+{
+	uint64 h = 14695981039346656037ull ^ ( (uint64)iStage << 32 );
+	for ( int i=0; i < 1000; i++ )
+	{
+		h ^= iWorkUnit + i;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static void ProcessWorkUnit( int iThread, uint64 iWorkUnit, MessageBuffer *pBuf )
+{
+	uint64 result = WorkUnitResult( g_iStage, iWorkUnit );
+	if ( !pBuf )
+	{
+		// A thread on the master; there's nothing to send.
+		if ( iWorkUnit < g_nWorkUnits )
+			ThreadInterlockedIncrement( &g_TimesReceived[(int)iWorkUnit] );
+		return;
+	}
+
+	unsigned char extra[MAX_EXTRA_BYTES];
+	int nExtra = (int)( iWorkUnit % MAX_EXTRA_BYTES );
+	for ( int i=0; i < nExtra; i++ )
+		extra[i] = (unsigned char)( result >> ( i % 8 ) * 8 );
+
+	pBuf->write( &result, sizeof( result ) );
+	pBuf->write( &nExtra, sizeof( nExtra ) );
+	pBuf->write( extra, nExtra );
+}
+
+static void ReceiveWorkUnit( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker )
+{
+	uint64 expected = WorkUnitResult( g_iStage, iWorkUnit );
+
+	uint64 result;
+	int nExtra;
+	unsigned char extra[MAX_EXTRA_BYTES];
+	bool bGood = iWorkUnit < g_nWorkUnits &&
+		pBuf->read( &result, sizeof( result ) ) >= 0 &&
+		pBuf->read( &nExtra, sizeof( nExtra ) ) >= 0 &&
+		nExtra == (int)( iWorkUnit % MAX_EXTRA_BYTES ) &&
+		pBuf->read( extra, nExtra ) >= 0 &&
+		result == expected;
+
+	for ( int i=0; bGood && i < nExtra; i++ )
+		bGood = ( extra[i] == (unsigned char)( expected >> ( i % 8 ) * 8 ) );
+
+	if ( !bGood )
+	{
+		Warning( "  work unit %llu from %s came back wrong.\n", (unsigned long long)iWorkUnit, VMPI_GetMachineName( iWorker ) );
+		++g_nBadResults;
+		return;
+	}
+
+	ThreadInterlockedIncrement( &g_TimesReceived[(int)iWorkUnit] );
+}
+
+
+class CStageTimeout : public IWorkUnitDistributorCallbacks
+{
+public:
+	CStageTimeout() : m_flGiveUpTime( Plat_FloatTime() + STAGE_TIMEOUT ) {}
+	virtual bool Update() { return Plat_FloatTime() > m_flGiveUpTime; }
+
+	double m_flGiveUpTime;
+};
+
+// Returns the number of problems found.
+static int RunStage( int iStage )
+{
+	g_iStage = iStage;
+	g_TimesReceived.SetCount( (int)g_nWorkUnits );
+	for ( int i=0; i < g_TimesReceived.Count(); i++ )
+		g_TimesReceived[i] = 0;
+	g_nBadResults = 0;
+
+	CStageTimeout timeout;
+	g_pDistributeWorkCallbacks = &timeout;
+	double flTime = DistributeWork( g_nWorkUnits, VMPITEST_DISTRIBUTEWORK_PACKETID, ProcessWorkUnit, ReceiveWorkUnit );
+	g_pDistributeWorkCallbacks = NULL;
+
+	if ( !g_bMPIMaster )
+		return 0;
+
+	int nMissing = 0, nDuplicates = 0;
+	for ( int i=0; i < g_TimesReceived.Count(); i++ )
+	{
+		if ( g_TimesReceived[i] == 0 )
+			++nMissing;
+		else if ( g_TimesReceived[i] > 1 )
+			++nDuplicates;
+	}
+
+	Msg( "Stage %d: %llu work units in %.2f seconds, %d missing, %d duplicated, %d wrong.\n",
+		iStage, (unsigned long long)g_nWorkUnits, flTime, nMissing, nDuplicates, g_nBadResults );
+	return nMissing + nDuplicates + g_nBadResults;
+}
+
+
+int main( int argc, char **argv )
+{
+	SpewOutputFunc( VMPITestOutputFunc );
+
+	if ( FindArg( argc, argv, "-help" ) || FindArg( argc, argv, "-?" ) )
+	{
+		Usage();
+	}
+
+	if ( const char *pUnits = FindArg( argc, argv, "-units" ) )
+	{
+		g_nWorkUnits = (uint64)MAX( atoi( pUnits ), 1 );
+	}
+
+	// Start local workers unless told how many to use, and leave the work to them.
+	CUtlVector<char*> args;
+	args.AddMultipleToTail( argc, argv );
+	bool bWorker = FindArg( argc, argv, VMPI_GetParamString( mpi_Worker ) ) != NULL;
+	if ( !bWorker && !FindArg( argc, argv, VMPI_GetParamString( mpi_LocalWorkers ) ) )
+	{
+		args.AddToTail( (char *)VMPI_GetParamString( mpi_LocalWorkers ) );
+		args.AddToTail( (char *)DEFAULT_LOCAL_WORKERS );
+	}
+	const char *pLocalWorkers = FindArg( args.Count(), args.Base(), VMPI_GetParamString( mpi_LocalWorkers ) );
+	int nLocalWorkers = pLocalWorkers ? atoi( pLocalWorkers ) : 0;
+	if ( !bWorker && nLocalWorkers > 0 && !FindArg( argc, argv, VMPI_GetParamString( mpi_NoMasterWorkerThreads ) ) )
+	{
+		args.AddToTail( (char *)VMPI_GetParamString( mpi_NoMasterWorkerThreads ) );
+	}
+	args.AddToTail( NULL );
+
+	int vmpiArgc = args.Count() - 1;
+	char **vmpiArgv = args.Base();
+	if ( !VMPI_Init( vmpiArgc, vmpiArgv, NULL, NULL, VMPI_RUN_NETWORKED ) )
+	{
+		Warning( "vmpitest: VMPI_Init failed.\n" );
+		return 1;
+	}
+
+	int nProblems = RunStage( 1 );
+	nProblems += RunStage( 2 );
+
+	if ( g_bMPIMaster && nLocalWorkers > 0 )
+	{
+		// Everything went through the workers, so each unit must have come back over a connection.
+		uint64 nFromWorkers = 0;
+		for ( int i=1; i < VMPI_GetCurrentNumberOfConnections(); i++ )
+		{
+			uint64 nCompleted = VMPI_GetNumWorkUnitsCompleted( i );
+			Msg( "  %-32s %llu work units\n", VMPI_GetMachineName( i ), (unsigned long long)nCompleted );
+			nFromWorkers += nCompleted;
+		}
+
+		if ( nFromWorkers < g_nWorkUnits * 2 )
+		{
+			Warning( "The workers only completed %llu of %llu work units.\n",
+				(unsigned long long)nFromWorkers, (unsigned long long)( g_nWorkUnits * 2 ) );
+			++nProblems;
+		}
+	}
+
+	VMPI_Finalize();
+
+	if ( g_bMPIMaster )
+	{
+		Msg( nProblems ? "vmpitest FAILED.\n" : "vmpitest passed.\n" );
+	}
+	return nProblems ? 1 : 0;
+}
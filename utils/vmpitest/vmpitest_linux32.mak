@@ -0,0 +1,123 @@
+NAME=vmpitest
+SRCROOT=../..
+TARGET_PLATFORM=linux32
+TARGET_PLATFORM_EXT=
+USE_VALVE_BINDIR=0
+PWD:=$(shell pwd)
+# If no configuration is specified, "release" will be used.
+ifeq "$(CFG)" ""
+	CFG = release
+endif
+
+GCC_ExtraCompilerFlags=
+GCC_ExtraLinkerFlags=
+SymbolVisibility=hidden
+OptimizerLevel=-gdwarf-2 -g2 $(OptimizerLevel_CompilerSpecific)
+SystemLibraries=
+DLL_EXT=.so
+SYM_EXT=.dbg
+FORCEINCLUDES= 
+ifeq "$(CFG)" "debug"
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DDEBUG -D_DEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=vmpitest -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DMPI -DPROTECTED_THINGS_DISABLE -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/vmpitest -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+else
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DNDEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=vmpitest -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DMPI -DPROTECTED_THINGS_DISABLE -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/vmpitest -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+endif
+INCLUDEDIRS += ../../common ../../public ../../public/tier0 ../../public/tier1 ../../thirdparty/SDL2 ../vmpi 
+CONFTYPE=exe
+OUTPUTFILE=../../../game/bin/vmpitest
+
+
+POSTBUILDCOMMAND=true
+
+
+
+CPPFILES= \
+    ../../public/tier0/memoverride.cpp \
+    ../vmpi/messbuf.cpp \
+    ../vmpi/vmpi_distribute_work_posix.cpp \
+    ../vmpi/vmpi_filesystem_posix.cpp \
+    ../vmpi/vmpi_posix.cpp \
+    vmpitest.cpp \
+
+
+LIBFILES = \
+    ../../lib/public/linux32/tier1.a \
+    ../../lib/public/linux32/mathlib.a \
+    -L../../lib/public/linux32 -ltier0 \
+    -L../../lib/public/linux32 -lvstdlib \
+
+
+LIBFILENAMES = \
+    ../../lib/public/linux32/libtier0.so \
+    ../../lib/public/linux32/libvstdlib.so \
+    ../../lib/public/linux32/mathlib.a \
+    ../../lib/public/linux32/tier1.a \
+
+
+# Include the base makefile now.
+include $(SRCROOT)/devtools/makefile_base_posix.mak
+
+
+
+OTHER_DEPENDENCIES = \
+
+
+$(OBJ_DIR)/_other_deps.P : $(OTHER_DEPENDENCIES)
+	$(GEN_OTHER_DEPS)
+
+-include $(OBJ_DIR)/_other_deps.P
+
+
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/memoverride.P
+endif
+
+$(OBJ_DIR)/memoverride.o : $(PWD)/../../public/tier0/memoverride.cpp $(PWD)/vmpitest_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/messbuf.P
+endif
+
+$(OBJ_DIR)/messbuf.o : $(PWD)/../vmpi/messbuf.cpp $(PWD)/vmpitest_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_distribute_work_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_distribute_work_posix.o : $(PWD)/../vmpi/vmpi_distribute_work_posix.cpp $(PWD)/vmpitest_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_filesystem_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_filesystem_posix.o : $(PWD)/../vmpi/vmpi_filesystem_posix.cpp $(PWD)/vmpitest_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_posix.o : $(PWD)/../vmpi/vmpi_posix.cpp $(PWD)/vmpitest_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpitest.P
+endif
+
+$(OBJ_DIR)/vmpitest.o : $(PWD)/vmpitest.cpp $(PWD)/vmpitest_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+
+# Runs a job on two local workers; fails if any work unit went missing or came back wrong
+check : all
+	$(OUTPUTFILE) -mpi_LocalWorkers 2
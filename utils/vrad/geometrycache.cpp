@@ -0,0 +1,539 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: On-disk cache of the ray-trace acceleration structure and the patch
+//			transfer lists.
+//
+//			The file is keyed by a CRC of everything that went into building them:
+//			the triangles handed to the ray tracer (brushes, displacements, static
+//			prop models and shadow casters) for the acceleration structure, and the
+//			patch layout plus the vis data for the transfers. It is read through a
+//			read-only file mapping.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "vrad.h"
+#include "geometrycache.h"
+
+
+extern int total_transfer;
+extern int max_transfer;
+
+// Triangles are staged through a buffer this size when writing, since they live in a
+// CUtlBlockVector rather than one contiguous array.
+#define TRIANGLE_WRITE_BATCH	4096
+
+
+// -------------------------------------------------------------------------------- //
+// Static helpers.
+// -------------------------------------------------------------------------------- //
+
+static bool g_bCacheFileError = false;
+static int64 g_nCacheFilePos = 0;
+
+static void CacheFileWrite( FileHandle_t fp, void const *pData, int64 size )
+{
+	// IFileSystem::Write takes an int
+	unsigned char const *pBytes = (unsigned char const *)pData;
+	while ( size > 0 && !g_bCacheFileError )
+	{
+		int nChunk = (int)min( size, (int64)( 1 << 30 ) );
+		if ( g_pFileSystem->Write( pBytes, nChunk, fp ) != nChunk )
+		{
+			g_bCacheFileError = true;
+		}
+		pBytes += nChunk;
+		size -= nChunk;
+		g_nCacheFilePos += nChunk;
+	}
+}
+
+// Pads the file out to where the next section starts.
+static void CacheFileAlign( FileHandle_t fp )
+{
+	static unsigned char const s_Zeros[GEOMETRYCACHE_ALIGN] = { 0 };
+	int nPad = (int)( -g_nCacheFilePos & ( GEOMETRYCACHE_ALIGN - 1 ) );
+	CacheFileWrite( fp, s_Zeros, nPad );
+}
+
+static inline int64 AlignCacheOffset( int64 nOffset )
+{
+	return ( nOffset + GEOMETRYCACHE_ALIGN - 1 ) & ~(int64)( GEOMETRYCACHE_ALIGN - 1 );
+}
+
+// Makes vec use nCount elements at pData without copying them. The memory isn't owned,
+// so vec won't free it.
+template < class T >
+static void PointVectorAt( CUtlVector<T> &vec, unsigned char const *pData, int nCount )
+{
+	CUtlVector<T> external( nCount ? (T*)pData : NULL, nCount, nCount );
+	vec.Swap( external );
+}
+
+// Gives vec its own copy of the elements it was pointed at.
+template < class T >
+static void CopyVectorToHeap( CUtlVector<T> &vec )
+{
+	CUtlVector<T> owned;
+	owned.CopyArray( vec.Base(), vec.Count() );
+	vec.Swap( owned );
+}
+
+
+CGeometryCache* GeometryCache()
+{
+	static CGeometryCache cache;
+	return &cache;
+}
+
+
+// -------------------------------------------------------------------------------- //
+// CGeometryCache.
+// -------------------------------------------------------------------------------- //
+
+CGeometryCache::CGeometryCache()
+{
+	m_Filename[0] = 0;
+	m_pEnv = NULL;
+	m_GeometryCRC = 0;
+	m_nGeometryTriangles = 0;
+	m_pMappedData = NULL;
+	m_nMappedSize = 0;
+	m_bEnvironmentMapped = false;
+	m_bTransfersMapped = false;
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#endif
+}
+
+
+CGeometryCache::~CGeometryCache()
+{
+	Shutdown();
+}
+
+
+void CGeometryCache::Init( char const *pCacheFilename, RayTracingEnvironment *pEnv )
+{
+	Shutdown();
+
+	Q_strncpy( m_Filename, pCacheFilename, sizeof( m_Filename ) );
+	m_pEnv = pEnv;
+
+	// Hash the triangles while they are still in geometry format.
+	CRC32_Init( &m_GeometryCRC );
+	m_nGeometryTriangles = pEnv->OptimizedTriangleList.Count();
+	for ( int i = 0; i < m_nGeometryTriangles; i++ )
+	{
+		TriGeometryData_t const &tri = pEnv->OptimizedTriangleList[i].m_Data.m_GeometryData;
+		CRC32_ProcessBuffer( &m_GeometryCRC, &tri.m_nTriangleID, sizeof( tri.m_nTriangleID ) );
+		CRC32_ProcessBuffer( &m_GeometryCRC, tri.m_VertexCoordData, sizeof( tri.m_VertexCoordData ) );
+		CRC32_ProcessBuffer( &m_GeometryCRC, &tri.m_nFlags, sizeof( tri.m_nFlags ) );
+	}
+	if ( pEnv->TriangleColors.Count() )
+		CRC32_ProcessBuffer( &m_GeometryCRC, pEnv->TriangleColors.Base(), pEnv->TriangleColors.Count() * sizeof( Vector ) );
+	if ( pEnv->TriangleMaterials.Count() )
+		CRC32_ProcessBuffer( &m_GeometryCRC, pEnv->TriangleMaterials.Base(), pEnv->TriangleMaterials.Count() * sizeof( int32 ) );
+	CRC32_Final( &m_GeometryCRC );
+
+	MapFile();
+}
+
+
+void CGeometryCache::Shutdown()
+{
+	ReleaseMappedArrays( false );
+	UnmapFile();
+	m_pEnv = NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Stops anything from pointing into the mapping before it goes away. The ray
+// tracer's arrays are copied if it is still going to be used, otherwise emptied.
+//-----------------------------------------------------------------------------
+void CGeometryCache::ReleaseMappedArrays( bool bCopyEnvironment )
+{
+	if ( m_bEnvironmentMapped )
+	{
+		if ( bCopyEnvironment )
+		{
+			CopyVectorToHeap( m_pEnv->OptimizedKDTree );
+			CopyVectorToHeap( m_pEnv->OptimizedBVHTree );
+			CopyVectorToHeap( m_pEnv->TriangleIndexList );
+		}
+		else
+		{
+			m_pEnv->OptimizedKDTree.Purge();
+			m_pEnv->OptimizedBVHTree.Purge();
+			m_pEnv->TriangleIndexList.Purge();
+		}
+		m_bEnvironmentMapped = false;
+	}
+
+	if ( m_bTransfersMapped )
+	{
+		for ( int i = 0; i < g_Patches.Count(); i++ )
+		{
+			g_Patches[i].transfers = NULL;
+		}
+		m_bTransfersMapped = false;
+	}
+}
+
+
+bool CGeometryCache::MapFile()
+{
+	UnmapFile();
+
+#ifdef _WIN32
+	HANDLE hFile = ::CreateFile( m_Filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	m_hFile = hFile;
+	LARGE_INTEGER fileSize;
+	if ( !::GetFileSizeEx( hFile, &fileSize ) )
+	{
+		UnmapFile();
+		return false;
+	}
+	m_nMappedSize = fileSize.QuadPart;
+	if ( m_nMappedSize < (int64)sizeof( CacheHeader_t ) )
+	{
+		UnmapFile();
+		return false;
+	}
+
+	m_hMapping = ::CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( !m_hMapping )
+	{
+		UnmapFile();
+		return false;
+	}
+
+	m_pMappedData = (unsigned char*)::MapViewOfFile( (HANDLE)m_hMapping, FILE_MAP_READ, 0, 0, 0 );
+#else
+	int fd = open( m_Filename, O_RDONLY );
+	if ( fd == -1 )
+		return false;
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || (int64)st.st_size < (int64)sizeof( CacheHeader_t ) ||
+		 (int64)(size_t)st.st_size != (int64)st.st_size )
+	{
+		close( fd );
+		return false;
+	}
+
+	m_nMappedSize = (int64)st.st_size;
+	void *pData = mmap( NULL, (size_t)m_nMappedSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	m_pMappedData = ( pData != MAP_FAILED ) ? (unsigned char*)pData : NULL;
+#endif
+
+	if ( !m_pMappedData )
+	{
+		UnmapFile();
+		return false;
+	}
+	return true;
+}
+
+
+void CGeometryCache::UnmapFile()
+{
+#ifdef _WIN32
+	if ( m_pMappedData )
+		::UnmapViewOfFile( m_pMappedData );
+	if ( m_hMapping )
+		::CloseHandle( (HANDLE)m_hMapping );
+	if ( m_hFile != INVALID_HANDLE_VALUE )
+		::CloseHandle( (HANDLE)m_hFile );
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if ( m_pMappedData )
+		munmap( m_pMappedData, (size_t)m_nMappedSize );
+#endif
+	m_pMappedData = NULL;
+	m_nMappedSize = 0;
+}
+
+
+bool CGeometryCache::ValidateHeader() const
+{
+	if ( !m_pMappedData )
+		return false;
+
+	CacheHeader_t const *pHeader = (CacheHeader_t const*)m_pMappedData;
+	if ( pHeader->m_nVersion != GEOMETRYCACHE_VERSION ||
+		 pHeader->m_nTriangleSize != sizeof( CacheOptimizedTriangle ) ||
+		 pHeader->m_nKDNodeSize != sizeof( CacheOptimizedKDNode ) ||
+		 pHeader->m_nBVHNodeSize != sizeof( CacheOptimizedBVHNode ) ||
+		 pHeader->m_nFlags != m_pEnv->Flags ||
+		 pHeader->m_GeometryCRC != m_GeometryCRC ||
+		 pHeader->m_nTriangles != m_nGeometryTriangles )
+	{
+		return false;
+	}
+
+	if ( pHeader->m_nKDNodes < 0 || pHeader->m_nBVHNodes < 0 || pHeader->m_nTriangleIndices < 0 ||
+		 pHeader->m_nPatches < 0 || pHeader->m_nTransferWords < 0 )
+	{
+		return false;
+	}
+
+	// Make sure the file isn't truncated.
+	CacheLayout_t layout;
+	ComputeLayout( *pHeader, layout );
+	return layout.m_nEnd == m_nMappedSize;
+}
+
+
+void CGeometryCache::ComputeLayout( CacheHeader_t const &header, CacheLayout_t &layout )
+{
+	layout.m_nTriangles = AlignCacheOffset( sizeof( CacheHeader_t ) );
+	layout.m_nKDNodes = AlignCacheOffset( layout.m_nTriangles + (int64)header.m_nTriangles * sizeof( CacheOptimizedTriangle ) );
+	layout.m_nBVHNodes = AlignCacheOffset( layout.m_nKDNodes + (int64)header.m_nKDNodes * sizeof( CacheOptimizedKDNode ) );
+	layout.m_nTriangleIndices = AlignCacheOffset( layout.m_nBVHNodes + (int64)header.m_nBVHNodes * sizeof( CacheOptimizedBVHNode ) );
+	layout.m_nPatchTransfers = AlignCacheOffset( layout.m_nTriangleIndices + (int64)header.m_nTriangleIndices * sizeof( int32 ) );
+	layout.m_nTransferWords = AlignCacheOffset( layout.m_nPatchTransfers + (int64)header.m_nPatches * sizeof( CachePatchTransfers_t ) );
+	layout.m_nEnd = layout.m_nTransferWords + (int64)header.m_nTransferWords * sizeof( unsigned short );
+}
+
+
+bool CGeometryCache::RestoreRayTraceEnvironment()
+{
+	if ( !IsActive() || !ValidateHeader() )
+		return false;
+
+	CacheHeader_t const *pHeader = (CacheHeader_t const*)m_pMappedData;
+	CacheLayout_t layout;
+	ComputeLayout( *pHeader, layout );
+
+	// Triangles, already in intersection format. They live in a CUtlBlockVector, so
+	// they're the one part that has to be copied.
+	CacheOptimizedTriangle const *pTris = (CacheOptimizedTriangle const*)( m_pMappedData + layout.m_nTriangles );
+	for ( int i = 0; i < pHeader->m_nTriangles; i++ )
+	{
+		memcpy( &m_pEnv->OptimizedTriangleList[i], &pTris[i], sizeof( CacheOptimizedTriangle ) );
+	}
+
+	// The trees and the index list are only read from here on, so use them in place.
+	PointVectorAt( m_pEnv->OptimizedKDTree, m_pMappedData + layout.m_nKDNodes, pHeader->m_nKDNodes );
+	PointVectorAt( m_pEnv->OptimizedBVHTree, m_pMappedData + layout.m_nBVHNodes, pHeader->m_nBVHNodes );
+	PointVectorAt( m_pEnv->TriangleIndexList, m_pMappedData + layout.m_nTriangleIndices, pHeader->m_nTriangleIndices );
+	m_bEnvironmentMapped = true;
+
+	m_pEnv->m_MinBound.Init( pHeader->m_MinBound[0], pHeader->m_MinBound[1], pHeader->m_MinBound[2] );
+	m_pEnv->m_MaxBound.Init( pHeader->m_MaxBound[0], pHeader->m_MaxBound[1], pHeader->m_MaxBound[2] );
+	return true;
+}
+
+
+void CGeometryCache::SaveRayTraceEnvironment()
+{
+	if ( IsActive() )
+		WriteFile( false );
+}
+
+
+CRC32_t CGeometryCache::ComputeTransferCRC() const
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+
+	// Transfers are traced against the ray-trace geometry.
+	CRC32_ProcessBuffer( &crc, &m_GeometryCRC, sizeof( m_GeometryCRC ) );
+
+	// The patch layout covers the chop settings, texlights and displacements.
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		CPatch const *pPatch = &g_Patches[i];
+		if ( pPatch->winding )
+		{
+			CRC32_ProcessBuffer( &crc, &pPatch->winding->numpoints, sizeof( pPatch->winding->numpoints ) );
+			CRC32_ProcessBuffer( &crc, pPatch->winding->p, pPatch->winding->numpoints * sizeof( Vector ) );
+		}
+		CRC32_ProcessBuffer( &crc, &pPatch->origin, sizeof( pPatch->origin ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->normal, sizeof( pPatch->normal ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->planeDist, sizeof( pPatch->planeDist ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->area, sizeof( pPatch->area ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->faceNumber, sizeof( pPatch->faceNumber ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->clusterNumber, sizeof( pPatch->clusterNumber ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->parent, sizeof( pPatch->parent ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->child1, sizeof( pPatch->child1 ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->child2, sizeof( pPatch->child2 ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->ndxNext, sizeof( pPatch->ndxNext ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->ndxNextParent, sizeof( pPatch->ndxNextParent ) );
+		CRC32_ProcessBuffer( &crc, &pPatch->ndxNextClusterChild, sizeof( pPatch->ndxNextClusterChild ) );
+	}
+	CRC32_ProcessBuffer( &crc, faceParents.Base(), numfaces * sizeof( int ) );
+	CRC32_ProcessBuffer( &crc, clusterChildren.Base(), dvis->numclusters * sizeof( int ) );
+
+	// Which patches can see each other, and which faces are sky.
+	CRC32_ProcessBuffer( &crc, dvisdata, visdatasize );
+	CRC32_ProcessBuffer( &crc, dleafs, numleafs * sizeof( dleaf_t ) );
+	CRC32_ProcessBuffer( &crc, dleaffaces, numleaffaces * sizeof( unsigned short ) );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		int nFlags = texinfo[ g_pFaces[i].texinfo ].flags;
+		CRC32_ProcessBuffer( &crc, &nFlags, sizeof( nFlags ) );
+	}
+
+	CRC32_Final( &crc );
+	return crc;
+}
+
+
+bool CGeometryCache::RestoreTransfers()
+{
+	if ( !IsActive() || !ValidateHeader() )
+		return false;
+
+	CacheHeader_t const *pHeader = (CacheHeader_t const*)m_pMappedData;
+	if ( pHeader->m_nPatches == 0 || pHeader->m_nPatches != g_Patches.Count() ||
+		 pHeader->m_TransferCRC != ComputeTransferCRC() )
+	{
+		return false;
+	}
+
+	CacheLayout_t layout;
+	ComputeLayout( *pHeader, layout );
+
+	CachePatchTransfers_t const *pPatchTransfers = (CachePatchTransfers_t const*)( m_pMappedData + layout.m_nPatchTransfers );
+	unsigned short const *pWords = (unsigned short const*)( m_pMappedData + layout.m_nTransferWords );
+
+	total_transfer = 0;
+	max_transfer = 0;
+	for ( int i = 0; i < pHeader->m_nPatches; i++ )
+	{
+		CPatch *pPatch = &g_Patches[i];
+		pPatch->numtransfers = pPatchTransfers[i].m_nTransfers;
+		pPatch->numtransferwords = pPatchTransfers[i].m_nTransferWords;
+		pPatch->transferscale = pPatchTransfers[i].m_flTransferScale;
+		if ( !pPatch->numtransfers )
+			continue;
+
+		// Gathering only reads the transfers, so they're used in place too
+		pPatch->transfers = const_cast<unsigned short*>( pWords );
+		pWords += pPatch->numtransferwords;
+
+		total_transfer += pPatch->numtransfers;
+		max_transfer = max( max_transfer, pPatch->numtransfers );
+	}
+	m_bTransfersMapped = true;
+
+	return true;
+}
+
+
+void CGeometryCache::SaveTransfers()
+{
+	if ( IsActive() )
+		WriteFile( true );
+}
+
+
+void CGeometryCache::WriteFile( bool bTransfers )
+{
+	// The file can't be replaced while it's mapped, and the ray tracer is still needed.
+	ReleaseMappedArrays( true );
+	UnmapFile();
+
+	CacheHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+	header.m_nVersion = GEOMETRYCACHE_VERSION;
+	header.m_nTriangleSize = sizeof( CacheOptimizedTriangle );
+	header.m_nKDNodeSize = sizeof( CacheOptimizedKDNode );
+	header.m_nBVHNodeSize = sizeof( CacheOptimizedBVHNode );
+	header.m_nFlags = m_pEnv->Flags;
+	header.m_GeometryCRC = m_GeometryCRC;
+	header.m_nTriangles = m_pEnv->OptimizedTriangleList.Count();
+	header.m_nKDNodes = m_pEnv->OptimizedKDTree.Count();
+	header.m_nBVHNodes = m_pEnv->OptimizedBVHTree.Count();
+	header.m_nTriangleIndices = m_pEnv->TriangleIndexList.Count();
+	for ( int i = 0; i < 3; i++ )
+	{
+		header.m_MinBound[i] = m_pEnv->m_MinBound[i];
+		header.m_MaxBound[i] = m_pEnv->m_MaxBound[i];
+	}
+
+	if ( bTransfers )
+	{
+		header.m_TransferCRC = ComputeTransferCRC();
+		header.m_nPatches = g_Patches.Count();
+		for ( int i = 0; i < g_Patches.Count(); i++ )
+		{
+			header.m_nTransferWords += g_Patches[i].numtransferwords;
+		}
+	}
+
+	FileHandle_t fp = g_pFileSystem->Open( m_Filename, "wb" );
+	if ( !fp )
+	{
+		Warning( "Unable to write geometry cache %s\n", m_Filename );
+		return;
+	}
+
+	g_bCacheFileError = false;
+	g_nCacheFilePos = 0;
+	CacheFileWrite( fp, &header, sizeof( header ) );
+	CacheFileAlign( fp );
+
+	CUtlVector<CacheOptimizedTriangle> batch;
+	batch.SetCount( min( header.m_nTriangles, TRIANGLE_WRITE_BATCH ) );
+	for ( int iFirst = 0; iFirst < header.m_nTriangles; iFirst += TRIANGLE_WRITE_BATCH )
+	{
+		int nBatch = min( header.m_nTriangles - iFirst, TRIANGLE_WRITE_BATCH );
+		for ( int i = 0; i < nBatch; i++ )
+		{
+			batch[i] = m_pEnv->OptimizedTriangleList[iFirst + i];
+		}
+		CacheFileWrite( fp, batch.Base(), nBatch * sizeof( CacheOptimizedTriangle ) );
+	}
+	CacheFileAlign( fp );
+
+	CacheFileWrite( fp, m_pEnv->OptimizedKDTree.Base(), (int64)header.m_nKDNodes * sizeof( CacheOptimizedKDNode ) );
+	CacheFileAlign( fp );
+	CacheFileWrite( fp, m_pEnv->OptimizedBVHTree.Base(), (int64)header.m_nBVHNodes * sizeof( CacheOptimizedBVHNode ) );
+	CacheFileAlign( fp );
+	CacheFileWrite( fp, m_pEnv->TriangleIndexList.Base(), (int64)header.m_nTriangleIndices * sizeof( int32 ) );
+	CacheFileAlign( fp );
+
+	if ( bTransfers )
+	{
+		for ( int i = 0; i < g_Patches.Count(); i++ )
+		{
+			CachePatchTransfers_t patchTransfers;
+			patchTransfers.m_nTransfers = g_Patches[i].numtransfers;
+			patchTransfers.m_nTransferWords = g_Patches[i].numtransferwords;
+			patchTransfers.m_flTransferScale = g_Patches[i].transferscale;
+			CacheFileWrite( fp, &patchTransfers, sizeof( patchTransfers ) );
+		}
+		CacheFileAlign( fp );
+		for ( int i = 0; i < g_Patches.Count(); i++ )
+		{
+			CPatch const *pPatch = &g_Patches[i];
+			CacheFileWrite( fp, pPatch->transfers, pPatch->numtransferwords * sizeof( unsigned short ) );
+		}
+	}
+
+	g_pFileSystem->Close( fp );
+
+	if ( g_bCacheFileError )
+	{
+		Warning( "Error writing geometry cache %s\n", m_Filename );
+		remove( m_Filename );
+	}
+}
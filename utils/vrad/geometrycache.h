@@ -0,0 +1,129 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: On-disk cache of the ray-trace acceleration structure and the patch
+//			transfer lists, so relighting an unchanged map can skip rebuilding them.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+#include "checksum_crc.h"
+
+
+#define GEOMETRYCACHE_VERSION	3
+
+// Each section of the file starts on a boundary this size, so the arrays that are
+// used straight out of the mapping keep their cache line alignment.
+#define GEOMETRYCACHE_ALIGN		64
+
+
+class RayTracingEnvironment;
+
+
+class CGeometryCache
+{
+public:
+						CGeometryCache();
+						~CGeometryCache();
+
+	// Hashes the triangles that have been added to the ray tracer and maps the cache file
+	// if it exists. Call this after all geometry has been added to the environment but
+	// before SetupAccelerationStructure.
+	void				Init( char const *pCacheFilename, RayTracingEnvironment *pEnv );
+
+	// Restores the acceleration structure from the cache. The tree and triangle index
+	// arrays point into the mapped file, so it stays mapped until Shutdown. Returns false
+	// if the cache is missing or stale, in which case the caller builds it and calls
+	// SaveRayTraceEnvironment.
+	bool				RestoreRayTraceEnvironment();
+	void				SaveRayTraceEnvironment();
+
+	// Same as above for the transfer lists, which also point into the mapped file. Call
+	// these once the patches have been made.
+	bool				RestoreTransfers();
+	void				SaveTransfers();
+
+	// Releases the mapped file. Anything restored from it is emptied, so only call this
+	// once lighting is done.
+	void				Shutdown();
+
+	bool				IsActive() const	{ return m_pEnv != NULL; }
+
+private:
+	struct CacheHeader_t
+	{
+		int		m_nVersion;
+		int		m_nTriangleSize;		// sizeof( CacheOptimizedTriangle ), etc. so a cache from
+		int		m_nKDNodeSize;			// a build with different structure layouts is rejected.
+		int		m_nBVHNodeSize;
+		uint32	m_nFlags;				// RTE_FLAGS_xxx used to build the tree
+		CRC32_t	m_GeometryCRC;
+		int		m_nTriangles;
+		int		m_nKDNodes;
+		int		m_nBVHNodes;
+		int		m_nTriangleIndices;
+		float	m_MinBound[3];
+		float	m_MaxBound[3];
+
+		// Transfer lists, written after the ray-trace data. m_nPatches is 0 if the transfers
+		// haven't been saved yet.
+		CRC32_t	m_TransferCRC;
+		int		m_nPatches;
+		int		m_nTransferWords;
+	};
+
+	// Followed by the compressed transfers for all the patches, in patch order.
+	struct CachePatchTransfers_t
+	{
+		int		m_nTransfers;
+		int		m_nTransferWords;
+		float	m_flTransferScale;
+	};
+
+	// Where each section starts, from the counts in the header.
+	struct CacheLayout_t
+	{
+		int64	m_nTriangles;
+		int64	m_nKDNodes;
+		int64	m_nBVHNodes;
+		int64	m_nTriangleIndices;
+		int64	m_nPatchTransfers;
+		int64	m_nTransferWords;
+		int64	m_nEnd;
+	};
+
+	static void			ComputeLayout( CacheHeader_t const &header, CacheLayout_t &layout );
+	CRC32_t				ComputeTransferCRC() const;
+	void				ReleaseMappedArrays( bool bCopyEnvironment );
+	bool				MapFile();
+	void				UnmapFile();
+	bool				ValidateHeader() const;
+	void				WriteFile( bool bTransfers );
+
+	char				m_Filename[MAX_PATH];
+	RayTracingEnvironment *m_pEnv;
+	CRC32_t				m_GeometryCRC;
+	int					m_nGeometryTriangles;
+
+	// The mapped cache file.
+	unsigned char		*m_pMappedData;
+	int64				m_nMappedSize;
+	bool				m_bEnvironmentMapped;	// The ray tracer's arrays point into the mapping
+	bool				m_bTransfersMapped;		// ...and so do the patches' transfers
+#ifdef _WIN32
+	void				*m_hFile;
+	void				*m_hMapping;
+#endif
+};
+
+
+CGeometryCache* GeometryCache();
+
+
+#endif // GEOMETRYCACHE_H
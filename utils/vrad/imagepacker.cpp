@@ -16,12 +16,40 @@
 #include "imagepacker.h"
 
 
-bool CImagePacker::Reset( int maxLightmapWidth, int maxLightmapHeight )
+static const char *s_pHeuristicNames[IMAGE_PACKER_HEURISTIC_COUNT] =
+{
+	"wavefront",
+	"skyline",
+	"maxrects",
+};
+
+const char *ImagePackerHeuristicName( ImagePackerHeuristic_t heuristic )
+{
+	Assert( heuristic >= 0 && heuristic < IMAGE_PACKER_HEURISTIC_COUNT );
+	return s_pHeuristicNames[heuristic];
+}
+
+bool ImagePackerHeuristicForName( const char *pName, ImagePackerHeuristic_t *pHeuristic )
+{
+	for ( int i = 0; i < IMAGE_PACKER_HEURISTIC_COUNT; i++ )
+	{
+		if ( !Q_stricmp( pName, s_pHeuristicNames[i] ) )
+		{
+			*pHeuristic = (ImagePackerHeuristic_t)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool CImagePacker::Reset( int maxLightmapWidth, int maxLightmapHeight, ImagePackerHeuristic_t heuristic )
 {
 	int i;
 	
 	Assert( maxLightmapWidth <= MAX_MAX_LIGHTMAP_WIDTH );
 	
+	m_Heuristic = heuristic;
 	m_MaxLightmapWidth = maxLightmapWidth;
 	m_MaxLightmapHeight = maxLightmapHeight;
 	
@@ -34,6 +62,77 @@ bool CImagePacker::Reset( int maxLightmapWidth, int maxLightmapHeight )
     {
 		m_pLightmapWavefront[i] = -1;
     }
+
+	m_Skyline.RemoveAll();
+	m_FreeRects.RemoveAll();
+	if ( m_Heuristic == IMAGE_PACKER_SKYLINE )
+	{
+		SkylineNode_t &node = m_Skyline[m_Skyline.AddToTail()];
+		node.x = 0;
+		node.y = 0;
+		node.width = maxLightmapWidth;
+	}
+	else if ( m_Heuristic == IMAGE_PACKER_MAXRECTS )
+	{
+		FreeRect_t &rect = m_FreeRects[m_FreeRects.AddToTail()];
+		rect.x = 0;
+		rect.y = 0;
+		rect.width = maxLightmapWidth;
+		rect.height = maxLightmapHeight;
+	}
+	return true;
+}
+
+
+int CImagePacker::GetMinimumHeight() const
+{
+	return ( m_MinimumHeight > 0 ) ? m_MinimumHeight : 0;
+}
+
+
+void CImagePacker::RememberFailedBlock( int width, int height )
+{
+	// If we failed to add it, remember the block size that failed
+	// *only if both dimensions are smaller*!!
+	// Just because a 1x10 block failed, doesn't mean a 10x1 block will fail
+	if ( ( width <= m_MaxBlockWidth ) && ( height <= m_MaxBlockHeight )	)
+	{
+		m_MaxBlockWidth = width;
+		m_MaxBlockHeight = height;
+	}
+}
+
+
+bool CImagePacker::AddBlock( int width, int height, int *returnX, int *returnY )
+{
+	// If we've already determined that a block this big couldn't fit
+	// then blow off checking again...
+	if ( ( width >= m_MaxBlockWidth ) && ( height >= m_MaxBlockHeight ) )
+		return false;
+
+	bool bFit;
+	switch ( m_Heuristic )
+	{
+	case IMAGE_PACKER_SKYLINE:
+		bFit = AddBlockSkyline( width, height, returnX, returnY );
+		break;
+
+	case IMAGE_PACKER_MAXRECTS:
+		bFit = AddBlockMaxRects( width, height, returnX, returnY );
+		break;
+
+	default:
+		bFit = AddBlockWavefront( width, height, returnX, returnY );
+		break;
+	}
+
+	if ( !bFit )
+	{
+		RememberFailedBlock( width, height );
+		return false;
+	}
+
+	m_AreaUsed += width * height;
 	return true;
 }
 
@@ -56,13 +155,8 @@ inline int CImagePacker::GetMaxYIndex( int firstX, int width )
 }
 
 
-bool CImagePacker::AddBlock( int width, int height, int *returnX, int *returnY )
+bool CImagePacker::AddBlockWavefront( int width, int height, int *returnX, int *returnY )
 {
-	// If we've already determined that a block this big couldn't fit
-	// then blow off checking again...
-	if ( ( width >= m_MaxBlockWidth ) && ( height >= m_MaxBlockHeight ) )
-		return false;
-
 	int bestX = -1;	
 	int maxYIdx;
 	int outerX = 0;
@@ -90,18 +184,7 @@ bool CImagePacker::AddBlock( int width, int height, int *returnX, int *returnY )
 	}
 	
 	if( bestX == -1 )
-	{
-		// If we failed to add it, remember the block size that failed
-		// *only if both dimensions are smaller*!!
-		// Just because a 1x10 block failed, doesn't mean a 10x1 block will fail
-		if ( ( width <= m_MaxBlockWidth ) && ( height <= m_MaxBlockHeight )	)
-		{
-			m_MaxBlockWidth = width;
-			m_MaxBlockHeight = height;
-		}
-
 		return false;
-	}
 	
 	// Set the return positions for the block.
 	*returnX = bestX;
@@ -111,15 +194,7 @@ bool CImagePacker::AddBlock( int width, int height, int *returnX, int *returnY )
 	// hack
 	//  if( *returnY + height > maxLightmapHeight )
 	if( *returnY + height >= m_MaxLightmapHeight - 1 )
-	{
-		if ( ( width <= m_MaxBlockWidth ) && ( height <= m_MaxBlockHeight )	)
-		{
-			m_MaxBlockWidth = width;
-			m_MaxBlockHeight = height;
-		}
-
 		return false;
-	}
 						   
 	// It fit!
 	// Keep up with the smallest possible size for the image so far.
@@ -134,8 +209,351 @@ bool CImagePacker::AddBlock( int width, int height, int *returnX, int *returnY )
     }
 	
 	//  AddBlockToLightmapImage( *returnX, *returnY, width, height );
-	m_AreaUsed += width * height;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Skyline, bottom-left: the top edge of everything packed so far is kept as a
+// list of horizontal segments. A block goes at the left end of whichever
+// segment lets its top edge sit lowest, ties going to the narrower segment.
+//-----------------------------------------------------------------------------
+
+// Returns the y the block would sit at if its left edge were at the start of
+// node iNode, or -1 if it won't fit there.
+int CImagePacker::SkylineFit( int iNode, int width, int height )
+{
+	int x = m_Skyline[iNode].x;
+	if ( x + width > m_MaxLightmapWidth )
+		return -1;
+
+	int y = 0;
+	int widthLeft = width;
+	for ( int i = iNode; widthLeft > 0; i++ )
+	{
+		y = MAX( y, m_Skyline[i].y );
+		if ( y + height > m_MaxLightmapHeight )
+			return -1;
+
+		widthLeft -= m_Skyline[i].width;
+	}
+	return y;
+}
+
+
+void CImagePacker::SkylineInsert( int iNode, int x, int y, int width, int height )
+{
+	SkylineNode_t node;
+	node.x = x;
+	node.y = y + height;
+	node.width = width;
+	m_Skyline.InsertBefore( iNode, node );
+
+	// Cut the new segment's span out of the segments it covers.
+	for ( int i = iNode + 1; i < m_Skyline.Count(); )
+	{
+		const SkylineNode_t &prev = m_Skyline[i - 1];
+		SkylineNode_t &cur = m_Skyline[i];
+
+		int nOverlap = prev.x + prev.width - cur.x;
+		if ( nOverlap <= 0 )
+			break;
+
+		cur.x += nOverlap;
+		cur.width -= nOverlap;
+		if ( cur.width > 0 )
+			break;
+
+		m_Skyline.Remove( i );
+	}
+
+	// Join neighbors at the same height.
+	for ( int i = 0; i < m_Skyline.Count() - 1; )
+	{
+		if ( m_Skyline[i].y == m_Skyline[i + 1].y )
+		{
+			m_Skyline[i].width += m_Skyline[i + 1].width;
+			m_Skyline.Remove( i + 1 );
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+
+bool CImagePacker::AddBlockSkyline( int width, int height, int *returnX, int *returnY )
+{
+	int bestNode = -1;
+	int bestBottom = INT_MAX;
+	int bestWidth = INT_MAX;
+	int bestY = 0;
+	for ( int i = 0; i < m_Skyline.Count(); i++ )
+	{
+		int y = SkylineFit( i, width, height );
+		if ( y < 0 )
+			continue;
 
+		int bottom = y + height;
+		if ( ( bottom < bestBottom ) || ( ( bottom == bestBottom ) && ( m_Skyline[i].width < bestWidth ) ) )
+		{
+			bestNode = i;
+			bestBottom = bottom;
+			bestWidth = m_Skyline[i].width;
+			bestY = y;
+		}
+	}
+
+	if ( bestNode == -1 )
+		return false;
+
+	*returnX = m_Skyline[bestNode].x;
+	*returnY = bestY;
+	SkylineInsert( bestNode, *returnX, bestY, width, height );
+
+	if ( bestBottom > m_MinimumHeight )
+		m_MinimumHeight = bestBottom;
 	return true;
 }
 
+
+//-----------------------------------------------------------------------------
+// MaxRects, best short side fit: keeps every maximal free rectangle (they
+// overlap). A block goes in the corner of the free rectangle it leaves the
+// least room in along its tighter side.
+//-----------------------------------------------------------------------------
+bool CImagePacker::AddBlockMaxRects( int width, int height, int *returnX, int *returnY )
+{
+	int bestRect = -1;
+	int bestShortSide = INT_MAX;
+	int bestLongSide = INT_MAX;
+	for ( int i = 0; i < m_FreeRects.Count(); i++ )
+	{
+		const FreeRect_t &rect = m_FreeRects[i];
+		if ( ( rect.width < width ) || ( rect.height < height ) )
+			continue;
+
+		int leftoverX = rect.width - width;
+		int leftoverY = rect.height - height;
+		int shortSide = MIN( leftoverX, leftoverY );
+		int longSide = MAX( leftoverX, leftoverY );
+		if ( ( shortSide < bestShortSide ) || ( ( shortSide == bestShortSide ) && ( longSide < bestLongSide ) ) )
+		{
+			bestRect = i;
+			bestShortSide = shortSide;
+			bestLongSide = longSide;
+		}
+	}
+
+	if ( bestRect == -1 )
+		return false;
+
+	FreeRect_t used;
+	used.x = m_FreeRects[bestRect].x;
+	used.y = m_FreeRects[bestRect].y;
+	used.width = width;
+	used.height = height;
+
+	SplitFreeRects( used );
+	PruneFreeRects();
+
+	*returnX = used.x;
+	*returnY = used.y;
+	if ( used.y + height > m_MinimumHeight )
+		m_MinimumHeight = used.y + height;
+	return true;
+}
+
+
+// Replaces each free rectangle the used one overlaps with the (up to four)
+// largest rectangles around it that are still free.
+void CImagePacker::SplitFreeRects( const FreeRect_t &used )
+{
+	for ( int i = m_FreeRects.Count(); --i >= 0; )
+	{
+		FreeRect_t free = m_FreeRects[i];
+		if ( ( used.x >= free.x + free.width ) || ( used.x + used.width <= free.x ) ||
+			 ( used.y >= free.y + free.height ) || ( used.y + used.height <= free.y ) )
+			continue;
+
+		// Anything that moves into slot i has either been looked at already or was just added.
+		m_FreeRects.FastRemove( i );
+
+		FreeRect_t split;
+		if ( used.x > free.x )
+		{
+			split = free;
+			split.width = used.x - free.x;
+			m_FreeRects.AddToTail( split );
+		}
+		if ( used.x + used.width < free.x + free.width )
+		{
+			split = free;
+			split.x = used.x + used.width;
+			split.width = free.x + free.width - split.x;
+			m_FreeRects.AddToTail( split );
+		}
+		if ( used.y > free.y )
+		{
+			split = free;
+			split.height = used.y - free.y;
+			m_FreeRects.AddToTail( split );
+		}
+		if ( used.y + used.height < free.y + free.height )
+		{
+			split = free;
+			split.y = used.y + used.height;
+			split.height = free.y + free.height - split.y;
+			m_FreeRects.AddToTail( split );
+		}
+	}
+}
+
+
+static inline bool IsContainedIn( int ax, int ay, int aw, int ah, int bx, int by, int bw, int bh )
+{
+	return ( ax >= bx ) && ( ay >= by ) && ( ax + aw <= bx + bw ) && ( ay + ah <= by + bh );
+}
+
+// Drops free rectangles that lie inside another one.
+void CImagePacker::PruneFreeRects()
+{
+	for ( int i = 0; i < m_FreeRects.Count(); i++ )
+	{
+		for ( int j = i + 1; j < m_FreeRects.Count(); j++ )
+		{
+			const FreeRect_t &a = m_FreeRects[i];
+			const FreeRect_t &b = m_FreeRects[j];
+			if ( IsContainedIn( a.x, a.y, a.width, a.height, b.x, b.y, b.width, b.height ) )
+			{
+				m_FreeRects.Remove( i );
+				--i;
+				break;
+			}
+			if ( IsContainedIn( b.x, b.y, b.width, b.height, a.x, a.y, a.width, a.height ) )
+			{
+				m_FreeRects.Remove( j );
+				--j;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// CMultiImagePacker
+//-----------------------------------------------------------------------------
+CMultiImagePacker::CMultiImagePacker() :
+	m_nImageWidth( 0 ), m_nImageHeight( 0 ), m_Heuristic( IMAGE_PACKER_WAVEFRONT ), m_nUnpacked( 0 )
+{
+}
+
+CMultiImagePacker::~CMultiImagePacker()
+{
+	m_Images.PurgeAndDeleteElements();
+}
+
+
+void CMultiImagePacker::Init( int imageWidth, int imageHeight, ImagePackerHeuristic_t heuristic )
+{
+	m_nImageWidth = imageWidth;
+	m_nImageHeight = imageHeight;
+	m_Heuristic = heuristic;
+	m_nUnpacked = 0;
+	m_Blocks.RemoveAll();
+	m_Images.PurgeAndDeleteElements();
+}
+
+
+int CMultiImagePacker::AddBlock( int width, int height )
+{
+	int i = m_Blocks.AddToTail();
+	Block_t &block = m_Blocks[i];
+	block.m_nWidth = width;
+	block.m_nHeight = height;
+	block.m_nImage = -1;
+	block.m_nX = 0;
+	block.m_nY = 0;
+	return i;
+}
+
+
+// Tallest first, then widest
+static int __cdecl CompareBlocks( CMultiImagePacker::Block_t * const *ppLeft, CMultiImagePacker::Block_t * const *ppRight )
+{
+	const CMultiImagePacker::Block_t *pLeft = *ppLeft;
+	const CMultiImagePacker::Block_t *pRight = *ppRight;
+	if ( pLeft->m_nHeight != pRight->m_nHeight )
+		return pRight->m_nHeight - pLeft->m_nHeight;
+	if ( pLeft->m_nWidth != pRight->m_nWidth )
+		return pRight->m_nWidth - pLeft->m_nWidth;
+
+	// Keep the order stable so the result doesn't depend on qsort
+	return ( pLeft < pRight ) ? -1 : ( pLeft > pRight );
+}
+
+
+int CMultiImagePacker::Pack()
+{
+	m_Images.PurgeAndDeleteElements();
+	m_nUnpacked = 0;
+
+	CUtlVector<Block_t*> sorted;
+	sorted.EnsureCapacity( m_Blocks.Count() );
+	for ( int i = 0; i < m_Blocks.Count(); i++ )
+	{
+		sorted.AddToTail( &m_Blocks[i] );
+	}
+	sorted.Sort( CompareBlocks );
+
+	for ( int i = 0; i < sorted.Count(); i++ )
+	{
+		Block_t *pBlock = sorted[i];
+		pBlock->m_nImage = -1;
+
+		for ( int j = 0; j < m_Images.Count(); j++ )
+		{
+			if ( m_Images[j]->AddBlock( pBlock->m_nWidth, pBlock->m_nHeight, &pBlock->m_nX, &pBlock->m_nY ) )
+			{
+				pBlock->m_nImage = j;
+				break;
+			}
+		}
+
+		if ( pBlock->m_nImage != -1 )
+			continue;
+
+		CImagePacker *pImage = new CImagePacker;
+		pImage->Reset( m_nImageWidth, m_nImageHeight, m_Heuristic );
+		if ( !pImage->AddBlock( pBlock->m_nWidth, pBlock->m_nHeight, &pBlock->m_nX, &pBlock->m_nY ) )
+		{
+			// Doesn't fit in an empty image
+			delete pImage;
+			++m_nUnpacked;
+			continue;
+		}
+
+		pBlock->m_nImage = m_Images.AddToTail( pImage );
+	}
+
+	return m_Images.Count();
+}
+
+
+float CMultiImagePacker::GetOccupancy() const
+{
+	int nImages = m_Images.Count();
+	if ( !nImages )
+		return 0.0f;
+
+	int64 nAreaUsed = 0;
+	for ( int i = 0; i < nImages; i++ )
+	{
+		nAreaUsed += m_Images[i]->GetAreaUsed();
+	}
+
+	int64 nArea = (int64)m_nImageWidth * m_nImageHeight * ( nImages - 1 );
+	nArea += (int64)m_nImageWidth * m_Images[nImages - 1]->GetMinimumHeight();
+	return nArea ? (float)( (double)nAreaUsed / nArea ) : 0.0f;
+}
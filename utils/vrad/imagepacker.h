@@ -19,21 +19,71 @@
 #pragma once
 #endif
 
+#include "tier1/utlvector.h"
+
 #define MAX_MAX_LIGHTMAP_WIDTH 2048
 
 
+//-----------------------------------------------------------------------------
+// How CImagePacker decides where a block goes
+//-----------------------------------------------------------------------------
+enum ImagePackerHeuristic_t
+{
+	IMAGE_PACKER_WAVEFRONT = 0,		// Lowest column height, scanning left to right
+	IMAGE_PACKER_SKYLINE,			// Skyline, bottom-left
+	IMAGE_PACKER_MAXRECTS,			// MaxRects, best short side fit
+
+	IMAGE_PACKER_HEURISTIC_COUNT
+};
+
+const char *ImagePackerHeuristicName( ImagePackerHeuristic_t heuristic );
+bool ImagePackerHeuristicForName( const char *pName, ImagePackerHeuristic_t *pHeuristic );
+
+
 //-----------------------------------------------------------------------------
 // This packs a single lightmap
 //-----------------------------------------------------------------------------
 class CImagePacker
 {
 public:
-	bool Reset( int maxLightmapWidth, int maxLightmapHeight );
+	bool Reset( int maxLightmapWidth, int maxLightmapHeight, ImagePackerHeuristic_t heuristic = IMAGE_PACKER_WAVEFRONT );
 	bool AddBlock( int width, int height, int *returnX, int *returnY );
 
+	int GetAreaUsed() const		{ return m_AreaUsed; }
+
+	// Height of the part of the image that has anything in it
+	int GetMinimumHeight() const;
+
 protected:
+	struct SkylineNode_t
+	{
+		int x;
+		int y;
+		int width;
+	};
+
+	struct FreeRect_t
+	{
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
 	int GetMaxYIndex( int firstX, int width );
 
+	bool AddBlockWavefront( int width, int height, int *returnX, int *returnY );
+	bool AddBlockSkyline( int width, int height, int *returnX, int *returnY );
+	bool AddBlockMaxRects( int width, int height, int *returnX, int *returnY );
+
+	int SkylineFit( int iNode, int width, int height );
+	void SkylineInsert( int iNode, int x, int y, int width, int height );
+	void SplitFreeRects( const FreeRect_t &used );
+	void PruneFreeRects();
+
+	void RememberFailedBlock( int width, int height );
+
+	ImagePackerHeuristic_t m_Heuristic;
 	int m_MaxLightmapWidth;
 	int m_MaxLightmapHeight;
 	int m_pLightmapWavefront[MAX_MAX_LIGHTMAP_WIDTH];
@@ -45,6 +95,58 @@ protected:
 	// that was unable to be stored in this image
 	int m_MaxBlockWidth;
 	int m_MaxBlockHeight;
+
+	CUtlVector<SkylineNode_t> m_Skyline;		// IMAGE_PACKER_SKYLINE, sorted by x
+	CUtlVector<FreeRect_t> m_FreeRects;			// IMAGE_PACKER_MAXRECTS
+};
+
+
+//-----------------------------------------------------------------------------
+// Packs a set of blocks into as many images of one size as it takes. Blocks
+// are packed tallest first, and each one goes into the first image it fits.
+//-----------------------------------------------------------------------------
+class CMultiImagePacker
+{
+public:
+	CMultiImagePacker();
+	~CMultiImagePacker();
+
+	struct Block_t
+	{
+		int m_nWidth;
+		int m_nHeight;
+
+		// Filled in by Pack(); m_nImage is -1 if the block is bigger than an image
+		int m_nImage;
+		int m_nX;
+		int m_nY;
+	};
+
+	void Init( int imageWidth, int imageHeight, ImagePackerHeuristic_t heuristic );
+
+	// Returns the block's index
+	int AddBlock( int width, int height );
+
+	// Returns the number of images used
+	int Pack();
+
+	int GetBlockCount() const						{ return m_Blocks.Count(); }
+	const Block_t &GetBlock( int i ) const			{ return m_Blocks[i]; }
+	int GetImageCount() const						{ return m_Images.Count(); }
+	int GetUnpackedBlockCount() const				{ return m_nUnpacked; }
+
+	// Fraction of the images that's covered by blocks. The last image only
+	// counts up to its minimum height.
+	float GetOccupancy() const;
+
+private:
+	int m_nImageWidth;
+	int m_nImageHeight;
+	ImagePackerHeuristic_t m_Heuristic;
+	int m_nUnpacked;
+
+	CUtlVector<Block_t> m_Blocks;
+	CUtlVector<CImagePacker*> m_Images;
 };
 
 
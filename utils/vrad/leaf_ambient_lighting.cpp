@@ -16,6 +16,8 @@
 #include "messbuf.h"
 #include "vmpi.h"
 #include "vmpi_distribute_work.h"
+#include "vmpi_filesystem.h"
+#include "mpivrad.h"
 
 static TableVector g_BoxDirections[6] = 
 {
@@ -89,27 +91,30 @@ float Engine_WorldLightDistanceFalloff( const dworldlight_t *wl, const Vector& d
 }
 
 
-void AddEmitSurfaceLights( const Vector &vStart, Vector lightBoxColor[6] )
+// Adds the contribution of up to 8 ambient cube surface lights, testing their visibility all at once.
+static void AddEmitSurfaceLightGroup( const Vector &vStart, dworldlight_t **ppLights, int nLights, Vector lightBoxColor[6] )
 {
-	fltx4 fractionVisible;
-
-	FourVectors vStart4, wlOrigin4;
-	vStart4.DuplicateVector ( vStart );
-
-	for ( int iLight=0; iLight < *pNumworldlights; iLight++ )
+	FourVectors vStart4[2], wlOrigin4[2];
+	vStart4[0].DuplicateVector( vStart );
+	vStart4[1].DuplicateVector( vStart );
+	for ( int i = 0; i < 8; i++ )
 	{
-		dworldlight_t *wl = &dworldlights[iLight];
-
-		// Should this light even go in the ambient cubes?
-		if ( !( wl->flags & DWL_FLAGS_INAMBIENTCUBE ) )
-			continue;
+		// pad the group out with the last light
+		const Vector &vOrigin = ppLights[MIN( i, nLights - 1 )]->origin;
+		wlOrigin4[i >> 2].X( i & 3 ) = vOrigin.x;
+		wlOrigin4[i >> 2].Y( i & 3 ) = vOrigin.y;
+		wlOrigin4[i >> 2].Z( i & 3 ) = vOrigin.z;
+	}
 
-		Assert( wl->type == emit_surface );
+	// Can these lights see the point?
+	fltx4 fractionVisible[2];
+	TestLine8( vStart4, wlOrigin4, fractionVisible );
 
-		// Can this light see the point?
-		wlOrigin4.DuplicateVector ( wl->origin );
-		TestLine ( vStart4, wlOrigin4, &fractionVisible );
-		if ( !TestSignSIMD ( CmpGtSIMD ( fractionVisible, Four_Zeros ) ) )
+	for ( int iLight = 0; iLight < nLights; iLight++ )
+	{
+		dworldlight_t *wl = ppLights[iLight];
+		float flFractionVisible = SubFloat( fractionVisible[iLight >> 2], iLight & 3 );
+		if ( flFractionVisible <= 0.0f )
 			continue;
 
 		// Add this light's contribution.
@@ -120,7 +125,7 @@ void AddEmitSurfaceLights( const Vector &vStart, Vector lightBoxColor[6] )
 		VectorNormalize( vDeltaNorm );
 		float flAngleScale = Engine_WorldLightAngle( wl, wl->normal, vDeltaNorm, vDeltaNorm );
 
-		float ratio = flDistanceScale * flAngleScale * SubFloat ( fractionVisible, 0 );
+		float ratio = flDistanceScale * flAngleScale * flFractionVisible;
 		if ( ratio == 0 )
 			continue;
 
@@ -132,7 +137,125 @@ void AddEmitSurfaceLights( const Vector &vStart, Vector lightBoxColor[6] )
 				lightBoxColor[i] += wl->intensity * (t * ratio);
 			}
 		}
-	}	
+	}
+}
+
+
+void AddEmitSurfaceLights( const Vector &vStart, Vector lightBoxColor[6] )
+{
+	dworldlight_t *pLights[8];
+	int nLights = 0;
+
+	for ( int iLight=0; iLight < *pNumworldlights; iLight++ )
+	{
+		dworldlight_t *wl = &dworldlights[iLight];
+
+		// Should this light even go in the ambient cubes?
+		if ( !( wl->flags & DWL_FLAGS_INAMBIENTCUBE ) )
+			continue;
+
+		Assert( wl->type == emit_surface );
+
+		pLights[nLights++] = wl;
+		if ( nLights == ARRAYSIZE( pLights ) )
+		{
+			AddEmitSurfaceLightGroup( vStart, pLights, nLights, lightBoxColor );
+			nLights = 0;
+		}
+	}
+
+	if ( nLights )
+	{
+		AddEmitSurfaceLightGroup( vStart, pLights, nLights, lightBoxColor );
+	}
+}
+
+
+// How far on either side of the ray tracer's hit to look for the surface that was hit.
+#define AMBIENT_HIT_SEARCH_DIST		8.0f
+
+// g_anorms, ordered so that the rays in each packet of 8 point the same way
+static int g_AmbientRayOrder[NUMVERTEXNORMALS];
+
+static int AmbientRaySignMask( const Vector &vDir )
+{
+	return ( vDir.x < 0 ? 1 : 0 ) | ( vDir.y < 0 ? 2 : 0 ) | ( vDir.z < 0 ? 4 : 0 );
+}
+
+static void InitAmbientRayOrder()
+{
+	int nRays = 0;
+	for ( int nSignMask = 0; nSignMask < 8; nSignMask++ )
+	{
+		for ( int i = 0; i < NUMVERTEXNORMALS; i++ )
+		{
+			if ( AmbientRaySignMask( g_anorms[i] ) == nSignMask )
+			{
+				g_AmbientRayOrder[nRays++] = i;
+			}
+		}
+	}
+	Assert( nRays == NUMVERTEXNORMALS );
+}
+
+//-----------------------------------------------------------------------------
+// Finds the color the spherical sample rays hit, 8 rays at a time. The ray tracer
+// finds how far each ray goes, then only the part of the ray around that point is
+// searched for the surface. Rays that hit static props, which the ambient rays
+// ignore, or where no surface is found near the hit are cast the slow way.
+//-----------------------------------------------------------------------------
+static void CalcRayAmbientLightingPackets( int iThread, const Vector &vStart, float tanTheta, Vector radcolor[NUMVERTEXNORMALS] )
+{
+	float flRayLength = COORD_EXTENT * 1.74;
+
+	EightRays rays;
+	rays.m_Rays[0].origin.DuplicateVector( vStart );
+	rays.m_Rays[1].origin.DuplicateVector( vStart );
+	fltx4 tMin[2] = { Four_Zeros, Four_Zeros };
+	fltx4 tMax[2] = { ReplicateX4( flRayLength ), ReplicateX4( flRayLength ) };
+
+	for ( int nFirst = 0; nFirst < NUMVERTEXNORMALS; nFirst += 8 )
+	{
+		int nRays = MIN( NUMVERTEXNORMALS - nFirst, 8 );
+		for ( int i = 0; i < 8; i++ )
+		{
+			const Vector &vDir = g_anorms[g_AmbientRayOrder[nFirst + MIN( i, nRays - 1 )]];
+			rays.m_Rays[i >> 2].direction.X( i & 3 ) = vDir.x;
+			rays.m_Rays[i >> 2].direction.Y( i & 3 ) = vDir.y;
+			rays.m_Rays[i >> 2].direction.Z( i & 3 ) = vDir.z;
+		}
+
+		RayTracingResult result[2];
+		g_RtEnv.Trace8Rays( rays, tMin, tMax, result );
+
+		for ( int i = 0; i < nRays; i++ )
+		{
+			int nDir = g_AmbientRayOrder[nFirst + i];
+			const Vector &vDir = g_anorms[nDir];
+
+			Vector lightStyleColors[MAX_LIGHTSTYLES];
+			lightStyleColors[0].Init();	// We only care about light style 0 here.
+
+			bool bFound = false;
+			int nHitID = result[i >> 2].HitIds[i & 3];
+			float flHitDist = SubFloat( result[i >> 2].HitDistance, i & 3 );
+			if ( nHitID != -1 && flHitDist < flRayLength &&
+				 !( g_RtEnv.OptimizedTriangleList[nHitID].m_Data.m_IntersectData.m_nTriangleID & TRACE_ID_STATICPROP ) )
+			{
+				float flSegStart = MAX( flHitDist - AMBIENT_HIT_SEARCH_DIST, 0.0f );
+				float flSegEnd = MIN( flHitDist + AMBIENT_HIT_SEARCH_DIST, flRayLength );
+				bFound = CalcRayAmbientLightingInSegment( iThread, vStart + vDir * flSegStart, vStart + vDir * flSegEnd,
+														  flSegStart, tanTheta, lightStyleColors );
+			}
+
+			if ( !bFound )
+			{
+				CalcRayAmbientLighting( iThread, vStart, vStart + vDir * flRayLength, tanTheta, lightStyleColors );
+			}
+
+			radcolor[nDir] = lightStyleColors[0];
+		}
+	}
 }
 
 
@@ -142,16 +265,23 @@ void ComputeAmbientFromSphericalSamples( int iThread, const Vector &vStart, Vect
 	Vector radcolor[NUMVERTEXNORMALS];
 	float tanTheta = tan(VERTEXNORMAL_CONE_INNER_ANGLE);
 
-	for ( int i = 0; i < NUMVERTEXNORMALS; i++ )
+	if ( g_bAdaptiveAmbient )
 	{
-		Vector vEnd = vStart + g_anorms[i] * (COORD_EXTENT * 1.74);
+		CalcRayAmbientLightingPackets( iThread, vStart, tanTheta, radcolor );
+	}
+	else
+	{
+		for ( int i = 0; i < NUMVERTEXNORMALS; i++ )
+		{
+			Vector vEnd = vStart + g_anorms[i] * (COORD_EXTENT * 1.74);
 
-		// Now that we've got a ray, see what surface we've hit
-		Vector lightStyleColors[MAX_LIGHTSTYLES];
-		lightStyleColors[0].Init();	// We only care about light style 0 here.
-		CalcRayAmbientLighting( iThread, vStart, vEnd, tanTheta, lightStyleColors );
-	
-		radcolor[i] = lightStyleColors[0];
+			// Now that we've got a ray, see what surface we've hit
+			Vector lightStyleColors[MAX_LIGHTSTYLES];
+			lightStyleColors[0].Init();	// We only care about light style 0 here.
+			CalcRayAmbientLighting( iThread, vStart, vEnd, tanTheta, lightStyleColors );
+		
+			radcolor[i] = lightStyleColors[0];
+		}
 	}
 
 	// accumulate samples into radiant box
@@ -522,6 +652,101 @@ static byte Fixed8Fraction( float t, float tMin, float tMax )
 
 CUtlVector< CUtlVector<ambientsample_t> > g_LeafAmbientSamples;
 
+// With -adaptiveambient every leaf gets one sample, the probe, before the rest are computed so
+// that each leaf can see how much the lighting changes between it and its neighbours.
+CUtlVector<ambientsample_t> g_LeafAmbientProbes;
+extern CUtlVector<char> g_LeafAmbientProbesFilename;
+
+// Lighting that changes by less than this many gamma space units is treated as flat.
+#define ADAPTIVE_AMBIENT_FLAT_DELTA			3
+// Leaves whose lighting differs from a neighbour's by this much get every sample.
+#define ADAPTIVE_AMBIENT_FULL_DELTA			32
+// Stop sampling a leaf once this many samples in a row were predicted by the ones before.
+#define ADAPTIVE_AMBIENT_CONVERGED_COUNT	4
+
+void ComputeAmbientProbeForLeaf( int iThread, int leafID, ambientsample_t &probe )
+{
+	memset( &probe, 0, sizeof( probe ) );
+	if ( dleafs[leafID].contents & CONTENTS_SOLID )
+		return;
+
+	CUtlVector<dplane_t> leafPlanes;
+	CLeafSampler sampler( iThread );
+
+	GetLeafBoundaryPlanes( leafPlanes, leafID );
+	sampler.GenerateLeafSamplePosition( leafID, leafPlanes, probe.pos );
+	ComputeAmbientFromSphericalSamples( iThread, probe.pos, probe.cube );
+}
+
+// the largest change in lighting between the leaf's probe and the probes of the leaves touching it
+static int EstimateLeafAmbientGradient( int leafID )
+{
+	Vector mins, maxs;
+	LeafBounds( leafID, mins, maxs );
+	Vector vTouch( 1, 1, 1 );
+	CLeafList leafList;
+	ToolBSPTree()->EnumerateLeavesInBox( mins - vTouch, maxs + vTouch, &leafList, 0 );
+
+	int maxDelta = 0;
+	for ( int i = 0; i < leafList.m_list.Count(); i++ )
+	{
+		int testIndex = leafList.m_list[i];
+		if ( testIndex == leafID || ( dleafs[testIndex].contents & CONTENTS_SOLID ) )
+			continue;
+
+		int delta = CubeDeltaGammaSpace( g_LeafAmbientProbes[leafID].cube, g_LeafAmbientProbes[testIndex].cube );
+		maxDelta = max( maxDelta, delta );
+	}
+	return maxDelta;
+}
+
+// Takes up to maxSampleCount samples, fewer where the lighting around the leaf is flat, and stops
+// early once new samples can be reconstructed from the ones already taken.
+static void ComputeAdaptiveAmbientForLeaf( int iThread, int leafID, int maxSampleCount, CUtlVector<ambientsample_t> &list )
+{
+	ambientsample_t &probe = g_LeafAmbientProbes[leafID];
+	AddSampleToList( list, probe.pos, probe.cube );
+
+	int gradient = EstimateLeafAmbientGradient( leafID );
+	if ( gradient < ADAPTIVE_AMBIENT_FLAT_DELTA )
+		return;
+
+	float flSampleCount = RemapValClamped( gradient, ADAPTIVE_AMBIENT_FLAT_DELTA, ADAPTIVE_AMBIENT_FULL_DELTA, 2.0f, maxSampleCount );
+	int sampleCount = min( (int)(flSampleCount + 0.5f), maxSampleCount );
+
+	CUtlVector<dplane_t> leafPlanes;
+	CLeafSampler sampler( iThread );
+	GetLeafBoundaryPlanes( leafPlanes, leafID );
+
+	// the sampler generates the same points it did for the probe, starting with the probe itself
+	Vector samplePosition;
+	sampler.GenerateLeafSamplePosition( leafID, leafPlanes, samplePosition );
+
+	Vector cube[6];
+	Vector predictedCube[6];
+	int nConverged = 0;
+	for ( int i = 1; i < sampleCount && nConverged < ADAPTIVE_AMBIENT_CONVERGED_COUNT; i++ )
+	{
+		sampler.GenerateLeafSamplePosition( leafID, leafPlanes, samplePosition );
+		ComputeAmbientFromSphericalSamples( iThread, samplePosition, cube );
+
+		Mod_LeafAmbientColorAtPos( predictedCube, samplePosition, list, -1 );
+		if ( CubeDeltaGammaSpace( predictedCube, cube ) < ADAPTIVE_AMBIENT_FLAT_DELTA )
+		{
+			nConverged++;
+		}
+		else
+		{
+			nConverged = 0;
+		}
+
+		AddSampleToList( list, samplePosition, cube );
+	}
+
+	// remove any samples that can be reconstructed with the remaining data
+	CompressAmbientSampleList( list );
+}
+
 void ComputeAmbientForLeaf( int iThread, int leafID, CUtlVector<ambientsample_t> &list )
 {
 	CUtlVector<dplane_t> leafPlanes;
@@ -550,6 +775,11 @@ void ComputeAmbientForLeaf( int iThread, int leafID, CUtlVector<ambientsample_t>
 		// NOTE: We copy the nearest non-solid leaf sample pointers into this leaf at the end
 		return;
 	}
+	if ( g_bAdaptiveAmbient )
+	{
+		ComputeAdaptiveAmbientForLeaf( iThread, leafID, sampleCount, list );
+		return;
+	}
 	Vector cube[6];
 	for ( int i = 0; i < sampleCount; i++ )
 	{
@@ -589,6 +819,13 @@ void VMPI_ProcessLeafAmbient( int iThread, uint64 iLeaf, MessageBuffer *pBuf )
 	CUtlVector<ambientsample_t> list;
 	ComputeAmbientForLeaf(iThread, (int)iLeaf, list);
 
+	// The master computes some leaves itself.
+	if ( !pBuf )
+	{
+		g_LeafAmbientSamples[iLeaf].CopyArray( list.Base(), list.Count() );
+		return;
+	}
+
 	VMPI_SetCurrentStage( "EncodeLeafAmbientResults" );
 
 	// Encode the results.
@@ -617,6 +854,93 @@ void VMPI_ReceiveLeafAmbientResults( uint64 leafID, MessageBuffer *pBuf, int iWo
 }
 
 
+static void ThreadComputeLeafAmbientProbe( int iThread, void *pUserData )
+{
+	while (1)
+	{
+		int leafID = GetThreadWork ();
+		if (leafID == -1)
+			break;
+		ComputeAmbientProbeForLeaf( iThread, leafID, g_LeafAmbientProbes[leafID] );
+	}
+}
+
+void VMPI_ProcessLeafAmbientProbe( int iThread, uint64 iLeaf, MessageBuffer *pBuf )
+{
+	ambientsample_t probe;
+	ComputeAmbientProbeForLeaf( iThread, (int)iLeaf, probe );
+
+	if ( pBuf )
+	{
+		pBuf->write( &probe, sizeof( probe ) );
+	}
+	else
+	{
+		g_LeafAmbientProbes[iLeaf] = probe;
+	}
+}
+
+void VMPI_ReceiveLeafAmbientProbe( uint64 leafID, MessageBuffer *pBuf, int iWorker )
+{
+	pBuf->read( &g_LeafAmbientProbes[leafID], sizeof( ambientsample_t ) );
+}
+
+//-----------------------------------------------------------------------------
+// The workers need every probe to place their samples, so the master sends them
+// all out once they're done.
+//-----------------------------------------------------------------------------
+static void VMPI_DistributeLeafAmbientProbes()
+{
+	if ( g_bMPIMaster )
+	{
+		const char *pVirtualFilename = "--leafambientprobes--";
+		VMPI_FileSystem_CreateVirtualFile( pVirtualFilename, g_LeafAmbientProbes.Base(), g_LeafAmbientProbes.Count() * sizeof( ambientsample_t ) );
+
+		char cPacketID[2] = { VMPI_VRAD_PACKET_ID, VMPI_SUBPACKETID_LEAF_AMBIENT_PROBES };
+		VMPI_Send2Chunks( cPacketID, sizeof( cPacketID ), pVirtualFilename, strlen( pVirtualFilename ) + 1, VMPI_PERSISTENT );
+	}
+	else
+	{
+		VMPI_SetCurrentStage( "VMPI_DistributeLeafAmbientProbes" );
+
+		// Wait until we've received the filename from the master.
+		while ( g_LeafAmbientProbesFilename.Count() == 0 )
+		{
+			VMPI_DispatchNextMessage();
+		}
+
+		FileHandle_t fp = g_pFileSystem->Open( g_LeafAmbientProbesFilename.Base(), "rb", VMPI_VIRTUAL_FILES_PATH_ID );
+		if ( !fp )
+			Error( "Can't open '%s' to read leaf ambient probes.", g_LeafAmbientProbesFilename.Base() );
+
+		int size = g_pFileSystem->Size( fp );
+		if ( size != g_LeafAmbientProbes.Count() * (int)sizeof( ambientsample_t ) )
+			Error( "'%s' has %d bytes of leaf ambient probes, expected %d.", g_LeafAmbientProbesFilename.Base(), size, g_LeafAmbientProbes.Count() * (int)sizeof( ambientsample_t ) );
+
+		g_pFileSystem->Read( g_LeafAmbientProbes.Base(), size, fp );
+		g_pFileSystem->Close( fp );
+	}
+}
+
+static void ComputeLeafAmbientProbes()
+{
+	InitAmbientRayOrder();
+	g_LeafAmbientProbes.SetCount( numleafs );
+
+	if ( g_bUseMPI )
+	{
+		// Distribute the work among the workers.
+		VMPI_SetCurrentStage( "ComputeLeafAmbientProbes" );
+		DistributeWork( numleafs, VMPI_DISTRIBUTEWORK_PACKETID, VMPI_ProcessLeafAmbientProbe, VMPI_ReceiveLeafAmbientProbe );
+		VMPI_DistributeLeafAmbientProbes();
+	}
+	else
+	{
+		RunThreadsOn(numleafs, true, ThreadComputeLeafAmbientProbe);
+	}
+}
+
+
 void ComputePerLeafAmbientLighting()
 {
 	// Figure out which lights should go in the per-leaf ambient cubes.
@@ -642,6 +966,11 @@ void ComputePerLeafAmbientLighting()
 
 	g_LeafAmbientSamples.SetCount(numleafs);
 
+	if ( g_bAdaptiveAmbient )
+	{
+		ComputeLeafAmbientProbes();
+	}
+
 	if ( g_bUseMPI )
 	{
 		// Distribute the work among the workers.
@@ -653,6 +982,8 @@ void ComputePerLeafAmbientLighting()
 		RunThreadsOn(numleafs, true, ThreadComputeLeafAmbient);
 	}
 
+	g_LeafAmbientProbes.Purge();
+
 	// now write out the data
 	Msg("Writing leaf ambient...");
 	g_pLeafAmbientIndex->RemoveAll();
@@ -0,0 +1,386 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Culls the direct lights that can't reach a face before its samples
+//			are lit, using a bvh over the lights' spheres of influence.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "lightcull.h"
+
+
+float g_flLightCullThreshold = 0.0f;
+
+// Leaves hold up to this many lights.
+#define LIGHTCULL_LEAF_SIZE		4
+
+// Slop for the sqrt estimate the sample code uses to measure light distance.
+#define LIGHTCULL_RADIUS_SCALE	1.01f
+#define LIGHTCULL_RADIUS_PAD	1.0f
+
+struct LightCullEntry_t
+{
+	directlight_t	*m_pLight;
+	int				m_nOrder;		// position in activelights
+	float			m_flRadius;		// FLT_MAX if the light reaches everywhere
+	Vector			m_Mins;
+	Vector			m_Maxs;
+};
+
+struct LightCullNode_t
+{
+	Vector			m_Mins;
+	Vector			m_Maxs;
+	int				m_iChild;		// first of two children, or -1 for a leaf
+	int				m_iFirstLight;	// leaves only, into g_LightCullEntries
+	int				m_nLights;
+};
+
+// Lights with an unbounded sphere are kept out of the tree and tested every time.
+static CUtlVector<LightCullEntry_t> g_UnboundedLights;
+static CUtlVector<LightCullEntry_t> g_LightCullEntries;
+static CUtlVector<LightCullNode_t> g_LightCullNodes;
+
+// activelights as an array, to map positions back to lights
+static CUtlVector<directlight_t *> g_LightsByOrder;
+
+static CUtlVector<int> g_LightCullOrder[MAX_TOOL_THREADS+1];
+static CUtlVector<int> g_LightCullStack[MAX_TOOL_THREADS+1];
+
+static int64 g_nLightsTested[MAX_TOOL_THREADS+1];
+static int64 g_nLightsKept[MAX_TOOL_THREADS+1];
+
+
+//-----------------------------------------------------------------------------
+// How far the light can reach. Hard falloff lights go to zero at the end of
+// their fade; with a threshold, anything dimmer than it is treated as zero too.
+//-----------------------------------------------------------------------------
+static float ComputeLightCullRadius( directlight_t *dl )
+{
+	float flRadius = FLT_MAX;
+
+	switch( dl->light.type )
+	{
+	case emit_point:
+	case emit_spotlight:
+	case emit_surface:
+		break;
+
+	default:
+		// sky lights come from infinitely far away
+		return FLT_MAX;
+	}
+
+	if ( dl->m_flEndFadeDistance > dl->m_flStartFadeDistance )
+	{
+		flRadius = dl->m_flEndFadeDistance;
+	}
+
+	if ( g_flLightCullThreshold > 0.0f )
+	{
+		float flMaxIntensity = max( fabs( dl->light.intensity.x ), max( fabs( dl->light.intensity.y ), fabs( dl->light.intensity.z ) ) );
+		float flRatio = flMaxIntensity / g_flLightCullThreshold;
+		float flThresholdRadius = FLT_MAX;
+
+		if ( dl->light.type == emit_surface )
+		{
+			// falloff is at most 1/dist^2
+			flThresholdRadius = sqrt( flRatio );
+		}
+		else
+		{
+			// solve constant + linear*d + quadratic*d^2 = ratio for d
+			float c = dl->light.constant_attn - flRatio;
+			float l = dl->light.linear_attn;
+			float q = dl->light.quadratic_attn;
+			if ( q > 0.0f )
+			{
+				float flDiscrim = l * l - 4.0f * q * c;
+				if ( flDiscrim >= 0.0f )
+				{
+					flThresholdRadius = ( -l + sqrt( flDiscrim ) ) / ( 2.0f * q );
+				}
+			}
+			else if ( l > 0.0f )
+			{
+				flThresholdRadius = -c / l;
+			}
+
+			// falloff stops changing past the cap, so it can't be used to bound the light
+			if ( flThresholdRadius > dl->m_flCapDist )
+			{
+				flThresholdRadius = FLT_MAX;
+			}
+		}
+
+		if ( flThresholdRadius < FLT_MAX )
+		{
+			flRadius = min( flRadius, max( flThresholdRadius, 0.0f ) );
+		}
+	}
+
+	if ( flRadius == FLT_MAX )
+		return FLT_MAX;
+
+	return flRadius * LIGHTCULL_RADIUS_SCALE + LIGHTCULL_RADIUS_PAD;
+}
+
+
+//-----------------------------------------------------------------------------
+// Tests that don't depend on distance: spotlights only light inside their cone
+// and surface lights only light in front of their surface.
+//-----------------------------------------------------------------------------
+static bool LightMayReachBoxDirectional( directlight_t *dl, const Vector &mins, const Vector &maxs )
+{
+	if ( dl->light.type == emit_surface )
+	{
+		// the corner of the box farthest in front of the light
+		Vector vecFarthest;
+		for ( int i = 0; i < 3; i++ )
+		{
+			vecFarthest[i] = ( dl->light.normal[i] > 0.0f ) ? maxs[i] : mins[i];
+		}
+		if ( DotProduct( vecFarthest - dl->light.origin, dl->light.normal ) < -LIGHTCULL_RADIUS_PAD )
+			return false;
+	}
+	else if ( dl->light.type == emit_spotlight && dl->light.stopdot2 > 0.0f )
+	{
+		// cone vs. the box's bounding sphere
+		Vector vecCenter = ( mins + maxs ) * 0.5f;
+		float flBoxRadius = ( maxs - vecCenter ).Length() + LIGHTCULL_RADIUS_PAD;
+		Vector vecDelta = vecCenter - dl->light.origin;
+		float flAlong = DotProduct( vecDelta, dl->light.normal );
+		float flAcross = sqrt( max( vecDelta.LengthSqr() - flAlong * flAlong, 0.0f ) );
+		float flCos = dl->light.stopdot2;
+		float flSin = sqrt( max( 1.0f - flCos * flCos, 0.0f ) );
+		if ( flAcross * flCos - flAlong * flSin > flBoxRadius )
+			return false;
+	}
+
+	return true;
+}
+
+
+static inline bool BoxesIntersect( const Vector &mins1, const Vector &maxs1, const Vector &mins2, const Vector &maxs2 )
+{
+	return ( mins1.x <= maxs2.x ) && ( maxs1.x >= mins2.x ) &&
+		   ( mins1.y <= maxs2.y ) && ( maxs1.y >= mins2.y ) &&
+		   ( mins1.z <= maxs2.z ) && ( maxs1.z >= mins2.z );
+}
+
+
+static bool LightMayReachBox( const LightCullEntry_t &entry, const Vector &mins, const Vector &maxs )
+{
+	if ( entry.m_flRadius < FLT_MAX )
+	{
+		float flDist2 = CalcSqrDistanceToAABB( mins, maxs, entry.m_pLight->light.origin );
+		if ( flDist2 > entry.m_flRadius * entry.m_flRadius )
+			return false;
+	}
+
+	return LightMayReachBoxDirectional( entry.m_pLight, mins, maxs );
+}
+
+
+//-----------------------------------------------------------------------------
+// Median split on the longest axis of the light centers.
+//-----------------------------------------------------------------------------
+static int s_nLightCullSortAxis;
+
+static int __cdecl LightCullEntryCompare( const void *pA, const void *pB )
+{
+	const Vector &a = ((const LightCullEntry_t *)pA)->m_pLight->light.origin;
+	const Vector &b = ((const LightCullEntry_t *)pB)->m_pLight->light.origin;
+	if ( a[s_nLightCullSortAxis] < b[s_nLightCullSortAxis] )
+		return -1;
+	if ( a[s_nLightCullSortAxis] > b[s_nLightCullSortAxis] )
+		return 1;
+	return 0;
+}
+
+static void BuildLightCullNode( int iNode, int iFirst, int nCount )
+{
+	Vector vecMins( FLT_MAX, FLT_MAX, FLT_MAX );
+	Vector vecMaxs( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+	Vector vecCenterMins = vecMins;
+	Vector vecCenterMaxs = vecMaxs;
+	for ( int i = iFirst; i < iFirst + nCount; i++ )
+	{
+		const LightCullEntry_t &entry = g_LightCullEntries[i];
+		VectorMin( vecMins, entry.m_Mins, vecMins );
+		VectorMax( vecMaxs, entry.m_Maxs, vecMaxs );
+		VectorMin( vecCenterMins, entry.m_pLight->light.origin, vecCenterMins );
+		VectorMax( vecCenterMaxs, entry.m_pLight->light.origin, vecCenterMaxs );
+	}
+
+	// NOTE: Can't hold a reference into g_LightCullNodes across the recursion, it may grow
+	g_LightCullNodes[iNode].m_Mins = vecMins;
+	g_LightCullNodes[iNode].m_Maxs = vecMaxs;
+
+	if ( nCount <= LIGHTCULL_LEAF_SIZE )
+	{
+		g_LightCullNodes[iNode].m_iChild = -1;
+		g_LightCullNodes[iNode].m_iFirstLight = iFirst;
+		g_LightCullNodes[iNode].m_nLights = nCount;
+		return;
+	}
+
+	Vector vecSize = vecCenterMaxs - vecCenterMins;
+	s_nLightCullSortAxis = ( vecSize.x > vecSize.y ) ? 0 : 1;
+	if ( vecSize.z > vecSize[s_nLightCullSortAxis] )
+	{
+		s_nLightCullSortAxis = 2;
+	}
+	qsort( &g_LightCullEntries[iFirst], nCount, sizeof( LightCullEntry_t ), LightCullEntryCompare );
+
+	int iChild = g_LightCullNodes.AddMultipleToTail( 2 );
+	g_LightCullNodes[iNode].m_iChild = iChild;
+	g_LightCullNodes[iNode].m_iFirstLight = -1;
+	g_LightCullNodes[iNode].m_nLights = 0;
+
+	int nLeft = nCount / 2;
+	BuildLightCullNode( iChild, iFirst, nLeft );
+	BuildLightCullNode( iChild + 1, iFirst + nLeft, nCount - nLeft );
+}
+
+
+void BuildLightCulling()
+{
+	FreeLightCulling();
+
+	int nOrder = 0;
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next, nOrder++ )
+	{
+		LightCullEntry_t entry;
+		entry.m_pLight = dl;
+		entry.m_nOrder = nOrder;
+		entry.m_flRadius = ComputeLightCullRadius( dl );
+		g_LightsByOrder.AddToTail( dl );
+
+		if ( entry.m_flRadius == FLT_MAX )
+		{
+			g_UnboundedLights.AddToTail( entry );
+			continue;
+		}
+
+		Vector vecRadius( entry.m_flRadius, entry.m_flRadius, entry.m_flRadius );
+		entry.m_Mins = dl->light.origin - vecRadius;
+		entry.m_Maxs = dl->light.origin + vecRadius;
+		g_LightCullEntries.AddToTail( entry );
+	}
+
+	if ( g_LightCullEntries.Count() )
+	{
+		g_LightCullNodes.EnsureCapacity( 2 * g_LightCullEntries.Count() );
+		g_LightCullNodes.AddToTail();
+		BuildLightCullNode( 0, 0, g_LightCullEntries.Count() );
+	}
+
+	for ( int i = 0; i <= MAX_TOOL_THREADS; i++ )
+	{
+		g_nLightsTested[i] = 0;
+		g_nLightsKept[i] = 0;
+	}
+
+	qprintf( "Light culling: %d bounded lights, %d unbounded\n", g_LightCullEntries.Count(), g_UnboundedLights.Count() );
+}
+
+
+void FreeLightCulling()
+{
+	g_UnboundedLights.Purge();
+	g_LightCullEntries.Purge();
+	g_LightCullNodes.Purge();
+	g_LightsByOrder.Purge();
+	for ( int i = 0; i <= MAX_TOOL_THREADS; i++ )
+	{
+		g_LightCullOrder[i].Purge();
+		g_LightCullStack[i].Purge();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Lights are gathered by their position in activelights and sorted, so the
+// lighting is summed in the same order as walking the list.
+//-----------------------------------------------------------------------------
+static int __cdecl IntCompare( const int *pA, const int *pB )
+{
+	return *pA - *pB;
+}
+
+void GetLightsReachingBox( const Vector &mins, const Vector &maxs, int iThread, CUtlVector<directlight_t *> &lights )
+{
+	lights.RemoveAll();
+
+	CUtlVector<int> &order = g_LightCullOrder[iThread];
+	order.RemoveAll();
+
+	for ( int i = 0; i < g_UnboundedLights.Count(); i++ )
+	{
+		if ( LightMayReachBoxDirectional( g_UnboundedLights[i].m_pLight, mins, maxs ) )
+		{
+			order.AddToTail( g_UnboundedLights[i].m_nOrder );
+		}
+	}
+
+	if ( g_LightCullNodes.Count() )
+	{
+		CUtlVector<int> &stack = g_LightCullStack[iThread];
+		stack.RemoveAll();
+		stack.AddToTail( 0 );
+		while ( stack.Count() )
+		{
+			const LightCullNode_t &node = g_LightCullNodes[ stack.Tail() ];
+			stack.RemoveMultipleFromTail( 1 );
+
+			if ( !BoxesIntersect( node.m_Mins, node.m_Maxs, mins, maxs ) )
+				continue;
+
+			if ( node.m_iChild >= 0 )
+			{
+				stack.AddToTail( node.m_iChild );
+				stack.AddToTail( node.m_iChild + 1 );
+				continue;
+			}
+
+			for ( int i = node.m_iFirstLight; i < node.m_iFirstLight + node.m_nLights; i++ )
+			{
+				if ( LightMayReachBox( g_LightCullEntries[i], mins, maxs ) )
+				{
+					order.AddToTail( g_LightCullEntries[i].m_nOrder );
+				}
+			}
+		}
+	}
+
+	order.Sort( IntCompare );
+
+	lights.EnsureCapacity( order.Count() );
+	for ( int i = 0; i < order.Count(); i++ )
+	{
+		lights.AddToTail( g_LightsByOrder[ order[i] ] );
+	}
+
+	g_nLightsTested[iThread] += g_UnboundedLights.Count() + g_LightCullEntries.Count();
+	g_nLightsKept[iThread] += lights.Count();
+}
+
+
+void PrintLightCullingStats()
+{
+	int64 nTested = 0;
+	int64 nKept = 0;
+	for ( int i = 0; i <= MAX_TOOL_THREADS; i++ )
+	{
+		nTested += g_nLightsTested[i];
+		nKept += g_nLightsKept[i];
+	}
+
+	if ( nTested == 0 )
+		return;
+
+	Msg( "Light culling: %lld of %lld light/face pairs kept (%.1f%%)\n",
+		(long long)nKept, (long long)nTested, 100.0 * (double)nKept / (double)nTested );
+}
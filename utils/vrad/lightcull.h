@@ -0,0 +1,38 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Culls the direct lights that can't reach a face before its samples
+//			are lit, using a bvh over the lights' spheres of influence.
+//
+//=============================================================================//
+
+#ifndef LIGHTCULL_H
+#define LIGHTCULL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+#include "utlvector.h"
+
+struct directlight_t;
+
+
+// If above zero, lights are also culled where their brightest color channel
+// falls below this (before lightstyles), which changes the lighting slightly.
+// At zero only lights that contribute exactly nothing are culled.
+extern float g_flLightCullThreshold;
+
+// Builds the culling structure over activelights. Call after the direct lights are
+// set up and before BuildFacelights. Rebuild if activelights changes.
+void BuildLightCulling();
+void FreeLightCulling();
+
+// Fills lights with the lights that may reach points in the box, in activelights
+// order so lighting adds up the same as walking the whole list.
+void GetLightsReachingBox( const Vector &mins, const Vector &maxs, int iThread, CUtlVector<directlight_t *> &lights );
+
+// Prints how many light/face pairs the culling removed.
+void PrintLightCullingStats();
+
+
+#endif // LIGHTCULL_H
@@ -22,6 +22,7 @@
 #include "mathlib/quantize.h"
 #include "bitmap/imageformat.h"
 #include "coordsize.h"
+#include "lightcull.h"
 
 enum
 {
@@ -1669,25 +1670,68 @@ void ExportDirectLightsToWorldLights()
 #define NSAMPLES_SUN_AREA_LIGHT 30							// number of samples to take for an
                                                             // non-point sun light
 
+// Helper functions below take 1 or 2 groups of 4 samples. Groups which can't receive any light
+// are marked inactive and skipped, and the visibility rays for the active groups are traced
+// together.
+#define MAX_SAMPLE_GROUPS 2
+
+// traces visibility from each active group of samples to its end points
+static void TestLineGroups( int nGroups, bool const *pActive, FourVectors const *pStart, FourVectors const *pStop,
+							fltx4 *pFractionVisible, int static_prop_index_to_ignore )
+{
+	if ( ( nGroups == 2 ) && pActive[0] && pActive[1] )
+	{
+		TestLine8( pStart, pStop, pFractionVisible, static_prop_index_to_ignore );
+		return;
+	}
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( pActive[g] )
+			TestLine( pStart[g], pStop[g], &pFractionVisible[g], static_prop_index_to_ignore );
+	}
+}
+
+static void TestLineGroups_DoesHitSky( int nGroups, bool const *pActive, FourVectors const *pStart, FourVectors const *pStop,
+									   fltx4 *pFractionVisible, int static_prop_index_to_ignore )
+{
+	if ( ( nGroups == 2 ) && pActive[0] && pActive[1] )
+	{
+		TestLine_DoesHitSky8( pStart, pStop, pFractionVisible, true, static_prop_index_to_ignore );
+		return;
+	}
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( pActive[g] )
+			TestLine_DoesHitSky( pStart[g], pStop[g], &pFractionVisible[g], true, static_prop_index_to_ignore );
+	}
+}
+
 // Helper function - gathers light from sun (emit_skylight)
-void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-							 FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, int facenum, 
+							 FourVectors const *pPos, FourVectors * const *ppNormals, int nGroups, int normalCount, int iThread,
 							 int nLFlags, int static_prop_index_to_ignore,
 							 float flEpsilon )
 {
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
 	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
 
-	fltx4 dot;
+	fltx4 dot[MAX_SAMPLE_GROUPS];
+	bool bActive[MAX_SAMPLE_GROUPS];
+	bool bAnyActive = false;
 
-	if ( bIgnoreNormals )
-		dot = ReplicateX4( CONSTANT_DOT );
-	else
-		dot = NegSIMD( pNormals[0] * dl->light.normal );
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( bIgnoreNormals )
+			dot[g] = ReplicateX4( CONSTANT_DOT );
+		else
+			dot[g] = NegSIMD( ppNormals[g][0] * dl->light.normal );
 
-	dot = MaxSIMD( dot, Four_Zeros );
-	int zeroMask = TestSignSIMD ( CmpEqSIMD( dot, Four_Zeros ) );
-	if (zeroMask == 0xF)
+		dot[g] = MaxSIMD( dot[g], Four_Zeros );
+		int zeroMask = TestSignSIMD ( CmpEqSIMD( dot[g], Four_Zeros ) );
+		bActive[g] = ( zeroMask != 0xF );
+		bAnyActive |= bActive[g];
+	}
+	if ( !bAnyActive )
 		return;
 
 	int nsamples = 1;
@@ -1698,8 +1742,13 @@ void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, i
 			nsamples /= 4;
 	}
 
-	fltx4 totalFractionVisible = Four_Zeros;
-	fltx4 fractionVisible = Four_Zeros;
+	fltx4 totalFractionVisible[MAX_SAMPLE_GROUPS];
+	fltx4 fractionVisible[MAX_SAMPLE_GROUPS];
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		totalFractionVisible[g] = Four_Zeros;
+		fractionVisible[g] = Four_Zeros;
+	}
 
 	DirectionalSampler_t sampler;
 
@@ -1716,34 +1765,45 @@ void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, i
 			ofs *= MAX_TRACE_LENGTH * g_SunAngularExtent;
 			delta += ofs;
 		}
-		FourVectors delta4;
-		delta4.DuplicateVector ( delta );
-		delta4 += pos;
+		FourVectors delta4[MAX_SAMPLE_GROUPS];
+		for ( int g = 0; g < nGroups; g++ )
+		{
+			delta4[g].DuplicateVector ( delta );
+			delta4[g] += pPos[g];
+		}
 
-		TestLine_DoesHitSky ( pos, delta4, &fractionVisible, true, static_prop_index_to_ignore );
+		TestLineGroups_DoesHitSky( nGroups, bActive, pPos, delta4, fractionVisible, static_prop_index_to_ignore );
 
-		totalFractionVisible = AddSIMD ( totalFractionVisible, fractionVisible );
+		for ( int g = 0; g < nGroups; g++ )
+			totalFractionVisible[g] = AddSIMD ( totalFractionVisible[g], fractionVisible[g] );
 	}
 
-	fltx4 seeAmount = MulSIMD ( totalFractionVisible, ReplicateX4 ( 1.0f / nsamples ) );
-	out.m_flDot[0] = MulSIMD ( dot, seeAmount );
-	out.m_flFalloff = Four_Ones;
-	out.m_flSunAmount = MulSIMD ( seeAmount, ReplicateX4( 10000.0f ) );
-	for ( int i = 1; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		if ( bIgnoreNormals )
-			out.m_flDot[i] = ReplicateX4 ( CONSTANT_DOT );
-		else
+		if ( !bActive[g] )
+			continue;
+
+		SSE_sampleLightOutput_t &out = pOut[g];
+		fltx4 seeAmount = MulSIMD ( totalFractionVisible[g], ReplicateX4 ( 1.0f / nsamples ) );
+		out.m_flDot[0] = MulSIMD ( dot[g], seeAmount );
+		out.m_flFalloff = Four_Ones;
+		out.m_flSunAmount = MulSIMD ( seeAmount, ReplicateX4( 10000.0f ) );
+		for ( int i = 1; i < normalCount; i++ )
 		{
-			out.m_flDot[i] = NegSIMD( pNormals[i] * dl->light.normal );
-			out.m_flDot[i] = MulSIMD( out.m_flDot[i], seeAmount );
+			if ( bIgnoreNormals )
+				out.m_flDot[i] = ReplicateX4 ( CONSTANT_DOT );
+			else
+			{
+				out.m_flDot[i] = NegSIMD( ppNormals[g][i] * dl->light.normal );
+				out.m_flDot[i] = MulSIMD( out.m_flDot[i], seeAmount );
+			}
 		}
 	}
 }
 
 // Helper function - gathers light from ambient sky light
-void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-							   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, int facenum, 
+							   FourVectors const *pPos, FourVectors * const *ppNormals, int nGroups, int normalCount, int iThread,
 							   int nLFlags, int static_prop_index_to_ignore,
 							   float flEpsilon )
 {
@@ -1751,15 +1811,19 @@ void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl,
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
 	bool force_fast = ( nLFlags & GATHERLFLAGS_FORCE_FAST ) != 0;
 
-	fltx4 sumdot = Four_Zeros;
-	fltx4 ambient_intensity[NUM_BUMP_VECTS+1];
-	fltx4 possibleHitCount[NUM_BUMP_VECTS+1];
-	fltx4 dots[NUM_BUMP_VECTS+1];
+	fltx4 sumdot[MAX_SAMPLE_GROUPS];
+	fltx4 ambient_intensity[MAX_SAMPLE_GROUPS][NUM_BUMP_VECTS+1];
+	fltx4 possibleHitCount[MAX_SAMPLE_GROUPS][NUM_BUMP_VECTS+1];
+	fltx4 dots[MAX_SAMPLE_GROUPS][NUM_BUMP_VECTS+1];
 
-	for ( int i = 0; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		ambient_intensity[i] = Four_Zeros;
-		possibleHitCount[i] = Four_Zeros;
+		sumdot[g] = Four_Zeros;
+		for ( int i = 0; i < normalCount; i++ )
+		{
+			ambient_intensity[g][i] = Four_Zeros;
+			possibleHitCount[g][i] = Four_Zeros;
+		}
 	}
 
 	DirectionalSampler_t sampler;
@@ -1774,259 +1838,307 @@ void GatherSampleAmbientSkySSE( SSE_sampleLightOutput_t &out, directlight_t *dl,
 		FourVectors anorm;
 		anorm.DuplicateVector( sampler.NextValue() );
 
-		if ( bIgnoreNormals )
-			dots[0] = ReplicateX4( CONSTANT_DOT );
-		else
-			dots[0] = NegSIMD( pNormals[0] * anorm );
-
-		fltx4 validity = CmpGtSIMD( dots[0], ReplicateX4( EQUAL_EPSILON ) );
-
-		// No possibility of anybody getting lit
-		if ( !TestSignSIMD( validity ) )
-			continue;
-
-		dots[0] = AndSIMD( validity, dots[0] );
-		sumdot = AddSIMD( dots[0], sumdot );
-		possibleHitCount[0] = AddSIMD( AndSIMD( validity, Four_Ones ), possibleHitCount[0] );
+		bool bTrace[MAX_SAMPLE_GROUPS];
+		bool bAnyTrace = false;
+		FourVectors delta[MAX_SAMPLE_GROUPS];
+		FourVectors surfacePos[MAX_SAMPLE_GROUPS];
+		fltx4 fractionVisible[MAX_SAMPLE_GROUPS];
 
-		for ( int i = 1; i < normalCount; i++ )
+		for ( int g = 0; g < nGroups; g++ )
 		{
 			if ( bIgnoreNormals )
-				dots[i] = ReplicateX4( CONSTANT_DOT );
+				dots[g][0] = ReplicateX4( CONSTANT_DOT );
 			else
-				dots[i] = NegSIMD( pNormals[i] * anorm );
-			fltx4 validity2 = CmpGtSIMD( dots[i], ReplicateX4 ( EQUAL_EPSILON ) );
-			dots[i] = AndSIMD( validity2, dots[i] );
-			possibleHitCount[i] = AddSIMD( AndSIMD( AndSIMD( validity, validity2 ), Four_Ones ), possibleHitCount[i] );
+				dots[g][0] = NegSIMD( ppNormals[g][0] * anorm );
+
+			fltx4 validity = CmpGtSIMD( dots[g][0], ReplicateX4( EQUAL_EPSILON ) );
+
+			// No possibility of anybody in this group getting lit
+			bTrace[g] = ( TestSignSIMD( validity ) != 0 );
+			if ( !bTrace[g] )
+				continue;
+			bAnyTrace = true;
+
+			dots[g][0] = AndSIMD( validity, dots[g][0] );
+			sumdot[g] = AddSIMD( dots[g][0], sumdot[g] );
+			possibleHitCount[g][0] = AddSIMD( AndSIMD( validity, Four_Ones ), possibleHitCount[g][0] );
+
+			for ( int i = 1; i < normalCount; i++ )
+			{
+				if ( bIgnoreNormals )
+					dots[g][i] = ReplicateX4( CONSTANT_DOT );
+				else
+					dots[g][i] = NegSIMD( ppNormals[g][i] * anorm );
+				fltx4 validity2 = CmpGtSIMD( dots[g][i], ReplicateX4 ( EQUAL_EPSILON ) );
+				dots[g][i] = AndSIMD( validity2, dots[g][i] );
+				possibleHitCount[g][i] = AddSIMD( AndSIMD( AndSIMD( validity, validity2 ), Four_Ones ), possibleHitCount[g][i] );
+			}
+
+			// search back to see if we can hit a sky brush
+			delta[g] = anorm;
+			delta[g] *= -MAX_TRACE_LENGTH;
+			delta[g] += pPos[g];
+			surfacePos[g] = pPos[g];
+			FourVectors offset = anorm;
+			offset *= -flEpsilon;
+			surfacePos[g] -= offset;
+
+			fractionVisible[g] = Four_Ones;
 		}
 
-		// search back to see if we can hit a sky brush
-		FourVectors delta = anorm;
-		delta *= -MAX_TRACE_LENGTH;
-		delta += pos;
-		FourVectors surfacePos = pos;
-		FourVectors offset = anorm;
-		offset *= -flEpsilon;
-		surfacePos -= offset;
-
-		fltx4 fractionVisible = Four_Ones;
-		TestLine_DoesHitSky( surfacePos, delta, &fractionVisible, true, static_prop_index_to_ignore );
-		for ( int i = 0; i < normalCount; i++ )
+		if ( !bAnyTrace )
+			continue;
+
+		TestLineGroups_DoesHitSky( nGroups, bTrace, surfacePos, delta, fractionVisible, static_prop_index_to_ignore );
+
+		for ( int g = 0; g < nGroups; g++ )
 		{
-			fltx4 addedAmount = MulSIMD( fractionVisible, dots[i] );
-			ambient_intensity[i] = AddSIMD( ambient_intensity[i], addedAmount );
+			if ( !bTrace[g] )
+				continue;
+			for ( int i = 0; i < normalCount; i++ )
+			{
+				fltx4 addedAmount = MulSIMD( fractionVisible[g], dots[g][i] );
+				ambient_intensity[g][i] = AddSIMD( ambient_intensity[g][i], addedAmount );
+			}
 		}
-
 	}
 
-	out.m_flFalloff = Four_Ones;
-	for ( int i = 0; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		// now scale out the missing parts of the hemisphere of this bump basis vector
-		fltx4 factor = ReciprocalSIMD( possibleHitCount[0] );
-		factor = MulSIMD( factor, possibleHitCount[i] );
-		out.m_flDot[i] = MulSIMD( factor, sumdot );
-		out.m_flDot[i] = ReciprocalSIMD( out.m_flDot[i] );
-		out.m_flDot[i] = MulSIMD( ambient_intensity[i], out.m_flDot[i] );
+		SSE_sampleLightOutput_t &out = pOut[g];
+		out.m_flFalloff = Four_Ones;
+		for ( int i = 0; i < normalCount; i++ )
+		{
+			// now scale out the missing parts of the hemisphere of this bump basis vector
+			fltx4 factor = ReciprocalSIMD( possibleHitCount[g][0] );
+			factor = MulSIMD( factor, possibleHitCount[g][i] );
+			out.m_flDot[i] = MulSIMD( factor, sumdot[g] );
+			out.m_flDot[i] = ReciprocalSIMD( out.m_flDot[i] );
+			out.m_flDot[i] = MulSIMD( ambient_intensity[g][i], out.m_flDot[i] );
+		}
 	}
 
 }
 
 // Helper function - gathers light from area lights, spot lights, and point lights
-void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-								  FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+void GatherSampleStandardLightSSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, int facenum, 
+								  FourVectors const *pPos, FourVectors * const *ppNormals, int nGroups, int normalCount, int iThread,
 								  int nLFlags, int static_prop_index_to_ignore,
 								  float flEpsilon )
 {
 	bool bIgnoreNormals = ( nLFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
+	bool bHasHardFalloff = ( dl->m_flEndFadeDistance > dl->m_flStartFadeDistance );
 
-	FourVectors src;
-	src.DuplicateVector( vec3_origin );
+	FourVectors src[MAX_SAMPLE_GROUPS];
+	FourVectors delta[MAX_SAMPLE_GROUPS];
+	fltx4 dot[MAX_SAMPLE_GROUPS];
+	bool bActive[MAX_SAMPLE_GROUPS];
+	bool bAnyActive = false;
 
-	if (dl->facenum == -1)
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		src.DuplicateVector( dl->light.origin );
-	}
+		SSE_sampleLightOutput_t &out = pOut[g];
+		bActive[g] = false;
 
-	// Find light vector
-	FourVectors delta;
-	delta = src;
-	delta -= pos;
-	fltx4 dist2 = delta.length2();
-	fltx4 rpcDist = ReciprocalSqrtSIMD( dist2 );
-	delta *= rpcDist;
-	fltx4 dist = SqrtEstSIMD( dist2 );//delta.VectorNormalize();
+		src[g].DuplicateVector( vec3_origin );
 
-	// Compute dot
-	fltx4 dot = ReplicateX4( (float) CONSTANT_DOT );
-	if ( !bIgnoreNormals )
-		dot = delta * pNormals[0];
-	dot = MaxSIMD( Four_Zeros, dot );
+		if (dl->facenum == -1)
+		{
+			src[g].DuplicateVector( dl->light.origin );
+		}
 
-	// Affix dot to zero if past fade distz
-	bool bHasHardFalloff = ( dl->m_flEndFadeDistance > dl->m_flStartFadeDistance );
-	if ( bHasHardFalloff )
-	{
-		fltx4 notPastFadeDist = CmpLeSIMD ( dist, ReplicateX4 ( dl->m_flEndFadeDistance ) );
-		dot = AndSIMD( dot, notPastFadeDist );  // dot = 0 if past fade distance
-		if ( !TestSignSIMD ( notPastFadeDist ) )
-			return;
-	}
+		// Find light vector
+		delta[g] = src[g];
+		delta[g] -= pPos[g];
+		fltx4 dist2 = delta[g].length2();
+		fltx4 rpcDist = ReciprocalSqrtSIMD( dist2 );
+		delta[g] *= rpcDist;
+		fltx4 dist = SqrtEstSIMD( dist2 );//delta.VectorNormalize();
 
-	dist = MaxSIMD( dist, Four_Ones );
-	fltx4 falloffEvalDist = MinSIMD( dist, ReplicateX4( dl->m_flCapDist ) );
+		// Compute dot
+		dot[g] = ReplicateX4( (float) CONSTANT_DOT );
+		if ( !bIgnoreNormals )
+			dot[g] = delta[g] * ppNormals[g][0];
+		dot[g] = MaxSIMD( Four_Zeros, dot[g] );
 
-	fltx4 constant, linear, quadratic;
-	fltx4 dot2, inCone, inFringe, mult;
-	FourVectors offset;
+		// Affix dot to zero if past fade distz
+		if ( bHasHardFalloff )
+		{
+			fltx4 notPastFadeDist = CmpLeSIMD ( dist, ReplicateX4 ( dl->m_flEndFadeDistance ) );
+			dot[g] = AndSIMD( dot[g], notPastFadeDist );  // dot = 0 if past fade distance
+			if ( !TestSignSIMD ( notPastFadeDist ) )
+				continue;
+		}
 
-	switch (dl->light.type)
-	{
-	case emit_point:
-		constant  = ReplicateX4( dl->light.constant_attn );
-		linear    = ReplicateX4( dl->light.linear_attn );
-		quadratic = ReplicateX4( dl->light.quadratic_attn );
-
-		out.m_flFalloff = MulSIMD( falloffEvalDist, falloffEvalDist );
-		out.m_flFalloff = MulSIMD( out.m_flFalloff, quadratic );
-		out.m_flFalloff = AddSIMD( out.m_flFalloff, MulSIMD( linear, falloffEvalDist ) );
-		out.m_flFalloff = AddSIMD( out.m_flFalloff, constant );
-		out.m_flFalloff = ReciprocalSIMD( out.m_flFalloff );
-		break;
+		dist = MaxSIMD( dist, Four_Ones );
+		fltx4 falloffEvalDist = MinSIMD( dist, ReplicateX4( dl->m_flCapDist ) );
 
-	case emit_surface:
-		dot2 = delta * dl->light.normal;
-		dot2 = NegSIMD( dot2 );
+		fltx4 constant, linear, quadratic;
+		fltx4 dot2, inCone, inFringe, mult;
+		FourVectors offset;
 
-		// Light behind surface yields zero dot
-		dot2 = MaxSIMD( Four_Zeros, dot2 );
-		if ( TestSignSIMD( CmpEqSIMD( Four_Zeros, dot ) ) == 0xF )
-			return;
+		switch (dl->light.type)
+		{
+		case emit_point:
+			constant  = ReplicateX4( dl->light.constant_attn );
+			linear    = ReplicateX4( dl->light.linear_attn );
+			quadratic = ReplicateX4( dl->light.quadratic_attn );
 
-		out.m_flFalloff = ReciprocalSIMD ( dist2 );
-		out.m_flFalloff = MulSIMD( out.m_flFalloff, dot2 );
+			out.m_flFalloff = MulSIMD( falloffEvalDist, falloffEvalDist );
+			out.m_flFalloff = MulSIMD( out.m_flFalloff, quadratic );
+			out.m_flFalloff = AddSIMD( out.m_flFalloff, MulSIMD( linear, falloffEvalDist ) );
+			out.m_flFalloff = AddSIMD( out.m_flFalloff, constant );
+			out.m_flFalloff = ReciprocalSIMD( out.m_flFalloff );
+			break;
 
-		// move the endpoint away from the surface by epsilon to prevent hitting the surface with the trace
-		offset.DuplicateVector ( dl->light.normal );
-		offset *= DIST_EPSILON;
-		src += offset;
-		break;
+		case emit_surface:
+			dot2 = delta[g] * dl->light.normal;
+			dot2 = NegSIMD( dot2 );
 
-	case emit_spotlight:
-		dot2 = delta * dl->light.normal;
-		dot2 = NegSIMD( dot2 );
+			// Light behind surface yields zero dot
+			dot2 = MaxSIMD( Four_Zeros, dot2 );
+			if ( TestSignSIMD( CmpEqSIMD( Four_Zeros, dot[g] ) ) == 0xF )
+				continue;
 
-		// Affix dot2 to zero if outside light cone
-		inCone = CmpGtSIMD( dot2, ReplicateX4( dl->light.stopdot2 ) );
-		if ( !TestSignSIMD ( inCone ) )
-			return;
-		dot = AndSIMD( inCone, dot );
-
-		constant  = ReplicateX4( dl->light.constant_attn );
-		linear    = ReplicateX4( dl->light.linear_attn );
-		quadratic = ReplicateX4( dl->light.quadratic_attn );
-
-		out.m_flFalloff = MulSIMD( falloffEvalDist, falloffEvalDist );
-		out.m_flFalloff = MulSIMD( out.m_flFalloff, quadratic );
-		out.m_flFalloff = AddSIMD( out.m_flFalloff, MulSIMD( linear, falloffEvalDist ) );
-		out.m_flFalloff = AddSIMD( out.m_flFalloff, constant );
-		out.m_flFalloff = ReciprocalSIMD( out.m_flFalloff );
-		out.m_flFalloff = MulSIMD( out.m_flFalloff, dot2 );
-
-		// outside the inner cone
-		inFringe = CmpLeSIMD( dot2, ReplicateX4( dl->light.stopdot ) );
-		mult = ReplicateX4( dl->light.stopdot - dl->light.stopdot2 );
-		mult = ReciprocalSIMD( mult );
-		mult = MulSIMD( mult, SubSIMD( dot2, ReplicateX4( dl->light.stopdot2 ) ) );
-		mult = MinSIMD( mult, Four_Ones );
-		mult = MaxSIMD( mult, Four_Zeros );
-
-		// pow is fixed point, so this isn't the most accurate, but it doesn't need to be
-		if ( (dl->light.exponent != 0.0f ) && ( dl->light.exponent != 1.0f ) )
-			mult = PowSIMD( mult, dl->light.exponent );
-
-		// if not in between inner and outer cones, mult by 1
-		mult = AndSIMD( inFringe, mult );
-		mult = AddSIMD( mult, AndNotSIMD( inFringe, Four_Ones ) );
-		out.m_flFalloff = MulSIMD( mult, out.m_flFalloff );
-		break;
+			out.m_flFalloff = ReciprocalSIMD ( dist2 );
+			out.m_flFalloff = MulSIMD( out.m_flFalloff, dot2 );
 
-	}
+			// move the endpoint away from the surface by epsilon to prevent hitting the surface with the trace
+			offset.DuplicateVector ( dl->light.normal );
+			offset *= DIST_EPSILON;
+			src[g] += offset;
+			break;
 
-	// we may be in the fade region - modulate lighting by the fade curve
-	//float t = ( dist - dl->m_flStartFadeDistance ) / 
-	//	( dl->m_flEndFadeDistance - dl->m_flStartFadeDistance );
-	if ( bHasHardFalloff )
-	{
-		fltx4 t = ReplicateX4( dl->m_flEndFadeDistance - dl->m_flStartFadeDistance );
-		t = ReciprocalSIMD( t );
-		t = MulSIMD( t, SubSIMD( dist, ReplicateX4( dl->m_flStartFadeDistance ) ) );
+		case emit_spotlight:
+			dot2 = delta[g] * dl->light.normal;
+			dot2 = NegSIMD( dot2 );
 
-		// clamp t to [0...1]
-		t = MinSIMD( t, Four_Ones );
-		t = MaxSIMD( t, Four_Zeros );
-		t = SubSIMD( Four_Ones, t );
+			// Affix dot2 to zero if outside light cone
+			inCone = CmpGtSIMD( dot2, ReplicateX4( dl->light.stopdot2 ) );
+			if ( !TestSignSIMD ( inCone ) )
+				continue;
+			dot[g] = AndSIMD( inCone, dot[g] );
+
+			constant  = ReplicateX4( dl->light.constant_attn );
+			linear    = ReplicateX4( dl->light.linear_attn );
+			quadratic = ReplicateX4( dl->light.quadratic_attn );
+
+			out.m_flFalloff = MulSIMD( falloffEvalDist, falloffEvalDist );
+			out.m_flFalloff = MulSIMD( out.m_flFalloff, quadratic );
+			out.m_flFalloff = AddSIMD( out.m_flFalloff, MulSIMD( linear, falloffEvalDist ) );
+			out.m_flFalloff = AddSIMD( out.m_flFalloff, constant );
+			out.m_flFalloff = ReciprocalSIMD( out.m_flFalloff );
+			out.m_flFalloff = MulSIMD( out.m_flFalloff, dot2 );
+
+			// outside the inner cone
+			inFringe = CmpLeSIMD( dot2, ReplicateX4( dl->light.stopdot ) );
+			mult = ReplicateX4( dl->light.stopdot - dl->light.stopdot2 );
+			mult = ReciprocalSIMD( mult );
+			mult = MulSIMD( mult, SubSIMD( dot2, ReplicateX4( dl->light.stopdot2 ) ) );
+			mult = MinSIMD( mult, Four_Ones );
+			mult = MaxSIMD( mult, Four_Zeros );
+
+			// pow is fixed point, so this isn't the most accurate, but it doesn't need to be
+			if ( (dl->light.exponent != 0.0f ) && ( dl->light.exponent != 1.0f ) )
+				mult = PowSIMD( mult, dl->light.exponent );
+
+			// if not in between inner and outer cones, mult by 1
+			mult = AndSIMD( inFringe, mult );
+			mult = AddSIMD( mult, AndNotSIMD( inFringe, Four_Ones ) );
+			out.m_flFalloff = MulSIMD( mult, out.m_flFalloff );
+			break;
+
+		}
+
+		// we may be in the fade region - modulate lighting by the fade curve
+		//float t = ( dist - dl->m_flStartFadeDistance ) / 
+		//	( dl->m_flEndFadeDistance - dl->m_flStartFadeDistance );
+		if ( bHasHardFalloff )
+		{
+			fltx4 t = ReplicateX4( dl->m_flEndFadeDistance - dl->m_flStartFadeDistance );
+			t = ReciprocalSIMD( t );
+			t = MulSIMD( t, SubSIMD( dist, ReplicateX4( dl->m_flStartFadeDistance ) ) );
 
-		// Using QuinticInterpolatingPolynomial, SSE-ified
-		// t * t * t *( t * ( t* 6.0 - 15.0 ) + 10.0 )
-		mult = SubSIMD( MulSIMD( ReplicateX4( 6.0f ), t ), ReplicateX4( 15.0f ) );
-		mult = AddSIMD( MulSIMD( mult, t ), ReplicateX4( 10.0f ) );
-		mult = MulSIMD( MulSIMD( t, t), mult );
-		mult = MulSIMD( t, mult );
-		out.m_flFalloff = MulSIMD( mult, out.m_flFalloff );
+			// clamp t to [0...1]
+			t = MinSIMD( t, Four_Ones );
+			t = MaxSIMD( t, Four_Zeros );
+			t = SubSIMD( Four_Ones, t );
+
+			// Using QuinticInterpolatingPolynomial, SSE-ified
+			// t * t * t *( t * ( t* 6.0 - 15.0 ) + 10.0 )
+			mult = SubSIMD( MulSIMD( ReplicateX4( 6.0f ), t ), ReplicateX4( 15.0f ) );
+			mult = AddSIMD( MulSIMD( mult, t ), ReplicateX4( 10.0f ) );
+			mult = MulSIMD( MulSIMD( t, t), mult );
+			mult = MulSIMD( t, mult );
+			out.m_flFalloff = MulSIMD( mult, out.m_flFalloff );
+		}
+
+		bActive[g] = true;
+		bAnyActive = true;
 	}
 
+	if ( !bAnyActive )
+		return;
+
 	// Raytrace for visibility function
-	fltx4 fractionVisible = Four_Ones;
-	TestLine( pos, src, &fractionVisible, static_prop_index_to_ignore);
-	dot = MulSIMD( fractionVisible, dot );
-	out.m_flDot[0] = dot;
+	fltx4 fractionVisible[MAX_SAMPLE_GROUPS];
+	for ( int g = 0; g < nGroups; g++ )
+		fractionVisible[g] = Four_Ones;
+	TestLineGroups( nGroups, bActive, pPos, src, fractionVisible, static_prop_index_to_ignore );
 
-	for ( int i = 1; i < normalCount; i++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		if ( bIgnoreNormals )
-			out.m_flDot[i] = ReplicateX4( (float) CONSTANT_DOT );
-		else
+		if ( !bActive[g] )
+			continue;
+
+		SSE_sampleLightOutput_t &out = pOut[g];
+		dot[g] = MulSIMD( fractionVisible[g], dot[g] );
+		out.m_flDot[0] = dot[g];
+
+		for ( int i = 1; i < normalCount; i++ )
 		{
-			out.m_flDot[i] = pNormals[i] * delta;
-			out.m_flDot[i] = MaxSIMD( Four_Zeros, out.m_flDot[i] );
+			if ( bIgnoreNormals )
+				out.m_flDot[i] = ReplicateX4( (float) CONSTANT_DOT );
+			else
+			{
+				out.m_flDot[i] = ppNormals[g][i] * delta[g];
+				out.m_flDot[i] = MaxSIMD( Four_Zeros, out.m_flDot[i] );
+			}
 		}
 	}
 }
 
-// returns dot product with normal and delta
-// dl - light
-// pos - position of sample
-// normal - surface normal of sample
-// out.m_flDot[] - returned dot products with light vector and each normal
-// out.m_flFalloff - amount of light falloff
-void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
-					   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
-					   int nLFlags,
-					   int static_prop_index_to_ignore,
-					   float flEpsilon )
+static void GatherSampleLightGroupsSSE( SSE_sampleLightOutput_t *pOut, directlight_t *dl, int facenum, 
+									   FourVectors const *pPos, FourVectors * const *ppNormals, int nGroups, int normalCount, int iThread,
+									   int nLFlags,
+									   int static_prop_index_to_ignore,
+									   float flEpsilon )
 {
-	for ( int b = 0; b < normalCount; b++ )
-		out.m_flDot[b] = Four_Zeros;
-	out.m_flFalloff = Four_Zeros;
-	out.m_flSunAmount = Four_Zeros;
+	Assert( nGroups <= MAX_SAMPLE_GROUPS );
 	Assert( normalCount <= (NUM_BUMP_VECTS+1) );
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		for ( int b = 0; b < normalCount; b++ )
+			pOut[g].m_flDot[b] = Four_Zeros;
+		pOut[g].m_flFalloff = Four_Zeros;
+		pOut[g].m_flSunAmount = Four_Zeros;
+	}
 
 	// skylights work fundamentally differently than normal lights
 	switch( dl->light.type )
 	{
 	case emit_skylight:
-		GatherSampleSkyLightSSE( out, dl, facenum, pos, pNormals, normalCount,
+		GatherSampleSkyLightSSE( pOut, dl, facenum, pPos, ppNormals, nGroups, normalCount,
 		                         iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	case emit_skyambient:
-		GatherSampleAmbientSkySSE( out, dl, facenum, pos, pNormals, normalCount,
+		GatherSampleAmbientSkySSE( pOut, dl, facenum, pPos, ppNormals, nGroups, normalCount,
 		                           iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	case emit_point:
 	case emit_surface:
 	case emit_spotlight:
-		GatherSampleStandardLightSSE( out, dl, facenum, pos, pNormals, normalCount,
+		GatherSampleStandardLightSSE( pOut, dl, facenum, pPos, ppNormals, nGroups, normalCount,
 		                              iThread, nLFlags, static_prop_index_to_ignore, flEpsilon );
 		break;
 	default:
@@ -2038,14 +2150,43 @@ void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int
 	// (tested by checking the dot product of the face normal and the light position)
 	// we don't want it to contribute to *any* of the bumped lightmaps. It glows
 	// in disturbing ways if we don't do this.
-	out.m_flDot[0] = MaxSIMD ( out.m_flDot[0], Four_Zeros );
-	fltx4 notZero = CmpGtSIMD( out.m_flDot[0], Four_Zeros );
-	for ( int n = 1; n < normalCount; n++ )
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		out.m_flDot[n] = MaxSIMD( out.m_flDot[n], Four_Zeros );
-		out.m_flDot[n] = AndSIMD( out.m_flDot[n], notZero );
+		SSE_sampleLightOutput_t &out = pOut[g];
+		out.m_flDot[0] = MaxSIMD ( out.m_flDot[0], Four_Zeros );
+		fltx4 notZero = CmpGtSIMD( out.m_flDot[0], Four_Zeros );
+		for ( int n = 1; n < normalCount; n++ )
+		{
+			out.m_flDot[n] = MaxSIMD( out.m_flDot[n], Four_Zeros );
+			out.m_flDot[n] = AndSIMD( out.m_flDot[n], notZero );
+		}
 	}
+}
 
+// returns dot product with normal and delta
+// dl - light
+// pos - position of sample
+// normal - surface normal of sample
+// out.m_flDot[] - returned dot products with light vector and each normal
+// out.m_flFalloff - amount of light falloff
+void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
+					   FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
+					   int nLFlags,
+					   int static_prop_index_to_ignore,
+					   float flEpsilon )
+{
+	GatherSampleLightGroupsSSE( &out, dl, facenum, &pos, &pNormals, 1, normalCount, iThread,
+								nLFlags, static_prop_index_to_ignore, flEpsilon );
+}
+
+void GatherSampleLight8SSE( SSE_sampleLightOutput_t out[2], directlight_t *dl, int facenum, 
+						FourVectors const pos[2], FourVectors *pNormals[2], int normalCount, int iThread,
+						int nLFlags,
+						int static_prop_index_to_ignore,
+						float flEpsilon )
+{
+	GatherSampleLightGroupsSSE( out, dl, facenum, pos, pNormals, 2, normalCount, iThread,
+								nLFlags, static_prop_index_to_ignore, flEpsilon );
 }
 
 /*
@@ -2486,82 +2627,171 @@ static void ComputeIlluminationPointAndNormalsSSE( lightinfo_t const& l, FourVec
 }
 
 //-----------------------------------------------------------------------------
-// Iterates over all lights and computes lighting at up to 4 sample points
+// Finds which of up to 4 sample points are in clusters a light can see. Returns
+// false if the light can't see any of them.
 //-----------------------------------------------------------------------------
-static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, int numSamples )
+static bool ComputeLightPVSMask( SSE_SampleInfo_t const& info, directlight_t *dl, int numSamples, fltx4 &dotMask )
 {
-	SSE_sampleLightOutput_t out;
+	dotMask = Four_Zeros;
+	bool bVisible = false;
+	for( int s = 0; s < numSamples; s++ )
+	{
+		if( PVSCheck( dl->pvs, info.m_Clusters[s] ) )
+		{
+			dotMask = SetComponentSIMD( dotMask, s, 1.0f );
+			bVisible = true;
+		}
+	}
+	return bVisible;
+}
 
-	// Iterate over all direct lights and add them to the particular sample
-	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
-	{	    
-		// is this lights cluster visible?
-		fltx4 dotMask = Four_Zeros;
-		bool skipLight = true;
-		for( int s = 0; s < numSamples; s++ )
+//-----------------------------------------------------------------------------
+// Adds the light gathered from one light to up to 4 sample points
+//-----------------------------------------------------------------------------
+static void AddLightToSamples( SSE_SampleInfo_t& info, directlight_t *dl, SSE_sampleLightOutput_t const& out,
+							   fltx4 dotMask, int sampleIdx, int numSamples )
+{
+	// Apply the PVS check filter and compute falloff x dot
+	fltx4 fxdot[NUM_BUMP_VECTS + 1];
+	bool skipLight = true;
+	for ( int b = 0; b < info.m_NormalCount; b++ )
+	{
+		fxdot[b] = MulSIMD( out.m_flDot[b], dotMask );
+		fxdot[b] = MulSIMD( fxdot[b], out.m_flFalloff );
+		if ( !IsAllZeros( fxdot[b] ) )
 		{
-			if( PVSCheck( dl->pvs, info.m_Clusters[s] ) )
-			{
-				dotMask = SetComponentSIMD( dotMask, s, 1.0f );
-				skipLight = false;
-			}
+			skipLight = false;
 		}
-		if ( skipLight )
-			continue;
+	}
+	if ( skipLight )
+		return;
 
-		GatherSampleLightSSE( out, dl, info.m_FaceNum, info.m_Points, info.m_PointNormals, info.m_NormalCount, info.m_iThread );
-		
-		// Apply the PVS check filter and compute falloff x dot
-		fltx4 fxdot[NUM_BUMP_VECTS + 1];
-		skipLight = true;
-		for ( int b = 0; b < info.m_NormalCount; b++ )
+	// Figure out the lightstyle for this particular sample
+	int lightStyleIndex = FindOrAllocateLightstyleSamples( info.m_pFace, info.m_pFaceLight, 
+		dl->light.style, info.m_NormalCount );
+	if (lightStyleIndex < 0)
+	{
+		if (info.m_WarnFace != info.m_FaceNum)
 		{
-			fxdot[b] = MulSIMD( out.m_flDot[b], dotMask );
-			fxdot[b] = MulSIMD( fxdot[b], out.m_flFalloff );
-			if ( !IsAllZeros( fxdot[b] ) )
-			{
-				skipLight = false;
-			}
+			Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
+				info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
+			info.m_WarnFace = info.m_FaceNum;
 		}
-		if ( skipLight )
-			continue;
+		return;
+	}
+
+	// pLightmaps is an array of the lightmaps for each normal direction,
+	// here's where the result of the sample gathering goes
+	LightingValue_t** pLightmaps = info.m_pFaceLight->light[lightStyleIndex];
 
-		// Figure out the lightstyle for this particular sample
-		int lightStyleIndex = FindOrAllocateLightstyleSamples( info.m_pFace, info.m_pFaceLight, 
-			dl->light.style, info.m_NormalCount );
-		if (lightStyleIndex < 0)
+	// Incremental lighting only cares about lightstyle zero
+	if( g_pIncremental && (dl->light.style == 0) )
+	{
+		for ( int i = 0; i < numSamples; i++ )
 		{
-			if (info.m_WarnFace != info.m_FaceNum)
-			{
-				Warning ("\nWARNING: Too many light styles on a face at (%f, %f, %f)\n",
-					info.m_Points.x.m128_f32[0], info.m_Points.y.m128_f32[0], info.m_Points.z.m128_f32[0] );
-				info.m_WarnFace = info.m_FaceNum;
-			}
-			continue;
+			g_pIncremental->AddLightToFace( dl->m_IncrementalID, info.m_FaceNum, sampleIdx + i, 
+				info.m_LightmapSize, SubFloat( fxdot[0], i ), info.m_iThread );
+		}
+	}
+
+	for( int n = 0; n < info.m_NormalCount; ++n )
+	{
+		for ( int i = 0; i < numSamples; i++ )
+		{
+			pLightmaps[n][sampleIdx + i].AddLight( SubFloat( fxdot[n], i ), dl->light.intensity, SubFloat( out.m_flSunAmount, i ) );
 		}
+	}
+}
 
-		// pLightmaps is an array of the lightmaps for each normal direction,
-		// here's where the result of the sample gathering goes
-		LightingValue_t** pLightmaps = info.m_pFaceLight->light[lightStyleIndex];
+//-----------------------------------------------------------------------------
+// Iterates over the face's lights and computes lighting at up to 4 sample points
+//-----------------------------------------------------------------------------
+static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, int numSamples )
+{
+	SSE_sampleLightOutput_t out;
 
-		// Incremental lighting only cares about lightstyle zero
-		if( g_pIncremental && (dl->light.style == 0) )
+	// Iterate over the lights that reach this face and add them to the particular sample
+	for ( int iLight = 0; iLight < info.m_nLights; iLight++ )
+	{
+		directlight_t *dl = info.m_ppLights[iLight];
+
+		// is this lights cluster visible?
+		fltx4 dotMask;
+		if ( !ComputeLightPVSMask( info, dl, numSamples, dotMask ) )
+			continue;
+
+		GatherSampleLightSSE( out, dl, info.m_FaceNum, info.m_Points, info.m_PointNormals, info.m_NormalCount, info.m_iThread );
+		AddLightToSamples( info, dl, out, dotMask, sampleIdx, numSamples );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Same as calling GatherSampleLightAt4Points on two consecutive groups of samples,
+// but each light is gathered for both groups at once so that the visibility rays
+// are traced 8 at a time. The second group's light is added after the first's so
+// lightstyles get allocated in the same order.
+//-----------------------------------------------------------------------------
+struct DeferredSampleLight_t
+{
+	SSE_sampleLightOutput_t m_Out;
+	fltx4 m_DotMask;
+	directlight_t *m_pLight;
+};
+
+// Per thread so the lights can be held back without allocating for every pair of groups
+static CUtlVector< DeferredSampleLight_t, CUtlMemoryAligned< DeferredSampleLight_t, 16 > > s_DeferredLights[MAX_TOOL_THREADS+1];
+
+static void GatherSampleLightAt8Points( SSE_SampleInfo_t info[2], int sampleIdx, int numSamples[2] )
+{
+	SSE_sampleLightOutput_t out[2];
+	FourVectors points[2] = { info[0].m_Points, info[1].m_Points };
+	FourVectors *pNormals[2] = { info[0].m_PointNormals, info[1].m_PointNormals };
+	CUtlVector< DeferredSampleLight_t, CUtlMemoryAligned< DeferredSampleLight_t, 16 > > &deferred = s_DeferredLights[info[0].m_iThread];
+	deferred.RemoveAll();
+
+	// both groups come from the same face, so they share its light list
+	for ( int iLight = 0; iLight < info[0].m_nLights; iLight++ )
+	{
+		directlight_t *dl = info[0].m_ppLights[iLight];
+
+		// is this lights cluster visible?
+		fltx4 dotMask[2];
+		bool bVisible[2];
+		for ( int g = 0; g < 2; g++ )
+			bVisible[g] = ComputeLightPVSMask( info[g], dl, numSamples[g], dotMask[g] );
+
+		if ( bVisible[0] && bVisible[1] )
 		{
-			for ( int i = 0; i < numSamples; i++ )
+			GatherSampleLight8SSE( out, dl, info[0].m_FaceNum, points, pNormals, info[0].m_NormalCount, info[0].m_iThread );
+		}
+		else
+		{
+			for ( int g = 0; g < 2; g++ )
 			{
-				g_pIncremental->AddLightToFace( dl->m_IncrementalID, info.m_FaceNum, sampleIdx + i, 
-					info.m_LightmapSize, SubFloat( fxdot[0], i ), info.m_iThread );
+				if ( bVisible[g] )
+					GatherSampleLightSSE( out[g], dl, info[g].m_FaceNum, info[g].m_Points, info[g].m_PointNormals, info[g].m_NormalCount, info[g].m_iThread );
 			}
 		}
 
-		for( int n = 0; n < info.m_NormalCount; ++n )
+		if ( bVisible[0] )
+			AddLightToSamples( info[0], dl, out[0], dotMask[0], sampleIdx, numSamples[0] );
+
+		if ( bVisible[1] )
 		{
-			for ( int i = 0; i < numSamples; i++ )
-			{
-				pLightmaps[n][sampleIdx + i].AddLight( SubFloat( fxdot[n], i ), dl->light.intensity, SubFloat( out.m_flSunAmount, i ) );
-			}
+			DeferredSampleLight_t &light = deferred[ deferred.AddToTail() ];
+			light.m_Out = out[1];
+			light.m_DotMask = dotMask[1];
+			light.m_pLight = dl;
 		}
 	}
+
+	info[1].m_WarnFace = info[0].m_WarnFace;
+	for ( int i = 0; i < deferred.Count(); i++ )
+	{
+		AddLightToSamples( info[1], deferred[i].m_pLight, deferred[i].m_Out, deferred[i].m_DotMask,
+						   sampleIdx + 4, numSamples[1] );
+	}
+	info[0].m_WarnFace = info[1].m_WarnFace;
 }
 
 
@@ -2582,9 +2812,10 @@ static void ResampleLightAt4Points( SSE_SampleInfo_t& info, int lightStyleIndex,
 		}
 	}
 
-	// Iterate over all direct lights and add them to the particular sample
-	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
+	// Iterate over the lights that reach this face and add them to the particular sample
+	for ( int iLight = 0; iLight < info.m_nLights; iLight++ )
 	{
+		directlight_t *dl = info.m_ppLights[iLight];
 		if ((flags & AMBIENT_ONLY) && (dl->light.type != emit_skyambient))
 			continue;
 
@@ -2678,10 +2909,46 @@ bool PointsInWinding ( FourVectors const & point, winding_t *w, int &invalidBits
 }
 
 //-----------------------------------------------------------------------------
-// Perform supersampling at a particular point
+// The 4x4 grid of direct light supersamples, in the order they're taken. Each
+// group of 4 puts one sample in every quadrant of the luxel, so whatever number
+// of groups gets taken still covers the whole luxel evenly.
+//-----------------------------------------------------------------------------
+#define MIN_SUPERSAMPLE_GROUPS	2
+
+static const int s_SupersampleGroups[4][4][2] =
+{
+	{ { 0, 0 }, { 2, 0 }, { 0, 2 }, { 2, 2 } },
+	{ { 1, 1 }, { 3, 1 }, { 1, 3 }, { 3, 3 } },
+	{ { 1, 0 }, { 3, 0 }, { 1, 2 }, { 3, 2 } },
+	{ { 0, 1 }, { 2, 1 }, { 0, 3 }, { 2, 3 } },
+};
+
+//-----------------------------------------------------------------------------
+// Is the standard error of the mean intensity of the supersamples so far below
+// g_flSupersampleMaxError for every bump direction?
+//-----------------------------------------------------------------------------
+static bool SupersampleErrorIsLow( SSE_SampleInfo_t& info, float const *pSum, float const *pSumSq, int nSamples )
+{
+	if ( g_flSupersampleMaxError <= 0.0f || nSamples < 2 )
+		return false;
+
+	float flMaxVariance = g_flSupersampleMaxError * g_flSupersampleMaxError * nSamples;
+	for ( int n = 0; n < info.m_NormalCount; ++n )
+	{
+		float flVariance = ( pSumSq[n] - pSum[n] * pSum[n] / nSamples ) / ( nSamples - 1 );
+		if ( flVariance > flMaxVariance )
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Perform supersampling at a particular point. The direct light is sampled
+// progressively and stops once the samples agree well enough. pTraced gets
+// the number of points that were lit.
 //-----------------------------------------------------------------------------
 static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info, 
-									int sampleIndex, int lightStyleIndex, LightingValue_t *pLight, int flags )
+									int sampleIndex, int lightStyleIndex, LightingValue_t *pLight, int flags, int *pTraced )
 {
 	sample_t& sample = info.m_pFaceLight->sample[sampleIndex];
 
@@ -2712,16 +2979,32 @@ static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
 		float aRow[4];
 		for ( int coord = 0; coord < 4; ++coord )
 			aRow[coord] = csshift + coord * cscale;
-		fltx4 sseRow = LoadUnalignedSIMD( aRow );
 
-		for (int s = 0; s < 4; ++s)
+		// Running sums of each bump direction's intensity, in the same linear
+		// perception space the gradients use
+		float flSum[NUM_BUMP_VECTS+1], flSumSq[NUM_BUMP_VECTS+1];
+		for ( int n = 0; n < info.m_NormalCount; ++n )
+		{
+			flSum[n] = flSumSq[n] = 0.0f;
+		}
+
+		for ( int g = 0; g < 4; ++g )
 		{
+			if ( g >= MIN_SUPERSAMPLE_GROUPS && SupersampleErrorIsLow( info, flSum, flSumSq, subsampleCount ) )
+				break;
+
 			// make sure the coordinate is inside of the sample's winding and when normalizing
 			// below use the number of samples used, not just numsamples and some of them
 			// will be skipped if they are not inside of the winding
+			float aOffsetS[4], aOffsetT[4];
+			for ( int i = 0; i < 4; ++i )
+			{
+				aOffsetS[i] = aRow[ s_SupersampleGroups[g][i][0] ];
+				aOffsetT[i] = aRow[ s_SupersampleGroups[g][i][1] ];
+			}
 			superSampleLightCoord.DuplicateVector( sampleLightOrigin );
-			superSampleLightCoord.x = AddSIMD( superSampleLightCoord.x, ReplicateX4( aRow[s] ) );
-			superSampleLightCoord.y = AddSIMD( superSampleLightCoord.y, sseRow );
+			superSampleLightCoord.x = AddSIMD( superSampleLightCoord.x, LoadUnalignedSIMD( aOffsetS ) );
+			superSampleLightCoord.y = AddSIMD( superSampleLightCoord.y, LoadUnalignedSIMD( aOffsetT ) );
 
 			// Figure out where the supersample exists in the world, and make sure
 			// it lies within the sample winding
@@ -2739,6 +3022,7 @@ static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
 			// Resample the non-ambient light at this point...
 			LightingValue_t result[4][NUM_BUMP_VECTS+1];
 			ResampleLightAt4Points( info, lightStyleIndex, NON_AMBIENT_ONLY, result );
+			*pTraced += 4;
 
 			// Got more subsamples
 			for ( int i = 0; i < 4; i++ )
@@ -2748,6 +3032,10 @@ static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
 					for ( int n = 0; n < info.m_NormalCount; ++n )
 					{
 						pLight[n].AddLight( result[i][n] );
+
+						float flIntensity = pow( result[i][n].Intensity() / 256.0f, 1.0f / 2.2f );
+						flSum[n] += flIntensity;
+						flSumSq[n] += flIntensity * flIntensity;
 					}
 					++subsampleCount;
 				}
@@ -2772,6 +3060,7 @@ static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
 
 		LightingValue_t result[4][NUM_BUMP_VECTS+1];
 		ResampleLightAt4Points( info, lightStyleIndex, AMBIENT_ONLY, result );
+		*pTraced += 4;
 
 		// Got more subsamples
 		for ( int i = 0; i < 4; i++ )
@@ -2935,10 +3224,14 @@ static void BuildSupersampleFaceLights( lightinfo_t& l, SSE_SampleInfo_t& info,
 			}
 
 			// Supersample the ambient light for each bump direction vector
-			int ambientSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pAmbientLight, AMBIENT_ONLY );
+			int nTraced = 0;
+			int ambientSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pAmbientLight, AMBIENT_ONLY, &nTraced );
 
 			// Supersample the non-ambient light for each bump direction vector
-			int directSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pDirectLight, NON_AMBIENT_ONLY );
+			int directSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pDirectLight, NON_AMBIENT_ONLY, &nTraced );
+
+			info.m_pFaceLight->numsupersampled++;
+			info.m_pFaceLight->numsupersamples += nTraced;
 
 			// Because of sampling problems, small area triangles may have no samples.
 			// In this case, just use what we already have
@@ -2976,6 +3269,35 @@ static void BuildSupersampleFaceLights( lightinfo_t& l, SSE_SampleInfo_t& info,
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Reports how many points -extra lit per supersampled luxel, overall and
+// (with -verbose) for each face.
+//-----------------------------------------------------------------------------
+void PrintSupersampleStats()
+{
+	int nLuxels = 0;
+	int64 nTraced = 0;
+	for ( int i = 0; i < numfaces; ++i )
+	{
+		facelight_t *fl = &facelight[i];
+		if ( !fl->numsupersampled )
+			continue;
+
+		qprintf( "  face %5d: %5d luxels supersampled, %4.1f rays/luxel\n", i, fl->numsupersampled,
+			(float)fl->numsupersamples / fl->numsupersampled );
+		nLuxels += fl->numsupersampled;
+		nTraced += fl->numsupersamples;
+	}
+
+	if ( nLuxels )
+	{
+		// each luxel takes at most 16 direct and 4 ambient samples
+		float flRaysPerLuxel = (float)nTraced / nLuxels;
+		Msg( "Supersampled %d luxels, %.1f rays/luxel (%.0f%% of the maximum)\n", nLuxels, flRaysPerLuxel,
+			100.0f * flRaysPerLuxel / 20.0f );
+	}
+}
+
 void InitLightinfo( lightinfo_t *pl, int facenum )
 {
 	dface_t		*f;
@@ -3056,6 +3378,43 @@ static void InitSampleInfo( lightinfo_t const& l, int iThread, SSE_SampleInfo_t&
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Loads the positions and normals of the group of up to 4 samples starting at
+// nSample into info. Returns the number of samples in the group.
+//-----------------------------------------------------------------------------
+static int LoadSampleGroup( lightinfo_t const& l, SSE_SampleInfo_t& info, int nSample )
+{
+	Vector v[4], n[4];
+
+	sample_t *sample = info.m_pFaceLight->sample + nSample;
+	int numSamples = min ( 4, info.m_pFaceLight->numsamples - nSample );
+
+	FourVectors positions;
+	FourVectors normals;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		v[i] = ( i < numSamples ) ? sample[i].pos : sample[numSamples - 1].pos;
+		n[i] = ( i < numSamples ) ? sample[i].normal : sample[numSamples - 1].normal;
+	}
+	positions.LoadAndSwizzle( v[0], v[1], v[2], v[3] );
+	normals.LoadAndSwizzle( n[0], n[1], n[2], n[3] );
+
+	ComputeIlluminationPointAndNormalsSSE( l, positions, normals, &info, numSamples );
+
+	// Fixup sample normals in case of smooth faces
+	if ( !l.isflat )
+	{
+		for ( int i = 0; i < numSamples; i++ )
+			sample[i].normal = info.m_PointNormals[0].Vec( i );
+	}
+
+	return numSamples;
+}
+
+// The lights that can reach the face each thread is working on, reused between faces
+static CUtlVector<directlight_t *> s_FaceLights[MAX_TOOL_THREADS+1];
+
 void BuildFacelights (int iThread, int facenum)
 {
 	int	i, j;
@@ -3063,10 +3422,9 @@ void BuildFacelights (int iThread, int facenum)
 	lightinfo_t	l;
 	dface_t *f;
 	facelight_t	*fl;
-	SSE_SampleInfo_t sampleInfo;
+	SSE_SampleInfo_t sampleInfo[2];
 	directlight_t *dl;
 	Vector spot;
-	Vector v[4], n[4];
 
 	if( g_bInterrupt )
 		return;
@@ -3104,45 +3462,55 @@ void BuildFacelights (int iThread, int facenum)
 
 	InitLightinfo( &l, facenum );
 	CalcPoints( &l, fl, facenum );
-	InitSampleInfo( l, iThread, sampleInfo );
+	InitSampleInfo( l, iThread, sampleInfo[0] );
+
+	// Cull the lights down to the ones that can reach the samples (or supersamples,
+	// which stay within a luxel of them), 1 unit off the face
+	Vector vecFaceMins, vecFaceMaxs;
+	ClearBounds( vecFaceMins, vecFaceMaxs );
+	for ( i = 0; i < fl->numsamples; ++i )
+	{
+		AddPointToBounds( fl->sample[i].pos, vecFaceMins, vecFaceMaxs );
+	}
+	Vector vecLuxelPad;
+	for ( i = 0; i < 3; ++i )
+	{
+		vecLuxelPad[i] = fabs( l.luxelToWorldSpace[0][i] ) + fabs( l.luxelToWorldSpace[1][i] ) + 2.0f;
+	}
+	GetLightsReachingBox( vecFaceMins - vecLuxelPad, vecFaceMaxs + vecLuxelPad, iThread, s_FaceLights[iThread] );
+	sampleInfo[0].m_ppLights = s_FaceLights[iThread].Base();
+	sampleInfo[0].m_nLights = s_FaceLights[iThread].Count();
+
+	sampleInfo[1] = sampleInfo[0];
 
 	// Allocate sample positions/normals to SSE
 	int numGroups = ( fl->numsamples & 0x3) ? ( fl->numsamples / 4 ) + 1 : ( fl->numsamples / 4 );
 
 	// always allocate style 0 lightmap
 	f->styles[0] = 0;
-	AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
+	AllocateLightstyleSamples( fl, 0, sampleInfo[0].m_NormalCount );
 
-	// sample the lights at each sample location
-	for ( int grp = 0; grp < numGroups; ++grp )
+	// sample the lights at each sample location. When the ray tracer can trace 8 rays at
+	// once, pairs of groups are lit together.
+	bool bEightWide = RayTracingEnvironment::SupportsEightWideTracing();
+	for ( int grp = 0; grp < numGroups; )
 	{
+		int nGroupsThisPass = ( bEightWide && ( grp + 1 < numGroups ) ) ? 2 : 1;
 		int nSample = 4 * grp;
+		int numSamples[2];
 
-		sample_t *sample = sampleInfo.m_pFaceLight->sample + nSample;
-		int numSamples = min ( 4, sampleInfo.m_pFaceLight->numsamples - nSample );
-
-		FourVectors positions;
-		FourVectors normals;
-
-		for ( int i = 0; i < 4; i++ )
+		for ( int g = 0; g < nGroupsThisPass; ++g )
 		{
-			v[i] = ( i < numSamples ) ? sample[i].pos : sample[numSamples - 1].pos;
-			n[i] = ( i < numSamples ) ? sample[i].normal : sample[numSamples - 1].normal;
-		}
-		positions.LoadAndSwizzle( v[0], v[1], v[2], v[3] );
-		normals.LoadAndSwizzle( n[0], n[1], n[2], n[3] );
-
-		ComputeIlluminationPointAndNormalsSSE( l, positions, normals, &sampleInfo, numSamples );
-
-		// Fixup sample normals in case of smooth faces
-		if ( !l.isflat )
-		{
-			for ( int i = 0; i < numSamples; i++ )
-				sample[i].normal = sampleInfo.m_PointNormals[0].Vec( i );
+			numSamples[g] = LoadSampleGroup( l, sampleInfo[g], nSample + 4 * g );
 		}
 
 		// Iterate over all the lights and add their contribution to this group of spots
-		GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		if ( nGroupsThisPass == 2 )
+			GatherSampleLightAt8Points( sampleInfo, nSample, numSamples );
+		else
+			GatherSampleLightAt4Points( sampleInfo[0], nSample, numSamples[0] );
+
+		grp += nGroupsThisPass;
 	}
 	
 	// Tell the incremental light manager that we're done with this face.
@@ -3161,7 +3529,9 @@ void BuildFacelights (int iThread, int facenum)
 	}
 
 	// get rid of the -extra functionality on displacement surfaces
-	if (do_extra && !sampleInfo.m_IsDispFace)
+	fl->numsupersampled = 0;
+	fl->numsupersamples = 0;
+	if (do_extra && !sampleInfo[0].m_IsDispFace)
 	{
 		// For each lightstyle, perform a supersampling pass
 		for ( i = 0; i < MAXLIGHTMAPS; ++i )
@@ -3170,7 +3540,7 @@ void BuildFacelights (int iThread, int facenum)
 			if (f->styles[i] == 255)
 				break;
 
-			BuildSupersampleFaceLights( l, sampleInfo, i );
+			BuildSupersampleFaceLights( l, sampleInfo[0], i );
 		}
 	}
 
@@ -3419,6 +3789,74 @@ void PrecompLightmapOffsets()
 	pdlightdata->SetSize( lightdatasize );
 }
 
+
+/*
+  =============
+  ReportLightmapPacking
+
+  The engine packs face lightmaps into atlas pages when it loads the map, so
+  nothing here changes the lighting lump or the offsets above. This packs the
+  same blocks the way the engine lays them out, bumped lightmaps side by side,
+  and prints how many pages they take.
+  =============
+*/
+
+#define LIGHTMAP_PAGE_WIDTH		512
+#define LIGHTMAP_PAGE_HEIGHT	256
+
+bool					g_bReportLightmapPacking = false;
+ImagePackerHeuristic_t	g_LightmapPacker = IMAGE_PACKER_MAXRECTS;
+
+static void PackLightmapBlocks( CMultiImagePacker &packer, ImagePackerHeuristic_t heuristic )
+{
+	packer.Init( LIGHTMAP_PAGE_WIDTH, LIGHTMAP_PAGE_HEIGHT, heuristic );
+
+	for ( int facenum = 0; facenum < numfaces; facenum++ )
+	{
+		dface_t *f = &g_pFaces[facenum];
+		if ( ( texinfo[f->texinfo].flags & TEX_SPECIAL ) || ( f->styles[0] == 255 ) )
+			continue;
+
+		int width = f->m_LightmapTextureSizeInLuxels[0] + 1;
+		int height = f->m_LightmapTextureSizeInLuxels[1] + 1;
+		if ( texinfo[f->texinfo].flags & SURF_BUMPLIGHT )
+		{
+			width *= NUM_BUMP_VECTS + 1;
+		}
+		packer.AddBlock( width, height );
+	}
+
+	packer.Pack();
+}
+
+void ReportLightmapPacking()
+{
+	if ( !g_bReportLightmapPacking )
+		return;
+
+	float flStart = Plat_FloatTime();
+
+	CMultiImagePacker packer;
+	PackLightmapBlocks( packer, g_LightmapPacker );
+
+	Msg( "Lightmap atlas (%dx%d, %s): %d lightmaps in %d pages, %.1f%% occupied",
+		LIGHTMAP_PAGE_WIDTH, LIGHTMAP_PAGE_HEIGHT, ImagePackerHeuristicName( g_LightmapPacker ),
+		packer.GetBlockCount(), packer.GetImageCount(), 100.0f * packer.GetOccupancy() );
+	if ( packer.GetUnpackedBlockCount() )
+	{
+		Msg( ", %d too big for a page", packer.GetUnpackedBlockCount() );
+	}
+	Msg( " (%.2f seconds)\n", Plat_FloatTime() - flStart );
+
+	if ( g_LightmapPacker != IMAGE_PACKER_WAVEFRONT )
+	{
+		CMultiImagePacker baseline;
+		PackLightmapBlocks( baseline, IMAGE_PACKER_WAVEFRONT );
+		Msg( "  %s: %d pages, %.1f%% occupied\n", ImagePackerHeuristicName( IMAGE_PACKER_WAVEFRONT ),
+			baseline.GetImageCount(), 100.0f * baseline.GetOccupancy() );
+	}
+}
+
 // Clamp the three values for bumped lighting such that we trade off directionality for brightness.
 static void ColorClampBumped( Vector& color1, Vector& color2, Vector& color3 )
 {
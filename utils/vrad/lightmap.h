@@ -17,6 +17,7 @@
 
 #include "mathlib/bumpvects.h"
 #include "bsplib.h"
+#include "imagepacker.h"
 
 typedef struct
 {
@@ -79,6 +80,10 @@ struct facelight_t
 	Vector		*luxel;				// world space position of luxel
 	Vector		*luxelNormals;		// world space normal of luxel
 	float		worldAreaPerLuxel;
+
+	// -extra supersampling stats
+	int			numsupersampled;	// luxels that got supersampled
+	int			numsupersamples;	// points lit to supersample them, summed over all the lightstyles
 };
 
 extern directlight_t	*activelights;
@@ -87,6 +92,10 @@ extern directlight_t	*freelights;
 extern facelight_t		facelight[MAX_MAP_FACES];
 extern int				numdlights;
 
+// -lightmappacker
+extern bool						g_bReportLightmapPacking;
+extern ImagePackerHeuristic_t	g_LightmapPacker;
+
 
 //==============================================
 
@@ -129,6 +138,10 @@ struct SSE_SampleInfo_t
 	int	        m_Clusters[4];
 	FourVectors	m_Points;
 	FourVectors	m_PointNormals[ NUM_BUMP_VECTS + 1 ];
+
+	// The lights that may reach this face, in activelights order
+	directlight_t * const *m_ppLights;
+	int		m_nLights;
 };
 
 extern void InitLightinfo( lightinfo_t *l, int facenum );
@@ -9,8 +9,10 @@
 // mpivrad.cpp
 //
 
+#ifdef _WIN32
 #include <windows.h>
 #include <conio.h>
+#endif
 #include "vrad.h"
 #include "physdll.h"
 #include "lightmap.h"
@@ -34,6 +36,7 @@
 
 
 CUtlVector<char> g_LightResultsFilename;
+CUtlVector<char> g_LeafAmbientProbesFilename;
 
 
 extern int total_transfer;
@@ -54,6 +57,13 @@ bool VRAD_DispatchFn( MessageBuffer *pBuf, int iSource, int iPacketID )
 			g_LightResultsFilename.CopyArray( pFilename, strlen( pFilename ) + 1 );
 			return true;
 		}
+
+		case VMPI_SUBPACKETID_LEAF_AMBIENT_PROBES:
+		{
+			const char *pFilename = &pBuf->data[2];
+			g_LeafAmbientProbesFilename.CopyArray( pFilename, strlen( pFilename ) + 1 );
+			return true;
+		}
 		
 		default:		
 			return false;
@@ -294,8 +304,10 @@ void MPI_ReceiveVisLeafsResults( uint64 iWorkUnit, MessageBuffer *pBuf, int iWor
 		patch->numtransfers = numtransfers;
 		if (numtransfers) 
 		{
-			patch->transfers = new transfer_t[numtransfers];
-			pBuf->read(patch->transfers, numtransfers * sizeof(transfer_t));
+			pBuf->read( &patch->numtransferwords, sizeof(patch->numtransferwords) );
+			pBuf->read( &patch->transferscale, sizeof(patch->transferscale) );
+			patch->transfers = ( unsigned short* )malloc( patch->numtransferwords * sizeof( unsigned short ) );
+			pBuf->read(patch->transfers, patch->numtransferwords * sizeof(unsigned short));
 		}
 		
 		total_transfer += numtransfers;
@@ -330,7 +342,12 @@ void MPI_AddPatchData( int iThread, int patchnum, CPatch *patch )
 		++pData->m_nPatchesInCluster;
 		pData->m_pVisLeafsMB->write(&patchnum, sizeof(patchnum));
 		pData->m_pVisLeafsMB->write(&patch->numtransfers, sizeof(patch->numtransfers));
-		pData->m_pVisLeafsMB->write( patch->transfers, patch->numtransfers * sizeof(transfer_t) );
+		if ( patch->numtransfers )
+		{
+			pData->m_pVisLeafsMB->write( &patch->numtransferwords, sizeof(patch->numtransferwords) );
+			pData->m_pVisLeafsMB->write( &patch->transferscale, sizeof(patch->transferscale) );
+			pData->m_pVisLeafsMB->write( patch->transfers, patch->numtransferwords * sizeof(unsigned short) );
+		}
 	}
 }
 
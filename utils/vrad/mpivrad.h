@@ -17,6 +17,7 @@
 	#define VMPI_SUBPACKETID_VIS_LEAFS			0
 	#define VMPI_SUBPACKETID_BUILDFACELIGHTS	1
 	#define VMPI_SUBPACKETID_PLIGHTDATA_RESULTS	2
+	#define VMPI_SUBPACKETID_LEAF_AMBIENT_PROBES	3
 
 // DistributeWork owns this packet ID.
 #define VMPI_DISTRIBUTEWORK_PACKETID			2
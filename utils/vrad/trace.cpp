@@ -11,7 +11,7 @@
 
 #include "vrad.h"
 #include "trace.h"
-#include "Cmodel.h"
+#include "cmodel.h"
 #include "mathlib/vmatrix.h"
 
 
@@ -148,6 +148,26 @@ public:
 	}
 };
 
+// turns a trace from TestLine into the fraction of each ray that reached its end point
+static fltx4 VisibilityFromTraceResult( RayTracingResult const &rt_result, fltx4 len, CCoverageCount &coverageCallback )
+{
+	// Assume we can see the targets unless we get hits
+	float visibility[4];
+	for ( int i = 0; i < 4; i++ )
+	{
+		visibility[i] = 1.0f;
+		if ( ( rt_result.HitIds[i] != -1 ) &&
+		     ( rt_result.HitDistance.m128_f32[i] < len.m128_f32[i] ) )
+		{
+			visibility[i] = 0.0f;
+		}
+	}
+	fltx4 fractionVisible = LoadUnalignedSIMD( visibility );
+	if ( g_bTextureShadows )
+		fractionVisible = MinSIMD( fractionVisible, coverageCallback.GetFractionVisible() );
+	return fractionVisible;
+}
+
 void TestLine( const FourVectors& start, const FourVectors& stop,
                fltx4 *pFractionVisible, int static_prop_index_to_ignore )
 {
@@ -163,20 +183,32 @@ void TestLine( const FourVectors& start, const FourVectors& stop,
 
 	g_RtEnv.Trace4Rays(myrays, Four_Zeros, len, &rt_result, TRACE_ID_STATICPROP | static_prop_index_to_ignore, g_bTextureShadows ? &coverageCallback : 0 );
 
-	// Assume we can see the targets unless we get hits
-	float visibility[4];
-	for ( int i = 0; i < 4; i++ )
+	*pFractionVisible = VisibilityFromTraceResult( rt_result, len, coverageCallback );
+}
+
+void TestLine8( FourVectors const start[2], FourVectors const stop[2],
+				fltx4 pFractionVisible[2], int static_prop_index_to_ignore )
+{
+	EightRays myrays;
+	fltx4 len[2];
+	fltx4 tmin[2] = { Four_Zeros, Four_Zeros };
+	for ( int h = 0; h < 2; h++ )
 	{
-		visibility[i] = 1.0f;
-		if ( ( rt_result.HitIds[i] != -1 ) &&
-		     ( rt_result.HitDistance.m128_f32[i] < len.m128_f32[i] ) )
-		{
-			visibility[i] = 0.0f;
-		}
+		myrays.m_Rays[h].origin = start[h];
+		myrays.m_Rays[h].direction = stop[h];
+		myrays.m_Rays[h].direction -= myrays.m_Rays[h].origin;
+		len[h] = myrays.m_Rays[h].direction.length();
+		myrays.m_Rays[h].direction *= ReciprocalSIMD( len[h] );
 	}
-	*pFractionVisible = LoadUnalignedSIMD( visibility );
-	if ( g_bTextureShadows )
-		*pFractionVisible = MinSIMD( *pFractionVisible, coverageCallback.GetFractionVisible() );
+
+	RayTracingResult rt_result[2];
+	CCoverageCountTexture coverageCallback[2];
+	ITransparentTriangleCallback *pCallbacks[2] = { &coverageCallback[0], &coverageCallback[1] };
+
+	g_RtEnv.Trace8Rays( myrays, tmin, len, rt_result, TRACE_ID_STATICPROP | static_prop_index_to_ignore, g_bTextureShadows ? pCallbacks : NULL );
+
+	for ( int h = 0; h < 2; h++ )
+		pFractionVisible[h] = VisibilityFromTraceResult( rt_result[h], len[h], coverageCallback[h] );
 }
 
 
@@ -349,6 +381,10 @@ void DM_ClipBoxToBrush( CToolTrace *trace, const Vector& mins, const Vector& max
 	}
 }
 
+static void FinishTestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop, fltx4 len,
+	RayTracingResult const &rt_result, CCoverageCount &coverageCallback,
+	fltx4 *pFractionVisible, bool canRecurse, int static_prop_to_skip, bool bDoDebug );
+
 void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
 	fltx4 *pFractionVisible, bool canRecurse, int static_prop_to_skip, bool bDoDebug )
 {
@@ -368,6 +404,43 @@ void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
 		WriteTrace( "trace.txt", myrays, rt_result );
 	}
 
+	FinishTestLine_DoesHitSky( start, stop, len, rt_result, coverageCallback, pFractionVisible, canRecurse, static_prop_to_skip, bDoDebug );
+}
+
+void TestLine_DoesHitSky8( FourVectors const start[2], FourVectors const stop[2],
+	fltx4 pFractionVisible[2], bool canRecurse, int static_prop_to_skip )
+{
+	EightRays myrays;
+	fltx4 len[2];
+	fltx4 tmin[2] = { Four_Zeros, Four_Zeros };
+	for ( int h = 0; h < 2; h++ )
+	{
+		myrays.m_Rays[h].origin = start[h];
+		myrays.m_Rays[h].direction = stop[h];
+		myrays.m_Rays[h].direction -= myrays.m_Rays[h].origin;
+		len[h] = myrays.m_Rays[h].direction.length();
+		myrays.m_Rays[h].direction *= ReciprocalSIMD( len[h] );
+	}
+	RayTracingResult rt_result[2];
+	CCoverageCountTexture coverageCallback[2];
+	ITransparentTriangleCallback *pCallbacks[2] = { &coverageCallback[0], &coverageCallback[1] };
+
+	g_RtEnv.Trace8Rays( myrays, tmin, len, rt_result, TRACE_ID_STATICPROP | static_prop_to_skip, g_bTextureShadows ? pCallbacks : NULL );
+
+	// the few rays which get into a 3d skybox are traced 4 at a time from here
+	for ( int h = 0; h < 2; h++ )
+	{
+		FinishTestLine_DoesHitSky( start[h], stop[h], len[h], rt_result[h], coverageCallback[h], &pFractionVisible[h],
+								   canRecurse, static_prop_to_skip, false );
+	}
+}
+
+// turns the trace from TestLine_DoesHitSky into sky visibility, recursing into the 3d skybox if
+// needed
+static void FinishTestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop, fltx4 len,
+	RayTracingResult const &rt_result, CCoverageCount &coverageCallback,
+	fltx4 *pFractionVisible, bool canRecurse, int static_prop_to_skip, bool bDoDebug )
+{
 	float aOcclusion[4];
 	for ( int i = 0; i < 4; i++ )
 	{
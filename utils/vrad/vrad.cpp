@@ -19,6 +19,9 @@
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "geometrycache.h"
+#include "toolstats.h"
+#include "lightcull.h"
 
 #define ALLOWDEBUGOPTIONS (0 || _DEBUG)
 
@@ -57,8 +60,11 @@ float		g_MaxDispPatchRadius = 1500.0f;			// Maximum radius allowed for displacem
 qboolean	g_bDumpPatches;
 bool	    bDumpNormals = false;
 bool		g_bDumpRtEnv = false;
+bool		g_bBenchmarkRtEnv = false;
+bool		g_bGeometryCache = false;
 bool		bRed2Black = true;
 bool		g_bFastAmbient = false;
+bool		g_bAdaptiveAmbient = false;
 bool        g_bNoSkyRecurse = false;
 
 int			junk;
@@ -79,6 +85,7 @@ char		level_lights[MAX_PATH] = "";
 
 char		vismatfile[_MAX_PATH] = "";
 char		incrementfile[_MAX_PATH] = "";
+char		geometrycachefile[_MAX_PATH] = "";
 
 IIncremental *g_pIncremental = 0;
 bool		g_bInterrupt = false;	// Wsed with background lighting in WC. Tells VRAD
@@ -101,6 +108,7 @@ bool		debug_extra = false;
 qboolean	do_fast = false;
 qboolean	do_centersamples = false;
 int			extrapasses = 4;
+float		g_flSupersampleMaxError = 0.004;	// -extra stops supersampling a luxel once its error is below this
 float		smoothing_threshold = 0.7071067; // cos(45.0*(M_PI/180)) 
 // Cosine of smoothing angle(in radians)
 float		coring = 1.0;	// Light threshold to force to blackness(minimizes lightmaps)
@@ -1198,11 +1206,73 @@ void MakeTransfer( int ndxPatch1, int ndxPatch2, transfer_t *all_transfers )
 }
 
 
+static int CompareTransfersByPatch( const void *a, const void *b )
+{
+	return ( (transfer_t const *)a )->patch - ( (transfer_t const *)b )->patch;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Packs a patch's normalized transfers into the 16-bit stream described
+//          in vrad.h. Reorders the transfers.
+//-----------------------------------------------------------------------------
+void CompressTransfers( CPatch *patch, transfer_t *pTransfers, int nTransfers )
+{
+	// sorting by patch keeps the deltas small and makes GatherLight walk emitlight in order
+	qsort( pTransfers, nTransfers, sizeof( transfer_t ), CompareTransfersByPatch );
+
+	float flScale = 0.0f;
+	int nWords = 0;
+	int nPrevPatch = 0;
+	for ( int i = 0; i < nTransfers; i++ )
+	{
+		flScale = max( flScale, pTransfers[i].transfer );
+
+		int nDelta = pTransfers[i].patch - nPrevPatch;
+		nWords += ( nDelta >= 0 && nDelta < TRANSFER_INDEX_ESCAPE ) ? 2 : 4;
+		nPrevPatch = pTransfers[i].patch;
+	}
+
+	patch->numtransferwords = nWords;
+	patch->transferscale = flScale;
+	patch->transfers = ( unsigned short* )malloc( nWords * sizeof( unsigned short ) );
+	if (!patch->transfers)
+		Error ("Memory allocation failure");
+
+	unsigned short *pOut = patch->transfers;
+	nPrevPatch = 0;
+	float flInvScale = flScale > 0.0f ? 1.0f / flScale : 0.0f;
+	for ( int i = 0; i < nTransfers; i++ )
+	{
+		int nDelta = pTransfers[i].patch - nPrevPatch;
+		if ( nDelta >= 0 && nDelta < TRANSFER_INDEX_ESCAPE )
+		{
+			*pOut++ = nDelta;
+		}
+		else
+		{
+			*pOut++ = TRANSFER_INDEX_ESCAPE;
+			*pOut++ = pTransfers[i].patch & 0xFFFF;
+			*pOut++ = (unsigned int)pTransfers[i].patch >> 16;
+		}
+		nPrevPatch = pTransfers[i].patch;
+
+		// round to nearest, letting the mantissa carry into the exponent
+		float flRelative = pTransfers[i].transfer * flInvScale;
+		uint32 nBits = *(uint32 *)&flRelative;
+		nBits = ( nBits > TRANSFER_FORMFACTOR_BIAS ) ? nBits - TRANSFER_FORMFACTOR_BIAS : 0;
+		nBits = ( nBits + ( 1 << ( TRANSFER_FORMFACTOR_SHIFT - 1 ) ) ) >> TRANSFER_FORMFACTOR_SHIFT;
+		*pOut++ = min( nBits, (uint32)( ( 0x3F800000 - TRANSFER_FORMFACTOR_BIAS ) >> TRANSFER_FORMFACTOR_SHIFT ) );
+	}
+	Assert( pOut - patch->transfers == nWords );
+}
+
+
 void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 {
 	int		j;
 	float	total;
-	transfer_t	*t, *t2;
+	transfer_t	*t;
 	total = 0;
 
 	if( ndxPatch == g_Patches.InvalidIndex() )
@@ -1217,18 +1287,13 @@ void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 			max_transfer = patch->numtransfers;
 		}
 
-
-		patch->transfers = ( transfer_t* )calloc (1, patch->numtransfers * sizeof(transfer_t));
-		if (!patch->transfers)
-			Error ("Memory allocation failure");
-
 		// get total transfer energy
-		t2 = all_transfers;
+		t = all_transfers;
 
 		// overflow check!
-		for (j=0 ; j<patch->numtransfers ; j++, t2++)
+		for (j=0 ; j<patch->numtransfers ; j++, t++)
 		{
-			total += t2->transfer;
+			total += t->transfer;
 		}
 
 		// the total transfer should be PI, but we need to correct errors due to overlaping surfaces
@@ -1237,17 +1302,13 @@ void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 		else	
 			total = 1.0f/M_PI;
 
-		t = patch->transfers;
-		t2 = all_transfers;
-		for (j=0 ; j<patch->numtransfers ; j++, t++, t2++)
-		{
-			t->transfer = t2->transfer*total;
-			t->patch = t2->patch;
-		}
-		if (patch->numtransfers > max_transfer)
+		t = all_transfers;
+		for (j=0 ; j<patch->numtransfers ; j++, t++)
 		{
-			max_transfer = patch->numtransfers;
+			t->transfer *= total;
 		}
+
+		CompressTransfers( patch, all_transfers, patch->numtransfers );
 	}
 	else
 	{
@@ -1534,7 +1595,6 @@ void PreGetBumpNormalsForDisp( texinfo_t *pTexinfo, Vector &vecU, Vector &vecV,
 void GatherLight (int threadnum, void *pUserData)
 {
 	int			i, j, k;
-	transfer_t	*trans;
 	int			num;
 	CPatch		*patch;
 	Vector		sum, v;
@@ -1547,7 +1607,7 @@ void GatherLight (int threadnum, void *pUserData)
 
 		patch = &g_Patches[j];
 
-		trans = patch->transfers;
+		CTransferReader transfers( patch );
 		num = patch->numtransfers;
 		if ( patch->needsBumpmap )
 		{
@@ -1588,9 +1648,12 @@ void GatherLight (int threadnum, void *pUserData)
 			}
 
 			float dot;
-			for (k=0 ; k<num ; k++, trans++)
+			for (k=0 ; k<num ; k++)
 			{
-				CPatch *patch2 = &g_Patches[trans->patch];
+				int ndxPatch2;
+				float transfer;
+				transfers.Next( ndxPatch2, transfer );
+				CPatch *patch2 = &g_Patches[ndxPatch2];
 
 				// get vector to other patch
 				VectorSubtract (patch2->origin, patch->origin, delta);
@@ -1598,11 +1661,11 @@ void GatherLight (int threadnum, void *pUserData)
 				// find light emitted from other patch
 				for(i=0; i<3; i++)
 				{
-					v[i] = emitlight[trans->patch][i] * patch2->reflectivity[i];
+					v[i] = emitlight[ndxPatch2][i] * patch2->reflectivity[i];
 				}
 				// remove normal already factored into transfer steradian
 				float scale = 1.0f / DotProduct (delta, patch->normal);
-				VectorScale( v, trans->transfer * scale, v );
+				VectorScale( v, transfer * scale, v );
 				
 				Vector bumpTransfer;
 				for ( i = 0; i < NUM_BUMP_VECTS+1; i++ )
@@ -1625,13 +1688,16 @@ void GatherLight (int threadnum, void *pUserData)
 		else
 		{
 			VectorFill( sum, 0 );
-			for (k=0 ; k<num ; k++, trans++)
+			for (k=0 ; k<num ; k++)
 			{
+				int ndxPatch2;
+				float transfer;
+				transfers.Next( ndxPatch2, transfer );
 				for(i=0; i<3; i++)
 				{
-					v[i] = emitlight[trans->patch][i] * g_Patches[trans->patch].reflectivity[i];
+					v[i] = emitlight[ndxPatch2][i] * g_Patches[ndxPatch2].reflectivity[i];
 				}
-				VectorScale( v, trans->transfer, v );
+				VectorScale( v, transfer, v );
 				VectorAdd( sum, v, sum );
 			}
 			VectorCopy( sum, addlight[j].light[0] );
@@ -1923,15 +1989,31 @@ void BuildFacesVisibleToLights( bool bAllVisible )
 
 void MakeAllScales (void)
 {
-	// determine visibility between patches
-	BuildVisMatrix ();
-	
-	// release visibility matrix
-	FreeVisMatrix ();
+	if ( GeometryCache()->RestoreTransfers() )
+	{
+		Msg("Loaded transfers from %s\n", geometrycachefile );
+	}
+	else
+	{
+		// determine visibility between patches
+		BuildVisMatrix ();
+
+		// release visibility matrix
+		FreeVisMatrix ();
+
+		GeometryCache()->SaveTransfers();
+	}
 
 	Msg("transfers %d, max %d\n", total_transfer, max_transfer );
 
-	qprintf ("transfer lists: %5.1f megs\n"
+	int64 nTransferBytes = 0;
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		nTransferBytes += g_Patches[i].numtransferwords * sizeof( unsigned short );
+	}
+	Msg("transfer lists: %5.1f megs, %.2f bytes per transfer (%5.1f megs uncompressed)\n"
+		, (float)nTransferBytes / (1024*1024)
+		, total_transfer ? (float)nTransferBytes / total_transfer : 0.0f
 		, (float)total_transfer * sizeof(transfer_t) / (1024*1024));
 }
 
@@ -2019,6 +2101,8 @@ bool RadWorld_Go()
 	}
 
 	// build initial facelights
+	ToolStats_BeginStage( "direct" );
+	BuildLightCulling();
 	if (g_bUseMPI) 
 	{
 		// RunThreadsOnIndividual (numfaces, true, BuildFacelights);
@@ -2027,6 +2111,8 @@ bool RadWorld_Go()
 	else 
 	{
 		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
+		PrintSupersampleStats();
+		PrintLightCullingStats();
 	}
 
 	// Was the process interrupted?
@@ -2035,6 +2121,7 @@ bool RadWorld_Go()
 
 	// Figure out the offset into lightmap data for each face.
 	PrecompLightmapOffsets();
+	ReportLightmapPacking();
 	
 	// If we're doing incremental lighting, stop here.
 	if( g_pIncremental )
@@ -2044,6 +2131,7 @@ bool RadWorld_Go()
 	else
 	{
 		// free up the direct lights now that we have facelights
+		FreeLightCulling();
 		ExportDirectLightsToWorldLights();
 
 		if ( g_bDumpPatches )
@@ -2064,6 +2152,7 @@ bool RadWorld_Go()
 			addlight.SetSize( g_Patches.Size() );
 			memset( addlight.Base(), 0, g_Patches.Size() * sizeof( bumplights_t ) );
 
+			ToolStats_BeginStage( "bounce" );
 			MakeAllScales ();
 
 			// spread light around
@@ -2073,6 +2162,7 @@ bool RadWorld_Go()
 		//
 		// displacement surface luxel accumulation (make threaded!!!)
 		//
+		ToolStats_BeginStage( "finallight" );
 		StaticDispMgr()->StartTimer( "Build Patch/Sample Hash Table(s)....." );
 		StaticDispMgr()->InsertSamplesDataIntoHashTable();
 		StaticDispMgr()->InsertPatchSampleDataIntoHashTable();
@@ -2125,6 +2215,7 @@ void VRAD_LoadBSP( char const *pFilename )
 	ThreadSetDefault ();
 
 	g_flStartTime = Plat_FloatTime();
+	ToolStats_BeginStage( "loadbsp" );
 
 	if( g_bLowPriority )
 	{
@@ -2158,7 +2249,12 @@ void VRAD_LoadBSP( char const *pFilename )
 		// Otherwise, try looking in the BIN directory from which we were run from
 		Msg( "Could not find lights.rad in %s.\nTrying VRAD BIN directory instead...\n", 
 			    global_lights );
+#ifdef _WIN32
 		GetModuleFileName( NULL, global_lights, sizeof( global_lights ) );
+#else
+		ssize_t nExeLen = readlink( "/proc/self/exe", global_lights, sizeof( global_lights ) - 1 );
+		global_lights[ MAX( (int)nExeLen, 0 ) ] = 0;
+#endif
 		Q_ExtractFilePath( global_lights, global_lights, sizeof( global_lights ) );
 		strcat( global_lights, "lights.rad" );
 	}
@@ -2176,6 +2272,8 @@ void VRAD_LoadBSP( char const *pFilename )
 
 	strcpy(incrementfile, source);
 	Q_DefaultExtension(incrementfile, ".r0", sizeof(incrementfile));
+	strcpy(geometrycachefile, source);
+	Q_DefaultExtension(geometrycachefile, ".rtc", sizeof(geometrycachefile));
 	Q_DefaultExtension(source, ".bsp", sizeof( source ));
 
 	GetPlatformMapPath( source, platformPath, 0, MAX_PATH );
@@ -2246,6 +2344,7 @@ void VRAD_LoadBSP( char const *pFilename )
 	}
 
 	// Setup ray tracer
+	ToolStats_BeginStage( "raytrace_setup" );
 	AddBrushesForRayTrace();
 	StaticDispMgr()->AddPolysForRayTrace();
 	StaticPropMgr()->AddPolysForRayTrace();
@@ -2255,11 +2354,34 @@ void VRAD_LoadBSP( char const *pFilename )
 		WriteRTEnv("trace.txt");
 
 	// Build acceleration structure
-	printf ( "Setting up ray-trace acceleration structure... ");
-	float start = Plat_FloatTime();
-	g_RtEnv.SetupAccelerationStructure();
-	float end = Plat_FloatTime();
-	printf ( "Done (%.2f seconds)\n", end-start );
+	if ( g_bBenchmarkRtEnv )
+	{
+		printf ( "Benchmarking ray-trace acceleration structures...\n");
+		g_RtEnv.BenchmarkAccelerationStructures( 1000000 );
+	}
+	else
+	{
+		// The cache file isn't shared between VMPI workers.
+		if ( g_bGeometryCache && !g_bUseMPI )
+		{
+			GeometryCache()->Init( geometrycachefile, &g_RtEnv );
+		}
+
+		float start = Plat_FloatTime();
+		if ( GeometryCache()->RestoreRayTraceEnvironment() )
+		{
+			printf ( "Loaded ray-trace acceleration structure from %s (%.2f seconds)\n", geometrycachefile, Plat_FloatTime()-start );
+		}
+		else
+		{
+			printf ( "Setting up ray-trace acceleration structure... ");
+			g_RtEnv.SetupAccelerationStructure();
+			float end = Plat_FloatTime();
+			printf ( "Done (%.2f seconds)\n", end-start );
+
+			GeometryCache()->SaveRayTraceEnvironment();
+		}
+	}
 
 #if 0  // To test only k-d build
 	exit(0);
@@ -2284,14 +2406,17 @@ void VRAD_ComputeOtherLighting()
 	// Compute lighting for the bsp file
 	if ( !g_bNoDetailLighting )
 	{
+		ToolStats_BeginStage( "detailprops" );
 		ComputeDetailPropLighting( THREADINDEX_MAIN );
 	}
 
+	ToolStats_BeginStage( "leafambient" );
 	ComputePerLeafAmbientLighting();
 
 	// bake the static props high quality vertex lighting into the bsp
 	if ( !do_fast && g_bStaticPropLighting )
 	{
+		ToolStats_BeginStage( "staticprops" );
 		StaticPropMgr()->ComputeLighting( THREADINDEX_MAIN );
 	}
 }
@@ -2310,6 +2435,7 @@ void VRAD_Finish()
 
 	Msg( "Writing %s\n", platformPath );
 	VMPI_SetCurrentStage( "WriteBSPFile" );
+	ToolStats_BeginStage( "writebsp" );
 	WriteBSPFile(platformPath);
 
 	if ( g_bDumpPatches )
@@ -2327,12 +2453,24 @@ void VRAD_Finish()
 
 	StaticPropMgr()->Shutdown();
 
+	// The ray tracer and the transfers may be using the cache file in place
+	GeometryCache()->Shutdown();
+
 	double end = Plat_FloatTime();
 	
 	char str[512];
 	GetHourMinuteSecondsString( (int)( end - g_flStartTime ), str, sizeof( str ) );
 	Msg( "%s elapsed\n", str );
 
+	if ( ToolStats_IsEnabled() )
+	{
+		ToolStats_SetCounter( "faces", numfaces );
+		ToolStats_SetCounter( "patches", g_Patches.Count() );
+		ToolStats_SetCounter( "lightmap_bytes", pdlightdata->Count() );
+		ToolStats_SetCounter( "rays_traced", RayTracingEnvironment::GetRayCount() );
+		ToolStats_Write();
+	}
+
 	ReleasePakFileLumps();
 }
 
@@ -2400,6 +2538,18 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bDumpRtEnv = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-bvh" ) )
+		{
+			g_RtEnv.Flags |= RTE_FLAGS_USE_BVH;
+		}
+		else if ( !Q_stricmp( argv[i], "-rtbench" ) )
+		{
+			g_bBenchmarkRtEnv = true;
+		}
+		else if ( !Q_stricmp( argv[i], "-geometrycache" ) )
+		{
+			g_bGeometryCache = true;
+		}
 		else if ( !Q_stricmp( argv[i], "-LargeDispSampleRadius" ) )
 		{
 			g_bLargeDispSampleRadius = true;
@@ -2443,6 +2593,10 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 				return 1;
 			}
 		}
+		else if ( !Q_stricmp( argv[i], "-threadstats" ) )
+		{
+			g_bPrintThreadStats = true;
+		}
 		else if ( !Q_stricmp(argv[i], "-lights" ) )
 		{
 			if ( ++i < argc && *argv[i] )
@@ -2463,10 +2617,73 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			debug_extra = true;
 		}
+		else if (!Q_stricmp(argv[i],"-extraerror"))
+		{
+			if ( ++i < argc )
+			{
+				g_flSupersampleMaxError = (float)atof( argv[i] );
+			}
+			else
+			{
+				Warning("Error: expected a value after '-extraerror'\n" );
+				return 1;
+			}
+		}
+		else if (!Q_stricmp(argv[i],"-lightcull"))
+		{
+			if ( ++i < argc )
+			{
+				g_flLightCullThreshold = (float)atof( argv[i] );
+				if ( g_flLightCullThreshold < 0 )
+				{
+					Warning("Error: expected a non-negative value after '-lightcull'\n" );
+					return 1;
+				}
+			}
+			else
+			{
+				Warning("Error: expected a value after '-lightcull'\n" );
+				return 1;
+			}
+		}
 		else if ( !Q_stricmp(argv[i], "-fastambient") )
 		{
 			g_bFastAmbient = true;
 		}
+		else if ( !Q_stricmp(argv[i], "-adaptiveambient") )
+		{
+			g_bAdaptiveAmbient = true;
+		}
+		else if ( !Q_stricmp(argv[i], "-lightmappacker") )
+		{
+			if ( ++i < argc && ImagePackerHeuristicForName( argv[i], &g_LightmapPacker ) )
+			{
+				g_bReportLightmapPacking = true;
+			}
+			else
+			{
+				Warning("Error: expected wavefront, skyline or maxrects after '-lightmappacker'\n" );
+				return 1;
+			}
+		}
+		else if ( !Q_stricmp(argv[i], "-benchstats") )
+		{
+			if ( ++i < argc )
+			{
+				// workers don't write stats. Under VMPI the master's stage times cover the
+				// whole run, but rays_traced only counts the rays the master traced itself.
+				if ( !g_bUseMPI || g_bMPIMaster )
+				{
+					ToolStats_Init( "vrad", argv[i] );
+					RayTracingEnvironment::EnableRayCounting( true );
+				}
+			}
+			else
+			{
+				Warning("Error: expected a filename after '-benchstats'\n" );
+				return 1;
+			}
+		}
 		else if (!Q_stricmp(argv[i],"-fast"))
 		{
 			do_fast = true;
@@ -2778,6 +2995,7 @@ void PrintUsage( int argc, char **argv )
 		"  -bounce #       : Set max number of bounces (default: 100).\n"
 		"  -fast           : Quick and dirty lighting.\n"
 		"  -fastambient    : Per-leaf ambient sampling is lower quality to save compute time.\n"
+		"  -adaptiveambient: Per-leaf ambient sampling spends its samples where the lighting changes.\n"
 		"  -final          : High quality processing. equivalent to -extrasky 16.\n"
 		"  -extrasky n     : trace N times as many rays for indirect light and sky ambient.\n"
 		"  -low            : Run as an idle-priority process.\n"
@@ -2792,17 +3010,38 @@ void PrintUsage( int argc, char **argv )
 		"  -dump           : Write debugging .txt files.\n"
 		"  -dumpnormals    : Write normals to debug files.\n"
 		"  -dumptrace      : Write ray-tracing environment to debug files.\n"
+		"  -bvh            : Use a bounding volume hierarchy built in parallel for ray\n"
+		"                    tracing instead of the kd-tree.\n"
+		"  -rtbench        : Build both the kd-tree and the bvh, and print build times\n"
+		"                    and rays per second for each.\n"
+		"  -geometrycache  : Save the ray-trace acceleration structure and transfer\n"
+		"                    lists to <mapname>.rtc, and reuse them on later runs if\n"
+		"                    the geometry, patches and vis haven't changed.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
+		"  -threadstats    : Print thread scheduler stats (idle time, steals, imbalance)\n"
+		"                    after each threaded stage.\n"
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
 		"                    level lights file.\n"
 		"  -noextra        : Disable supersampling.\n"
 		"  -debugextra     : Places debugging data in lightmaps to visualize\n"
 		"                    supersampling.\n"
+		"  -extraerror #   : Stop supersampling a luxel once the estimated error of its\n"
+		"                    intensity is below this (default 0.004, about one step\n"
+		"                    of an 8 bit lightmap). 0 always takes every supersample.\n"
+		"  -lightcull #    : Also skip lights on faces where they're dimmer than this\n"
+		"                    (linear, 1 = white, default 0). Faster with many lights, but\n"
+		"                    drops their faint tails. Lights that can't reach a face\n"
+		"                    at all are always skipped.\n"
 		"  -smooth #       : Set the threshold for smoothing groups, in degrees\n"
 		"                    (default 45).\n"
 		"  -dlightmap      : Force direct lighting into different lightmap than\n"
 		"                    radiosity.\n"
+		"  -lightmappacker <wavefront|skyline|maxrects>: Pack the lightmaps into\n"
+		"                    512x256 atlas pages with this heuristic and print how\n"
+		"                    many pages it takes and how full they are.\n"
+		"  -benchstats <file>: Write the time, cpu time and peak memory of each stage,\n"
+		"                    and the number of rays traced, to <file> as JSON.\n"
 		"  -stoponexit	   : Wait for a keypress on exit.\n"
 		"  -mpi_pw <pw>    : Use a password to choose a specific set of VMPI workers.\n"
 		"  -nodetaillight  : Don't light detail props.\n"
@@ -24,9 +24,9 @@
 #include "polylib.h"
 #include "threads.h"
 #include "builddisp.h"
-#include "VRAD_DispColl.h"
-#include "UtlMemory.h"
-#include "UtlHash.h"
+#include "vrad_dispcoll.h"
+#include "utlmemory.h"
+#include "utlhash.h"
 #include "utlvector.h"
 #include "iincremental.h"
 #include "raytrace.h"
@@ -39,12 +39,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifdef _WIN32
 #pragma warning(disable: 4142 4028)
 #include <io.h>
 #pragma warning(default: 4142 4028)
+#endif
 
 #include <fcntl.h>
+#ifdef _WIN32
 #include <direct.h>
+#endif
 #include <ctype.h>
 
 
@@ -113,6 +117,16 @@ struct transfer_t
 };
 
 
+// Patches store their transfers compressed, as a stream of 16-bit words sorted by patch index.
+// Each transfer is the delta from the previous patch index followed by the form factor. Deltas
+// that don't fit are written as TRANSFER_INDEX_ESCAPE and then the full index in two words.
+// Form factors are relative to the patch's transferscale, and keep 5 bits of the float
+// exponent and the top 11 bits of the mantissa, so they cover 2^-31 to 1 at about 3 digits.
+#define TRANSFER_INDEX_ESCAPE		0xFFFF
+#define TRANSFER_FORMFACTOR_BIAS	0x30000000		// float bits of 2^-31
+#define TRANSFER_FORMFACTOR_SHIFT	12
+
+
 struct LightingValue_t
 {
 	Vector m_vecLighting;
@@ -237,13 +251,53 @@ struct CPatch
 //	struct		patch_s		*nextclusterchild;		// next terminal child in cluster
 
 	int			numtransfers;
-	transfer_t	*transfers;
+	int			numtransferwords;		// size of the compressed transfers
+	float		transferscale;			// largest form factor in transfers
+	unsigned short *transfers;
 
 	short		indices[3];				// displacement use these for subdivision
 };
 
 
 extern CUtlVector<CPatch>	g_Patches;
+
+
+//-----------------------------------------------------------------------------
+// Reads back a patch's compressed transfer list, in order.
+//-----------------------------------------------------------------------------
+class CTransferReader
+{
+public:
+	CTransferReader( CPatch const *pPatch )
+	{
+		m_pData = pPatch->transfers;
+		m_nPatch = 0;
+		m_flScale = pPatch->transferscale;
+	}
+
+	FORCEINLINE void Next( int &nPatch, float &flTransfer )
+	{
+		unsigned short nDelta = *m_pData++;
+		if ( nDelta == TRANSFER_INDEX_ESCAPE )
+		{
+			m_nPatch = m_pData[0] | ( m_pData[1] << 16 );
+			m_pData += 2;
+		}
+		else
+		{
+			m_nPatch += nDelta;
+		}
+
+		uint32 nBits = ( (uint32)*m_pData++ << TRANSFER_FORMFACTOR_SHIFT ) + TRANSFER_FORMFACTOR_BIAS;
+		flTransfer = *(float *)&nBits * m_flScale;
+		nPatch = m_nPatch;
+	}
+
+private:
+	unsigned short const *m_pData;
+	int m_nPatch;
+	float m_flScale;
+};
 extern CUtlVector<int>		g_FacePatches;		// constains all patches, children first
 extern CUtlVector<int>		faceParents;		// contains only root patches, use next parent to iterate
 extern CUtlVector<int>		clusterChildren;
@@ -275,6 +329,7 @@ extern bool			bRed2Black;
 extern bool         g_bNoSkyRecurse;
 extern bool			bDumpNormals;
 extern bool			g_bFastAmbient;
+extern bool			g_bAdaptiveAmbient;
 extern float		maxchop;
 extern FileHandle_t	pFileSamples[4][4];
 extern qboolean		g_bLowPriority;
@@ -320,6 +375,7 @@ extern  qboolean do_extra;
 extern  qboolean do_fast;
 extern  qboolean do_centersamples;
 extern  int extrapasses;
+extern  float g_flSupersampleMaxError;
 extern	Vector ambient;
 extern  float maxlight;
 extern	unsigned numbounce;
@@ -360,7 +416,9 @@ qboolean IsIncremental(char *filename);
 int SaveIncremental(char *filename);
 int PartialHead (void);
 void BuildFacelights (int facenum, int threadnum);
+void PrintSupersampleStats();
 void PrecompLightmapOffsets();
+void ReportLightmapPacking();
 void FinalLightFace (int threadnum, int facenum);
 void PvsForOrigin (Vector& org, byte *pvs);
 void ConvertRGBExp32ToRGBA8888( const ColorRGBExp32 *pSrc, unsigned char *pDst );
@@ -386,6 +444,12 @@ void TestLine( FourVectors const& start, FourVectors const& stop, fltx4 *pFracti
 void TestLine_DoesHitSky( FourVectors const& start, FourVectors const& stop,
                           fltx4 *pFractionVisible, bool canRecurse = true, int static_prop_to_skip=-1, bool bDoDebug = false );
 
+// same as TestLine and TestLine_DoesHitSky for two groups of 4 rays at once, which lets the ray
+// tracer trace all 8 together on cpus with AVX
+void TestLine8( FourVectors const start[2], FourVectors const stop[2], fltx4 pFractionVisible[2], int static_prop_index_to_ignore=-1 );
+void TestLine_DoesHitSky8( FourVectors const start[2], FourVectors const stop[2],
+                           fltx4 pFractionVisible[2], bool canRecurse = true, int static_prop_to_skip=-1 );
+
 // converts any marked brush entities to triangles for shadow casting
 void ExtractBrushEntityShadowCasters ( void );
 void AddBrushesForRayTrace ( void );
@@ -455,6 +519,13 @@ void GatherSampleLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int
 					   int nLFlags = 0,					// GATHERLFLAGS_xxx
 					   int static_prop_to_skip=-1,
 					   float flEpsilon = 0.0 );
+// GatherSampleLightSSE for two groups of 4 samples at once, so that their visibility rays can be
+// traced 8 at a time
+void GatherSampleLight8SSE( SSE_sampleLightOutput_t out[2], directlight_t *dl, int facenum, 
+						FourVectors const pos[2], FourVectors *pNormals[2], int normalCount, int iThread,
+						int nLFlags = 0,					// GATHERLFLAGS_xxx
+						int static_prop_to_skip=-1,
+						float flEpsilon = 0.0 );
 //void GatherSampleSkyLightSSE( SSE_sampleLightOutput_t &out, directlight_t *dl, int facenum, 
 //							 FourVectors const& pos, FourVectors *pNormals, int normalCount, int iThread,
 //							 int nLFlags = 0,
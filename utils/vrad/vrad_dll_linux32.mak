@@ -0,0 +1,525 @@
+NAME=vrad_dll
+SRCROOT=../..
+TARGET_PLATFORM=linux32
+TARGET_PLATFORM_EXT=
+USE_VALVE_BINDIR=0
+PWD:=$(shell pwd)
+# If no configuration is specified, "release" will be used.
+ifeq "$(CFG)" ""
+	CFG = release
+endif
+
+GCC_ExtraCompilerFlags=
+GCC_ExtraLinkerFlags=
+SymbolVisibility=hidden
+OptimizerLevel=-gdwarf-2 -g2 $(OptimizerLevel_CompilerSpecific)
+SystemLibraries=
+DLL_EXT=.so
+SYM_EXT=.dbg
+FORCEINCLUDES= 
+ifeq "$(CFG)" "debug"
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DDEBUG -D_DEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=vrad_dll -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DMPI -DPROTECTED_THINGS_DISABLE -DVRAD -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/vrad -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+else
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DNDEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=vrad_dll -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DMPI -DPROTECTED_THINGS_DISABLE -DVRAD -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/vrad -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+endif
+INCLUDEDIRS += ../../common ../../public ../../public/tier0 ../../public/tier1 ../../thirdparty/SDL2 ../common ../vmpi ../vmpi/mysql/mysqlpp/include ../vmpi/mysql/include 
+CONFTYPE=dll
+IMPORTLIBRARY=
+GAMEOUTPUTFILE=../../../game/bin/vrad_dll.so
+OUTPUTFILE=$(OBJ_DIR)/vrad_dll.so
+
+
+POSTBUILDCOMMAND=true
+
+
+
+CPPFILES= \
+    ../../public/tier0/memoverride.cpp \
+    ../../public/bsptreedata.cpp \
+    ../../public/disp_common.cpp \
+    ../../public/disp_powerinfo.cpp \
+    disp_vrad.cpp \
+    geometrycache.cpp \
+    imagepacker.cpp \
+    incremental.cpp \
+    leaf_ambient_lighting.cpp \
+    lightcull.cpp \
+    lightmap.cpp \
+    ../../public/loadcmdline.cpp \
+    ../../public/lumpfiles.cpp \
+    macro_texture.cpp \
+    ../common/mpi_stats_posix.cpp \
+    mpivrad.cpp \
+    ../common/pacifier.cpp \
+    ../common/physdll.cpp \
+    radial.cpp \
+    samplehash.cpp \
+    trace.cpp \
+    ../common/utilmatlib.cpp \
+    vismat.cpp \
+    ../common/vmpi_tools_shared.cpp \
+    vrad.cpp \
+    vrad_dispcoll.cpp \
+    vraddetailprops.cpp \
+    vraddisps.cpp \
+    vraddll.cpp \
+    vradstaticprops.cpp \
+    ../../public/zip_utils.cpp \
+    ../vmpi/messbuf.cpp \
+    ../vmpi/vmpi_distribute_work_posix.cpp \
+    ../vmpi/vmpi_filesystem_posix.cpp \
+    ../vmpi/vmpi_posix.cpp \
+    ../common/bsplib.cpp \
+    ../../public/builddisp.cpp \
+    ../../public/chunkfile.cpp \
+    ../common/cmdlib.cpp \
+    ../../public/dispcoll_common.cpp \
+    ../common/map_shared.cpp \
+    ../common/polylib.cpp \
+    ../common/scriplib.cpp \
+    ../common/threads.cpp \
+    ../common/toolstats.cpp \
+    ../common/tools_minidump.cpp \
+    ../../public/collisionutils.cpp \
+    ../../public/filesystem_helpers.cpp \
+    ../../public/scratchpad3d.cpp \
+    ../../public/ScratchPadUtils.cpp \
+
+
+LIBFILES = \
+    ../../lib/public/linux32/tier1.a \
+    ../../lib/public/linux32/bitmap.a \
+    ../../lib/public/linux32/mathlib.a \
+    ../../lib/public/linux32/raytrace.a \
+    ../../lib/public/linux32/tier2.a \
+    ../../lib/public/linux32/vtf.a \
+    -L../../lib/public/linux32 -ltier0 \
+    -L../../lib/public/linux32 -lvstdlib \
+
+
+LIBFILENAMES = \
+    ../../lib/public/linux32/bitmap.a \
+    ../../lib/public/linux32/libtier0.so \
+    ../../lib/public/linux32/libvstdlib.so \
+    ../../lib/public/linux32/mathlib.a \
+    ../../lib/public/linux32/raytrace.a \
+    ../../lib/public/linux32/tier1.a \
+    ../../lib/public/linux32/tier2.a \
+    ../../lib/public/linux32/vtf.a \
+
+
+# Include the base makefile now.
+include $(SRCROOT)/devtools/makefile_base_posix.mak
+
+
+
+OTHER_DEPENDENCIES = \
+
+
+$(OBJ_DIR)/_other_deps.P : $(OTHER_DEPENDENCIES)
+	$(GEN_OTHER_DEPS)
+
+-include $(OBJ_DIR)/_other_deps.P
+
+
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/memoverride.P
+endif
+
+$(OBJ_DIR)/memoverride.o : $(PWD)/../../public/tier0/memoverride.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/bsptreedata.P
+endif
+
+$(OBJ_DIR)/bsptreedata.o : $(PWD)/../../public/bsptreedata.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/disp_common.P
+endif
+
+$(OBJ_DIR)/disp_common.o : $(PWD)/../../public/disp_common.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/disp_powerinfo.P
+endif
+
+$(OBJ_DIR)/disp_powerinfo.o : $(PWD)/../../public/disp_powerinfo.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/disp_vrad.P
+endif
+
+$(OBJ_DIR)/disp_vrad.o : $(PWD)/disp_vrad.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/geometrycache.P
+endif
+
+$(OBJ_DIR)/geometrycache.o : $(PWD)/geometrycache.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/imagepacker.P
+endif
+
+$(OBJ_DIR)/imagepacker.o : $(PWD)/imagepacker.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/incremental.P
+endif
+
+$(OBJ_DIR)/incremental.o : $(PWD)/incremental.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/leaf_ambient_lighting.P
+endif
+
+$(OBJ_DIR)/leaf_ambient_lighting.o : $(PWD)/leaf_ambient_lighting.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/lightcull.P
+endif
+
+$(OBJ_DIR)/lightcull.o : $(PWD)/lightcull.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/lightmap.P
+endif
+
+$(OBJ_DIR)/lightmap.o : $(PWD)/lightmap.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/loadcmdline.P
+endif
+
+$(OBJ_DIR)/loadcmdline.o : $(PWD)/../../public/loadcmdline.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/lumpfiles.P
+endif
+
+$(OBJ_DIR)/lumpfiles.o : $(PWD)/../../public/lumpfiles.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/macro_texture.P
+endif
+
+$(OBJ_DIR)/macro_texture.o : $(PWD)/macro_texture.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/mpi_stats_posix.P
+endif
+
+$(OBJ_DIR)/mpi_stats_posix.o : $(PWD)/../common/mpi_stats_posix.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/mpivrad.P
+endif
+
+$(OBJ_DIR)/mpivrad.o : $(PWD)/mpivrad.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/pacifier.P
+endif
+
+$(OBJ_DIR)/pacifier.o : $(PWD)/../common/pacifier.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/physdll.P
+endif
+
+$(OBJ_DIR)/physdll.o : $(PWD)/../common/physdll.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/radial.P
+endif
+
+$(OBJ_DIR)/radial.o : $(PWD)/radial.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/samplehash.P
+endif
+
+$(OBJ_DIR)/samplehash.o : $(PWD)/samplehash.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/trace.P
+endif
+
+$(OBJ_DIR)/trace.o : $(PWD)/trace.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/utilmatlib.P
+endif
+
+$(OBJ_DIR)/utilmatlib.o : $(PWD)/../common/utilmatlib.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vismat.P
+endif
+
+$(OBJ_DIR)/vismat.o : $(PWD)/vismat.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_tools_shared.P
+endif
+
+$(OBJ_DIR)/vmpi_tools_shared.o : $(PWD)/../common/vmpi_tools_shared.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vrad.P
+endif
+
+$(OBJ_DIR)/vrad.o : $(PWD)/vrad.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vrad_dispcoll.P
+endif
+
+$(OBJ_DIR)/vrad_dispcoll.o : $(PWD)/vrad_dispcoll.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vraddetailprops.P
+endif
+
+$(OBJ_DIR)/vraddetailprops.o : $(PWD)/vraddetailprops.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vraddisps.P
+endif
+
+$(OBJ_DIR)/vraddisps.o : $(PWD)/vraddisps.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vraddll.P
+endif
+
+$(OBJ_DIR)/vraddll.o : $(PWD)/vraddll.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vradstaticprops.P
+endif
+
+$(OBJ_DIR)/vradstaticprops.o : $(PWD)/vradstaticprops.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/zip_utils.P
+endif
+
+$(OBJ_DIR)/zip_utils.o : $(PWD)/../../public/zip_utils.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/messbuf.P
+endif
+
+$(OBJ_DIR)/messbuf.o : $(PWD)/../vmpi/messbuf.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_distribute_work_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_distribute_work_posix.o : $(PWD)/../vmpi/vmpi_distribute_work_posix.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_filesystem_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_filesystem_posix.o : $(PWD)/../vmpi/vmpi_filesystem_posix.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_posix.o : $(PWD)/../vmpi/vmpi_posix.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/bsplib.P
+endif
+
+$(OBJ_DIR)/bsplib.o : $(PWD)/../common/bsplib.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/builddisp.P
+endif
+
+$(OBJ_DIR)/builddisp.o : $(PWD)/../../public/builddisp.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/chunkfile.P
+endif
+
+$(OBJ_DIR)/chunkfile.o : $(PWD)/../../public/chunkfile.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/cmdlib.P
+endif
+
+$(OBJ_DIR)/cmdlib.o : $(PWD)/../common/cmdlib.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/dispcoll_common.P
+endif
+
+$(OBJ_DIR)/dispcoll_common.o : $(PWD)/../../public/dispcoll_common.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/map_shared.P
+endif
+
+$(OBJ_DIR)/map_shared.o : $(PWD)/../common/map_shared.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/polylib.P
+endif
+
+$(OBJ_DIR)/polylib.o : $(PWD)/../common/polylib.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/scriplib.P
+endif
+
+$(OBJ_DIR)/scriplib.o : $(PWD)/../common/scriplib.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/threads.P
+endif
+
+$(OBJ_DIR)/threads.o : $(PWD)/../common/threads.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/toolstats.P
+endif
+
+$(OBJ_DIR)/toolstats.o : $(PWD)/../common/toolstats.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/tools_minidump.P
+endif
+
+$(OBJ_DIR)/tools_minidump.o : $(PWD)/../common/tools_minidump.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/collisionutils.P
+endif
+
+$(OBJ_DIR)/collisionutils.o : $(PWD)/../../public/collisionutils.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/filesystem_helpers.P
+endif
+
+$(OBJ_DIR)/filesystem_helpers.o : $(PWD)/../../public/filesystem_helpers.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/scratchpad3d.P
+endif
+
+$(OBJ_DIR)/scratchpad3d.o : $(PWD)/../../public/scratchpad3d.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/ScratchPadUtils.P
+endif
+
+$(OBJ_DIR)/ScratchPadUtils.o : $(PWD)/../../public/ScratchPadUtils.cpp $(PWD)/vrad_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
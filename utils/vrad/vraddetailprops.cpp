@@ -10,11 +10,11 @@
 //=============================================================================//
 
 #include "vrad.h"
-#include "Bsplib.h"
-#include "GameBSPFile.h"
-#include "UtlBuffer.h"
+#include "bsplib.h"
+#include "gamebspfile.h"
+#include "utlbuffer.h"
 #include "utlvector.h"
-#include "CModel.h"
+#include "cmodel.h"
 #include "studio.h"
 #include "pacifier.h"
 #include "vraddetailprops.h"
@@ -578,6 +578,15 @@ bool CastRayInLeaf( int iThread, const Vector &start, const Vector &end, int lea
 // Ray represents a cone, tanTheta is the tan of the inner cone angle
 //-----------------------------------------------------------------------------
 void CalcRayAmbientLighting( int iThread, const Vector &vStart, const Vector &vEnd, float tanTheta, Vector color[MAX_LIGHTSTYLES] )
+{
+	CalcRayAmbientLightingInSegment( iThread, vStart, vEnd, 0.0f, tanTheta, color );
+}
+
+//-----------------------------------------------------------------------------
+// Same as CalcRayAmbientLighting, but only looks for a surface between vStart and
+// vEnd, which is flStartDist along the cone. Returns false if there isn't one.
+//-----------------------------------------------------------------------------
+bool CalcRayAmbientLightingInSegment( int iThread, const Vector &vStart, const Vector &vEnd, float flStartDist, float tanTheta, Vector color[MAX_LIGHTSTYLES] )
 {
 	Ray_t ray;
 	ray.Init( vStart, vEnd, vec3_origin, vec3_origin );
@@ -586,10 +595,10 @@ void CalcRayAmbientLighting( int iThread, const Vector &vStart, const Vector &vE
 
 	CLightSurface surfEnum(iThread);
 	if (!surfEnum.FindIntersection( ray ))
-		return;
+		return false;
 
 	// compute the approximate radius of a circle centered around the intersection point
-	float dist = ray.m_Delta.Length() * tanTheta * surfEnum.m_HitFrac;
+	float dist = flStartDist * tanTheta + ray.m_Delta.Length() * tanTheta * surfEnum.m_HitFrac;
 
 	// until 20" we use the point sample, then blend in the average until we're covering 40"
 	// This is attempting to model the ray as a cone - in the ideal case we'd simply sample all
@@ -615,6 +624,7 @@ void CalcRayAmbientLighting( int iThread, const Vector &vStart, const Vector &vE
 	{
 		ComputeLightmapColorPointSample( surfEnum.m_pSurface, pSkyLight, surfEnum.m_LuxelCoord, scaleSample, color );
 	}
+	return true;
 }
 
 //-----------------------------------------------------------------------------
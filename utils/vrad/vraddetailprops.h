@@ -26,6 +26,17 @@ void CalcRayAmbientLighting(
 	Vector color[MAX_LIGHTSTYLES]	// The color contribution from each lightstyle.
 	);
 
+// Same as CalcRayAmbientLighting, but only looks for a surface between vStart and vEnd,
+// which is flStartDist along the cone. Returns false if there isn't one there.
+bool CalcRayAmbientLightingInSegment(
+	int iThread,
+	const Vector &vStart,
+	const Vector &vEnd,
+	float flStartDist,		// distance from the cone's apex to vStart
+	float tanTheta,
+	Vector color[MAX_LIGHTSTYLES]
+	);
+
 bool CastRayInLeaf( int iThread, const Vector &start, const Vector &end, int leafIndex, float *pFraction, Vector *pNormal );
 
 void ComputeDetailPropLighting( int iThread );
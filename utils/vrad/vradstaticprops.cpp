@@ -11,16 +11,16 @@
 
 #include "vrad.h"
 #include "mathlib/vector.h"
-#include "UtlBuffer.h"
+#include "utlbuffer.h"
 #include "utlvector.h"
-#include "GameBSPFile.h"
-#include "BSPTreeData.h"
-#include "VPhysics_Interface.h"
-#include "Studio.h"
-#include "Optimize.h"
-#include "Bsplib.h"
-#include "CModel.h"
-#include "PhysDll.h"
+#include "gamebspfile.h"
+#include "bsptreedata.h"
+#include "vphysics_interface.h"
+#include "studio.h"
+#include "optimize.h"
+#include "bsplib.h"
+#include "cmodel.h"
+#include "physdll.h"
 #include "phyfile.h"
 #include "collisionutils.h"
 #include "tier1/KeyValues.h"
@@ -40,6 +40,10 @@
 
 #define ALIGN_TO_POW2(x,y) (((x)+(y-1))&~(y-1))
 
+// Props with more vertices than this are lit in several pieces so that
+// big props are spread across threads and workers.
+#define MAX_STATIC_PROP_WORKUNIT_VERTS	1024
+
 // identifies a vertex embedded in solid
 // lighting will be copied from nearest valid neighbor
 struct badVertex_t
@@ -97,14 +101,14 @@ public:
 
 private:
 	// VMPI stuff.
-	static void VMPI_ProcessStaticProp_Static( int iThread, uint64 iStaticProp, MessageBuffer *pBuf );
-	static void VMPI_ReceiveStaticPropResults_Static( uint64 iStaticProp, MessageBuffer *pBuf, int iWorker );
-	void VMPI_ProcessStaticProp( int iThread, int iStaticProp, MessageBuffer *pBuf );
-	void VMPI_ReceiveStaticPropResults( int iStaticProp, MessageBuffer *pBuf, int iWorker );
+	static void VMPI_ProcessStaticProp_Static( int iThread, uint64 iWorkUnit, MessageBuffer *pBuf );
+	static void VMPI_ReceiveStaticPropResults_Static( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker );
+	void VMPI_ProcessStaticProp( int iThread, int iWorkUnit, MessageBuffer *pBuf );
+	void VMPI_ReceiveStaticPropResults( int iWorkUnit, MessageBuffer *pBuf, int iWorker );
 	
 	// local thread version
 	static void ThreadComputeStaticPropLighting( int iThread, void *pUserData );
-	void ComputeLightingForProp( int iThread, int iStaticProp );
+	void ComputeLightingForWorkUnit( int iThread, int iWorkUnit );
 
 	// Methods associated with unserializing static props
 	void UnserializeModelDict( CUtlBuffer& buf );
@@ -156,13 +160,36 @@ private:
 		Ray_t const* m_pRay;
 	};
 
+	// A range of vertices in one of a static prop's models
+	struct StaticPropWorkUnit_t
+	{
+		int						m_nProp;
+		int						m_nBodyPart;
+		int						m_nModel;
+		int						m_nColorVertsArray;	// index into the prop's CComputeStaticPropLightingResults
+		int						m_nFirstVertex;
+		int						m_nVertexCount;
+	};
+
 	// The list of all static props
 	CUtlVector <StaticPropDict_t>	m_StaticPropDict;
 	CUtlVector <CStaticProp>		m_StaticProps;
 
 	bool m_bIgnoreStaticPropTrace;
 
-	void ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults );
+	// Lighting work units, and the results of the props they belong to as they come in
+	CUtlVector <StaticPropWorkUnit_t>	m_LightingWorkUnits;
+	CUtlVector <bool>				m_LightingWorkUnitDone;
+	CUtlVector <CComputeStaticPropLightingResults*>	m_LightingResults;
+	CUtlVector <int>				m_LightingWorkUnitsLeft;
+	CThreadFastMutex				m_LightingResultsMutex;
+
+	bool CanComputeLighting( const CStaticProp &prop );
+	static int __cdecl LightingWorkUnitCompare( const StaticPropWorkUnit_t *pLeft, const StaticPropWorkUnit_t *pRight );
+	void BuildLightingWorkUnits();
+	CComputeStaticPropLightingResults *AllocateLightingResults( const CStaticProp &prop );
+	void ComputeLighting( const StaticPropWorkUnit_t &workUnit, int iThread, colorVertex_t *pColorVerts );
+	void FinishLightingWorkUnit( int iWorkUnit, const colorVertex_t *pColorVerts );
 	void ApplyLightingToStaticProp( CStaticProp &prop, const CComputeStaticPropLightingResults *pResults );
 
 	void SerializeLighting();
@@ -1025,6 +1052,157 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Finds the lights that can reach a group of vertices: unstyled lights that see
+// one of the vertex clusters, and that can reach the vertex bounds at all.
+//-----------------------------------------------------------------------------
+static void CullLightsForVertices( const CUtlVector<int> &clusters, const Vector &mins, const Vector &maxs, CUtlVector<directlight_t*> &lights )
+{
+	// vertices get pushed up to 4 units towards each light, and the SSE code
+	// only estimates distances, so leave some slack
+	Vector vecSlack( 8.0f, 8.0f, 8.0f );
+	Vector vecMins = mins - vecSlack;
+	Vector vecMaxs = maxs + vecSlack;
+
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		if ( dl->light.style )
+		{
+			// skip lights with style
+			continue;
+		}
+
+		bool bVisible = false;
+		for ( int i = 0; i < clusters.Count() && !bVisible; i++ )
+		{
+			bVisible = PVSCheck( dl->pvs, clusters[i] ) != 0;
+		}
+
+		if ( !bVisible )
+			continue;
+
+		// only lights with a real position can be culled by distance
+		if ( dl->facenum != -1 || dl->light.type == emit_skylight || dl->light.type == emit_skyambient )
+		{
+			lights.AddToTail( dl );
+			continue;
+		}
+
+		// hard falloff lights are zero past their end fade distance
+		if ( dl->m_flEndFadeDistance > dl->m_flStartFadeDistance )
+		{
+			float flMaxDist = dl->m_flEndFadeDistance * 1.01f;
+			if ( CalcSqrDistanceToAABB( vecMins, vecMaxs, dl->light.origin ) > flMaxDist * flMaxDist )
+				continue;
+		}
+
+		// surface lights don't light anything behind them
+		if ( dl->light.type == emit_surface )
+		{
+			Vector vecFront;
+			for ( int j = 0; j < 3; j++ )
+			{
+				vecFront[j] = ( dl->light.normal[j] >= 0.0f ) ? vecMaxs[j] : vecMins[j];
+			}
+
+			if ( DotProduct( vecFront - dl->light.origin, dl->light.normal ) < 0.0f )
+				continue;
+		}
+
+		lights.AddToTail( dl );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Direct lighting for up to 8 vertices at once, from lights already culled for
+// them. Same as calling ComputeDirectLightingAtPoint on each vertex.
+//-----------------------------------------------------------------------------
+static void ComputeDirectLightingAt8Points( const FourVectors positions[2], FourVectors normals[2], const int *pClusters, int nPoints,
+										   const CUtlVector<directlight_t*> &lights, FourVectors outColor[2], int iThread,
+										   int static_prop_id_to_skip, int nLFlags )
+{
+	SSE_sampleLightOutput_t out[2];
+	FourVectors adjusted_pos[2];
+	FourVectors *pNormals[2] = { &normals[0], &normals[1] };
+	int nGroups = ( nPoints > 4 ) ? 2 : 1;
+
+	outColor[0].DuplicateVector( vec3_origin );
+	outColor[1].DuplicateVector( vec3_origin );
+
+	for ( int i = 0; i < lights.Count(); i++ )
+	{
+		directlight_t *dl = lights[i];
+
+		// is this lights cluster visible?
+		fltx4 pvsMask[2] = { Four_Zeros, Four_Zeros };
+		bool bVisible[2] = { false, false };
+		for ( int nPoint = 0; nPoint < nPoints; nPoint++ )
+		{
+			if ( PVSCheck( dl->pvs, pClusters[nPoint] ) )
+			{
+				pvsMask[nPoint >> 2] = SetComponentSIMD( pvsMask[nPoint >> 2], nPoint & 3, 1.0f );
+				bVisible[nPoint >> 2] = true;
+			}
+		}
+
+		// push the vertexes towards the light to avoid surface acne
+		for ( int g = 0; g < nGroups; g++ )
+		{
+			FourVectors fudge;
+			if ( dl->light.type == emit_skyambient )
+			{
+				// push out along normal
+				fudge = normals[g];
+			}
+			else if ( dl->light.type == emit_skylight )
+			{
+				fudge.DuplicateVector( -dl->light.normal );
+			}
+			else
+			{
+				fudge.DuplicateVector( dl->light.origin );
+				fudge -= positions[g];
+
+				// a vertex right on the light stays put instead of going to NaN
+				fltx4 flLength2 = MaxSIMD( fudge.length2(), ReplicateX4( 1.0e-12f ) );
+				fudge *= ReciprocalSqrtSIMD( flLength2 );
+			}
+			fudge *= 4.0f;
+
+			adjusted_pos[g] = positions[g];
+			adjusted_pos[g] += fudge;
+		}
+
+		if ( bVisible[0] && bVisible[1] )
+		{
+			GatherSampleLight8SSE( out, dl, -1, adjusted_pos, pNormals, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
+								   static_prop_id_to_skip, 0.0f );
+		}
+		else
+		{
+			for ( int g = 0; g < nGroups; g++ )
+			{
+				if ( bVisible[g] )
+				{
+					GatherSampleLightSSE( out[g], dl, -1, adjusted_pos[g], pNormals[g], 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
+										  static_prop_id_to_skip, 0.0f );
+				}
+			}
+		}
+
+		for ( int g = 0; g < nGroups; g++ )
+		{
+			if ( !bVisible[g] )
+				continue;
+
+			FourVectors contribution;
+			contribution.DuplicateVector( dl->light.intensity );
+			contribution *= MulSIMD( MulSIMD( out[g].m_flFalloff, out[g].m_flDot[0] ), pvsMask[g] );
+			outColor[g] += contribution;
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Takes the results from a ComputeLighting call and applies it to the static prop in question.
 //-----------------------------------------------------------------------------
@@ -1082,183 +1260,378 @@ void CVradStaticPropMgr::ApplyLightingToStaticProp( CStaticProp &prop, const CCo
 }
 
 //-----------------------------------------------------------------------------
-// Trace rays from each unique vertex, accumulating direct and indirect
-// sources at each ray termination. Use the winding data to distribute the unique vertexes
-// into the rendering layout.
+// Props without a model or with per vertex lighting turned off get no lighting;
+// the game falls back to fullbright for them.
 //-----------------------------------------------------------------------------
-void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults )
+bool CVradStaticPropMgr::CanComputeLighting( const CStaticProp &prop )
 {
-	CUtlVector<badVertex_t>		badVerts;
+	const StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
+	if ( !dict.m_pStudioHdr || !dict.m_VtxBuf.Base() )
+		return false;
 
-	StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
-	studiohdr_t	*pStudioHdr = dict.m_pStudioHdr;
-	OptimizedModel::FileHeader_t *pVtxHdr = (OptimizedModel::FileHeader_t *)dict.m_VtxBuf.Base();
-	if ( !pStudioHdr || !pVtxHdr )
+	return ( prop.m_Flags & STATIC_PROP_NO_PER_VERTEX_LIGHTING ) == 0;
+}
+
+//-----------------------------------------------------------------------------
+// Splits the props up into work units. The master and workers all build the
+// same list.
+//-----------------------------------------------------------------------------
+int __cdecl CVradStaticPropMgr::LightingWorkUnitCompare( const StaticPropWorkUnit_t *pLeft, const StaticPropWorkUnit_t *pRight )
+{
+	// biggest pieces first so the threads finish together, then in prop order
+	if ( pLeft->m_nVertexCount != pRight->m_nVertexCount )
+		return pRight->m_nVertexCount - pLeft->m_nVertexCount;
+
+	if ( pLeft->m_nProp != pRight->m_nProp )
+		return pLeft->m_nProp - pRight->m_nProp;
+
+	if ( pLeft->m_nColorVertsArray != pRight->m_nColorVertsArray )
+		return pLeft->m_nColorVertsArray - pRight->m_nColorVertsArray;
+
+	return pLeft->m_nFirstVertex - pRight->m_nFirstVertex;
+}
+
+void CVradStaticPropMgr::BuildLightingWorkUnits()
+{
+	m_LightingWorkUnits.RemoveAll();
+	m_LightingResults.SetCount( m_StaticProps.Count() );
+	m_LightingWorkUnitsLeft.SetCount( m_StaticProps.Count() );
+
+	for ( int i = 0; i < m_StaticProps.Count(); i++ )
 	{
-		// must have model and its verts for lighting computation
-		// game will fallback to fullbright
-		return;
+		m_LightingResults[i] = NULL;
+		m_LightingWorkUnitsLeft[i] = 0;
+
+		if ( !CanComputeLighting( m_StaticProps[i] ) )
+			continue;
+
+		studiohdr_t	*pStudioHdr = m_StaticPropDict[m_StaticProps[i].m_ModelIdx].m_pStudioHdr;
+		int nColorVertsArray = 0;
+		for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
+		{
+			mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
+
+			for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID, ++nColorVertsArray )
+			{
+				mstudiomodel_t *pStudioModel = pBodyPart->pModel( modelID );
+
+				for ( int nFirstVertex = 0; nFirstVertex < pStudioModel->numvertices; nFirstVertex += MAX_STATIC_PROP_WORKUNIT_VERTS )
+				{
+					StaticPropWorkUnit_t &workUnit = m_LightingWorkUnits[m_LightingWorkUnits.AddToTail()];
+					workUnit.m_nProp = i;
+					workUnit.m_nBodyPart = bodyID;
+					workUnit.m_nModel = modelID;
+					workUnit.m_nColorVertsArray = nColorVertsArray;
+					workUnit.m_nFirstVertex = nFirstVertex;
+					workUnit.m_nVertexCount = MIN( pStudioModel->numvertices - nFirstVertex, MAX_STATIC_PROP_WORKUNIT_VERTS );
+					m_LightingWorkUnitsLeft[i]++;
+				}
+			}
+		}
+
+		if ( !m_LightingWorkUnitsLeft[i] && ( !g_bUseMPI || g_bMPIMaster ) )
+		{
+			// nothing to light, but the prop still gets its empty meshes
+			CComputeStaticPropLightingResults *pResults = AllocateLightingResults( m_StaticProps[i] );
+			ApplyLightingToStaticProp( m_StaticProps[i], pResults );
+			delete pResults;
+		}
 	}
 
-	if (prop.m_Flags & STATIC_PROP_NO_PER_VERTEX_LIGHTING )
-		return;
+	m_LightingWorkUnits.Sort( LightingWorkUnitCompare );
 
-	VMPI_SetCurrentStage( "ComputeLighting" );
-	
+	m_LightingWorkUnitDone.SetCount( m_LightingWorkUnits.Count() );
+	for ( int i = 0; i < m_LightingWorkUnitDone.Count(); i++ )
+	{
+		m_LightingWorkUnitDone[i] = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Makes the per model vertex color lists for a prop.
+//-----------------------------------------------------------------------------
+CComputeStaticPropLightingResults *CVradStaticPropMgr::AllocateLightingResults( const CStaticProp &prop )
+{
+	CComputeStaticPropLightingResults *pResults = new CComputeStaticPropLightingResults;
+
+	studiohdr_t	*pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
 	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
 	{
 		mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
 
 		for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID )
 		{
-			mstudiomodel_t *pStudioModel = pBodyPart->pModel( modelID );
-
-			// light all unique vertexes
 			CUtlVector<colorVertex_t> *pColorVertsArray = new CUtlVector<colorVertex_t>;
 			pResults->m_ColorVertsArrays.AddToTail( pColorVertsArray );
-			
-			CUtlVector<colorVertex_t> &colorVerts = *pColorVertsArray; 
-			colorVerts.EnsureCount( pStudioModel->numvertices );
-			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof(colorVertex_t) );
 
-			int numVertexes = 0;
-			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
-			{
-				mstudiomesh_t *pStudioMesh = pStudioModel->pMesh( meshID );
-				const mstudio_meshvertexdata_t *vertData = pStudioMesh->GetVertexData((void *)pStudioHdr);
-				Assert( vertData ); // This can only return NULL on X360 for now
-				for ( int vertexID = 0; vertexID < pStudioMesh->numvertices; ++vertexID )
-				{
-					Vector sampleNormal;
-					Vector samplePosition;
-					// transform position and normal into world coordinate system
-					matrix3x4_t	matrix;
-					AngleMatrix( prop.m_Angles, prop.m_Origin, matrix );
-					VectorTransform( *vertData->Position( vertexID ), matrix, samplePosition );
-					AngleMatrix( prop.m_Angles, matrix );
-					VectorTransform( *vertData->Normal( vertexID ), matrix, sampleNormal );
-
-					if ( PositionInSolid( samplePosition ) )
-					{
-						// vertex is in solid, add to the bad list, and recover later
-						badVertex_t badVertex;
-						badVertex.m_ColorVertex = numVertexes;
-						badVertex.m_Position = samplePosition;
-						badVertex.m_Normal = sampleNormal;
-						badVerts.AddToTail( badVertex );			
-					}
-					else
-					{
-						Vector direct_pos=samplePosition;
-						int skip_prop = -1;
-						if ( g_bDisablePropSelfShadowing || ( prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING ) )
-						{
-							skip_prop = prop_index;
-						}
-							
-						int nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
+			pColorVertsArray->EnsureCount( pBodyPart->pModel( modelID )->numvertices );
+			memset( pColorVertsArray->Base(), 0, pColorVertsArray->Count() * sizeof(colorVertex_t) );
+		}
+	}
 
-						Vector directColor(0,0,0);
-						ComputeDirectLightingAtPoint( direct_pos,
-													  sampleNormal, directColor, iThread,
-													  skip_prop, nFlags );
-						Vector indirectColor(0,0,0);
+	return pResults;
+}
 
-						if (g_bShowStaticPropNormals)
-						{
-							directColor= sampleNormal;
-							directColor += Vector(1.0,1.0,1.0);
-							directColor *= 50.0;
-						}
-						else
-						{
-							if (numbounce >= 1)
-								ComputeIndirectLightingAtPoint( 
-									samplePosition, sampleNormal, 
-									indirectColor, iThread, true,
-									( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
-						}
-						
-						colorVerts[numVertexes].m_bValid = true;
-						colorVerts[numVertexes].m_Position = samplePosition;
-						VectorAdd( directColor, indirectColor, colorVerts[numVertexes].m_Color );
-					}
-					
-					numVertexes++;
-				}
+//-----------------------------------------------------------------------------
+// Trace rays from each vertex in the work unit, accumulating direct and indirect
+// sources at each ray termination. Vertices are lit 8 at a time against the
+// lights that can reach the work unit at all.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::ComputeLighting( const StaticPropWorkUnit_t &workUnit, int iThread, colorVertex_t *pColorVerts )
+{
+	CStaticProp &prop = m_StaticProps[workUnit.m_nProp];
+	studiohdr_t	*pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
+	mstudiomodel_t *pStudioModel = pStudioHdr->pBodypart( workUnit.m_nBodyPart )->pModel( workUnit.m_nModel );
+	const mstudio_modelvertexdata_t *pVertData = pStudioModel->GetVertexData( pStudioHdr );
+	Assert( pVertData ); // This can only return NULL on X360 for now
+
+	VMPI_SetCurrentStage( "ComputeLighting" );
+
+	int skip_prop = -1;
+	if ( g_bDisablePropSelfShadowing || ( prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING ) )
+	{
+		skip_prop = workUnit.m_nProp;
+	}
+	bool bIgnoreNormals = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) != 0;
+	int nFlags = bIgnoreNormals ? GATHERLFLAGS_IGNORE_NORMALS : 0;
+
+	// transform positions and normals into world coordinate system
+	matrix3x4_t	matrix;
+	AngleMatrix( prop.m_Angles, prop.m_Origin, matrix );
+
+	int nVertexes = workUnit.m_nVertexCount;
+	memset( pColorVerts, 0, nVertexes * sizeof(colorVertex_t) );
+
+	CUtlVector<Vector> normals;
+	CUtlVector<int> clusters;
+	CUtlVector<int> goodVerts;
+	CUtlVector<badVertex_t> badVerts;
+	CUtlVector<int> uniqueClusters;
+	Vector mins, maxs;
+	ClearBounds( mins, maxs );
+
+	normals.SetCount( nVertexes );
+	clusters.SetCount( nVertexes );
+	for ( int i = 0; i < nVertexes; i++ )
+	{
+		int vertexID = workUnit.m_nFirstVertex + i;
+		Vector samplePosition;
+		VectorTransform( *pVertData->Position( vertexID ), matrix, samplePosition );
+		VectorRotate( *pVertData->Normal( vertexID ), matrix, normals[i] );
+
+		dleaf_t *pLeaf = &dleafs[PointLeafnum( samplePosition )];
+		if ( pLeaf->contents & CONTENTS_SOLID )
+		{
+			// vertex is in solid, add to the bad list, and recover later
+			badVertex_t badVertex;
+			badVertex.m_ColorVertex = i;
+			badVertex.m_Position = samplePosition;
+			badVertex.m_Normal = normals[i];
+			badVerts.AddToTail( badVertex );
+			continue;
+		}
+
+		pColorVerts[i].m_bValid = true;
+		pColorVerts[i].m_Position = samplePosition;
+		clusters[i] = pLeaf->cluster;
+		goodVerts.AddToTail( i );
+
+		AddPointToBounds( samplePosition, mins, maxs );
+		if ( uniqueClusters.Find( pLeaf->cluster ) == uniqueClusters.InvalidIndex() )
+		{
+			uniqueClusters.AddToTail( pLeaf->cluster );
+		}
+	}
+
+	CUtlVector<directlight_t*> lights;
+	if ( goodVerts.Count() && !g_bShowStaticPropNormals )
+	{
+		CullLightsForVertices( uniqueClusters, mins, maxs, lights );
+	}
+
+	for ( int nBatch = 0; nBatch < goodVerts.Count(); nBatch += 8 )
+	{
+		int nPoints = MIN( goodVerts.Count() - nBatch, 8 );
+
+		// pad out the batch by repeating the last vertex
+		FourVectors positions[2];
+		FourVectors normals4[2];
+		int batchClusters[8];
+		for ( int nPoint = 0; nPoint < 8; nPoint++ )
+		{
+			int i = goodVerts[nBatch + MIN( nPoint, nPoints - 1 )];
+			positions[nPoint >> 2].X( nPoint & 3 ) = pColorVerts[i].m_Position.x;
+			positions[nPoint >> 2].Y( nPoint & 3 ) = pColorVerts[i].m_Position.y;
+			positions[nPoint >> 2].Z( nPoint & 3 ) = pColorVerts[i].m_Position.z;
+			normals4[nPoint >> 2].X( nPoint & 3 ) = normals[i].x;
+			normals4[nPoint >> 2].Y( nPoint & 3 ) = normals[i].y;
+			normals4[nPoint >> 2].Z( nPoint & 3 ) = normals[i].z;
+			batchClusters[nPoint] = clusters[i];
+		}
+
+		FourVectors directColor[2];
+		if ( !g_bShowStaticPropNormals )
+		{
+			ComputeDirectLightingAt8Points( positions, normals4, batchClusters, nPoints, lights, directColor, iThread,
+											skip_prop, nFlags );
+		}
+
+		for ( int nPoint = 0; nPoint < nPoints; nPoint++ )
+		{
+			int i = goodVerts[nBatch + nPoint];
+			Vector indirectColor( 0, 0, 0 );
+			Vector directColor2;
+
+			if ( g_bShowStaticPropNormals )
+			{
+				directColor2 = normals[i];
+				directColor2 += Vector( 1.0, 1.0, 1.0 );
+				directColor2 *= 50.0;
 			}
-			
-			// color in the bad vertexes
-			// when entire model has no lighting origin and no valid neighbors
-			// must punt, leave black coloring
-			if ( badVerts.Count() && ( prop.m_bLightingOriginValid || badVerts.Count() != numVertexes ) )
+			else
 			{
-				for ( int nBadVertex = 0; nBadVertex < badVerts.Count(); nBadVertex++ )
-				{		
-					Vector bestPosition;
-					if ( prop.m_bLightingOriginValid )
-					{
-						// use the specified lighting origin
-						VectorCopy( prop.m_LightingOrigin, bestPosition );
-					}
-					else
-					{
-						// find the closest valid neighbor
-						int best = 0;
-						float closest = FLT_MAX;
-						for ( int nColorVertex = 0; nColorVertex < numVertexes; nColorVertex++ )
-						{
-							if ( !colorVerts[nColorVertex].m_bValid )
-							{
-								// skip invalid neighbors
-								continue;
-							}
-							Vector delta;
-							VectorSubtract( colorVerts[nColorVertex].m_Position, badVerts[nBadVertex].m_Position, delta );
-							float distance = VectorLength( delta );
-							if ( distance < closest )
-							{
-								closest = distance;
-								best    = nColorVertex;
-							}
-						}
+				directColor2 = directColor[nPoint >> 2].Vec( nPoint & 3 );
+				if ( numbounce >= 1 )
+					ComputeIndirectLightingAtPoint( 
+						pColorVerts[i].m_Position, normals[i], 
+						indirectColor, iThread, true, bIgnoreNormals );
+			}
 
-						// use the best neighbor as the direction to crawl
-						VectorCopy( colorVerts[best].m_Position, bestPosition );
-					}
+			VectorAdd( directColor2, indirectColor, pColorVerts[i].m_Color );
+		}
+	}
 
-					// crawl toward best position
-					// sudivide to determine a closer valid point to the bad vertex, and re-light
-					Vector midPosition;
-					int numIterations = 20;
-					while ( --numIterations > 0 )
-					{
-						VectorAdd( bestPosition, badVerts[nBadVertex].m_Position, midPosition );
-						VectorScale( midPosition, 0.5f, midPosition );
-						if ( PositionInSolid( midPosition ) )
-							break;
-						bestPosition = midPosition;
-					}
+	if ( !badVerts.Count() )
+		return;
 
-					// re-light from better position
-					Vector directColor;
-					ComputeDirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal, directColor, iThread );
+	// the closest valid neighbor can be anywhere in the model, not just in this work unit
+	CUtlVector<Vector> validPositions;
+	if ( !prop.m_bLightingOriginValid )
+	{
+		if ( nVertexes == pStudioModel->numvertices )
+		{
+			for ( int i = 0; i < goodVerts.Count(); i++ )
+			{
+				validPositions.AddToTail( pColorVerts[goodVerts[i]].m_Position );
+			}
+		}
+		else
+		{
+			for ( int vertexID = 0; vertexID < pStudioModel->numvertices; vertexID++ )
+			{
+				Vector samplePosition;
+				VectorTransform( *pVertData->Position( vertexID ), matrix, samplePosition );
+				if ( !PositionInSolid( samplePosition ) )
+				{
+					validPositions.AddToTail( samplePosition );
+				}
+			}
+		}
+	}
 
-					Vector indirectColor;
-					ComputeIndirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal,
-													indirectColor, iThread, true );
+	// color in the bad vertexes
+	// when entire model has no lighting origin and no valid neighbors
+	// must punt, leave black coloring
+	if ( !prop.m_bLightingOriginValid && !validPositions.Count() )
+		return;
 
-					// save results, not changing valid status
-					// to ensure this offset position is not considered as a viable candidate
-					colorVerts[badVerts[nBadVertex].m_ColorVertex].m_Position = bestPosition;
-					VectorAdd( directColor, indirectColor, colorVerts[badVerts[nBadVertex].m_ColorVertex].m_Color );
+	for ( int nBadVertex = 0; nBadVertex < badVerts.Count(); nBadVertex++ )
+	{
+		Vector bestPosition;
+		if ( prop.m_bLightingOriginValid )
+		{
+			// use the specified lighting origin
+			VectorCopy( prop.m_LightingOrigin, bestPosition );
+		}
+		else
+		{
+			// find the closest valid neighbor
+			int best = 0;
+			float closest = FLT_MAX;
+			for ( int nValid = 0; nValid < validPositions.Count(); nValid++ )
+			{
+				Vector delta;
+				VectorSubtract( validPositions[nValid], badVerts[nBadVertex].m_Position, delta );
+				float distance = VectorLength( delta );
+				if ( distance < closest )
+				{
+					closest = distance;
+					best    = nValid;
 				}
 			}
-			
-			// discard bad verts
-			badVerts.Purge();
+
+			// use the best neighbor as the direction to crawl
+			VectorCopy( validPositions[best], bestPosition );
+		}
+
+		// crawl toward best position
+		// sudivide to determine a closer valid point to the bad vertex, and re-light
+		Vector midPosition;
+		int numIterations = 20;
+		while ( --numIterations > 0 )
+		{
+			VectorAdd( bestPosition, badVerts[nBadVertex].m_Position, midPosition );
+			VectorScale( midPosition, 0.5f, midPosition );
+			if ( PositionInSolid( midPosition ) )
+				break;
+			bestPosition = midPosition;
+		}
+
+		// re-light from better position
+		Vector directColor;
+		ComputeDirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal, directColor, iThread );
+
+		Vector indirectColor;
+		ComputeIndirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal,
+										indirectColor, iThread, true );
+
+		// save results, not changing valid status
+		// to ensure this offset position is not considered as a viable candidate
+		pColorVerts[badVerts[nBadVertex].m_ColorVertex].m_Position = bestPosition;
+		VectorAdd( directColor, indirectColor, pColorVerts[badVerts[nBadVertex].m_ColorVertex].m_Color );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Stores the results for a work unit. Once all of a prop's work units are in,
+// its lighting is applied.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::FinishLightingWorkUnit( int iWorkUnit, const colorVertex_t *pColorVerts )
+{
+	const StaticPropWorkUnit_t &workUnit = m_LightingWorkUnits[iWorkUnit];
+	CComputeStaticPropLightingResults *pFinishedResults = NULL;
+
+	m_LightingResultsMutex.Lock();
+
+	// with VMPI the master can get the same work unit twice
+	if ( !m_LightingWorkUnitDone[iWorkUnit] )
+	{
+		m_LightingWorkUnitDone[iWorkUnit] = true;
+
+		CComputeStaticPropLightingResults *pResults = m_LightingResults[workUnit.m_nProp];
+		if ( !pResults )
+		{
+			pResults = AllocateLightingResults( m_StaticProps[workUnit.m_nProp] );
+			m_LightingResults[workUnit.m_nProp] = pResults;
+		}
+
+		CUtlVector<colorVertex_t> &colorVerts = *pResults->m_ColorVertsArrays[workUnit.m_nColorVertsArray];
+		memcpy( &colorVerts[workUnit.m_nFirstVertex], pColorVerts, workUnit.m_nVertexCount * sizeof(colorVertex_t) );
+
+		if ( --m_LightingWorkUnitsLeft[workUnit.m_nProp] == 0 )
+		{
+			pFinishedResults = pResults;
+			m_LightingResults[workUnit.m_nProp] = NULL;
 		}
 	}
+
+	m_LightingResultsMutex.Unlock();
+
+	if ( pFinishedResults )
+	{
+		ApplyLightingToStaticProp( m_StaticProps[workUnit.m_nProp], pFinishedResults );
+		delete pFinishedResults;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -1359,74 +1732,72 @@ void CVradStaticPropMgr::SerializeLighting()
 	}
 }
 
-void CVradStaticPropMgr::VMPI_ProcessStaticProp_Static( int iThread, uint64 iStaticProp, MessageBuffer *pBuf )
+void CVradStaticPropMgr::VMPI_ProcessStaticProp_Static( int iThread, uint64 iWorkUnit, MessageBuffer *pBuf )
 {
-	g_StaticPropMgr.VMPI_ProcessStaticProp( iThread, iStaticProp, pBuf );
+	g_StaticPropMgr.VMPI_ProcessStaticProp( iThread, iWorkUnit, pBuf );
 }
 
-void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static( uint64 iStaticProp, MessageBuffer *pBuf, int iWorker )
+void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker )
 {
-	g_StaticPropMgr.VMPI_ReceiveStaticPropResults( iStaticProp, pBuf, iWorker );
+	g_StaticPropMgr.VMPI_ReceiveStaticPropResults( iWorkUnit, pBuf, iWorker );
 }
 	
 //-----------------------------------------------------------------------------
-// Called on workers to do the computation for a static prop and send
+// Called on workers to do the computation for a static prop work unit and send
 // it to the master.
 //-----------------------------------------------------------------------------
-void CVradStaticPropMgr::VMPI_ProcessStaticProp( int iThread, int iStaticProp, MessageBuffer *pBuf )
+void CVradStaticPropMgr::VMPI_ProcessStaticProp( int iThread, int iWorkUnit, MessageBuffer *pBuf )
 {
 	// Compute the lighting.
-	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
+	CUtlVector<colorVertex_t> colorVerts;
+	colorVerts.SetCount( m_LightingWorkUnits[iWorkUnit].m_nVertexCount );
+	ComputeLighting( m_LightingWorkUnits[iWorkUnit], iThread, colorVerts.Base() );
+
+	// The master lights some work units itself.
+	if ( !pBuf )
+	{
+		FinishLightingWorkUnit( iWorkUnit, colorVerts.Base() );
+		return;
+	}
 
 	VMPI_SetCurrentStage( "EncodeLightingResults" );
 	
 	// Encode the results.
-	int nLists = results.m_ColorVertsArrays.Count();
-	pBuf->write( &nLists, sizeof( nLists ) );
-	
-	for ( int i=0; i < nLists; i++ )
-	{
-		CUtlVector<colorVertex_t> &curList = *results.m_ColorVertsArrays[i];
-		int count = curList.Count();
-		pBuf->write( &count, sizeof( count ) );
-		pBuf->write( curList.Base(), curList.Count() * sizeof( colorVertex_t ) );
-	}
+	int count = colorVerts.Count();
+	pBuf->write( &count, sizeof( count ) );
+	pBuf->write( colorVerts.Base(), colorVerts.Count() * sizeof( colorVertex_t ) );
 }
 
 //-----------------------------------------------------------------------------
-// Called on the master when a worker finishes processing a static prop.
+// Called on the master when a worker finishes processing a static prop work unit.
 //-----------------------------------------------------------------------------
-void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults( int iStaticProp, MessageBuffer *pBuf, int iWorker )
+void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults( int iWorkUnit, MessageBuffer *pBuf, int iWorker )
 {
 	// Read in the results.
-	CComputeStaticPropLightingResults results;
-	
-	int nLists;
-	pBuf->read( &nLists, sizeof( nLists ) );
-	
-	for ( int i=0; i < nLists; i++ )
+	int count;
+	pBuf->read( &count, sizeof( count ) );
+	if ( count != m_LightingWorkUnits[iWorkUnit].m_nVertexCount )
 	{
-		CUtlVector<colorVertex_t> *pList = new CUtlVector<colorVertex_t>;
-		results.m_ColorVertsArrays.AddToTail( pList );
-		
-		int count;
-		pBuf->read( &count, sizeof( count ) );
-		pList->SetSize( count );
-		pBuf->read( pList->Base(), count * sizeof( colorVertex_t ) );
+		Error( "VMPI_ReceiveStaticPropResults: work unit %d has %d vertexes, worker %d sent %d",
+			iWorkUnit, m_LightingWorkUnits[iWorkUnit].m_nVertexCount, iWorker, count );
 	}
+
+	CUtlVector<colorVertex_t> colorVerts;
+	colorVerts.SetCount( count );
+	pBuf->read( colorVerts.Base(), count * sizeof( colorVertex_t ) );
 	
 	// Apply the results.
-	ApplyLightingToStaticProp( m_StaticProps[iStaticProp], &results );
+	FinishLightingWorkUnit( iWorkUnit, colorVerts.Base() );
 }
 
 
-void CVradStaticPropMgr::ComputeLightingForProp( int iThread, int iStaticProp )
+void CVradStaticPropMgr::ComputeLightingForWorkUnit( int iThread, int iWorkUnit )
 {
 	// Compute the lighting.
-	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
-	ApplyLightingToStaticProp( m_StaticProps[iStaticProp], &results );
+	CUtlVector<colorVertex_t> colorVerts;
+	colorVerts.SetCount( m_LightingWorkUnits[iWorkUnit].m_nVertexCount );
+	ComputeLighting( m_LightingWorkUnits[iWorkUnit], iThread, colorVerts.Base() );
+	FinishLightingWorkUnit( iWorkUnit, colorVerts.Base() );
 }
 
 void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, void *pUserData )
@@ -1436,8 +1807,7 @@ void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, void *pUs
 		int j = GetThreadWork ();
 		if (j == -1)
 			break;
-		CComputeStaticPropLightingResults results;
-		g_StaticPropMgr.ComputeLightingForProp( iThread, j );
+		g_StaticPropMgr.ComputeLightingForWorkUnit( iThread, j );
 	}
 }
 
@@ -1460,22 +1830,29 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 	// ensure any traces against us are ignored because we have no inherit lighting contribution
 	m_bIgnoreStaticPropTrace = true;
 
+	BuildLightingWorkUnits();
+
 	if ( g_bUseMPI )
 	{
 		// Distribute the work among the workers.
 		VMPI_SetCurrentStage( "CVradStaticPropMgr::ComputeLighting" );
 		
 		DistributeWork( 
-			count, 
+			m_LightingWorkUnits.Count(), 
 			VMPI_DISTRIBUTEWORK_PACKETID,
 			&CVradStaticPropMgr::VMPI_ProcessStaticProp_Static, 
 			&CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static );
 	}
 	else
 	{
-		RunThreadsOn(count, true, ThreadComputeStaticPropLighting);
+		RunThreadsOn(m_LightingWorkUnits.Count(), true, ThreadComputeStaticPropLighting);
 	}
 
+	m_LightingWorkUnits.Purge();
+	m_LightingWorkUnitDone.Purge();
+	m_LightingResults.PurgeAndDeleteElements();
+	m_LightingWorkUnitsLeft.Purge();
+
 	// restore default
 	m_bIgnoreStaticPropTrace = false;
 
@@ -7,6 +7,8 @@
 //=============================================================================//
 #include "vis.h"
 #include "vmpi.h"
+#include "mathlib/ssemath.h"
+#include "threads.h"
 
 int g_TraceClusterStart = -1;
 int g_TraceClusterStop = -1;
@@ -34,8 +36,17 @@ int CountBits (byte *bits, int numbits)
 	int		i;
 	int		c;
 
+	// whole bytes first
 	c = 0;
-	for (i=0 ; i<numbits ; i++)
+	for (i=0 ; i<(numbits>>3) ; i++)
+	{
+		byte b = bits[i];
+		b = (b & 0x55) + ((b >> 1) & 0x55);
+		b = (b & 0x33) + ((b >> 2) & 0x33);
+		c += (b & 0x0f) + (b >> 4);
+	}
+
+	for (i<<=3 ; i<numbits ; i++)
 		if ( CheckBit( bits, i ) )
 			c++;
 
@@ -102,6 +113,30 @@ void FreeStackWinding (winding_t *w, pstack_t *stack)
 	stack->freewindings[i] = 1;
 }
 
+/*
+==============
+WindingPlaneDists
+
+Distances of all the points of a winding from a plane, computed four points at
+a time. dists needs room for numpoints rounded up to a multiple of 4.
+==============
+*/
+static void WindingPlaneDists (winding_t const *w, plane_t const *plane, vec_t *dists)
+{
+	FourVectors normal;
+	normal.DuplicateVector (plane->normal);
+	fltx4 dist = ReplicateX4 (plane->dist);
+
+	int last = w->numpoints - 1;
+	for (int i=0 ; i<w->numpoints ; i+=4)
+	{
+		FourVectors points;
+		points.LoadAndSwizzle (w->points[i], w->points[min(i+1, last)],
+			w->points[min(i+2, last)], w->points[min(i+3, last)]);
+		StoreUnalignedSIMD (dists + i, SubSIMD (points * normal, dist));
+	}
+}
+
 /*
 ==============
 ChopWinding
@@ -126,11 +161,10 @@ winding_t	*ChopWinding (winding_t *in, pstack_t *stack, plane_t *split)
 	counts[0] = counts[1] = counts[2] = 0;
 
 // determine sides for each point
+	WindingPlaneDists (in, split, dists);
 	for (i=0 ; i<in->numpoints ; i++)
 	{
-		dot = DotProduct (in->points[i], split->normal);
-		dot -= split->dist;
-		dists[i] = dot;
+		dot = dists[i];
 		if (dot > ON_VIS_EPSILON)
 			sides[i] = SIDE_FRONT;
 		else if (dot < -ON_VIS_EPSILON)
@@ -243,6 +277,7 @@ winding_t	*ClipToSeperators (winding_t *source, winding_t *pass, winding_t *targ
 	vec_t		length;
 	int			counts[3];
 	bool		fliptest;
+	vec_t		dists[MAX_POINTS_ON_WINDING+4];
 
 // check all combinations	
 	for (i=0 ; i<source->numpoints ; i++)
@@ -284,11 +319,12 @@ winding_t	*ClipToSeperators (winding_t *source, winding_t *pass, winding_t *targ
 		//
 #if 1
 			fliptest = false;
+			WindingPlaneDists (source, &plane, dists);
 			for (k=0 ; k<source->numpoints ; k++)
 			{
 				if (k == i || k == l)
 					continue;
-				d = DotProduct (source->points[k], plane.normal) - plane.dist;
+				d = dists[k];
 				if (d < -ON_VIS_EPSILON)
 				{	// source is on the negative side, so we want all
 					// pass and target on the positive side
@@ -321,11 +357,12 @@ winding_t	*ClipToSeperators (winding_t *source, winding_t *pass, winding_t *targ
 		// this is the seperating plane
 		//
 			counts[0] = counts[1] = counts[2] = 0;
+			WindingPlaneDists (pass, &plane, dists);
 			for (k=0 ; k<pass->numpoints ; k++)
 			{
 				if (k==j)
 					continue;
-				d = DotProduct (pass->points[k], plane.normal) - plane.dist;
+				d = dists[k];
 				if (d < -ON_VIS_EPSILON)
 					break;
 				else if (d > ON_VIS_EPSILON)
@@ -467,6 +504,49 @@ void WritePortalTrace( const char *source )
 	Warning("Wrote %s!!!\n", filename);
 }
 
+/*
+==================
+MaskMightSee
+
+might = prevmight & test, 128 bits at a time. Returns true if might has any bits
+that aren't already in vis.
+==================
+*/
+static bool MaskMightSee (byte *might, byte const *prevmight, byte const *test, byte const *vis)
+{
+	fltx4 more = Four_Zeros;
+	for (int j=0 ; j<portalbytes ; j+=16)
+	{
+		fltx4 m = AndSIMD (LoadUnalignedSIMD (prevmight + j), LoadUnalignedSIMD (test + j));
+		StoreUnalignedSIMD ((float *)(might + j), m);
+		more = OrSIMD (more, AndNotSIMD (LoadUnalignedSIMD (vis + j), m));
+	}
+
+	ALIGN16 uint32 anymore[4] ALIGN16_POST;
+	StoreAlignedSIMD ((float *)anymore, more);
+	return (anymore[0] | anymore[1] | anymore[2] | anymore[3]) != 0;
+}
+
+/*
+==================
+GetStackFrame
+
+Recursion frames come from a per-thread arena rather than the C stack: the
+mightsee vectors are too big to want one on the stack per level, and reusing the
+same frames for every portal the thread flows keeps them in cache. pstack_head
+is depth 0 and lives in the threaddata_t, so depth 1 is frame 0.
+==================
+*/
+static pstack_t *GetStackFrame (threaddata_t *thread, int depth)
+{
+	CUtlVector<pstack_t *> &frames = *thread->stackframes;
+	while (frames.Count() < depth)
+	{
+		frames.AddToTail ((pstack_t *)malloc (sizeof(pstack_t)));
+	}
+	return frames[depth - 1];
+}
+
 /*
 ==================
 RecursiveLeafFlow
@@ -477,12 +557,11 @@ If src_portal is NULL, this is the originating leaf
 */
 void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 {
-	pstack_t	stack;
 	portal_t	*p;
 	plane_t		backplane;
 	leaf_t 		*leaf;
-	int			i, j;
-	long		*test, *might, *vis, more;
+	int			i;
+	byte		*test;
 	int			pnum;
 
 	// Early-out if we're a VMPI worker that's told to exit. If we don't do this here, then the
@@ -500,14 +579,13 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 
 	leaf = &leafs[leafnum];
 
+	pstack_t &stack = *GetStackFrame (thread, prevstack->depth + 1);
 	prevstack->next = &stack;
 
 	stack.next = NULL;
 	stack.leaf = leaf;
 	stack.portal = NULL;
-
-	might = (long *)stack.mightsee;
-	vis = (long *)thread->base->portalvis;
+	stack.depth = prevstack->depth + 1;
 	
 	// check all portals for flowing into other leafs	
 	for (i=0 ; i<leaf->portals.Count() ; i++)
@@ -524,19 +602,14 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		// if the portal can't see anything we haven't allready seen, skip it
 		if (p->status == stat_done)
 		{
-			test = (long *)p->portalvis;
+			test = p->portalvis;
 		}
 		else
 		{
-			test = (long *)p->portalflood;
+			test = p->portalflood;
 		}
 
-		more = 0;
-		for (j=0 ; j<portallongs ; j++)
-		{
-			might[j] = ((long *)prevstack->mightsee)[j] & test[j];
-			more |= (might[j] & ~vis[j]);
-		}
+		bool more = MaskMightSee (stack.mightsee, prevstack->mightsee, test, thread->base->portalvis);
 		
 		if ( !more && CheckBit( thread->base->portalvis, pnum ) )
 		{	// can't see anything new
@@ -624,32 +697,68 @@ PortalFlow
 generates the portalvis bit vector
 ===============
 */
+static CUtlVector<pstack_t *> g_StackFrames[MAX_TOOL_THREADS+1];
+
+// per thread so the counts don't need locks
+static int64 g_nPortalsFlowed[MAX_TOOL_THREADS+1];
+static int64 g_nFlowChains[MAX_TOOL_THREADS+1];
+
+void FreePortalFlowFrames (void)
+{
+	for ( int i = 0; i <= MAX_TOOL_THREADS; i++ )
+	{
+		for ( int j = 0; j < g_StackFrames[i].Count(); j++ )
+		{
+			free( g_StackFrames[i][j] );
+		}
+		g_StackFrames[i].Purge();
+	}
+}
+
+void GetPortalFlowStats (int64 *pPortalsFlowed, int64 *pChains)
+{
+	*pPortalsFlowed = 0;
+	*pChains = 0;
+	for ( int i = 0; i <= MAX_TOOL_THREADS; i++ )
+	{
+		*pPortalsFlowed += g_nPortalsFlowed[i];
+		*pChains += g_nFlowChains[i];
+	}
+}
+
 void PortalFlow (int iThread, int portalnum)
 {
 	threaddata_t	data;
-	int				i;
 	portal_t		*p;
 	int				c_might, c_can;
 
 	p = sorted_portals[portalnum];
+
+	// already restored from the vis cache
+	if (p->status == stat_done)
+		return;
+
 	p->status = stat_working;
 				
 	c_might = CountBits (p->portalflood, g_numportals*2);
 
 	memset (&data, 0, sizeof(data));
 	data.base = p;
+	data.stackframes = &g_StackFrames[iThread];
 	
 	data.pstack_head.portal = p;
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
-	for (i=0 ; i<portallongs ; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+	memcpy (data.pstack_head.mightsee, p->portalflood, portalbytes);
 
 	RecursiveLeafFlow (p->leaf, &data, &data.pstack_head);
 
 
 	p->status = stat_done;
 
+	g_nPortalsFlowed[iThread]++;
+	g_nFlowChains[iThread] += data.c_chains;
+
 	c_can = CountBits (p->portalvis, g_numportals*2);
 
 	qprintf ("portal:%4i  mightsee:%4i  cansee:%4i (%i chains)\n", 
@@ -6,7 +6,9 @@
 //
 //=============================================================================//
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include "vis.h"
 #include "threads.h"
 #include "stdlib.h"
@@ -20,7 +22,9 @@
 #include "threadhelpers.h"
 #include "vstdlib/random.h"
 #include "vmpi_tools_shared.h"
+#ifdef _WIN32
 #include <conio.h>
+#endif
 #include "scratchpad_helpers.h"
 
 
@@ -52,11 +56,15 @@ CCycleCount g_CPUTime;
 
 
 // This stuff is all for the multicast channel the master uses to send out the portal results.
+// The POSIX VMPI backend has no multicast sockets, so there workers only get the results
+// of the portals they flow themselves.
 ISocket *g_pPortalMCSocket = NULL;
 CIPAddr g_PortalMCAddr;
 bool g_bGotMCAddr = false;
+#ifdef _WIN32
 HANDLE g_hMCThread = NULL;
 CEvent g_MCThreadExitEvent;
+#endif
 unsigned long g_PortalMCThreadUniqueID = 0;
 int g_nMulticastPortalsReceived = 0;
 
@@ -113,6 +121,7 @@ CDispatchReg g_DistributeWorkReg( VMPI_DISTRIBUTEWORK_PACKETID, DistributeWorkDi
 
 void VMPI_DeletePortalMCSocket()
 {
+#ifdef _WIN32
 	// Stop the thread if it exists.
 	if ( g_hMCThread )
 	{
@@ -121,6 +130,7 @@ void VMPI_DeletePortalMCSocket()
 		CloseHandle( g_hMCThread );
 		g_hMCThread = NULL;
 	}
+#endif
 
 	if ( g_pPortalMCSocket )
 	{
@@ -352,6 +362,7 @@ void ReceivePortalFlow( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker )
 }
 
 
+#ifdef _WIN32
 DWORD WINAPI PortalMCThreadFn( LPVOID p )
 {
 	CUtlVector<char> data;
@@ -402,6 +413,7 @@ void MCThreadCleanupFn()
 {
 	g_MCThreadExitEvent.SetEvent();
 }
+#endif
 		
 
 // --------------------------------------------------------------------------------- //
@@ -420,6 +432,7 @@ public:
 	
 	virtual bool Update()
 	{
+#ifdef _WIN32
 		if ( kbhit() )
 		{
 			int key = toupper( getch() );
@@ -479,6 +492,7 @@ public:
 				}
 			}
 		}
+#endif
 		
 		return false;
 	}
@@ -528,6 +542,7 @@ void RunMPIPortalFlow()
 	if ( g_bMPIMaster )
 		StartPacifier("");
 
+#ifdef _WIN32
 	// Workers wait until we get the MC socket address.
 	g_PortalMCThreadUniqueID = StatsDB_GetUniqueJobID();
 	if ( g_bMPIMaster )
@@ -596,6 +611,7 @@ void RunMPIPortalFlow()
 			Error( "RunMPIPortalFlow: CreateThread failed for multicast receive thread." );
 		}			
 	}
+#endif
 
 	VMPI_SetCurrentStage( "RunMPIBasePortalFlow" );
 
@@ -611,6 +627,7 @@ void RunMPIPortalFlow()
 		);
 		
 	g_pDistributeWorkCallbacks = NULL;
+	FreePortalFlowFrames();
 
 	CheckExitedEarly();
 
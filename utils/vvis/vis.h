@@ -77,6 +77,7 @@ struct pstack_t
 	int			freewindings[3];
 
 	plane_t		portalplane;
+	int			depth;		// recursion depth, 0 for pstack_head; frame depth-1 in threaddata_t::stackframes
 };
 
 struct threaddata_t
@@ -84,6 +85,7 @@ struct threaddata_t
 	portal_t	*base;
 	int			c_chains;
 	pstack_t	pstack_head;
+	CUtlVector<pstack_t *> *stackframes;	// per-thread recursion frames, reused between portals
 };
 
 extern	int			g_numportals;
@@ -113,6 +115,10 @@ void LeafFlow (int leafnum);
 void BasePortalVis (int iThread, int portalnum);
 void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
+// Frees the recursion frames PortalFlow keeps for each thread. Call once all the portals are flowed.
+void FreePortalFlowFrames (void);
+// Portals PortalFlow has run on and the leaf chains it walked for them, over all threads.
+void GetPortalFlowStats (int64 *pPortalsFlowed, int64 *pChains);
 void WritePortalTrace( const char *source );
 
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
@@ -120,6 +126,10 @@ extern int g_TraceClusterStart, g_TraceClusterStop;
 
 int CountBits (byte *bits, int numbits);
 
+// viscache.cpp
+int LoadPortalVisCache (char const *pFilename);
+void SavePortalVisCache (char const *pFilename);
+
 #define CheckBit( bitstring, bitNumber )	( (bitstring)[ ((bitNumber) >> 3) ] & ( 1 << ( (bitNumber) & 7 ) ) )
 #define SetBit( bitstring, bitNumber )	( (bitstring)[ ((bitNumber) >> 3) ] |= ( 1 << ( (bitNumber) & 7 ) ) )
 #define ClearBit( bitstring, bitNumber )	( (bitstring)[ ((bitNumber) >> 3) ] &= ~( 1 << ( (bitNumber) & 7 ) ) )
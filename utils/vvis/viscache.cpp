@@ -0,0 +1,281 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Saves the portalvis bits from a full vis and reuses them on later
+//			runs for every portal whose flow can't have changed.
+//
+//			A portal's flow only ever looks at the portals in its portalflood,
+//			so its result is reused when its own key and the keys of everything
+//			in its flood match the previous run. A portal's key covers its
+//			winding, its plane, and the windings of the portals around the
+//			leaves on either side, so it doesn't depend on the portal numbering
+//			vbsp happened to write out.
+//
+//=============================================================================//
+#include "vis.h"
+#include "utlbuffer.h"
+#include "filesystem.h"
+
+
+#define VISCACHE_VERSION	1
+
+
+static CUtlVector<uint64>	g_PortalKeys;
+static CUtlVector<uint64>	g_FloodKeys;
+
+
+//-----------------------------------------------------------------------------
+// Hashing
+//-----------------------------------------------------------------------------
+static uint64 HashBytes( void const *pData, int nBytes, uint64 nHash )
+{
+	// FNV-1a
+	byte const *pBytes = (byte const *)pData;
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		nHash = ( nHash ^ pBytes[i] ) * 0x100000001b3ull;
+	}
+	return nHash;
+}
+
+// Scrambles a hash so that sums of hashes make good order independent set keys.
+static uint64 MixHash( uint64 nHash )
+{
+	nHash ^= nHash >> 33;
+	nHash *= 0xff51afd7ed558ccdull;
+	nHash ^= nHash >> 33;
+	nHash *= 0xc4ceb9fe1a85ec53ull;
+	nHash ^= nHash >> 33;
+	return nHash;
+}
+
+
+//-----------------------------------------------------------------------------
+// Builds g_PortalKeys and g_FloodKeys for the current portals. Needs portalflood.
+//-----------------------------------------------------------------------------
+static void ComputePortalKeys()
+{
+	int nPortals = g_numportals * 2;
+
+	CUtlVector<uint64> windingHashes;
+	CUtlVector<int> sourceLeafs;
+	windingHashes.SetCount( nPortals );
+	sourceLeafs.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		portal_t *p = &portals[i];
+		uint64 nHash = HashBytes( &p->plane, sizeof( p->plane ), 0xcbf29ce484222325ull );
+		windingHashes[i] = HashBytes( p->winding->points, p->winding->numpoints * sizeof( Vector ), nHash );
+		sourceLeafs[i] = -1;	// not in any leaf's portal list
+	}
+
+	// A leaf is identified by the portals around it.
+	CUtlVector<uint64> leafKeys;
+	leafKeys.SetCount( portalclusters );
+	for ( int i = 0; i < portalclusters; i++ )
+	{
+		uint64 nKey = 0;
+		for ( int j = 0; j < leafs[i].portals.Count(); j++ )
+		{
+			int pnum = leafs[i].portals[j] - portals;
+			nKey += MixHash( windingHashes[pnum] );
+			sourceLeafs[pnum] = i;
+		}
+		leafKeys[i] = nKey;
+	}
+
+	g_PortalKeys.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		uint64 nKey = MixHash( windingHashes[i] );
+		nKey = MixHash( nKey + ( sourceLeafs[i] >= 0 ? leafKeys[ sourceLeafs[i] ] : 0 ) );
+		nKey = MixHash( nKey + leafKeys[ portals[i].leaf ] );
+		g_PortalKeys[i] = nKey;
+	}
+
+	CUtlVector<uint64> mixedKeys;
+	mixedKeys.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		mixedKeys[i] = MixHash( g_PortalKeys[i] );
+	}
+
+	g_FloodKeys.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		uint64 nKey = 0;
+		byte const *pFlood = portals[i].portalflood;
+		for ( int nByte = 0; nByte < portalbytes; nByte++ )
+		{
+			if ( !pFlood[nByte] )
+				continue;
+			for ( int j = nByte << 3; j < ( nByte << 3 ) + 8; j++ )
+			{
+				if ( CheckBit( pFlood, j ) )
+				{
+					nKey += mixedKeys[j];
+				}
+			}
+		}
+		g_FloodKeys[i] = nKey;
+	}
+}
+
+
+struct PortalKey_t
+{
+	uint64	m_nKey;
+	int		m_nPortal;
+};
+
+static int ComparePortalKeys( const void *a, const void *b )
+{
+	uint64 nA = ( (PortalKey_t const *)a )->m_nKey;
+	uint64 nB = ( (PortalKey_t const *)b )->m_nKey;
+	return ( nA < nB ) ? -1 : ( nA > nB );
+}
+
+
+//-----------------------------------------------------------------------------
+// Marks the portals whose vis can be taken from the cache as stat_done and fills
+// in their portalvis. Returns the number of portals restored.
+//-----------------------------------------------------------------------------
+int LoadPortalVisCache( char const *pFilename )
+{
+	ComputePortalKeys();
+
+	CUtlBuffer buf;
+	if ( !g_pFileSystem->ReadFile( pFilename, NULL, buf ) )
+		return 0;
+
+	int nVersion = buf.GetInt();
+	int nOldPortals = buf.GetInt();
+	int nOldPortalBytes = buf.GetInt();
+	int nExpectedSize = 3 * sizeof( int ) + nOldPortals * ( 2 * sizeof( uint64 ) + nOldPortalBytes );
+	if ( nVersion != VISCACHE_VERSION || nOldPortals <= 0 || buf.TellMaxPut() != nExpectedSize )
+	{
+		Warning( "Ignoring out of date vis cache %s\n", pFilename );
+		return 0;
+	}
+
+	CUtlVector<uint64> oldPortalKeys, oldFloodKeys;
+	oldPortalKeys.SetCount( nOldPortals );
+	oldFloodKeys.SetCount( nOldPortals );
+	buf.Get( oldPortalKeys.Base(), nOldPortals * sizeof( uint64 ) );
+	buf.Get( oldFloodKeys.Base(), nOldPortals * sizeof( uint64 ) );
+	byte const *pOldVis = (byte const *)buf.PeekGet();
+
+	// Match the old portals to the new ones by key. Keys that aren't unique can't be matched.
+	int nPortals = g_numportals * 2;
+	CUtlVector<PortalKey_t> sortedKeys;
+	sortedKeys.SetCount( nPortals );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		sortedKeys[i].m_nKey = g_PortalKeys[i];
+		sortedKeys[i].m_nPortal = i;
+	}
+	qsort( sortedKeys.Base(), nPortals, sizeof( PortalKey_t ), ComparePortalKeys );
+
+	CUtlVector<int> oldToNew;
+	oldToNew.SetCount( nOldPortals );
+	for ( int i = 0; i < nOldPortals; i++ )
+	{
+		oldToNew[i] = -1;
+
+		int nLow = 0, nHigh = nPortals - 1;
+		while ( nLow <= nHigh )
+		{
+			int nMid = ( nLow + nHigh ) / 2;
+			if ( sortedKeys[nMid].m_nKey < oldPortalKeys[i] )
+			{
+				nLow = nMid + 1;
+			}
+			else if ( sortedKeys[nMid].m_nKey > oldPortalKeys[i] )
+			{
+				nHigh = nMid - 1;
+			}
+			else
+			{
+				bool bUnique = ( nMid == 0 || sortedKeys[nMid-1].m_nKey != oldPortalKeys[i] ) &&
+					( nMid == nPortals - 1 || sortedKeys[nMid+1].m_nKey != oldPortalKeys[i] );
+				if ( bUnique )
+				{
+					oldToNew[i] = sortedKeys[nMid].m_nPortal;
+				}
+				break;
+			}
+		}
+	}
+
+	int nRestored = 0;
+	for ( int i = 0; i < nOldPortals; i++ )
+	{
+		int n = oldToNew[i];
+		if ( n < 0 || oldFloodKeys[i] != g_FloodKeys[n] )
+			continue;
+
+		portal_t *p = &portals[n];
+		byte const *pVis = pOldVis + i * nOldPortalBytes;
+
+		// Every portal this one could see must still be around. It is, unless two portals
+		// have collided on their key, since they are all in the flood we just matched.
+		memset( p->portalvis, 0, portalbytes );
+		bool bMissing = false;
+		for ( int j = 0; j < nOldPortals && !bMissing; j++ )
+		{
+			if ( !pVis[j >> 3] )
+			{
+				j |= 7;
+				continue;
+			}
+			if ( !CheckBit( pVis, j ) )
+				continue;
+			if ( oldToNew[j] < 0 )
+			{
+				bMissing = true;
+				break;
+			}
+			SetBit( p->portalvis, oldToNew[j] );
+		}
+
+		if ( bMissing )
+		{
+			memset( p->portalvis, 0, portalbytes );
+			continue;
+		}
+
+		p->status = stat_done;
+		nRestored++;
+	}
+
+	return nRestored;
+}
+
+
+//-----------------------------------------------------------------------------
+// Writes every portal's key and portalvis. Call after PortalFlow has finished.
+//-----------------------------------------------------------------------------
+void SavePortalVisCache( char const *pFilename )
+{
+	int nPortals = g_numportals * 2;
+	if ( g_PortalKeys.Count() != nPortals )
+	{
+		ComputePortalKeys();
+	}
+
+	CUtlBuffer buf;
+	buf.EnsureCapacity( 3 * sizeof( int ) + nPortals * ( 2 * sizeof( uint64 ) + portalbytes ) );
+	buf.PutInt( VISCACHE_VERSION );
+	buf.PutInt( nPortals );
+	buf.PutInt( portalbytes );
+	buf.Put( g_PortalKeys.Base(), nPortals * sizeof( uint64 ) );
+	buf.Put( g_FloodKeys.Base(), nPortals * sizeof( uint64 ) );
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		buf.Put( portals[i].portalvis, portalbytes );
+	}
+
+	if ( !g_pFileSystem->WriteFile( pFilename, NULL, buf ) )
+	{
+		Warning( "Unable to write vis cache %s\n", pFilename );
+	}
+}
@@ -7,7 +7,9 @@
 //=============================================================================//
 // vis.c
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include "vis.h"
 #include "threads.h"
 #include "stdlib.h"
@@ -22,6 +24,7 @@
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "toolstats.h"
 
 
 int			g_numportals;
@@ -46,6 +49,8 @@ int			portalbytes, portallongs;
 
 bool		fastvis;
 bool		nosort;
+bool		g_bVisCache = false;
+char		g_VisCacheFile[1024];
 
 int			totalvis;
 
@@ -84,7 +89,8 @@ winding_t *NewWinding (int points)
 	if (points > MAX_POINTS_ON_WINDING)
 		Error ("NewWinding: %i points, max %d", points, MAX_POINTS_ON_WINDING);
 	
-	size = (int)(&((winding_t *)0)->points[points]);
+	// one spare point, since flow.cpp loads points 16 bytes at a time
+	size = (int)(&((winding_t *)0)->points[points+1]);
 	w = (winding_t*)malloc (size);
 	memset (w, 0, size);
 	
@@ -302,6 +308,14 @@ void CalcPortalVis (void)
 	}
 
 
+	// the vis cache isn't shared with VMPI workers
+	bool bVisCache = g_bVisCache && !g_bUseMPI;
+	if ( bVisCache )
+	{
+		int nRestored = LoadPortalVisCache( g_VisCacheFile );
+		Msg ("reused %i of %i portals from %s\n", nRestored, g_numportals*2, g_VisCacheFile);
+	}
+
     if (g_bUseMPI) 
 	{
  		RunMPIPortalFlow();
@@ -310,6 +324,12 @@ void CalcPortalVis (void)
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
 	}
+	FreePortalFlowFrames ();
+
+	if ( bVisCache )
+	{
+		SavePortalVisCache( g_VisCacheFile );
+	}
 }
 
 
@@ -320,6 +340,7 @@ void CalcVisTrace (void)
 	// NOTE: We only schedule the one-way portals out of the start cluster here
 	// so don't run g_numportals*2 in this case
 	RunThreadsOnIndividual (g_numportals, true, PortalFlow);
+	FreePortalFlowFrames ();
 }
 
 /*
@@ -331,6 +352,7 @@ void CalcVis (void)
 {
 	int		i;
 
+	ToolStats_BeginStage( "baseportalvis" );
 	if (g_bUseMPI) 
 	{
 		RunMPIBasePortalVis();
@@ -342,8 +364,11 @@ void CalcVis (void)
 
 	SortPortals ();
 
+	ToolStats_BeginStage( "portalflow" );
 	CalcPortalVis ();
 
+	ToolStats_BeginStage( "clustervis" );
+
 	//
 	// assemble the leaf vis lists by oring the portal lists
 	//
@@ -418,6 +443,7 @@ void LoadPortals (char *name)
 	{
 		// If we're using MPI, copy off the file to a temporary first. This will download the file
 		// from the MPI master, then we get to use nice functions like fscanf on it.
+#ifdef _WIN32
 		char tempPath[MAX_PATH], tempFile[MAX_PATH];
 		if ( GetTempPath( sizeof( tempPath ), tempPath ) == 0 )
 		{
@@ -428,6 +454,7 @@ void LoadPortals (char *name)
 		{
 			Error( "LoadPortals: GetTempFileName failed.\n" );
 		}
+#endif
 
 		// Read all the data from the network file into memory.
 		FileHandle_t hFile = g_pFileSystem->Open(name, "r");
@@ -440,12 +467,22 @@ void LoadPortals (char *name)
 		g_pFileSystem->Close( hFile );
 
 		// Dump it into a temp file.
+#ifdef _WIN32
 		f = fopen( tempFile, "wt" );
 		fwrite( data.Base(), 1, data.Count(), f );
 		fclose( f );
 
 		// Open the temp file up.
 		f = fopen( tempFile, "rSTD" ); // read only, sequential, temporary, delete on close
+#else
+		f = tmpfile(); // deleted on close
+		if ( !f )
+		{
+			Error( "LoadPortals: tmpfile failed.\n" );
+		}
+		fwrite( data.Base(), 1, data.Count(), f );
+		rewind( f );
+#endif
 	}
 	else
 	{
@@ -472,7 +509,8 @@ void LoadPortals (char *name)
 	leafbytes = ((portalclusters+63)&~63)>>3;
 	leaflongs = leafbytes/sizeof(long);
 	
-	portalbytes = ((g_numportals*2+63)&~63)>>3;
+	// rounded up to 128 bits so flow.cpp can mask them with SIMD ops
+	portalbytes = ((g_numportals*2+127)&~127)>>3;
 	portallongs = portalbytes/sizeof(long);
 
 // each file portal is split into two memory portals
@@ -916,6 +954,10 @@ int ParseCommandLine( int argc, char **argv )
 			numthreads = atoi (argv[i+1]);
 			i++;
 		}
+		else if (!Q_stricmp(argv[i], "-threadstats"))
+		{
+			g_bPrintThreadStats = true;
+		}
 		else if (!Q_stricmp(argv[i], "-fast"))
 		{
 			Msg ("fastvis = true\n");
@@ -942,6 +984,20 @@ int ParseCommandLine( int argc, char **argv )
 			i++;
 			Msg( "Tracing vis from cluster %d to %d\n", g_TraceClusterStart, g_TraceClusterStop );
 		}
+		else if (!Q_stricmp (argv[i],"-viscache"))
+		{
+			g_bVisCache = true;
+		}
+		else if (!Q_stricmp (argv[i],"-benchstats"))
+		{
+			// workers don't write stats. Under VMPI the master's stage times cover the
+			// whole run, but portals_flowed and flow_chains only count the master's own work.
+			if ( !g_bUseMPI || g_bMPIMaster )
+			{
+				ToolStats_Init( "vvis", argv[i+1] );
+			}
+			i++;
+		}
 		else if (!Q_stricmp (argv[i],"-nosort"))
 		{
 			Msg ("nosort = true\n");
@@ -1029,7 +1085,13 @@ void PrintUsage( int argc, char **argv )
 		"  -mpi_pw <pw>    : Use a password to choose a specific set of VMPI workers.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
+		"  -threadstats    : Print thread scheduler stats (idle time, steals, imbalance)\n"
+		"                    after each threaded stage.\n"
+		"  -benchstats <file>: Write the time, cpu time and peak memory of each stage,\n"
+		"                    and the number of portals processed, to <file> as JSON.\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -viscache       : Save each portal's vis to <mapname>.pvc and reuse it on\n"
+		"                    later runs for portals that a map edit didn't affect.\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"
@@ -1117,6 +1179,8 @@ int RunVVis( int argc, char **argv )
 	
 	ThreadSetDefault ();
 
+	ToolStats_BeginStage( "load" );
+
 	char	targetPath[1024];
 	GetPlatformMapPath( source, targetPath, 0, 1024 );
 	Msg ("reading %s\n", targetPath);
@@ -1151,6 +1215,9 @@ int RunVVis( int argc, char **argv )
 		Q_StripExtension( portalfile, portalfile, sizeof( portalfile ) );
 	}
 	strcat (portalfile, ".prt");
+
+	Q_strncpy( g_VisCacheFile, portalfile, sizeof( g_VisCacheFile ) );
+	Q_SetExtension( g_VisCacheFile, ".pvc", sizeof( g_VisCacheFile ) );
 	
 	Msg ("reading %s\n", portalfile);
 	LoadPortals (portalfile);
@@ -1159,6 +1226,8 @@ int RunVVis( int argc, char **argv )
 	if ( g_TraceClusterStart < 0 )
 	{
 		CalcVis ();
+
+		ToolStats_BeginStage( "pas" );
 		CalcPAS ();
 
 		// We need a mapping from cluster to leaves, since the PVS
@@ -1172,6 +1241,7 @@ int RunVVis( int argc, char **argv )
 		Msg ("visdatasize:%i  compressed from %i\n", visdatasize, originalvismapsize*2);
 
 		Msg ("writing %s\n", targetPath);
+		ToolStats_BeginStage( "writebsp" );
 		WriteBSPFile (targetPath);	
 	}
 	else
@@ -1194,6 +1264,19 @@ int RunVVis( int argc, char **argv )
 	GetHourMinuteSecondsString( (int)( end - start ), str, sizeof( str ) );
 	Msg( "%s elapsed\n", str );
 
+	if ( ToolStats_IsEnabled() )
+	{
+		int64 nPortalsFlowed, nChains;
+		GetPortalFlowStats( &nPortalsFlowed, &nChains );
+
+		ToolStats_SetCounter( "portals", g_numportals*2 );
+		ToolStats_SetCounter( "portals_flowed", nPortalsFlowed );
+		ToolStats_SetCounter( "flow_chains", nChains );
+		ToolStats_SetCounter( "clusters", portalclusters );
+		ToolStats_SetCounter( "visdatasize", visdatasize );
+		ToolStats_Write();
+	}
+
 	ReleasePakFileLumps();
 	DeleteCmdLine( argc, argv );
 	CmdLib_Cleanup();
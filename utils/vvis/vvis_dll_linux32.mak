@@ -0,0 +1,294 @@
+NAME=vvis_dll
+SRCROOT=../..
+TARGET_PLATFORM=linux32
+TARGET_PLATFORM_EXT=
+USE_VALVE_BINDIR=0
+PWD:=$(shell pwd)
+# If no configuration is specified, "release" will be used.
+ifeq "$(CFG)" ""
+	CFG = release
+endif
+
+GCC_ExtraCompilerFlags=
+GCC_ExtraLinkerFlags=
+SymbolVisibility=hidden
+OptimizerLevel=-gdwarf-2 -g2 $(OptimizerLevel_CompilerSpecific)
+SystemLibraries=
+DLL_EXT=.so
+SYM_EXT=.dbg
+FORCEINCLUDES= 
+ifeq "$(CFG)" "debug"
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DDEBUG -D_DEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=vvis_dll -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DMPI -DPROTECTED_THINGS_DISABLE -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/vvis -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+else
+DEFINES += -DVPC -DRAD_TELEMETRY_DISABLED -DNDEBUG -DGNUC -DPOSIX -DCOMPILER_GCC -D_DLL_EXT=.so -D_LINUX -DLINUX -DPOSIX -D_POSIX -DDLLNAME=vvis_dll -DBINK_VIDEO -DGL_GLEXT_PROTOTYPES -DDX_TO_GL_ABSTRACTION -DUSE_SDL -DDEV_BUILD -DFRAME_POINTER_OMISSION_DISABLED -D_MBCS -D_EXTERNAL_DLL_EXT=.so -DMPI -DPROTECTED_THINGS_DISABLE -DVPCGAMECAPS=VALVE -DPROJECTDIR=/home/luna/prog/lemon-project/sp/src/utils/vvis -D_DLL_EXT=.so -DSOURCE1=1 -DVPCGAME=valve -D_LINUX=1 -D_POSIX=1 -DLINUX=1 -DPOSIX=1 
+endif
+INCLUDEDIRS += ../../common ../../public ../../public/tier0 ../../public/tier1 ../../thirdparty/SDL2 ../common ../vmpi ../vmpi/mysql/include 
+CONFTYPE=dll
+IMPORTLIBRARY=
+GAMEOUTPUTFILE=../../../game/bin/vvis_dll.so
+OUTPUTFILE=$(OBJ_DIR)/vvis_dll.so
+
+
+POSTBUILDCOMMAND=true
+
+
+
+CPPFILES= \
+    ../common/bsplib.cpp \
+    ../common/cmdlib.cpp \
+    ../../public/collisionutils.cpp \
+    ../../public/filesystem_helpers.cpp \
+    flow.cpp \
+    ../../public/loadcmdline.cpp \
+    ../../public/lumpfiles.cpp \
+    ../common/mpi_stats_posix.cpp \
+    mpivis.cpp \
+    ../common/pacifier.cpp \
+    ../../public/scratchpad3d.cpp \
+    ../common/scratchpad_helpers.cpp \
+    ../common/scriplib.cpp \
+    ../common/threads.cpp \
+    ../common/toolstats.cpp \
+    ../common/tools_minidump.cpp \
+    viscache.cpp \
+    ../common/vmpi_tools_shared.cpp \
+    vvis.cpp \
+    WaterDist.cpp \
+    ../../public/zip_utils.cpp \
+    ../vmpi/messbuf.cpp \
+    ../vmpi/vmpi_distribute_work_posix.cpp \
+    ../vmpi/vmpi_filesystem_posix.cpp \
+    ../vmpi/vmpi_posix.cpp \
+
+
+LIBFILES = \
+    ../../lib/public/linux32/tier1.a \
+    ../../lib/public/linux32/mathlib.a \
+    ../../lib/public/linux32/tier2.a \
+    -L../../lib/public/linux32 -ltier0 \
+    -L../../lib/public/linux32 -lvstdlib \
+
+
+LIBFILENAMES = \
+    ../../lib/public/linux32/libtier0.so \
+    ../../lib/public/linux32/libvstdlib.so \
+    ../../lib/public/linux32/mathlib.a \
+    ../../lib/public/linux32/tier1.a \
+    ../../lib/public/linux32/tier2.a \
+
+
+# Include the base makefile now.
+include $(SRCROOT)/devtools/makefile_base_posix.mak
+
+
+
+OTHER_DEPENDENCIES = \
+
+
+$(OBJ_DIR)/_other_deps.P : $(OTHER_DEPENDENCIES)
+	$(GEN_OTHER_DEPS)
+
+-include $(OBJ_DIR)/_other_deps.P
+
+
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/bsplib.P
+endif
+
+$(OBJ_DIR)/bsplib.o : $(PWD)/../common/bsplib.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/cmdlib.P
+endif
+
+$(OBJ_DIR)/cmdlib.o : $(PWD)/../common/cmdlib.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/collisionutils.P
+endif
+
+$(OBJ_DIR)/collisionutils.o : $(PWD)/../../public/collisionutils.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/filesystem_helpers.P
+endif
+
+$(OBJ_DIR)/filesystem_helpers.o : $(PWD)/../../public/filesystem_helpers.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/flow.P
+endif
+
+$(OBJ_DIR)/flow.o : $(PWD)/flow.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/loadcmdline.P
+endif
+
+$(OBJ_DIR)/loadcmdline.o : $(PWD)/../../public/loadcmdline.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/lumpfiles.P
+endif
+
+$(OBJ_DIR)/lumpfiles.o : $(PWD)/../../public/lumpfiles.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/mpi_stats_posix.P
+endif
+
+$(OBJ_DIR)/mpi_stats_posix.o : $(PWD)/../common/mpi_stats_posix.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/mpivis.P
+endif
+
+$(OBJ_DIR)/mpivis.o : $(PWD)/mpivis.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/pacifier.P
+endif
+
+$(OBJ_DIR)/pacifier.o : $(PWD)/../common/pacifier.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/scratchpad3d.P
+endif
+
+$(OBJ_DIR)/scratchpad3d.o : $(PWD)/../../public/scratchpad3d.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/scratchpad_helpers.P
+endif
+
+$(OBJ_DIR)/scratchpad_helpers.o : $(PWD)/../common/scratchpad_helpers.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/scriplib.P
+endif
+
+$(OBJ_DIR)/scriplib.o : $(PWD)/../common/scriplib.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/threads.P
+endif
+
+$(OBJ_DIR)/threads.o : $(PWD)/../common/threads.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/toolstats.P
+endif
+
+$(OBJ_DIR)/toolstats.o : $(PWD)/../common/toolstats.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/tools_minidump.P
+endif
+
+$(OBJ_DIR)/tools_minidump.o : $(PWD)/../common/tools_minidump.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/viscache.P
+endif
+
+$(OBJ_DIR)/viscache.o : $(PWD)/viscache.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_tools_shared.P
+endif
+
+$(OBJ_DIR)/vmpi_tools_shared.o : $(PWD)/../common/vmpi_tools_shared.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vvis.P
+endif
+
+$(OBJ_DIR)/vvis.o : $(PWD)/vvis.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/WaterDist.P
+endif
+
+$(OBJ_DIR)/WaterDist.o : $(PWD)/WaterDist.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/zip_utils.P
+endif
+
+$(OBJ_DIR)/zip_utils.o : $(PWD)/../../public/zip_utils.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/messbuf.P
+endif
+
+$(OBJ_DIR)/messbuf.o : $(PWD)/../vmpi/messbuf.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_distribute_work_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_distribute_work_posix.o : $(PWD)/../vmpi/vmpi_distribute_work_posix.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_filesystem_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_filesystem_posix.o : $(PWD)/../vmpi/vmpi_filesystem_posix.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
+ifneq (clean, $(findstring clean, $(MAKECMDGOALS)))
+-include $(OBJ_DIR)/vmpi_posix.P
+endif
+
+$(OBJ_DIR)/vmpi_posix.o : $(PWD)/../vmpi/vmpi_posix.cpp $(PWD)/vvis_dll_linux32.mak $(SRCROOT)/devtools/makefile_base_posix.mak
+	$(PRE_COMPILE_FILE)
+	$(COMPILE_FILE) $(POST_COMPILE_FILE)
+
@@ -8,8 +8,12 @@
 // vvis_launcher.cpp : Defines the entry point for the console application.
 //
 
-#include "stdafx.h"
+#include "StdAfx.h"
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <dlfcn.h>
+#endif
 #include "tier1/strtools.h"
 #include "tier0/icommandline.h"
 #include "ilaunchabledll.h"
@@ -20,6 +24,7 @@ char* GetLastErrorString()
 {
 	static char err[2048];
 	
+#ifdef _WIN32
 	LPVOID lpMsgBuf;
 	FormatMessage( 
 		FORMAT_MESSAGE_ALLOCATE_BUFFER | 
@@ -37,6 +42,10 @@ char* GetLastErrorString()
 	LocalFree( lpMsgBuf );
 
 	err[ sizeof( err ) - 1 ] = 0;
+#else
+	const char *pError = dlerror();
+	Q_snprintf( err, sizeof( err ), "%s\n", pError ? pError : "" );
+#endif
 
 	return err;
 }